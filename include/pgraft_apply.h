@@ -51,6 +51,12 @@ typedef struct PgRaftKVEntry
  */
 extern int	pgraft_apply_entry_to_postgres(uint64 raft_index, const char *data, size_t len);
 
+/*
+ * Drain committed entries from the Go layer and apply them
+ * Called from the background worker loop
+ */
+extern int	pgraft_apply_committed_entries(void);
+
 /*
  * Parse Raft log entry from serialized data
  */
@@ -4,6 +4,9 @@
 #include "postgres.h"
 #include "storage/shmem.h"
 #include "storage/spin.h"
+#include "storage/condition_variable.h"
+
+#include "pgraft_kv.h"
 
 /* Worker status enum */
 typedef enum
@@ -22,11 +25,11 @@ typedef enum
 	COMMAND_ADD_NODE = 2,
 	COMMAND_REMOVE_NODE = 3,
 	COMMAND_LOG_APPEND = 4,
-	COMMAND_LOG_COMMIT = 5,
-	COMMAND_LOG_APPLY = 6,
 	COMMAND_SHUTDOWN = 7,
 	COMMAND_KV_PUT = 8,
-	COMMAND_KV_DELETE = 9
+	COMMAND_KV_DELETE = 9,
+	COMMAND_PROPOSE = 10,		/* Propose a prebuilt JSON entry (log_data) */
+	COMMAND_KV_PATCH = 11		/* Merge patch in kv_value, see kv_expected_version */
 }			COMMAND_TYPE;
 
 /* Command status enum */
@@ -41,6 +44,7 @@ typedef enum
 /* Command structure with status tracking */
 typedef struct
 {
+	uint64		command_id;		/* Unique id assigned at queue time */
 	COMMAND_TYPE type;
 	int			node_id;
 	char		address[256];
@@ -51,8 +55,11 @@ typedef struct
 	int			log_index;			/* For log operations */
 	/* KV operation fields */
 	char		kv_key[256];		/* For KV operations */
-	char		kv_value[1024];		/* For KV operations */
+	char		kv_value[PGRAFT_KV_VALUE_SIZE];	/* KV_PUT value or KV_PATCH patch, any length the store takes */
 	char		kv_client_id[64];	/* For KV operations */
+	int64_t		kv_expected_version;	/* KV_PATCH: required key version, -1 for any */
+	int32_t		term;				/* Raft term the command was queued in */
+	int32_t		group_id;			/* Raft group a KV command is proposed to */
 	/* Status tracking */
 	COMMAND_STATUS status;
 	char		error_message[512]; /* Error message if failed */
@@ -63,6 +70,49 @@ typedef struct
 #define MAX_COMMANDS 100
 #define MAX_APPLY_ENTRIES 1000
 
+/*
+ * Command priority lanes
+ *
+ * Membership changes and shutdown must never be refused or delayed behind a
+ * storm of KV writes, so each class of command gets its own queue with its
+ * own capacity.  The worker drains the lanes by weighted round robin: each
+ * refill grants a lane "weight" dequeues, lanes are visited in priority
+ * order, and credits are refilled once every non-empty lane has spent its
+ * share.
+ */
+typedef enum
+{
+	COMMAND_LANE_CONTROL = 0,	/* INIT, ADD_NODE, REMOVE_NODE, SHUTDOWN */
+	COMMAND_LANE_KV = 1,		/* KV_PUT, KV_DELETE, PROPOSE */
+	COMMAND_LANE_BULK = 2,		/* LOG_APPEND */
+	COMMAND_NUM_LANES = 3
+}			COMMAND_LANE;
+
+#define MAX_CONTROL_COMMANDS	16
+#define MAX_KV_COMMANDS			MAX_COMMANDS
+#define MAX_BULK_COMMANDS		50
+
+/* Every command the lanes can hold, one being processed, and finished ones */
+#define MAX_STATUS_COMMANDS		(MAX_CONTROL_COMMANDS + MAX_KV_COMMANDS + MAX_BULK_COMMANDS + MAX_COMMANDS)
+
+#define CONTROL_LANE_WEIGHT		8
+#define KV_LANE_WEIGHT			4
+#define BULK_LANE_WEIGHT		1
+
+/* One priority lane: fixed-size circular buffer of commands */
+typedef struct
+{
+	pgraft_command_t commands[MAX_COMMANDS];
+	int			head;				/* Index of next command to process */
+	int			tail;				/* Index of next slot to write */
+	int			count;				/* Number of commands in lane */
+	int			capacity;			/* Maximum commands this lane accepts */
+	int			weight;				/* Dequeues granted per refill */
+	int			credits;			/* Dequeues left in current round */
+	int64_t		enqueued;			/* Commands accepted */
+	int64_t		rejected;			/* Commands refused because lane was full */
+}			pgraft_command_lane_t;
+
 /* Apply entry structure for Raft log application */
 typedef struct
 {
@@ -80,17 +130,21 @@ typedef struct
 	int			port;
 	WORKER_STATUS status;
 
-	/* Fixed-size circular buffer for commands */
-	pgraft_command_t commands[MAX_COMMANDS];
-	int			command_head;		/* Index of next command to process */
-	int			command_tail;		/* Index of next slot to write */
-	int			command_count;		/* Number of commands in queue */
+	/* Priority lanes for commands, protected by queue_mutex */
+	pgraft_command_lane_t lanes[COMMAND_NUM_LANES];
+	int			command_count;		/* Number of commands across all lanes */
+	uint64		next_command_id;	/* Last command id handed out */
+	slock_t		queue_mutex;
 
-	/* Fixed-size circular buffer for command status */
-	pgraft_command_t status_commands[MAX_COMMANDS];
-	int			status_head;		/* Index of next status to read */
-	int			status_tail;		/* Index of next slot to write */
-	int			status_count;		/* Number of status entries */
+	/*
+	 * Command status, recorded when a command is queued and taken out by
+	 * the backend waiting for it; free slots have command_id 0.  It holds
+	 * every queued command and then some, so only finished commands whose
+	 * waiter gave up are ever evicted.
+	 */
+	slock_t		status_mutex;
+	pgraft_command_t status_commands[MAX_STATUS_COMMANDS];
+	int			status_count;		/* Slots in use */
 
 	/* Fixed-size circular buffer for Raft log entries to apply */
 	pgraft_apply_entry_t apply_queue[MAX_APPLY_ENTRIES];
@@ -100,15 +154,78 @@ typedef struct
 	uint64		last_applied_index; /* Last Raft index applied to PostgreSQL */
 }			pgraft_worker_state_t;
 
-/* Core consensus types */
+/*
+ * Cluster membership
+ *
+ * Members live in a shared memory table of their own whose capacity comes
+ * from pgraft.max_nodes at postmaster start, so larger clusters, learners and
+ * read replicas only need a restart, not a rebuild.  The table is protected
+ * by the cluster mutex.  Addresses are packed into a string arena behind the
+ * entries rather than kept in fixed-size slots; entries are always in arena
+ * order, so holes left by removals are squeezed out in place by the next
+ * insert that runs short of room.
+ */
+#define PGRAFT_NODE_ADDRESS_AVG		64	/* Arena bytes budgeted per member */
+#define PGRAFT_NODE_ADDRESS_MAX		256 /* Longest address accepted */
+
 typedef struct pgraft_node
 {
 	int32_t		id;
-	char		address[256];
 	int32_t		port;
 	bool		is_leader;
+	uint32		address_off;		/* Offset of the address in the arena */
+	uint32		address_len;		/* Address length, excluding the NUL */
 }			pgraft_node_t;
 
+/*
+ * Multi-Raft
+ *
+ * With pgraft.raft_groups > 1 the KV keyspace is hash-partitioned across
+ * several independent Raft groups so that writes to different partitions
+ * commit in parallel and leadership can be spread across nodes.  Group 0 is
+ * the cluster's own group: it carries membership and all control state
+ * (sequences, locks, counters) besides its share of KV keys.  The worker
+ * publishes each group's view here since backends cannot call into Go.
+ */
+#define PGRAFT_MAX_GROUPS 16
+
+typedef struct pgraft_group_status
+{
+	int64_t		leader_id;
+	int32_t		current_term;
+	uint64		commit_index;
+	uint64		applied_index;		/* Last entry of this group applied locally */
+	int64_t		proposals;
+	bool		quiesced;			/* Group stopped ticking while idle */
+}			pgraft_group_status_t;
+
+/* Heartbeat round trip to one peer, measured by the leader */
+typedef struct pgraft_peer_latency
+{
+	int64_t		node_id;
+	int64_t		rtt_us;				/* Smoothed RTT */
+	int64_t		rtt_var_us;			/* RTT variation (jitter) */
+	int64_t		samples;
+}			pgraft_peer_latency_t;
+
+typedef struct pgraft_node_table
+{
+	int32_t		capacity;			/* Members that fit */
+	int32_t		num_nodes;
+	int32_t		num_peers;			/* Valid entries in peers[] */
+	uint32		arena_size;
+	uint32		arena_used;
+	pgraft_peer_latency_t peers[FLEXIBLE_ARRAY_MEMBER];	/* capacity entries */
+	/* pgraft_node_t nodes[capacity] and the address arena follow */
+}			pgraft_node_table_t;
+
+#define PGRAFT_NODE_TABLE_NODES(table) \
+	((pgraft_node_t *) &(table)->peers[(table)->capacity])
+#define PGRAFT_NODE_TABLE_ARENA(table) \
+	((char *) &PGRAFT_NODE_TABLE_NODES(table)[(table)->capacity])
+#define PGRAFT_NODE_ADDRESS(table, node) \
+	(PGRAFT_NODE_TABLE_ARENA(table) + (node)->address_off)
+
 typedef struct pgraft_cluster
 {
 	bool		initialized;	/* Whether the core system is initialized */
@@ -116,14 +233,24 @@ typedef struct pgraft_cluster
 	int32_t		current_term;
 	int64_t		leader_id;
 	char		state[32];		/* "leader", "follower", "candidate" */
-	int32_t		num_nodes;
-	pgraft_node_t nodes[16];
 	
 	/* Performance metrics */
 	int64_t		messages_processed;
 	int64_t		heartbeats_sent;
 	int64_t		elections_triggered;
 	
+	/* Leadership change notification */
+	uint64		leader_epoch;		/* Bumped on every leader or term change */
+	char		leader_address[256];	/* Address of current leader, if known */
+	ConditionVariable leader_cv;	/* Broadcast on leader/term change and command completion */
+	
+	/* Election timeout after adapting to peer latency (see node table) */
+	int32_t		election_timeout_ms;	/* Effective (possibly stretched) timeout */
+	
+	/* Raft groups; groups[0] mirrors the fields above */
+	int32_t		num_groups;
+	pgraft_group_status_t groups[PGRAFT_MAX_GROUPS];
+	
 	/* Mutex for thread safety */
 	slock_t		mutex;
 }			pgraft_cluster_t;
@@ -135,14 +262,29 @@ int			pgraft_core_remove_node(int32_t node_id);
 int			pgraft_core_get_cluster_state(pgraft_cluster_t *cluster);
 int			pgraft_core_update_cluster_state(int64_t leader_id, int64_t current_term, const char *state);
 int			pgraft_core_update_nodes(int32_t num_nodes, int32_t *node_ids, char **addresses);
+int32_t		pgraft_core_get_num_nodes(void);
+bool		pgraft_core_node_address(int64_t node_id, char *address, size_t address_len);
+pgraft_node_table_t *pgraft_core_snapshot_nodes(void);
 bool		pgraft_core_is_leader(void);
 int64_t		pgraft_core_get_leader_id(void);
 int32_t		pgraft_core_get_current_term(void);
+int			pgraft_core_wait_for_command(uint64 command_id, int32_t term, int timeout_ms);
+int			pgraft_core_wait_for_group_command(uint64 command_id, int group, int32_t term, int timeout_ms);
+bool		pgraft_core_group_leadership(int group, int32_t *term, int64_t *leader_id,
+										 char *leader_address, size_t address_len);
+void		pgraft_core_report_leader_change(int32_t term, int32_t current_term,
+											 int64_t leader_id, const char *leader_address);
+void		pgraft_core_require_leader(int32_t *term, int32_t *node_id);
+void		pgraft_core_check_term(int32_t term);
+int			pgraft_core_propose(const char *data, int32_t term);
+int			pgraft_core_wait_for_apply(bool (*applied) (void *arg), void *arg, int32_t term, int timeout_ms);
 void		pgraft_core_cleanup(void);
 
 /* Shared memory functions */
+Size		pgraft_core_shmem_size(void);
 void		pgraft_core_init_shared_memory(void);
 pgraft_cluster_t *pgraft_core_get_shared_memory(void);
+pgraft_node_table_t *pgraft_core_get_node_table(void);
 
 /* Background worker functions */
 void		pgraft_worker_main(Datum main_arg);
@@ -155,15 +297,20 @@ pgraft_worker_state_t *pgraft_worker_get_state(void);
 /* Command queue functions */
 bool		pgraft_queue_command(COMMAND_TYPE type, int node_id, const char *address, int port, const char *cluster_id);
 bool		pgraft_queue_log_command(COMMAND_TYPE type, const char *log_data, int log_index);
-bool		pgraft_queue_kv_command(COMMAND_TYPE type, const char *key, const char *value, const char *client_id);
+bool		pgraft_queue_kv_command(COMMAND_TYPE type, const char *key, const char *value, const char *client_id,
+									int64_t expected_version, int32_t term, int group_id, uint64 *command_id);
+bool		pgraft_queue_propose_command(const char *data, int32_t term, uint64 *command_id);
 bool		pgraft_dequeue_command(pgraft_command_t *cmd);
 bool		pgraft_queue_is_empty(void);
+void		pgraft_queue_init_lanes(pgraft_worker_state_t *state);
+COMMAND_LANE pgraft_command_lane(COMMAND_TYPE type);
+const char *pgraft_command_lane_name(COMMAND_LANE lane);
 
 /* Command status functions */
 bool		pgraft_add_command_to_status(pgraft_command_t *cmd);
-bool		pgraft_get_command_status(int64_t timestamp, pgraft_command_t *status_cmd);
-bool		pgraft_update_command_status(int64_t timestamp, COMMAND_STATUS status, const char *error_message);
-bool		pgraft_remove_completed_commands(void);
+bool		pgraft_get_command_status(uint64 command_id, pgraft_command_t *status_cmd);
+bool		pgraft_update_command_status(uint64 command_id, COMMAND_STATUS status, const char *error_message);
+void		pgraft_forget_command_status(uint64 command_id);
 
 /* Apply queue functions (for Raft log replication) */
 bool		pgraft_enqueue_apply_entry(uint64 raft_index, const char *data, size_t data_len);
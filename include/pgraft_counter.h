@@ -0,0 +1,86 @@
+/*
+ * pgraft_counter.h
+ * Replicated counters with leader-side combining
+ *
+ * Increments that arrive on the leader within one batching window are
+ * summed into a single "counter_add" Raft entry.  The first caller of a
+ * window (the combiner) proposes it; everyone in the batch then derives its
+ * own post-increment value from the batch result and its position in the
+ * batch.  Only one batch per counter is in flight at a time, so while one
+ * round is committing the next batch keeps absorbing callers.
+ */
+
+#ifndef PGRAFT_COUNTER_H
+#define PGRAFT_COUNTER_H
+
+#include "postgres.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+
+#define PGRAFT_MAX_COUNTERS			128
+#define PGRAFT_COUNTER_NAME_LEN		128
+#define PGRAFT_COUNTER_RESULTS		16	/* Recent batch results kept per counter */
+
+/* Counter operation as carried in the Raft log */
+typedef struct pgraft_counter_op
+{
+	char		name[PGRAFT_COUNTER_NAME_LEN];
+	int64		delta;			/* Sum of all increments in the batch */
+	uint64		batch;			/* Proposer-local batch id */
+	int32		term;			/* Term of the proposing leader */
+	int32		node_id;		/* Proposing node */
+} pgraft_counter_op_t;
+
+/* Outcome of one applied batch */
+typedef struct pgraft_counter_result
+{
+	uint64		batch;
+	int32		term;
+	int32		node_id;
+	int64		delta;
+	int64		value;			/* Counter value after the batch */
+	bool		failed;			/* Batch was not applied */
+} pgraft_counter_result_t;
+
+/* One counter */
+typedef struct pgraft_counter
+{
+	bool		in_use;
+	char		name[PGRAFT_COUNTER_NAME_LEN];
+
+	/* Replicated state, identical on every node once applied */
+	int64		value;
+	int64		batches_applied;
+	pgraft_counter_result_t results[PGRAFT_COUNTER_RESULTS];
+
+	/* Leader-local combining state */
+	uint64		open_batch;		/* Batch accepting increments, 0 if none */
+	int32		open_term;
+	int64		open_sum;
+	uint64		in_flight_batch;	/* Batch proposed and not yet applied, 0 if none */
+	int64		adds;			/* Increments served by this node */
+	int64		batches_proposed;	/* Raft entries this node proposed */
+} pgraft_counter_t;
+
+/* Counter table in shared memory */
+typedef struct pgraft_counter_state
+{
+	pgraft_counter_t counters[PGRAFT_MAX_COUNTERS];
+	int32		num_counters;
+	uint64		next_batch;
+	int64		last_applied_index;
+	slock_t		mutex;
+} pgraft_counter_state_t;
+
+/* Shared memory */
+void		pgraft_counter_init_shared_memory(void);
+pgraft_counter_state_t *pgraft_counter_get_state(void);
+
+/* Counter operations */
+int64		pgraft_counter_add(const char *name, int64 delta);
+bool		pgraft_counter_get(const char *name, int64 *value);
+
+/* Apply a committed counter entry (all nodes) */
+int			pgraft_counter_apply(uint64 raft_index, const char *json_data, size_t len);
+
+#endif							/* PGRAFT_COUNTER_H */
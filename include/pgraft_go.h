@@ -2,6 +2,9 @@
 #define PGRAFT_GO_H
 
 #include "postgres.h"
+#include "port/atomics.h"
+
+#include <semaphore.h>
 
 /* Cluster member structure - parsed from initial_cluster */
 typedef struct pgraft_go_cluster_member {
@@ -10,6 +13,92 @@ typedef struct pgraft_go_cluster_member {
 	int		peer_port;     /* Peer port (e.g., 2380) */
 } pgraft_go_cluster_member_t;
 
+/* Raft group of a KV key, handed to Go for the client gateway */
+typedef int (*pgraft_go_group_for_key_fn) (const char *key);
+
+/* Quota check of a client gateway write (pgraft_kv_quota_admit_gateway) */
+typedef int (*pgraft_go_quota_admit_fn) (const char *key, int is_delete, int64_t value_size, int64_t old_size);
+
+/*
+ * Shared memory proposal ring, consumed by a goroutine of the Go layer
+ * (see pgraft_proposal.h); the Go preamble declares the same layout
+ */
+#define PGRAFT_PROPOSAL_SLOTS		64
+#define PGRAFT_PROPOSAL_DATA_SIZE	8192
+
+/* Slot states */
+#define PGRAFT_PROPOSAL_FREE		0
+#define PGRAFT_PROPOSAL_READY		1	/* Filled by a backend */
+#define PGRAFT_PROPOSAL_TAKEN		2	/* Being proposed */
+#define PGRAFT_PROPOSAL_DONE		3	/* result is set */
+#define PGRAFT_PROPOSAL_ABANDONED	4	/* Backend gave up waiting */
+
+/* Slot results */
+#define PGRAFT_PROPOSAL_OK			0
+#define PGRAFT_PROPOSAL_FAILED		(-1)
+#define PGRAFT_PROPOSAL_STALE		(-2)	/* Not leading the group in term */
+#define PGRAFT_PROPOSAL_UNKNOWN		(-3)	/* Consumer went away mid-proposal */
+
+typedef struct pgraft_go_proposal_slot {
+	pg_atomic_uint32 state;
+	int32_t		group;
+	int32_t		term;			/* Term the backend saw, 0 to skip the check */
+	int32_t		result;
+	int32_t		length;
+	sem_t		done;			/* Posted once state is DONE */
+	char		data[PGRAFT_PROPOSAL_DATA_SIZE];
+} pgraft_go_proposal_slot_t;
+
+typedef struct pgraft_go_proposal_ring {
+	pg_atomic_uint32 consumer;	/* 1 while the goroutine runs */
+	sem_t		wakeup;			/* Posted for every filled slot */
+	pgraft_go_proposal_slot_t slots[PGRAFT_PROPOSAL_SLOTS];
+} pgraft_go_proposal_ring_t;
+
+/* One node's metrics snapshot, a row of pgraft_cluster_stats() */
+typedef struct pgraft_go_node_stats {
+	int64_t		node_id;
+	int			reachable;		/* Answered the last stats round */
+	int64_t		leader_id;
+	uint64_t	term;
+	uint64_t	commit_index;
+	uint64_t	applied_index;
+	int64_t		apply_lag;		/* commit_index - applied_index */
+	int64_t		queue_depth;	/* Commands waiting for the worker */
+	int64_t		pending_entries;	/* Committed entries not yet applied */
+	int64_t		disk_bytes;		/* Size of the Raft data directory */
+	int64_t		rtt_us;			/* Stats request round trip */
+	int64_t		max_peer_rtt_us;	/* Slowest heartbeat RTT the node measures */
+	uint64_t	kv_hash;		/* Root of the KV hash tree */
+	uint64_t	kv_hash_revision;	/* KV changes the hash covers */
+} pgraft_go_node_stats_t;
+
+/* A key as the client gateway sees it (pgraft_kv_gateway.c) */
+typedef struct pgraft_go_kv {
+	const char *key;
+	const char *value;			/* NULL for a deletion, or when only keys are read */
+	int64_t		create_revision;
+	int64_t		mod_revision;
+	int64_t		version;
+	int64_t		lease;
+} pgraft_go_kv_t;
+
+/* A read the client gateway hands the worker; key and range_end are Go's */
+#define PGRAFT_GO_READ_RANGE		1
+#define PGRAFT_GO_READ_LEASE		2
+
+typedef struct pgraft_go_gateway_read {
+	uint64_t	id;
+	int			kind;
+	char	   *key;
+	char	   *range_end;		/* NULL for the key alone, "" for every key from it */
+	int64_t		limit;			/* 0 for no limit */
+	int			keys_only;
+	int			count_only;
+	int64_t		lease;			/* Lease reads */
+	int			lease_keys;		/* Lease reads: list the attached keys */
+} pgraft_go_gateway_read_t;
+
 /* Configuration structure for Go init (etcd-style) */
 typedef struct pgraft_go_config {
 	int		node_id;
@@ -75,6 +164,14 @@ typedef struct pgraft_go_config {
 	int		max_log_entries;
 	int		batch_size;
 	int		max_batch_delay;
+	int		raft_groups;		/* Raft groups hosted per node (pgraft.raft_groups) */
+	int		quiesce_timeout;	/* Idle time before a group stops ticking, 0 = never */
+	int		tick_interval;		/* Raft tick resolution in ms (pgraft.tick_interval) */
+	int		election_timeout_max;	/* Upper bound of the adaptive election timeout, 0 = fixed */
+	int		client_gateway;		/* Serve the etcd v3 JSON API on listen_client_urls */
+	int		proposal_timeout;	/* Gateway write timeout in ms (pgraft.proposal_timeout) */
+	pgraft_go_group_for_key_fn group_for_key;	/* Must be safe to call from any thread */
+	pgraft_go_quota_admit_fn quota_admit;	/* Likewise */
 } pgraft_go_config_t;
 
 /* Function pointers for Go functions */
@@ -91,7 +188,6 @@ typedef int (*pgraft_go_is_initialized_func) (void);
 typedef int (*pgraft_go_is_leader_func) (void);
 typedef int (*pgraft_go_append_log_func) (char *data, int length);
 typedef char *(*pgraft_go_get_stats_func) (void);
-typedef char *(*pgraft_go_get_logs_func) (void);
 typedef int (*pgraft_go_commit_log_func) (long index);
 typedef int (*pgraft_go_step_message_func) (char *data, int length);
 typedef char *(*pgraft_go_get_network_status_func) (void);
@@ -125,7 +221,6 @@ extern int pgraft_go_is_initialized(void);
 extern int pgraft_go_is_leader(void);
 extern int pgraft_go_append_log(char *data, int length);
 extern char *pgraft_go_get_stats(void);
-extern char *pgraft_go_get_logs(void);
 extern int pgraft_go_commit_log(long index);
 extern int pgraft_go_step_message(char *data, int length);
 extern char *pgraft_go_get_network_status(void);
@@ -135,7 +230,30 @@ extern int pgraft_go_update_cluster_state(int64_t leaderID, int64_t currentTerm,
 extern int pgraft_go_start_network_server(int port);
 extern int pgraft_go_trigger_heartbeat(void);
 extern int64_t pgraft_go_get_node_id(void);
-extern int pgraft_go_tick(void);  /* Worker-driven tick function */
+extern int pgraft_go_tick(void);  /* 0 while Raft runs; ticking is done by Go */
+extern char *pgraft_go_next_committed(uint64_t *index, int *length);  /* Next committed entry to apply */
+extern int pgraft_go_group_count(void);  /* Raft groups including group 0 */
+extern int pgraft_go_group_append(int group, char *data, int length);
+extern int pgraft_go_group_status(int group, int64_t *leader, int32_t *term, uint64_t *commit, int64_t *proposals);
+extern char *pgraft_go_next_group_committed(int group, uint64_t *index, int *length);
+extern int pgraft_go_get_peer_latency(int64_t *ids, int64_t *srtt_us, int64_t *rttvar_us,
+									  int64_t *samples, int max_peers);  /* Heartbeat RTT per peer */
+extern int pgraft_go_get_election_timeout(void);  /* Effective election timeout in ms */
+extern int pgraft_go_is_quiesced(int group);  /* 1 while the group is not ticking */
+extern int pgraft_go_read_log(uint64_t from_index, int max_entries, uint64_t *indexes, uint64_t *terms,
+							  int32_t *types, int32_t *sizes, int32_t *offsets, int32_t *lengths,
+							  char *buf, int buf_size, uint64_t *bounds);  /* One page of the Raft log */
+extern int pgraft_go_attach_proposals(pgraft_go_proposal_ring_t *ring, uint64_t tail);
+extern void pgraft_go_set_local_stats(uint64_t applied_index, int queue_depth, uint64_t kv_hash,
+									  uint64_t kv_hash_revision);
+extern void pgraft_go_gateway_event(const pgraft_go_kv_t *kv, const pgraft_go_kv_t *prev);
+extern void pgraft_go_gateway_applied(const char *client_id, int64_t revision, int succeeded);
+extern int pgraft_go_gateway_next_read(pgraft_go_gateway_read_t *read);  /* 1 if a read was taken */
+extern void pgraft_go_gateway_read_row(uint64_t id, const pgraft_go_kv_t *kv);
+extern void pgraft_go_gateway_read_done(uint64_t id, int64_t revision, int64_t count, int64_t lease_ttl,
+										int64_t lease_remaining);  /* revision -1: failed */
+extern int pgraft_go_cluster_stats(pgraft_go_node_stats_t *stats, int max_nodes, int max_age_ms,
+								   int *age_ms);  /* -1 while a round runs */
 extern void cleanup_pgraft(void);
 
 /* C-side Go library management functions */
@@ -139,6 +139,25 @@ extern char	   *go_library_path;
 extern int		pgraft_max_log_entries;
 extern int		pgraft_batch_size;
 extern int		pgraft_max_batch_delay;
+extern int		pgraft_proposal_timeout;
+extern int		pgraft_seq_lease_size;
+extern int		pgraft_raft_groups;
+extern int		pgraft_quiesce_timeout;
+extern int		pgraft_tick_interval;
+extern int		pgraft_election_timeout_max;
+extern int		pgraft_max_nodes;
+extern bool		pgraft_client_gateway;
+extern int		pgraft_cluster_stats_ttl;
+extern int		pgraft_kv_read_cache_size;
+extern int		pgraft_kv_arena_size;
+extern int		pgraft_kv_compress_threshold;
+extern char	   *pgraft_kv_sync_database;
+extern int		pgraft_kv_sync_batch_size;
+extern int		pgraft_kv_sync_interval;
+extern int		pgraft_kv_memory_budget;
+extern int		pgraft_kv_defrag_threshold;
+extern int		pgraft_kv_defrag_step;
+extern int		pgraft_kv_namespace_depth;
 
 /* GUC functions */
 void		pgraft_guc_init(void);
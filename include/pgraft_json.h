@@ -8,28 +8,107 @@
 
 #include "postgres.h"
 #include "pgraft_kv.h"
+#include "pgraft_seq.h"
+#include "pgraft_lock.h"
+#include "pgraft_counter.h"
+#include "pgraft_kv_quota.h"
+#include "pgraft_kv_bulk.h"
+#include "pgraft_kv_gateway.h"
+#include "pgraft_core.h"
 
 /* Forward declarations */
 typedef struct PgRaftLogEntry PgRaftLogEntry;
 
-/* Parse nodes JSON from Go layer */
+/* Parse nodes JSON from Go layer, addresses are palloc'd */
 int pgraft_parse_nodes_json(const char *nodes_json, int32_t *node_ids, char **addresses, int max_nodes);
 
+/* Cluster member as recorded in the cluster state file */
+typedef struct pgraft_member
+{
+	int64		id;
+	char		name[64];
+	char		address[PGRAFT_NODE_ADDRESS_MAX];
+	bool		active;
+}			pgraft_member_t;
+
+/* Parse the members of a cluster state file, returns count or -1 on error */
+int pgraft_json_parse_members(const char *state_json, pgraft_member_t *members, int max_members);
+
 /* Parse KV JSON entry from Raft log */
 PgRaftLogEntry *pgraft_parse_kv_json_entry(const char *data, size_t len);
 
 /* Create KV operation JSON using json-c library */
 int pgraft_json_create_kv_operation(pgraft_kv_op_type_t op_type, const char *key, const char *value, const char *client_id, char *json_buffer, size_t buffer_size);
 
+/* Create a KV merge patch entry; expected_version -1 leaves it unconditional */
+int pgraft_json_create_kv_patch(const char *key, const char *patch, int64_t expected_version, const char *client_id, char *json_buffer, size_t buffer_size);
+
 /* Parse KV operation from JSON using json-c library */
 int pgraft_json_parse_kv_operation(const char *json_data, size_t len, int *op_type, char **key, char **value);
 
+/* Extract the "expected_version" of a KV patch entry, -1 when absent */
+int64_t pgraft_json_get_expected_version(const char *json_data, size_t len);
+
 /* Create KV stats JSON using json-c library */
 int pgraft_json_create_kv_stats(pgraft_kv_store_t *stats, char *json_buffer, size_t buffer_size);
 
 /* Create key list JSON array using json-c library */
 int pgraft_json_create_key_list(pgraft_kv_store_t *store, char *json_buffer, size_t buffer_size);
 
+/* Extract the "type" field of a replicated JSON entry */
+int pgraft_json_get_type(const char *json_data, size_t len, char *type_buffer, size_t buffer_size);
+
+/* Extract operation and key (or name) of a log payload, which need not be NUL-terminated */
+int pgraft_json_describe_entry(const char *data, size_t len, char *op, size_t op_size, char *key, size_t key_size);
+
+/* Create sequence operation JSON using json-c library */
+int pgraft_json_create_seq_operation(const pgraft_seq_op_t *op, char *json_buffer, size_t buffer_size);
+
+/* Parse sequence operation from JSON using json-c library */
+int pgraft_json_parse_seq_operation(const char *json_data, size_t len, pgraft_seq_op_t *op);
+
+/* Create lock operation JSON using json-c library */
+int pgraft_json_create_lock_operation(const pgraft_lock_op_t *op, char *json_buffer, size_t buffer_size);
+
+/* Parse lock operation from JSON using json-c library */
+int pgraft_json_parse_lock_operation(const char *json_data, size_t len, pgraft_lock_op_t *op);
+
+/* Create counter operation JSON using json-c library */
+int pgraft_json_create_counter_operation(const pgraft_counter_op_t *op, char *json_buffer, size_t buffer_size);
+
+/* Parse counter operation from JSON using json-c library */
+int pgraft_json_parse_counter_operation(const char *json_data, size_t len, pgraft_counter_op_t *op);
+
+/* Create KV quota operation JSON using json-c library */
+int pgraft_json_create_kv_quota_operation(const pgraft_kv_quota_op_t *op, char *json_buffer, size_t buffer_size);
+
+/* Parse KV quota operation from JSON using json-c library */
+int pgraft_json_parse_kv_quota_operation(const char *json_data, size_t len, pgraft_kv_quota_op_t *op);
+
+/* Create KV batch JSON (pgraft_kv_import()) using json-c library */
+int pgraft_json_create_kv_batch(const pgraft_kv_batch_item_t *items, int count, const char *client_id, char *json_buffer, size_t buffer_size);
+
+/* Parse KV batch from JSON using json-c library; items are palloc'd */
+int pgraft_json_parse_kv_batch(const char *json_data, size_t len, pgraft_kv_batch_item_t **items, int *count);
+
+/* Extract an integer field of a replicated JSON entry, default_value when absent */
+int64_t pgraft_json_get_int64(const char *json_data, size_t len, const char *field, int64_t default_value);
+
+/* Extract a string field of a replicated JSON entry */
+int pgraft_json_get_string(const char *json_data, size_t len, const char *field, char *buffer, size_t buffer_size);
+
+/* Create KV Txn JSON (client gateway) using json-c library */
+int pgraft_json_create_kv_txn(const pgraft_kv_txn_t *txn, const char *client_id, char *json_buffer, size_t buffer_size);
+
+/* Parse KV Txn from JSON using json-c library; everything is palloc'd */
+int pgraft_json_parse_kv_txn(const char *json_data, size_t len, pgraft_kv_txn_t *txn);
+
+/* Create KV lease operation JSON (client gateway) using json-c library */
+int pgraft_json_create_kv_lease_operation(const pgraft_kv_lease_op_t *op, char *json_buffer, size_t buffer_size);
+
+/* Parse KV lease operation from JSON using json-c library */
+int pgraft_json_parse_kv_lease_operation(const char *json_data, size_t len, pgraft_kv_lease_op_t *op);
+
 /* Parse log entry from JSON using json-c library */
 PgRaftLogEntry *pgraft_json_parse_log_entry(const char *json_data, size_t len);
 
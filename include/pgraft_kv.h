@@ -2,6 +2,7 @@
 #define PGRAFT_KV_H
 
 #include "postgres.h"
+#include "port/atomics.h"
 #include "storage/shmem.h"
 #include "storage/spin.h"
 
@@ -10,21 +11,68 @@ typedef enum pgraft_kv_op_type
 {
 	PGRAFT_KV_PUT = 1,
 	PGRAFT_KV_DELETE = 2,
-	PGRAFT_KV_GET = 3
+	PGRAFT_KV_GET = 3,
+	PGRAFT_KV_PATCH = 4			/* JSON merge patch of an existing value */
 } pgraft_kv_op_type_t;
 
-/* Key/Value entry structure */
+/*
+ * Largest value, including the terminating NUL: a proposal ring slot
+ * (PGRAFT_PROPOSAL_DATA_SIZE).  A command queued to the worker carries
+ * values of this size too (pgraft_command_t.kv_value), so a full or
+ * missing ring never limits them.  A value is refused before it is
+ * proposed if its entry does not fit in a slot.
+ */
+#define PGRAFT_KV_VALUE_SIZE 8192
+
+/* Hash tree (pgraft_kv_hash()): keys fall into leaves by hash_bytes() of the key */
+#define PGRAFT_KV_HASH_DEPTH 10
+#define PGRAFT_KV_HASH_LEAVES (1 << PGRAFT_KV_HASH_DEPTH)
+#define PGRAFT_KV_HASH_HISTORY 1024	/* Past roots kept */
+
+/*
+ * Key/Value entry structure
+ *
+ * The value lives in the store's arena, pglz-compressed when it is at least
+ * pgraft.kv_compress_threshold bytes and compression pays off.
+ */
 typedef struct pgraft_kv_entry
 {
 	char		key[256];		/* Key (max 255 chars + null terminator) */
-	char		value[1024];	/* Value (max 1023 chars + null terminator) */
+	uint32		value_offset;	/* Start of the stored value in the arena */
+	uint32		value_size;		/* Bytes the value takes in the arena */
+	uint32		raw_size;		/* Length of the value itself */
+	bool		compressed;		/* Stored pglz-compressed */
 	int64_t		version;		/* Version number for this key */
 	int64_t		created_at;		/* Creation timestamp */
 	int64_t		updated_at;		/* Last update timestamp */
 	int64_t		log_index;		/* Raft log index that created/modified this entry */
+	int64_t		create_index;	/* Raft log index of the write that created the key */
+	int64_t		lease;			/* Client gateway lease the key is attached to, 0 if none */
+	uint64		mod_revision;	/* Store revision of the last put or delete */
+	uint64		last_access;	/* Store access clock at the last read or write */
+	uint64		kv_hash;		/* Hash of key, value and version; 0 when deleted */
 	bool		deleted;		/* True if this entry is deleted */
 } pgraft_kv_entry_t;
 
+/*
+ * Client gateway lease (see pgraft_kv_gateway.h)
+ *
+ * Leases are granted, kept alive and revoked by group 0 entries.  A lease
+ * expires its TTL after the timestamp the proposer of its last grant or
+ * keepalive put in the entry, so every node agrees on when.  A revoked
+ * lease keeps its slot until a grant needs it, so that keys still
+ * attached to it are found and deleted.
+ */
+#define PGRAFT_KV_MAX_LEASES 1024
+
+typedef struct pgraft_kv_lease
+{
+	int64_t		id;				/* 0 for a free slot */
+	int64_t		ttl;			/* Granted TTL in seconds */
+	int64_t		expires_at;		/* Proposer's timestamp of the last grant or keepalive, plus ttl */
+	int64_t		revoked_index;	/* Raft log index of the revocation, 0 while live */
+} pgraft_kv_lease_t;
+
 /* Key/Value store state */
 typedef struct pgraft_kv_store
 {
@@ -32,7 +80,7 @@ typedef struct pgraft_kv_store
 	pgraft_kv_entry_t entries[1000];	/* Support up to 1000 key/value pairs */
 	int32_t		num_entries;			/* Current number of active entries */
 	int64_t		total_operations;		/* Total number of operations performed */
-	int64_t		last_applied_index;		/* Last Raft log index applied to store */
+	int64_t		last_applied_index;		/* Highest Raft log index of a change applied to the store */
 	
 	/* Statistics */
 	int64_t		puts;				/* Number of PUT operations */
@@ -41,8 +89,88 @@ typedef struct pgraft_kv_store
 	
 	/* Mutex for thread safety */
 	slock_t		mutex;
+	
+	/* Bumped under the mutex by every change; backends' read caches check it */
+	pg_atomic_uint64 revision;
+	uint64		resync_revision;	/* Last revision at which entries were dropped wholesale */
+	uint64		purged_revision;	/* Newest deletion dropped from shared memory on its own */
+	
+	/*
+	 * Tiering: entries are the hot keys; the least recently used ones are
+	 * evicted to the cold tier file (see pgraft_kv_cold.h) to make room
+	 * within pgraft.kv_memory_budget, and brought back when written.
+	 */
+	uint64		access_clock;		/* Stamps entries' last_access */
+	uint64		spill_horizon;		/* With pgraft.kv_sync_database, newest change pgraft.kv has */
+	uint64		cold_revision;		/* Newest change written to the cold tier */
+	int64_t		cold_entries;		/* Keys in the cold tier */
+	int64_t		hot_hits;			/* Reads answered from shared memory */
+	int64_t		cold_hits;			/* Reads answered from the cold tier */
+	int64_t		misses;				/* Reads of missing keys */
+	int64_t		evictions;			/* Keys moved to the cold tier */
+	int64_t		promotions;			/* Keys brought back from it by a write */
+	int64_t		cold_leased;		/* Leased keys evicted to it, at most */
+	
+	/* Client gateway leases */
+	pgraft_kv_lease_t leases[PGRAFT_KV_MAX_LEASES];
+	
+	/*
+	 * Hash tree over the live keys of both tiers: leaf b sums the hashes of
+	 * the keys in bucket b, every inner node i hashes nodes 2i and 2i+1, and
+	 * node 1 is the root.  It depends only on keys, values and versions, so
+	 * nodes that applied the same KV entries have the same tree.
+	 * hash_revision counts the changes folded into it, and the root after
+	 * change r is kept in hash_history[r % PGRAFT_KV_HASH_HISTORY].
+	 */
+	uint64		hash_tree[2 * PGRAFT_KV_HASH_LEAVES];
+	uint64		hash_revision;
+	uint64		hash_history[PGRAFT_KV_HASH_HISTORY];
+	
+	/*
+	 * Background defragmentation (pgraft_kv_defragment): a pass drops the
+	 * deleted entries it may, then slides live values down one at a time;
+	 * below defrag_cursor the arena is packed.
+	 */
+	bool		defrag_active;		/* A pass is under way */
+	uint32		defrag_cursor;		/* Where the pass puts the next value */
+	int64_t		defrag_passes;
+	int64_t		defrag_relocations;	/* Values moved */
+	int64_t		defrag_bytes_moved;
+	int64_t		defrag_purged;		/* Deleted entries dropped */
+	int64_t		full_compactions;	/* Whole-arena compactions, under the mutex */
+	
+	/* Value arena (pgraft.kv_arena_size): bump allocated, compacted when full */
+	uint32		arena_size;			/* Capacity of arena[] */
+	uint32		arena_used;			/* Bytes allocated, live or not */
+	uint32		arena_live;			/* Bytes held by live values */
+	char		arena[FLEXIBLE_ARRAY_MEMBER];
 } pgraft_kv_store_t;
 
+/* Header of the store, without the arena */
+#define PGRAFT_KV_STORE_HEADER_SIZE offsetof(pgraft_kv_store_t, arena)
+
+/* Storage footprint of one live key, for pgraft_kv_value_stats() */
+typedef struct pgraft_kv_value_stats
+{
+	char		key[256];
+	int64_t		version;
+	uint32		raw_size;		/* Length of the value */
+	uint32		stored_size;	/* Bytes it takes in the arena */
+	bool		compressed;
+} pgraft_kv_value_stats_t;
+
+/* A changed key as handed to the pgraft.kv materializer */
+typedef struct pgraft_kv_change
+{
+	char		key[256];
+	char		value[PGRAFT_KV_VALUE_SIZE];	/* Empty when deleted */
+	int64_t		version;
+	int64_t		created_at;
+	int64_t		updated_at;
+	uint64		mod_revision;
+	bool		deleted;
+} pgraft_kv_change_t;
+
 /* Log entry for key/value operations */
 typedef struct pgraft_kv_log_entry
 {
@@ -54,18 +182,22 @@ typedef struct pgraft_kv_log_entry
 } pgraft_kv_log_entry_t;
 
 /* Key/Value store functions */
+Size		pgraft_kv_shmem_size(void);
 void		pgraft_kv_init_shared_memory(void);
 pgraft_kv_store_t *pgraft_kv_get_store(void);
 
 /* Key/Value operations */
-int			pgraft_kv_put(const char *key, const char *value, int64_t log_index);
+int			pgraft_kv_put(const char *key, const char *value, int64_t lease, int64_t log_index);
 int			pgraft_kv_get(const char *key, char *value, size_t value_size, int64_t *version);
 int			pgraft_kv_delete(const char *key, int64_t log_index);
+int			pgraft_kv_patch(const char *key, const char *patch, int64_t expected_version, int64_t log_index);
 bool		pgraft_kv_exists(const char *key);
 
 /* Key/Value replication (through Raft) */
 int			pgraft_kv_replicate_put(const char *key, const char *value, const char *client_id);
 int			pgraft_kv_replicate_delete(const char *key, const char *client_id);
+int			pgraft_kv_replicate_patch(const char *key, const char *patch, int64_t expected_version,
+									  const char *client_id);
 
 /* Key/Value log application */
 int			pgraft_kv_apply_log_entry(const pgraft_kv_log_entry_t *log_entry, int64_t log_index);
@@ -76,16 +208,59 @@ int			pgraft_kv_load_from_disk(const char *path);
 
 /* Key/Value statistics and monitoring */
 int			pgraft_kv_get_stats(pgraft_kv_store_t *stats);
+int			pgraft_kv_get_value_stats(pgraft_kv_value_stats_t *rows, int max_rows);
 void		pgraft_kv_list_keys(char *keys_json, size_t json_size);
 
+/* Change feed for the pgraft.kv materializer */
+void		pgraft_kv_get_revisions(uint64 *revision, uint64 *resync_revision);
+int			pgraft_kv_count_changes(uint64 since);
+int			pgraft_kv_collect_changes(uint64 since, int max_changes, pgraft_kv_change_t *changes,
+									  uint64 *through);
+
+/* Hash tree */
+int			pgraft_kv_get_hash(uint64 revision, uint64 *hash, uint64 *hash_revision,
+							   uint64 *compact_revision);
+uint64		pgraft_kv_get_hash_level(int level, uint64 *hashes);
+
+/* Quota usage */
+typedef void (*pgraft_kv_counted_callback) (int64 keys, int64 bytes, uint64 resync_revision, void *arg);
+int			pgraft_kv_value_size(const char *key);
+void		pgraft_kv_count_prefix(const char *prefix, pgraft_kv_counted_callback counted, void *arg);
+
+/* Bulk export (pgraft_kv_export()) and batched imports (pgraft_kv_import()) */
+typedef void (*pgraft_kv_export_callback) (const pgraft_kv_change_t *change, void *arg);
+int			pgraft_kv_export(uint64 changed_since, pgraft_kv_export_callback emit, void *arg,
+							 uint64 *revision, uint64 *horizon);
+int			pgraft_kv_apply_batch(uint64 raft_index, const char *json_data, size_t len);
+
+/* Reads and leases of the client gateway (pgraft_kv_gateway.c) */
+typedef void (*pgraft_kv_read_callback) (const pgraft_kv_entry_t *entry, const char *value, void *arg);
+bool		pgraft_kv_read(const char *key, pgraft_kv_entry_t *entry, char *value, size_t value_size);
+int64		pgraft_kv_range(const char *start, const char *end, int64 limit, bool keys_only,
+							pgraft_kv_read_callback emit, void *arg, uint64 *revision);
+void		pgraft_kv_scan_leased(pgraft_kv_read_callback visit, void *arg);
+void		pgraft_kv_defer_save(bool defer);
+bool		pgraft_kv_lease_grant(int64_t id, int64_t ttl, int64_t now);
+bool		pgraft_kv_lease_keepalive(int64_t id, int64_t now);
+bool		pgraft_kv_lease_revoke(int64_t id, int64_t now, bool expire, int64_t log_index);
+bool		pgraft_kv_lease_get(int64_t id, pgraft_kv_lease_t *lease);
+int			pgraft_kv_lease_list(pgraft_kv_lease_t *leases, int max_leases);
+
+/* Tiering */
+void		pgraft_kv_set_spill_horizon(uint64 revision);
+Size		pgraft_kv_hot_bytes(const pgraft_kv_store_t *store);
+
 /* Key/Value cleanup and maintenance */
 void		pgraft_kv_compact(void);
+void		pgraft_kv_defragment(void);
 void		pgraft_kv_reset(void);
 
 /* Key/Value replication operations */
 int			pgraft_kv_replicate_put(const char *key, const char *value, const char *client_id);
 int			pgraft_kv_replicate_delete(const char *key, const char *client_id);
-int			pgraft_kv_queue_operation(pgraft_kv_op_type_t op_type, const char *key, const char *value, const char *client_id);
+int			pgraft_kv_group_for_key(const char *key);
+int			pgraft_kv_queue_operation(pgraft_kv_op_type_t op_type, const char *key, const char *value,
+									  int64_t expected_version, const char *client_id);
 
 /* Local KV operations (for apply callback) */
 int			pgraft_kv_put_local(const char *key, const char *value);
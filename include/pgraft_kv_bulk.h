@@ -0,0 +1,59 @@
+#ifndef PGRAFT_KV_BULK_H
+#define PGRAFT_KV_BULK_H
+
+#include "postgres.h"
+#include "portability/instr_time.h"
+
+#include "pgraft_core.h"
+
+/*
+ * Bulk KV import
+ *
+ * pgraft_kv_import() proposes keys many at a time instead of one Raft
+ * entry each.  Keys are gathered per Raft group into kv_batch entries,
+ * each as large as a proposal ring slot takes, and a batch is proposed as
+ * soon as the next key would not fit.  Every node applies a batch's puts
+ * and deletes in order and saves the store once for all of them.
+ *
+ * Each key is checked like a single write first: length limits and
+ * namespace quotas.  Batches go through the proposal ring only; when it
+ * cannot take one, its keys are queued for the worker one at a time.
+ */
+#define PGRAFT_KV_BATCH_MAX_ITEMS	512
+
+/* Room left in an entry for its type, timestamp and client id */
+#define PGRAFT_KV_BATCH_ENVELOPE	192
+
+/* One key of a kv_batch entry */
+typedef struct pgraft_kv_batch_item
+{
+	char	   *key;
+	char	   *value;			/* NULL to delete the key */
+}			pgraft_kv_batch_item_t;
+
+/* Keys waiting to be proposed to one group */
+typedef struct pgraft_kv_batch
+{
+	MemoryContext context;		/* Holds the keys and values; reset once proposed */
+	int32_t		term;			/* Term we lead the group in, 0 before the first key */
+	int			count;
+	size_t		size;			/* Encoded size of the items so far */
+	instr_time	started;		/* When the first key was added */
+	pgraft_kv_batch_item_t items[PGRAFT_KV_BATCH_MAX_ITEMS];
+}			pgraft_kv_batch_t;
+
+/* An import in progress */
+typedef struct pgraft_kv_import
+{
+	char		client_id[64];
+	int64		keys;			/* Keys proposed so far */
+	int64		entries;		/* Raft entries they took */
+	pgraft_kv_batch_t *batches[PGRAFT_MAX_GROUPS];
+}			pgraft_kv_import_t;
+
+/* Leader only: propose keys in batches, value NULL deleting the key */
+pgraft_kv_import_t *pgraft_kv_import_begin(void);
+void		pgraft_kv_import_add(pgraft_kv_import_t *import, const char *key, const char *value);
+int64		pgraft_kv_import_finish(pgraft_kv_import_t *import);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef PGRAFT_KV_COLD_H
+#define PGRAFT_KV_COLD_H
+
+#include "postgres.h"
+
+#include "pgraft_kv.h"
+
+/*
+ * Cold tier of the KV store
+ *
+ * Keys evicted from shared memory live in a hash table on disk: a file of
+ * fixed-size records addressed by the hash of the key and probed linearly,
+ * rebuilt at twice the size when it gets three quarters full.  Values are
+ * kept exactly as they were stored in the arena, compressed or not.  The
+ * file is node-local, like the shared memory store it extends, and sits in
+ * the data directory since it can grow far beyond shared memory.
+ *
+ * None of these functions lock anything: callers serialize on the store's
+ * cold tier LWLock, shared for lookups and exclusive for changes.
+ */
+#define PGRAFT_KV_COLD_FILE "pgraft_kv_cold.dat"
+
+/* Named LWLock tranche of the cold tier lock, requested in pgraft.c */
+#define PGRAFT_KV_COLD_TRANCHE "pgraft_kv_cold"
+
+typedef struct pgraft_kv_cold_record
+{
+	uint32		state;			/* Empty, used or removed */
+	uint32		hash;			/* hash_bytes() of the key */
+	pgraft_kv_entry_t entry;	/* The entry as it was in shared memory */
+	char		data[PGRAFT_KV_VALUE_SIZE];	/* Its stored value */
+}			pgraft_kv_cold_record_t;
+
+/* Number of keys in the file, checking it can be used */
+int64		pgraft_kv_cold_count(void);
+int64		pgraft_kv_cold_file_size(void);
+
+bool		pgraft_kv_cold_fetch(const char *key, pgraft_kv_cold_record_t *record);
+
+/* Visit every key in the file */
+typedef void (*pgraft_kv_cold_callback) (const pgraft_kv_cold_record_t *record, void *arg);
+void		pgraft_kv_cold_scan(pgraft_kv_cold_callback callback, void *arg);
+
+/*
+ * Reading the file a chunk at a time
+ *
+ * The cursor keeps reading the file it opened even if a rebuild replaces
+ * it meanwhile, so no record is seen twice or skipped for moving slots.
+ * Callers hold the cold tier lock shared while opening the cursor and while
+ * reading each chunk, and may release it in between.
+ */
+typedef struct pgraft_kv_cold_cursor
+{
+	int			fd;
+	uint64		num_slots;
+	uint64		next_slot;		/* First slot not read yet */
+	pgraft_kv_cold_record_t *records;	/* Used records of the last chunk */
+	int			count;
+}			pgraft_kv_cold_cursor_t;
+
+bool		pgraft_kv_cold_cursor_open(pgraft_kv_cold_cursor_t *cursor);
+bool		pgraft_kv_cold_cursor_next(pgraft_kv_cold_cursor_t *cursor);
+void		pgraft_kv_cold_cursor_close(pgraft_kv_cold_cursor_t *cursor);
+
+/* Changes are on disk when they return, and report the number of keys left */
+int64		pgraft_kv_cold_store(const pgraft_kv_entry_t *entry, const char *data);
+bool		pgraft_kv_cold_remove(const char *key, int64 *count);
+void		pgraft_kv_cold_reset(void);
+
+#endif
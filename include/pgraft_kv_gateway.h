@@ -0,0 +1,116 @@
+#ifndef PGRAFT_KV_GATEWAY_H
+#define PGRAFT_KV_GATEWAY_H
+
+#include "postgres.h"
+
+#include "pgraft_kv.h"
+
+/*
+ * C side of the client gateway (pgraft.client_gateway)
+ *
+ * The Go layer serves the etcd v3 JSON API, but the KV store stays the
+ * only copy of the data: the worker answers the gateway's reads from it,
+ * and everything a write depends on is decided where it is applied.  A
+ * Txn is one kv_txn entry whose compares are evaluated against the store
+ * by every node applying it, and leases are a table in the store kept by
+ * lease_grant, lease_keepalive and lease_revoke entries of group 0.
+ *
+ * A key's mod revision is the Raft log index of its last write and its
+ * create revision that of the write that created it; the header revision
+ * is the highest index applied to the store.  With one Raft group these
+ * are etcd revisions.  With several they are indexes of different logs,
+ * so they are only ordered per group: a compare against a key's mod
+ * revision still works, ordering keys of different groups by it does not.
+ *
+ * Leases expire on the group 0 leader, which proposes a lease_revoke for
+ * every lease whose TTL ran out by the timestamps the entries carry.
+ * Revoking deletes the group 0 keys attached to the lease in the same
+ * entry; keys of other groups are deleted by a kv_txn per key, proposed
+ * by the leader's sweep, that only deletes the key if it is still on the
+ * lease.
+ */
+
+/* What a Txn compare looks at */
+typedef enum pgraft_kv_compare_target
+{
+	PGRAFT_KV_COMPARE_VERSION = 0,
+	PGRAFT_KV_COMPARE_CREATE = 1,
+	PGRAFT_KV_COMPARE_MOD = 2,
+	PGRAFT_KV_COMPARE_VALUE = 3,
+	PGRAFT_KV_COMPARE_LEASE = 4
+} pgraft_kv_compare_target_t;
+
+typedef enum pgraft_kv_compare_result
+{
+	PGRAFT_KV_COMPARE_EQUAL = 0,
+	PGRAFT_KV_COMPARE_GREATER = 1,
+	PGRAFT_KV_COMPARE_LESS = 2,
+	PGRAFT_KV_COMPARE_NOT_EQUAL = 3
+} pgraft_kv_compare_result_t;
+
+/* One compare; a missing key has version, revisions and lease 0 */
+typedef struct pgraft_kv_compare
+{
+	char	   *key;
+	pgraft_kv_compare_target_t target;
+	pgraft_kv_compare_result_t result;
+	int64		number;			/* Every target but VALUE */
+	char	   *value;			/* VALUE */
+}			pgraft_kv_compare_t;
+
+/* One write of a Txn branch */
+typedef struct pgraft_kv_txn_op
+{
+	bool		is_delete;
+	char	   *key;
+	char	   *range_end;		/* Deletes: NULL for the key alone, "" for every key from it */
+	char	   *value;			/* Puts */
+	int64		lease;			/* Puts */
+}			pgraft_kv_txn_op_t;
+
+/* A kv_txn entry, carried in the log of the group owning its keys */
+typedef struct pgraft_kv_txn
+{
+	int			group;
+	pgraft_kv_compare_t *compares;
+	int			num_compares;
+	pgraft_kv_txn_op_t *success;
+	int			num_success;
+	pgraft_kv_txn_op_t *failure;
+	int			num_failure;
+}			pgraft_kv_txn_t;
+
+/* Lease operation as carried in the Raft log */
+typedef enum pgraft_kv_lease_op_type
+{
+	PGRAFT_KV_LEASE_GRANT = 1,
+	PGRAFT_KV_LEASE_KEEPALIVE = 2,
+	PGRAFT_KV_LEASE_REVOKE = 3
+} pgraft_kv_lease_op_type_t;
+
+typedef struct pgraft_kv_lease_op
+{
+	pgraft_kv_lease_op_type_t op_type;
+	int64		lease;
+	int64		ttl;			/* Grants */
+	int64		timestamp;		/* Proposer's clock, PostgreSQL epoch microseconds */
+	bool		expire;			/* Revokes: only if expired by timestamp */
+}			pgraft_kv_lease_op_t;
+
+/* Apply committed kv_txn and lease_* entries (all nodes) */
+int			pgraft_kv_txn_apply(uint64 raft_index, const char *json_data, size_t len);
+int			pgraft_kv_lease_apply(uint64 raft_index, const char *json_data, size_t len);
+
+/* After every applied entry: tell the gateway its outcome */
+void		pgraft_kv_gateway_applied(uint64 raft_index, const char *json_data, size_t len, bool applied);
+
+/* Changes to the store, for the gateway's watches */
+bool		pgraft_kv_gateway_active(void);
+void		pgraft_kv_gateway_publish(const pgraft_kv_entry_t *entry, const char *value,
+									  const pgraft_kv_entry_t *prev, const char *prev_value);
+
+/* Worker: answer the gateway's reads; on the group 0 leader, expire leases */
+void		pgraft_kv_gateway_serve(void);
+void		pgraft_kv_gateway_expire(void);
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef PGRAFT_KV_QUOTA_H
+#define PGRAFT_KV_QUOTA_H
+
+#include "postgres.h"
+#include "port/atomics.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+#include "pgraft_kv.h"
+
+/*
+ * KV namespace quotas
+ *
+ * A quota limits the keys starting with a prefix to a number of live keys,
+ * a number of bytes (key plus value) and a rate of writes.  Quotas are
+ * set and dropped through Raft, like counters, so every node has them and
+ * a new leader enforces them right away.  Each node also keeps the usage
+ * of every quota prefix up to date as it applies KV changes; usage is
+ * recounted from the store, both tiers, whenever the store has dropped
+ * entries wholesale since it was last counted.
+ *
+ * The leader checks the quotas of a key before proposing a write to it,
+ * whether the write comes from the KV functions, the client gateway or an
+ * entry appended with pgraft_log_append().  Writes already proposed but
+ * not yet applied are not in the usage, so a burst can overshoot the key
+ * and byte limits by what is in flight; the write rate limit bounds that.  Deletes only count against the write
+ * rate, and writes that do not add keys or bytes are never refused for
+ * being over the key or byte limit.
+ *
+ * Slots are never reused for another prefix, so that the apply process
+ * can find a key's quotas without a lock while backends recount them.
+ */
+#define PGRAFT_KV_MAX_QUOTAS		128
+#define PGRAFT_KV_QUOTA_PREFIX_LEN	128
+
+/* Outcome of checking a write against its quotas */
+#define PGRAFT_KV_QUOTA_ADMITTED	0
+#define PGRAFT_KV_QUOTA_KEYS		1	/* Over the key limit */
+#define PGRAFT_KV_QUOTA_BYTES		2	/* Over the byte limit */
+#define PGRAFT_KV_QUOTA_RATE		3	/* Over the write rate */
+#define PGRAFT_KV_QUOTA_NEED_SIZE	4	/* Call again with the key's current size */
+
+/* Current size of a key the caller has not read */
+#define PGRAFT_KV_QUOTA_SIZE_UNKNOWN	(-2)
+
+/* Quota operation as carried in the Raft log */
+typedef struct pgraft_kv_quota_op
+{
+	char		prefix[PGRAFT_KV_QUOTA_PREFIX_LEN];
+	bool		drop;
+	int64		max_keys;		/* 0 means no limit */
+	int64		max_bytes;
+	int32		max_write_rate;	/* Writes per second */
+	uint64		request;		/* Proposer-local request id */
+	int32		term;			/* Term of the proposing leader */
+	int32		node_id;		/* Proposing node */
+}			pgraft_kv_quota_op_t;
+
+/* One quota prefix */
+typedef struct pgraft_kv_quota
+{
+	char		prefix[PGRAFT_KV_QUOTA_PREFIX_LEN];	/* Never changes once set */
+	int			prefix_len;
+
+	/* Replicated limits, identical on every node once applied */
+	bool		in_use;			/* False once dropped */
+	int64		max_keys;
+	int64		max_bytes;
+	int32		max_write_rate;
+	uint64		request;		/* Last operation applied */
+	int32		term;
+	int32		node_id;
+
+	/* Node-local usage, changed under the KV store mutex */
+	pg_atomic_uint64 keys;
+	pg_atomic_uint64 bytes;
+	pg_atomic_uint64 counted_at;	/* Store resync revision + 1, 0 if not counted */
+
+	/* Leader-local admission state */
+	double		tokens;			/* Writes the rate limit still allows */
+	TimestampTz refilled_at;
+	int64		admitted;
+	int64		refused_keys;
+	int64		refused_bytes;
+	int64		refused_rate;
+}			pgraft_kv_quota_t;
+
+/* Quota table in shared memory */
+typedef struct pgraft_kv_quota_state
+{
+	slock_t		mutex;			/* Limits and admission state */
+	pg_atomic_uint32 num_quotas;	/* Slots set up, in use or dropped */
+	uint64		next_request;
+	pgraft_kv_quota_t quotas[PGRAFT_KV_MAX_QUOTAS];
+}			pgraft_kv_quota_state_t;
+
+/* Shared memory */
+void		pgraft_kv_quota_init_shared_memory(void);
+pgraft_kv_quota_state_t *pgraft_kv_quota_get_state(void);
+
+/* Set or drop a quota through Raft (leader only); drop returns false if there was none */
+void		pgraft_kv_quota_set(const char *prefix, int64 max_keys, int64 max_bytes, int32 max_write_rate);
+bool		pgraft_kv_quota_drop(const char *prefix);
+
+/* Refuse a write the key's quotas do not allow, on the leader before proposing it */
+void		pgraft_kv_quota_admit(pgraft_kv_op_type_t op_type, const char *key, const char *value);
+
+/* The same for a client gateway write; any thread, returns PGRAFT_KV_QUOTA_* */
+int			pgraft_kv_quota_admit_gateway(const char *key, int is_delete, int64_t value_size, int64_t old_size);
+
+/* The same for the KV writes of an entry appended to the log as it is */
+void		pgraft_kv_quota_admit_entry(const char *json_data, size_t len);
+
+/* Worker: recount stale usage for the client gateway's checks */
+void		pgraft_kv_quota_refresh(void);
+
+/* Usage of a quota, recounted first if the store changed wholesale */
+void		pgraft_kv_quota_usage(pgraft_kv_quota_t *quota, int64 *keys, int64 *bytes);
+
+/* Account an applied change of a key; sizes are -1 when it does not exist */
+void		pgraft_kv_quota_account(const char *key, int old_size, int new_size);
+
+/* Apply a committed quota entry (all nodes) */
+int			pgraft_kv_quota_apply(uint64 raft_index, const char *json_data, size_t len);
+
+#endif
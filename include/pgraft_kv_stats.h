@@ -0,0 +1,100 @@
+#ifndef PGRAFT_KV_STATS_H
+#define PGRAFT_KV_STATS_H
+
+#include "postgres.h"
+#include "port/atomics.h"
+#include "portability/instr_time.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+/*
+ * Per-namespace KV statistics and hot keys
+ *
+ * A key's namespace is its first pgraft.kv_namespace_depth '/'-separated
+ * segments, a leading '/' included: "/orders/eu/42" is in "/orders/" at
+ * depth 1.  Counters for up to PGRAFT_KV_NAMESPACE_SLOTS namespaces live in
+ * an open-addressing table whose slots are claimed once under the mutex and
+ * then found and bumped with atomics only; further namespaces share an
+ * overflow slot.
+ *
+ * The hottest keys are tracked by a count-min sketch per kind of access
+ * and a short list of the keys with the highest estimates.  Every access
+ * adds to the sketch without a lock; the mutex is only taken when a key
+ * not in the list overtakes its coldest member.
+ *
+ * Reads are counted on the node they are made on, puts and deletes when
+ * they are applied, so on every node, and proposals on the leader that
+ * admits them.
+ */
+#define PGRAFT_KV_NAMESPACE_SIZE	128	/* Longer namespaces are truncated */
+#define PGRAFT_KV_NAMESPACE_SLOTS	256
+#define PGRAFT_KV_SKETCH_DEPTH		4
+#define PGRAFT_KV_SKETCH_WIDTH		2048
+#define PGRAFT_KV_HOT_KEYS			32
+
+typedef enum pgraft_kv_access
+{
+	PGRAFT_KV_ACCESS_READ = 0,
+	PGRAFT_KV_ACCESS_WRITE = 1
+} pgraft_kv_access_t;
+
+#define PGRAFT_KV_ACCESS_KINDS		2
+
+typedef struct pgraft_kv_namespace_stats
+{
+	pg_atomic_uint32 used;			/* Set once prefix is filled in */
+	uint32		hash;
+	char		prefix[PGRAFT_KV_NAMESPACE_SIZE];
+	pg_atomic_uint64 reads;
+	pg_atomic_uint64 read_misses;
+	pg_atomic_uint64 read_bytes;
+	pg_atomic_uint64 read_time_ns;
+	pg_atomic_uint64 puts;
+	pg_atomic_uint64 deletes;
+	pg_atomic_uint64 write_bytes;
+	pg_atomic_uint64 proposals;
+	pg_atomic_uint64 proposal_time_ns;
+}			pgraft_kv_namespace_stats_t;
+
+typedef struct pgraft_kv_sketch
+{
+	pg_atomic_uint64 counters[PGRAFT_KV_SKETCH_DEPTH][PGRAFT_KV_SKETCH_WIDTH];
+	pg_atomic_uint64 total;			/* Accesses counted */
+	pg_atomic_uint64 threshold;		/* Estimate a key must pass to enter the list */
+	pg_atomic_uint64 hashes[PGRAFT_KV_HOT_KEYS];	/* Listed keys' hashes, 0 if free */
+	char		keys[PGRAFT_KV_HOT_KEYS][256];
+}			pgraft_kv_sketch_t;
+
+typedef struct pgraft_kv_stats_state
+{
+	slock_t		mutex;				/* Claiming slots and changing hot key lists */
+	TimestampTz stats_reset;
+	pgraft_kv_namespace_stats_t namespaces[PGRAFT_KV_NAMESPACE_SLOTS];
+	pgraft_kv_namespace_stats_t overflow;
+	pgraft_kv_sketch_t sketches[PGRAFT_KV_ACCESS_KINDS];
+}			pgraft_kv_stats_state_t;
+
+/* A hot key as reported by pgraft_kv_hot_keys() */
+typedef struct pgraft_kv_hot_key
+{
+	char		key[256];
+	uint64		estimate;			/* Never below the true count */
+}			pgraft_kv_hot_key_t;
+
+/* Shared memory */
+void		pgraft_kv_stats_init_shared_memory(void);
+pgraft_kv_stats_state_t *pgraft_kv_stats_get_shared_memory(void);
+
+/* Bytes of a key that make up its namespace */
+int			pgraft_kv_namespace_length(const char *key);
+
+/* Counting; start is when the operation began */
+void		pgraft_kv_stats_read(const char *key, int value_bytes, instr_time start);
+void		pgraft_kv_stats_write(const char *key, bool deleted, int value_bytes);
+void		pgraft_kv_stats_proposal(const char *key, instr_time start);
+
+/* Reporting */
+int			pgraft_kv_stats_hot_keys(pgraft_kv_access_t kind, pgraft_kv_hot_key_t *keys, uint64 *total);
+void		pgraft_kv_stats_reset(void);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef PGRAFT_KV_SYNC_H
+#define PGRAFT_KV_SYNC_H
+
+#include "postgres.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+/*
+ * pgraft.kv materializer
+ *
+ * A background worker connected to pgraft.kv_sync_database copies the
+ * entries changed in the shared memory KV store into the pgraft.kv table,
+ * one transaction per batch of up to pgraft.kv_sync_batch_size keys.  Only
+ * the latest state of each key is written, so a key rewritten many times
+ * between two batches costs one row.  After the store drops entries
+ * wholesale (compaction, reset, loading from disk) the table is rebuilt
+ * from the live keys.  Changes are read from both tiers of the store, so
+ * keys are evicted to the cold tier whether the table has them yet or not;
+ * only deletions stay in shared memory until the table has them.
+ */
+typedef struct pgraft_kv_sync_state
+{
+	slock_t		mutex;
+	pid_t		pid;					/* Worker pid, 0 when not running */
+	bool		synced;					/* Table rebuilt since the worker started */
+	uint64		materialized_revision;	/* Store revision pgraft.kv reflects */
+	uint64		resync_revision;		/* Store resync revision it was rebuilt after */
+	int64		batches;
+	int64		rows_upserted;
+	int64		rows_deleted;
+	int64		resyncs;
+	TimestampTz last_batch_at;
+}			pgraft_kv_sync_state_t;
+
+/* Shared memory */
+void		pgraft_kv_sync_init_shared_memory(void);
+pgraft_kv_sync_state_t *pgraft_kv_sync_get_shared_memory(void);
+
+/* Register the worker when pgraft.kv_sync_database is set */
+void		pgraft_kv_sync_register_worker(void);
+
+/* Background worker entry point */
+void		pgraft_kv_sync_main(Datum main_arg);
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * pgraft_lock.h
+ * Distributed locks and leader elections on replicated state
+ *
+ * Every acquire is a Raft entry whose log index becomes its revision.  A
+ * free lock is granted to the acquirer; otherwise the acquirer joins the
+ * lock's waiter queue, which is ordered by revision because entries apply
+ * in log order.  Ownership is backed by a lease: a holder that neither
+ * releases nor renews within its TTL is expired by the leader.  A queued
+ * waiter has a deadline too, which its backend renews while it waits, so
+ * that a waiter whose backend went away is dropped rather than granted the
+ * lock.  When a lock is handed to the next waiter, the node applying the
+ * entry sets that backend's latch directly.
+ *
+ * Elections are locks in their own namespace whose holder carries a value.
+ */
+
+#ifndef PGRAFT_LOCK_H
+#define PGRAFT_LOCK_H
+
+#include "postgres.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+
+#define PGRAFT_MAX_LOCKS			64
+#define PGRAFT_LOCK_MAX_WAITERS		32
+#define PGRAFT_LOCK_NAME_LEN		128
+#define PGRAFT_LOCK_VALUE_LEN		256
+
+/* Prefix that puts elections in their own lock namespace */
+#define PGRAFT_ELECTION_PREFIX		"election/"
+
+/* Replicated lock operation types */
+typedef enum pgraft_lock_op_type
+{
+	PGRAFT_LOCK_ACQUIRE = 1,
+	PGRAFT_LOCK_RELEASE = 2,
+	PGRAFT_LOCK_EXPIRE = 3,
+	PGRAFT_LOCK_CANCEL = 4,
+	PGRAFT_LOCK_RENEW = 5
+} pgraft_lock_op_type_t;
+
+/* Lock operation as carried in the Raft log */
+typedef struct pgraft_lock_op
+{
+	pgraft_lock_op_type_t op_type;
+	char		name[PGRAFT_LOCK_NAME_LEN];
+	int32		node_id;		/* Requesting node */
+	int32		pid;			/* Requesting backend */
+	int32		procno;			/* Requesting backend's PGPROC number */
+	int32		ttl_ms;			/* ACQUIRE: lease length */
+	int64		revision;		/* EXPIRE: revision of the holder or waiter to expire */
+	int64		now;			/* Leader clock when proposed */
+	char		value[PGRAFT_LOCK_VALUE_LEN];	/* ACQUIRE: election value */
+} pgraft_lock_op_t;
+
+/* A holder or a queued waiter */
+typedef struct pgraft_lock_owner
+{
+	int32		node_id;
+	int32		pid;
+	int32		procno;
+	int32		ttl_ms;
+	int64		revision;		/* Raft index of the acquire entry */
+	int64		expires;		/* Waiters: leader clock after which they are dropped */
+	char		value[PGRAFT_LOCK_VALUE_LEN];
+} pgraft_lock_owner_t;
+
+/* One lock */
+typedef struct pgraft_lock
+{
+	bool		in_use;
+	char		name[PGRAFT_LOCK_NAME_LEN];
+	bool		held;
+	pgraft_lock_owner_t holder;
+	int64		lease_expires;	/* Leader clock; holder is expired after this */
+	pgraft_lock_owner_t waiters[PGRAFT_LOCK_MAX_WAITERS];	/* Revision order */
+	int32		num_waiters;
+	int64		acquisitions;
+	int64		handoffs;		/* Grants made straight to a waiter */
+	int64		expirations;
+} pgraft_lock_t;
+
+/* Lock table in shared memory */
+typedef struct pgraft_lock_state
+{
+	pgraft_lock_t locks[PGRAFT_MAX_LOCKS];
+	int64		last_applied_index;
+	slock_t		mutex;
+} pgraft_lock_state_t;
+
+/* Shared memory */
+void		pgraft_lock_init_shared_memory(void);
+pgraft_lock_state_t *pgraft_lock_get_state(void);
+
+/* Lock operations (leader only); acquire returns the holder revision */
+int64		pgraft_lock_acquire(const char *name, int32 ttl_ms, const char *value);
+bool		pgraft_lock_release(const char *name);
+
+/* Extend the lease of a lock held by this backend; false if it does not hold it */
+bool		pgraft_lock_renew(const char *name);
+
+/* Current holder's value; false if the lock is free */
+bool		pgraft_lock_get_holder(const char *name, pgraft_lock_owner_t *holder);
+
+/* Apply a committed lock entry (all nodes) */
+int			pgraft_lock_apply(uint64 raft_index, const char *json_data, size_t len);
+
+/* Leader housekeeping: propose expiry for holders and waiters past their time */
+void		pgraft_lock_expire_leases(void);
+
+#endif							/* PGRAFT_LOCK_H */
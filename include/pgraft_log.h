@@ -4,63 +4,81 @@
 #include "postgres.h"
 #include "storage/shmem.h"
 #include "storage/spin.h"
+#include "storage/condition_variable.h"
+#include "utils/timestamp.h"
 
-/* Log entry structure */
-typedef struct pgraft_log_entry
+/*
+ * Raft log inspection
+ *
+ * The Raft log lives in the Go layer's storage, which only the background
+ * worker can reach, so nothing is mirrored into shared memory.  Instead a
+ * single request slot lets a backend ask for one page at a time: it claims
+ * the slot, posts the starting index and page size, and sleeps on the slot's
+ * condition variable while the worker has Go copy the entries straight out
+ * of storage into the slot's page.  Backends copy the page out and free the
+ * slot before building any tuples.
+ */
+#define PGRAFT_LOG_PAGE_ENTRIES		256
+#define PGRAFT_LOG_PAGE_BYTES		(64 * 1024)
+
+/* Entry types, numbered as raftpb.EntryType */
+#define PGRAFT_LOG_ENTRY_NORMAL			0
+#define PGRAFT_LOG_ENTRY_CONF_CHANGE	1
+#define PGRAFT_LOG_ENTRY_CONF_CHANGE_V2	2
+
+/* One page of the Raft log; payloads are packed into data[] */
+typedef struct pgraft_log_page
+{
+	/* Log bounds when the page was read */
+	uint64		first_index;
+	uint64		last_index;
+	uint64		commit_index;
+	uint64		persist_errors;		/* Failed writes of the log to disk */
+
+	int32_t		num_entries;
+	uint64		index[PGRAFT_LOG_PAGE_ENTRIES];
+	uint64		term[PGRAFT_LOG_PAGE_ENTRIES];
+	int32_t		type[PGRAFT_LOG_PAGE_ENTRIES];
+	int32_t		size[PGRAFT_LOG_PAGE_ENTRIES];		/* Full payload size */
+	int32_t		offset[PGRAFT_LOG_PAGE_ENTRIES];	/* Payload offset in data[] */
+	int32_t		length[PGRAFT_LOG_PAGE_ENTRIES];	/* Bytes present, < size if truncated */
+	char		data[PGRAFT_LOG_PAGE_BYTES];
+}			pgraft_log_page_t;
+
+/* Request slot states */
+typedef enum
 {
-	int64_t		index;			/* Log index */
-	int64_t		term;			/* Term when entry was created */
-	int64_t		timestamp;		/* Timestamp when entry was created */
-	char		data[1024];		/* Log entry data */
-	int32_t		data_size;		/* Size of data */
-	int32_t		committed;		/* 1 if committed, 0 if not */
-	int32_t		applied;		/* 1 if applied, 0 if not */
-}			pgraft_log_entry_t;
+	LOG_SLOT_IDLE = 0,
+	LOG_SLOT_REQUESTED = 1,		/* Posted by a backend, waiting for the worker */
+	LOG_SLOT_SERVING = 2,		/* Worker is filling the page */
+	LOG_SLOT_READY = 3,			/* Page holds the answer */
+	LOG_SLOT_FAILED = 4			/* Raft is not running */
+}			LOG_SLOT_STATUS;
 
-/* Log replication state */
+/* Request slot in shared memory */
 typedef struct pgraft_log_state
 {
-	/* Log entries array */
-	pgraft_log_entry_t entries[1000];	/* Support up to 1000 log entries */
-	int32_t		log_size;		/* Current number of log entries */
-	int64_t		last_index;		/* Last log index */
-	int64_t		commit_index;	/* Last committed index */
-	int64_t		last_applied;	/* Last applied index */
-	
-	/* Replication metrics */
-	int64_t		entries_replicated;	/* Number of entries replicated */
-	int64_t		entries_committed;	/* Number of entries committed */
-	int64_t		entries_applied;	/* Number of entries applied */
-	int64_t		replication_errors;	/* Number of replication errors */
-	
-	/* Mutex for thread safety */
+	LOG_SLOT_STATUS status;
+	int			owner_pid;			/* Backend that claimed the slot */
+	bool		abandoned;			/* Owner gave up while the worker was serving */
+	TimestampTz status_time;		/* Last status change */
+	uint64		from_index;
+	int32_t		max_entries;
+	pgraft_log_page_t page;
+
+	ConditionVariable cv;			/* Broadcast on every status change */
 	slock_t		mutex;
 }			pgraft_log_state_t;
 
-/* Log replication functions */
+/* Log inspection functions */
 void		pgraft_log_init_shared_memory(void);
 pgraft_log_state_t *pgraft_log_get_shared_memory(void);
-
-/* Log entry management */
-int			pgraft_log_append_entry(int64_t term, const char *data, int32_t data_size);
-int			pgraft_log_commit_entry(int64_t index);
-int			pgraft_log_apply_entry(int64_t index);
-int			pgraft_log_get_entry(int64_t index, pgraft_log_entry_t *entry);
-int			pgraft_log_get_last_index(int64_t *last_index);
-int			pgraft_log_get_commit_index(int64_t *commit_index);
-int			pgraft_log_get_last_applied(int64_t *last_applied);
+bool		pgraft_log_read_page(uint64 from_index, int max_entries, pgraft_log_page_t *page);
+void		pgraft_log_serve_request(void);
+const char *pgraft_log_entry_type_name(int32_t type);
 
 /* Log replication */
-int			pgraft_log_replicate_to_node(int32_t node_id, int64_t from_index);
 int			pgraft_log_replicate_from_leader(int32_t leader_id, int64_t from_index);
 int			pgraft_log_sync_with_leader(void);
 
-/* Log statistics */
-int			pgraft_log_get_statistics(pgraft_log_state_t *stats);
-int			pgraft_log_get_replication_status(char *status, size_t status_size);
-
-/* Log cleanup */
-void		pgraft_log_cleanup_old_entries(int64_t before_index);
-void		pgraft_log_reset(void);
-
 #endif
@@ -0,0 +1,50 @@
+#ifndef PGRAFT_PROPOSAL_H
+#define PGRAFT_PROPOSAL_H
+
+#include "postgres.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+
+#include "pgraft_go.h"
+
+/*
+ * Direct proposals
+ *
+ * KV writes reach Raft without going through the background worker's
+ * command loop.  A backend claims the next slot of a ring in shared memory,
+ * copies its encoded entry in and posts the ring's semaphore; a goroutine
+ * of the Go layer, started in the worker, wakes up, proposes the entry and
+ * posts the slot's semaphore with the result.  Claiming and filling happen
+ * under the ring's spinlock, so slots become ready strictly in ring order.
+ *
+ * The ring needs process-shared unnamed POSIX semaphores.  Where they are
+ * not available, or while no goroutine consumes the ring, or when the ring
+ * is full, writes take the worker's command queue as before.
+ */
+typedef struct pgraft_proposal_state
+{
+	pgraft_go_proposal_ring_t ring;
+
+	slock_t		mutex;			/* Protects head and slot claiming */
+	uint64		head;			/* Next slot to claim */
+	int64		direct;			/* Writes proposed through the ring */
+	int64		fallbacks;		/* Writes sent to the command queue instead */
+}			pgraft_proposal_state_t;
+
+/* Proposal submission results */
+#define PGRAFT_PROPOSAL_SUBMITTED		0
+#define PGRAFT_PROPOSAL_TIMED_OUT		(-1)
+#define PGRAFT_PROPOSAL_UNAVAILABLE		1
+
+/* Shared memory */
+void		pgraft_proposal_init_shared_memory(void);
+pgraft_proposal_state_t *pgraft_proposal_get_shared_memory(void);
+
+/* Background worker: start the Go goroutine on the ring */
+void		pgraft_proposal_attach(void);
+
+/* Backends: propose an encoded entry to a group */
+int			pgraft_proposal_submit(int group, int32_t term, const char *data, int length,
+								   int timeout_ms);
+
+#endif
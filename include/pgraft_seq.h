@@ -0,0 +1,83 @@
+/*
+ * pgraft_seq.h
+ * Replicated sequence allocator with leader-side range leasing
+ *
+ * The replicated state of a sequence is a single high-water mark: every id
+ * below reserved_to has been leased to some leader.  A leader extends it by
+ * proposing one "seq_lease" entry for a whole range and then hands out ids
+ * from that range in memory.  Leases apply as compare-and-set on the start
+ * of the range, so two leaders can never be granted overlapping ranges.
+ */
+
+#ifndef PGRAFT_SEQ_H
+#define PGRAFT_SEQ_H
+
+#include "postgres.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+
+#define PGRAFT_MAX_SEQUENCES	64
+#define PGRAFT_SEQ_NAME_LEN		64
+
+/* Replicated sequence operation types */
+typedef enum pgraft_seq_op_type
+{
+	PGRAFT_SEQ_CREATE = 1,
+	PGRAFT_SEQ_LEASE = 2
+} pgraft_seq_op_type_t;
+
+/* Sequence operation as carried in the Raft log */
+typedef struct pgraft_seq_op
+{
+	pgraft_seq_op_type_t op_type;
+	char		name[PGRAFT_SEQ_NAME_LEN];
+	int64		start;			/* LEASE: first id, must equal reserved_to */
+	int64		end;			/* LEASE: one past the last id */
+	int32		term;			/* Term of the proposing leader */
+	int32		node_id;		/* Proposing node */
+} pgraft_seq_op_t;
+
+/* One sequence */
+typedef struct pgraft_seq
+{
+	bool		in_use;
+	char		name[PGRAFT_SEQ_NAME_LEN];
+
+	/* Replicated state, identical on every node once applied */
+	int64		reserved_to;	/* All ids below this are leased out */
+	int64		granted_start;	/* Last lease that took effect */
+	int64		granted_end;
+	int32		granted_term;
+	int32		granted_node;
+	int64		leases;			/* Number of leases granted */
+
+	/* Leader-local range, valid only while lease_term is the current term */
+	int64		next_id;		/* Next id to hand out */
+	int64		lease_end;		/* One past the last id of the local range */
+	int32		lease_term;
+	bool		lease_pending;	/* A backend is proposing a new lease */
+	int32		pending_term;
+	int64		ids_issued;		/* Ids handed out by this node */
+} pgraft_seq_t;
+
+/* Sequence table in shared memory */
+typedef struct pgraft_seq_state
+{
+	pgraft_seq_t seqs[PGRAFT_MAX_SEQUENCES];
+	int32		num_seqs;
+	int64		last_applied_index;
+	slock_t		mutex;
+} pgraft_seq_state_t;
+
+/* Shared memory */
+void		pgraft_seq_init_shared_memory(void);
+pgraft_seq_state_t *pgraft_seq_get_state(void);
+
+/* Sequence operations (leader only) */
+bool		pgraft_seq_create(const char *name);
+int64		pgraft_seq_next(const char *name, int64 count);
+
+/* Apply a committed sequence entry (all nodes) */
+int			pgraft_seq_apply(uint64 raft_index, const char *json_data, size_t len);
+
+#endif							/* PGRAFT_SEQ_H */
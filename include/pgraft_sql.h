@@ -31,6 +31,7 @@ Datum		pgraft_log_append(PG_FUNCTION_ARGS);
 Datum		pgraft_log_commit(PG_FUNCTION_ARGS);
 Datum		pgraft_log_apply(PG_FUNCTION_ARGS);
 Datum		pgraft_log_get_entry_sql(PG_FUNCTION_ARGS);
+Datum		pgraft_log_entries(PG_FUNCTION_ARGS);
 Datum		pgraft_log_get_stats_table(PG_FUNCTION_ARGS);
 Datum		pgraft_log_get_replication_status_table(PG_FUNCTION_ARGS);
 Datum		pgraft_log_sync_with_leader_sql(PG_FUNCTION_ARGS);
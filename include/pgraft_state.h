@@ -27,12 +27,6 @@ typedef struct pgraft_go_state
 	int64_t		go_leader_id;
 	char		go_raft_state[64];
 	
-	/* Node configuration */
-	int32_t		num_nodes;
-	int32_t		node_ids[16];
-	char		node_addresses[16][256];
-	int32_t		node_ports[16];
-	
 	/* Performance metrics */
 	int64_t		go_messages_processed;
 	int64_t		go_log_entries_committed;
@@ -57,10 +51,6 @@ void		pgraft_state_restore_go_raft_state(void);
 /* Node configuration persistence */
 void		pgraft_state_save_node_config(int32_t node_id, const char *address, int32_t port);
 void		pgraft_state_restore_node_config(int32_t *node_id, char *address, int32_t *port);
-void		pgraft_state_save_cluster_nodes(int32_t num_nodes, int32_t *node_ids,
-											char node_addresses[][256], int32_t *node_ports);
-void		pgraft_state_restore_cluster_nodes(int32_t *num_nodes, int32_t *node_ids,
-											   char node_addresses[][256], int32_t *node_ports);
 
 /* State validation */
 bool		pgraft_state_is_go_lib_loaded(void);
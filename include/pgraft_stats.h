@@ -0,0 +1,50 @@
+#ifndef PGRAFT_STATS_H
+#define PGRAFT_STATS_H
+
+#include "postgres.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "storage/condition_variable.h"
+#include "utils/timestamp.h"
+
+#include "pgraft_go.h"
+
+/*
+ * Cluster-wide statistics
+ *
+ * Each node's metrics are gathered by the Go layer, which asks every peer
+ * for a snapshot over the Raft peer connections.  Only the background worker
+ * reaches Go, so the last collected round is cached here: a backend serves
+ * it while it is younger than pgraft.cluster_stats_ttl, and otherwise raises
+ * the request flag and sleeps on the condition variable until the worker
+ * publishes a fresh round.  A backend that gives up waiting falls back to
+ * the stale round.
+ */
+typedef struct pgraft_stats_state
+{
+	bool		requested;			/* A backend wants a fresh round */
+	int32		requested_ttl;		/* Oldest round it accepts, in ms */
+	uint64		generation;			/* Bumped on every published round */
+	TimestampTz collected_at;		/* When the published round started */
+
+	ConditionVariable cv;			/* Broadcast on every published round */
+	slock_t		mutex;
+
+	int32		capacity;			/* Entries in nodes[], pgraft.max_nodes */
+	int32		num_nodes;
+	pgraft_go_node_stats_t nodes[FLEXIBLE_ARRAY_MEMBER];
+}			pgraft_stats_state_t;
+
+/* Shared memory */
+Size		pgraft_stats_shmem_size(void);
+void		pgraft_stats_init_shared_memory(void);
+pgraft_stats_state_t *pgraft_stats_get_shared_memory(void);
+
+/* Backend side: up to capacity rows, newer than ttl_ms if the worker answers */
+int			pgraft_stats_collect(int ttl_ms, pgraft_go_node_stats_t *nodes,
+								 TimestampTz *collected_at);
+
+/* Background worker side */
+void		pgraft_stats_serve_request(void);
+
+#endif
@@ -95,7 +95,12 @@ AS 'pgraft', 'pgraft_get_nodes_table';
 
 -- Get nodes directly from Raft cluster (works on replicas)
 CREATE OR REPLACE FUNCTION pgraft_get_nodes_from_raft()
-RETURNS text
+RETURNS TABLE(
+    node_id bigint,
+    name text,
+    address text,
+    active boolean
+)
 LANGUAGE C
 AS 'pgraft', 'pgraft_get_nodes_from_raft';
 
@@ -134,19 +139,19 @@ AS 'pgraft', 'pgraft_set_debug';
 -- Log Replication Functions
 -- ============================================================================
 
--- Append log entry
+-- Propose an entry to the Raft log (term is ignored, Raft assigns it)
 CREATE OR REPLACE FUNCTION pgraft_log_append(term bigint, data text)
 RETURNS boolean
 LANGUAGE C
 AS 'pgraft', 'pgraft_log_append';
 
--- Commit log entry
+-- Whether a log entry is committed
 CREATE OR REPLACE FUNCTION pgraft_log_commit(index bigint)
 RETURNS boolean
 LANGUAGE C
 AS 'pgraft', 'pgraft_log_commit';
 
--- Apply log entry
+-- Whether a log entry has been applied on this node
 CREATE OR REPLACE FUNCTION pgraft_log_apply(index bigint)
 RETURNS boolean
 LANGUAGE C
@@ -158,6 +163,21 @@ RETURNS text
 LANGUAGE C
 AS 'pgraft', 'pgraft_log_get_entry_sql';
 
+-- Stream the Raft log itself, max_entries NULL reads to the end
+CREATE OR REPLACE FUNCTION pgraft_log_entries(from_index bigint DEFAULT 1, max_entries integer DEFAULT 100)
+RETURNS TABLE(
+    index bigint,
+    term bigint,
+    type text,
+    size integer,
+    op text,
+    key text,
+    committed boolean,
+    data bytea
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_log_entries';
+
 -- Get log statistics as table with individual columns
 CREATE OR REPLACE FUNCTION pgraft_log_get_stats()
 RETURNS TABLE(
@@ -213,16 +233,16 @@ AS 'pgraft', 'pgraft_get_term';
 -- View that matches 'etcdctl member list' output format (with dead node detection)
 CREATE OR REPLACE VIEW pgraft.member_list AS
 SELECT 
-    (node->>'id')::text as "memberID",
-    (node->>'address')::text as "peerURLs",
-    (node->>'address')::text as "clientURLs",
+    node_id::text as "memberID",
+    address as "peerURLs",
+    address as "clientURLs",
     CASE 
-        WHEN (node->>'active')::boolean = false THEN 'unavailable'
-        WHEN (node->>'id')::int = pgraft_get_leader() THEN 'leader'
+        WHEN NOT active THEN 'unavailable'
+        WHEN node_id = pgraft_get_leader() THEN 'leader'
         ELSE 'follower'
     END as "status"
-FROM json_array_elements(pgraft_get_nodes_from_raft()::json) AS node
-ORDER BY (node->>'id')::int;
+FROM pgraft_get_nodes_from_raft()
+ORDER BY node_id;
 
 -- Legacy view using C function (deprecated, kept for compatibility)
 CREATE OR REPLACE VIEW pgraft.member_list_legacy AS
@@ -303,14 +323,16 @@ WHERE pgraft_is_leader();
 
 -- Additional etcd-compatible views for comprehensive compatibility
 
--- View that matches 'etcdctl endpoint hashkv' output format
+-- View that matches 'etcdctl endpoint hashkv' output format; each node's
+-- KV hash comes from the last pgraft_cluster_stats() round
 CREATE OR REPLACE VIEW pgraft.endpoint_hashkv AS
 SELECT 
-    address || ':' || port::text as "endpoint",
-    '0' as "hash",
-    '0' as "hash_revision"
-FROM pgraft_get_nodes()
-ORDER BY node_id;
+    n.address || ':' || n.port::text as "endpoint",
+    s.kv_hash::text as "hash",
+    s.kv_hash_revision::text as "hash_revision"
+FROM pgraft_get_nodes() n
+LEFT JOIN pgraft_cluster_stats() s ON s.node_id = n.node_id
+ORDER BY n.node_id;
 
 -- View that provides etcd-style watch status
 CREATE OR REPLACE VIEW pgraft.watch_status AS
@@ -391,6 +413,51 @@ RETURNS TABLE(
 LANGUAGE C
 AS 'pgraft', 'pgraft_get_queue_status';
 
+-- Command queue priority lanes (control, kv, bulk)
+CREATE OR REPLACE FUNCTION pgraft_get_queue_lanes()
+RETURNS TABLE(
+    lane text,
+    depth integer,
+    capacity integer,
+    weight integer,
+    enqueued bigint,
+    rejected bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_get_queue_lanes';
+
+-- Multi-Raft groups the KV keyspace is partitioned across (pgraft.raft_groups)
+CREATE OR REPLACE FUNCTION pgraft_get_groups()
+RETURNS TABLE(
+    group_id integer,
+    leader_id bigint,
+    term integer,
+    is_leader boolean,
+    commit_index bigint,
+    applied_index bigint,
+    proposals bigint,
+    quiesced boolean
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_get_groups';
+
+-- Heartbeat round-trip time and jitter per peer (measured by the leader)
+CREATE OR REPLACE FUNCTION pgraft_get_peer_latency()
+RETURNS TABLE(
+    node_id bigint,
+    rtt_ms double precision,
+    jitter_ms double precision,
+    samples bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_get_peer_latency';
+
+-- Election timeout currently in effect (see pgraft.election_timeout_max)
+CREATE OR REPLACE FUNCTION pgraft_get_election_timeout()
+RETURNS integer
+LANGUAGE C
+AS 'pgraft', 'pgraft_get_election_timeout';
+
 -- Core cluster state view (reads from shared memory)
 CREATE VIEW pgraft_cluster_state AS
 SELECT 
@@ -454,18 +521,20 @@ SELECT
 FROM pgraft_get_nodes() n,
      LATERAL (SELECT * FROM pgraft_cluster_state LIMIT 1) c;
 
--- Log replication status view (simplified)
+-- Log replication status view
 CREATE VIEW pgraft_log_status AS
 SELECT
-    1 as node_id,
-    0 as log_size,
-    0 as last_index,
-    0 as commit_index,
-    0 as last_applied,
-    false as replicated,
-    false as committed,
-    false as applied,
-    0 as errors;
+    c.node_id,
+    s.log_size,
+    s.last_index,
+    s.commit_index,
+    s.last_applied,
+    s.replicated,
+    s.committed,
+    s.applied,
+    s.errors
+FROM pgraft_log_get_stats() s,
+     LATERAL (SELECT node_id FROM pgraft_cluster_state LIMIT 1) c;
 
 
 
@@ -497,6 +566,18 @@ RETURNS boolean
 LANGUAGE C
 AS 'pgraft', 'pgraft_kv_exists_sql';
 
+-- PATCH operation - replicate a JSON merge patch, optionally conditional on the key's version
+CREATE OR REPLACE FUNCTION pgraft_kv_patch(key text, patch jsonb, expected_version bigint DEFAULT NULL)
+RETURNS boolean
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_patch_sql';
+
+-- VERSION operation - current version of a key (NULL if absent)
+CREATE OR REPLACE FUNCTION pgraft_kv_version(key text)
+RETURNS bigint
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_version_sql';
+
 -- LIST_KEYS operation - list all keys as JSON array
 CREATE OR REPLACE FUNCTION pgraft_kv_list_keys()
 RETURNS text
@@ -513,11 +594,199 @@ RETURNS TABLE(
     deletes bigint,
     gets bigint,
     active_entries integer,
-    deleted_entries integer
+    deleted_entries integer,
+    value_bytes bigint,
+    stored_bytes bigint,
+    arena_used bigint,
+    arena_size bigint
 )
 LANGUAGE C
 AS 'pgraft', 'pgraft_kv_get_stats_table';
 
+-- Per-key storage footprint: value length, bytes kept in the arena, compression
+CREATE OR REPLACE FUNCTION pgraft_kv_value_stats()
+RETURNS TABLE(
+    key text,
+    version bigint,
+    value_bytes integer,
+    stored_bytes integer,
+    compressed boolean
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_value_stats_sql';
+
+-- Keys held in shared memory and on disk, and which tier answered reads
+CREATE OR REPLACE FUNCTION pgraft_kv_tier_stats()
+RETURNS TABLE(
+    hot_entries integer,
+    hot_bytes bigint,
+    memory_budget bigint,
+    cold_entries bigint,
+    cold_file_bytes bigint,
+    hot_hits bigint,
+    cold_hits bigint,
+    misses bigint,
+    hot_hit_ratio double precision,
+    evictions bigint,
+    promotions bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_tier_stats_sql';
+
+-- Arena fragmentation and background defragmentation progress
+CREATE OR REPLACE FUNCTION pgraft_kv_defrag_stats()
+RETURNS TABLE(
+    arena_size bigint,
+    arena_used bigint,
+    arena_live bigint,
+    fragmentation double precision,
+    deleted_entries integer,
+    in_progress boolean,
+    passes bigint,
+    values_moved bigint,
+    bytes_moved bigint,
+    deleted_purged bigint,
+    full_compactions bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_defrag_stats_sql';
+
+-- Root of the KV hash tree after a given number of changes, 0 for now;
+-- equal on nodes that applied the same KV entries
+CREATE OR REPLACE FUNCTION pgraft_kv_hash(revision bigint DEFAULT 0)
+RETURNS TABLE(
+    hash bigint,
+    hash_revision bigint,
+    compact_revision bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_hash_sql';
+
+-- One level of the KV hash tree; walk down where nodes differ to find the
+-- key buckets (hashtext(key) & 1023) that diverge
+CREATE OR REPLACE FUNCTION pgraft_kv_hash_tree(level integer)
+RETURNS TABLE(
+    node integer,
+    first_bucket integer,
+    last_bucket integer,
+    hash bigint,
+    hash_revision bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_hash_tree_sql';
+
+-- KV operations, bytes and latency per key namespace on this node;
+-- pgraft.kv_namespace_depth sets how many path segments a namespace has
+CREATE OR REPLACE FUNCTION pgraft_kv_namespace_stats()
+RETURNS TABLE(
+    namespace text,
+    reads bigint,
+    read_misses bigint,
+    read_bytes bigint,
+    avg_read_us double precision,
+    puts bigint,
+    deletes bigint,
+    write_bytes bigint,
+    proposals bigint,
+    avg_proposal_ms double precision,
+    stats_reset timestamptz
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_namespace_stats_sql';
+
+-- Most read and most written KV keys on this node, from count-min sketches
+CREATE OR REPLACE FUNCTION pgraft_kv_hot_keys()
+RETURNS TABLE(
+    kind text,
+    rank integer,
+    key text,
+    estimated_count bigint,
+    share double precision
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_hot_keys_sql';
+
+CREATE OR REPLACE FUNCTION pgraft_kv_stats_reset()
+RETURNS void
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_stats_reset_sql';
+
+-- Limit the keys starting with a prefix to a number of keys, bytes (key plus
+-- value) and writes per second; 0 means no limit.  Replicated through Raft
+-- and enforced by the leader before proposing a write (leader only)
+CREATE OR REPLACE FUNCTION pgraft_kv_set_quota(prefix text, max_keys bigint DEFAULT 0,
+                                               max_bytes bigint DEFAULT 0,
+                                               max_writes_per_sec integer DEFAULT 0)
+RETURNS void
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_set_quota_sql';
+
+-- Drop the quota of a prefix; false if it had none (leader only)
+CREATE OR REPLACE FUNCTION pgraft_kv_drop_quota(prefix text)
+RETURNS boolean
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_drop_quota_sql';
+
+-- Quotas with their usage on this node; admitted and refused writes are
+-- counted by the node that was leader at the time
+CREATE OR REPLACE FUNCTION pgraft_kv_quotas()
+RETURNS TABLE(
+    prefix text,
+    max_keys bigint,
+    max_bytes bigint,
+    max_writes_per_sec integer,
+    keys bigint,
+    bytes bigint,
+    admitted bigint,
+    refused_keys bigint,
+    refused_bytes bigint,
+    refused_rate bigint,
+    usage double precision
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_quotas_sql';
+
+-- Every live key of this node's store, both tiers; with changed_since, the
+-- keys put or deleted after that revision (value NULL when deleted).  Not a
+-- point-in-time view: follow up with the largest mod_revision returned.
+-- For COPY (SELECT * FROM pgraft_kv_export()) TO ...
+CREATE OR REPLACE FUNCTION pgraft_kv_export(changed_since bigint DEFAULT 0)
+RETURNS TABLE(
+    key text,
+    value text,
+    version bigint,
+    mod_revision bigint,
+    created_at timestamptz,
+    updated_at timestamptz
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_export_sql';
+
+-- Propose the (key, value) rows of a query as KV writes, many keys per Raft
+-- entry; a NULL value deletes the key.  Returns the keys proposed (leader only)
+CREATE OR REPLACE FUNCTION pgraft_kv_import(query text)
+RETURNS bigint
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_import_sql';
+
+-- Progress of the worker copying KV changes into pgraft.kv
+CREATE OR REPLACE FUNCTION pgraft_kv_sync_status()
+RETURNS TABLE(
+    database text,
+    pid integer,
+    store_revision bigint,
+    materialized_revision bigint,
+    pending_changes integer,
+    synced boolean,
+    batches bigint,
+    rows_upserted bigint,
+    rows_deleted bigint,
+    resyncs bigint,
+    last_batch_at timestamptz
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_kv_sync_status_sql';
+
 -- COMPACT operation - remove deleted entries and optimize storage
 CREATE OR REPLACE FUNCTION pgraft_kv_compact()
 RETURNS boolean
@@ -552,6 +821,152 @@ SELECT
     END as status
 FROM pgraft_kv_get_stats() s;
 
+-- ============================================================================
+-- Replicated Sequence Functions
+-- ============================================================================
+
+-- Create a cluster-wide sequence (leader only)
+CREATE OR REPLACE FUNCTION pgraft_seq_create(name text)
+RETURNS boolean
+LANGUAGE C
+AS 'pgraft', 'pgraft_seq_create_sql';
+
+-- Allocate n consecutive ids, returning the first (leader only)
+CREATE OR REPLACE FUNCTION pgraft_seq_next(name text, n bigint DEFAULT 1)
+RETURNS bigint
+LANGUAGE C
+AS 'pgraft', 'pgraft_seq_next_sql';
+
+-- Sequence high-water marks and this node's leased range
+CREATE OR REPLACE FUNCTION pgraft_seq_status()
+RETURNS TABLE(
+    name text,
+    reserved_to bigint,
+    leases bigint,
+    next_id bigint,
+    lease_end bigint,
+    ids_issued bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_seq_status_sql';
+
+-- ============================================================================
+-- Distributed Lock and Election Functions
+-- ============================================================================
+
+-- Acquire a lock, blocking until granted; returns the holder revision (leader only)
+CREATE OR REPLACE FUNCTION pgraft_lock_acquire(name text, ttl integer DEFAULT 30000)
+RETURNS bigint
+LANGUAGE C
+AS 'pgraft', 'pgraft_lock_acquire_sql';
+
+-- Release a lock held by this session (leader only)
+CREATE OR REPLACE FUNCTION pgraft_lock_release(name text)
+RETURNS boolean
+LANGUAGE C
+AS 'pgraft', 'pgraft_lock_release_sql';
+
+-- Extend the lease of a lock held by this session by its ttl (leader only)
+CREATE OR REPLACE FUNCTION pgraft_lock_renew(name text)
+RETURNS boolean
+LANGUAGE C
+AS 'pgraft', 'pgraft_lock_renew_sql';
+
+-- Campaign in an election, blocking until elected; returns the revision (leader only)
+CREATE OR REPLACE FUNCTION pgraft_campaign(election text, value text, ttl integer DEFAULT 30000)
+RETURNS bigint
+LANGUAGE C
+AS 'pgraft', 'pgraft_campaign_sql';
+
+-- Step down as leader of an election (leader only)
+CREATE OR REPLACE FUNCTION pgraft_resign(election text)
+RETURNS boolean
+LANGUAGE C
+AS 'pgraft', 'pgraft_resign_sql';
+
+-- Extend the lease of an election this session leads by its ttl (leader only)
+CREATE OR REPLACE FUNCTION pgraft_proclaim(election text)
+RETURNS boolean
+LANGUAGE C
+AS 'pgraft', 'pgraft_proclaim_sql';
+
+-- Value published by the current election leader
+CREATE OR REPLACE FUNCTION pgraft_election_leader(election text)
+RETURNS text
+LANGUAGE C
+AS 'pgraft', 'pgraft_election_leader_sql';
+
+-- Locks with holder, lease and queue depth
+CREATE OR REPLACE FUNCTION pgraft_lock_status()
+RETURNS TABLE(
+    name text,
+    holder_node integer,
+    holder_pid integer,
+    revision bigint,
+    value text,
+    lease_expires timestamptz,
+    waiters integer,
+    handoffs bigint,
+    expirations bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_lock_status_sql';
+
+-- ============================================================================
+-- Replicated Counter Functions
+-- ============================================================================
+
+-- Add to a counter; returns the value right after this increment (leader only)
+CREATE OR REPLACE FUNCTION pgraft_counter_add(name text, delta bigint DEFAULT 1)
+RETURNS bigint
+LANGUAGE C
+AS 'pgraft', 'pgraft_counter_add_sql';
+
+-- Current counter value, NULL if the counter does not exist
+CREATE OR REPLACE FUNCTION pgraft_counter_get(name text)
+RETURNS bigint
+LANGUAGE C
+AS 'pgraft', 'pgraft_counter_get_sql';
+
+-- Counters with value and combining statistics
+CREATE OR REPLACE FUNCTION pgraft_counter_status()
+RETURNS TABLE(
+    name text,
+    value bigint,
+    batches_applied bigint,
+    adds bigint,
+    batches_proposed bigint
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_counter_status_sql';
+
+-- ============================================================================
+-- Cluster Statistics Functions
+-- ============================================================================
+
+-- Metrics of every node, gathered over the Raft peer connections and cached
+-- for pgraft.cluster_stats_ttl; unreachable nodes have only their id
+CREATE OR REPLACE FUNCTION pgraft_cluster_stats()
+RETURNS TABLE(
+    node_id bigint,
+    reachable boolean,
+    leader_id bigint,
+    term bigint,
+    commit_index bigint,
+    applied_index bigint,
+    apply_lag bigint,
+    queue_depth bigint,
+    pending_entries bigint,
+    disk_bytes bigint,
+    rtt_us bigint,
+    max_peer_rtt_us bigint,
+    kv_hash bigint,
+    kv_hash_revision bigint,
+    collected_at timestamptz
+)
+LANGUAGE C
+AS 'pgraft', 'pgraft_cluster_stats_sql';
+
 
 
 -- Replicate a log entry via the Raft leader
@@ -17,6 +17,7 @@
 #include "storage/ipc.h"
 #include "utils/elog.h"
 #include "utils/builtins.h"
+#include "utils/memutils.h"
 #include "postmaster/bgworker.h"
 #include "access/xact.h"
 #include "access/xlog.h"
@@ -34,15 +35,27 @@
 #include "../include/pgraft_sql.h"
 #include "../include/pgraft_json.h"
 #include "../include/pgraft_apply.h"
+#include "../include/pgraft_seq.h"
+#include "../include/pgraft_lock.h"
+#include "../include/pgraft_counter.h"
+#include "../include/pgraft_stats.h"
+#include "../include/pgraft_proposal.h"
+#include "../include/pgraft_kv_sync.h"
+#include "../include/pgraft_kv_cold.h"
+#include "../include/pgraft_kv_stats.h"
+#include "../include/pgraft_kv_quota.h"
+#include "../include/pgraft_kv_gateway.h"
 
 /* Function declarations */
 /* Forward declarations */
 static int pgraft_init_system(int node_id, const char *address, int port);
 static int pgraft_add_node_system(int node_id, const char *address, int port);
 static int pgraft_remove_node_system(int node_id);
-static int pgraft_log_append_system(const char *log_data, int log_index);
-static int pgraft_log_commit_system(int log_index);
-static int pgraft_log_apply_system(int log_index);
+static int pgraft_log_append_system(const char *log_data);
+static bool pgraft_command_term_is_stale(const pgraft_command_t *cmd);
+static bool pgraft_go_leadership_changed(void);
+static void pgraft_update_groups_from_go(void);
+static void pgraft_update_latency_from_go(void);
 /* Function declaration moved to header */
 
 /* Extension cleanup function */
@@ -70,8 +83,8 @@ pgraft_shmem_request_hook(void)
 	if (prev_shmem_request_hook)
 		prev_shmem_request_hook();
 	
-	/* Request shared memory for core system */
-	RequestAddinShmemSpace(sizeof(pgraft_cluster_t));
+	/* Request shared memory for core system and membership table */
+	RequestAddinShmemSpace(pgraft_core_shmem_size());
 	
 	/* Request shared memory for Go state persistence */
 	RequestAddinShmemSpace(sizeof(pgraft_go_state_t));
@@ -79,12 +92,37 @@ pgraft_shmem_request_hook(void)
 	/* Request shared memory for log replication */
 	RequestAddinShmemSpace(sizeof(pgraft_log_state_t));
 	
-	/* Request shared memory for key/value store */
-	RequestAddinShmemSpace(sizeof(pgraft_kv_store_t));
+	/* Request shared memory for key/value store, and the lock of its cold tier */
+	RequestAddinShmemSpace(pgraft_kv_shmem_size());
+	RequestNamedLWLockTranche(PGRAFT_KV_COLD_TRANCHE, 1);
 	
 	/* Request shared memory for background worker state */
 	RequestAddinShmemSpace(sizeof(pgraft_worker_state_t));
 	
+	/* Request shared memory for replicated sequences */
+	RequestAddinShmemSpace(sizeof(pgraft_seq_state_t));
+	
+	/* Request shared memory for distributed locks */
+	RequestAddinShmemSpace(sizeof(pgraft_lock_state_t));
+	
+	/* Request shared memory for replicated counters */
+	RequestAddinShmemSpace(sizeof(pgraft_counter_state_t));
+	
+	/* Request shared memory for the cluster stats cache */
+	RequestAddinShmemSpace(pgraft_stats_shmem_size());
+	
+	/* Request shared memory for the direct proposal ring */
+	RequestAddinShmemSpace(sizeof(pgraft_proposal_state_t));
+	
+	/* Request shared memory for the pgraft.kv materializer */
+	RequestAddinShmemSpace(sizeof(pgraft_kv_sync_state_t));
+	
+	/* Request shared memory for per-namespace KV statistics */
+	RequestAddinShmemSpace(sizeof(pgraft_kv_stats_state_t));
+	
+	/* Request shared memory for KV namespace quotas */
+	RequestAddinShmemSpace(sizeof(pgraft_kv_quota_state_t));
+	
 	elog(LOG, "pgraft: shared memory request hook completed");
 }
 #endif
@@ -104,6 +142,14 @@ pgraft_shmem_startup_hook(void)
 	pgraft_log_init_shared_memory();
 	pgraft_kv_init_shared_memory();
 	pgraft_worker_init_shared_memory();
+	pgraft_seq_init_shared_memory();
+	pgraft_lock_init_shared_memory();
+	pgraft_counter_init_shared_memory();
+	pgraft_stats_init_shared_memory();
+	pgraft_proposal_init_shared_memory();
+	pgraft_kv_sync_init_shared_memory();
+	pgraft_kv_stats_init_shared_memory();
+	pgraft_kv_quota_init_shared_memory();
 	
 	elog(LOG, "pgraft: all shared memory structures initialized");
 }
@@ -116,6 +162,10 @@ _PG_init(void)
 {
 	elog(INFO, "pgraft: initializing extension version %s", PGRAFT_VERSION);
 
+	/* Register GUC variables first, pgraft.max_nodes and pgraft.kv_arena_size size shared memory */
+	pgraft_register_guc_variables();
+	elog(LOG, "pgraft: guc variables registered");
+
 	/* Install shared memory request hook (PG15+) */
 #if PG_VERSION_NUM >= 150000
 	prev_shmem_request_hook = shmem_request_hook;
@@ -123,11 +173,20 @@ _PG_init(void)
 	elog(LOG, "pgraft: shared memory request hook installed");
 #else
 	/* For PG < 15, request shared memory in _PG_init */
-	RequestAddinShmemSpace(sizeof(pgraft_cluster_t));
+	RequestAddinShmemSpace(pgraft_core_shmem_size());
 	RequestAddinShmemSpace(sizeof(pgraft_go_state_t));
 	RequestAddinShmemSpace(sizeof(pgraft_log_state_t));
-	RequestAddinShmemSpace(sizeof(pgraft_kv_store_t));
+	RequestAddinShmemSpace(pgraft_kv_shmem_size());
+	RequestNamedLWLockTranche(PGRAFT_KV_COLD_TRANCHE, 1);
 	RequestAddinShmemSpace(sizeof(pgraft_worker_state_t));
+	RequestAddinShmemSpace(sizeof(pgraft_seq_state_t));
+	RequestAddinShmemSpace(sizeof(pgraft_lock_state_t));
+	RequestAddinShmemSpace(sizeof(pgraft_counter_state_t));
+	RequestAddinShmemSpace(pgraft_stats_shmem_size());
+	RequestAddinShmemSpace(sizeof(pgraft_proposal_state_t));
+	RequestAddinShmemSpace(sizeof(pgraft_kv_sync_state_t));
+	RequestAddinShmemSpace(sizeof(pgraft_kv_stats_state_t));
+	RequestAddinShmemSpace(sizeof(pgraft_kv_quota_state_t));
 	elog(LOG, "pgraft: shared memory requested (PG < 15)");
 #endif
 
@@ -136,14 +195,13 @@ _PG_init(void)
 	shmem_startup_hook = pgraft_shmem_startup_hook;
 	elog(LOG, "pgraft: shared memory startup hook installed");
 
-	/* Register GUC variables */
-	pgraft_register_guc_variables();
-	elog(LOG, "pgraft: guc variables registered");
-
 	/* Register background worker */
 	pgraft_register_worker();
 	elog(LOG, "pgraft: background worker registration completed");
 
+	/* Register the pgraft.kv materializer if pgraft.kv_sync_database is set */
+	pgraft_kv_sync_register_worker();
+
 	elog(INFO, "pgraft: extension initialized successfully");
 }
 
@@ -214,7 +272,7 @@ pgraft_main(Datum main_arg)
 	pgraft_worker_state_t *state;
 	pgraft_command_t cmd;
 	int sleep_count;
-	int tick_result;
+	bool quiesced = false;
 	
 	sleep_count = 0;
 	
@@ -276,6 +334,9 @@ pgraft_main(Datum main_arg)
 	}
 	elog(LOG, "pgraft: background worker Go Raft goroutines started successfully");
 	
+	/* Let backends propose KV writes to Go without going through this loop */
+	pgraft_proposal_attach();
+	
 	/* Start the background ticker and processing loops */
 	elog(LOG, "pgraft: background worker starting Raft ticker and processing loops");
 	if (pgraft_go_start_background() != 0)
@@ -317,31 +378,72 @@ pgraft_main(Datum main_arg)
 	{
 		if (sleep_count % 5 == 0)
 		{
-			elog(LOG, "pgraft: worker loop - command_count=%d, head=%d, tail=%d", 
-				 state->command_count, state->command_head, state->command_tail);
+			elog(LOG, "pgraft: worker loop - command_count=%d (control=%d, kv=%d, bulk=%d)", 
+				 state->command_count,
+				 state->lanes[COMMAND_LANE_CONTROL].count,
+				 state->lanes[COMMAND_LANE_KV].count,
+				 state->lanes[COMMAND_LANE_BULK].count);
 		}
 		
-		if (pgraft_go_is_loaded())
-		{
-			tick_result = pgraft_go_tick();
-			if (sleep_count % 20 == 0)
-			{
-				elog(LOG, "pgraft: calling tick... result=%d", tick_result);
-			}
-		}
+		/* A quiesced cluster needs no polling until something wakes it */
+		quiesced = pgraft_go_is_loaded() && pgraft_go_is_quiesced(0);
+		
+		/* Raft time is advanced by the Go tick scheduler, not by this loop */
 		
 		/* Update shared memory with current Go library state every 5 iterations */
 		/* Only update if Go library is loaded */
-		if (sleep_count % 5 == 0 && pgraft_go_is_loaded())
+		/* A leader or term change is published right away so waiting writers can redirect */
+		if (pgraft_go_is_loaded() &&
+			((sleep_count % 5 == 0 && !quiesced) || pgraft_go_leadership_changed()))
 		{
 			pgraft_update_shared_memory_from_go();
 		}
 		
-		if (sleep_count % 10 == 0 && pgraft_go_is_loaded())
+		/* Publish per-group leadership for Multi-Raft KV writes */
+		if (pgraft_go_is_loaded())
+		{
+			pgraft_update_groups_from_go();
+		}
+		
+		/* Publish measured peer RTT and the election timeout in use */
+		if (sleep_count % 5 == 0 && pgraft_go_is_loaded() && !quiesced)
+		{
+			pgraft_update_latency_from_go();
+		}
+		
+		if (sleep_count % 10 == 0 && pgraft_go_is_loaded() && !quiesced)
 		{
 			(void) pgraft_go_trigger_heartbeat();
 		}
 		
+		/* Apply whatever Raft committed since the last iteration */
+		if (pgraft_go_is_loaded())
+		{
+			(void) pgraft_apply_committed_entries();
+		}
+		
+		/* Hand a waiting backend the page of the Raft log it asked for */
+		pgraft_log_serve_request();
+		
+		/* Keep our stats snapshot current and collect a round if asked */
+		if (pgraft_go_is_loaded())
+		{
+			pgraft_stats_serve_request();
+		}
+		
+		/* Answer the client gateway's reads from the KV store */
+		pgraft_kv_gateway_serve();
+		
+		/* Reclaim locks whose holders let their lease run out */
+		if (sleep_count % 10 == 0 && pgraft_go_is_loaded() && pgraft_core_is_leader())
+		{
+			pgraft_lock_expire_leases();
+			pgraft_kv_gateway_expire();
+		}
+		
+		/* Reclaim KV deleted entries and arena holes a few at a time */
+		pgraft_kv_defragment();
+		
 		if (pgraft_dequeue_command(&cmd))
 		{
 			elog(LOG, "pgraft: worker processing command %d for node %d", cmd.type, cmd.node_id);
@@ -367,7 +469,7 @@ pgraft_main(Datum main_arg)
 						state->status = WORKER_STATUS_RUNNING;
 						cmd.status = COMMAND_STATUS_COMPLETED;
 					}
-					pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
+					pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
 					break;
 					
 				case COMMAND_ADD_NODE:
@@ -382,7 +484,7 @@ pgraft_main(Datum main_arg)
 						cmd.status = COMMAND_STATUS_COMPLETED;
 						pg_usleep(2000000);
 					}
-					pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
+					pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
 					break;
 					
 				case COMMAND_REMOVE_NODE:
@@ -396,59 +498,38 @@ pgraft_main(Datum main_arg)
 					{
 						cmd.status = COMMAND_STATUS_COMPLETED;
 					}
-					pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
+					pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
 					break;
 					
 				case COMMAND_LOG_APPEND:
-					if (pgraft_log_append_system(cmd.log_data, cmd.log_index) != 0)
+					if (pgraft_log_append_system(cmd.log_data) != 0)
 					{
 						cmd.status = COMMAND_STATUS_FAILED;
 						snprintf(cmd.error_message, sizeof(cmd.error_message), 
-								"Failed to append log entry at index %d", cmd.log_index);
+								"Failed to propose log entry");
 					}
 					else
 					{
 						cmd.status = COMMAND_STATUS_COMPLETED;
 					}
-					pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
-					break;
-					
-				case COMMAND_LOG_COMMIT:
-					if (pgraft_log_commit_system(cmd.log_index) != 0)
-					{
-						cmd.status = COMMAND_STATUS_FAILED;
-						snprintf(cmd.error_message, sizeof(cmd.error_message), 
-								"Failed to commit log entry at index %d", cmd.log_index);
-					}
-					else
-					{
-						cmd.status = COMMAND_STATUS_COMPLETED;
-					}
-					pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
-					break;
-					
-				case COMMAND_LOG_APPLY:
-					if (pgraft_log_apply_system(cmd.log_index) != 0)
-					{
-						cmd.status = COMMAND_STATUS_FAILED;
-						snprintf(cmd.error_message, sizeof(cmd.error_message), 
-								"Failed to apply log entry at index %d", cmd.log_index);
-					}
-					else
-					{
-						cmd.status = COMMAND_STATUS_COMPLETED;
-					}
-					pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
+					pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
 					break;
 					
 				case COMMAND_KV_PUT:
 					{
-						char json_data[2048];
+						char json_data[PGRAFT_PROPOSAL_DATA_SIZE + 1];
 						int result;
 						
 						elog(LOG, "pgraft: processing COMMAND_KV_PUT for key=%s", cmd.kv_key);
 						
-						if (pgraft_go_is_loaded())
+						if (pgraft_command_term_is_stale(&cmd))
+						{
+							cmd.status = COMMAND_STATUS_FAILED;
+							snprintf(cmd.error_message, sizeof(cmd.error_message), 
+									"Leadership changed since term %d, KV PUT not proposed", cmd.term);
+							elog(LOG, "pgraft: %s", cmd.error_message);
+						}
+						else if (pgraft_go_is_loaded())
 						{
 							/* Create JSON data for Raft replication using json-c */
 							if (pgraft_json_create_kv_operation(PGRAFT_KV_PUT, cmd.kv_key, cmd.kv_value, cmd.kv_client_id, json_data, sizeof(json_data)) != 0) {
@@ -456,12 +537,13 @@ pgraft_main(Datum main_arg)
 								continue;
 							}
 							
-							elog(LOG, "pgraft: calling pgraft_go_append_log with data=%s", json_data);
+							elog(LOG, "pgraft: calling pgraft_go_group_append for group %d with data=%s",
+								 cmd.group_id, json_data);
 							
-							/* Replicate through Raft */
-							result = pgraft_go_append_log(json_data, strlen(json_data));
+							/* Replicate through the Raft group owning the key */
+							result = pgraft_go_group_append(cmd.group_id, json_data, strlen(json_data));
 							
-							elog(LOG, "pgraft: pgraft_go_append_log returned result=%d", result);
+							elog(LOG, "pgraft: pgraft_go_group_append returned result=%d", result);
 							
 							if (result < 0)
 							{
@@ -483,7 +565,7 @@ pgraft_main(Datum main_arg)
 									"Go layer not loaded, cannot replicate KV operation");
 							elog(WARNING, "pgraft: %s", cmd.error_message);
 						}
-						pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
+						pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
 					}
 					break;
 					
@@ -494,7 +576,14 @@ pgraft_main(Datum main_arg)
 						
 						elog(LOG, "pgraft: processing COMMAND_KV_DELETE for key=%s", cmd.kv_key);
 						
-						if (pgraft_go_is_loaded())
+						if (pgraft_command_term_is_stale(&cmd))
+						{
+							cmd.status = COMMAND_STATUS_FAILED;
+							snprintf(cmd.error_message, sizeof(cmd.error_message), 
+									"Leadership changed since term %d, KV DELETE not proposed", cmd.term);
+							elog(LOG, "pgraft: %s", cmd.error_message);
+						}
+						else if (pgraft_go_is_loaded())
 						{
 							/* Create JSON data for Raft replication using json-c */
 							if (pgraft_json_create_kv_operation(PGRAFT_KV_DELETE, cmd.kv_key, NULL, cmd.kv_client_id, json_data, sizeof(json_data)) != 0) {
@@ -502,12 +591,13 @@ pgraft_main(Datum main_arg)
 								continue;
 							}
 							
-							elog(LOG, "pgraft: calling pgraft_go_append_log with data=%s", json_data);
+							elog(LOG, "pgraft: calling pgraft_go_group_append for group %d with data=%s",
+								 cmd.group_id, json_data);
 							
-							/* Replicate through Raft */
-							result = pgraft_go_append_log(json_data, strlen(json_data));
+							/* Replicate through the Raft group owning the key */
+							result = pgraft_go_group_append(cmd.group_id, json_data, strlen(json_data));
 							
-							elog(LOG, "pgraft: pgraft_go_append_log returned result=%d", result);
+							elog(LOG, "pgraft: pgraft_go_group_append returned result=%d", result);
 							
 							if (result < 0)
 							{
@@ -529,15 +619,79 @@ pgraft_main(Datum main_arg)
 									"Go layer not loaded, cannot replicate KV operation");
 							elog(WARNING, "pgraft: %s", cmd.error_message);
 						}
-						pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
+						pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
+					}
+					break;
+					
+				case COMMAND_KV_PATCH:
+					{
+						char json_data[PGRAFT_PROPOSAL_DATA_SIZE + 1];
+						
+						if (pgraft_command_term_is_stale(&cmd))
+						{
+							cmd.status = COMMAND_STATUS_FAILED;
+							snprintf(cmd.error_message, sizeof(cmd.error_message), 
+									"Leadership changed since term %d, KV PATCH not proposed", cmd.term);
+							elog(LOG, "pgraft: %s", cmd.error_message);
+						}
+						else if (!pgraft_go_is_loaded())
+						{
+							cmd.status = COMMAND_STATUS_FAILED;
+							snprintf(cmd.error_message, sizeof(cmd.error_message), 
+									"Go layer not loaded, cannot replicate KV operation");
+							elog(WARNING, "pgraft: %s", cmd.error_message);
+						}
+						else if (pgraft_json_create_kv_patch(cmd.kv_key, cmd.kv_value, cmd.kv_expected_version,
+															 cmd.kv_client_id, json_data, sizeof(json_data)) != 0 ||
+								 pgraft_go_group_append(cmd.group_id, json_data, strlen(json_data)) < 0)
+						{
+							cmd.status = COMMAND_STATUS_FAILED;
+							snprintf(cmd.error_message, sizeof(cmd.error_message), 
+									"Failed to replicate KV PATCH operation through Raft");
+							elog(WARNING, "pgraft: %s", cmd.error_message);
+						}
+						else
+						{
+							cmd.status = COMMAND_STATUS_COMPLETED;
+						}
+						pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
 					}
 					break;
 					
+				case COMMAND_PROPOSE:
+					if (pgraft_command_term_is_stale(&cmd))
+					{
+						cmd.status = COMMAND_STATUS_FAILED;
+						snprintf(cmd.error_message, sizeof(cmd.error_message), 
+								"Leadership changed since term %d, entry not proposed", cmd.term);
+						elog(LOG, "pgraft: %s", cmd.error_message);
+					}
+					else if (!pgraft_go_is_loaded())
+					{
+						cmd.status = COMMAND_STATUS_FAILED;
+						snprintf(cmd.error_message, sizeof(cmd.error_message), 
+								"Go layer not loaded, cannot replicate entry");
+						elog(WARNING, "pgraft: %s", cmd.error_message);
+					}
+					else if (pgraft_go_append_log(cmd.log_data, strlen(cmd.log_data)) < 0)
+					{
+						cmd.status = COMMAND_STATUS_FAILED;
+						snprintf(cmd.error_message, sizeof(cmd.error_message), 
+								"Failed to propose entry through Raft");
+						elog(WARNING, "pgraft: %s", cmd.error_message);
+					}
+					else
+					{
+						cmd.status = COMMAND_STATUS_COMPLETED;
+					}
+					pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
+					break;
+					
 				case COMMAND_SHUTDOWN:
 					elog(LOG, "pgraft: shutdown command received");
 					state->status = WORKER_STATUS_STOPPED;
 					cmd.status = COMMAND_STATUS_COMPLETED;
-					pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
+					pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
 					break;
 					
 				default:
@@ -545,7 +699,7 @@ pgraft_main(Datum main_arg)
 					cmd.status = COMMAND_STATUS_FAILED;
 					snprintf(cmd.error_message, sizeof(cmd.error_message), 
 							"Unknown command type %d", cmd.type);
-					pgraft_update_command_status(cmd.timestamp, cmd.status, cmd.error_message);
+					pgraft_update_command_status(cmd.command_id, cmd.status, cmd.error_message);
 					break;
 			}
 		}
@@ -584,12 +738,11 @@ pgraft_worker_get_state(void)
 			strlcpy(worker_state->address, "127.0.0.1", sizeof(worker_state->address));
 			worker_state->status = WORKER_STATUS_STOPPED;
 			
-			/* Initialize circular buffers */
-			worker_state->command_head = 0;
-			worker_state->command_tail = 0;
-			worker_state->command_count = 0;
-			worker_state->status_head = 0;
-			worker_state->status_tail = 0;
+			/* Initialize priority lanes and circular buffers */
+			pgraft_queue_init_lanes(worker_state);
+			worker_state->next_command_id = 0;
+			SpinLockInit(&worker_state->status_mutex);
+			memset(worker_state->status_commands, 0, sizeof(worker_state->status_commands));
 			worker_state->status_count = 0;
 		}
 	}
@@ -638,6 +791,7 @@ pgraft_init_system(int node_id, const char *address, int port)
 		return -1;
 	}
 	elog(LOG, "pgraft: go raft goroutines started successfully");
+	pgraft_proposal_attach();
 
 	if (pgraft_go_start_network_server(port) != 0)
 	{
@@ -649,6 +803,176 @@ pgraft_init_system(int node_id, const char *address, int port)
 	return 0;
 }
 
+/*
+ * Check whether a queued write was proposed under a term this node no
+ * longer leads.  Such commands are failed instead of appended so that the
+ * waiting backend can redirect its client to the new leader.
+ */
+static bool
+pgraft_command_term_is_stale(const pgraft_command_t *cmd)
+{
+	int32_t		current_term;
+	int64_t		leader_id;
+	char		leader_address[256];
+	bool		is_leader;
+	
+	if (cmd->term <= 0)
+		return false;
+	
+	if (!pgraft_core_get_shared_memory())
+		return false;
+	
+	is_leader = pgraft_core_group_leadership(cmd->group_id, &current_term, &leader_id,
+											 leader_address, sizeof(leader_address));
+	
+	return (current_term != cmd->term || !is_leader);
+}
+
+/*
+ * Publish the leader, term and commit index of every Raft group
+ *
+ * groups[0] mirrors the cluster-wide fields maintained by
+ * pgraft_update_shared_memory_from_go(); the additional groups are read from
+ * the Go layer.  Waiting writers are woken when any group changes leader.
+ */
+static void
+pgraft_update_groups_from_go(void)
+{
+	pgraft_cluster_t *cluster;
+	pgraft_group_status_t groups[PGRAFT_MAX_GROUPS];
+	int			num_groups;
+	bool		changed = false;
+	int			g;
+	
+	cluster = pgraft_core_get_shared_memory();
+	if (!cluster)
+		return;
+	
+	num_groups = pgraft_go_group_count();
+	if (num_groups < 1)
+		num_groups = 1;
+	if (num_groups > PGRAFT_MAX_GROUPS)
+		num_groups = PGRAFT_MAX_GROUPS;
+	
+	memset(groups, 0, sizeof(groups));
+	groups[0].quiesced = pgraft_go_is_quiesced(0) != 0;
+	for (g = 1; g < num_groups; g++)
+	{
+		int64_t		leader = -1;
+		int32_t		term = 0;
+		uint64_t	commit = 0;
+		int64_t		proposals = 0;
+		
+		groups[g].quiesced = pgraft_go_is_quiesced(g) != 0;
+		if (pgraft_go_group_status(g, &leader, &term, &commit, &proposals) < 0)
+		{
+			num_groups = g;
+			break;
+		}
+		groups[g].leader_id = leader;
+		groups[g].current_term = term;
+		groups[g].commit_index = commit;
+		groups[g].proposals = proposals;
+	}
+	
+	SpinLockAcquire(&cluster->mutex);
+	cluster->groups[0].leader_id = cluster->leader_id;
+	cluster->groups[0].current_term = cluster->current_term;
+	cluster->groups[0].quiesced = groups[0].quiesced;
+	for (g = 1; g < num_groups; g++)
+	{
+		if (cluster->groups[g].leader_id != groups[g].leader_id ||
+			cluster->groups[g].current_term != groups[g].current_term)
+			changed = true;
+		cluster->groups[g].leader_id = groups[g].leader_id;
+		cluster->groups[g].current_term = groups[g].current_term;
+		cluster->groups[g].commit_index = groups[g].commit_index;
+		cluster->groups[g].proposals = groups[g].proposals;
+		cluster->groups[g].quiesced = groups[g].quiesced;
+	}
+	cluster->num_groups = num_groups;
+	SpinLockRelease(&cluster->mutex);
+	
+	if (changed)
+		ConditionVariableBroadcast(&cluster->leader_cv);
+}
+
+/*
+ * Publish the heartbeat RTT per peer and the effective election timeout
+ */
+static void
+pgraft_update_latency_from_go(void)
+{
+	static int64_t *ids = NULL;
+	static int64_t *srtt_us;
+	static int64_t *rttvar_us;
+	static int64_t *samples;
+	pgraft_cluster_t *cluster;
+	pgraft_node_table_t *table;
+	int			count;
+	int			election_timeout_ms;
+	int			i;
+	
+	cluster = pgraft_core_get_shared_memory();
+	table = pgraft_core_get_node_table();
+	if (!cluster || !table)
+		return;
+	
+	/* One set of buffers for the life of the worker, sized like the table */
+	if (ids == NULL)
+	{
+		ids = MemoryContextAlloc(TopMemoryContext, sizeof(int64_t) * table->capacity);
+		srtt_us = MemoryContextAlloc(TopMemoryContext, sizeof(int64_t) * table->capacity);
+		rttvar_us = MemoryContextAlloc(TopMemoryContext, sizeof(int64_t) * table->capacity);
+		samples = MemoryContextAlloc(TopMemoryContext, sizeof(int64_t) * table->capacity);
+	}
+	
+	count = pgraft_go_get_peer_latency(ids, srtt_us, rttvar_us, samples, table->capacity);
+	election_timeout_ms = pgraft_go_get_election_timeout();
+	
+	SpinLockAcquire(&cluster->mutex);
+	table->num_peers = count;
+	for (i = 0; i < count; i++)
+	{
+		table->peers[i].node_id = ids[i];
+		table->peers[i].rtt_us = srtt_us[i];
+		table->peers[i].rtt_var_us = rttvar_us[i];
+		table->peers[i].samples = samples[i];
+	}
+	cluster->election_timeout_ms = election_timeout_ms;
+	SpinLockRelease(&cluster->mutex);
+}
+
+/*
+ * Cheap check whether the Go layer's leader or term differs from what is
+ * published in shared memory
+ */
+static bool
+pgraft_go_leadership_changed(void)
+{
+	pgraft_cluster_t *cluster;
+	pgraft_go_get_leader_func get_leader_func;
+	pgraft_go_get_term_func get_term_func;
+	int64_t		go_leader;
+	int32_t		go_term;
+	bool		changed;
+	
+	get_leader_func = pgraft_go_get_get_leader_func();
+	get_term_func = pgraft_go_get_get_term_func();
+	cluster = pgraft_core_get_shared_memory();
+	if (!get_leader_func || !get_term_func || !cluster)
+		return false;
+	
+	go_leader = get_leader_func();
+	go_term = get_term_func();
+	
+	SpinLockAcquire(&cluster->mutex);
+	changed = (cluster->leader_id != go_leader || cluster->current_term != go_term);
+	SpinLockRelease(&cluster->mutex);
+	
+	return changed;
+}
+
 /*
  * Write cluster state to persistence file with nodes list
  * This allows replicas and other processes to read the state without accessing Go library
@@ -801,6 +1125,9 @@ pgraft_update_shared_memory_from_go(void)
 	int32_t current_term;
 	int64_t go_node_id;
 	char *nodes_json_for_file;
+	bool leader_changed;
+	uint64 leader_epoch;
+	int i;
 
 	if (!pgraft_go_is_loaded())
 		return;
@@ -841,21 +1168,17 @@ pgraft_update_shared_memory_from_go(void)
 			{
 				/* Parse JSON using separate module */
 				int node_count;
-				int32_t node_ids[16];
-				char *addresses[16];
-				char address_buf[16][256];
-				int i;
+				int max_nodes = pgraft_max_nodes + 1;	/* One extra detects overflow */
+				int32_t *node_ids;
+				char **addresses;
 				
 				/* Keep a copy for persistence file */
 				nodes_json_for_file = pstrdup(nodes_json);
 				
-				/* Initialize */
-				for (i = 0; i < 16; i++) {
-					addresses[i] = address_buf[i];
-					address_buf[i][0] = '\0';
-				}
+				node_ids = (int32_t *) palloc(sizeof(int32_t) * max_nodes);
+				addresses = (char **) palloc0(sizeof(char *) * max_nodes);
 				
-				node_count = pgraft_parse_nodes_json(nodes_json, node_ids, addresses, 16);
+				node_count = pgraft_parse_nodes_json(nodes_json, node_ids, addresses, max_nodes);
 				
 				if (node_count > 0)
 				{
@@ -871,6 +1194,10 @@ pgraft_update_shared_memory_from_go(void)
 					elog(LOG, "pgraft: DEBUG - No valid nodes parsed from JSON");
 				}
 				
+				for (i = 0; i < node_count; i++)
+					pfree(addresses[i]);
+				pfree(addresses);
+				pfree(node_ids);
 				pgraft_go_free_string(nodes_json);
 			}
 		}
@@ -878,10 +1205,23 @@ pgraft_update_shared_memory_from_go(void)
 	
 	/* Update shared memory with current Go state */
 	SpinLockAcquire(&shm_cluster->mutex);
+	leader_changed = (shm_cluster->leader_id != current_leader ||
+					  shm_cluster->current_term != current_term);
 	shm_cluster->leader_id = current_leader;
 	shm_cluster->current_term = current_term;
 	shm_cluster->initialized = true;  /* Mark as initialized */
 	
+	/* Remember where the leader lives so deposed writers can redirect */
+	if (leader_changed || shm_cluster->leader_address[0] == '\0')
+	{
+		if (!pgraft_core_node_address(current_leader, shm_cluster->leader_address,
+									  sizeof(shm_cluster->leader_address)))
+			shm_cluster->leader_address[0] = '\0';
+	}
+	if (leader_changed)
+		shm_cluster->leader_epoch++;
+	leader_epoch = shm_cluster->leader_epoch;
+	
 	/* Update node_id from Go layer */
 	if (go_node_id > 0) {
 		shm_cluster->node_id = go_node_id;
@@ -908,6 +1248,14 @@ pgraft_update_shared_memory_from_go(void)
 	
 	SpinLockRelease(&shm_cluster->mutex);
 	
+	/* Wake every backend waiting on an in-flight write */
+	if (leader_changed)
+	{
+		elog(LOG, "pgraft: leadership changed - leader=%lld, term=%d, epoch=%llu",
+			 (long long)current_leader, current_term, (unsigned long long)leader_epoch);
+		ConditionVariableBroadcast(&shm_cluster->leader_cv);
+	}
+	
 	elog(DEBUG1, "pgraft: Updated shared memory from Go library - leader=%lld, term=%d, state=%s", 
 		 (long long)current_leader, current_term, shm_cluster->state);
 	
@@ -1003,43 +1351,16 @@ pgraft_remove_node_system(int node_id)
 
 /*
  * Append log entry to pgraft system
+ * The entry is proposed to Raft, which assigns its index and term.
  */
 static int
-pgraft_log_append_system(const char *log_data, int log_index)
-{
-	if (pgraft_log_append_entry((int64_t)log_index, log_data, strlen(log_data)) != 0) {
-		elog(WARNING, "pgraft: failed to append log entry at index %d", log_index);
-		return -1;
-	}
-	elog(INFO, "pgraft: log entry at index %d appended", log_index);
-	return 0;
-}
-
-/*
- * Commit log entry in pgraft system
- */
-static int
-pgraft_log_commit_system(int log_index)
-{
-	if (pgraft_log_commit_entry((int64_t)log_index) != 0) {
-		elog(WARNING, "pgraft: failed to commit log entry at index %d", log_index);
-		return -1;
-	}
-	elog(INFO, "pgraft: log entry at index %d committed", log_index);
-	return 0;
-}
-
-/*
- * Apply log entry in pgraft system
- */
-static int
-pgraft_log_apply_system(int log_index)
+pgraft_log_append_system(const char *log_data)
 {
-	if (pgraft_log_apply_entry((int64_t)log_index) != 0) {
-		elog(WARNING, "pgraft: failed to apply log entry at index %d", log_index);
+	if (pgraft_go_append_log((char *) log_data, strlen(log_data)) != 0) {
+		elog(WARNING, "pgraft: failed to propose log entry");
 		return -1;
 	}
-	elog(INFO, "pgraft: log entry at index %d applied", log_index);
+	elog(INFO, "pgraft: log entry proposed");
 	return 0;
 }
 
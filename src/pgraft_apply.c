@@ -17,12 +17,20 @@
 #include "../include/pgraft_core.h"
 #include "../include/pgraft_json.h"
 #include "../include/pgraft_kv.h"
+#include "../include/pgraft_seq.h"
+#include "../include/pgraft_lock.h"
+#include "../include/pgraft_counter.h"
+#include "../include/pgraft_kv_quota.h"
+#include "../include/pgraft_kv_gateway.h"
+#include "../include/pgraft_go.h"
 
 #include "executor/spi.h"
 #include "utils/snapmgr.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
 #include "storage/proc.h"
+#include "storage/condition_variable.h"
+#include "storage/lwlock.h"
 #include "access/xact.h"
 #include "miscadmin.h"
 #include "catalog/pg_type.h"
@@ -54,10 +62,26 @@ pgraft_apply_entry_to_postgres(uint64 raft_index, const char *data, size_t len)
 										  ALLOCSET_DEFAULT_SIZES);
 	oldcontext = MemoryContextSwitchTo(apply_context);
 
-	/* Check if this is a KV operation (JSON format) */
+	/* Check if this is a KV, quota, sequence, lock or counter operation (JSON format) */
 	if (data[0] == '{')
 	{
-		ret = pgraft_apply_kv_operation(raft_index, data, len);
+		char		type[32];
+		
+		if (pgraft_json_get_type(data, len, type, sizeof(type)) != 0)
+			type[0] = '\0';
+		
+		if (strncmp(type, "seq_", 4) == 0)
+			ret = pgraft_seq_apply(raft_index, data, len);
+		else if (strncmp(type, "lock_", 5) == 0)
+			ret = pgraft_lock_apply(raft_index, data, len);
+		else if (strncmp(type, "counter_", 8) == 0)
+			ret = pgraft_counter_apply(raft_index, data, len);
+		else if (strncmp(type, "quota_", 6) == 0)
+			ret = pgraft_kv_quota_apply(raft_index, data, len);
+		else if (strncmp(type, "lease_", 6) == 0)
+			ret = pgraft_kv_lease_apply(raft_index, data, len);
+		else
+			ret = pgraft_apply_kv_operation(raft_index, data, len);
 		if (ret == 0)
 		{
 			/* Record that we applied this entry */
@@ -135,6 +159,175 @@ pgraft_apply_entry_to_postgres(uint64 raft_index, const char *data, size_t len)
 	return 0;
 }
 
+/*
+ * Could a failure to apply an entry be this node's own?
+ *
+ * Running out of room, memory or disk, and I/O errors, depend on the node;
+ * any other failure would happen the same way on every node.
+ */
+static bool
+pgraft_apply_error_is_local(int sqlerrcode)
+{
+	int			category = ERRCODE_TO_CATEGORY(sqlerrcode);
+	
+	return category == ERRCODE_INSUFFICIENT_RESOURCES || category == ERRCODE_SYSTEM_ERROR;
+}
+
+/*
+ * Drain committed entries of one Raft group and apply them
+ *
+ * Group 0 carries every entry type; the additional Multi-Raft groups only
+ * carry KV operations.  Adds the number of entries taken from the group to
+ * *processed and returns the number applied.
+ *
+ * An entry that fails the same way on every node is skipped with a
+ * warning.  One this node could not apply for lack of local resources
+ * stops the worker instead, since skipping it would leave this node's
+ * store behind the others for good: the entries before it are recorded
+ * as applied, and once the worker restarts Raft hands the log out again
+ * from there.
+ */
+static int
+pgraft_apply_group_entries(pgraft_cluster_t *cluster, int group, int *processed)
+{
+	uint64_t	index;
+	int			length;
+	char	   *data;
+	int			applied = 0;
+	uint64		applied_before = 0;
+	uint64		last_index = 0;
+	
+	if (cluster != NULL)
+	{
+		SpinLockAcquire(&cluster->mutex);
+		applied_before = cluster->groups[group].applied_index;
+		SpinLockRelease(&cluster->mutex);
+	}
+	
+	while ((data = pgraft_go_next_group_committed(group, &index, &length)) != NULL)
+	{
+		MemoryContext oldcontext = CurrentMemoryContext;
+		char	   *copy;
+		
+		/* Go hands out raw bytes; json-c wants a terminated string */
+		copy = palloc(length + 1);
+		memcpy(copy, data, length);
+		copy[length] = '\0';
+		pgraft_go_free_string(data);
+		(*processed)++;
+		
+		/* Applied before the worker last stopped */
+		if (index <= applied_before)
+		{
+			pfree(copy);
+			continue;
+		}
+		
+		if (length == 0 || copy[0] != '{')
+		{
+			elog(DEBUG1, "pgraft: skipping non-JSON committed entry %lu of group %d",
+				 (unsigned long) index, group);
+			last_index = index;
+			pfree(copy);
+			continue;
+		}
+		
+		PG_TRY();
+		{
+			int			ret;
+			
+			if (group == 0)
+				ret = pgraft_apply_entry_to_postgres(index, copy, length);
+			else
+				ret = pgraft_apply_kv_operation(index, copy, length);
+			if (ret == 0)
+				applied++;
+			pgraft_kv_gateway_applied(index, copy, length, ret == 0);
+		}
+		PG_CATCH();
+		{
+			ErrorData  *edata;
+			
+			MemoryContextSwitchTo(oldcontext);
+			edata = CopyErrorData();
+			FlushErrorState();
+			/* There is no transaction abort to release the KV cold tier lock */
+			LWLockReleaseAll();
+			
+			if (pgraft_apply_error_is_local(edata->sqlerrcode))
+			{
+				if (last_index > 0 && cluster != NULL)
+				{
+					SpinLockAcquire(&cluster->mutex);
+					cluster->groups[group].applied_index = last_index;
+					SpinLockRelease(&cluster->mutex);
+				}
+				ereport(FATAL,
+						(errcode(edata->sqlerrcode),
+						 errmsg("pgraft: could not apply committed entry %lu of group %d: %s",
+								(unsigned long) index, group, edata->message),
+						 errdetail("The worker stops rather than skip the entry, and applies it again once restarted.")));
+			}
+			
+			elog(WARNING, "pgraft: failed to apply committed entry %lu of group %d: %s",
+				 (unsigned long) index, group, edata->message);
+			FreeErrorData(edata);
+			pgraft_kv_gateway_applied(index, copy, length, false);
+		}
+		PG_END_TRY();
+		
+		last_index = index;
+		pfree(copy);
+	}
+	
+	if (last_index > 0 && cluster != NULL)
+	{
+		SpinLockAcquire(&cluster->mutex);
+		cluster->groups[group].applied_index = last_index;
+		SpinLockRelease(&cluster->mutex);
+	}
+	
+	return applied;
+}
+
+/*
+ * Drain committed entries from the Go layer and apply them
+ *
+ * Called from the background worker loop.  Only JSON entries (KV and
+ * sequence operations) are applied here: the worker has no database
+ * connection, so SQL entries are left to the SPI path.  Failures are logged
+ * and, unless only this node could not apply the entry, do not stop the
+ * worker.  Every Raft group is drained in turn, and
+ * waiters on the cluster condition variable are woken once the batch is
+ * done.  Returns the number of entries applied.
+ */
+int
+pgraft_apply_committed_entries(void)
+{
+	pgraft_cluster_t *cluster;
+	int			num_groups = 1;
+	int			processed = 0;
+	int			applied = 0;
+	int			group;
+	
+	cluster = pgraft_core_get_shared_memory();
+	if (cluster)
+	{
+		SpinLockAcquire(&cluster->mutex);
+		if (cluster->num_groups > 1)
+			num_groups = Min(cluster->num_groups, PGRAFT_MAX_GROUPS);
+		SpinLockRelease(&cluster->mutex);
+	}
+	
+	for (group = 0; group < num_groups; group++)
+		applied += pgraft_apply_group_entries(cluster, group, &processed);
+	
+	if (processed > 0 && cluster)
+		ConditionVariableBroadcast(&cluster->leader_cv);
+	
+	return applied;
+}
+
 /*
  * Parse Raft log entry from serialized data
  * Simple format: index|term|op|database|schema|sql
@@ -339,11 +532,21 @@ pgraft_apply_kv_operation(uint64 raft_index, const char *json_data, size_t len)
 {
 	char *key = NULL;
 	char *value = NULL;
+	char type[32];
 	int op_type = -1;
 	int result = 0;
 	
 	elog(LOG, "pgraft: applying KV operation from JSON at index %lu", raft_index);
 	
+	/* Bulk imports carry many keys in one entry, client gateway Txns their writes */
+	if (pgraft_json_get_type(json_data, len, type, sizeof(type)) == 0)
+	{
+		if (strcmp(type, "kv_batch") == 0)
+			return pgraft_kv_apply_batch(raft_index, json_data, len);
+		if (strcmp(type, "kv_txn") == 0)
+			return pgraft_kv_txn_apply(raft_index, json_data, len);
+	}
+	
 	/* Parse JSON to extract operation details using json-c */
 	if (pgraft_json_parse_kv_operation(json_data, len, &op_type, &key, &value) != 0) {
 		elog(WARNING, "pgraft: failed to parse KV operation JSON");
@@ -358,7 +561,7 @@ pgraft_apply_kv_operation(uint64 raft_index, const char *json_data, size_t len)
 				result = -1;
 				break;
 			}
-			result = pgraft_kv_put_local(key, value);
+			result = pgraft_kv_put(key, value, 0, raft_index);
 			if (result == 0) {
 				elog(LOG, "pgraft: applied KV PUT operation: key='%s', value='%s'", key, value);
 			} else {
@@ -371,13 +574,27 @@ pgraft_apply_kv_operation(uint64 raft_index, const char *json_data, size_t len)
 				result = -1;
 				break;
 			}
-			result = pgraft_kv_delete_local(key);
+			result = pgraft_kv_delete(key, raft_index);
 			if (result == 0) {
 				elog(LOG, "pgraft: applied KV DELETE operation: key='%s'", key);
 			} else {
 				elog(ERROR, "pgraft: failed to apply KV DELETE operation: key='%s', error=%d", key, result);
 			}
 			break;
+		case PGRAFT_KV_PATCH:
+			if (!key || !value) {
+				elog(ERROR, "pgraft: invalid PATCH operation parameters (key=%p, patch=%p)", key, value);
+				result = -1;
+				break;
+			}
+			result = pgraft_kv_patch(key, value, pgraft_json_get_expected_version(json_data, len), raft_index);
+			if (result == 0) {
+				elog(LOG, "pgraft: applied KV PATCH operation: key='%s', patch='%s'", key, value);
+			} else if (result > 0) {
+				/* Version mismatch: skipped the same way on every node */
+				result = 0;
+			}
+			break;
 		default:
 			elog(ERROR, "pgraft: unsupported KV operation type: %d", op_type);
 			result = -1;
@@ -9,14 +9,109 @@
  */
 
 #include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/shmem.h"
 #include "storage/spin.h"
+#include "storage/condition_variable.h"
 #include "utils/elog.h"
+#include "utils/timestamp.h"
 
 #include <string.h>
 
 #include "../include/pgraft_core.h"
 #include "../include/pgraft_go.h"
+#include "../include/pgraft_guc.h"
+
+/*
+ * Bytes needed for a node table holding capacity members
+ */
+static Size
+pgraft_node_table_size(int capacity)
+{
+	Size		size;
+
+	size = offsetof(pgraft_node_table_t, peers);
+	size = add_size(size, mul_size(capacity, sizeof(pgraft_peer_latency_t)));
+	size = add_size(size, mul_size(capacity, sizeof(pgraft_node_t)));
+	size = add_size(size, mul_size(capacity, PGRAFT_NODE_ADDRESS_AVG));
+	size = add_size(size, PGRAFT_NODE_ADDRESS_MAX);
+	return size;
+}
+
+/*
+ * Squeeze out arena space left behind by removed members
+ * Caller holds the cluster mutex.
+ */
+static void
+pgraft_node_table_compact(pgraft_node_table_t *table)
+{
+	pgraft_node_t *nodes = PGRAFT_NODE_TABLE_NODES(table);
+	char	   *arena = PGRAFT_NODE_TABLE_ARENA(table);
+	uint32		used = 0;
+	int			i;
+
+	for (i = 0; i < table->num_nodes; i++)
+	{
+		Assert(nodes[i].address_off >= used);
+		if (nodes[i].address_off != used)
+			memmove(arena + used, arena + nodes[i].address_off, nodes[i].address_len + 1);
+		nodes[i].address_off = used;
+		used += nodes[i].address_len + 1;
+	}
+	table->arena_used = used;
+}
+
+/*
+ * Append a member, returning false if the table or its arena is full
+ * Caller holds the cluster mutex.
+ */
+static bool
+pgraft_node_table_append(pgraft_node_table_t *table, int32_t node_id,
+						 const char *address, int32_t port)
+{
+	pgraft_node_t *node;
+	uint32		len = strnlen(address, PGRAFT_NODE_ADDRESS_MAX - 1);
+
+	if (table->num_nodes >= table->capacity)
+		return false;
+
+	if (table->arena_used + len + 1 > table->arena_size)
+		pgraft_node_table_compact(table);
+	if (table->arena_used + len + 1 > table->arena_size)
+		return false;
+
+	node = &PGRAFT_NODE_TABLE_NODES(table)[table->num_nodes];
+	node->id = node_id;
+	node->port = port;
+	node->is_leader = false;
+	node->address_off = table->arena_used;
+	node->address_len = len;
+	memcpy(PGRAFT_NODE_ADDRESS(table, node), address, len);
+	PGRAFT_NODE_ADDRESS(table, node)[len] = '\0';
+
+	table->arena_used += len + 1;
+	table->num_nodes++;
+	return true;
+}
+
+/*
+ * Find a member by id
+ * Caller holds the cluster mutex.
+ */
+static pgraft_node_t *
+pgraft_node_table_find(pgraft_node_table_t *table, int64_t node_id)
+{
+	pgraft_node_t *nodes = PGRAFT_NODE_TABLE_NODES(table);
+	int			i;
+
+	for (i = 0; i < table->num_nodes; i++)
+	{
+		if ((int64_t) nodes[i].id == node_id)
+			return &nodes[i];
+	}
+	return NULL;
+}
 
 /*
  * Initialize core consensus system
@@ -25,9 +120,11 @@ int
 pgraft_core_init(int32_t node_id, const char *address, int32_t port)
 {
 	pgraft_cluster_t *cluster;
+	pgraft_node_table_t *table;
 	
 	cluster = pgraft_core_get_shared_memory();
-	if (!cluster)
+	table = pgraft_core_get_node_table();
+	if (!cluster || !table)
 	{
 		elog(ERROR, "pgraft: core init failed to get shared memory");
 		return -1;
@@ -46,16 +143,13 @@ pgraft_core_init(int32_t node_id, const char *address, int32_t port)
 	cluster->leader_id = -1;
 	strncpy(cluster->state, "follower", sizeof(cluster->state) - 1);
 	cluster->state[sizeof(cluster->state) - 1] = '\0';
-	cluster->num_nodes = 1;
 	cluster->messages_processed = 0;
 	cluster->heartbeats_sent = 0;
 	cluster->elections_triggered = 0;
 	
-	cluster->nodes[0].id = node_id;
-	strncpy(cluster->nodes[0].address, address, sizeof(cluster->nodes[0].address) - 1);
-	cluster->nodes[0].address[sizeof(cluster->nodes[0].address) - 1] = '\0';
-	cluster->nodes[0].port = port;
-	cluster->nodes[0].is_leader = false;
+	table->num_nodes = 0;
+	table->arena_used = 0;
+	pgraft_node_table_append(table, node_id, address, port);
 	
 	cluster->initialized = true;
 	SpinLockRelease(&cluster->mutex);
@@ -74,10 +168,12 @@ int
 pgraft_core_add_node(int32_t node_id, const char *address, int32_t port)
 {
 	pgraft_cluster_t *cluster;
-	pgraft_node_t *node;
+	pgraft_node_table_t *table;
+	int32_t		num_nodes;
 	
 	cluster = pgraft_core_get_shared_memory();
-	if (!cluster)
+	table = pgraft_core_get_node_table();
+	if (!cluster || !table)
 	{
 		elog(ERROR, "pgraft: cannot add node %d - failed to get shared memory", node_id);
 		return -1;
@@ -91,26 +187,24 @@ pgraft_core_add_node(int32_t node_id, const char *address, int32_t port)
 		return -1;
 	}
 	
-	if (cluster->num_nodes >= 16)
+	if (!pgraft_node_table_append(table, node_id, address, port))
 	{
+		int32_t		capacity = table->capacity;
+		
 		SpinLockRelease(&cluster->mutex);
-		elog(ERROR, "pgraft: maximum number of nodes (16) reached");
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("pgraft: cannot add node %d - membership table is full", node_id),
+				 errdetail("The table holds %d members and their addresses.", capacity),
+				 errhint("Increase pgraft.max_nodes and restart the server.")));
 		return -1;
 	}
-	
-	node = &cluster->nodes[cluster->num_nodes];
-	node->id = node_id;
-	strncpy(node->address, address, sizeof(node->address) - 1);
-	node->address[sizeof(node->address) - 1] = '\0';
-	node->port = port;
-	node->is_leader = false;
-	
-	cluster->num_nodes++;
+	num_nodes = table->num_nodes;
 	
 	SpinLockRelease(&cluster->mutex);
 	
 	elog(INFO, "pgraft: added node %d at %s:%d", node_id, address, port);
-	elog(INFO, "pgraft: total nodes in cluster: %d", cluster->num_nodes);
+	elog(INFO, "pgraft: total nodes in cluster: %d", num_nodes);
 	return 0;
 }
 
@@ -121,11 +215,13 @@ int
 pgraft_core_remove_node(int32_t node_id)
 {
 	pgraft_cluster_t *cluster;
-	int			i;
-	int			j;
+	pgraft_node_table_t *table;
+	pgraft_node_t *nodes;
+	pgraft_node_t *node;
 	
 	cluster = pgraft_core_get_shared_memory();
-	if (!cluster)
+	table = pgraft_core_get_node_table();
+	if (!cluster || !table)
 	{
 		elog(ERROR, "pgraft: cannot remove node %d - failed to get shared memory", node_id);
 		return -1;
@@ -139,17 +235,16 @@ pgraft_core_remove_node(int32_t node_id)
 		return -1;
 	}
 	
-	for (i = 0; i < cluster->num_nodes; i++)
+	node = pgraft_node_table_find(table, node_id);
+	if (node)
 	{
-		if (cluster->nodes[i].id == node_id)
-		{
-			for (j = i; j < cluster->num_nodes - 1; j++)
-				cluster->nodes[j] = cluster->nodes[j + 1];
-			cluster->num_nodes--;
-			SpinLockRelease(&cluster->mutex);
-			elog(INFO, "pgraft: removed node %d", node_id);
-			return 0;
-		}
+		/* Keep entries in arena order; the address becomes a hole */
+		nodes = PGRAFT_NODE_TABLE_NODES(table);
+		memmove(node, node + 1, (table->num_nodes - (node - nodes) - 1) * sizeof(pgraft_node_t));
+		table->num_nodes--;
+		SpinLockRelease(&cluster->mutex);
+		elog(INFO, "pgraft: removed node %d", node_id);
+		return 0;
 	}
 	
 	SpinLockRelease(&cluster->mutex);
@@ -264,11 +359,13 @@ int
 pgraft_core_update_nodes(int32_t num_nodes, int32_t *node_ids, char **addresses)
 {
 	pgraft_cluster_t *cluster;
+	pgraft_node_table_t *table;
 	int i;
 	
 	/* Get shared memory */
 	cluster = pgraft_core_get_shared_memory();
-	if (!cluster)
+	table = pgraft_core_get_node_table();
+	if (!cluster || !table)
 		return -1;
 	
 	SpinLockAcquire(&cluster->mutex);
@@ -278,24 +375,102 @@ pgraft_core_update_nodes(int32_t num_nodes, int32_t *node_ids, char **addresses)
 		return -1;
 	}
 	
-	/* Clear existing nodes */
-	memset(cluster->nodes, 0, sizeof(cluster->nodes));
-	cluster->num_nodes = 0;
-	
-	/* Copy up to 16 nodes */
-	for (i = 0; i < num_nodes && i < 16; i++)
+	/* Rebuild the table from scratch, which also empties the arena */
+	table->num_nodes = 0;
+	table->arena_used = 0;
+	for (i = 0; i < num_nodes; i++)
 	{
-		cluster->nodes[i].id = node_ids[i];
-		strncpy(cluster->nodes[i].address, addresses[i], sizeof(cluster->nodes[i].address) - 1);
-		cluster->nodes[i].address[sizeof(cluster->nodes[i].address) - 1] = '\0';
-		cluster->num_nodes++;
+		if (!pgraft_node_table_append(table, node_ids[i], addresses[i], 0))
+			break;
 	}
 	
 	SpinLockRelease(&cluster->mutex);
 	
+	if (i < num_nodes)
+		elog(WARNING, "pgraft: membership table holds %d of %d nodes, increase pgraft.max_nodes",
+			 i, num_nodes);
+	
 	return 0;
 }
 
+/*
+ * Number of cluster members
+ */
+int32_t
+pgraft_core_get_num_nodes(void)
+{
+	pgraft_cluster_t *cluster;
+	pgraft_node_table_t *table;
+	int32_t		num_nodes;
+	
+	cluster = pgraft_core_get_shared_memory();
+	table = pgraft_core_get_node_table();
+	if (!cluster || !table)
+		return 0;
+	
+	SpinLockAcquire(&cluster->mutex);
+	num_nodes = table->num_nodes;
+	SpinLockRelease(&cluster->mutex);
+	
+	return num_nodes;
+}
+
+/*
+ * Copy a member's address, returning false if the id is unknown
+ * Caller holds the cluster mutex.
+ */
+bool
+pgraft_core_node_address(int64_t node_id, char *address, size_t address_len)
+{
+	pgraft_node_table_t *table = pgraft_core_get_node_table();
+	pgraft_node_t *node;
+	
+	node = table ? pgraft_node_table_find(table, node_id) : NULL;
+	if (!node)
+		return false;
+	
+	strlcpy(address, PGRAFT_NODE_ADDRESS(table, node), address_len);
+	return true;
+}
+
+/*
+ * Copy the membership table into backend memory
+ * The copy has the same layout, so callers can walk it with the usual
+ * macros without holding the mutex.
+ */
+pgraft_node_table_t *
+pgraft_core_snapshot_nodes(void)
+{
+	pgraft_cluster_t *cluster;
+	pgraft_node_table_t *table;
+	pgraft_node_table_t *copy;
+	int32_t		capacity;
+	uint32		arena_size;
+	
+	cluster = pgraft_core_get_shared_memory();
+	table = pgraft_core_get_node_table();
+	if (!cluster || !table)
+		return NULL;
+	
+	capacity = table->capacity;
+	arena_size = table->arena_size;
+	copy = (pgraft_node_table_t *) palloc(pgraft_node_table_size(capacity));
+	
+	SpinLockAcquire(&cluster->mutex);
+	copy->capacity = table->capacity;
+	copy->num_nodes = table->num_nodes;
+	copy->num_peers = table->num_peers;
+	copy->arena_size = arena_size;
+	copy->arena_used = table->arena_used;
+	memcpy(copy->peers, table->peers, sizeof(pgraft_peer_latency_t) * table->num_peers);
+	memcpy(PGRAFT_NODE_TABLE_NODES(copy), PGRAFT_NODE_TABLE_NODES(table),
+		   sizeof(pgraft_node_t) * table->num_nodes);
+	memcpy(PGRAFT_NODE_TABLE_ARENA(copy), PGRAFT_NODE_TABLE_ARENA(table), table->arena_used);
+	SpinLockRelease(&cluster->mutex);
+	
+	return copy;
+}
+
 /*
  * Get current leader ID
  */
@@ -352,6 +527,300 @@ pgraft_core_get_current_term(void)
 	return term;
 }
 
+/*
+ * Raise a retriable error for a write that was proposed under a term this
+ * node no longer leads, pointing the client at the new leader when known.
+ */
+void
+pgraft_core_report_leader_change(int32_t term, int32_t current_term,
+								 int64_t leader_id, const char *leader_address)
+{
+	if (leader_address[0] != '\0')
+		ereport(ERROR,
+				(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+				 errmsg("pgraft: leadership changed while write was pending"),
+				 errdetail("Write was queued in term %d; current term is %d and node %lld is leader.",
+						   term, current_term, (long long) leader_id),
+				 errhint("Retry the write against the leader at %s.", leader_address)));
+	else
+		ereport(ERROR,
+				(errcode(ERRCODE_T_R_SERIALIZATION_FAILURE),
+				 errmsg("pgraft: leadership changed while write was pending"),
+				 errdetail("Write was queued in term %d; current term is %d and no leader is known.",
+						   term, current_term),
+				 errhint("Retry the write once a new leader has been elected.")));
+}
+
+/*
+ * Leadership of one Raft group as published by the worker
+ *
+ * Group 0 (and any group outside the configured range) is the cluster-wide
+ * view.  Returns true if this node leads the group.
+ */
+bool
+pgraft_core_group_leadership(int group, int32_t *term, int64_t *leader_id,
+							 char *leader_address, size_t address_len)
+{
+	pgraft_cluster_t *cluster;
+	bool		is_leader;
+	
+	cluster = pgraft_core_get_shared_memory();
+	if (!cluster)
+		elog(ERROR, "pgraft: cannot access cluster state");
+	
+	SpinLockAcquire(&cluster->mutex);
+	if (group <= 0 || group >= cluster->num_groups)
+	{
+		*term = cluster->current_term;
+		*leader_id = cluster->leader_id;
+		strlcpy(leader_address, cluster->leader_address, address_len);
+	}
+	else
+	{
+		*term = cluster->groups[group].current_term;
+		*leader_id = cluster->groups[group].leader_id;
+		if (!pgraft_core_node_address(*leader_id, leader_address, address_len))
+			leader_address[0] = '\0';
+	}
+	is_leader = (*leader_id == (int64_t) cluster->node_id);
+	SpinLockRelease(&cluster->mutex);
+	
+	return is_leader;
+}
+
+/*
+ * Wait for a queued write to be handed to Raft by the background worker
+ *
+ * Sleeps on the cluster condition variable, which is broadcast both when the
+ * worker finishes a command and when leadership or term changes.  If the
+ * term the write was queued in is no longer ours, fails immediately with a
+ * retriable error instead of waiting for the timeout.  Returns 0 once the
+ * command completed, -1 if timeout_ms elapsed first.
+ */
+int
+pgraft_core_wait_for_command(uint64 command_id, int32_t term, int timeout_ms)
+{
+	return pgraft_core_wait_for_group_command(command_id, 0, term, timeout_ms);
+}
+
+/*
+ * As pgraft_core_wait_for_command(), for a write proposed to a given group
+ */
+int
+pgraft_core_wait_for_group_command(uint64 command_id, int group, int32_t term, int timeout_ms)
+{
+	pgraft_cluster_t *cluster;
+	TimestampTz deadline;
+	
+	cluster = pgraft_core_get_shared_memory();
+	if (!cluster)
+	{
+		elog(ERROR, "pgraft: cannot wait for command - failed to get shared memory");
+		return -1;
+	}
+	
+	deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout_ms);
+	
+	ConditionVariablePrepareToSleep(&cluster->leader_cv);
+	for (;;)
+	{
+		pgraft_command_t status_cmd;
+		int32_t		current_term;
+		int64_t		leader_id;
+		bool		is_leader;
+		char		leader_address[256];
+		long		remaining;
+		
+		is_leader = pgraft_core_group_leadership(group, &current_term, &leader_id,
+												 leader_address, sizeof(leader_address));
+		
+		if (pgraft_get_command_status(command_id, &status_cmd))
+		{
+			if (status_cmd.status == COMMAND_STATUS_COMPLETED)
+			{
+				ConditionVariableCancelSleep();
+				pgraft_forget_command_status(command_id);
+				return 0;
+			}
+			if (status_cmd.status == COMMAND_STATUS_FAILED)
+			{
+				ConditionVariableCancelSleep();
+				pgraft_forget_command_status(command_id);
+				if (current_term != term || !is_leader)
+					pgraft_core_report_leader_change(term, current_term, leader_id, leader_address);
+				elog(ERROR, "pgraft: command %llu failed: %s",
+					 (unsigned long long) command_id, status_cmd.error_message);
+				return -1;
+			}
+		}
+		
+		/* Deposed while the write was still in flight: fail fast */
+		if (current_term != term || !is_leader)
+		{
+			ConditionVariableCancelSleep();
+			pgraft_core_report_leader_change(term, current_term, leader_id, leader_address);
+		}
+		
+		remaining = TimestampDifferenceMilliseconds(GetCurrentTimestamp(), deadline);
+		if (remaining <= 0)
+		{
+			ConditionVariableCancelSleep();
+			return -1;
+		}
+		
+		(void) ConditionVariableTimedSleep(&cluster->leader_cv, remaining, PG_WAIT_EXTENSION);
+	}
+}
+
+/*
+ * Require that this node leads; return the term and our node id
+ *
+ * Raises an error naming the current leader otherwise.  Callers pass the
+ * term on to pgraft_core_propose() and friends so that a later leadership
+ * change is detected.
+ */
+void
+pgraft_core_require_leader(int32_t *term, int32_t *node_id)
+{
+	pgraft_cluster_t *cluster;
+	int64_t		leader_id;
+	bool		is_leader;
+	
+	cluster = pgraft_core_get_shared_memory();
+	if (!cluster)
+		elog(ERROR, "pgraft: cannot access cluster state");
+	
+	pgraft_update_shared_memory_from_go();
+	
+	SpinLockAcquire(&cluster->mutex);
+	is_leader = (cluster->node_id == cluster->leader_id);
+	leader_id = cluster->leader_id;
+	*term = cluster->current_term;
+	*node_id = cluster->node_id;
+	SpinLockRelease(&cluster->mutex);
+	
+	if (!is_leader)
+		elog(ERROR, "pgraft: operation only allowed on leader node (current leader: %lld)",
+			 (long long) leader_id);
+}
+
+/*
+ * Raise a retriable error if we no longer lead in term
+ */
+void
+pgraft_core_check_term(int32_t term)
+{
+	pgraft_cluster_t *cluster;
+	int32_t		current_term;
+	int64_t		leader_id;
+	bool		is_leader;
+	char		leader_address[256];
+	
+	cluster = pgraft_core_get_shared_memory();
+	if (!cluster)
+		elog(ERROR, "pgraft: cannot access cluster state");
+	
+	SpinLockAcquire(&cluster->mutex);
+	current_term = cluster->current_term;
+	leader_id = cluster->leader_id;
+	is_leader = (cluster->leader_id == (int64_t) cluster->node_id);
+	strlcpy(leader_address, cluster->leader_address, sizeof(leader_address));
+	SpinLockRelease(&cluster->mutex);
+	
+	if (current_term != term || !is_leader)
+		pgraft_core_report_leader_change(term, current_term, leader_id, leader_address);
+}
+
+/*
+ * Hand a prebuilt entry to the worker and wait until it is proposed
+ *
+ * term must be the term the caller observed itself leading in.  Raises an
+ * error if the entry cannot be queued, the proposal fails, or it is not
+ * proposed within pgraft.proposal_timeout.
+ */
+int
+pgraft_core_propose(const char *data, int32_t term)
+{
+	uint64		command_id = 0;
+	
+	if (!pgraft_queue_propose_command(data, term, &command_id))
+	{
+		elog(ERROR, "pgraft: failed to queue proposal for Raft replication");
+		return -1;
+	}
+	
+	if (pgraft_core_wait_for_command(command_id, term, pgraft_proposal_timeout) != 0)
+	{
+		elog(ERROR, "pgraft: timed out after %d ms waiting for proposal; outcome unknown",
+			 pgraft_proposal_timeout);
+		return -1;
+	}
+	
+	return 0;
+}
+
+/*
+ * Wait until a proposed entry has been applied locally
+ *
+ * applied(arg) is re-evaluated every time the cluster condition variable is
+ * broadcast, which the worker does after each batch of committed entries.
+ * Fails fast with a retriable error if leadership moves away from term.
+ * Returns 0 once applied(arg) holds, -1 if timeout_ms elapsed first.
+ */
+int
+pgraft_core_wait_for_apply(bool (*applied) (void *arg), void *arg, int32_t term, int timeout_ms)
+{
+	pgraft_cluster_t *cluster;
+	TimestampTz deadline;
+	
+	cluster = pgraft_core_get_shared_memory();
+	if (!cluster)
+	{
+		elog(ERROR, "pgraft: cannot wait for apply - failed to get shared memory");
+		return -1;
+	}
+	
+	deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout_ms);
+	
+	ConditionVariablePrepareToSleep(&cluster->leader_cv);
+	for (;;)
+	{
+		int32_t		current_term;
+		int64_t		leader_id;
+		bool		is_leader;
+		char		leader_address[256];
+		long		remaining;
+		
+		if (applied(arg))
+		{
+			ConditionVariableCancelSleep();
+			return 0;
+		}
+		
+		SpinLockAcquire(&cluster->mutex);
+		current_term = cluster->current_term;
+		leader_id = cluster->leader_id;
+		is_leader = (cluster->leader_id == (int64_t) cluster->node_id);
+		strlcpy(leader_address, cluster->leader_address, sizeof(leader_address));
+		SpinLockRelease(&cluster->mutex);
+		
+		if (current_term != term || !is_leader)
+		{
+			ConditionVariableCancelSleep();
+			pgraft_core_report_leader_change(term, current_term, leader_id, leader_address);
+		}
+		
+		remaining = TimestampDifferenceMilliseconds(GetCurrentTimestamp(), deadline);
+		if (remaining <= 0)
+		{
+			ConditionVariableCancelSleep();
+			return -1;
+		}
+		
+		(void) ConditionVariableTimedSleep(&cluster->leader_cv, remaining, PG_WAIT_EXTENSION);
+	}
+}
+
 /*
  * Cleanup core system
  */
@@ -374,6 +843,15 @@ pgraft_core_cleanup(void)
 	}
 }
 
+/*
+ * Shared memory needed by the core, including the membership table
+ */
+Size
+pgraft_core_shmem_size(void)
+{
+	return add_size(sizeof(pgraft_cluster_t), pgraft_node_table_size(pgraft_max_nodes));
+}
+
 /*
  * Initialize shared memory
  */
@@ -401,6 +879,7 @@ pgraft_core_init_shared_memory(void)
 			
 			/* Initialize mutex */
 			SpinLockInit(&cluster->mutex);
+			ConditionVariableInit(&cluster->leader_cv);
 			
 			/* Initialize default values */
 			cluster->initialized = false;
@@ -409,10 +888,11 @@ pgraft_core_init_shared_memory(void)
 			cluster->leader_id = -1;
 			strncpy(cluster->state, "stopped", sizeof(cluster->state) - 1);
 			cluster->state[sizeof(cluster->state) - 1] = '\0';
-			cluster->num_nodes = 0;
 			cluster->messages_processed = 0;
 			cluster->heartbeats_sent = 0;
 			cluster->elections_triggered = 0;
+			cluster->leader_epoch = 0;
+			cluster->leader_address[0] = '\0';
 			
 			elog(INFO, "pgraft: shared memory initialized");
 		}
@@ -425,6 +905,8 @@ pgraft_core_init_shared_memory(void)
 	{
 		elog(ERROR, "pgraft: failed to get shared memory pointer");
 	}
+	
+	pgraft_core_get_node_table();
 }
 
 /*
@@ -447,6 +929,34 @@ pgraft_core_get_shared_memory(void)
 			/* Initialize shared memory when first accessed */
 			pgraft_core_init_shared_memory();
 		}
+		
+		/* Resolve the node table now, callers look it up under the mutex */
+		pgraft_core_get_node_table();
 	}
 	return cluster;
 }
+
+/*
+ * Get the membership table, creating it on first use
+ */
+pgraft_node_table_t *
+pgraft_core_get_node_table(void)
+{
+	static pgraft_node_table_t *table = NULL;
+	bool		found;
+	
+	if (table == NULL)
+	{
+		table = (pgraft_node_table_t *) ShmemInitStruct("pgraft_node_table",
+														pgraft_node_table_size(pgraft_max_nodes),
+														&found);
+		if (!found)
+		{
+			memset(table, 0, offsetof(pgraft_node_table_t, peers));
+			table->capacity = pgraft_max_nodes;
+			table->arena_size = pgraft_max_nodes * PGRAFT_NODE_ADDRESS_AVG + PGRAFT_NODE_ADDRESS_MAX;
+			elog(INFO, "pgraft: membership table initialized for %d nodes", table->capacity);
+		}
+	}
+	return table;
+}
@@ -0,0 +1,434 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_counter.c
+ *      Replicated counters with leader-side combining
+ *
+ * pgraft_counter_add() joins the counter's open batch if there is one and
+ * otherwise opens a batch and becomes its combiner.  The combiner waits for
+ * the counter's previous batch to apply and for the rest of the batching
+ * window (pgraft.max_batch_delay), closes the batch and proposes the summed
+ * delta as one Raft entry.  When that entry applies, every caller in the
+ * batch computes its own post-increment value as
+ *
+ *		value_after_batch - batch_delta + (sum of deltas up to and including mine)
+ *
+ * so callers see distinct, gap-free values exactly as if they had been
+ * applied one at a time in arrival order.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <string.h>
+
+#include "common/int.h"
+#include "miscadmin.h"
+#include "storage/condition_variable.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/elog.h"
+#include "utils/timestamp.h"
+
+#include "../include/pgraft_counter.h"
+#include "../include/pgraft_core.h"
+#include "../include/pgraft_json.h"
+#include "../include/pgraft_guc.h"
+
+/* Global shared memory pointer */
+static pgraft_counter_state_t *g_counter_state = NULL;
+
+/* Arguments for the apply-wait predicates */
+typedef struct pgraft_counter_wait
+{
+	char		name[PGRAFT_COUNTER_NAME_LEN];
+	uint64		batch;
+	int32		term;
+	int32		node_id;
+} pgraft_counter_wait_t;
+
+/*
+ * Initialize shared memory for counters
+ */
+void
+pgraft_counter_init_shared_memory(void)
+{
+	bool		found;
+
+	g_counter_state = (pgraft_counter_state_t *) ShmemInitStruct("pgraft_counter_state",
+																 sizeof(pgraft_counter_state_t),
+																 &found);
+
+	if (!found)
+	{
+		memset(g_counter_state, 0, sizeof(pgraft_counter_state_t));
+		SpinLockInit(&g_counter_state->mutex);
+		elog(INFO, "pgraft: counter table initialized");
+	}
+}
+
+/*
+ * Get counter table shared memory
+ */
+pgraft_counter_state_t *
+pgraft_counter_get_state(void)
+{
+	return g_counter_state;
+}
+
+/*
+ * Find counter by name, optionally creating it; caller holds the mutex
+ */
+static pgraft_counter_t *
+pgraft_counter_find(const char *name, bool create)
+{
+	pgraft_counter_t *counter;
+	int			i;
+
+	for (i = 0; i < g_counter_state->num_counters; i++)
+	{
+		if (g_counter_state->counters[i].in_use &&
+			strcmp(g_counter_state->counters[i].name, name) == 0)
+			return &g_counter_state->counters[i];
+	}
+
+	if (!create || g_counter_state->num_counters >= PGRAFT_MAX_COUNTERS)
+		return NULL;
+
+	counter = &g_counter_state->counters[g_counter_state->num_counters++];
+	memset(counter, 0, sizeof(*counter));
+	counter->in_use = true;
+	strlcpy(counter->name, name, sizeof(counter->name));
+
+	return counter;
+}
+
+/*
+ * Find the recorded result of a batch; caller holds the mutex
+ */
+static pgraft_counter_result_t *
+pgraft_counter_find_result(pgraft_counter_t *counter, uint64 batch, int32 term, int32 node_id)
+{
+	pgraft_counter_result_t *result;
+
+	if (counter == NULL)
+		return NULL;
+
+	result = &counter->results[batch % PGRAFT_COUNTER_RESULTS];
+	if (result->batch == batch && result->term == term && result->node_id == node_id)
+		return result;
+
+	return NULL;
+}
+
+/*
+ * Record the outcome of a batch; caller holds the mutex
+ */
+static void
+pgraft_counter_record_result(pgraft_counter_t *counter, const pgraft_counter_op_t *op, bool failed)
+{
+	pgraft_counter_result_t *result = &counter->results[op->batch % PGRAFT_COUNTER_RESULTS];
+
+	result->batch = op->batch;
+	result->term = op->term;
+	result->node_id = op->node_id;
+	result->delta = op->delta;
+	result->value = counter->value;
+	result->failed = failed;
+}
+
+/*
+ * Apply-wait predicates
+ */
+static bool
+pgraft_counter_batch_done(void *arg)
+{
+	pgraft_counter_wait_t *wait = (pgraft_counter_wait_t *) arg;
+	bool		done;
+
+	SpinLockAcquire(&g_counter_state->mutex);
+	done = (pgraft_counter_find_result(pgraft_counter_find(wait->name, false),
+									   wait->batch, wait->term, wait->node_id) != NULL);
+	SpinLockRelease(&g_counter_state->mutex);
+
+	return done;
+}
+
+static bool
+pgraft_counter_idle(void *arg)
+{
+	pgraft_counter_wait_t *wait = (pgraft_counter_wait_t *) arg;
+	pgraft_counter_t *counter;
+	bool		idle;
+
+	SpinLockAcquire(&g_counter_state->mutex);
+	counter = pgraft_counter_find(wait->name, false);
+	idle = (counter == NULL || counter->in_flight_batch == 0);
+	SpinLockRelease(&g_counter_state->mutex);
+
+	return idle;
+}
+
+/*
+ * Close the open batch and propose it
+ *
+ * Called by the backend that opened the batch.  Waits for the previous
+ * batch to apply and for the rest of the batching window first, so that
+ * callers arriving meanwhile join this batch.  Any error on the way (cancel,
+ * leader change, proposal failure) closes the batch and fails it, so it does
+ * not stay open for the rest of the term.
+ */
+static void
+pgraft_counter_propose_batch(pgraft_counter_wait_t *wait, TimestampTz opened_at)
+{
+	pgraft_counter_op_t op;
+	pgraft_counter_t *counter;
+	char		json_data[1024];
+	long		remaining_ms;
+
+	memset(&op, 0, sizeof(op));
+	strlcpy(op.name, wait->name, sizeof(op.name));
+	op.batch = wait->batch;
+	op.term = wait->term;
+	op.node_id = wait->node_id;
+
+	PG_TRY();
+	{
+		/* One batch in flight per counter; a stuck one is abandoned after the timeout */
+		if (pgraft_core_wait_for_apply(pgraft_counter_idle, wait, wait->term, pgraft_proposal_timeout) != 0)
+		{
+			elog(WARNING, "pgraft_counter: previous batch of \"%s\" did not apply within %d ms, proceeding",
+				 wait->name, pgraft_proposal_timeout);
+
+			SpinLockAcquire(&g_counter_state->mutex);
+			counter = pgraft_counter_find(wait->name, false);
+			if (counter)
+				counter->in_flight_batch = 0;
+			SpinLockRelease(&g_counter_state->mutex);
+		}
+
+		remaining_ms = pgraft_max_batch_delay -
+			TimestampDifferenceMilliseconds(opened_at, GetCurrentTimestamp());
+		if (remaining_ms > 0)
+			pg_usleep(remaining_ms * 1000L);
+
+		SpinLockAcquire(&g_counter_state->mutex);
+		counter = pgraft_counter_find(wait->name, false);
+		if (counter && counter->open_batch == wait->batch)
+		{
+			op.delta = counter->open_sum;
+			counter->open_batch = 0;
+			counter->open_sum = 0;
+			counter->in_flight_batch = wait->batch;
+			counter->batches_proposed++;
+		}
+		SpinLockRelease(&g_counter_state->mutex);
+
+		if (pgraft_json_create_counter_operation(&op, json_data, sizeof(json_data)) != 0)
+			elog(ERROR, "pgraft_counter: failed to create JSON for counter batch");
+
+		pgraft_core_propose(json_data, wait->term);
+	}
+	PG_CATCH();
+	{
+		pgraft_cluster_t *cluster;
+
+		/* Close and fail the whole batch so the other callers do not wait it out */
+		SpinLockAcquire(&g_counter_state->mutex);
+		counter = pgraft_counter_find(wait->name, false);
+		if (counter)
+		{
+			if (counter->open_batch == wait->batch)
+			{
+				op.delta = counter->open_sum;
+				counter->open_batch = 0;
+				counter->open_sum = 0;
+			}
+			if (counter->in_flight_batch == wait->batch)
+				counter->in_flight_batch = 0;
+			pgraft_counter_record_result(counter, &op, true);
+		}
+		SpinLockRelease(&g_counter_state->mutex);
+
+		cluster = pgraft_core_get_shared_memory();
+		if (cluster)
+			ConditionVariableBroadcast(&cluster->leader_cv);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+}
+
+/*
+ * Add delta to a counter and return the value right after this increment
+ * The counter is created at zero on first use.
+ */
+int64
+pgraft_counter_add(const char *name, int64 delta)
+{
+	pgraft_counter_t *counter;
+	pgraft_counter_result_t *result;
+	pgraft_counter_result_t outcome;
+	pgraft_counter_wait_t wait;
+	TimestampTz opened_at = 0;
+	int64		prefix;
+	bool		combiner = false;
+	bool		found;
+
+	if (!g_counter_state)
+		elog(ERROR, "pgraft_counter: counter table not initialized");
+
+	if (strlen(name) == 0 || strlen(name) >= PGRAFT_COUNTER_NAME_LEN)
+		elog(ERROR, "pgraft_counter: counter name must be 1 to %d characters", PGRAFT_COUNTER_NAME_LEN - 1);
+
+	memset(&wait, 0, sizeof(wait));
+	strlcpy(wait.name, name, sizeof(wait.name));
+	pgraft_core_require_leader(&wait.term, &wait.node_id);
+
+	SpinLockAcquire(&g_counter_state->mutex);
+	counter = pgraft_counter_find(name, true);
+	if (counter == NULL)
+	{
+		SpinLockRelease(&g_counter_state->mutex);
+		elog(ERROR, "pgraft_counter: counter table full (%d counters)", PGRAFT_MAX_COUNTERS);
+	}
+
+	if (counter->open_batch != 0 && counter->open_term == wait.term &&
+		!pg_add_s64_overflow(counter->open_sum, delta, &prefix))
+	{
+		/* Join the open batch */
+		counter->open_sum = prefix;
+	}
+	else
+	{
+		/* Open a new batch and combine it */
+		counter->open_batch = ++g_counter_state->next_batch;
+		counter->open_term = wait.term;
+		counter->open_sum = delta;
+		prefix = delta;
+		combiner = true;
+		opened_at = GetCurrentTimestamp();
+	}
+	wait.batch = counter->open_batch;
+	counter->adds++;
+	SpinLockRelease(&g_counter_state->mutex);
+
+	if (combiner)
+		pgraft_counter_propose_batch(&wait, opened_at);
+
+	if (pgraft_core_wait_for_apply(pgraft_counter_batch_done, &wait, wait.term,
+								   pgraft_proposal_timeout + pgraft_max_batch_delay) != 0)
+	{
+		/* Stop holding back the next batch behind one that may never apply */
+		SpinLockAcquire(&g_counter_state->mutex);
+		counter = pgraft_counter_find(name, false);
+		if (counter && counter->in_flight_batch == wait.batch)
+			counter->in_flight_batch = 0;
+		SpinLockRelease(&g_counter_state->mutex);
+
+		elog(ERROR, "pgraft_counter: timed out waiting for increment of \"%s\" to apply; outcome unknown",
+			 name);
+	}
+
+	SpinLockAcquire(&g_counter_state->mutex);
+	result = pgraft_counter_find_result(pgraft_counter_find(name, false),
+										wait.batch, wait.term, wait.node_id);
+	found = (result != NULL);
+	if (found)
+		outcome = *result;
+	SpinLockRelease(&g_counter_state->mutex);
+
+	if (!found)
+		elog(ERROR, "pgraft_counter: result of increment of \"%s\" is no longer available", name);
+
+	if (outcome.failed)
+		elog(ERROR, "pgraft_counter: increment of \"%s\" was not applied", name);
+
+	return outcome.value - outcome.delta + prefix;
+}
+
+/*
+ * Current counter value, read from local replicated state
+ */
+bool
+pgraft_counter_get(const char *name, int64 *value)
+{
+	pgraft_counter_t *counter;
+	bool		found = false;
+
+	if (!g_counter_state)
+		return false;
+
+	SpinLockAcquire(&g_counter_state->mutex);
+	counter = pgraft_counter_find(name, false);
+	if (counter)
+	{
+		*value = counter->value;
+		found = true;
+	}
+	SpinLockRelease(&g_counter_state->mutex);
+
+	return found;
+}
+
+/*
+ * Apply a committed counter entry
+ * Runs on every node in log order, so the outcome is deterministic
+ */
+int
+pgraft_counter_apply(uint64 raft_index, const char *json_data, size_t len)
+{
+	pgraft_counter_op_t op;
+	pgraft_counter_t *counter;
+	pgraft_cluster_t *cluster;
+	int32		local_node_id = -1;
+	int64		value;
+	bool		overflow = false;
+
+	if (!g_counter_state)
+		return -1;
+
+	if (pgraft_json_parse_counter_operation(json_data, len, &op) != 0)
+		return -1;
+
+	cluster = pgraft_core_get_shared_memory();
+	if (cluster)
+	{
+		SpinLockAcquire(&cluster->mutex);
+		local_node_id = cluster->node_id;
+		SpinLockRelease(&cluster->mutex);
+	}
+
+	SpinLockAcquire(&g_counter_state->mutex);
+	counter = pgraft_counter_find(op.name, true);
+	if (counter == NULL)
+	{
+		SpinLockRelease(&g_counter_state->mutex);
+		elog(WARNING, "pgraft_counter: counter table full, cannot apply \"%s\" at index %lu",
+			 op.name, (unsigned long) raft_index);
+		return -1;
+	}
+
+	if (pg_add_s64_overflow(counter->value, op.delta, &value))
+		overflow = true;
+	else
+	{
+		counter->value = value;
+		counter->batches_applied++;
+	}
+	pgraft_counter_record_result(counter, &op, overflow);
+
+	/* Our own batch landed: let the next one go */
+	if (op.node_id == local_node_id && counter->in_flight_batch == op.batch)
+		counter->in_flight_batch = 0;
+
+	g_counter_state->last_applied_index = raft_index;
+	SpinLockRelease(&g_counter_state->mutex);
+
+	if (overflow)
+		elog(WARNING, "pgraft_counter: counter \"%s\" would overflow, batch at index %lu not applied",
+			 op.name, (unsigned long) raft_index);
+
+	return 0;
+}
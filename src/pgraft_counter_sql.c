@@ -0,0 +1,139 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_counter_sql.c
+ *      SQL interface for replicated counters
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+
+#include "../include/pgraft_counter.h"
+
+PG_FUNCTION_INFO_V1(pgraft_counter_add_sql);
+PG_FUNCTION_INFO_V1(pgraft_counter_get_sql);
+PG_FUNCTION_INFO_V1(pgraft_counter_status_sql);
+
+/*
+ * Add to a counter and return the value right after this increment
+ * Usage: SELECT pgraft_counter_add('api-calls', 1);
+ */
+Datum
+pgraft_counter_add_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	int64		delta;
+	int64		value;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_counter: counter name cannot be NULL");
+
+	name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	delta = PG_ARGISNULL(1) ? 1 : PG_GETARG_INT64(1);
+	value = pgraft_counter_add(name, delta);
+	pfree(name);
+
+	PG_RETURN_INT64(value);
+}
+
+/*
+ * Current value of a counter, NULL if it does not exist
+ * Reads local replicated state, so it works on any node
+ */
+Datum
+pgraft_counter_get_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	int64		value;
+	bool		found;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	found = pgraft_counter_get(name, &value);
+	pfree(name);
+
+	if (!found)
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT64(value);
+}
+
+/*
+ * List counters with their value and combining statistics
+ */
+Datum
+pgraft_counter_status_sql(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	pgraft_counter_state_t *state;
+	pgraft_counter_t *counters;
+	int			num_counters;
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	state = pgraft_counter_get_state();
+	if (state == NULL)
+		return (Datum) 0;
+
+	/* Copy the table out so no tuple building happens under the spinlock */
+	counters = (pgraft_counter_t *) palloc(sizeof(pgraft_counter_t) * PGRAFT_MAX_COUNTERS);
+	SpinLockAcquire(&state->mutex);
+	num_counters = state->num_counters;
+	memcpy(counters, state->counters, sizeof(pgraft_counter_t) * num_counters);
+	SpinLockRelease(&state->mutex);
+
+	for (i = 0; i < num_counters; i++)
+	{
+		Datum		values[5];
+		bool		nulls[5];
+
+		if (!counters[i].in_use)
+			continue;
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(counters[i].name);
+		values[1] = Int64GetDatum(counters[i].value);
+		values[2] = Int64GetDatum(counters[i].batches_applied);
+		values[3] = Int64GetDatum(counters[i].adds);
+		values[4] = Int64GetDatum(counters[i].batches_proposed);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(counters);
+
+	return (Datum) 0;
+}
@@ -766,6 +766,661 @@ pgraft_go_tick(void)
 	return tick_func();
 }
 
+/*
+ * Pop the next committed entry from the Go layer.  Returns NULL when nothing
+ * is pending; the caller frees the result with pgraft_go_free_string().
+ */
+char *
+pgraft_go_next_committed(uint64_t *index, int *length)
+{
+	typedef char *(*pgraft_go_next_committed_func)(uint64_t *index, int *length);
+	static pgraft_go_next_committed_func next_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return NULL;
+	}
+	
+	if (next_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		next_func = (pgraft_go_next_committed_func) dlsym(go_lib_handle, "pgraft_go_next_committed");
+		if (next_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_next_committed: %s", error ? error : "unknown error");
+			return NULL;
+		}
+	}
+	
+	if (next_func == NULL)
+	{
+		return NULL;
+	}
+	
+	return next_func(index, length);
+}
+
+/*
+ * Number of Raft groups hosted by the Go layer, including group 0
+ */
+int
+pgraft_go_group_count(void)
+{
+	typedef int (*pgraft_go_group_count_func)(void);
+	static pgraft_go_group_count_func count_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return 1;
+	}
+	
+	if (count_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		count_func = (pgraft_go_group_count_func) dlsym(go_lib_handle, "pgraft_go_group_count");
+		if (count_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_group_count: %s", error ? error : "unknown error");
+			return 1;
+		}
+	}
+	
+	if (count_func == NULL)
+	{
+		return 1;
+	}
+	
+	return count_func();
+}
+
+/*
+ * Propose an entry to a Raft group; group 0 is pgraft_go_append_log()
+ */
+int
+pgraft_go_group_append(int group, char *data, int length)
+{
+	typedef int (*pgraft_go_group_append_func)(int group, char *data, int length);
+	static pgraft_go_group_append_func append_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (group == 0)
+	{
+		return pgraft_go_append_log(data, length);
+	}
+	
+	if (!pgraft_go_is_loaded())
+	{
+		elog(ERROR, "pgraft: go library not loaded");
+		return -1;
+	}
+	
+	if (append_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		append_func = (pgraft_go_group_append_func) dlsym(go_lib_handle, "pgraft_go_group_append");
+		if (append_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_group_append: %s", error ? error : "unknown error");
+			return -1;
+		}
+	}
+	
+	if (append_func == NULL)
+	{
+		return -1;
+	}
+	
+	return append_func(group, data, length);
+}
+
+/*
+ * Leader, term, commit index and proposal count of an additional Raft group
+ * Returns -1 for group 0 and unknown groups.
+ */
+int
+pgraft_go_group_status(int group, int64_t *leader, int32_t *term, uint64_t *commit, int64_t *proposals)
+{
+	typedef int (*pgraft_go_group_status_func)(int group, int64_t *leader, int32_t *term,
+											   uint64_t *commit, int64_t *proposals);
+	static pgraft_go_group_status_func status_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return -1;
+	}
+	
+	if (status_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		status_func = (pgraft_go_group_status_func) dlsym(go_lib_handle, "pgraft_go_group_status");
+		if (status_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_group_status: %s", error ? error : "unknown error");
+			return -1;
+		}
+	}
+	
+	if (status_func == NULL)
+	{
+		return -1;
+	}
+	
+	return status_func(group, leader, term, commit, proposals);
+}
+
+/*
+ * Pop the next committed entry of a Raft group; group 0 is
+ * pgraft_go_next_committed().  The caller frees the result with
+ * pgraft_go_free_string().
+ */
+char *
+pgraft_go_next_group_committed(int group, uint64_t *index, int *length)
+{
+	typedef char *(*pgraft_go_next_group_committed_func)(int group, uint64_t *index, int *length);
+	static pgraft_go_next_group_committed_func next_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (group == 0)
+	{
+		return pgraft_go_next_committed(index, length);
+	}
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return NULL;
+	}
+	
+	if (next_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		next_func = (pgraft_go_next_group_committed_func) dlsym(go_lib_handle, "pgraft_go_next_group_committed");
+		if (next_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_next_group_committed: %s", error ? error : "unknown error");
+			return NULL;
+		}
+	}
+	
+	if (next_func == NULL)
+	{
+		return NULL;
+	}
+	
+	return next_func(group, index, length);
+}
+
+/*
+ * Heartbeat RTT of up to max_peers peers; returns the number filled in
+ */
+int
+pgraft_go_get_peer_latency(int64_t *ids, int64_t *srtt_us, int64_t *rttvar_us,
+						   int64_t *samples, int max_peers)
+{
+	typedef int (*pgraft_go_get_peer_latency_func)(int64_t *ids, int64_t *srtt_us, int64_t *rttvar_us,
+												   int64_t *samples, int max_peers);
+	static pgraft_go_get_peer_latency_func latency_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return 0;
+	}
+	
+	if (latency_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		latency_func = (pgraft_go_get_peer_latency_func) dlsym(go_lib_handle, "pgraft_go_get_peer_latency");
+		if (latency_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_get_peer_latency: %s", error ? error : "unknown error");
+			return 0;
+		}
+	}
+	
+	if (latency_func == NULL)
+	{
+		return 0;
+	}
+	
+	return latency_func(ids, srtt_us, rttvar_us, samples, max_peers);
+}
+
+/*
+ * Election timeout the Go layer currently uses, in milliseconds; -1 if unknown
+ */
+int
+pgraft_go_get_election_timeout(void)
+{
+	typedef int (*pgraft_go_get_election_timeout_func)(void);
+	static pgraft_go_get_election_timeout_func timeout_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return -1;
+	}
+	
+	if (timeout_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		timeout_func = (pgraft_go_get_election_timeout_func) dlsym(go_lib_handle, "pgraft_go_get_election_timeout");
+		if (timeout_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_get_election_timeout: %s", error ? error : "unknown error");
+			return -1;
+		}
+	}
+	
+	if (timeout_func == NULL)
+	{
+		return -1;
+	}
+	
+	return timeout_func();
+}
+
+/*
+ * Whether a Raft group has quiesced; 0 if unknown
+ */
+int
+pgraft_go_is_quiesced(int group)
+{
+	typedef int (*pgraft_go_is_quiesced_func)(int group);
+	static pgraft_go_is_quiesced_func quiesced_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return 0;
+	}
+	
+	if (quiesced_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		quiesced_func = (pgraft_go_is_quiesced_func) dlsym(go_lib_handle, "pgraft_go_is_quiesced");
+		if (quiesced_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_is_quiesced: %s", error ? error : "unknown error");
+			return 0;
+		}
+	}
+	
+	if (quiesced_func == NULL)
+	{
+		return 0;
+	}
+	
+	return quiesced_func(group);
+}
+
+/*
+ * Copy one page of the Raft log; returns entries copied, -1 if unavailable
+ */
+int
+pgraft_go_read_log(uint64_t from_index, int max_entries, uint64_t *indexes, uint64_t *terms,
+				   int32_t *types, int32_t *sizes, int32_t *offsets, int32_t *lengths,
+				   char *buf, int buf_size, uint64_t *bounds)
+{
+	typedef int (*pgraft_go_read_log_func)(uint64_t from_index, int max_entries, uint64_t *indexes,
+										   uint64_t *terms, int32_t *types, int32_t *sizes,
+										   int32_t *offsets, int32_t *lengths,
+										   char *buf, int buf_size, uint64_t *bounds);
+	static pgraft_go_read_log_func read_log_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return -1;
+	}
+	
+	if (read_log_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		read_log_func = (pgraft_go_read_log_func) dlsym(go_lib_handle, "pgraft_go_read_log");
+		if (read_log_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_read_log: %s", error ? error : "unknown error");
+			return -1;
+		}
+	}
+	
+	if (read_log_func == NULL)
+	{
+		return -1;
+	}
+	
+	return read_log_func(from_index, max_entries, indexes, terms, types, sizes, offsets, lengths,
+						 buf, buf_size, bounds);
+}
+
+/*
+ * Start the Go proposal goroutine on the shared memory ring; -1 on failure
+ */
+int
+pgraft_go_attach_proposals(pgraft_go_proposal_ring_t *ring, uint64_t tail)
+{
+	typedef int (*pgraft_go_attach_proposals_func)(pgraft_go_proposal_ring_t *ring, uint64_t tail);
+	static pgraft_go_attach_proposals_func attach_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return -1;
+	}
+	
+	if (attach_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		attach_func = (pgraft_go_attach_proposals_func) dlsym(go_lib_handle, "pgraft_go_attach_proposals");
+		if (attach_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_attach_proposals: %s", error ? error : "unknown error");
+			return -1;
+		}
+	}
+	
+	if (attach_func == NULL)
+	{
+		return -1;
+	}
+	
+	return attach_func(ring, tail);
+}
+
+/*
+ * Publish the worker-side metrics served to peers' stats rounds
+ */
+void
+pgraft_go_set_local_stats(uint64_t applied_index, int queue_depth, uint64_t kv_hash, uint64_t kv_hash_revision)
+{
+	typedef void (*pgraft_go_set_local_stats_func)(uint64_t applied_index, int queue_depth,
+												   uint64_t kv_hash, uint64_t kv_hash_revision);
+	static pgraft_go_set_local_stats_func set_stats_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return;
+	}
+	
+	if (set_stats_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		set_stats_func = (pgraft_go_set_local_stats_func) dlsym(go_lib_handle, "pgraft_go_set_local_stats");
+		if (set_stats_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_set_local_stats: %s", error ? error : "unknown error");
+			return;
+		}
+	}
+	
+	if (set_stats_func == NULL)
+	{
+		return;
+	}
+	
+	set_stats_func(applied_index, queue_depth, kv_hash, kv_hash_revision);
+}
+
+/*
+ * Hand a change of the KV store to the client gateway's watches
+ */
+void
+pgraft_go_gateway_event(const pgraft_go_kv_t *kv, const pgraft_go_kv_t *prev)
+{
+	typedef void (*pgraft_go_gateway_event_func)(pgraft_go_kv_t *kv, pgraft_go_kv_t *prev);
+	static pgraft_go_gateway_event_func func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return;
+	}
+	
+	if (func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		func = (pgraft_go_gateway_event_func) dlsym(go_lib_handle, "pgraft_go_gateway_event");
+		if (func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_gateway_event: %s", error ? error : "unknown error");
+			return;
+		}
+	}
+	
+	if (func == NULL)
+	{
+		return;
+	}
+	
+	func((pgraft_go_kv_t *) kv, (pgraft_go_kv_t *) prev);
+}
+
+/*
+ * Tell the client gateway an entry was applied
+ */
+void
+pgraft_go_gateway_applied(const char *client_id, int64_t revision, int succeeded)
+{
+	typedef void (*pgraft_go_gateway_applied_func)(char *client_id, int64_t revision, int succeeded);
+	static pgraft_go_gateway_applied_func func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return;
+	}
+	
+	if (func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		func = (pgraft_go_gateway_applied_func) dlsym(go_lib_handle, "pgraft_go_gateway_applied");
+		if (func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_gateway_applied: %s", error ? error : "unknown error");
+			return;
+		}
+	}
+	
+	if (func == NULL)
+	{
+		return;
+	}
+	
+	func((char *) client_id, revision, succeeded);
+}
+
+/*
+ * Take the next read the client gateway queued; 0 if there is none
+ */
+int
+pgraft_go_gateway_next_read(pgraft_go_gateway_read_t *read)
+{
+	typedef int (*pgraft_go_gateway_next_read_func)(pgraft_go_gateway_read_t *read);
+	static pgraft_go_gateway_next_read_func func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return 0;
+	}
+	
+	if (func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		func = (pgraft_go_gateway_next_read_func) dlsym(go_lib_handle, "pgraft_go_gateway_next_read");
+		if (func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_gateway_next_read: %s", error ? error : "unknown error");
+			return 0;
+		}
+	}
+	
+	if (func == NULL)
+	{
+		return 0;
+	}
+	
+	return func(read);
+}
+
+/*
+ * Hand one key of a read to the client gateway
+ */
+void
+pgraft_go_gateway_read_row(uint64_t id, const pgraft_go_kv_t *kv)
+{
+	typedef void (*pgraft_go_gateway_read_row_func)(uint64_t id, pgraft_go_kv_t *kv);
+	static pgraft_go_gateway_read_row_func func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return;
+	}
+	
+	if (func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		func = (pgraft_go_gateway_read_row_func) dlsym(go_lib_handle, "pgraft_go_gateway_read_row");
+		if (func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_gateway_read_row: %s", error ? error : "unknown error");
+			return;
+		}
+	}
+	
+	if (func == NULL)
+	{
+		return;
+	}
+	
+	func(id, (pgraft_go_kv_t *) kv);
+}
+
+/*
+ * Finish a read of the client gateway; revision -1 if it failed
+ */
+void
+pgraft_go_gateway_read_done(uint64_t id, int64_t revision, int64_t count, int64_t lease_ttl, int64_t lease_remaining)
+{
+	typedef void (*pgraft_go_gateway_read_done_func)(uint64_t id, int64_t revision, int64_t count, int64_t lease_ttl, int64_t lease_remaining);
+	static pgraft_go_gateway_read_done_func func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return;
+	}
+	
+	if (func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		func = (pgraft_go_gateway_read_done_func) dlsym(go_lib_handle, "pgraft_go_gateway_read_done");
+		if (func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_gateway_read_done: %s", error ? error : "unknown error");
+			return;
+		}
+	}
+	
+	if (func == NULL)
+	{
+		return;
+	}
+	
+	func(id, revision, count, lease_ttl, lease_remaining);
+}
+
+/*
+ * Copy the last cluster stats round; -1 while a fresh round is collected
+ */
+int
+pgraft_go_cluster_stats(pgraft_go_node_stats_t *stats, int max_nodes, int max_age_ms, int *age_ms)
+{
+	typedef int (*pgraft_go_cluster_stats_func)(pgraft_go_node_stats_t *stats, int max_nodes,
+												int max_age_ms, int *age_ms);
+	static pgraft_go_cluster_stats_func cluster_stats_func = NULL;
+	static bool load_attempted = false;
+	char *error;
+	
+	if (!pgraft_go_is_loaded())
+	{
+		return -1;
+	}
+	
+	if (cluster_stats_func == NULL && !load_attempted)
+	{
+		load_attempted = true;
+		dlerror();
+		cluster_stats_func = (pgraft_go_cluster_stats_func) dlsym(go_lib_handle, "pgraft_go_cluster_stats");
+		if (cluster_stats_func == NULL)
+		{
+			error = dlerror();
+			elog(WARNING, "pgraft: failed to load pgraft_go_cluster_stats: %s", error ? error : "unknown error");
+			return -1;
+		}
+	}
+	
+	if (cluster_stats_func == NULL)
+	{
+		return -1;
+	}
+	
+	return cluster_stats_func(stats, max_nodes, max_age_ms, age_ms);
+}
+
 int
 pgraft_go_append_log(char *data, int length)
 {
@@ -16,8 +16,31 @@ package main
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
 
-// No external C callbacks - we'll use file-based IPC or shared memory
+// No external C callbacks - we'll use file-based IPC or shared memory,
+// except for the pure functions handed over in the config
+
+// Raft group of a KV key (pgraft_kv_group_for_key)
+typedef int (*pgraft_go_group_for_key_fn) (const char *key);
+
+static inline int
+pgraft_go_call_group_for_key(pgraft_go_group_for_key_fn fn, const char *key)
+{
+	return fn(key);
+}
+
+// Quota check of a client gateway write (pgraft_kv_quota_admit_gateway)
+typedef int (*pgraft_go_quota_admit_fn) (const char *key, int is_delete, int64_t value_size, int64_t old_size);
+
+static inline int
+pgraft_go_call_quota_admit(pgraft_go_quota_admit_fn fn, const char *key, int is_delete, int64_t value_size,
+						   int64_t old_size)
+{
+	return fn(key, is_delete, value_size, old_size);
+}
 
 typedef struct pgraft_go_cluster_member {
 	char   *name;
@@ -25,6 +48,107 @@ typedef struct pgraft_go_cluster_member {
 	int		peer_port;
 } pgraft_go_cluster_member;
 
+// Shared memory proposal ring (pgraft_proposal.c). Backends fill a slot and
+// post wakeup; the proposal goroutine proposes it and posts the slot's done.
+#define PGRAFT_PROPOSAL_SLOTS		64
+#define PGRAFT_PROPOSAL_DATA_SIZE	8192
+
+#define PGRAFT_PROPOSAL_FREE		0
+#define PGRAFT_PROPOSAL_READY		1	// Filled by a backend
+#define PGRAFT_PROPOSAL_TAKEN		2	// Being proposed
+#define PGRAFT_PROPOSAL_DONE		3	// result is set
+#define PGRAFT_PROPOSAL_ABANDONED	4	// Backend gave up waiting
+
+#define PGRAFT_PROPOSAL_OK			0
+#define PGRAFT_PROPOSAL_FAILED		(-1)
+#define PGRAFT_PROPOSAL_STALE		(-2)	// Not leading the group in term
+#define PGRAFT_PROPOSAL_UNKNOWN		(-3)	// Consumer went away mid-proposal
+
+typedef struct pgraft_go_proposal_slot {
+	uint32_t	state;		// pg_atomic_uint32 on the C side
+	int32_t		group;
+	int32_t		term;
+	int32_t		result;
+	int32_t		length;
+	sem_t		done;
+	char		data[PGRAFT_PROPOSAL_DATA_SIZE];
+} pgraft_go_proposal_slot;
+
+typedef struct pgraft_go_proposal_ring {
+	uint32_t	consumer;	// pg_atomic_uint32; 1 while the goroutine runs
+	sem_t		wakeup;
+	pgraft_go_proposal_slot slots[PGRAFT_PROPOSAL_SLOTS];
+} pgraft_go_proposal_ring;
+
+// Wait up to timeout_ms for a backend to post the ring's wakeup
+static inline void
+pgraft_go_proposal_wait(pgraft_go_proposal_ring *ring, int timeout_ms)
+{
+#ifdef __APPLE__
+	usleep(timeout_ms * 1000);		// Never attached: no unnamed semaphores
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	(void) sem_timedwait(&ring->wakeup, &ts);
+#endif
+}
+
+// Wake the backend waiting for a slot
+static inline void
+pgraft_go_proposal_post(pgraft_go_proposal_slot *slot)
+{
+	(void) sem_post(&slot->done);
+}
+
+// One node's row of pgraft_cluster_stats()
+typedef struct pgraft_go_node_stats {
+	int64_t		node_id;
+	int			reachable;
+	int64_t		leader_id;
+	uint64_t	term;
+	uint64_t	commit_index;
+	uint64_t	applied_index;
+	int64_t		apply_lag;
+	int64_t		queue_depth;
+	int64_t		pending_entries;
+	int64_t		disk_bytes;
+	int64_t		rtt_us;
+	int64_t		max_peer_rtt_us;
+	uint64_t	kv_hash;
+	uint64_t	kv_hash_revision;
+} pgraft_go_node_stats;
+
+// A key as the client gateway sees it
+typedef struct pgraft_go_kv {
+	const char *key;
+	const char *value;
+	int64_t		create_revision;
+	int64_t		mod_revision;
+	int64_t		version;
+	int64_t		lease;
+} pgraft_go_kv;
+
+// A read the client gateway hands the worker
+typedef struct pgraft_go_gateway_read {
+	uint64_t	id;
+	int			kind;
+	char	   *key;
+	char	   *range_end;
+	int64_t		limit;
+	int			keys_only;
+	int			count_only;
+	int64_t		lease;
+	int			lease_keys;
+} pgraft_go_gateway_read;
+
 typedef struct pgraft_go_config {
 	int		node_id;
 	char   *cluster_id;
@@ -84,6 +208,14 @@ typedef struct pgraft_go_config {
 	int		max_log_entries;
 	int		batch_size;
 	int		max_batch_delay;
+	int		raft_groups;
+	int		quiesce_timeout;
+	int		tick_interval;
+	int		election_timeout_max;
+	int		client_gateway;
+	int		proposal_timeout;
+	pgraft_go_group_for_key_fn group_for_key;
+	pgraft_go_quota_admit_fn quota_admit;
 } pgraft_go_config;
 */
 import "C"
@@ -94,18 +226,22 @@ import (
 	"encoding/binary"
 	"encoding/json"
 	"fmt"
+	"hash/fnv"
 	"io"
 	"io/ioutil"
 	"log"
 	"net"
+	"net/http"
 	"os"
 	"path/filepath"
 	"runtime"
+	"sort"
 	"strconv"
 	"strings"
 	"sync"
 	"sync/atomic"
 	"time"
+	"unicode/utf8"
 	"unsafe"
 
 	"go.etcd.io/raft/v3"
@@ -536,8 +672,30 @@ var (
 	// Error tracking
 	errorCount int64
 	lastError  time.Time
+
+	// Committed normal entries waiting for the background worker to apply
+	committedEntries committedBuffer
 )
 
+// committedEntry is a committed normal entry handed to the C apply path
+type committedEntry struct {
+	index uint64
+	data  []byte
+}
+
+// committedBuffer holds one Raft group's committed entries until the
+// background worker picks them up
+type committedBuffer struct {
+	mu        sync.Mutex
+	entries   []committedEntry
+	lastIndex uint64
+	space     chan struct{} // signalled by pop while a full push waits
+}
+
+// Upper bound on entries buffered for the worker; past it the Ready loop
+// waits for the worker instead of advancing
+const maxCommittedQueue = 10000
+
 // clusterMember represents a single member in the cluster (name + address)
 // Using struct for ordered storage (max 10 nodes)
 type clusterMember struct {
@@ -571,6 +729,13 @@ func recordError(err error) {
 }
 
 // Network utility functions
+
+// isTimeoutError reports whether a read failed only because its deadline passed
+func isTimeoutError(err error) bool {
+	netErr, ok := err.(net.Error)
+	return ok && netErr.Timeout()
+}
+
 func readUint32(conn net.Conn, value *uint32) error {
 	buf := make([]byte, 4)
 	if _, err := io.ReadFull(conn, buf); err != nil {
@@ -587,10 +752,24 @@ func writeUint32(conn net.Conn, value uint32) error {
 	return err
 }
 
+// getNetworkLatency is the mean smoothed heartbeat RTT to the peers in
+// milliseconds, 0 until a round trip has been measured
 func getNetworkLatency() float64 {
-	// Simple network latency measurement
-	// In a real implementation, this would measure actual network latency
-	return 1.0 // milliseconds
+	peerLatencyMutex.Lock()
+	defer peerLatencyMutex.Unlock()
+
+	var total time.Duration
+	n := 0
+	for _, pl := range peerLatencies {
+		if pl.samples > 0 {
+			total += pl.srtt
+			n++
+		}
+	}
+	if n == 0 {
+		return 0
+	}
+	return float64(total) / float64(n) / float64(time.Millisecond)
 }
 
 // Debug logging function that respects log level
@@ -656,8 +835,15 @@ func pgraft_go_start() C.int {
 	go raftProcessingLoop()
 	go messageReceiver()
 	go connectionMonitor()
+	for g := 1; g < len(raftGroups); g++ {
+		go groupReadyLoop(raftGroups[g])
+	}
+	if len(raftGroups) > 1 {
+		go groupTransportLoop()
+	}
 
 	atomic.StoreInt32(&running, 1)
+	startClientGateway()
 	logInfo("INFO - Started successfully - Ready processing active, tick will be called from worker")
 
 	return 0
@@ -681,6 +867,7 @@ func pgraft_go_propose(data *C.char, len C.size_t) C.int {
 	logInfo("proposing entry to raft: len=%d, data='%s'", len, string(goData))
 
 	// Propose to Raft
+	raftQuiescence.wake(0, "proposal")
 	err := raftNode.Propose(raftCtx, goData)
 	if err != nil {
 		logError("failed to propose to raft: %v", err)
@@ -693,6 +880,9 @@ func pgraft_go_propose(data *C.char, len C.size_t) C.int {
 
 //export pgraft_go_stop
 func pgraft_go_stop() C.int {
+	// Before taking raftMutex: the proposal goroutine needs it to finish
+	detachProposals()
+
 	raftMutex.Lock()
 	defer raftMutex.Unlock()
 
@@ -702,6 +892,7 @@ func pgraft_go_stop() C.int {
 	}
 
 	// Signal shutdown
+	stopClientGateway()
 	close(stopChan)
 
 	// Stop ticker
@@ -714,6 +905,10 @@ func pgraft_go_stop() C.int {
 		raftCancel()
 	}
 
+	for g := 1; g < len(raftGroups); g++ {
+		raftGroups[g].node.Stop()
+	}
+
 	// Close all connections
 	connMutex.Lock()
 	for nodeID, managedConn := range connections {
@@ -867,6 +1062,11 @@ func pgraft_go_init_config(config *C.struct_pgraft_go_config) C.int {
 	heartbeatInterval := int(config.heartbeat_interval)
 	snapshotInterval := int(config.snapshot_interval)
 	memberCount := int(config.cluster_member_count)
+	groupCount := int(config.raft_groups)
+	joining := config.initial_cluster_state == 0
+	quiesceTimeout := int(config.quiesce_timeout)
+	tickIntervalMs := int(config.tick_interval)
+	electionTimeoutMax := int(config.election_timeout_max)
 
 	// Extract pre-parsed cluster members from C struct (already split into host/port)
 	if memberCount == 0 || config.cluster_members == nil {
@@ -951,25 +1151,40 @@ func pgraft_go_init_config(config *C.struct_pgraft_go_config) C.int {
 
 	// NOTE: Storage creation moved after Raft ID determination
 
-	// Calculate ticks from millisecond values (etcd-style)
-	// Tick interval is 100ms, so we convert timeouts to ticks
-	tickIntervalMs := 100
-	electionTick := electionTimeout / tickIntervalMs
-	heartbeatTick := heartbeatInterval / tickIntervalMs
-
-	// Ensure minimum values
-	if electionTick < 1 {
-		electionTick = 10
-		logInfo("WARNING - election_timeout too small, using minimum 10 ticks (1000ms)")
+	// Calculate ticks from millisecond values (etcd-style) using the
+	// configured tick resolution (pgraft.tick_interval)
+	if tickIntervalMs < 1 {
+		tickIntervalMs = 100
 	}
-	if heartbeatTick < 1 {
-		heartbeatTick = 1
-		logInfo("WARNING - heartbeat_interval too small, using minimum 1 tick (100ms)")
+	tickInterval = time.Duration(tickIntervalMs) * time.Millisecond
+	electionTick := durationToTicks("election_timeout", electionTimeout, tickIntervalMs)
+	heartbeatTick := durationToTicks("heartbeat_interval", heartbeatInterval, tickIntervalMs)
+
+	// Raft needs at least one heartbeat per election timeout
+	if electionTick <= heartbeatTick {
+		electionTick = heartbeatTick * 10
+		logWarning("election_timeout must exceed heartbeat_interval, using %d ticks (%dms)",
+			electionTick, electionTick*tickIntervalMs)
 	}
 
 	logInfo("raft timing: electiontick=%d, heartbeatTick=%d (tick interval=%dms)",
 		electionTick, heartbeatTick, tickIntervalMs)
 
+	// Followers stretch their election timeout up to election_timeout_max
+	// when the leader's heartbeats arrive late or irregularly
+	configureElectionAdaptation(electionTick*tickIntervalMs, electionTimeoutMax)
+
+	// Idle groups stop ticking after quiesce_timeout; 0 keeps them ticking
+	if quiesceTimeout > 0 {
+		quiesceTicks := quiesceTimeout / tickIntervalMs
+		if quiesceTicks < 1 {
+			quiesceTicks = 1
+		}
+		atomic.StoreInt32(&quiesceAfterTicks, int32(quiesceTicks))
+		atomic.StoreInt32(&quiesceKeepaliveTicks, int32(electionTick))
+		logInfo("raft quiescence after %d idle ticks, keepalive every %d ticks", quiesceTicks, electionTick)
+	}
+
 	// NOTE: raftConfig will be fully initialized after we determine the Raft ID
 	// For now, just set the timing parameters
 	logInfo("raft timing prepared: electionTick=%d, heartbeatTick=%d (tick interval=%dms)",
@@ -1077,10 +1292,20 @@ func pgraft_go_init_config(config *C.struct_pgraft_go_config) C.int {
 
 	logInfo("Bootstrap node %d created with %d initial peers", nodeID, len(peers))
 
+	// Additional Raft groups share the peers but nothing else
+	if groupCount > 1 {
+		if err := startRaftGroups(groupCount, thisNodeRaftID, dataDir, electionTick, heartbeatTick, joining); err != nil {
+			logError("%v", err)
+			return -1
+		}
+	}
+
 	// Initialize applied and committed indices
 	appliedIndex = 0
 	committedIndex = 0
 
+	configureClientGateway(config, clusterID)
+
 	logInfo("INFO - Raft node initialized, goroutines will be started separately via pgraft_go_start()")
 
 	// Note: Campaign will be triggered automatically based on cluster size and initial_cluster_state
@@ -1275,7 +1500,8 @@ func pgraft_go_start_background() C.int {
 	debugLog("start_background: background processing started")
 
 	// Start the ticker for Raft operations
-	raftTicker = time.NewTicker(100 * time.Millisecond)
+	tickStartTime = time.Now()
+	raftTicker = time.NewTicker(tickInterval)
 	go processRaftTicker()
 	debugLog("start_background: Raft ticker started")
 
@@ -1323,33 +1549,24 @@ func pgraft_go_add_peer(nodeID C.int, address *C.char, port C.int) C.int {
 			Context: []byte(nodeAddr),
 		}
 
-		// Propose the configuration change with proper sequencing
+		// Propose the configuration change in the background: the retries
+		// back off for seconds, which the caller must not wait through
 		logInfo("proposing configuration change for node %d", nodeID)
+		node := raftNode
+		go func() {
+			// Use a longer timeout for configuration changes
+			ctx, cancel := context.WithTimeout(raftCtx, 30*time.Second)
+			defer cancel()
 
-		// Use a longer timeout for configuration changes
-		ctx, cancel := context.WithTimeout(raftCtx, 30*time.Second)
-		defer cancel()
-
-		// Retry configuration change up to 3 times
-		var err error
-		for retry := 0; retry < 3; retry++ {
-			if retry > 0 {
-				logInfo("Retrying configuration change for node %d (attempt %d)", nodeID, retry+1)
-				time.Sleep(time.Duration(retry) * time.Second) // Exponential backoff
-			}
-
-			err = raftNode.ProposeConfChange(ctx, cc)
-			if err == nil {
-				logInfo("configuration change proposed successfully for node %d", nodeID)
-				break
+			if err := proposeConfChangeWithRetry(ctx, node, &raftQuiescence, 0, cc); err != nil {
+				logError("failed to propose configuration change for node %d after 3 attempts: %v", nodeID, err)
+				return
 			}
-			logInfo("ERROR proposing configuration change (attempt %d): %v", retry+1, err)
-		}
+			logInfo("configuration change proposed successfully for node %d", nodeID)
 
-		if err != nil {
-			logInfo("CRITICAL ERROR - Failed to propose configuration change for node %d after 3 attempts", nodeID)
-			return -1
-		}
+			// The additional groups get the same member
+			proposeGroupConfChange(cc)
+		}()
 
 		// Establish TCP connection to the peer
 		go func() {
@@ -1366,7 +1583,7 @@ func pgraft_go_add_peer(nodeID C.int, address *C.char, port C.int) C.int {
 		logInfo("WARNING - Raft node is nil, cannot add peer to configuration")
 	}
 
-	logInfo("added peer node %d at %s (configuration change applied)", nodeID, nodeAddr)
+	logInfo("added peer node %d at %s (configuration change proposed)", nodeID, nodeAddr)
 
 	return 0
 }
@@ -1399,7 +1616,9 @@ func pgraft_go_remove_peer(nodeID C.int) C.int {
 		NodeID: uint64(nodeID),
 	}
 
+	raftQuiescence.wake(0, "configuration change")
 	raftNode.ProposeConfChange(raftCtx, cc)
+	proposeGroupConfChange(cc)
 
 	logInfo("removed peer node %d", nodeID)
 
@@ -1540,6 +1759,7 @@ func pgraft_go_append_log(data *C.char, length C.int) C.int {
 	goData := C.GoBytes(unsafe.Pointer(data), length)
 
 	// Propose the data
+	raftQuiescence.wake(0, "proposal")
 	raftNode.Propose(raftCtx, goData)
 
 	atomic.AddInt64(&logEntriesCommitted, 1)
@@ -1565,6 +1785,18 @@ func pgraft_go_get_stats() *C.char {
 		"uptime_seconds":        time.Since(startupTime).Seconds(),
 		"health_status":         healthStatus,
 		"connected_nodes":       len(connections),
+		"raft_groups":           int(pgraft_go_group_count()),
+		"group_frames_sent":     atomic.LoadInt64(&groupFramesSent),
+		"group_messages_sent":   atomic.LoadInt64(&groupMessagesSent),
+		"group_leader_moves":    atomic.LoadInt64(&groupLeaderMoves),
+		"tick_interval_ms":      tickInterval.Milliseconds(),
+		"ticks":                 atomic.LoadUint64(&tickCount),
+		"ticks_missed":          atomic.LoadInt64(&ticksMissed),
+		"election_timeout_ms":   int(pgraft_go_get_election_timeout()),
+		"quiesced":              raftQuiescence.isQuiesced(),
+		"quiesce_entered":       atomic.LoadInt64(&quiesceEntered),
+		"quiesce_wakeups":       atomic.LoadInt64(&quiesceWakeups),
+		"proposals_direct":      atomic.LoadInt64(&proposalsDirect),
 	}
 
 	jsonData, err := json.Marshal(stats)
@@ -1575,45 +1807,89 @@ func pgraft_go_get_stats() *C.char {
 	return C.CString(string(jsonData))
 }
 
-//export pgraft_go_get_logs
-func pgraft_go_get_logs() *C.char {
+// pgraft_go_read_log copies up to maxEntries entries of the group 0 log,
+// starting at fromIndex, into the caller's arrays. Payloads are packed back to
+// back into buf; an entry that no longer fits ends the page, except the first,
+// which is truncated so that every page makes progress. bounds receives the
+// first, last and commit index and the persistence failure count. Returns the
+// number of entries copied, or -1 if Raft is not running.
+//
+//export pgraft_go_read_log
+func pgraft_go_read_log(fromIndex C.uint64_t, maxEntries C.int, indexes *C.uint64_t, terms *C.uint64_t,
+	types *C.int32_t, sizes *C.int32_t, offsets *C.int32_t, lengths *C.int32_t,
+	buf *C.char, bufSize C.int, bounds *C.uint64_t) C.int {
 	raftMutex.RLock()
 	defer raftMutex.RUnlock()
 
-	if atomic.LoadInt32(&running) == 0 {
-		return C.CString("[]")
+	if atomic.LoadInt32(&running) == 0 || raftStorage == nil {
+		return -1
 	}
 
-	// Get logs from storage
-	firstIndex, _ := raftStorage.FirstIndex()
-	lastIndex, _ := raftStorage.LastIndex()
-
-	logs := make([]map[string]interface{}, 0)
-
-	for i := firstIndex; i <= lastIndex; i++ {
-		entries, err := raftStorage.Entries(i, i+1, 0)
-		if err != nil || len(entries) == 0 {
-			continue
-		}
+	firstIndex, err := raftStorage.FirstIndex()
+	if err != nil {
+		return -1
+	}
+	lastIndex, err := raftStorage.LastIndex()
+	if err != nil {
+		return -1
+	}
 
-		entry := entries[0]
-		logEntry := map[string]interface{}{
-			"index":     entry.Index,
-			"term":      entry.Term,
-			"type":      entry.Type.String(),
-			"data":      string(entry.Data),
-			"committed": entry.Index <= committedIndex,
-		}
+	boundSlice := unsafe.Slice(bounds, 4)
+	boundSlice[0] = C.uint64_t(firstIndex)
+	boundSlice[1] = C.uint64_t(lastIndex)
+	boundSlice[2] = C.uint64_t(committedIndex)
+	boundSlice[3] = C.uint64_t(atomic.LoadInt64(&persistenceFailureCount))
 
-		logs = append(logs, logEntry)
+	lo := uint64(fromIndex)
+	if lo < firstIndex {
+		lo = firstIndex
+	}
+	if maxEntries <= 0 || bufSize <= 0 || lo > lastIndex {
+		return 0
+	}
+	hi := lo + uint64(maxEntries)
+	if hi > lastIndex+1 {
+		hi = lastIndex + 1
 	}
 
-	jsonData, err := json.Marshal(logs)
+	// Entries hands back a view of the storage's own slice, so the payloads
+	// are copied exactly once, straight into the caller's buffer
+	entries, err := raftStorage.Entries(lo, hi, uint64(bufSize))
 	if err != nil {
-		return C.CString("{\"error\": \"failed to marshal logs\"}")
+		return -1
 	}
 
-	return C.CString(string(jsonData))
+	indexSlice := unsafe.Slice(indexes, int(maxEntries))
+	termSlice := unsafe.Slice(terms, int(maxEntries))
+	typeSlice := unsafe.Slice(types, int(maxEntries))
+	sizeSlice := unsafe.Slice(sizes, int(maxEntries))
+	offsetSlice := unsafe.Slice(offsets, int(maxEntries))
+	lengthSlice := unsafe.Slice(lengths, int(maxEntries))
+	data := unsafe.Slice((*byte)(unsafe.Pointer(buf)), int(bufSize))
+
+	used := 0
+	n := 0
+	for _, entry := range entries {
+		stored := len(entry.Data)
+		if used+stored > len(data) {
+			if n > 0 {
+				break
+			}
+			stored = len(data) - used
+		}
+
+		indexSlice[n] = C.uint64_t(entry.Index)
+		termSlice[n] = C.uint64_t(entry.Term)
+		typeSlice[n] = C.int32_t(entry.Type)
+		sizeSlice[n] = C.int32_t(len(entry.Data))
+		offsetSlice[n] = C.int32_t(used)
+		lengthSlice[n] = C.int32_t(stored)
+		copy(data[used:used+stored], entry.Data[:stored])
+		used += stored
+		n++
+	}
+
+	return C.int(n)
 }
 
 //export pgraft_go_commit_log
@@ -1684,42 +1960,77 @@ func pgraft_go_free_string(str *C.char) {
 	C.free(unsafe.Pointer(str))
 }
 
-// Main processing loop following etcd-io/raft patterns
-// pgraft_go_tick is called by the PostgreSQL background worker on each iteration
-// This is a non-blocking function that processes one tick of Raft work
+// pgraft_go_tick reports whether Raft is running. Raft time is advanced only
+// by the Go tick scheduler (processRaftTicker), so calling this never ticks
+// and the worker loop's timing cannot change the tick rate.
 //
 //export pgraft_go_tick
 func pgraft_go_tick() C.int {
-	if atomic.LoadInt32(&running) == 0 {
-		// Log periodically (not every call to avoid spam)
-		if tickCount%100 == 0 {
-			logInfo("tick() called but not running (tickCount=%d)", tickCount)
-		}
-		tickCount++
-		return -1 // Not running
+	if atomic.LoadInt32(&running) == 0 || raftNode == nil {
+		return -1
 	}
+	return 0
+}
 
-	if raftNode == nil {
-		if tickCount%100 == 0 {
-			logInfo("tick() called but raftNode is nil (tickCount=%d)", tickCount)
-		}
-		tickCount++
-		return -1 // Not initialized
+// Tick scheduler
+//
+// A single goroutine advances Raft time every pgraft.tick_interval, so
+// election_timeout and heartbeat_interval map onto a whole number of ticks
+// of a known length. The schedule follows the monotonic clock: when the
+// scheduler falls behind (GC pause, overloaded host) the ticks it could not
+// run are counted as missed rather than replayed in a burst, which would
+// fire election timeouts all at once.
+
+var (
+	tickInterval  = 100 * time.Millisecond
+	ticksRun      uint64
+	ticksMissed   int64
+	tickStartTime time.Time
+)
+
+// durationToTicks converts a millisecond setting into ticks, rounding to
+// the nearest tick and never below one
+func durationToTicks(name string, ms int, tickMs int) int {
+	ticks := (ms + tickMs/2) / tickMs
+	if ticks < 1 {
+		ticks = 1
+	}
+	if ticks*tickMs != ms {
+		logWarning("%s of %dms is not a multiple of tick_interval %dms, using %d ticks (%dms)",
+			name, ms, tickMs, ticks, ticks*tickMs)
 	}
+	return ticks
+}
+
+// ticksPerSecond is the number of ticks in one second, at least one
+func ticksPerSecond() uint64 {
+	n := uint64(time.Second / tickInterval)
+	if n < 1 {
+		n = 1
+	}
+	return n
+}
 
-	// Perform one Raft tick
-	raftNode.Tick()
+// runRaftTick advances group 0 and the additional groups by one tick
+func runRaftTick() {
+	// Idle clusters stop ticking until a proposal or message arrives; a
+	// follower on a slow link runs its clock slower to stretch its
+	// election timeout
+	if raftQuiescence.shouldTick(0, raftNode, raftStorage, sendMessage) && electionClockAdvances() {
+		raftNode.Tick()
+	}
+	tickRaftGroups()
 
-	// Periodically log status for debugging (every 10 ticks = ~1 second)
-	tickCount++
-	if tickCount%10 == 0 {
+	// Periodically log status for debugging (about once a second)
+	ticks := atomic.AddUint64(&tickCount, 1)
+	if ticks%ticksPerSecond() == 0 {
 		status := raftNode.Status()
-		logInfo("raft status (tick #%d): state=%s, term=%d, lead=%d",
-			tickCount, status.RaftState.String(), status.Term, status.Lead)
+		debugLog("raft status (tick #%d): state=%s, term=%d, lead=%d",
+			ticks, status.RaftState.String(), status.Term, status.Lead)
 	}
 
 	// FIX #2: Immediate campaign for single-node clusters (after first tick)
-	if tickCount == 1 {
+	if ticks == 1 {
 		logInfo("First tick received! Checking if single-node...")
 		status := raftNode.Status()
 		isSingleNode := len(status.Config.Voters[0]) == 1
@@ -1729,8 +2040,6 @@ func pgraft_go_tick() C.int {
 			raftNode.Campaign(raftCtx)
 		}
 	}
-
-	return 0
 }
 
 // Separate Ready processing loop (etcd/raft recommended pattern)
@@ -1966,8 +2275,9 @@ func applyEntry(entry raftpb.Entry) {
 			return
 		}
 
-		// Store committed entry data for background worker to apply
-		// The background worker will read from Raft storage and apply to PostgreSQL
+		// Hand the committed entry to the background worker, which applies
+		// it to the local state machine through pgraft_go_next_committed
+		queueCommittedEntry(entry)
 
 		// Update applied index
 		appliedIndex = entry.Index
@@ -1996,151 +2306,3286 @@ func applyEntry(entry raftpb.Entry) {
 	}
 }
 
-// Apply configuration change
-func applyConfChange(cc raftpb.ConfChange) {
-	logInfo("Applying ConfChange: type=%s, node=%d", cc.Type.String(), cc.NodeID)
+// queueCommittedEntry buffers a committed normal entry for the background
+// worker. Both Ready consumers call this, so entries are de-duplicated by index.
+func queueCommittedEntry(entry raftpb.Entry) {
+	committedEntries.push(entry)
+}
 
-	// CRITICAL: Actually apply the configuration change to the Raft node
-	if raftNode != nil {
-		logInfo("Applying ConfChange to Raft node")
-		raftNode.ApplyConfChange(cc)
-		logInfo("ConfChange applied to Raft node successfully")
-	} else {
-		logInfo("ERROR - Raft node is nil, cannot apply ConfChange")
-		return
+// push appends a committed entry unless an entry at or past its index was
+// already buffered. A full buffer blocks the calling Ready loop until the
+// background worker catches up, so committed entries are never skipped;
+// returns false only when Raft is stopping.
+func (b *committedBuffer) push(entry raftpb.Entry) bool {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+
+	if entry.Index <= b.lastIndex {
+		return true
 	}
+	if len(b.entries) >= maxCommittedQueue {
+		logWarning("committed entry queue full at index %d, waiting for the background worker", entry.Index)
+	}
+	for len(b.entries) >= maxCommittedQueue {
+		if b.space == nil {
+			b.space = make(chan struct{}, 1)
+		}
+		space := b.space
+		stop := stopChan
 
-	switch cc.Type {
-	case raftpb.ConfChangeAddNode:
-		logInfo("Added node %d to cluster", cc.NodeID)
-		// Update transport membership
-		updateTransportMembership()
-	case raftpb.ConfChangeRemoveNode:
-		logInfo("Removed node %d from cluster", cc.NodeID)
-		// Update transport membership
-		updateTransportMembership()
-	case raftpb.ConfChangeUpdateNode:
-		logInfo("Updated node %d in cluster", cc.NodeID)
-		// Update transport membership
-		updateTransportMembership()
+		b.mu.Unlock()
+		select {
+		case <-space:
+		case <-stop:
+			b.mu.Lock()
+			return false
+		}
+		b.mu.Lock()
+
+		// The other Ready consumer may have buffered it meanwhile
+		if entry.Index <= b.lastIndex {
+			return true
+		}
 	}
+
+	data := make([]byte, len(entry.Data))
+	copy(data, entry.Data)
+	b.entries = append(b.entries, committedEntry{index: entry.Index, data: data})
+	b.lastIndex = entry.Index
+	return true
 }
 
-// Update transport membership to match Raft configuration
-func updateTransportMembership() {
-	logInfo("Updating transport membership")
+// pop removes the oldest buffered entry
+func (b *committedBuffer) pop() (committedEntry, bool) {
+	b.mu.Lock()
+	defer b.mu.Unlock()
 
-	// Get current Raft status to see the configuration
-	if raftNode == nil {
-		logInfo("WARNING - Raft node is nil, cannot update transport membership")
-		return
+	if len(b.entries) == 0 {
+		return committedEntry{}, false
 	}
 
-	status := raftNode.Status()
-	logInfo("Current Raft configuration: voters=%v, learners=%v", status.Config.Voters, status.Config.Learners)
-
-	// The Raft node's configuration is automatically updated by ApplyConfChange
-	// We just need to ensure our transport layer knows about the changes
-	nodesMutex.Lock()
-	defer nodesMutex.Unlock()
+	entry := b.entries[0]
+	b.entries[0] = committedEntry{}
+	b.entries = b.entries[1:]
 
-	// Remove nodes that are no longer in the configuration
-	for id := range status.Config.Voters {
-		found := false
-		for voterID := range status.Config.Voters {
-			if id == voterID {
-				found = true
-				break
-			}
-		}
-		if !found && uint64(id) != raftConfig.ID {
-			logInfo("Removing disconnected node %d from transport membership", id)
-			delete(nodes, uint64(id))
-			// Also close and remove connection if it exists
-			connMutex.Lock()
-			if managedConn, ok := connections[uint64(id)]; ok {
-				managedConn.Conn.Close()
-				delete(connections, uint64(id))
-			}
-			connMutex.Unlock()
+	// Wake a Ready loop waiting for room
+	if b.space != nil {
+		select {
+		case b.space <- struct{}{}:
+		default:
 		}
 	}
-	for id := range status.Config.Learners {
-		found := false
-		for learnerID := range status.Config.Learners {
-			if id == learnerID {
-				found = true
-				break
-			}
-		}
-		if !found && id != raftConfig.ID {
-			logInfo("Removing disconnected learner node %d from transport membership", id)
-			delete(nodes, id)
-			// Also close and remove connection if it exists
-			connMutex.Lock()
-			if managedConn, ok := connections[id]; ok {
-				managedConn.Conn.Close()
-				delete(connections, id)
-			}
-			connMutex.Unlock()
-		}
+	return entry, true
+}
+
+// depth is the number of entries waiting for the background worker
+func (b *committedBuffer) depth() int {
+	b.mu.Lock()
+	defer b.mu.Unlock()
+
+	return len(b.entries)
+}
+
+// pgraft_go_next_committed pops the oldest committed entry not yet handed to
+// the background worker. Returns NULL when there is none; otherwise the caller
+// owns the returned buffer and must release it with pgraft_go_free_string.
+//
+//export pgraft_go_next_committed
+func pgraft_go_next_committed(index *C.uint64_t, length *C.int) *C.char {
+	entry, ok := committedEntries.pop()
+	if !ok {
+		return nil
 	}
 
-	logInfo("Transport membership updated - nodes: %v", nodes)
+	*index = C.uint64_t(entry.index)
+	*length = C.int(len(entry.data))
+	return (*C.char)(C.CBytes(entry.data))
 }
 
-// Apply configuration change v2
-func applyConfChangeV2(cc raftpb.ConfChangeV2) {
-	logInfo("Applying ConfChangeV2: changes=%d", len(cc.Changes))
+// Multi-Raft
+//
+// Besides the original group (group 0: raftNode, raftStorage and the other
+// package globals) a node can host pgraft.raft_groups-1 additional groups.
+// Every group has the same voters but its own log, storage, leader and
+// committed-entry buffer, so KV writes hashed to different groups commit in
+// parallel instead of queueing behind a single leader.
+//
+// Messages of the additional groups are not written one by one. Ready loops
+// queue them per destination node and one flusher writes a single framed
+// batch per peer; heartbeats are only flushed on the tick, so the heartbeats
+// of all groups between two nodes share one write.
+
+// Upper bound on groups per node; matches PGRAFT_MAX_GROUPS on the C side
+const maxRaftGroups = 16
+
+// A frame length with this bit set carries a batch of group messages encoded
+// as repeated [group uint32][length uint32][message] records. Group 0 keeps
+// the plain [length][message] framing.
+const groupFrameFlag = 0x80000000
+
+// raftGroup is one additional Raft group hosted by this node
+type raftGroup struct {
+	id        uint32
+	node      raft.Node
+	storage   *PersistentStorage
+	committed committedBuffer
+	quiesce   quiescence
+
+	// Published with atomics for pgraft_go_group_status
+	lead      uint64
+	term      uint64
+	commit    uint64
+	proposals int64
+}
 
-	// CRITICAL: Actually apply the configuration change to the Raft node
-	if raftNode != nil {
-		logInfo("Applying ConfChangeV2 to Raft node")
-		raftNode.ApplyConfChange(cc)
-		logInfo("ConfChangeV2 applied to Raft node successfully")
-	} else {
-		logInfo("ERROR - Raft node is nil, cannot apply ConfChangeV2")
-		return
+// groupMessage is a marshalled message waiting in a peer's outbox
+type groupMessage struct {
+	group uint32
+	data  []byte
+}
+
+var (
+	raftGroups []*raftGroup // Index 0 unused: group 0 is raftNode
+
+	groupOutbox      map[uint64][]groupMessage
+	groupOutboxMutex sync.Mutex
+	groupFlushChan   chan struct{}
+	groupTicks       uint64
+
+	groupFramesSent   int64
+	groupMessagesSent int64
+	groupLeaderMoves  int64
+)
+
+// startRaftGroups creates groups 1..count-1 next to the already created
+// group 0, each with its own storage under dataDir. A node joining an
+// existing cluster starts its groups empty: every group's leader adds it
+// through the membership change proposed to all groups, then sends it the
+// log or a snapshot.
+func startRaftGroups(count int, nodeID uint64, dataDir string, electionTick, heartbeatTick int, joining bool) error {
+	if count > maxRaftGroups {
+		logWarning("raft_groups=%d exceeds maximum of %d, using %d", count, maxRaftGroups, maxRaftGroups)
+		count = maxRaftGroups
 	}
 
-	for _, change := range cc.Changes {
-		switch change.Type {
-		case raftpb.ConfChangeAddNode:
-			logInfo("Added node %d to cluster", change.NodeID)
-		case raftpb.ConfChangeRemoveNode:
-			logInfo("Removed node %d from cluster", change.NodeID)
-		case raftpb.ConfChangeUpdateNode:
-			logInfo("Updated node %d in cluster", change.NodeID)
-		}
+	raftGroups = make([]*raftGroup, count)
+	groupOutbox = make(map[uint64][]groupMessage)
+	groupFlushChan = make(chan struct{}, 1)
+
+	nodesMutex.RLock()
+	peers := make([]raft.Peer, 0, len(nodes))
+	for peerID := range nodes {
+		peers = append(peers, raft.Peer{ID: peerID})
 	}
+	nodesMutex.RUnlock()
 
-	// Update transport membership
-	updateTransportMembership()
-}
+	for g := 1; g < count; g++ {
+		storage, err := NewPersistentStorage(nodeID, filepath.Join(dataDir, fmt.Sprintf("group_%d", g)))
+		if err != nil {
+			return fmt.Errorf("failed to create storage for raft group %d: %v", g, err)
+		}
 
-// Process outgoing messages through comm module
-func processMessage(msg raftpb.Message) {
-	// Convert message to bytes
-	data, err := msg.Marshal()
-	if err != nil {
-		logInfo("failed to marshal message: %v", err)
-		return
+		config := &raft.Config{
+			ID:              nodeID,
+			ElectionTick:    electionTick,
+			HeartbeatTick:   heartbeatTick,
+			Storage:         storage,
+			MaxInflightMsgs: 256,
+			MaxSizePerMsg:   1024 * 1024,
+			PreVote:         true,
+		}
+
+		group := &raftGroup{id: uint32(g), storage: storage}
+		hardState, confState, err := storage.InitialState()
+		if err == nil && (!raft.IsEmptyHardState(hardState) || len(confState.Voters) > 0) {
+			group.node = raft.RestartNode(config)
+			group.term = hardState.Term
+			group.commit = hardState.Commit
+		} else if joining {
+			group.node = raft.RestartNode(config)
+		} else {
+			group.node = raft.StartNode(config, peers)
+		}
+		raftGroups[g] = group
 	}
 
-	// Send to specific node
-	if msg.To != 0 {
-		sendToNode(msg.To, data)
+	if joining {
+		logInfo("started %d additional raft groups empty, waiting to be added", count-1)
 	} else {
-		// Broadcast to all nodes
-		broadcastToAllNodes(data)
+		logInfo("started %d additional raft groups with %d peers each", count-1, len(peers))
 	}
+	return nil
+}
 
-	atomic.AddInt64(&messagesProcessed, 1)
+// proposeGroupConfChange proposes a membership change, already proposed to
+// group 0, to every additional group so they keep the same members. A
+// group this node does not lead forwards the proposal to its leader. Each
+// group retries in its own goroutine, so the caller never waits on them.
+func proposeGroupConfChange(cc raftpb.ConfChange) {
+	for g := 1; g < len(raftGroups); g++ {
+		go func(group *raftGroup) {
+			ctx, cancel := context.WithTimeout(raftCtx, 30*time.Second)
+			defer cancel()
+			if err := proposeConfChangeWithRetry(ctx, group.node, &group.quiesce, group.id, cc); err != nil {
+				logError("raft group %d: failed to propose configuration change for node %d: %v", group.id, cc.NodeID, err)
+			}
+		}(raftGroups[g])
+	}
 }
 
-// Send message to specific node
-func sendToNode(nodeID uint64, data []byte) {
-	connMutex.RLock()
+// proposeConfChangeWithRetry proposes cc to one group, retrying up to three
+// times with a growing backoff that ends early when ctx does
+func proposeConfChangeWithRetry(ctx context.Context, node raft.Node, quiesce *quiescence, g uint32, cc raftpb.ConfChange) error {
+	var err error
+	for retry := 0; retry < 3; retry++ {
+		if retry > 0 {
+			select {
+			case <-time.After(time.Duration(retry) * time.Second):
+			case <-ctx.Done():
+				return ctx.Err()
+			}
+		}
+		quiesce.wake(g, "configuration change")
+		if err = node.ProposeConfChange(ctx, cc); err == nil {
+			return nil
+		}
+	}
+	return err
+}
+
+// lookupGroup returns additional group g, or nil if there is no such group
+func lookupGroup(g int) *raftGroup {
+	if g <= 0 || g >= len(raftGroups) {
+		return nil
+	}
+	return raftGroups[g]
+}
+
+// groupReadyLoop persists, sends and hands off the Ready output of one group
+func groupReadyLoop(group *raftGroup) {
+	logInfo("ready loop for raft group %d started", group.id)
+
+	for {
+		select {
+		case <-raftCtx.Done():
+			return
+		case <-stopChan:
+			return
+		case rd := <-group.node.Ready():
+			if !raft.IsEmptySnap(rd.Snapshot) {
+				if err := group.storage.ApplySnapshot(rd.Snapshot); err != nil {
+					stopGroup(group, "failed to apply snapshot", err)
+					return
+				}
+			}
+			if len(rd.Entries) > 0 {
+				if err := group.storage.Append(rd.Entries); err != nil {
+					stopGroup(group, "failed to persist entries", err)
+					return
+				}
+			}
+			if !raft.IsEmptyHardState(rd.HardState) {
+				if err := group.storage.SetHardState(rd.HardState); err != nil {
+					stopGroup(group, "failed to persist hard state", err)
+					return
+				}
+				atomic.StoreUint64(&group.term, rd.HardState.Term)
+				atomic.StoreUint64(&group.commit, rd.HardState.Commit)
+			}
+			if rd.SoftState != nil {
+				atomic.StoreUint64(&group.lead, rd.SoftState.Lead)
+			}
+
+			for _, msg := range rd.Messages {
+				queueGroupMessage(group, msg)
+			}
+
+			for _, entry := range rd.CommittedEntries {
+				switch entry.Type {
+				case raftpb.EntryNormal:
+					if len(entry.Data) > 0 {
+						group.committed.push(entry)
+					}
+				case raftpb.EntryConfChange:
+					var cc raftpb.ConfChange
+					if err := cc.Unmarshal(entry.Data); err == nil {
+						group.node.ApplyConfChange(cc)
+					}
+				case raftpb.EntryConfChangeV2:
+					var cc raftpb.ConfChangeV2
+					if err := cc.Unmarshal(entry.Data); err == nil {
+						group.node.ApplyConfChange(cc)
+					}
+				}
+			}
+
+			group.node.Advance()
+		}
+	}
+}
+
+// stopGroup takes a group out of service on this node after its storage
+// failed. Going on would send messages and acknowledge entries this node
+// may not have persisted; proposals to the stopped group fail instead.
+func stopGroup(group *raftGroup, what string, err error) {
+	logError("raft group %d: %s, stopping the group on this node: %v", group.id, what, err)
+	atomic.StoreUint64(&group.lead, 0)
+	group.node.Stop()
+}
+
+// queueGroupMessage puts a group message in its destination's outbox
+func queueGroupMessage(group *raftGroup, msg raftpb.Message) {
+	if msg.To == raftConfig.ID {
+		group.node.Step(raftCtx, msg)
+		return
+	}
+
+	data, err := msg.Marshal()
+	if err != nil {
+		logError("raft group %d: failed to marshal message for node %d: %v", group.id, msg.To, err)
+		return
+	}
+
+	groupOutboxMutex.Lock()
+	groupOutbox[msg.To] = append(groupOutbox[msg.To], groupMessage{group: group.id, data: data})
+	groupOutboxMutex.Unlock()
+
+	// Heartbeats wait for the tick so all groups' heartbeats travel together
+	if msg.Type != raftpb.MsgHeartbeat && msg.Type != raftpb.MsgHeartbeatResp {
+		signalGroupFlush()
+	}
+}
+
+// signalGroupFlush wakes the group transport loop without blocking
+func signalGroupFlush() {
+	select {
+	case groupFlushChan <- struct{}{}:
+	default:
+	}
+}
+
+// groupTransportLoop writes queued group messages, one frame per peer
+func groupTransportLoop() {
+	logInfo("raft group transport started")
+
+	for {
+		select {
+		case <-raftCtx.Done():
+			return
+		case <-stopChan:
+			return
+		case <-groupFlushChan:
+			flushGroupOutbox()
+		}
+	}
+}
+
+// flushGroupOutbox sends everything queued so far as one frame per peer
+func flushGroupOutbox() {
+	groupOutboxMutex.Lock()
+	outbox := groupOutbox
+	if len(outbox) == 0 {
+		groupOutboxMutex.Unlock()
+		return
+	}
+	groupOutbox = make(map[uint64][]groupMessage, len(outbox))
+	groupOutboxMutex.Unlock()
+
+	for nodeID, batch := range outbox {
+		size := 0
+		for _, m := range batch {
+			size += 8 + len(m.data)
+		}
+
+		frame := make([]byte, 0, size)
+		var header [8]byte
+		for _, m := range batch {
+			binary.BigEndian.PutUint32(header[0:4], m.group)
+			binary.BigEndian.PutUint32(header[4:8], uint32(len(m.data)))
+			frame = append(frame, header[:]...)
+			frame = append(frame, m.data...)
+		}
+
+		if !writeFrame(nodeID, groupFrameFlag|uint32(len(frame)), frame) {
+			for _, m := range batch {
+				if group := lookupGroup(int(m.group)); group != nil {
+					group.node.ReportUnreachable(nodeID)
+				}
+			}
+			continue
+		}
+
+		atomic.AddInt64(&groupFramesSent, 1)
+		atomic.AddInt64(&groupMessagesSent, int64(len(batch)))
+	}
+}
+
+// deliverGroupFrame steps every message of a received group frame into its group
+func deliverGroupFrame(nodeID uint64, frame []byte) {
+	for len(frame) >= 8 {
+		g := binary.BigEndian.Uint32(frame[0:4])
+		length := binary.BigEndian.Uint32(frame[4:8])
+		frame = frame[8:]
+		if uint32(len(frame)) < length {
+			logWarning("truncated group frame from node %d", nodeID)
+			return
+		}
+
+		data := frame[:length]
+		frame = frame[length:]
+
+		group := lookupGroup(int(g))
+		if group == nil {
+			debugLog("dropping message for unknown raft group %d from node %d", g, nodeID)
+			continue
+		}
+
+		var msg raftpb.Message
+		if err := msg.Unmarshal(data); err != nil {
+			logWarning("failed to unmarshal raft group %d message from node %d: %v", g, nodeID, err)
+			continue
+		}
+		if isQuiesceNotice(msg) {
+			group.quiesce.accept(group.id, group.node, group.storage, msg)
+			continue
+		}
+		group.quiesce.wake(group.id, "message")
+		group.node.Step(raftCtx, msg)
+		atomic.AddInt64(&messagesProcessed, 1)
+	}
+}
+
+// tickRaftGroups advances the additional groups' clocks by one tick
+func tickRaftGroups() {
+	if len(raftGroups) < 2 {
+		return
+	}
+
+	for g := 1; g < len(raftGroups); g++ {
+		group := raftGroups[g]
+		notify := func(msg raftpb.Message) { queueGroupMessage(group, msg) }
+		if group.quiesce.shouldTick(group.id, group.node, group.storage, notify) {
+			group.node.Tick()
+		}
+	}
+
+	// Heartbeats queued since the previous tick go out now
+	signalGroupFlush()
+
+	groupTicks++
+	if groupTicks%ticksPerSecond() == 0 {
+		balanceGroupLeaders()
+	}
+}
+
+// preferredGroupLeader spreads groups round robin over the sorted voters
+func preferredGroupLeader(group uint32, status raft.Status) uint64 {
+	voters := make([]uint64, 0, len(status.Config.Voters[0]))
+	for id := range status.Config.Voters[0] {
+		voters = append(voters, id)
+	}
+	if len(voters) == 0 {
+		return 0
+	}
+
+	sort.Slice(voters, func(i, j int) bool { return voters[i] < voters[j] })
+	return voters[int(group)%len(voters)]
+}
+
+// balanceGroupLeaders hands every group this node leads to its preferred
+// leader, so that leadership, and with it write load, is spread over nodes
+func balanceGroupLeaders() {
+	for g := 1; g < len(raftGroups); g++ {
+		group := raftGroups[g]
+		status := group.node.Status()
+		if status.RaftState != raft.StateLeader || status.LeadTransferee != 0 {
+			continue
+		}
+
+		preferred := preferredGroupLeader(group.id, status)
+		if preferred == 0 || preferred == status.ID {
+			continue
+		}
+
+		// Only hand over to a caught-up, live peer or writes stall meanwhile
+		pr, ok := status.Progress[preferred]
+		if !ok || !pr.RecentActive || pr.Match < status.Commit {
+			continue
+		}
+
+		logInfo("raft group %d: transferring leadership from node %d to preferred node %d",
+			group.id, status.ID, preferred)
+		group.quiesce.wake(group.id, "leadership transfer")
+		group.node.TransferLeadership(raftCtx, status.ID, preferred)
+		atomic.AddInt64(&groupLeaderMoves, 1)
+	}
+}
+
+// pgraft_go_group_count returns the number of Raft groups including group 0
+//
+//export pgraft_go_group_count
+func pgraft_go_group_count() C.int {
+	if len(raftGroups) == 0 {
+		return 1
+	}
+	return C.int(len(raftGroups))
+}
+
+// pgraft_go_group_append proposes an entry to a group
+//
+//export pgraft_go_group_append
+func pgraft_go_group_append(group C.int, data *C.char, length C.int) C.int {
+	if group == 0 {
+		return pgraft_go_append_log(data, length)
+	}
+
+	if atomic.LoadInt32(&running) == 0 {
+		return -1
+	}
+
+	g := lookupGroup(int(group))
+	if g == nil {
+		logError("cannot propose: no raft group %d", int(group))
+		return -1
+	}
+
+	g.quiesce.wake(g.id, "proposal")
+	if err := g.node.Propose(raftCtx, C.GoBytes(unsafe.Pointer(data), length)); err != nil {
+		logError("raft group %d: failed to propose: %v", g.id, err)
+		return -1
+	}
+
+	atomic.AddInt64(&g.proposals, 1)
+	return 0
+}
+
+// pgraft_go_group_status reports leader, term, commit index and proposal
+// count of an additional group; returns -1 for group 0 or unknown groups
+//
+//export pgraft_go_group_status
+func pgraft_go_group_status(group C.int, leader *C.int64_t, term *C.int32_t, commit *C.uint64_t, proposals *C.int64_t) C.int {
+	g := lookupGroup(int(group))
+	if g == nil {
+		return -1
+	}
+
+	*leader = C.int64_t(atomic.LoadUint64(&g.lead))
+	*term = C.int32_t(atomic.LoadUint64(&g.term))
+	*commit = C.uint64_t(atomic.LoadUint64(&g.commit))
+	*proposals = C.int64_t(atomic.LoadInt64(&g.proposals))
+	return 0
+}
+
+// pgraft_go_next_group_committed is pgraft_go_next_committed for any group
+//
+//export pgraft_go_next_group_committed
+func pgraft_go_next_group_committed(group C.int, index *C.uint64_t, length *C.int) *C.char {
+	if group == 0 {
+		return pgraft_go_next_committed(index, length)
+	}
+
+	g := lookupGroup(int(group))
+	if g == nil {
+		return nil
+	}
+
+	entry, ok := g.committed.pop()
+	if !ok {
+		return nil
+	}
+
+	*index = C.uint64_t(entry.index)
+	*length = C.int(len(entry.data))
+	return (*C.char)(C.CBytes(entry.data))
+}
+
+// Peer latency
+//
+// The leader times every group 0 heartbeat against its response and keeps
+// a smoothed RTT and RTT variation per peer, computed like TCP's
+// retransmission timer (RFC 6298). Followers time the gaps between the
+// leader's heartbeats the same way. When pgraft.election_timeout_max is
+// set, a follower whose leader's heartbeats arrive late or irregularly runs
+// its Raft clock slower, stretching its (randomized) election timeout up to
+// that bound, so a slow link does not trigger false elections while a
+// good one keeps the configured, fast timeout. A node that stops hearing a
+// leader runs its clock at full speed again.
+
+// peerLatency is the measured heartbeat round trip to one peer
+type peerLatency struct {
+	sentAt     time.Time // Outstanding heartbeat, zero if none
+	srtt       time.Duration
+	rttvar     time.Duration
+	samples    int64
+	lastSample time.Time
+}
+
+// heartbeatGaps is the measured spacing of the leader's heartbeats
+type heartbeatGaps struct {
+	leader  uint64
+	last    time.Time
+	gap     time.Duration
+	gapvar  time.Duration
+	samples int64
+}
+
+var (
+	peerLatencies    = make(map[uint64]*peerLatency)
+	peerLatencyMutex sync.Mutex
+
+	leaderHeartbeats      heartbeatGaps
+	leaderHeartbeatsMutex sync.Mutex
+
+	electionTimeoutBase time.Duration // Configured election timeout
+	electionTimeoutMax  time.Duration // 0 disables adaptation
+	electionTimeoutNow  int64         // Effective timeout in ns, read atomically
+	electionClockCredit float64       // Tick scheduler only
+)
+
+// configureElectionAdaptation sets the bounds for the adaptive election
+// timeout; a maximum not above the base disables adaptation
+func configureElectionAdaptation(baseMs int, maxMs int) {
+	electionTimeoutBase = time.Duration(baseMs) * time.Millisecond
+	electionTimeoutMax = 0
+	if maxMs > baseMs {
+		electionTimeoutMax = time.Duration(maxMs) * time.Millisecond
+		logInfo("adaptive election timeout between %dms and %dms", baseMs, maxMs)
+	}
+	atomic.StoreInt64(&electionTimeoutNow, int64(electionTimeoutBase))
+}
+
+// smoothRTT folds one sample into a smoothed value and its variation
+func smoothRTT(srtt, rttvar *time.Duration, samples int64, sample time.Duration) {
+	if samples == 0 {
+		*srtt = sample
+		*rttvar = sample / 2
+		return
+	}
+
+	delta := *srtt - sample
+	if delta < 0 {
+		delta = -delta
+	}
+	*rttvar = (3**rttvar + delta) / 4
+	*srtt = (7**srtt + sample) / 8
+}
+
+// recordHeartbeatSent starts timing a heartbeat unless one to the same peer
+// is still outstanding; a response lost for an election timeout is given up
+func recordHeartbeatSent(nodeID uint64) {
+	now := time.Now()
+
+	peerLatencyMutex.Lock()
+	defer peerLatencyMutex.Unlock()
+
+	pl, ok := peerLatencies[nodeID]
+	if !ok {
+		pl = &peerLatency{}
+		peerLatencies[nodeID] = pl
+	}
+	if pl.sentAt.IsZero() || now.Sub(pl.sentAt) > electionTimeoutBase {
+		pl.sentAt = now
+	}
+}
+
+// recordHeartbeatResponse completes the round trip of a timed heartbeat
+func recordHeartbeatResponse(nodeID uint64) {
+	now := time.Now()
+
+	peerLatencyMutex.Lock()
+	defer peerLatencyMutex.Unlock()
+
+	pl, ok := peerLatencies[nodeID]
+	if !ok || pl.sentAt.IsZero() {
+		return
+	}
+
+	smoothRTT(&pl.srtt, &pl.rttvar, pl.samples, now.Sub(pl.sentAt))
+	pl.samples++
+	pl.lastSample = now
+	pl.sentAt = time.Time{}
+}
+
+// recordLeaderHeartbeat times the gap since the leader's previous
+// heartbeat and recomputes the effective election timeout
+func recordLeaderHeartbeat(leader uint64) {
+	now := time.Now()
+
+	leaderHeartbeatsMutex.Lock()
+	defer leaderHeartbeatsMutex.Unlock()
+
+	hb := &leaderHeartbeats
+	if hb.leader != leader {
+		*hb = heartbeatGaps{leader: leader, last: now}
+		atomic.StoreInt64(&electionTimeoutNow, int64(electionTimeoutBase))
+		return
+	}
+
+	gap := now.Sub(hb.last)
+	hb.last = now
+
+	// A gap beyond the longest allowed timeout is a pause (quiescence,
+	// partition), not a sample of the heartbeat stream
+	limit := electionTimeoutMax
+	if limit == 0 {
+		limit = electionTimeoutBase
+	}
+	if gap <= 0 || gap > limit {
+		return
+	}
+
+	smoothRTT(&hb.gap, &hb.gapvar, hb.samples, gap)
+	hb.samples++
+
+	if electionTimeoutMax == 0 {
+		return
+	}
+
+	// Randomized timeouts start at the configured value, so it has to cover
+	// twice the worst expected gap
+	timeout := 2 * (hb.gap + 4*hb.gapvar)
+	if timeout < electionTimeoutBase {
+		timeout = electionTimeoutBase
+	}
+	if timeout > electionTimeoutMax {
+		timeout = electionTimeoutMax
+	}
+	atomic.StoreInt64(&electionTimeoutNow, int64(timeout))
+}
+
+// electionClockAdvances decides whether group 0 is ticked on this scheduler
+// tick. While a leader is heard, a stretched election timeout slows the
+// clock by base/effective; otherwise every tick counts.
+func electionClockAdvances() bool {
+	timeout := time.Duration(atomic.LoadInt64(&electionTimeoutNow))
+	if electionTimeoutMax == 0 || timeout <= electionTimeoutBase {
+		return true
+	}
+
+	leaderHeartbeatsMutex.Lock()
+	heard := !leaderHeartbeats.last.IsZero() && time.Since(leaderHeartbeats.last) < timeout
+	leaderHeartbeatsMutex.Unlock()
+	if !heard {
+		electionClockCredit = 0
+		return true
+	}
+
+	electionClockCredit += float64(electionTimeoutBase) / float64(timeout)
+	if electionClockCredit < 1 {
+		return false
+	}
+	electionClockCredit--
+	return true
+}
+
+// pgraft_go_get_peer_latency copies up to maxPeers peers' node id, smoothed RTT
+// and RTT variation (microseconds) and sample count; returns the count
+//
+//export pgraft_go_get_peer_latency
+func pgraft_go_get_peer_latency(ids *C.int64_t, srttUs *C.int64_t, rttvarUs *C.int64_t, samples *C.int64_t, maxPeers C.int) C.int {
+	if maxPeers <= 0 {
+		return 0
+	}
+
+	idSlice := unsafe.Slice(ids, int(maxPeers))
+	srttSlice := unsafe.Slice(srttUs, int(maxPeers))
+	rttvarSlice := unsafe.Slice(rttvarUs, int(maxPeers))
+	sampleSlice := unsafe.Slice(samples, int(maxPeers))
+
+	peerLatencyMutex.Lock()
+	defer peerLatencyMutex.Unlock()
+
+	peerIDs := make([]uint64, 0, len(peerLatencies))
+	for id := range peerLatencies {
+		peerIDs = append(peerIDs, id)
+	}
+	sort.Slice(peerIDs, func(i, j int) bool { return peerIDs[i] < peerIDs[j] })
+
+	n := 0
+	for _, id := range peerIDs {
+		if n >= int(maxPeers) {
+			break
+		}
+		pl := peerLatencies[id]
+		idSlice[n] = C.int64_t(id)
+		srttSlice[n] = C.int64_t(pl.srtt.Microseconds())
+		rttvarSlice[n] = C.int64_t(pl.rttvar.Microseconds())
+		sampleSlice[n] = C.int64_t(pl.samples)
+		n++
+	}
+	return C.int(n)
+}
+
+// pgraft_go_get_election_timeout returns the election timeout this node
+// currently uses, in milliseconds
+//
+//export pgraft_go_get_election_timeout
+func pgraft_go_get_election_timeout() C.int {
+	return C.int(time.Duration(atomic.LoadInt64(&electionTimeoutNow)).Milliseconds())
+}
+
+// Direct proposals
+//
+// KV writes skip the background worker: a backend copies its encoded entry
+// into a slot of the shared memory proposal ring and posts the ring's
+// semaphore, and the proposal goroutine, running in the worker process that
+// attached the ring, proposes the slot straight to its group and posts the
+// slot's own semaphore with the result. Slots are claimed in order under a
+// spinlock on the C side, so the goroutine simply follows them round the
+// ring; a slot's state word is the only thing both sides change.
+
+// How long the proposal goroutine sleeps between checks for stop
+const proposalWaitMs = 100
+
+var (
+	proposalStop chan struct{}
+	proposalDone chan struct{}
+
+	proposalsDirect int64 // Slots proposed, for pgraft_go_get_stats
+)
+
+// slotState is a slot's state word, shared with the C side's atomics
+func slotState(slot *C.pgraft_go_proposal_slot) *uint32 {
+	return (*uint32)(unsafe.Pointer(&slot.state))
+}
+
+// proposeDirect proposes an entry to a group if this node still leads it in
+// the term the backend saw
+func proposeDirect(group int, term int32, data []byte) C.int32_t {
+	if atomic.LoadInt32(&running) == 0 {
+		return C.PGRAFT_PROPOSAL_FAILED
+	}
+
+	if group == 0 {
+		raftMutex.RLock()
+		defer raftMutex.RUnlock()
+
+		if raftNode == nil {
+			return C.PGRAFT_PROPOSAL_FAILED
+		}
+		status := raftNode.Status()
+		if term > 0 && (status.Lead != status.ID || int32(status.Term) != term) {
+			return C.PGRAFT_PROPOSAL_STALE
+		}
+		raftQuiescence.wake(0, "proposal")
+		if err := raftNode.Propose(raftCtx, data); err != nil {
+			logError("failed to propose direct entry: %v", err)
+			return C.PGRAFT_PROPOSAL_FAILED
+		}
+		atomic.AddInt64(&logEntriesCommitted, 1)
+		return C.PGRAFT_PROPOSAL_OK
+	}
+
+	g := lookupGroup(group)
+	if g == nil {
+		logError("cannot propose: no raft group %d", group)
+		return C.PGRAFT_PROPOSAL_FAILED
+	}
+	if term > 0 && (atomic.LoadUint64(&g.lead) != currentNodeID || int32(atomic.LoadUint64(&g.term)) != term) {
+		return C.PGRAFT_PROPOSAL_STALE
+	}
+	g.quiesce.wake(g.id, "proposal")
+	if err := g.node.Propose(raftCtx, data); err != nil {
+		logError("raft group %d: failed to propose direct entry: %v", g.id, err)
+		return C.PGRAFT_PROPOSAL_FAILED
+	}
+	atomic.AddInt64(&g.proposals, 1)
+	return C.PGRAFT_PROPOSAL_OK
+}
+
+// serveProposalSlot proposes one filled slot and hands the result back
+func serveProposalSlot(slot *C.pgraft_go_proposal_slot, fail bool) {
+	state := slotState(slot)
+	if !atomic.CompareAndSwapUint32(state, C.PGRAFT_PROPOSAL_READY, C.PGRAFT_PROPOSAL_TAKEN) {
+		// Abandoned before we got to it: nobody is waiting
+		atomic.StoreUint32(state, C.PGRAFT_PROPOSAL_FREE)
+		return
+	}
+
+	result := C.int32_t(C.PGRAFT_PROPOSAL_FAILED)
+	if !fail {
+		data := C.GoBytes(unsafe.Pointer(&slot.data[0]), C.int(slot.length))
+		result = proposeDirect(int(slot.group), int32(slot.term), data)
+		atomic.AddInt64(&proposalsDirect, 1)
+	}
+	slot.result = result
+
+	if !atomic.CompareAndSwapUint32(state, C.PGRAFT_PROPOSAL_TAKEN, C.PGRAFT_PROPOSAL_DONE) {
+		atomic.StoreUint32(state, C.PGRAFT_PROPOSAL_FREE)
+		return
+	}
+	C.pgraft_go_proposal_post(slot)
+}
+
+// runProposalRing follows the ring from slot tail until stopped
+func runProposalRing(ring *C.pgraft_go_proposal_ring, tail uint64, stop chan struct{}, done chan struct{}) {
+	defer close(done)
+
+	consumer := (*uint32)(unsafe.Pointer(&ring.consumer))
+	for {
+		select {
+		case <-stop:
+			// Refuse new slots, then fail the ones already filled
+			atomic.StoreUint32(consumer, 0)
+			for {
+				slot := &ring.slots[tail%C.PGRAFT_PROPOSAL_SLOTS]
+				if s := atomic.LoadUint32(slotState(slot)); s != C.PGRAFT_PROPOSAL_READY && s != C.PGRAFT_PROPOSAL_ABANDONED {
+					return
+				}
+				serveProposalSlot(slot, true)
+				tail++
+			}
+		case <-raftCtx.Done():
+			atomic.StoreUint32(consumer, 0)
+			return
+		default:
+		}
+
+		slot := &ring.slots[tail%C.PGRAFT_PROPOSAL_SLOTS]
+		switch atomic.LoadUint32(slotState(slot)) {
+		case C.PGRAFT_PROPOSAL_READY, C.PGRAFT_PROPOSAL_ABANDONED:
+			serveProposalSlot(slot, false)
+			tail++
+		default:
+			C.pgraft_go_proposal_wait(ring, proposalWaitMs)
+		}
+	}
+}
+
+// pgraft_go_attach_proposals starts the proposal goroutine on a ring in
+// shared memory, beginning at slot tail; the caller marks the ring as
+// consumed once this returns 0. Attaching again restarts the goroutine.
+//
+//export pgraft_go_attach_proposals
+func pgraft_go_attach_proposals(ring *C.pgraft_go_proposal_ring, tail C.uint64_t) C.int {
+	if atomic.LoadInt32(&running) == 0 {
+		return -1
+	}
+
+	detachProposals()
+
+	proposalStop = make(chan struct{})
+	proposalDone = make(chan struct{})
+	go runProposalRing(ring, uint64(tail), proposalStop, proposalDone)
+
+	logInfo("proposal ring attached at slot %d", uint64(tail))
+	return 0
+}
+
+// detachProposals stops the proposal goroutine, if any, and waits for it
+func detachProposals() {
+	if proposalStop == nil {
+		return
+	}
+	close(proposalStop)
+	<-proposalDone
+	proposalStop = nil
+}
+
+// Cluster statistics
+//
+// pgraft_cluster_stats() shows the metrics of every node from any node. The
+// node asked runs a stats round: it sends each peer a stats request as a
+// control frame over the existing peer connection, and each peer answers
+// with a snapshot of its own metrics the same way. A round completes once
+// every peer has answered or statsRoundTimeout has passed; peers that stayed
+// silent are reported unreachable. The last completed round is served until
+// it is older than the caller's TTL.
+
+// A frame length with this bit set carries a control message encoded as
+// [kind byte][round uint64][payload]. Control frames never reach raft.
+const controlFrameFlag = 0x40000000
+
+// Control message kinds
+const (
+	controlStatsRequest  = 1 // No payload
+	controlStatsResponse = 2 // Payload is the JSON nodeStats of the sender
+	controlPing          = 3 // No payload; probes a connection that went quiet
+	controlPong          = 4 // No payload; answers a ping
+)
+
+const (
+	statsRoundTimeout = time.Second
+	diskUsageRefresh  = 10 * time.Second // Walking the data directory is not free
+)
+
+// nodeStats is one node's metrics snapshot
+type nodeStats struct {
+	NodeID         uint64 `json:"node_id"`
+	LeaderID       uint64 `json:"leader_id"`
+	Term           uint64 `json:"term"`
+	CommitIndex    uint64 `json:"commit_index"`
+	AppliedIndex   uint64 `json:"applied_index"`
+	QueueDepth     int64  `json:"queue_depth"`
+	PendingEntries int64  `json:"pending_entries"`
+	DiskBytes      int64  `json:"disk_bytes"`
+	MaxPeerRTTUs   int64  `json:"max_peer_rtt_us"`
+	KVHash         uint64 `json:"kv_hash"`
+	KVHashRevision uint64 `json:"kv_hash_revision"`
+
+	rtt time.Duration // Request to response, measured by the asking node
+}
+
+// statsRound collects one snapshot per node
+type statsRound struct {
+	id       uint64
+	started  time.Time
+	expected []uint64
+	replies  map[uint64]nodeStats
+}
+
+var (
+	statsMutex     sync.Mutex
+	statsCurrent   *statsRound // Round being collected, nil if none
+	statsLast      *statsRound // Last completed round
+	statsNextRound uint64
+
+	// Published by the background worker through pgraft_go_set_local_stats
+	localAppliedIndex   uint64
+	localQueueDepth     int64
+	localKVMutex        sync.Mutex
+	localKVHash         uint64
+	localKVHashRevision uint64
+
+	diskUsageMutex sync.Mutex
+	diskUsageBytes int64
+	diskUsageAt    time.Time
+)
+
+// diskUsage returns the size of the Raft data directory, refreshed at most
+// every diskUsageRefresh
+func diskUsage() int64 {
+	diskUsageMutex.Lock()
+	defer diskUsageMutex.Unlock()
+
+	if !diskUsageAt.IsZero() && time.Since(diskUsageAt) < diskUsageRefresh {
+		return diskUsageBytes
+	}
+	if raftStorage == nil || raftStorage.dataDir == "" {
+		return 0
+	}
+
+	// Group storage lives below group 0's directory
+	var total int64
+	filepath.Walk(raftStorage.dataDir, func(path string, info os.FileInfo, err error) error {
+		if err == nil && info.Mode().IsRegular() {
+			total += info.Size()
+		}
+		return nil
+	})
+	diskUsageBytes = total
+	diskUsageAt = time.Now()
+	return total
+}
+
+// localNodeStats takes this node's metrics snapshot
+func localNodeStats() nodeStats {
+	s := nodeStats{
+		NodeID:       currentNodeID,
+		AppliedIndex: atomic.LoadUint64(&localAppliedIndex),
+		QueueDepth:   atomic.LoadInt64(&localQueueDepth),
+		DiskBytes:    diskUsage(),
+	}
+
+	localKVMutex.Lock()
+	s.KVHash = localKVHash
+	s.KVHashRevision = localKVHashRevision
+	localKVMutex.Unlock()
+
+	if raftNode != nil {
+		status := raftNode.Status()
+		s.LeaderID = status.Lead
+		s.Term = status.Term
+		s.CommitIndex = status.Commit
+	}
+
+	s.PendingEntries = int64(committedEntries.depth())
+	for _, g := range raftGroups {
+		if g != nil {
+			s.PendingEntries += int64(g.committed.depth())
+		}
+	}
+
+	peerLatencyMutex.Lock()
+	for _, pl := range peerLatencies {
+		if pl.samples > 0 && pl.srtt.Microseconds() > s.MaxPeerRTTUs {
+			s.MaxPeerRTTUs = pl.srtt.Microseconds()
+		}
+	}
+	peerLatencyMutex.Unlock()
+
+	return s
+}
+
+// sendControlFrame writes one control message to a peer
+func sendControlFrame(nodeID uint64, kind byte, round uint64, payload []byte) bool {
+	frame := make([]byte, 9+len(payload))
+	frame[0] = kind
+	binary.BigEndian.PutUint64(frame[1:9], round)
+	copy(frame[9:], payload)
+	return writeFrame(nodeID, controlFrameFlag|uint32(len(frame)), frame)
+}
+
+// handleControlFrame handles a control message read from a peer connection
+func handleControlFrame(nodeID uint64, data []byte) {
+	if len(data) < 9 {
+		logWarning("short control frame from node %d", nodeID)
+		return
+	}
+	round := binary.BigEndian.Uint64(data[1:9])
+
+	switch data[0] {
+	case controlStatsRequest:
+		// Answer off the read loop; the snapshot may walk the data directory
+		go func() {
+			payload, err := json.Marshal(localNodeStats())
+			if err != nil {
+				logError("failed to encode stats for node %d: %v", nodeID, err)
+				return
+			}
+			sendControlFrame(nodeID, controlStatsResponse, round, payload)
+		}()
+	case controlStatsResponse:
+		var s nodeStats
+		if err := json.Unmarshal(data[9:], &s); err != nil {
+			logWarning("failed to decode stats from node %d: %v", nodeID, err)
+			return
+		}
+		recordStatsReply(nodeID, round, s)
+	case controlPing:
+		go sendControlFrame(nodeID, controlPong, round, nil)
+	case controlPong:
+		// Reading it was the point
+	default:
+		logWarning("unknown control frame kind %d from node %d", data[0], nodeID)
+	}
+}
+
+// startStatsRound begins collecting a new round; statsMutex must be held
+func startStatsRound() {
+	statsNextRound++
+	r := &statsRound{
+		id:      statsNextRound,
+		started: time.Now(),
+		replies: make(map[uint64]nodeStats),
+	}
+
+	nodesMutex.RLock()
+	for id := range nodes {
+		if id != currentNodeID {
+			r.expected = append(r.expected, id)
+		}
+	}
+	nodesMutex.RUnlock()
+
+	statsCurrent = r
+
+	go func() {
+		recordStatsReply(currentNodeID, r.id, localNodeStats())
+		for _, id := range r.expected {
+			sendControlFrame(id, controlStatsRequest, r.id, nil)
+		}
+		time.AfterFunc(statsRoundTimeout, func() {
+			statsMutex.Lock()
+			finishStatsRound(r)
+			statsMutex.Unlock()
+		})
+	}()
+}
+
+// recordStatsReply stores a node's snapshot in the round it answers
+func recordStatsReply(nodeID uint64, round uint64, s nodeStats) {
+	statsMutex.Lock()
+	defer statsMutex.Unlock()
+
+	r := statsCurrent
+	if r == nil || r.id != round {
+		return
+	}
+
+	s.NodeID = nodeID
+	if nodeID != currentNodeID {
+		s.rtt = time.Since(r.started)
+	}
+	r.replies[nodeID] = s
+
+	if len(r.replies) == len(r.expected)+1 {
+		finishStatsRound(r)
+	}
+}
+
+// finishStatsRound publishes a round; statsMutex must be held
+func finishStatsRound(r *statsRound) {
+	if statsCurrent != r {
+		return
+	}
+	statsCurrent = nil
+	statsLast = r
+}
+
+// pgraft_go_set_local_stats publishes the metrics only the background worker
+// knows: the index applied to PostgreSQL, the command queue depth and the
+// root of the KV hash tree with the number of changes it covers
+//
+//export pgraft_go_set_local_stats
+func pgraft_go_set_local_stats(appliedIndex C.uint64_t, queueDepth C.int, kvHash C.uint64_t, kvHashRevision C.uint64_t) {
+	atomic.StoreUint64(&localAppliedIndex, uint64(appliedIndex))
+	atomic.StoreInt64(&localQueueDepth, int64(queueDepth))
+
+	// The hash and its revision are only meaningful together
+	localKVMutex.Lock()
+	localKVHash = uint64(kvHash)
+	localKVHashRevision = uint64(kvHashRevision)
+	localKVMutex.Unlock()
+}
+
+// pgraft_go_cluster_stats copies up to maxNodes snapshots of the last
+// completed stats round, ordered by node id, sets ageMs to the round's age
+// and returns the count. A round older than maxAgeMs is not served: a new
+// round is started if none is running and -1 is returned, so the caller asks
+// again later.
+//
+//export pgraft_go_cluster_stats
+func pgraft_go_cluster_stats(stats *C.pgraft_go_node_stats, maxNodes C.int, maxAgeMs C.int, ageMs *C.int) C.int {
+	if maxNodes <= 0 {
+		return 0
+	}
+
+	statsMutex.Lock()
+	defer statsMutex.Unlock()
+
+	r := statsLast
+	if r == nil || time.Since(r.started) > time.Duration(maxAgeMs)*time.Millisecond {
+		if statsCurrent == nil {
+			startStatsRound()
+		}
+		return -1
+	}
+
+	*ageMs = C.int(time.Since(r.started).Milliseconds())
+
+	ids := append([]uint64{currentNodeID}, r.expected...)
+	sort.Slice(ids, func(i, j int) bool { return ids[i] < ids[j] })
+
+	out := unsafe.Slice(stats, int(maxNodes))
+	n := 0
+	for _, id := range ids {
+		if n >= int(maxNodes) {
+			break
+		}
+		s, ok := r.replies[id]
+
+		row := &out[n]
+		*row = C.pgraft_go_node_stats{}
+		row.node_id = C.int64_t(id)
+		if ok {
+			row.reachable = 1
+			row.leader_id = C.int64_t(s.LeaderID)
+			row.term = C.uint64_t(s.Term)
+			row.commit_index = C.uint64_t(s.CommitIndex)
+			row.applied_index = C.uint64_t(s.AppliedIndex)
+			if s.CommitIndex > s.AppliedIndex {
+				row.apply_lag = C.int64_t(s.CommitIndex - s.AppliedIndex)
+			}
+			row.queue_depth = C.int64_t(s.QueueDepth)
+			row.pending_entries = C.int64_t(s.PendingEntries)
+			row.disk_bytes = C.int64_t(s.DiskBytes)
+			row.rtt_us = C.int64_t(s.rtt.Microseconds())
+			row.max_peer_rtt_us = C.int64_t(s.MaxPeerRTTUs)
+			row.kv_hash = C.uint64_t(s.KVHash)
+			row.kv_hash_revision = C.uint64_t(s.KVHashRevision)
+		}
+		n++
+	}
+	return C.int(n)
+}
+
+// Quiescence
+//
+// A group with nothing to do still ticks, heartbeats every heartbeat
+// interval and keeps its followers' election timers running. Once a leader
+// has seen no proposal or message for quiesceAfterTicks ticks, and every
+// follower is live and has acknowledged the whole log, it stops ticking and
+// sends each follower a quiesce notice: a heartbeat carrying
+// quiesceContext, handled by the transport and never stepped into raft. A
+// follower that is caught up with the notice's commit index stops ticking
+// too. Any proposal, any other message, or losing a peer connection wakes
+// the group again; the first message of a waking leader wakes its followers.
+//
+// A quiesced leader re-sends the notice every quiesceKeepaliveTicks (one
+// election timeout) as a keepalive. A quiesced follower that hears no
+// notice for two of those wakes and ticks again, so a leader that died or
+// was cut off without the connection failing is still noticed.
+
+// Heartbeat context marking a quiesce notice
+const quiesceContext = "pgraft-quiesce"
+
+// quiescence is the idle state of one Raft group
+type quiescence struct {
+	quiesced int32
+	idle     int32 // Ticks since the last activity
+	quiet    int32 // Quiesced: ticks since the last notice sent or received
+}
+
+var (
+	raftQuiescence        quiescence // Group 0
+	quiesceAfterTicks     int32      // 0 disables quiescence
+	quiesceKeepaliveTicks int32      // Quiesced leaders re-send notices this often
+
+	quiesceEntered int64
+	quiesceWakeups int64
+)
+
+// isQuiesced reports whether the group has stopped ticking
+func (q *quiescence) isQuiesced() bool {
+	return atomic.LoadInt32(&q.quiesced) == 1
+}
+
+// wake records activity and resumes ticking if the group was quiesced
+func (q *quiescence) wake(group uint32, reason string) {
+	atomic.StoreInt32(&q.idle, 0)
+	if atomic.CompareAndSwapInt32(&q.quiesced, 1, 0) {
+		atomic.AddInt64(&quiesceWakeups, 1)
+		logInfo("raft group %d: waking from quiescence (%s)", group, reason)
+	}
+}
+
+// shouldTick is called once per tick and reports whether the node must be
+// ticked. A leader that has been idle long enough and whose followers are
+// caught up quiesces here and sends them notices through notify.
+func (q *quiescence) shouldTick(group uint32, node raft.Node, storage *PersistentStorage, notify func(raftpb.Message)) bool {
+	if q.isQuiesced() {
+		return q.keepalive(group, node, notify)
+	}
+
+	limit := atomic.LoadInt32(&quiesceAfterTicks)
+	if limit <= 0 {
+		return true
+	}
+	if atomic.LoadInt32(&q.idle) < limit {
+		atomic.AddInt32(&q.idle, 1)
+		return true
+	}
+
+	status := node.Status()
+	if !canQuiesce(status, storage) {
+		return true
+	}
+	if !atomic.CompareAndSwapInt32(&q.quiesced, 0, 1) {
+		return false
+	}
+
+	atomic.AddInt64(&quiesceEntered, 1)
+	atomic.StoreInt32(&q.quiet, 0)
+	logInfo("raft group %d: quiescing at term %d, commit %d", group, status.Term, status.Commit)
+
+	sendQuiesceNotices(status, notify)
+	return false
+}
+
+// keepalive runs once per tick while the group is quiesced and reports
+// whether it woke up. A leader re-sends its notices every
+// quiesceKeepaliveTicks; a follower that misses two wakes.
+func (q *quiescence) keepalive(group uint32, node raft.Node, notify func(raftpb.Message)) bool {
+	interval := atomic.LoadInt32(&quiesceKeepaliveTicks)
+	if interval <= 0 {
+		return false
+	}
+
+	quiet := atomic.AddInt32(&q.quiet, 1)
+	if quiet < interval {
+		return false
+	}
+
+	status := node.Status()
+	if status.RaftState == raft.StateLeader {
+		atomic.StoreInt32(&q.quiet, 0)
+		sendQuiesceNotices(status, notify)
+		return false
+	}
+	if quiet < 2*interval {
+		return false
+	}
+
+	q.wake(group, "no quiesce notice from leader")
+	return true
+}
+
+// sendQuiesceNotices sends every follower a quiesce notice at the leader's
+// current term and commit
+func sendQuiesceNotices(status raft.Status, notify func(raftpb.Message)) {
+	for id := range status.Progress {
+		if id == status.ID {
+			continue
+		}
+		notify(raftpb.Message{
+			Type:    raftpb.MsgHeartbeat,
+			To:      id,
+			From:    status.ID,
+			Term:    status.Term,
+			Commit:  status.Commit,
+			Context: []byte(quiesceContext),
+		})
+	}
+}
+
+// canQuiesce reports whether a leader has nothing left to replicate or apply
+func canQuiesce(status raft.Status, storage *PersistentStorage) bool {
+	if status.RaftState != raft.StateLeader || status.LeadTransferee != 0 {
+		return false
+	}
+
+	lastIndex, err := storage.LastIndex()
+	if err != nil || lastIndex != status.Commit || status.Applied != status.Commit {
+		return false
+	}
+
+	for id, pr := range status.Progress {
+		if id == status.ID {
+			continue
+		}
+		if !pr.RecentActive || pr.Match != status.Commit {
+			return false
+		}
+	}
+	return true
+}
+
+// isQuiesceNotice reports whether msg is a leader's quiesce notice
+func isQuiesceNotice(msg raftpb.Message) bool {
+	return msg.Type == raftpb.MsgHeartbeat && string(msg.Context) == quiesceContext
+}
+
+// accept quiesces a follower on its current leader's notice, provided it
+// already has every entry the leader committed; for a follower that is
+// already quiesced the notice is the leader's keepalive
+func (q *quiescence) accept(group uint32, node raft.Node, storage *PersistentStorage, msg raftpb.Message) {
+	status := node.Status()
+	if status.RaftState != raft.StateFollower || status.Lead != msg.From ||
+		status.Term != msg.Term || status.Commit != msg.Commit {
+		return
+	}
+
+	lastIndex, err := storage.LastIndex()
+	if err != nil || lastIndex != msg.Commit {
+		return
+	}
+
+	atomic.StoreInt32(&q.quiet, 0)
+	if atomic.CompareAndSwapInt32(&q.quiesced, 0, 1) {
+		atomic.AddInt64(&quiesceEntered, 1)
+		logInfo("raft group %d: quiescing on notice from leader %d at commit %d", group, msg.From, msg.Commit)
+	}
+}
+
+// wakeAllGroups wakes every group, e.g. when a peer connection is lost
+func wakeAllGroups(reason string) {
+	raftQuiescence.wake(0, reason)
+	for g := 1; g < len(raftGroups); g++ {
+		raftGroups[g].quiesce.wake(uint32(g), reason)
+	}
+}
+
+// pgraft_go_is_quiesced reports whether a group has stopped ticking
+//
+//export pgraft_go_is_quiesced
+func pgraft_go_is_quiesced(group C.int) C.int {
+	q := &raftQuiescence
+	if group != 0 {
+		g := lookupGroup(int(group))
+		if g == nil {
+			return 0
+		}
+		q = &g.quiesce
+	}
+
+	if q.isQuiesced() {
+		return 1
+	}
+	return 0
+}
+
+// Client gateway
+//
+// With pgraft.client_gateway on, the Go layer serves the etcd v3 JSON API
+// (the /v3/kv, /v3/watch and /v3/lease endpoints etcd's gRPC gateway
+// exposes) on pgraft.listen_client_urls, so etcd tooling talks to pgraft
+// without going through a SQL connection.
+//
+// The C store is the only copy of the keys (pgraft_kv_gateway.c). Reads are
+// queued to the background worker, which answers them from the store, cold
+// tier included. Writes are proposed as kv_txn entries to the Raft group
+// owning their keys and leases as lease_grant, lease_keepalive and
+// lease_revoke entries to group 0. A Txn's compares and the lease table are
+// evaluated where the entries are applied, so every node takes the same
+// branch; the group 0 leader's worker expires leases. The worker reports
+// every change it applies, which feeds watches, and the outcome of every
+// entry, which answers the request that proposed it.
+//
+// Revisions are Raft log indexes: a key's mod revision is the index of its
+// last write and its create revision that of the write that created it, and
+// the header revision is the highest index applied to the store. With
+// several Raft groups these are indexes of different logs, so a Txn's keys
+// must all belong to one group.
+
+// Events kept for watches that start at a past revision
+const gatewayHistorySize = 4096
+
+// Events buffered per watch before it is cancelled as too slow
+const gatewayWatchBuffer = 1024
+
+// Reads queued for the worker before handlers wait for room
+const gatewayReadQueue = 256
+
+// Times a Put with ignore_value or ignore_lease retries when the key
+// changed between reading it and writing it
+const gatewayPutRetries = 3
+
+// Key and value limits of the C store (pgraft_kv_entry_t, PGRAFT_KV_VALUE_SIZE)
+const (
+	gatewayMaxKey   = 255
+	gatewayMaxValue = 8191
+)
+
+// Quota check results (PGRAFT_KV_QUOTA_*)
+const (
+	gatewayQuotaAdmitted    = 0
+	gatewayQuotaKeys        = 1
+	gatewayQuotaBytes       = 2
+	gatewayQuotaRate        = 3
+	gatewayQuotaNeedSize    = 4
+	gatewayQuotaSizeUnknown = -2
+)
+
+// Read kinds (PGRAFT_GO_READ_RANGE, PGRAFT_GO_READ_LEASE)
+const (
+	gatewayReadRange = 1
+	gatewayReadLease = 2
+)
+
+// gatewayKV is one key as the store holds it
+type gatewayKV struct {
+	value          string
+	createRevision int64
+	modRevision    int64
+	version        int64
+	lease          int64
+}
+
+// gatewayEvent is one change of one key
+type gatewayEvent struct {
+	key     string
+	deleted bool
+	kv      gatewayKV
+	prev    *gatewayKV
+}
+
+// gatewayWatch is an open watch stream
+type gatewayWatch struct {
+	key    string
+	end    string
+	prevKV bool
+	events chan gatewayEvent // Closed when the watch falls too far behind
+}
+
+// gatewayOutcome is how an entry the gateway proposed was applied
+type gatewayOutcome struct {
+	revision  int64
+	succeeded bool           // A Txn's compares held, or a lease operation took effect
+	events    []gatewayEvent // Changes the entry made, in order
+}
+
+// gatewayRow is one key of a read's answer
+type gatewayRow struct {
+	key string
+	kv  gatewayKV
+}
+
+// gatewayRead is a read the worker answers from the store
+type gatewayRead struct {
+	id        uint64
+	kind      int
+	key       string
+	rangeEnd  *string // nil for the key alone, "" for every key from it
+	limit     int64
+	keysOnly  bool
+	countOnly bool
+	lease     int64
+	leaseKeys bool
+
+	// Filled by the worker
+	rows           []gatewayRow
+	revision       int64 // -1 if the read failed
+	count          int64
+	leaseTTL       int64 // -1 if the lease is not live
+	leaseRemaining int64
+	done           chan struct{}
+}
+
+// gatewayHub ties the HTTP handlers to the worker
+type gatewayHub struct {
+	mu        sync.Mutex
+	revision  int64
+	history   []gatewayEvent // Ring of the last gatewayHistorySize events
+	oldest    int            // Position of the oldest event in history
+	watches   map[int64]*gatewayWatch
+	nextWatch int64
+	waiters   map[string]chan gatewayOutcome // Gateway proposals by client_id
+	changes   []gatewayEvent                 // Published since the last applied entry
+	reads     map[uint64]*gatewayRead        // Reads not answered yet
+	nextRead  uint64
+}
+
+// gatewayEntry is the JSON form of the entries the gateway proposes
+type gatewayEntry struct {
+	Type      string              `json:"type"`
+	Group     int                 `json:"group"`
+	Timestamp int64               `json:"timestamp"`
+	ClientID  string              `json:"client_id"`
+	Lease     int64               `json:"lease,omitempty"`   // lease_*
+	TTL       int64               `json:"ttl,omitempty"`     // lease_grant
+	Compare   []gatewayTxnCompare `json:"compare,omitempty"` // kv_txn
+	Success   []gatewayTxnOp      `json:"success,omitempty"` // kv_txn
+	Failure   []gatewayTxnOp      `json:"failure,omitempty"` // kv_txn
+}
+
+// gatewayTxnCompare is one compare of a kv_txn entry (pgraft_kv_compare_t)
+type gatewayTxnCompare struct {
+	Key    string `json:"key"`
+	Target string `json:"target"`
+	Result string `json:"result"`
+	Number int64  `json:"number"`
+	Value  string `json:"value,omitempty"`
+}
+
+// gatewayTxnOp is one write of a kv_txn entry (pgraft_kv_txn_op_t)
+type gatewayTxnOp struct {
+	Op       string  `json:"op"`
+	Key      string  `json:"key"`
+	RangeEnd *string `json:"range_end,omitempty"`
+	Value    string  `json:"value,omitempty"`
+	Lease    int64   `json:"lease,omitempty"`
+}
+
+var (
+	clientGateway = gatewayHub{
+		watches: make(map[int64]*gatewayWatch),
+		waiters: make(map[string]chan gatewayOutcome),
+		reads:   make(map[uint64]*gatewayRead),
+	}
+	gatewayReads = make(chan *gatewayRead, gatewayReadQueue)
+
+	gatewayEnabled   int32
+	gatewayAddress   string
+	gatewayTimeout   = 5 * time.Second
+	gatewayGroupFunc C.pgraft_go_group_for_key_fn
+	gatewayQuotaFunc C.pgraft_go_quota_admit_fn
+	gatewayServer    *http.Server
+	gatewaySequence  uint64
+	gatewayClusterID uint64
+)
+
+// configureClientGateway records the gateway settings of pgraft_go_init_config
+func configureClientGateway(config *C.struct_pgraft_go_config, clusterID string) {
+	if config.client_gateway == 0 || config.listen_client_host == nil || config.listen_client_port <= 0 {
+		return
+	}
+
+	gatewayAddress = net.JoinHostPort(C.GoString(config.listen_client_host), strconv.Itoa(int(config.listen_client_port)))
+	if config.proposal_timeout > 0 {
+		gatewayTimeout = time.Duration(config.proposal_timeout) * time.Millisecond
+	}
+	gatewayGroupFunc = config.group_for_key
+	gatewayQuotaFunc = config.quota_admit
+
+	hash := fnv.New64a()
+	hash.Write([]byte(clusterID))
+	gatewayClusterID = hash.Sum64()
+
+	atomic.StoreInt32(&gatewayEnabled, 1)
+}
+
+// startClientGateway starts serving the etcd API; called from pgraft_go_start
+func startClientGateway() {
+	if atomic.LoadInt32(&gatewayEnabled) == 0 {
+		return
+	}
+
+	mux := http.NewServeMux()
+	mux.HandleFunc("/v3/kv/range", gatewayRange)
+	mux.HandleFunc("/v3/kv/put", gatewayPut)
+	mux.HandleFunc("/v3/kv/deleterange", gatewayDeleteRange)
+	mux.HandleFunc("/v3/kv/txn", gatewayTxn)
+	mux.HandleFunc("/v3/watch", gatewayWatchStream)
+	mux.HandleFunc("/v3/lease/grant", gatewayLeaseGrant)
+	mux.HandleFunc("/v3/lease/revoke", gatewayLeaseRevoke)
+	mux.HandleFunc("/v3/kv/lease/revoke", gatewayLeaseRevoke)
+	mux.HandleFunc("/v3/lease/keepalive", gatewayLeaseKeepAlive)
+	mux.HandleFunc("/v3/lease/timetolive", gatewayLeaseTimeToLive)
+	mux.HandleFunc("/v3/kv/lease/timetolive", gatewayLeaseTimeToLive)
+	mux.HandleFunc("/version", gatewayVersion)
+	mux.HandleFunc("/health", gatewayHealth)
+
+	listener, err := net.Listen("tcp", gatewayAddress)
+	if err != nil {
+		logError("client gateway: cannot listen on %s: %v", gatewayAddress, err)
+		return
+	}
+
+	gatewayServer = &http.Server{Handler: mux}
+	go func() {
+		if err := gatewayServer.Serve(listener); err != nil && err != http.ErrServerClosed {
+			logError("client gateway stopped: %v", err)
+		}
+	}()
+
+	logInfo("client gateway serving the etcd v3 JSON API on %s", gatewayAddress)
+}
+
+// stopClientGateway closes the listener and every open stream
+func stopClientGateway() {
+	if gatewayServer != nil {
+		gatewayServer.Close()
+		gatewayServer = nil
+	}
+}
+
+// gatewayKVFromC copies a key the worker handed over
+func gatewayKVFromC(kv *C.pgraft_go_kv) gatewayKV {
+	result := gatewayKV{
+		createRevision: int64(kv.create_revision),
+		modRevision:    int64(kv.mod_revision),
+		version:        int64(kv.version),
+		lease:          int64(kv.lease),
+	}
+	if kv.value != nil {
+		result.value = C.GoString(kv.value)
+	}
+	return result
+}
+
+// pgraft_go_gateway_event hands the gateway a change the worker applied to
+// the store, whichever path it came through; kv's value is NULL for a
+// deletion and prev is NULL if the key did not exist
+//
+//export pgraft_go_gateway_event
+func pgraft_go_gateway_event(kv *C.pgraft_go_kv, prev *C.pgraft_go_kv) {
+	if kv == nil || kv.key == nil {
+		return
+	}
+
+	event := gatewayEvent{key: C.GoString(kv.key), deleted: kv.value == nil, kv: gatewayKVFromC(kv)}
+	if prev != nil {
+		prevKV := gatewayKVFromC(prev)
+		event.prev = &prevKV
+	}
+
+	h := &clientGateway
+	h.mu.Lock()
+	h.changes = append(h.changes, event)
+	if event.kv.modRevision > h.revision {
+		h.revision = event.kv.modRevision
+	}
+	h.publish(event)
+	h.mu.Unlock()
+}
+
+// pgraft_go_gateway_applied tells the gateway the worker applied an entry:
+// the request that proposed it, if any, is answered with the changes
+// published since the previous entry and whether it succeeded
+//
+//export pgraft_go_gateway_applied
+func pgraft_go_gateway_applied(clientID *C.char, revision C.int64_t, succeeded C.int) {
+	h := &clientGateway
+	h.mu.Lock()
+	if int64(revision) > h.revision {
+		h.revision = int64(revision)
+	}
+	outcome := gatewayOutcome{revision: h.revision, succeeded: succeeded != 0, events: h.changes}
+	h.changes = nil
+
+	var waiter chan gatewayOutcome
+	if clientID != nil {
+		id := C.GoString(clientID)
+		if waiter = h.waiters[id]; waiter != nil {
+			delete(h.waiters, id)
+		}
+	}
+	h.mu.Unlock()
+
+	if waiter != nil {
+		waiter <- outcome
+	}
+}
+
+// pgraft_go_gateway_next_read hands the worker the next queued read and
+// returns 1, or returns 0 if there is none. The worker releases key and
+// range_end with pgraft_go_free_string.
+//
+//export pgraft_go_gateway_next_read
+func pgraft_go_gateway_next_read(read *C.pgraft_go_gateway_read) C.int {
+	for {
+		var r *gatewayRead
+		select {
+		case r = <-gatewayReads:
+		default:
+			return 0
+		}
+
+		// Skip reads whose handler gave up
+		clientGateway.mu.Lock()
+		_, waiting := clientGateway.reads[r.id]
+		clientGateway.mu.Unlock()
+		if !waiting {
+			continue
+		}
+
+		read.id = C.uint64_t(r.id)
+		read.kind = C.int(r.kind)
+		read.key = C.CString(r.key)
+		read.range_end = nil
+		if r.rangeEnd != nil {
+			read.range_end = C.CString(*r.rangeEnd)
+		}
+		read.limit = C.int64_t(r.limit)
+		read.keys_only = gatewayCBool(r.keysOnly)
+		read.count_only = gatewayCBool(r.countOnly)
+		read.lease = C.int64_t(r.lease)
+		read.lease_keys = gatewayCBool(r.leaseKeys)
+		return 1
+	}
+}
+
+func gatewayCBool(b bool) C.int {
+	if b {
+		return 1
+	}
+	return 0
+}
+
+// pgraft_go_gateway_read_row adds one key to the answer of a read
+//
+//export pgraft_go_gateway_read_row
+func pgraft_go_gateway_read_row(id C.uint64_t, kv *C.pgraft_go_kv) {
+	if kv == nil || kv.key == nil {
+		return
+	}
+
+	h := &clientGateway
+	h.mu.Lock()
+	if read, ok := h.reads[uint64(id)]; ok {
+		read.rows = append(read.rows, gatewayRow{key: C.GoString(kv.key), kv: gatewayKVFromC(kv)})
+	}
+	h.mu.Unlock()
+}
+
+// pgraft_go_gateway_read_done completes a read: revision is the one the
+// answer reflects, -1 if the read failed, count the keys in range and, for
+// lease reads, leaseTTL the granted TTL (-1 if the lease is not live) and
+// leaseRemaining the seconds left
+//
+//export pgraft_go_gateway_read_done
+func pgraft_go_gateway_read_done(id C.uint64_t, revision C.int64_t, count C.int64_t, leaseTTL C.int64_t, leaseRemaining C.int64_t) {
+	h := &clientGateway
+	h.mu.Lock()
+	read, ok := h.reads[uint64(id)]
+	if ok {
+		delete(h.reads, uint64(id))
+		read.revision = int64(revision)
+		read.count = int64(count)
+		read.leaseTTL = int64(leaseTTL)
+		read.leaseRemaining = int64(leaseRemaining)
+		if int64(revision) > h.revision {
+			h.revision = int64(revision)
+		}
+	}
+	h.mu.Unlock()
+
+	if ok {
+		close(read.done)
+	}
+}
+
+// publish records an event and hands it to matching watches; caller holds h.mu
+func (h *gatewayHub) publish(event gatewayEvent) {
+	if len(h.history) < gatewayHistorySize {
+		h.history = append(h.history, event)
+	} else {
+		h.history[h.oldest] = event
+		h.oldest = (h.oldest + 1) % gatewayHistorySize
+	}
+
+	for id, watch := range h.watches {
+		if !keyInRange(event.key, watch.key, watch.end) {
+			continue
+		}
+		select {
+		case watch.events <- event:
+		default:
+			close(watch.events)
+			delete(h.watches, id)
+		}
+	}
+}
+
+// keyInRange applies etcd's range_end convention: empty is the key itself,
+// "\x00" is every key from key on
+func keyInRange(key, start, end string) bool {
+	switch end {
+	case "":
+		return key == start
+	case "\x00":
+		return key >= start
+	}
+	return key >= start && key < end
+}
+
+// gatewayRangeEnd converts etcd's range_end to the store's: nil for the
+// key alone, "" for every key from it
+func gatewayRangeEnd(end []byte) *string {
+	if len(end) == 0 {
+		return nil
+	}
+	result := ""
+	if !(len(end) == 1 && end[0] == 0) {
+		result = string(end)
+	}
+	return &result
+}
+
+// oldestRevision is the first revision history still holds; caller holds h.mu
+func (h *gatewayHub) oldestRevision() int64 {
+	if len(h.history) == 0 {
+		return h.revision + 1
+	}
+	return h.history[h.oldest].kv.modRevision
+}
+
+// eventsSince lists the recorded events of a range from a revision on, in
+// order; caller holds h.mu
+func (h *gatewayHub) eventsSince(start int64, key, end string) []gatewayEvent {
+	events := make([]gatewayEvent, 0)
+	for i := 0; i < len(h.history); i++ {
+		event := h.history[(h.oldest+i)%len(h.history)]
+		if event.kv.modRevision >= start && keyInRange(event.key, key, end) {
+			events = append(events, event)
+		}
+	}
+	return events
+}
+
+// currentRevision is the highest revision the gateway has seen applied
+func (h *gatewayHub) currentRevision() int64 {
+	h.mu.Lock()
+	defer h.mu.Unlock()
+	return h.revision
+}
+
+// JSON encoding of the etcd API
+//
+// The gateway speaks protobuf's JSON mapping: 64-bit integers travel as
+// strings (numbers are accepted too), bytes as base64 and enums by name.
+
+// jsonInt64 is a protobuf int64 field
+type jsonInt64 int64
+
+func (v jsonInt64) MarshalJSON() ([]byte, error) {
+	return []byte(strconv.Quote(strconv.FormatInt(int64(v), 10))), nil
+}
+
+func (v *jsonInt64) UnmarshalJSON(data []byte) error {
+	text := strings.Trim(string(data), "\"")
+	if text == "" || text == "null" {
+		*v = 0
+		return nil
+	}
+	n, err := strconv.ParseInt(text, 10, 64)
+	if err != nil {
+		u, uerr := strconv.ParseUint(text, 10, 64)
+		if uerr != nil {
+			return err
+		}
+		n = int64(u)
+	}
+	*v = jsonInt64(n)
+	return nil
+}
+
+// jsonEnum is a protobuf enum field, sent by name or by number
+type jsonEnum string
+
+func (e *jsonEnum) UnmarshalJSON(data []byte) error {
+	*e = jsonEnum(strings.Trim(string(data), "\""))
+	return nil
+}
+
+type gwHeader struct {
+	ClusterID jsonInt64 `json:"cluster_id,omitempty"`
+	MemberID  jsonInt64 `json:"member_id,omitempty"`
+	Revision  jsonInt64 `json:"revision,omitempty"`
+	RaftTerm  jsonInt64 `json:"raft_term,omitempty"`
+}
+
+type gwKeyValue struct {
+	Key            []byte    `json:"key,omitempty"`
+	CreateRevision jsonInt64 `json:"create_revision,omitempty"`
+	ModRevision    jsonInt64 `json:"mod_revision,omitempty"`
+	Version        jsonInt64 `json:"version,omitempty"`
+	Value          []byte    `json:"value,omitempty"`
+	Lease          jsonInt64 `json:"lease,omitempty"`
+}
+
+type gwRangeRequest struct {
+	Key       []byte    `json:"key"`
+	RangeEnd  []byte    `json:"range_end"`
+	Limit     jsonInt64 `json:"limit"`
+	Revision  jsonInt64 `json:"revision"`
+	KeysOnly  bool      `json:"keys_only"`
+	CountOnly bool      `json:"count_only"`
+}
+
+type gwRangeResponse struct {
+	Header gwHeader     `json:"header"`
+	Kvs    []gwKeyValue `json:"kvs,omitempty"`
+	More   bool         `json:"more,omitempty"`
+	Count  jsonInt64    `json:"count,omitempty"`
+}
+
+type gwPutRequest struct {
+	Key         []byte    `json:"key"`
+	Value       []byte    `json:"value"`
+	Lease       jsonInt64 `json:"lease"`
+	PrevKv      bool      `json:"prev_kv"`
+	IgnoreValue bool      `json:"ignore_value"`
+	IgnoreLease bool      `json:"ignore_lease"`
+}
+
+type gwPutResponse struct {
+	Header gwHeader    `json:"header"`
+	PrevKv *gwKeyValue `json:"prev_kv,omitempty"`
+}
+
+type gwDeleteRangeRequest struct {
+	Key      []byte `json:"key"`
+	RangeEnd []byte `json:"range_end"`
+	PrevKv   bool   `json:"prev_kv"`
+}
+
+type gwDeleteRangeResponse struct {
+	Header  gwHeader     `json:"header"`
+	Deleted jsonInt64    `json:"deleted,omitempty"`
+	PrevKvs []gwKeyValue `json:"prev_kvs,omitempty"`
+}
+
+type gwCompare struct {
+	Result         jsonEnum  `json:"result"`
+	Target         jsonEnum  `json:"target"`
+	Key            []byte    `json:"key"`
+	RangeEnd       []byte    `json:"range_end"`
+	Version        jsonInt64 `json:"version"`
+	CreateRevision jsonInt64 `json:"create_revision"`
+	ModRevision    jsonInt64 `json:"mod_revision"`
+	Value          []byte    `json:"value"`
+	Lease          jsonInt64 `json:"lease"`
+}
+
+type gwRequestOp struct {
+	RequestRange       *gwRangeRequest       `json:"request_range,omitempty"`
+	RequestPut         *gwPutRequest         `json:"request_put,omitempty"`
+	RequestDeleteRange *gwDeleteRangeRequest `json:"request_delete_range,omitempty"`
+}
+
+type gwResponseOp struct {
+	ResponseRange       *gwRangeResponse       `json:"response_range,omitempty"`
+	ResponsePut         *gwPutResponse         `json:"response_put,omitempty"`
+	ResponseDeleteRange *gwDeleteRangeResponse `json:"response_delete_range,omitempty"`
+}
+
+type gwTxnRequest struct {
+	Compare []gwCompare   `json:"compare"`
+	Success []gwRequestOp `json:"success"`
+	Failure []gwRequestOp `json:"failure"`
+}
+
+type gwTxnResponse struct {
+	Header    gwHeader       `json:"header"`
+	Succeeded bool           `json:"succeeded,omitempty"`
+	Responses []gwResponseOp `json:"responses,omitempty"`
+}
+
+type gwLeaseRequest struct {
+	TTL  jsonInt64 `json:"TTL"`
+	ID   jsonInt64 `json:"ID"`
+	Keys bool      `json:"keys"`
+}
+
+type gwLeaseResponse struct {
+	Header     gwHeader  `json:"header"`
+	ID         jsonInt64 `json:"ID,omitempty"`
+	TTL        jsonInt64 `json:"TTL,omitempty"`
+	GrantedTTL jsonInt64 `json:"grantedTTL,omitempty"`
+	Keys       [][]byte  `json:"keys,omitempty"`
+}
+
+type gwWatchRequest struct {
+	CreateRequest *struct {
+		Key           []byte    `json:"key"`
+		RangeEnd      []byte    `json:"range_end"`
+		StartRevision jsonInt64 `json:"start_revision"`
+		PrevKv        bool      `json:"prev_kv"`
+	} `json:"create_request"`
+}
+
+type gwEvent struct {
+	Type   string      `json:"type,omitempty"`
+	Kv     *gwKeyValue `json:"kv,omitempty"`
+	PrevKv *gwKeyValue `json:"prev_kv,omitempty"`
+}
+
+type gwWatchResponse struct {
+	Header          gwHeader  `json:"header"`
+	WatchID         jsonInt64 `json:"watch_id,omitempty"`
+	Created         bool      `json:"created,omitempty"`
+	Canceled        bool      `json:"canceled,omitempty"`
+	CompactRevision jsonInt64 `json:"compact_revision,omitempty"`
+	CancelReason    string    `json:"cancel_reason,omitempty"`
+	Events          []gwEvent `json:"events,omitempty"`
+}
+
+// gatewayError is an etcd API error with its gRPC status code
+type gatewayError struct {
+	code   int
+	status int
+	msg    string
+}
+
+func (e *gatewayError) Error() string {
+	return e.msg
+}
+
+var (
+	errGatewayKeyEmpty      = &gatewayError{3, http.StatusBadRequest, "etcdserver: key is not provided"}
+	errGatewayKeyTooLarge   = &gatewayError{3, http.StatusBadRequest, "etcdserver: key is too large"}
+	errGatewayValueTooLarge = &gatewayError{3, http.StatusBadRequest, "etcdserver: request is too large"}
+	errGatewayBadBytes      = &gatewayError{3, http.StatusBadRequest, "etcdserver: keys and values must be NUL-free UTF-8"}
+	errGatewayLeaseNotFound = &gatewayError{5, http.StatusNotFound, "etcdserver: requested lease not found"}
+	errGatewayBadTTL        = &gatewayError{3, http.StatusBadRequest, "etcdserver: lease TTL must be positive"}
+	errGatewayCompacted     = &gatewayError{11, http.StatusBadRequest, "etcdserver: mvcc: required revision has been compacted"}
+	errGatewayFutureRev     = &gatewayError{11, http.StatusBadRequest, "etcdserver: mvcc: required revision is a future revision"}
+	errGatewayTimeout       = &gatewayError{14, http.StatusServiceUnavailable, "etcdserver: request timed out"}
+	errGatewayNotRunning    = &gatewayError{14, http.StatusServiceUnavailable, "etcdserver: raft is not running"}
+	errGatewayNoValue       = &gatewayError{3, http.StatusBadRequest, "etcdserver: key not found"}
+	errGatewayLeaseExists   = &gatewayError{9, http.StatusBadRequest, "etcdserver: lease already exists"}
+	errGatewayTooManyLeases = &gatewayError{8, http.StatusServiceUnavailable, "etcdserver: too many leases"}
+	errGatewayReadFailed    = &gatewayError{13, http.StatusInternalServerError, "etcdserver: failed to read the store"}
+	errGatewayWriteFailed   = &gatewayError{13, http.StatusInternalServerError, "etcdserver: the store rejected the write"}
+	errGatewayConflict      = &gatewayError{10, http.StatusConflict, "etcdserver: key kept changing while it was written"}
+	errGatewayTxnGroups     = &gatewayError{3, http.StatusBadRequest, "etcdserver: txn keys belong to different raft groups"}
+	errGatewayTxnRange      = &gatewayError{12, http.StatusNotImplemented, "etcdserver: txn range deletes are not supported across raft groups"}
+	errGatewayQuotaKeys     = &gatewayError{8, http.StatusTooManyRequests, "etcdserver: key quota of the prefix exceeded"}
+	errGatewayQuotaBytes    = &gatewayError{8, http.StatusTooManyRequests, "etcdserver: byte quota of the prefix exceeded"}
+	errGatewayQuotaRate     = &gatewayError{8, http.StatusTooManyRequests, "etcdserver: write rate quota of the prefix exceeded"}
+	errGatewayCompareRange  = &gatewayError{12, http.StatusNotImplemented, "etcdserver: txn compares over a range are not supported"}
+	errGatewayTxnIgnore     = &gatewayError{12, http.StatusNotImplemented, "etcdserver: ignore_value and ignore_lease are not supported in a txn"}
+)
+
+// gatewayHeader builds the response header at a revision
+func gatewayHeader(revision int64) gwHeader {
+	return gwHeader{
+		ClusterID: jsonInt64(gatewayClusterID),
+		MemberID:  jsonInt64(currentNodeID),
+		Revision:  jsonInt64(revision),
+		RaftTerm:  jsonInt64(gatewayTerm()),
+	}
+}
+
+// gatewayTerm is the group 0 term, 0 before storage exists
+func gatewayTerm() uint64 {
+	if raftStorage == nil {
+		return 0
+	}
+	return getCurrentTerm()
+}
+
+// gatewayKeyValue converts a key of the store to its API form
+func gatewayKeyValue(key string, kv *gatewayKV, keysOnly bool) gwKeyValue {
+	result := gwKeyValue{
+		Key:            []byte(key),
+		CreateRevision: jsonInt64(kv.createRevision),
+		ModRevision:    jsonInt64(kv.modRevision),
+		Version:        jsonInt64(kv.version),
+		Lease:          jsonInt64(kv.lease),
+	}
+	if !keysOnly {
+		result.Value = []byte(kv.value)
+	}
+	return result
+}
+
+// gatewayDecode reads a JSON request body; POST is the only method
+func gatewayDecode(w http.ResponseWriter, r *http.Request, request interface{}) bool {
+	if r.Method != http.MethodPost {
+		w.Header().Set("Allow", http.MethodPost)
+		http.Error(w, "method not allowed", http.StatusMethodNotAllowed)
+		return false
+	}
+	if err := json.NewDecoder(r.Body).Decode(request); err != nil && err != io.EOF {
+		gatewayReply(w, nil, &gatewayError{3, http.StatusBadRequest, "invalid request: " + err.Error()})
+		return false
+	}
+	return true
+}
+
+// gatewayReply writes a response or an error in the gateway's format
+func gatewayReply(w http.ResponseWriter, response interface{}, err error) {
+	w.Header().Set("Content-Type", "application/json")
+
+	if err != nil {
+		gwErr, ok := err.(*gatewayError)
+		if !ok {
+			gwErr = &gatewayError{2, http.StatusInternalServerError, err.Error()}
+		}
+		w.WriteHeader(gwErr.status)
+		json.NewEncoder(w).Encode(map[string]interface{}{
+			"error":   gwErr.msg,
+			"message": gwErr.msg,
+			"code":    gwErr.code,
+		})
+		return
+	}
+
+	json.NewEncoder(w).Encode(response)
+}
+
+// checkGatewayKey enforces the C store's limits before anything is proposed
+func checkGatewayKey(key []byte, value []byte) error {
+	if len(key) == 0 {
+		return errGatewayKeyEmpty
+	}
+	if len(key) > gatewayMaxKey {
+		return errGatewayKeyTooLarge
+	}
+	if len(value) > gatewayMaxValue {
+		return errGatewayValueTooLarge
+	}
+	if !utf8.Valid(key) || !utf8.Valid(value) || bytes.IndexByte(key, 0) >= 0 || bytes.IndexByte(value, 0) >= 0 {
+		return errGatewayBadBytes
+	}
+	return nil
+}
+
+// gatewayGroupForKey asks the C side which Raft group owns a key, so writes
+// through the gateway and through SQL are ordered by the same log
+func gatewayGroupForKey(key string) int {
+	if len(raftGroups) <= 1 || gatewayGroupFunc == nil {
+		return 0
+	}
+
+	cKey := C.CString(key)
+	defer C.free(unsafe.Pointer(cKey))
+
+	group := int(C.pgraft_go_call_group_for_key(gatewayGroupFunc, cKey))
+	if lookupGroup(group) == nil {
+		return 0
+	}
+	return group
+}
+
+// gatewayGroupCount is the number of Raft groups keys are spread over
+func gatewayGroupCount() int {
+	if len(raftGroups) <= 1 {
+		return 1
+	}
+	return len(raftGroups)
+}
+
+// gatewayQuery queues a read for the worker and waits for its answer
+func gatewayQuery(read *gatewayRead) error {
+	if atomic.LoadInt32(&running) == 0 {
+		return errGatewayNotRunning
+	}
+
+	h := &clientGateway
+	read.done = make(chan struct{})
+	h.mu.Lock()
+	h.nextRead++
+	read.id = h.nextRead
+	h.reads[read.id] = read
+	h.mu.Unlock()
+
+	timer := time.NewTimer(gatewayTimeout)
+	defer timer.Stop()
+
+	queued := false
+	select {
+	case gatewayReads <- read:
+		queued = true
+		select {
+		case <-read.done:
+			return gatewayReadResult(read)
+		case <-timer.C:
+		}
+	case <-timer.C:
+	}
+
+	h.mu.Lock()
+	_, pending := h.reads[read.id]
+	delete(h.reads, read.id)
+	h.mu.Unlock()
+
+	// Answered while timing out
+	if queued && !pending {
+		<-read.done
+		return gatewayReadResult(read)
+	}
+	return errGatewayTimeout
+}
+
+func gatewayReadResult(read *gatewayRead) error {
+	if read.revision < 0 {
+		return errGatewayReadFailed
+	}
+	return nil
+}
+
+// gatewayAdmit checks a write against the quotas of its key before it is
+// proposed, as the KV functions do; the C side asks for the key's current
+// size only when a key or byte limit applies to it
+func gatewayAdmit(key string, deletion bool, value string) error {
+	if gatewayQuotaFunc == nil {
+		return nil
+	}
+
+	cKey := C.CString(key)
+	defer C.free(unsafe.Pointer(cKey))
+
+	oldSize := int64(gatewayQuotaSizeUnknown)
+	for {
+		result := C.pgraft_go_call_quota_admit(gatewayQuotaFunc, cKey, gatewayCBool(deletion),
+			C.int64_t(len(value)), C.int64_t(oldSize))
+		switch result {
+		case gatewayQuotaKeys:
+			return errGatewayQuotaKeys
+		case gatewayQuotaBytes:
+			return errGatewayQuotaBytes
+		case gatewayQuotaRate:
+			return errGatewayQuotaRate
+		case gatewayQuotaNeedSize:
+			if oldSize != gatewayQuotaSizeUnknown {
+				return nil
+			}
+			read := &gatewayRead{kind: gatewayReadRange, key: key}
+			if err := gatewayQuery(read); err != nil {
+				return err
+			}
+			oldSize = -1
+			if len(read.rows) > 0 {
+				oldSize = int64(len(read.rows[0].kv.value))
+			}
+		default:
+			return nil
+		}
+	}
+}
+
+// gatewayAdmitDelete checks a delete against the quotas of every key it
+// removes, read first for a range
+func gatewayAdmitDelete(key string, rangeEnd *string) error {
+	if rangeEnd == nil || gatewayQuotaFunc == nil {
+		return gatewayAdmit(key, true, "")
+	}
+
+	read := &gatewayRead{kind: gatewayReadRange, key: key, rangeEnd: rangeEnd, keysOnly: true}
+	if err := gatewayQuery(read); err != nil {
+		return err
+	}
+	for _, row := range read.rows {
+		if err := gatewayAdmit(row.key, true, ""); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// gatewayCheckLease fails unless a lease is live
+func gatewayCheckLease(id int64) error {
+	read := &gatewayRead{kind: gatewayReadLease, lease: id}
+	if err := gatewayQuery(read); err != nil {
+		return err
+	}
+	if read.leaseTTL < 0 {
+		return errGatewayLeaseNotFound
+	}
+	return nil
+}
+
+// gatewayCommit proposes an entry to a group and waits until this node has
+// applied it
+func gatewayCommit(group int, entry gatewayEntry) (gatewayOutcome, error) {
+	if atomic.LoadInt32(&running) == 0 {
+		return gatewayOutcome{}, errGatewayNotRunning
+	}
+
+	entry.Group = group
+	entry.ClientID = fmt.Sprintf("gateway-%d-%d", currentNodeID, atomic.AddUint64(&gatewaySequence, 1))
+	entry.Timestamp = time.Now().UnixMicro() - 946684800000000 // PostgreSQL epoch
+	data, err := json.Marshal(entry)
+	if err != nil {
+		return gatewayOutcome{}, err
+	}
+
+	waiter := make(chan gatewayOutcome, 1)
+	clientGateway.mu.Lock()
+	clientGateway.waiters[entry.ClientID] = waiter
+	clientGateway.mu.Unlock()
+
+	ctx, cancel := context.WithTimeout(raftCtx, gatewayTimeout)
+	defer cancel()
+
+	if group == 0 {
+		raftQuiescence.wake(0, "proposal")
+		err = raftNode.Propose(ctx, data)
+	} else {
+		g := lookupGroup(group)
+		g.quiesce.wake(g.id, "proposal")
+		if err = g.node.Propose(ctx, data); err == nil {
+			atomic.AddInt64(&g.proposals, 1)
+		}
+	}
+
+	if err == nil {
+		select {
+		case outcome := <-waiter:
+			return outcome, nil
+		case <-ctx.Done():
+		}
+	}
+
+	clientGateway.mu.Lock()
+	delete(clientGateway.waiters, entry.ClientID)
+	clientGateway.mu.Unlock()
+
+	if err != nil && err != context.DeadlineExceeded {
+		return gatewayOutcome{}, &gatewayError{14, http.StatusServiceUnavailable, "etcdserver: " + err.Error()}
+	}
+	return gatewayOutcome{}, errGatewayTimeout
+}
+
+// gatewayTakeEvent removes and returns the first event of an outcome that
+// changed a key, nil if there is none
+func gatewayTakeEvent(events *[]gatewayEvent, key string, deleted bool) *gatewayEvent {
+	for i := range *events {
+		event := (*events)[i]
+		if event.key == key && event.deleted == deleted {
+			*events = append((*events)[:i], (*events)[i+1:]...)
+			return &event
+		}
+	}
+	return nil
+}
+
+// gatewayTakeDeletes removes the deletions of a range from an outcome's
+// events and fills a DeleteRange response from them
+func gatewayTakeDeletes(events *[]gatewayEvent, key, end string, response *gwDeleteRangeResponse, withPrev bool) {
+	remaining := (*events)[:0]
+	for _, event := range *events {
+		if !event.deleted || !keyInRange(event.key, key, end) {
+			remaining = append(remaining, event)
+			continue
+		}
+		response.Deleted++
+		if withPrev && event.prev != nil {
+			response.PrevKvs = append(response.PrevKvs, gatewayKeyValue(event.key, event.prev, false))
+		}
+	}
+	*events = remaining
+}
+
+// Range
+func gatewayRange(w http.ResponseWriter, r *http.Request) {
+	var request gwRangeRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+	response, err := gatewayDoRange(&request)
+	gatewayReply(w, response, err)
+}
+
+func gatewayDoRange(request *gwRangeRequest) (*gwRangeResponse, error) {
+	if len(request.Key) == 0 {
+		return nil, errGatewayKeyEmpty
+	}
+
+	read := &gatewayRead{
+		kind:      gatewayReadRange,
+		key:       string(request.Key),
+		rangeEnd:  gatewayRangeEnd(request.RangeEnd),
+		limit:     int64(request.Limit),
+		keysOnly:  request.KeysOnly,
+		countOnly: request.CountOnly,
+	}
+	if err := gatewayQuery(read); err != nil {
+		return nil, err
+	}
+
+	// Only the current revision is kept
+	if request.Revision > 0 && int64(request.Revision) < read.revision {
+		return nil, errGatewayCompacted
+	}
+	if int64(request.Revision) > read.revision {
+		return nil, errGatewayFutureRev
+	}
+
+	response := &gwRangeResponse{Header: gatewayHeader(read.revision), Count: jsonInt64(read.count)}
+	if request.CountOnly {
+		return response, nil
+	}
+	response.More = read.count > int64(len(read.rows))
+	for i := range read.rows {
+		response.Kvs = append(response.Kvs, gatewayKeyValue(read.rows[i].key, &read.rows[i].kv, request.KeysOnly))
+	}
+	return response, nil
+}
+
+// Put
+func gatewayPut(w http.ResponseWriter, r *http.Request) {
+	var request gwPutRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+	response, err := gatewayDoPut(&request)
+	gatewayReply(w, response, err)
+}
+
+// gatewayDoPut writes a key as a kv_txn entry. ignore_value and ignore_lease
+// take the value or lease the key has when it is read, and the write only
+// applies if the key was not modified since; otherwise it is read again.
+func gatewayDoPut(request *gwPutRequest) (*gwPutResponse, error) {
+	key := string(request.Key)
+	group := gatewayGroupForKey(key)
+
+	for attempt := 0; ; attempt++ {
+		value := string(request.Value)
+		leaseID := int64(request.Lease)
+		var compares []gatewayTxnCompare
+
+		if request.IgnoreValue || request.IgnoreLease {
+			if len(request.Key) == 0 {
+				return nil, errGatewayKeyEmpty
+			}
+			read := &gatewayRead{kind: gatewayReadRange, key: key}
+			if err := gatewayQuery(read); err != nil {
+				return nil, err
+			}
+			if len(read.rows) == 0 {
+				return nil, errGatewayNoValue
+			}
+			current := read.rows[0].kv
+			if request.IgnoreValue {
+				value = current.value
+			}
+			if request.IgnoreLease {
+				leaseID = current.lease
+			}
+			compares = []gatewayTxnCompare{{Key: key, Target: "MOD", Result: "EQUAL", Number: current.modRevision}}
+		}
+
+		if err := checkGatewayKey(request.Key, []byte(value)); err != nil {
+			return nil, err
+		}
+		if leaseID != 0 && !request.IgnoreLease {
+			if err := gatewayCheckLease(leaseID); err != nil {
+				return nil, err
+			}
+		}
+		if err := gatewayAdmit(key, false, value); err != nil {
+			return nil, err
+		}
+
+		outcome, err := gatewayCommit(group, gatewayEntry{
+			Type:    "kv_txn",
+			Compare: compares,
+			Success: []gatewayTxnOp{{Op: "put", Key: key, Value: value, Lease: leaseID}},
+		})
+		if err != nil {
+			return nil, err
+		}
+		if !outcome.succeeded {
+			if len(compares) > 0 && attempt < gatewayPutRetries {
+				continue
+			}
+			if len(compares) > 0 {
+				return nil, errGatewayConflict
+			}
+			return nil, errGatewayWriteFailed
+		}
+
+		response := &gwPutResponse{Header: gatewayHeader(outcome.revision)}
+		if event := gatewayTakeEvent(&outcome.events, key, false); request.PrevKv && event != nil && event.prev != nil {
+			prev := gatewayKeyValue(key, event.prev, false)
+			response.PrevKv = &prev
+		}
+		return response, nil
+	}
+}
+
+// DeleteRange
+func gatewayDeleteRange(w http.ResponseWriter, r *http.Request) {
+	var request gwDeleteRangeRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+	response, err := gatewayDoDeleteRange(&request)
+	gatewayReply(w, response, err)
+}
+
+// gatewayDoDeleteRange deletes a key, or a range as one kv_txn entry per
+// Raft group; with several groups a range delete is atomic per group only
+func gatewayDoDeleteRange(request *gwDeleteRangeRequest) (*gwDeleteRangeResponse, error) {
+	if len(request.Key) == 0 {
+		return nil, errGatewayKeyEmpty
+	}
+
+	key := string(request.Key)
+	rangeEnd := gatewayRangeEnd(request.RangeEnd)
+	groups := []int{gatewayGroupForKey(key)}
+	if rangeEnd != nil {
+		groups = groups[:0]
+		for group := 0; group < gatewayGroupCount(); group++ {
+			groups = append(groups, group)
+		}
+	}
+
+	if err := gatewayAdmitDelete(key, rangeEnd); err != nil {
+		return nil, err
+	}
+
+	response := &gwDeleteRangeResponse{}
+	var revision int64
+	for _, group := range groups {
+		outcome, err := gatewayCommit(group, gatewayEntry{
+			Type:    "kv_txn",
+			Success: []gatewayTxnOp{{Op: "delete", Key: key, RangeEnd: rangeEnd}},
+		})
+		if err != nil {
+			return nil, err
+		}
+		if !outcome.succeeded {
+			return nil, errGatewayWriteFailed
+		}
+		if outcome.revision > revision {
+			revision = outcome.revision
+		}
+		gatewayTakeDeletes(&outcome.events, key, string(request.RangeEnd), response, request.PrevKv)
+	}
+
+	response.Header = gatewayHeader(revision)
+	return response, nil
+}
+
+// Txn
+//
+// A Txn is one kv_txn entry in the log of the group owning its keys: every
+// node evaluates its compares against its store when applying it and runs
+// the same branch, so compare-and-swap holds against writes from any node
+// and from SQL. Range operations of the branch taken are read after it is
+// applied.
+func gatewayTxn(w http.ResponseWriter, r *http.Request) {
+	var request gwTxnRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+	response, err := gatewayDoTxn(&request)
+	gatewayReply(w, response, err)
+}
+
+// Names of etcd's Compare enums, indexed by value (pgraft_kv_compare_target_t,
+// pgraft_kv_compare_result_t)
+var (
+	gatewayCompareTargets = []string{"VERSION", "CREATE", "MOD", "VALUE", "LEASE"}
+	gatewayCompareResults = []string{"EQUAL", "GREATER", "LESS", "NOT_EQUAL"}
+)
+
+// gatewayEnumName maps an enum sent by name or number to its name; an
+// omitted enum is its zero value
+func gatewayEnumName(e jsonEnum, names []string) (string, bool) {
+	if e == "" {
+		return names[0], true
+	}
+	if n, err := strconv.Atoi(string(e)); err == nil {
+		if n < 0 || n >= len(names) {
+			return "", false
+		}
+		return names[n], true
+	}
+	for _, name := range names {
+		if string(e) == name {
+			return name, true
+		}
+	}
+	return "", false
+}
+
+// gatewayTxnGroup checks a Txn key belongs to the same group as the others
+func gatewayTxnGroup(group *int, key []byte) error {
+	if len(key) == 0 {
+		return errGatewayKeyEmpty
+	}
+	g := gatewayGroupForKey(string(key))
+	if *group >= 0 && g != *group {
+		return errGatewayTxnGroups
+	}
+	*group = g
+	return nil
+}
+
+// gatewayTxnOps converts the writes of a Txn branch and checks them against
+// their quotas; both branches are checked, as either may run
+func gatewayTxnOps(ops []gwRequestOp, group *int) ([]gatewayTxnOp, error) {
+	result := make([]gatewayTxnOp, 0, len(ops))
+	for _, op := range ops {
+		switch {
+		case op.RequestRange != nil:
+			continue
+		case op.RequestPut != nil:
+			put := op.RequestPut
+			if put.IgnoreValue || put.IgnoreLease {
+				return nil, errGatewayTxnIgnore
+			}
+			if err := checkGatewayKey(put.Key, put.Value); err != nil {
+				return nil, err
+			}
+			if err := gatewayTxnGroup(group, put.Key); err != nil {
+				return nil, err
+			}
+			if put.Lease != 0 {
+				if err := gatewayCheckLease(int64(put.Lease)); err != nil {
+					return nil, err
+				}
+			}
+			if err := gatewayAdmit(string(put.Key), false, string(put.Value)); err != nil {
+				return nil, err
+			}
+			result = append(result, gatewayTxnOp{Op: "put", Key: string(put.Key), Value: string(put.Value), Lease: int64(put.Lease)})
+		case op.RequestDeleteRange != nil:
+			del := op.RequestDeleteRange
+			rangeEnd := gatewayRangeEnd(del.RangeEnd)
+			if rangeEnd != nil && gatewayGroupCount() > 1 {
+				return nil, errGatewayTxnRange
+			}
+			if err := gatewayTxnGroup(group, del.Key); err != nil {
+				return nil, err
+			}
+			if err := gatewayAdmitDelete(string(del.Key), rangeEnd); err != nil {
+				return nil, err
+			}
+			result = append(result, gatewayTxnOp{Op: "delete", Key: string(del.Key), RangeEnd: rangeEnd})
+		default:
+			return nil, &gatewayError{12, http.StatusNotImplemented, "etcdserver: unsupported txn operation"}
+		}
+	}
+	return result, nil
+}
+
+func gatewayDoTxn(request *gwTxnRequest) (*gwTxnResponse, error) {
+	entry := gatewayEntry{Type: "kv_txn"}
+	group := -1
+
+	for _, compare := range request.Compare {
+		if len(compare.RangeEnd) > 0 {
+			return nil, errGatewayCompareRange
+		}
+		target, ok := gatewayEnumName(compare.Target, gatewayCompareTargets)
+		if !ok {
+			return nil, &gatewayError{3, http.StatusBadRequest, "etcdserver: invalid compare target"}
+		}
+		result, ok := gatewayEnumName(compare.Result, gatewayCompareResults)
+		if !ok {
+			return nil, &gatewayError{3, http.StatusBadRequest, "etcdserver: invalid compare result"}
+		}
+		if err := gatewayTxnGroup(&group, compare.Key); err != nil {
+			return nil, err
+		}
+
+		c := gatewayTxnCompare{Key: string(compare.Key), Target: target, Result: result}
+		switch target {
+		case "VERSION":
+			c.Number = int64(compare.Version)
+		case "CREATE":
+			c.Number = int64(compare.CreateRevision)
+		case "MOD":
+			c.Number = int64(compare.ModRevision)
+		case "LEASE":
+			c.Number = int64(compare.Lease)
+		case "VALUE":
+			c.Value = string(compare.Value)
+		}
+		entry.Compare = append(entry.Compare, c)
+	}
+
+	var err error
+	if entry.Success, err = gatewayTxnOps(request.Success, &group); err != nil {
+		return nil, err
+	}
+	if entry.Failure, err = gatewayTxnOps(request.Failure, &group); err != nil {
+		return nil, err
+	}
+	if group < 0 {
+		group = 0
+	}
+
+	outcome, err := gatewayCommit(group, entry)
+	if err != nil {
+		return nil, err
+	}
+
+	// A failed branch that ran no compares means the store rejected a write
+	ops := request.Success
+	if !outcome.succeeded {
+		if len(entry.Compare) == 0 {
+			return nil, errGatewayWriteFailed
+		}
+		ops = request.Failure
+	}
+
+	response := &gwTxnResponse{Header: gatewayHeader(outcome.revision), Succeeded: outcome.succeeded}
+	for _, op := range ops {
+		var result gwResponseOp
+		switch {
+		case op.RequestRange != nil:
+			if result.ResponseRange, err = gatewayDoRange(op.RequestRange); err != nil {
+				return nil, err
+			}
+		case op.RequestPut != nil:
+			put := &gwPutResponse{Header: response.Header}
+			event := gatewayTakeEvent(&outcome.events, string(op.RequestPut.Key), false)
+			if op.RequestPut.PrevKv && event != nil && event.prev != nil {
+				prev := gatewayKeyValue(event.key, event.prev, false)
+				put.PrevKv = &prev
+			}
+			result.ResponsePut = put
+		case op.RequestDeleteRange != nil:
+			del := op.RequestDeleteRange
+			result.ResponseDeleteRange = &gwDeleteRangeResponse{Header: response.Header}
+			gatewayTakeDeletes(&outcome.events, string(del.Key), string(del.RangeEnd), result.ResponseDeleteRange, del.PrevKv)
+		}
+		response.Responses = append(response.Responses, result)
+	}
+	return response, nil
+}
+
+// Watch
+//
+// Like etcd's gateway, a watch is one long POST: the body carries a
+// create_request and the response streams one JSON object per batch.
+func gatewayWatchStream(w http.ResponseWriter, r *http.Request) {
+	var request gwWatchRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+	if request.CreateRequest == nil {
+		gatewayReply(w, nil, &gatewayError{3, http.StatusBadRequest, "etcdserver: no create_request"})
+		return
+	}
+	flusher, ok := w.(http.Flusher)
+	if !ok {
+		gatewayReply(w, nil, &gatewayError{12, http.StatusNotImplemented, "streaming unsupported"})
+		return
+	}
+
+	create := request.CreateRequest
+	watch := &gatewayWatch{
+		key:    string(create.Key),
+		end:    string(create.RangeEnd),
+		prevKV: create.PrevKv,
+		events: make(chan gatewayEvent, gatewayWatchBuffer),
+	}
+
+	// Register and take the replay under one lock so no change slips between
+	m := &clientGateway
+	m.mu.Lock()
+	start := int64(create.StartRevision)
+	revision := m.revision
+	var replay []gatewayEvent
+	if start > 0 && start <= m.revision {
+		oldest := m.oldestRevision()
+		if start < oldest {
+			m.mu.Unlock()
+			gatewayStream(w, flusher, &gwWatchResponse{
+				Header:          gatewayHeader(revision),
+				Created:         true,
+				Canceled:        true,
+				CompactRevision: jsonInt64(oldest - 1),
+				CancelReason:    errGatewayCompacted.msg,
+			})
+			return
+		}
+		replay = m.eventsSince(start, watch.key, watch.end)
+	}
+	m.nextWatch++
+	id := m.nextWatch
+	m.watches[id] = watch
+	m.mu.Unlock()
+
+	defer func() {
+		m.mu.Lock()
+		if m.watches[id] == watch {
+			delete(m.watches, id)
+		}
+		m.mu.Unlock()
+	}()
+
+	w.Header().Set("Content-Type", "application/json")
+	if !gatewayStream(w, flusher, &gwWatchResponse{Header: gatewayHeader(revision), WatchID: jsonInt64(id), Created: true}) {
+		return
+	}
+
+	for len(replay) > 0 {
+		n := len(replay)
+		if n > 128 {
+			n = 128
+		}
+		batch := &gwWatchResponse{Header: gatewayHeader(replay[n-1].kv.modRevision), WatchID: jsonInt64(id)}
+		for i := 0; i < n; i++ {
+			batch.Events = append(batch.Events, gatewayWatchEvent(&replay[i], watch.prevKV))
+		}
+		if !gatewayStream(w, flusher, batch) {
+			return
+		}
+		replay = replay[n:]
+	}
+
+	for {
+		select {
+		case <-r.Context().Done():
+			return
+		case event, open := <-watch.events:
+			if !open {
+				gatewayStream(w, flusher, &gwWatchResponse{
+					Header:       gatewayHeader(m.currentRevision()),
+					WatchID:      jsonInt64(id),
+					Canceled:     true,
+					CancelReason: "etcdserver: watcher fell too far behind",
+				})
+				return
+			}
+
+			// Send whatever else is already queued in the same batch
+			batch := &gwWatchResponse{WatchID: jsonInt64(id)}
+			for {
+				batch.Events = append(batch.Events, gatewayWatchEvent(&event, watch.prevKV))
+				batch.Header = gatewayHeader(event.kv.modRevision)
+				if len(batch.Events) >= 128 {
+					break
+				}
+				select {
+				case event, open = <-watch.events:
+				default:
+					open = false
+				}
+				if !open {
+					break
+				}
+			}
+			if !gatewayStream(w, flusher, batch) {
+				return
+			}
+		}
+	}
+}
+
+// gatewayWatchEvent converts an event to its API form
+func gatewayWatchEvent(event *gatewayEvent, withPrev bool) gwEvent {
+	result := gwEvent{}
+	if event.deleted {
+		result.Type = "DELETE"
+		result.Kv = &gwKeyValue{Key: []byte(event.key), ModRevision: jsonInt64(event.kv.modRevision)}
+	} else {
+		kv := gatewayKeyValue(event.key, &event.kv, false)
+		result.Kv = &kv
+	}
+	if withPrev && event.prev != nil {
+		prev := gatewayKeyValue(event.key, event.prev, false)
+		result.PrevKv = &prev
+	}
+	return result
+}
+
+// gatewayStream writes one streamed message; false once the client is gone
+func gatewayStream(w http.ResponseWriter, flusher http.Flusher, response *gwWatchResponse) bool {
+	if err := json.NewEncoder(w).Encode(map[string]interface{}{"result": response}); err != nil {
+		return false
+	}
+	flusher.Flush()
+	return true
+}
+
+// Leases
+//
+// Leases live in the C store and change only through group 0 entries; a
+// grant, keepalive or revoke is answered once this node has applied it.
+func gatewayLeaseGrant(w http.ResponseWriter, r *http.Request) {
+	var request gwLeaseRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+	if request.TTL <= 0 {
+		gatewayReply(w, nil, errGatewayBadTTL)
+		return
+	}
+
+	// IDs carry the granting node in the top bits, like etcd's
+	id := int64(request.ID)
+	if id == 0 {
+		id = int64(currentNodeID&0xffff)<<48 | int64(uint64(time.Now().UnixNano()/1000)&0xffffffffffff)
+	}
+
+	read := &gatewayRead{kind: gatewayReadLease, lease: id}
+	if err := gatewayQuery(read); err != nil {
+		gatewayReply(w, nil, err)
+		return
+	}
+	if read.leaseTTL >= 0 {
+		gatewayReply(w, nil, errGatewayLeaseExists)
+		return
+	}
+
+	outcome, err := gatewayCommit(0, gatewayEntry{Type: "lease_grant", Lease: id, TTL: int64(request.TTL)})
+	if err == nil && !outcome.succeeded {
+		err = errGatewayTooManyLeases
+	}
+	gatewayReply(w, &gwLeaseResponse{Header: gatewayHeader(outcome.revision), ID: jsonInt64(id), TTL: request.TTL}, err)
+}
+
+// Revoking deletes the lease's keys of group 0 in the same entry and those
+// of other groups shortly after, through the group 0 leader's sweep
+func gatewayLeaseRevoke(w http.ResponseWriter, r *http.Request) {
+	var request gwLeaseRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+
+	outcome, err := gatewayCommit(0, gatewayEntry{Type: "lease_revoke", Lease: int64(request.ID)})
+	if err == nil && !outcome.succeeded {
+		err = errGatewayLeaseNotFound
+	}
+	gatewayReply(w, &gwLeaseResponse{Header: gatewayHeader(outcome.revision)}, err)
+}
+
+// Keepalives are replicated so any node that becomes leader knows the
+// lease was alive; etcd's gateway streams them, one request per reply here
+func gatewayLeaseKeepAlive(w http.ResponseWriter, r *http.Request) {
+	var request gwLeaseRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+
+	read := &gatewayRead{kind: gatewayReadLease, lease: int64(request.ID)}
+	if err := gatewayQuery(read); err != nil {
+		gatewayReply(w, nil, err)
+		return
+	}
+
+	// An expired lease answers with TTL 0
+	response := &gwLeaseResponse{ID: request.ID}
+	revision := read.revision
+	if read.leaseTTL >= 0 {
+		outcome, err := gatewayCommit(0, gatewayEntry{Type: "lease_keepalive", Lease: int64(request.ID)})
+		if err != nil {
+			gatewayReply(w, nil, err)
+			return
+		}
+		revision = outcome.revision
+		if outcome.succeeded {
+			response.TTL = jsonInt64(read.leaseTTL)
+		}
+	}
+	response.Header = gatewayHeader(revision)
+	gatewayReply(w, map[string]interface{}{"result": response}, nil)
+}
+
+func gatewayLeaseTimeToLive(w http.ResponseWriter, r *http.Request) {
+	var request gwLeaseRequest
+	if !gatewayDecode(w, r, &request) {
+		return
+	}
+
+	read := &gatewayRead{kind: gatewayReadLease, lease: int64(request.ID), leaseKeys: request.Keys}
+	if err := gatewayQuery(read); err != nil {
+		gatewayReply(w, nil, err)
+		return
+	}
+
+	response := &gwLeaseResponse{Header: gatewayHeader(read.revision), ID: request.ID, TTL: -1}
+	if read.leaseTTL >= 0 {
+		response.TTL = jsonInt64(read.leaseRemaining)
+		response.GrantedTTL = jsonInt64(read.leaseTTL)
+		for _, row := range read.rows {
+			response.Keys = append(response.Keys, []byte(row.key))
+		}
+	}
+	gatewayReply(w, response, nil)
+}
+
+// Version and health, as probed by etcd clients before they pick an API
+func gatewayVersion(w http.ResponseWriter, r *http.Request) {
+	gatewayReply(w, map[string]string{"etcdserver": "3.5.0", "etcdcluster": "3.5.0"}, nil)
+}
+
+func gatewayHealth(w http.ResponseWriter, r *http.Request) {
+	healthy := atomic.LoadInt32(&running) == 1 && raftNode != nil && raftNode.Status().Lead != 0
+	if !healthy {
+		w.Header().Set("Content-Type", "application/json")
+		w.WriteHeader(http.StatusServiceUnavailable)
+	}
+	gatewayReply(w, map[string]string{"health": strconv.FormatBool(healthy)}, nil)
+}
+
+// Apply configuration change
+func applyConfChange(cc raftpb.ConfChange) {
+	logInfo("Applying ConfChange: type=%s, node=%d", cc.Type.String(), cc.NodeID)
+
+	// CRITICAL: Actually apply the configuration change to the Raft node
+	if raftNode != nil {
+		logInfo("Applying ConfChange to Raft node")
+		raftNode.ApplyConfChange(cc)
+		logInfo("ConfChange applied to Raft node successfully")
+	} else {
+		logInfo("ERROR - Raft node is nil, cannot apply ConfChange")
+		return
+	}
+
+	switch cc.Type {
+	case raftpb.ConfChangeAddNode:
+		logInfo("Added node %d to cluster", cc.NodeID)
+		// Update transport membership
+		updateTransportMembership()
+	case raftpb.ConfChangeRemoveNode:
+		logInfo("Removed node %d from cluster", cc.NodeID)
+		// Update transport membership
+		updateTransportMembership()
+	case raftpb.ConfChangeUpdateNode:
+		logInfo("Updated node %d in cluster", cc.NodeID)
+		// Update transport membership
+		updateTransportMembership()
+	}
+}
+
+// Update transport membership to match Raft configuration
+func updateTransportMembership() {
+	logInfo("Updating transport membership")
+
+	// Get current Raft status to see the configuration
+	if raftNode == nil {
+		logInfo("WARNING - Raft node is nil, cannot update transport membership")
+		return
+	}
+
+	status := raftNode.Status()
+	logInfo("Current Raft configuration: voters=%v, learners=%v", status.Config.Voters, status.Config.Learners)
+
+	// The Raft node's configuration is automatically updated by ApplyConfChange
+	// We just need to ensure our transport layer knows about the changes
+	nodesMutex.Lock()
+	defer nodesMutex.Unlock()
+
+	// Remove nodes that are no longer in the configuration
+	for id := range status.Config.Voters {
+		found := false
+		for voterID := range status.Config.Voters {
+			if id == voterID {
+				found = true
+				break
+			}
+		}
+		if !found && uint64(id) != raftConfig.ID {
+			logInfo("Removing disconnected node %d from transport membership", id)
+			delete(nodes, uint64(id))
+			// Also close and remove connection if it exists
+			connMutex.Lock()
+			if managedConn, ok := connections[uint64(id)]; ok {
+				managedConn.Conn.Close()
+				delete(connections, uint64(id))
+			}
+			connMutex.Unlock()
+		}
+	}
+	for id := range status.Config.Learners {
+		found := false
+		for learnerID := range status.Config.Learners {
+			if id == learnerID {
+				found = true
+				break
+			}
+		}
+		if !found && id != raftConfig.ID {
+			logInfo("Removing disconnected learner node %d from transport membership", id)
+			delete(nodes, id)
+			// Also close and remove connection if it exists
+			connMutex.Lock()
+			if managedConn, ok := connections[id]; ok {
+				managedConn.Conn.Close()
+				delete(connections, id)
+			}
+			connMutex.Unlock()
+		}
+	}
+
+	logInfo("Transport membership updated - nodes: %v", nodes)
+}
+
+// Apply configuration change v2
+func applyConfChangeV2(cc raftpb.ConfChangeV2) {
+	logInfo("Applying ConfChangeV2: changes=%d", len(cc.Changes))
+
+	// CRITICAL: Actually apply the configuration change to the Raft node
+	if raftNode != nil {
+		logInfo("Applying ConfChangeV2 to Raft node")
+		raftNode.ApplyConfChange(cc)
+		logInfo("ConfChangeV2 applied to Raft node successfully")
+	} else {
+		logInfo("ERROR - Raft node is nil, cannot apply ConfChangeV2")
+		return
+	}
+
+	for _, change := range cc.Changes {
+		switch change.Type {
+		case raftpb.ConfChangeAddNode:
+			logInfo("Added node %d to cluster", change.NodeID)
+		case raftpb.ConfChangeRemoveNode:
+			logInfo("Removed node %d from cluster", change.NodeID)
+		case raftpb.ConfChangeUpdateNode:
+			logInfo("Updated node %d in cluster", change.NodeID)
+		}
+	}
+
+	// Update transport membership
+	updateTransportMembership()
+}
+
+// Process outgoing messages through comm module
+func processMessage(msg raftpb.Message) {
+	// Convert message to bytes
+	data, err := msg.Marshal()
+	if err != nil {
+		logInfo("failed to marshal message: %v", err)
+		return
+	}
+
+	// Send to specific node
+	if msg.To != 0 {
+		sendToNode(msg.To, data)
+	} else {
+		// Broadcast to all nodes
+		broadcastToAllNodes(data)
+	}
+
+	atomic.AddInt64(&messagesProcessed, 1)
+}
+
+// Send message to specific node
+func sendToNode(nodeID uint64, data []byte) {
+	connMutex.RLock()
 	conn, exists := connections[nodeID]
 	connMutex.RUnlock()
 
@@ -2294,6 +5739,17 @@ func handleConnectionMessages(nodeID uint64, conn net.Conn) {
 			// Read message length
 			var msgLen uint32
 			if err := readUint32(conn, &msgLen); err != nil {
+				// A quiet connection is expected while groups are
+				// quiesced, so probe it; an unanswered probe or a
+				// broken connection must restart election timers
+				if isTimeoutError(err) {
+					if connectionErrors > 0 {
+						wakeAllGroups(fmt.Sprintf("node %d did not answer a ping", nodeID))
+					}
+					sendControlFrame(nodeID, controlPing, 0, nil)
+				} else {
+					wakeAllGroups(fmt.Sprintf("connection to node %d lost", nodeID))
+				}
 				connectionErrors++
 				if connectionErrors >= maxConsecutiveErrors {
 					logWarning("Connection to node %d failed after %d errors, closing: %v", nodeID, connectionErrors, err)
@@ -2313,9 +5769,10 @@ func handleConnectionMessages(nodeID uint64, conn net.Conn) {
 				continue
 			}
 
-			// Read message data
-			data := make([]byte, msgLen)
-			if _, err := conn.Read(data); err != nil {
+			// Read message data; group batches and control messages
+			// flag the length's top bits
+			data := make([]byte, msgLen&^(groupFrameFlag|controlFrameFlag))
+			if _, err := io.ReadFull(conn, data); err != nil {
 				connectionErrors++
 				if connectionErrors >= maxConsecutiveErrors {
 					logWarning("Failed to read from node %d after %d errors, closing: %v", nodeID, connectionErrors, err)
@@ -2337,6 +5794,15 @@ func handleConnectionMessages(nodeID uint64, conn net.Conn) {
 			// Reset error counter on successful read
 			connectionErrors = 0
 
+			if msgLen&groupFrameFlag != 0 {
+				deliverGroupFrame(nodeID, data)
+				continue
+			}
+			if msgLen&controlFrameFlag != 0 {
+				handleControlFrame(nodeID, data)
+				continue
+			}
+
 			// Process message
 			var msg raftpb.Message
 			if err := msg.Unmarshal(data); err != nil {
@@ -2344,6 +5810,19 @@ func handleConnectionMessages(nodeID uint64, conn net.Conn) {
 				continue
 			}
 
+			if isQuiesceNotice(msg) {
+				raftQuiescence.accept(0, raftNode, raftStorage, msg)
+				continue
+			}
+			raftQuiescence.wake(0, "message")
+
+			switch msg.Type {
+			case raftpb.MsgHeartbeat:
+				recordLeaderHeartbeat(msg.From)
+			case raftpb.MsgHeartbeatResp:
+				recordHeartbeatResponse(msg.From)
+			}
+
 			logInfo("Received message from node %d: type=%s, term=%d", nodeID, msg.Type.String(), msg.Term)
 
 			// Send message to Raft node
@@ -2912,6 +6391,7 @@ func processRaftReady() {
 				} else if entry.Type == raftpb.EntryNormal && len(entry.Data) > 0 {
 					logInfo("processing normal entry: %s", string(entry.Data))
 					// Process normal log entry
+					queueCommittedEntry(entry)
 					committedIndex = entry.Index
 					atomic.StoreInt64(&logEntriesCommitted, int64(entry.Index))
 				}
@@ -2952,34 +6432,31 @@ func processRaftReady() {
 	}
 }
 
-// processRaftTicker handles periodic Raft operations
+// processRaftTicker is the tick scheduler, the only source of Raft time
 func processRaftTicker() {
-	logInfo("processRaftTicker started")
+	logInfo("processRaftTicker started (tick interval %v)", tickInterval)
 
 	for {
 		select {
 		case <-raftCtx.Done():
 			logInfo("processRaftTicker stopping")
 			return
-		case <-raftTicker.C:
-			if raftNode != nil {
-				// Tick the Raft node (this triggers elections, heartbeats, etc.)
-				raftNode.Tick()
-
-				// Check for ready messages - now handled by raftProcessingLoop
-				// Removing direct interaction with raftNode.Ready() from here.
-				/*
-					select {
-					case rd := <-raftNode.Ready():
-							logInfo("ticker received ready message")
-						raftReady <- rd
-					default:
-						// No ready message
-					}
-				*/
-			} else {
+		case now := <-raftTicker.C:
+			if raftNode == nil {
 				logInfo("ticker - raftNode is nil")
+				continue
 			}
+
+			// time.Ticker drops ticks for a slow receiver; account for them
+			// against the monotonic schedule instead of replaying them
+			due := uint64(now.Sub(tickStartTime) / tickInterval)
+			ticksRun++
+			if due > ticksRun {
+				atomic.AddInt64(&ticksMissed, int64(due-ticksRun))
+				ticksRun = due
+			}
+
+			runRaftTick()
 		}
 	}
 }
@@ -3027,34 +6504,56 @@ func sendMessage(msg raftpb.Message) {
 		return
 	}
 
+	if msg.Type == raftpb.MsgHeartbeat && !isQuiesceNotice(msg) {
+		recordHeartbeatSent(msg.To)
+	}
+
+	// Message length first (4 bytes, big-endian), then the message
+	if !writeFrame(msg.To, uint32(len(data)), data) {
+		return
+	}
+
+	atomic.AddInt64(&messagesProcessed, 1)
+	debugLog("Sent message to node %d (type=%s, from=%d, term=%d)", msg.To, msg.Type.String(), msg.From, msg.Term)
+}
+
+// writeFrame writes a length header and payload to a peer's connection,
+// dropping the connection and requesting a reconnect if the write fails
+func writeFrame(nodeID uint64, header uint32, data []byte) bool {
+	connMutex.RLock()
+	managedConn, connExists := connections[nodeID]
+	connMutex.RUnlock()
+
+	if !connExists || managedConn.Conn == nil {
+		reconnectChan <- nodeID
+		return false
+	}
+
 	managedConn.Mutex.Lock() // Protect writes to this specific connection
 	defer managedConn.Mutex.Unlock()
 
-	// Send message length first (4 bytes, big-endian)
-	if err := writeUint32(managedConn.Conn, uint32(len(data))); err != nil {
-		logError("Failed to write message length to node %d (%s): %v", msg.To, address, err)
+	if err := writeUint32(managedConn.Conn, header); err != nil {
+		logError("Failed to write message length to node %d: %v", nodeID, err)
 		managedConn.Conn.Close()
 		connMutex.Lock()
-		delete(connections, msg.To)
+		delete(connections, nodeID)
 		connMutex.Unlock()
-		reconnectChan <- msg.To
-		return
+		reconnectChan <- nodeID
+		return false
 	}
 
-	// Then send the message data
 	if _, err := managedConn.Conn.Write(data); err != nil {
-		logError("Failed to write message data to node %d (%s): %v", msg.To, address, err)
+		logError("Failed to write message data to node %d: %v", nodeID, err)
 		managedConn.Conn.Close()
 		connMutex.Lock()
-		delete(connections, msg.To)
+		delete(connections, nodeID)
 		connMutex.Unlock()
-		reconnectChan <- msg.To
-		return
+		reconnectChan <- nodeID
+		return false
 	}
 
 	managedConn.LastActivity = time.Now()
-	atomic.AddInt64(&messagesProcessed, 1)
-	debugLog("Sent message to node %d (type=%s, from=%d, term=%d)", msg.To, msg.Type.String(), msg.From, msg.Term)
+	return true
 }
 
 // processIncomingMessages processes messages from the message channel
@@ -3156,6 +6655,11 @@ func pgraft_go_trigger_heartbeat() C.int {
 		return -1
 	}
 
+	// A quiesced leader has nothing to heartbeat for
+	if raftQuiescence.isQuiesced() {
+		return 0
+	}
+
 	status := raftNode.Status()
 	if status.RaftState != raft.StateLeader {
 		logInfo("WARNING - Not leader, cannot trigger heartbeat")
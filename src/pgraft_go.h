@@ -27,8 +27,31 @@ extern const char *_GoStringPtr(_GoString_ s);
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
 
-// No external C callbacks - we'll use file-based IPC or shared memory
+// No external C callbacks - we'll use file-based IPC or shared memory,
+// except for the pure functions handed over in the config
+
+// Raft group of a KV key (pgraft_kv_group_for_key)
+typedef int (*pgraft_go_group_for_key_fn) (const char *key);
+
+static inline int
+pgraft_go_call_group_for_key(pgraft_go_group_for_key_fn fn, const char *key)
+{
+	return fn(key);
+}
+
+// Quota check of a client gateway write (pgraft_kv_quota_admit_gateway)
+typedef int (*pgraft_go_quota_admit_fn) (const char *key, int is_delete, int64_t value_size, int64_t old_size);
+
+static inline int
+pgraft_go_call_quota_admit(pgraft_go_quota_admit_fn fn, const char *key, int is_delete, int64_t value_size,
+						   int64_t old_size)
+{
+	return fn(key, is_delete, value_size, old_size);
+}
 
 typedef struct pgraft_go_cluster_member {
 	char   *name;
@@ -36,6 +59,107 @@ typedef struct pgraft_go_cluster_member {
 	int		peer_port;
 } pgraft_go_cluster_member;
 
+// Shared memory proposal ring (pgraft_proposal.c). Backends fill a slot and
+// post wakeup; the proposal goroutine proposes it and posts the slot's done.
+#define PGRAFT_PROPOSAL_SLOTS		64
+#define PGRAFT_PROPOSAL_DATA_SIZE	8192
+
+#define PGRAFT_PROPOSAL_FREE		0
+#define PGRAFT_PROPOSAL_READY		1	// Filled by a backend
+#define PGRAFT_PROPOSAL_TAKEN		2	// Being proposed
+#define PGRAFT_PROPOSAL_DONE		3	// result is set
+#define PGRAFT_PROPOSAL_ABANDONED	4	// Backend gave up waiting
+
+#define PGRAFT_PROPOSAL_OK			0
+#define PGRAFT_PROPOSAL_FAILED		(-1)
+#define PGRAFT_PROPOSAL_STALE		(-2)	// Not leading the group in term
+#define PGRAFT_PROPOSAL_UNKNOWN		(-3)	// Consumer went away mid-proposal
+
+typedef struct pgraft_go_proposal_slot {
+	uint32_t	state;		// pg_atomic_uint32 on the C side
+	int32_t		group;
+	int32_t		term;
+	int32_t		result;
+	int32_t		length;
+	sem_t		done;
+	char		data[PGRAFT_PROPOSAL_DATA_SIZE];
+} pgraft_go_proposal_slot;
+
+typedef struct pgraft_go_proposal_ring {
+	uint32_t	consumer;	// pg_atomic_uint32; 1 while the goroutine runs
+	sem_t		wakeup;
+	pgraft_go_proposal_slot slots[PGRAFT_PROPOSAL_SLOTS];
+} pgraft_go_proposal_ring;
+
+// Wait up to timeout_ms for a backend to post the ring's wakeup
+static inline void
+pgraft_go_proposal_wait(pgraft_go_proposal_ring *ring, int timeout_ms)
+{
+#ifdef __APPLE__
+	usleep(timeout_ms * 1000);		// Never attached: no unnamed semaphores
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	(void) sem_timedwait(&ring->wakeup, &ts);
+#endif
+}
+
+// Wake the backend waiting for a slot
+static inline void
+pgraft_go_proposal_post(pgraft_go_proposal_slot *slot)
+{
+	(void) sem_post(&slot->done);
+}
+
+// One node's row of pgraft_cluster_stats()
+typedef struct pgraft_go_node_stats {
+	int64_t		node_id;
+	int			reachable;
+	int64_t		leader_id;
+	uint64_t	term;
+	uint64_t	commit_index;
+	uint64_t	applied_index;
+	int64_t		apply_lag;
+	int64_t		queue_depth;
+	int64_t		pending_entries;
+	int64_t		disk_bytes;
+	int64_t		rtt_us;
+	int64_t		max_peer_rtt_us;
+	uint64_t	kv_hash;
+	uint64_t	kv_hash_revision;
+} pgraft_go_node_stats;
+
+// A key as the client gateway sees it
+typedef struct pgraft_go_kv {
+	const char *key;
+	const char *value;
+	int64_t		create_revision;
+	int64_t		mod_revision;
+	int64_t		version;
+	int64_t		lease;
+} pgraft_go_kv;
+
+// A read the client gateway hands the worker
+typedef struct pgraft_go_gateway_read {
+	uint64_t	id;
+	int			kind;
+	char	   *key;
+	char	   *range_end;
+	int64_t		limit;
+	int			keys_only;
+	int			count_only;
+	int64_t		lease;
+	int			lease_keys;
+} pgraft_go_gateway_read;
+
 typedef struct pgraft_go_config {
 	int		node_id;
 	char   *cluster_id;
@@ -95,6 +219,14 @@ typedef struct pgraft_go_config {
 	int		max_log_entries;
 	int		batch_size;
 	int		max_batch_delay;
+	int		raft_groups;
+	int		quiesce_timeout;
+	int		tick_interval;
+	int		election_timeout_max;
+	int		client_gateway;
+	int		proposal_timeout;
+	pgraft_go_group_for_key_fn group_for_key;
+	pgraft_go_quota_admit_fn quota_admit;
 } pgraft_go_config;
 
 #line 1 "cgo-generated-wrapper"
@@ -192,17 +324,111 @@ extern int pgraft_go_is_initialized(void);
 extern int pgraft_go_is_leader(void);
 extern int pgraft_go_append_log(char* data, int length);
 extern char* pgraft_go_get_stats(void);
-extern char* pgraft_go_get_logs(void);
+
+// pgraft_go_read_log copies up to maxEntries entries of the group 0 log,
+// starting at fromIndex, into the caller's arrays. Payloads are packed back to
+// back into buf; an entry that no longer fits ends the page, except the first,
+// which is truncated so that every page makes progress. bounds receives the
+// first, last and commit index and the persistence failure count. Returns the
+// number of entries copied, or -1 if Raft is not running.
+//
+extern int pgraft_go_read_log(uint64_t fromIndex, int maxEntries, uint64_t* indexes, uint64_t* terms, int32_t* types, int32_t* sizes, int32_t* offsets, int32_t* lengths, char* buf, int bufSize, uint64_t* bounds);
 extern int pgraft_go_commit_log(long index);
 extern int pgraft_go_step_message(char* data, int length);
 extern char* pgraft_go_get_network_status(void);
 extern void pgraft_go_free_string(char* str);
 
-// Main processing loop following etcd-io/raft patterns
-// pgraft_go_tick is called by the PostgreSQL background worker on each iteration
-// This is a non-blocking function that processes one tick of Raft work
+// pgraft_go_tick reports whether Raft is running. Raft time is advanced only
+// by the Go tick scheduler (processRaftTicker), so calling this never ticks
+// and the worker loop's timing cannot change the tick rate.
 //
 extern int pgraft_go_tick(void);
+
+// pgraft_go_next_committed pops the oldest committed entry not yet handed to
+// the background worker. Returns NULL when there is none; otherwise the caller
+// owns the returned buffer and must release it with pgraft_go_free_string.
+//
+extern char* pgraft_go_next_committed(uint64_t* index, int* length);
+
+// pgraft_go_group_count returns the number of Raft groups including group 0
+//
+extern int pgraft_go_group_count(void);
+
+// pgraft_go_group_append proposes an entry to a group
+//
+extern int pgraft_go_group_append(int group, char* data, int length);
+
+// pgraft_go_group_status reports leader, term, commit index and proposal
+// count of an additional group; returns -1 for group 0 or unknown groups
+//
+extern int pgraft_go_group_status(int group, int64_t* leader, int32_t* term, uint64_t* commit, int64_t* proposals);
+
+// pgraft_go_next_group_committed is pgraft_go_next_committed for any group
+//
+extern char* pgraft_go_next_group_committed(int group, uint64_t* index, int* length);
+
+// pgraft_go_get_peer_latency copies up to maxPeers peers' node id, smoothed RTT
+// and RTT variation (microseconds) and sample count; returns the count
+//
+extern int pgraft_go_get_peer_latency(int64_t* ids, int64_t* srttUs, int64_t* rttvarUs, int64_t* samples, int maxPeers);
+
+// pgraft_go_get_election_timeout returns the election timeout this node
+// currently uses, in milliseconds
+//
+extern int pgraft_go_get_election_timeout(void);
+
+// pgraft_go_is_quiesced reports whether a group has stopped ticking
+//
+extern int pgraft_go_is_quiesced(int group);
+
+// pgraft_go_attach_proposals starts the proposal goroutine on a ring in
+// shared memory, beginning at slot tail; the caller marks the ring as
+// consumed once this returns 0. Attaching again restarts the goroutine.
+//
+extern int pgraft_go_attach_proposals(pgraft_go_proposal_ring* ring, uint64_t tail);
+
+// pgraft_go_set_local_stats publishes the metrics only the background worker
+// knows: the index applied to PostgreSQL, the command queue depth and the
+// root of the KV hash tree with the number of changes it covers
+//
+extern void pgraft_go_set_local_stats(uint64_t appliedIndex, int queueDepth, uint64_t kvHash, uint64_t kvHashRevision);
+
+// pgraft_go_gateway_event hands the gateway a change the worker applied to
+// the store, whichever path it came through; kv's value is NULL for a
+// deletion and prev is NULL if the key did not exist
+//
+extern void pgraft_go_gateway_event(pgraft_go_kv* kv, pgraft_go_kv* prev);
+
+// pgraft_go_gateway_applied tells the gateway the worker applied an entry:
+// the request that proposed it, if any, is answered with the changes
+// published since the previous entry and whether it succeeded
+//
+extern void pgraft_go_gateway_applied(char* clientID, int64_t revision, int succeeded);
+
+// pgraft_go_gateway_next_read hands the worker the next queued read and
+// returns 1, or returns 0 if there is none. The worker releases key and
+// range_end with pgraft_go_free_string.
+//
+extern int pgraft_go_gateway_next_read(pgraft_go_gateway_read* read);
+
+// pgraft_go_gateway_read_row adds one key to the answer of a read
+//
+extern void pgraft_go_gateway_read_row(uint64_t id, pgraft_go_kv* kv);
+
+// pgraft_go_gateway_read_done completes a read: revision is the one the
+// answer reflects, -1 if the read failed, count the keys in range and, for
+// lease reads, leaseTTL the granted TTL (-1 if the lease is not live) and
+// leaseRemaining the seconds left
+//
+extern void pgraft_go_gateway_read_done(uint64_t id, int64_t revision, int64_t count, int64_t leaseTTL, int64_t leaseRemaining);
+
+// pgraft_go_cluster_stats copies up to maxNodes snapshots of the last
+// completed stats round, ordered by node id, sets ageMs to the round's age
+// and returns the count. A round older than maxAgeMs is not served: a new
+// round is started if none is running and -1 is returned, so the caller asks
+// again later.
+//
+extern int pgraft_go_cluster_stats(pgraft_go_node_stats* stats, int maxNodes, int maxAgeMs, int* ageMs);
 extern int pgraft_go_replicate_log_entry(char* data, int dataLen);
 extern char* pgraft_go_get_replication_status(void);
 extern char* pgraft_go_create_snapshot(void);
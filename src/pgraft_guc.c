@@ -70,6 +70,25 @@ char	   *go_library_path = "";
 int			pgraft_max_log_entries = 10000;
 int			pgraft_batch_size = 100;
 int			pgraft_max_batch_delay = 10;
+int			pgraft_proposal_timeout = 5000;
+int			pgraft_seq_lease_size = 1000;
+int			pgraft_raft_groups = 1;
+int			pgraft_quiesce_timeout = 2000;
+int			pgraft_tick_interval = 100;
+int			pgraft_election_timeout_max = 0;
+int			pgraft_max_nodes = 64;
+bool		pgraft_client_gateway = false;
+int			pgraft_cluster_stats_ttl = 1000;
+int			pgraft_kv_read_cache_size = 0;
+int			pgraft_kv_arena_size = 1024;
+int			pgraft_kv_compress_threshold = 256;
+char	   *pgraft_kv_sync_database = NULL;
+int			pgraft_kv_sync_batch_size = 500;
+int			pgraft_kv_sync_interval = 1000;
+int			pgraft_kv_memory_budget = 0;
+int			pgraft_kv_defrag_threshold = 25;
+int			pgraft_kv_defrag_step = 32;
+int			pgraft_kv_namespace_depth = 1;
 
 /*
  * Register GUC variables
@@ -192,7 +211,7 @@ pgraft_register_guc_variables(void)
 							"Time before starting new election if no heartbeat received",
 							&election_timeout,
 							1000,
-							100,
+							10,
 							30000,
 							PGC_SIGHUP,
 							0,
@@ -205,7 +224,7 @@ pgraft_register_guc_variables(void)
 							"Frequency of heartbeat messages from leader",
 							&heartbeat_interval,
 							100,
-							10,
+							1,
 							10000,
 							PGC_SIGHUP,
 							0,
@@ -608,6 +627,249 @@ pgraft_register_guc_variables(void)
 							NULL,
 							NULL);
 
+	DefineCustomIntVariable("pgraft.proposal_timeout",
+							"Maximum time a KV write waits to be proposed, in milliseconds",
+							"Writes fail immediately instead if leadership changes while they wait",
+							&pgraft_proposal_timeout,
+							5000,
+							100,
+							600000,
+							PGC_USERSET,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.seq_lease_size",
+							"Number of sequence values the leader reserves per Raft entry",
+							"Larger ranges mean fewer consensus rounds but bigger gaps after a failover",
+							&pgraft_seq_lease_size,
+							1000,
+							1,
+							INT_MAX,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.raft_groups",
+							"Number of Raft groups the KV keyspace is partitioned across",
+							"Group 0 also carries membership and control state; must match on every node",
+							&pgraft_raft_groups,
+							1,
+							1,
+							16,		/* PGRAFT_MAX_GROUPS */
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.quiesce_timeout",
+							"Idle time after which a Raft group stops ticking and heartbeating",
+							"The group wakes on the next proposal or message; 0 disables quiescence",
+							&pgraft_quiesce_timeout,
+							2000,
+							0,
+							INT_MAX,
+							PGC_POSTMASTER,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.tick_interval",
+							"Length of one Raft tick in milliseconds",
+							"election_timeout and heartbeat_interval are converted to whole ticks of this length",
+							&pgraft_tick_interval,
+							100,
+							1,
+							1000,
+							PGC_POSTMASTER,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.election_timeout_max",
+							"Upper bound for the adaptive election timeout in milliseconds",
+							"Followers stretch election_timeout up to this value when leader heartbeats arrive late or irregularly; 0 keeps it fixed",
+							&pgraft_election_timeout_max,
+							0,
+							0,
+							300000,
+							PGC_POSTMASTER,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.max_nodes",
+							"Maximum number of cluster members, including learners",
+							"Sizes the shared memory membership table at server start",
+							&pgraft_max_nodes,
+							64,
+							1,
+							8192,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("pgraft.client_gateway",
+							"Serve the etcd v3 JSON API on listen_client_urls",
+							"The background worker answers etcd KV, watch and lease requests without a SQL connection",
+							&pgraft_client_gateway,
+							false,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.cluster_stats_ttl",
+							"How long pgraft_cluster_stats() serves a collected round, in milliseconds",
+							"Older rounds are refreshed by asking every peer over the Raft transport",
+							&pgraft_cluster_stats_ttl,
+							1000,
+							0,
+							3600000,
+							PGC_USERSET,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.kv_read_cache_size",
+							"Maximum number of keys each backend caches for pgraft_kv_get()",
+							"Cached reads take no shared lock and are dropped as soon as the store changes; 0 disables the cache",
+							&pgraft_kv_read_cache_size,
+							0,
+							0,
+							1000000,
+							PGC_USERSET,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.kv_arena_size",
+							"Shared memory for KV values",
+							"Values are packed into this arena, compressed ones at their compressed size",
+							&pgraft_kv_arena_size,
+							1024,
+							64,
+							512 * 1024,
+							PGC_POSTMASTER,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.kv_compress_threshold",
+							"Minimum KV value length that is stored and replicated pglz-compressed",
+							"Values are only kept compressed when that makes them smaller; 0 disables compression",
+							&pgraft_kv_compress_threshold,
+							256,
+							0,
+							1024,
+							PGC_SIGHUP,
+							GUC_UNIT_BYTE,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomStringVariable("pgraft.kv_sync_database",
+							   "Database whose pgraft.kv table mirrors the KV store",
+							   "Empty disables the materializer worker",
+							   &pgraft_kv_sync_database,
+							   "",
+							   PGC_POSTMASTER,
+							   0,
+							   NULL,
+							   NULL,
+							   NULL);
+
+	DefineCustomIntVariable("pgraft.kv_sync_batch_size",
+							"Pending KV changes that make the materializer write a batch",
+							"Also the most rows written to pgraft.kv in one transaction",
+							&pgraft_kv_sync_batch_size,
+							500,
+							1,
+							1000,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.kv_sync_interval",
+							"Longest time a KV change waits before it is written to pgraft.kv",
+							NULL,
+							&pgraft_kv_sync_interval,
+							1000,
+							10,
+							3600000,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.kv_memory_budget",
+							"Shared memory KV keys may take before the least recently used are evicted to disk",
+							"Counts entry slots and values; 0 evicts only when the store's slots or arena are full",
+							&pgraft_kv_memory_budget,
+							0,
+							0,
+							512 * 1024,
+							PGC_SIGHUP,
+							GUC_UNIT_KB,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.kv_defrag_threshold",
+							"Percentage of KV arena holes or deleted entries that starts a background defragmentation pass",
+							"0 leaves defragmentation to pgraft_kv_compact() and a full arena",
+							&pgraft_kv_defrag_threshold,
+							25,
+							0,
+							100,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.kv_defrag_step",
+							"Values moved or deleted entries dropped per background defragmentation step",
+							"The worker takes a step every 100ms; each value is moved under its own short hold of the store lock",
+							&pgraft_kv_defrag_step,
+							32,
+							1,
+							1000,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("pgraft.kv_namespace_depth",
+							"Leading key path segments that make up a KV namespace for statistics",
+							"At depth 1 the key \"/orders/eu/42\" is counted under \"/orders/\"",
+							&pgraft_kv_namespace_depth,
+							1,
+							1,
+							16,
+							PGC_POSTMASTER,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
 }
 
 /*
@@ -710,18 +972,32 @@ pgraft_validate_configuration(void)
 	}
 
 	/* Validate consensus settings */
-	if (heartbeat_interval < 10 || heartbeat_interval > 10000)
+	if (heartbeat_interval < 1 || heartbeat_interval > 10000)
 	{
-		elog(ERROR, "pgraft: invalid heartbeat_interval %d, must be between 10 and 10000 ms", 
+		elog(ERROR, "pgraft: invalid heartbeat_interval %d, must be between 1 and 10000 ms", 
 			 heartbeat_interval);
 	}
 
-	if (election_timeout < 100 || election_timeout > 30000)
+	if (election_timeout < 10 || election_timeout > 30000)
 	{
-		elog(ERROR, "pgraft: invalid election_timeout %d, must be between 100 and 30000 ms", 
+		elog(ERROR, "pgraft: invalid election_timeout %d, must be between 10 and 30000 ms", 
 			 election_timeout);
 	}
 
+	if (pgraft_election_timeout_max != 0 && pgraft_election_timeout_max <= election_timeout)
+	{
+		elog(WARNING, "pgraft: election_timeout_max (%d ms) is not above election_timeout (%d ms), election timeout stays fixed",
+			 pgraft_election_timeout_max, election_timeout);
+	}
+
+	/* Timeouts are counted in whole ticks, at least one */
+	if (heartbeat_interval % pgraft_tick_interval != 0 ||
+		election_timeout % pgraft_tick_interval != 0)
+	{
+		elog(WARNING, "pgraft: election_timeout (%d ms) and heartbeat_interval (%d ms) are rounded to multiples of tick_interval (%d ms)",
+			 election_timeout, heartbeat_interval, pgraft_tick_interval);
+	}
+
 	/* Election timeout should be at least 5x heartbeat interval */
 	if (election_timeout < (heartbeat_interval * 5))
 	{
@@ -6,16 +6,19 @@
 
 #include "postgres.h"
 #include <json-c/json.h>
+#include "common/base64.h"
+#include "common/pg_lzcompress.h"
 #include "utils/timestamp.h"
 
 #include "../include/pgraft_core.h"
 #include "../include/pgraft_apply.h"
 #include "../include/pgraft_kv.h"
 #include "../include/pgraft_json.h"
+#include "../include/pgraft_guc.h"
 
 /*
  * Parse nodes JSON from Go layer
- * Returns number of nodes parsed, -1 on error
+ * Addresses are palloc'd; returns number of nodes parsed, -1 on error
  */
 int
 pgraft_parse_nodes_json(const char *nodes_json, int32_t *node_ids, char **addresses, int max_nodes)
@@ -65,8 +68,7 @@ pgraft_parse_nodes_json(const char *nodes_json, int32_t *node_ids, char **addres
 			if (address && node_id > 0)
 			{
 				node_ids[node_count] = (int32_t)node_id;
-				strncpy(addresses[node_count], address, 255);
-				addresses[node_count][255] = '\0';
+				addresses[node_count] = pstrdup(address);
 				node_count++;
 			}
 		}
@@ -76,6 +78,63 @@ pgraft_parse_nodes_json(const char *nodes_json, int32_t *node_ids, char **addres
 	return node_count;
 }
 
+/*
+ * Parse the "nodes" array of the cluster state file
+ * Returns number of members filled in, -1 if the file is not valid JSON
+ */
+int
+pgraft_json_parse_members(const char *state_json, pgraft_member_t *members, int max_members)
+{
+	struct json_object *root;
+	struct json_object *nodes;
+	int member_count = 0;
+	int array_len;
+	int i;
+	
+	root = json_tokener_parse(state_json);
+	if (!root || !json_object_is_type(root, json_type_object))
+	{
+		if (root) json_object_put(root);
+		return -1;
+	}
+	
+	/* The file has no nodes list until the worker has seen the membership */
+	if (!json_object_object_get_ex(root, "nodes", &nodes) ||
+		!json_object_is_type(nodes, json_type_array))
+	{
+		json_object_put(root);
+		return 0;
+	}
+	
+	array_len = json_object_array_length(nodes);
+	for (i = 0; i < array_len && member_count < max_members; i++)
+	{
+		struct json_object *node_obj;
+		struct json_object *field;
+		pgraft_member_t *member = &members[member_count];
+		
+		node_obj = json_object_array_get_idx(nodes, i);
+		if (!node_obj || !json_object_is_type(node_obj, json_type_object))
+			continue;
+		if (!json_object_object_get_ex(node_obj, "id", &field) ||
+			!json_object_is_type(field, json_type_int))
+			continue;
+		
+		memset(member, 0, sizeof(pgraft_member_t));
+		member->id = json_object_get_int64(field);
+		if (json_object_object_get_ex(node_obj, "name", &field))
+			strlcpy(member->name, json_object_get_string(field), sizeof(member->name));
+		if (json_object_object_get_ex(node_obj, "address", &field))
+			strlcpy(member->address, json_object_get_string(field), sizeof(member->address));
+		if (json_object_object_get_ex(node_obj, "active", &field))
+			member->active = json_object_get_boolean(field);
+		member_count++;
+	}
+	
+	json_object_put(root);
+	return member_count;
+}
+
 /*
  * Parse KV JSON entry from Raft log
  * Returns parsed entry or NULL on error
@@ -207,6 +266,89 @@ pgraft_parse_kv_json_entry(const char *data, size_t len)
 	return entry;
 }
 
+/*
+ * Add a PUT value to an entry, as "value_pglz" when that is smaller
+ *
+ * Values of at least pgraft.kv_compress_threshold bytes are pglz-compressed
+ * and base64-encoded together with their "value_len"; when that does not
+ * beat the plain text the value is sent as "value".
+ */
+static void
+pgraft_json_add_kv_value(json_object *json_obj, const char *value)
+{
+	int			raw_len = strlen(value);
+	
+	if (pgraft_kv_compress_threshold > 0 && raw_len >= pgraft_kv_compress_threshold)
+	{
+		char	   *compressed = palloc(PGLZ_MAX_OUTPUT(raw_len));
+		int32		compressed_len;
+		
+		compressed_len = pglz_compress(value, raw_len, compressed, PGLZ_strategy_default);
+		if (compressed_len >= 0 && pg_b64_enc_len(compressed_len) < raw_len)
+		{
+			char	   *encoded = palloc(pg_b64_enc_len(compressed_len) + 1);
+			int			encoded_len;
+			
+			encoded_len = pg_b64_encode(compressed, compressed_len, encoded, pg_b64_enc_len(compressed_len));
+			if (encoded_len >= 0)
+			{
+				encoded[encoded_len] = '\0';
+				json_object_object_add(json_obj, "value_pglz", json_object_new_string(encoded));
+				json_object_object_add(json_obj, "value_len", json_object_new_int(raw_len));
+				pfree(encoded);
+				pfree(compressed);
+				return;
+			}
+			pfree(encoded);
+		}
+		pfree(compressed);
+	}
+	
+	json_object_object_add(json_obj, "value", json_object_new_string(value));
+}
+
+/*
+ * Read a PUT value written by pgraft_json_add_kv_value(), or NULL
+ */
+static char *
+pgraft_json_get_kv_value(json_object *json_obj)
+{
+	json_object *value_obj;
+	json_object *len_obj;
+	const char *encoded;
+	char	   *compressed;
+	char	   *value;
+	int			compressed_len;
+	int			raw_len;
+	
+	if (json_object_object_get_ex(json_obj, "value", &value_obj))
+		return pstrdup(json_object_get_string(value_obj));
+	
+	if (!json_object_object_get_ex(json_obj, "value_pglz", &value_obj) ||
+		!json_object_object_get_ex(json_obj, "value_len", &len_obj))
+		return NULL;
+	
+	encoded = json_object_get_string(value_obj);
+	raw_len = json_object_get_int(len_obj);
+	if (raw_len < 0 || raw_len >= PGRAFT_KV_VALUE_SIZE)
+		return NULL;
+	
+	compressed = palloc(pg_b64_dec_len(strlen(encoded)));
+	compressed_len = pg_b64_decode(encoded, strlen(encoded), compressed, pg_b64_dec_len(strlen(encoded)));
+	value = palloc(raw_len + 1);
+	if (compressed_len < 0 ||
+		pglz_decompress(compressed, compressed_len, value, raw_len, true) != raw_len)
+	{
+		pfree(compressed);
+		pfree(value);
+		return NULL;
+	}
+	value[raw_len] = '\0';
+	pfree(compressed);
+	
+	return value;
+}
+
 /*
  * Create KV operation JSON using json-c library
  */
@@ -216,7 +358,6 @@ pgraft_json_create_kv_operation(pgraft_kv_op_type_t op_type, const char *key, co
 	json_object *json_obj;
 	json_object *type_obj;
 	json_object *key_obj;
-	json_object *value_obj;
 	json_object *timestamp_obj;
 	json_object *client_id_obj;
 	const char *json_string;
@@ -248,8 +389,7 @@ pgraft_json_create_kv_operation(pgraft_kv_op_type_t op_type, const char *key, co
 	
 	/* Set value (only for PUT operations) */
 	if (op_type == PGRAFT_KV_PUT && value) {
-		value_obj = json_object_new_string(value);
-		json_object_object_add(json_obj, "value", value_obj);
+		pgraft_json_add_kv_value(json_obj, value);
 	}
 	
 	/* Set timestamp */
@@ -286,6 +426,53 @@ pgraft_json_create_kv_operation(pgraft_kv_op_type_t op_type, const char *key, co
 	return 0;
 }
 
+/*
+ * Create KV merge patch JSON using json-c library
+ *
+ * The patch travels as canonical jsonb text; every node merges it into its
+ * own copy of the value when the entry is applied.
+ */
+int
+pgraft_json_create_kv_patch(const char *key, const char *patch, int64_t expected_version, const char *client_id, char *json_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	const char *json_string;
+	size_t json_len;
+	
+	json_obj = json_object_new_object();
+	if (!json_obj) {
+		elog(ERROR, "pgraft_json: failed to create JSON object");
+		return -1;
+	}
+	
+	json_object_object_add(json_obj, "type", json_object_new_string("kv_patch"));
+	json_object_object_add(json_obj, "key", json_object_new_string(key));
+	json_object_object_add(json_obj, "patch", json_object_new_string(patch));
+	if (expected_version >= 0)
+		json_object_object_add(json_obj, "expected_version", json_object_new_int64(expected_version));
+	json_object_object_add(json_obj, "timestamp", json_object_new_int64(GetCurrentTimestamp()));
+	json_object_object_add(json_obj, "client_id", json_object_new_string(client_id));
+	
+	json_string = json_object_to_json_string(json_obj);
+	if (!json_string) {
+		elog(ERROR, "pgraft_json: failed to convert JSON to string");
+		json_object_put(json_obj);
+		return -1;
+	}
+	
+	json_len = strlen(json_string);
+	if (json_len >= buffer_size) {
+		elog(ERROR, "pgraft_json: KV patch JSON string too long for buffer (len=%zu, max=%zu)", json_len, buffer_size - 1);
+		json_object_put(json_obj);
+		return -1;
+	}
+	strlcpy(json_buffer, json_string, buffer_size);
+	
+	json_object_put(json_obj);
+	
+	return 0;
+}
+
 /*
  * Parse KV operation from JSON using json-c library
  */
@@ -298,7 +485,6 @@ pgraft_json_parse_kv_operation(const char *json_data, size_t len, int *op_type,
 	json_object *value_obj;
 	const char *type_str;
 	const char *key_str;
-	const char *value_str;
 	
 	/* Parse JSON */
 	json_obj = json_tokener_parse(json_data);
@@ -327,17 +513,26 @@ pgraft_json_parse_kv_operation(const char *json_data, size_t len, int *op_type,
 	if (strcmp(type_str, "kv_put") == 0) {
 		*op_type = PGRAFT_KV_PUT;
 		
-		/* Extract value for PUT operations */
-		if (!json_object_object_get_ex(json_obj, "value", &value_obj)) {
-			elog(ERROR, "pgraft_json: missing 'value' field in PUT operation");
+		/* Extract value for PUT operations, decompressing it if needed */
+		*value = pgraft_json_get_kv_value(json_obj);
+		if (*value == NULL) {
+			elog(ERROR, "pgraft_json: missing or corrupt value in PUT operation");
 			json_object_put(json_obj);
 			return -1;
 		}
-		value_str = json_object_get_string(value_obj);
-		*value = pstrdup(value_str);
 	} else if (strcmp(type_str, "kv_delete") == 0) {
 		*op_type = PGRAFT_KV_DELETE;
 		*value = NULL; /* DELETE operations don't have values */
+	} else if (strcmp(type_str, "kv_patch") == 0) {
+		*op_type = PGRAFT_KV_PATCH;
+		
+		/* The patch takes the place of the value */
+		if (!json_object_object_get_ex(json_obj, "patch", &value_obj)) {
+			elog(ERROR, "pgraft_json: missing 'patch' field in PATCH operation");
+			json_object_put(json_obj);
+			return -1;
+		}
+		*value = pstrdup(json_object_get_string(value_obj));
 	} else {
 		elog(ERROR, "pgraft_json: unknown operation type: %s", type_str);
 		json_object_put(json_obj);
@@ -353,6 +548,28 @@ pgraft_json_parse_kv_operation(const char *json_data, size_t len, int *op_type,
 	return 0;
 }
 
+/*
+ * Extract the "expected_version" of a KV patch entry
+ */
+int64_t
+pgraft_json_get_expected_version(const char *json_data, size_t len)
+{
+	json_object *json_obj;
+	json_object *expected_obj;
+	int64_t expected = -1;
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj)
+		return -1;
+	
+	if (json_object_object_get_ex(json_obj, "expected_version", &expected_obj))
+		expected = json_object_get_int64(expected_obj);
+	
+	json_object_put(json_obj);
+	
+	return expected;
+}
+
 /*
  * Create KV stats JSON using json-c library
  */
@@ -464,6 +681,898 @@ pgraft_json_create_key_list(pgraft_kv_store_t *store, char *json_buffer, size_t
 	return 0;
 }
 
+/*
+ * Extract the "type" field of a replicated JSON entry
+ * Returns 0 on success, -1 if the entry is not JSON or has no type
+ */
+int
+pgraft_json_get_type(const char *json_data, size_t len, char *type_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	json_object *type_obj;
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj)
+		return -1;
+	
+	if (!json_object_object_get_ex(json_obj, "type", &type_obj)) {
+		json_object_put(json_obj);
+		return -1;
+	}
+	strlcpy(type_buffer, json_object_get_string(type_obj), buffer_size);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Extract the operation and the key or name it targets from a log payload
+ * The payload need not be NUL-terminated.  Either output is left empty if
+ * the field is missing; returns -1 if the payload is not a JSON object.
+ */
+int
+pgraft_json_describe_entry(const char *data, size_t len, char *op, size_t op_size,
+						   char *key, size_t key_size)
+{
+	struct json_tokener *tok;
+	json_object *json_obj;
+	json_object *field;
+	
+	op[0] = '\0';
+	key[0] = '\0';
+	
+	tok = json_tokener_new();
+	if (!tok)
+		return -1;
+	json_obj = json_tokener_parse_ex(tok, data, (int) len);
+	json_tokener_free(tok);
+	
+	if (!json_obj || !json_object_is_type(json_obj, json_type_object)) {
+		if (json_obj)
+			json_object_put(json_obj);
+		return -1;
+	}
+	
+	if (json_object_object_get_ex(json_obj, "type", &field))
+		strlcpy(op, json_object_get_string(field), op_size);
+	
+	/* KV entries carry a key, sequences, locks and counters a name, quotas a prefix */
+	if (json_object_object_get_ex(json_obj, "key", &field) ||
+		json_object_object_get_ex(json_obj, "name", &field) ||
+		json_object_object_get_ex(json_obj, "prefix", &field))
+		strlcpy(key, json_object_get_string(field), key_size);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Create sequence operation JSON using json-c library
+ * Format: {"type": "seq_lease", "name": "orders", "start": 1, "end": 1001, "term": 3, "node_id": 1}
+ */
+int
+pgraft_json_create_seq_operation(const pgraft_seq_op_t *op, char *json_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	const char *json_string;
+	
+	json_obj = json_object_new_object();
+	if (!json_obj) {
+		elog(ERROR, "pgraft_json: failed to create JSON object");
+		return -1;
+	}
+	
+	if (op->op_type == PGRAFT_SEQ_CREATE) {
+		json_object_object_add(json_obj, "type", json_object_new_string("seq_create"));
+	} else if (op->op_type == PGRAFT_SEQ_LEASE) {
+		json_object_object_add(json_obj, "type", json_object_new_string("seq_lease"));
+	} else {
+		elog(ERROR, "pgraft_json: unknown sequence operation type: %d", op->op_type);
+		json_object_put(json_obj);
+		return -1;
+	}
+	json_object_object_add(json_obj, "name", json_object_new_string(op->name));
+	json_object_object_add(json_obj, "start", json_object_new_int64(op->start));
+	json_object_object_add(json_obj, "end", json_object_new_int64(op->end));
+	json_object_object_add(json_obj, "term", json_object_new_int(op->term));
+	json_object_object_add(json_obj, "node_id", json_object_new_int(op->node_id));
+	
+	json_string = json_object_to_json_string(json_obj);
+	if (!json_string || strlen(json_string) >= buffer_size) {
+		elog(ERROR, "pgraft_json: sequence operation JSON too long for buffer");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strcpy(json_buffer, json_string);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Parse sequence operation from JSON using json-c library
+ */
+int
+pgraft_json_parse_seq_operation(const char *json_data, size_t len, pgraft_seq_op_t *op)
+{
+	json_object *json_obj;
+	json_object *field_obj;
+	const char *type_str;
+	
+	memset(op, 0, sizeof(*op));
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj) {
+		elog(WARNING, "pgraft_json: failed to parse sequence operation JSON");
+		return -1;
+	}
+	
+	if (!json_object_object_get_ex(json_obj, "type", &field_obj)) {
+		elog(WARNING, "pgraft_json: missing 'type' field in sequence operation");
+		json_object_put(json_obj);
+		return -1;
+	}
+	type_str = json_object_get_string(field_obj);
+	if (strcmp(type_str, "seq_create") == 0) {
+		op->op_type = PGRAFT_SEQ_CREATE;
+	} else if (strcmp(type_str, "seq_lease") == 0) {
+		op->op_type = PGRAFT_SEQ_LEASE;
+	} else {
+		elog(WARNING, "pgraft_json: unknown sequence operation type: %s", type_str);
+		json_object_put(json_obj);
+		return -1;
+	}
+	
+	if (!json_object_object_get_ex(json_obj, "name", &field_obj)) {
+		elog(WARNING, "pgraft_json: missing 'name' field in sequence operation");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strlcpy(op->name, json_object_get_string(field_obj), sizeof(op->name));
+	
+	if (json_object_object_get_ex(json_obj, "start", &field_obj))
+		op->start = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "end", &field_obj))
+		op->end = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "term", &field_obj))
+		op->term = json_object_get_int(field_obj);
+	if (json_object_object_get_ex(json_obj, "node_id", &field_obj))
+		op->node_id = json_object_get_int(field_obj);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/* Lock operation type names as they appear in the Raft log */
+static const char *const pgraft_lock_op_names[] = {
+	NULL, "lock_acquire", "lock_release", "lock_expire", "lock_cancel", "lock_renew"
+};
+
+/*
+ * Create lock operation JSON using json-c library
+ * Format: {"type": "lock_acquire", "name": "jobs", "node_id": 1, "pid": 4242, "procno": 17,
+ *          "ttl": 30000, "revision": 0, "now": 770000000000000, "value": ""}
+ */
+int
+pgraft_json_create_lock_operation(const pgraft_lock_op_t *op, char *json_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	const char *json_string;
+	
+	if (op->op_type < PGRAFT_LOCK_ACQUIRE || op->op_type > PGRAFT_LOCK_CANCEL) {
+		elog(ERROR, "pgraft_json: unknown lock operation type: %d", op->op_type);
+		return -1;
+	}
+	
+	json_obj = json_object_new_object();
+	if (!json_obj) {
+		elog(ERROR, "pgraft_json: failed to create JSON object");
+		return -1;
+	}
+	
+	json_object_object_add(json_obj, "type", json_object_new_string(pgraft_lock_op_names[op->op_type]));
+	json_object_object_add(json_obj, "name", json_object_new_string(op->name));
+	json_object_object_add(json_obj, "node_id", json_object_new_int(op->node_id));
+	json_object_object_add(json_obj, "pid", json_object_new_int(op->pid));
+	json_object_object_add(json_obj, "procno", json_object_new_int(op->procno));
+	json_object_object_add(json_obj, "ttl", json_object_new_int(op->ttl_ms));
+	json_object_object_add(json_obj, "revision", json_object_new_int64(op->revision));
+	json_object_object_add(json_obj, "now", json_object_new_int64(op->now));
+	json_object_object_add(json_obj, "value", json_object_new_string(op->value));
+	
+	json_string = json_object_to_json_string(json_obj);
+	if (!json_string || strlen(json_string) >= buffer_size) {
+		elog(ERROR, "pgraft_json: lock operation JSON too long for buffer");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strcpy(json_buffer, json_string);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Parse lock operation from JSON using json-c library
+ */
+int
+pgraft_json_parse_lock_operation(const char *json_data, size_t len, pgraft_lock_op_t *op)
+{
+	json_object *json_obj;
+	json_object *field_obj;
+	const char *type_str;
+	int			i;
+	
+	memset(op, 0, sizeof(*op));
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj) {
+		elog(WARNING, "pgraft_json: failed to parse lock operation JSON");
+		return -1;
+	}
+	
+	if (!json_object_object_get_ex(json_obj, "type", &field_obj)) {
+		elog(WARNING, "pgraft_json: missing 'type' field in lock operation");
+		json_object_put(json_obj);
+		return -1;
+	}
+	type_str = json_object_get_string(field_obj);
+	for (i = PGRAFT_LOCK_ACQUIRE; i <= PGRAFT_LOCK_RENEW; i++) {
+		if (strcmp(type_str, pgraft_lock_op_names[i]) == 0)
+			op->op_type = (pgraft_lock_op_type_t) i;
+	}
+	if (op->op_type == 0) {
+		elog(WARNING, "pgraft_json: unknown lock operation type: %s", type_str);
+		json_object_put(json_obj);
+		return -1;
+	}
+	
+	if (!json_object_object_get_ex(json_obj, "name", &field_obj)) {
+		elog(WARNING, "pgraft_json: missing 'name' field in lock operation");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strlcpy(op->name, json_object_get_string(field_obj), sizeof(op->name));
+	
+	if (json_object_object_get_ex(json_obj, "node_id", &field_obj))
+		op->node_id = json_object_get_int(field_obj);
+	if (json_object_object_get_ex(json_obj, "pid", &field_obj))
+		op->pid = json_object_get_int(field_obj);
+	if (json_object_object_get_ex(json_obj, "procno", &field_obj))
+		op->procno = json_object_get_int(field_obj);
+	if (json_object_object_get_ex(json_obj, "ttl", &field_obj))
+		op->ttl_ms = json_object_get_int(field_obj);
+	if (json_object_object_get_ex(json_obj, "revision", &field_obj))
+		op->revision = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "now", &field_obj))
+		op->now = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "value", &field_obj))
+		strlcpy(op->value, json_object_get_string(field_obj), sizeof(op->value));
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Create counter operation JSON using json-c library
+ * Format: {"type": "counter_add", "name": "api-calls", "delta": 42, "batch": 7, "term": 3, "node_id": 1}
+ */
+int
+pgraft_json_create_counter_operation(const pgraft_counter_op_t *op, char *json_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	const char *json_string;
+	
+	json_obj = json_object_new_object();
+	if (!json_obj) {
+		elog(ERROR, "pgraft_json: failed to create JSON object");
+		return -1;
+	}
+	
+	json_object_object_add(json_obj, "type", json_object_new_string("counter_add"));
+	json_object_object_add(json_obj, "name", json_object_new_string(op->name));
+	json_object_object_add(json_obj, "delta", json_object_new_int64(op->delta));
+	json_object_object_add(json_obj, "batch", json_object_new_int64((int64_t) op->batch));
+	json_object_object_add(json_obj, "term", json_object_new_int(op->term));
+	json_object_object_add(json_obj, "node_id", json_object_new_int(op->node_id));
+	
+	json_string = json_object_to_json_string(json_obj);
+	if (!json_string || strlen(json_string) >= buffer_size) {
+		elog(ERROR, "pgraft_json: counter operation JSON too long for buffer");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strcpy(json_buffer, json_string);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Parse counter operation from JSON using json-c library
+ */
+int
+pgraft_json_parse_counter_operation(const char *json_data, size_t len, pgraft_counter_op_t *op)
+{
+	json_object *json_obj;
+	json_object *field_obj;
+	
+	memset(op, 0, sizeof(*op));
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj) {
+		elog(WARNING, "pgraft_json: failed to parse counter operation JSON");
+		return -1;
+	}
+	
+	if (!json_object_object_get_ex(json_obj, "name", &field_obj) ||
+		!json_object_object_get_ex(json_obj, "delta", NULL)) {
+		elog(WARNING, "pgraft_json: missing 'name' or 'delta' field in counter operation");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strlcpy(op->name, json_object_get_string(field_obj), sizeof(op->name));
+	
+	if (json_object_object_get_ex(json_obj, "delta", &field_obj))
+		op->delta = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "batch", &field_obj))
+		op->batch = (uint64) json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "term", &field_obj))
+		op->term = json_object_get_int(field_obj);
+	if (json_object_object_get_ex(json_obj, "node_id", &field_obj))
+		op->node_id = json_object_get_int(field_obj);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Create KV quota operation JSON using json-c library
+ * Format: {"type": "quota_set", "prefix": "/team-a/", "max_keys": 1000, "max_bytes": 65536,
+ *          "max_write_rate": 100, "request": 7, "term": 3, "node_id": 1}
+ */
+int
+pgraft_json_create_kv_quota_operation(const pgraft_kv_quota_op_t *op, char *json_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	const char *json_string;
+	
+	json_obj = json_object_new_object();
+	if (!json_obj) {
+		elog(ERROR, "pgraft_json: failed to create JSON object");
+		return -1;
+	}
+	
+	json_object_object_add(json_obj, "type", json_object_new_string(op->drop ? "quota_drop" : "quota_set"));
+	json_object_object_add(json_obj, "prefix", json_object_new_string(op->prefix));
+	if (!op->drop) {
+		json_object_object_add(json_obj, "max_keys", json_object_new_int64(op->max_keys));
+		json_object_object_add(json_obj, "max_bytes", json_object_new_int64(op->max_bytes));
+		json_object_object_add(json_obj, "max_write_rate", json_object_new_int(op->max_write_rate));
+	}
+	json_object_object_add(json_obj, "request", json_object_new_int64((int64_t) op->request));
+	json_object_object_add(json_obj, "term", json_object_new_int(op->term));
+	json_object_object_add(json_obj, "node_id", json_object_new_int(op->node_id));
+	
+	json_string = json_object_to_json_string(json_obj);
+	if (!json_string || strlen(json_string) >= buffer_size) {
+		elog(ERROR, "pgraft_json: quota operation JSON too long for buffer");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strcpy(json_buffer, json_string);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Parse KV quota operation from JSON using json-c library
+ */
+int
+pgraft_json_parse_kv_quota_operation(const char *json_data, size_t len, pgraft_kv_quota_op_t *op)
+{
+	json_object *json_obj;
+	json_object *field_obj;
+	
+	memset(op, 0, sizeof(*op));
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj) {
+		elog(WARNING, "pgraft_json: failed to parse quota operation JSON");
+		return -1;
+	}
+	
+	if (!json_object_object_get_ex(json_obj, "type", &field_obj)) {
+		elog(WARNING, "pgraft_json: missing 'type' field in quota operation");
+		json_object_put(json_obj);
+		return -1;
+	}
+	op->drop = (strcmp(json_object_get_string(field_obj), "quota_drop") == 0);
+	
+	if (!json_object_object_get_ex(json_obj, "prefix", &field_obj)) {
+		elog(WARNING, "pgraft_json: missing 'prefix' field in quota operation");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strlcpy(op->prefix, json_object_get_string(field_obj), sizeof(op->prefix));
+	
+	if (json_object_object_get_ex(json_obj, "max_keys", &field_obj))
+		op->max_keys = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "max_bytes", &field_obj))
+		op->max_bytes = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "max_write_rate", &field_obj))
+		op->max_write_rate = json_object_get_int(field_obj);
+	if (json_object_object_get_ex(json_obj, "request", &field_obj))
+		op->request = (uint64) json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "term", &field_obj))
+		op->term = json_object_get_int(field_obj);
+	if (json_object_object_get_ex(json_obj, "node_id", &field_obj))
+		op->node_id = json_object_get_int(field_obj);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Create KV batch JSON using json-c library
+ * Format: {"type": "kv_batch", "items": [{"key": "a", "value": "1"}, {"key": "b", "deleted": true}],
+ *          "timestamp": 123, "client_id": "pg_123"}
+ */
+int
+pgraft_json_create_kv_batch(const pgraft_kv_batch_item_t *items, int count, const char *client_id, char *json_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	json_object *items_obj;
+	const char *json_string;
+	int i;
+	
+	json_obj = json_object_new_object();
+	items_obj = json_object_new_array();
+	if (!json_obj || !items_obj) {
+		elog(ERROR, "pgraft_json: failed to create JSON object");
+		return -1;
+	}
+	
+	for (i = 0; i < count; i++) {
+		json_object *item_obj = json_object_new_object();
+		
+		json_object_object_add(item_obj, "key", json_object_new_string(items[i].key));
+		if (items[i].value)
+			json_object_object_add(item_obj, "value", json_object_new_string(items[i].value));
+		else
+			json_object_object_add(item_obj, "deleted", json_object_new_boolean(1));
+		json_object_array_add(items_obj, item_obj);
+	}
+	
+	json_object_object_add(json_obj, "type", json_object_new_string("kv_batch"));
+	json_object_object_add(json_obj, "items", items_obj);
+	json_object_object_add(json_obj, "timestamp", json_object_new_int64(GetCurrentTimestamp()));
+	json_object_object_add(json_obj, "client_id", json_object_new_string(client_id));
+	
+	json_string = json_object_to_json_string_ext(json_obj, JSON_C_TO_STRING_PLAIN);
+	if (!json_string || strlen(json_string) >= buffer_size) {
+		elog(ERROR, "pgraft_json: KV batch JSON too long for buffer (%d keys, max=%zu)", count, buffer_size - 1);
+		json_object_put(json_obj);
+		return -1;
+	}
+	strcpy(json_buffer, json_string);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Parse KV batch from JSON using json-c library
+ */
+int
+pgraft_json_parse_kv_batch(const char *json_data, size_t len, pgraft_kv_batch_item_t **items, int *count)
+{
+	json_object *json_obj;
+	json_object *items_obj;
+	json_object *field_obj;
+	int num_items;
+	int i;
+	
+	*items = NULL;
+	*count = 0;
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj) {
+		elog(WARNING, "pgraft_json: failed to parse KV batch JSON");
+		return -1;
+	}
+	
+	if (!json_object_object_get_ex(json_obj, "items", &items_obj) ||
+		!json_object_is_type(items_obj, json_type_array)) {
+		elog(WARNING, "pgraft_json: missing 'items' array in KV batch");
+		json_object_put(json_obj);
+		return -1;
+	}
+	
+	num_items = (int) json_object_array_length(items_obj);
+	*items = (pgraft_kv_batch_item_t *) palloc0(sizeof(pgraft_kv_batch_item_t) * Max(num_items, 1));
+	
+	for (i = 0; i < num_items; i++) {
+		json_object *item_obj = json_object_array_get_idx(items_obj, i);
+		
+		if (!json_object_object_get_ex(item_obj, "key", &field_obj)) {
+			elog(WARNING, "pgraft_json: missing 'key' field in KV batch item %d", i);
+			json_object_put(json_obj);
+			return -1;
+		}
+		(*items)[i].key = pstrdup(json_object_get_string(field_obj));
+		
+		if (json_object_object_get_ex(item_obj, "deleted", &field_obj) &&
+			json_object_get_boolean(field_obj))
+			(*items)[i].value = NULL;
+		else if (json_object_object_get_ex(item_obj, "value", &field_obj))
+			(*items)[i].value = pstrdup(json_object_get_string(field_obj));
+		else
+			(*items)[i].value = pstrdup("");
+	}
+	*count = num_items;
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Extract an integer field of a replicated JSON entry, default_value when
+ * the entry has no such field
+ */
+int64_t
+pgraft_json_get_int64(const char *json_data, size_t len, const char *field, int64_t default_value)
+{
+	json_object *json_obj;
+	json_object *field_obj;
+	int64_t value = default_value;
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj)
+		return default_value;
+	
+	if (json_object_object_get_ex(json_obj, field, &field_obj))
+		value = json_object_get_int64(field_obj);
+	
+	json_object_put(json_obj);
+	return value;
+}
+
+/*
+ * Extract a string field of a replicated JSON entry
+ * Returns 0 on success, -1 if the entry is not JSON or has no such field
+ */
+int
+pgraft_json_get_string(const char *json_data, size_t len, const char *field, char *buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	json_object *field_obj;
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj)
+		return -1;
+	
+	if (!json_object_object_get_ex(json_obj, field, &field_obj)) {
+		json_object_put(json_obj);
+		return -1;
+	}
+	strlcpy(buffer, json_object_get_string(field_obj), buffer_size);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/* Names of Txn compare targets and results in kv_txn entries, as etcd spells them */
+static const char *const pgraft_kv_compare_target_names[] = {"VERSION", "CREATE", "MOD", "VALUE", "LEASE"};
+static const char *const pgraft_kv_compare_result_names[] = {"EQUAL", "GREATER", "LESS", "NOT_EQUAL"};
+
+/*
+ * Add one branch of a Txn to a kv_txn entry
+ */
+static json_object *
+pgraft_json_create_kv_txn_ops(const pgraft_kv_txn_op_t *ops, int count)
+{
+	json_object *ops_obj = json_object_new_array();
+	int i;
+	
+	for (i = 0; i < count; i++) {
+		json_object *op_obj = json_object_new_object();
+		
+		json_object_object_add(op_obj, "op", json_object_new_string(ops[i].is_delete ? "delete" : "put"));
+		json_object_object_add(op_obj, "key", json_object_new_string(ops[i].key));
+		if (ops[i].is_delete) {
+			if (ops[i].range_end)
+				json_object_object_add(op_obj, "range_end", json_object_new_string(ops[i].range_end));
+		} else {
+			json_object_object_add(op_obj, "value", json_object_new_string(ops[i].value));
+			if (ops[i].lease != 0)
+				json_object_object_add(op_obj, "lease", json_object_new_int64(ops[i].lease));
+		}
+		json_object_array_add(ops_obj, op_obj);
+	}
+	
+	return ops_obj;
+}
+
+/*
+ * Create KV Txn JSON using json-c library
+ * Format: {"type": "kv_txn", "group": 0,
+ *          "compare": [{"key": "a", "target": "MOD", "result": "EQUAL", "number": 7}],
+ *          "success": [{"op": "put", "key": "a", "value": "1", "lease": 5}],
+ *          "failure": [{"op": "delete", "key": "b", "range_end": "c"}],
+ *          "timestamp": 123, "client_id": "pg_123"}
+ */
+int
+pgraft_json_create_kv_txn(const pgraft_kv_txn_t *txn, const char *client_id, char *json_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	json_object *compares_obj;
+	const char *json_string;
+	int i;
+	
+	json_obj = json_object_new_object();
+	compares_obj = json_object_new_array();
+	if (!json_obj || !compares_obj) {
+		elog(ERROR, "pgraft_json: failed to create JSON object");
+		return -1;
+	}
+	
+	for (i = 0; i < txn->num_compares; i++) {
+		const pgraft_kv_compare_t *compare = &txn->compares[i];
+		json_object *compare_obj = json_object_new_object();
+		
+		json_object_object_add(compare_obj, "key", json_object_new_string(compare->key));
+		json_object_object_add(compare_obj, "target",
+							   json_object_new_string(pgraft_kv_compare_target_names[compare->target]));
+		json_object_object_add(compare_obj, "result",
+							   json_object_new_string(pgraft_kv_compare_result_names[compare->result]));
+		if (compare->target == PGRAFT_KV_COMPARE_VALUE)
+			json_object_object_add(compare_obj, "value", json_object_new_string(compare->value));
+		else
+			json_object_object_add(compare_obj, "number", json_object_new_int64(compare->number));
+		json_object_array_add(compares_obj, compare_obj);
+	}
+	
+	json_object_object_add(json_obj, "type", json_object_new_string("kv_txn"));
+	json_object_object_add(json_obj, "group", json_object_new_int(txn->group));
+	json_object_object_add(json_obj, "compare", compares_obj);
+	json_object_object_add(json_obj, "success", pgraft_json_create_kv_txn_ops(txn->success, txn->num_success));
+	json_object_object_add(json_obj, "failure", pgraft_json_create_kv_txn_ops(txn->failure, txn->num_failure));
+	json_object_object_add(json_obj, "timestamp", json_object_new_int64(GetCurrentTimestamp()));
+	json_object_object_add(json_obj, "client_id", json_object_new_string(client_id));
+	
+	json_string = json_object_to_json_string_ext(json_obj, JSON_C_TO_STRING_PLAIN);
+	if (!json_string || strlen(json_string) >= buffer_size) {
+		elog(ERROR, "pgraft_json: KV txn JSON too long for buffer (max=%zu)", buffer_size - 1);
+		json_object_put(json_obj);
+		return -1;
+	}
+	strcpy(json_buffer, json_string);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Look a name up in a table of names; -1 if it is not there
+ */
+static int
+pgraft_json_lookup_name(const char *name, const char *const *names, int count)
+{
+	int i;
+	
+	for (i = 0; i < count; i++) {
+		if (strcmp(name, names[i]) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Parse one branch of a kv_txn entry; ops are palloc'd
+ */
+static int
+pgraft_json_parse_kv_txn_ops(json_object *json_obj, const char *branch, pgraft_kv_txn_op_t **ops, int *count)
+{
+	json_object *ops_obj;
+	json_object *field_obj;
+	int num_ops;
+	int i;
+	
+	*ops = NULL;
+	*count = 0;
+	if (!json_object_object_get_ex(json_obj, branch, &ops_obj))
+		return 0;
+	if (!json_object_is_type(ops_obj, json_type_array)) {
+		elog(WARNING, "pgraft_json: '%s' of KV txn is not an array", branch);
+		return -1;
+	}
+	
+	num_ops = (int) json_object_array_length(ops_obj);
+	*ops = (pgraft_kv_txn_op_t *) palloc0(sizeof(pgraft_kv_txn_op_t) * Max(num_ops, 1));
+	
+	for (i = 0; i < num_ops; i++) {
+		json_object *op_obj = json_object_array_get_idx(ops_obj, i);
+		pgraft_kv_txn_op_t *op = &(*ops)[i];
+		
+		if (!json_object_object_get_ex(op_obj, "op", &field_obj)) {
+			elog(WARNING, "pgraft_json: missing 'op' field in KV txn %s %d", branch, i);
+			return -1;
+		}
+		op->is_delete = (strcmp(json_object_get_string(field_obj), "delete") == 0);
+		
+		if (!json_object_object_get_ex(op_obj, "key", &field_obj)) {
+			elog(WARNING, "pgraft_json: missing 'key' field in KV txn %s %d", branch, i);
+			return -1;
+		}
+		op->key = pstrdup(json_object_get_string(field_obj));
+		
+		if (json_object_object_get_ex(op_obj, "range_end", &field_obj))
+			op->range_end = pstrdup(json_object_get_string(field_obj));
+		if (json_object_object_get_ex(op_obj, "value", &field_obj))
+			op->value = pstrdup(json_object_get_string(field_obj));
+		else
+			op->value = pstrdup("");
+		if (json_object_object_get_ex(op_obj, "lease", &field_obj))
+			op->lease = json_object_get_int64(field_obj);
+	}
+	*count = num_ops;
+	
+	return 0;
+}
+
+/*
+ * Parse KV Txn from JSON using json-c library; everything is palloc'd
+ */
+int
+pgraft_json_parse_kv_txn(const char *json_data, size_t len, pgraft_kv_txn_t *txn)
+{
+	json_object *json_obj;
+	json_object *compares_obj;
+	json_object *field_obj;
+	int num_compares = 0;
+	int i;
+	
+	memset(txn, 0, sizeof(*txn));
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj) {
+		elog(WARNING, "pgraft_json: failed to parse KV txn JSON");
+		return -1;
+	}
+	
+	if (json_object_object_get_ex(json_obj, "group", &field_obj))
+		txn->group = json_object_get_int(field_obj);
+	
+	if (json_object_object_get_ex(json_obj, "compare", &compares_obj) &&
+		json_object_is_type(compares_obj, json_type_array))
+		num_compares = (int) json_object_array_length(compares_obj);
+	txn->compares = (pgraft_kv_compare_t *) palloc0(sizeof(pgraft_kv_compare_t) * Max(num_compares, 1));
+	
+	for (i = 0; i < num_compares; i++) {
+		json_object *compare_obj = json_object_array_get_idx(compares_obj, i);
+		pgraft_kv_compare_t *compare = &txn->compares[i];
+		int target = -1;
+		int result = -1;
+		
+		if (json_object_object_get_ex(compare_obj, "target", &field_obj))
+			target = pgraft_json_lookup_name(json_object_get_string(field_obj), pgraft_kv_compare_target_names,
+											 lengthof(pgraft_kv_compare_target_names));
+		if (json_object_object_get_ex(compare_obj, "result", &field_obj))
+			result = pgraft_json_lookup_name(json_object_get_string(field_obj), pgraft_kv_compare_result_names,
+											 lengthof(pgraft_kv_compare_result_names));
+		if (target < 0 || result < 0 || !json_object_object_get_ex(compare_obj, "key", &field_obj)) {
+			elog(WARNING, "pgraft_json: invalid compare %d in KV txn", i);
+			json_object_put(json_obj);
+			return -1;
+		}
+		compare->key = pstrdup(json_object_get_string(field_obj));
+		compare->target = (pgraft_kv_compare_target_t) target;
+		compare->result = (pgraft_kv_compare_result_t) result;
+		
+		if (json_object_object_get_ex(compare_obj, "number", &field_obj))
+			compare->number = json_object_get_int64(field_obj);
+		if (json_object_object_get_ex(compare_obj, "value", &field_obj))
+			compare->value = pstrdup(json_object_get_string(field_obj));
+		else
+			compare->value = pstrdup("");
+	}
+	txn->num_compares = num_compares;
+	
+	if (pgraft_json_parse_kv_txn_ops(json_obj, "success", &txn->success, &txn->num_success) != 0 ||
+		pgraft_json_parse_kv_txn_ops(json_obj, "failure", &txn->failure, &txn->num_failure) != 0) {
+		json_object_put(json_obj);
+		return -1;
+	}
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/* Names of lease operations in the log, indexed by pgraft_kv_lease_op_type_t */
+static const char *const pgraft_kv_lease_op_names[] = {NULL, "lease_grant", "lease_keepalive", "lease_revoke"};
+
+/*
+ * Create KV lease operation JSON using json-c library
+ * Format: {"type": "lease_revoke", "lease": 42, "timestamp": 123, "expire": true}
+ */
+int
+pgraft_json_create_kv_lease_operation(const pgraft_kv_lease_op_t *op, char *json_buffer, size_t buffer_size)
+{
+	json_object *json_obj;
+	const char *json_string;
+	
+	if (op->op_type < PGRAFT_KV_LEASE_GRANT || op->op_type > PGRAFT_KV_LEASE_REVOKE) {
+		elog(ERROR, "pgraft_json: unknown lease operation type: %d", op->op_type);
+		return -1;
+	}
+	
+	json_obj = json_object_new_object();
+	if (!json_obj) {
+		elog(ERROR, "pgraft_json: failed to create JSON object");
+		return -1;
+	}
+	
+	json_object_object_add(json_obj, "type", json_object_new_string(pgraft_kv_lease_op_names[op->op_type]));
+	json_object_object_add(json_obj, "lease", json_object_new_int64(op->lease));
+	json_object_object_add(json_obj, "ttl", json_object_new_int64(op->ttl));
+	json_object_object_add(json_obj, "timestamp", json_object_new_int64(op->timestamp));
+	json_object_object_add(json_obj, "expire", json_object_new_boolean(op->expire));
+	
+	json_string = json_object_to_json_string(json_obj);
+	if (!json_string || strlen(json_string) >= buffer_size) {
+		elog(ERROR, "pgraft_json: lease operation JSON too long for buffer");
+		json_object_put(json_obj);
+		return -1;
+	}
+	strcpy(json_buffer, json_string);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
+/*
+ * Parse KV lease operation from JSON using json-c library
+ */
+int
+pgraft_json_parse_kv_lease_operation(const char *json_data, size_t len, pgraft_kv_lease_op_t *op)
+{
+	json_object *json_obj;
+	json_object *field_obj;
+	int type;
+	
+	memset(op, 0, sizeof(*op));
+	
+	json_obj = json_tokener_parse(json_data);
+	if (!json_obj) {
+		elog(WARNING, "pgraft_json: failed to parse lease operation JSON");
+		return -1;
+	}
+	
+	type = json_object_object_get_ex(json_obj, "type", &field_obj) ?
+		pgraft_json_lookup_name(json_object_get_string(field_obj), pgraft_kv_lease_op_names + 1,
+								lengthof(pgraft_kv_lease_op_names) - 1) : -1;
+	if (type < 0) {
+		elog(WARNING, "pgraft_json: unknown lease operation");
+		json_object_put(json_obj);
+		return -1;
+	}
+	op->op_type = (pgraft_kv_lease_op_type_t) (type + 1);
+	
+	if (json_object_object_get_ex(json_obj, "lease", &field_obj))
+		op->lease = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "ttl", &field_obj))
+		op->ttl = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "timestamp", &field_obj))
+		op->timestamp = json_object_get_int64(field_obj);
+	if (json_object_object_get_ex(json_obj, "expire", &field_obj))
+		op->expire = json_object_get_boolean(field_obj);
+	
+	json_object_put(json_obj);
+	return 0;
+}
+
 /*
  * Parse log entry from JSON using json-c library
  */
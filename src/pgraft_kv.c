@@ -19,15 +19,29 @@
 #include "miscadmin.h"
 #include "storage/ipc.h"
 #include "../include/pgraft_go.h"
+#include "storage/lwlock.h"
 #include "storage/shmem.h"
 #include "storage/spin.h"
 #include "utils/elog.h"
+#include "utils/fmgrprotos.h"
+#include "utils/hsearch.h"
+#include "utils/jsonb.h"
+#include "utils/memutils.h"
 #include "utils/timestamp.h"
 #include "port/pg_crc32c.h"
+#include "common/hashfn.h"
+#include "common/pg_lzcompress.h"
 
 #include "../include/pgraft_kv.h"
+#include "../include/pgraft_kv_bulk.h"
+#include "../include/pgraft_kv_cold.h"
+#include "../include/pgraft_kv_gateway.h"
+#include "../include/pgraft_kv_quota.h"
+#include "../include/pgraft_kv_stats.h"
 #include "../include/pgraft_core.h"
 #include "../include/pgraft_json.h"
+#include "../include/pgraft_guc.h"
+#include "../include/pgraft_proposal.h"
 
 /*
  * Replicate PUT operation through Raft
@@ -35,7 +49,7 @@
 int
 pgraft_kv_replicate_put(const char *key, const char *value, const char *client_id)
 {
-	char json_data[2048];
+	char json_data[PGRAFT_PROPOSAL_DATA_SIZE + 1];
 	int result;
 	
 	/* Create JSON using json-c library */
@@ -47,7 +61,7 @@ pgraft_kv_replicate_put(const char *key, const char *value, const char *client_i
 	elog(INFO, "pgraft_kv: replicating PUT operation: %s", json_data);
 	
 	/* Queue the operation for the background worker to process through Raft */
-	result = pgraft_kv_queue_operation(PGRAFT_KV_PUT, key, value, client_id);
+	result = pgraft_kv_queue_operation(PGRAFT_KV_PUT, key, value, -1, client_id);
 	if (result < 0)
 	{
 		elog(ERROR, "pgraft_kv: failed to queue operation for replication. Operation rejected to prevent split-brain.");
@@ -63,7 +77,7 @@ pgraft_kv_replicate_put(const char *key, const char *value, const char *client_i
 int
 pgraft_kv_replicate_delete(const char *key, const char *client_id)
 {
-	char json_data[2048];
+	char json_data[PGRAFT_PROPOSAL_DATA_SIZE + 1];
 	int result;
 	
 	/* Create JSON using json-c library */
@@ -75,7 +89,7 @@ pgraft_kv_replicate_delete(const char *key, const char *client_id)
 	elog(INFO, "pgraft_kv: replicating DELETE operation: %s", json_data);
 	
 	/* Queue the operation for the background worker to process through Raft */
-	result = pgraft_kv_queue_operation(PGRAFT_KV_DELETE, key, NULL, client_id);
+	result = pgraft_kv_queue_operation(PGRAFT_KV_DELETE, key, NULL, -1, client_id);
 	if (result < 0)
 	{
 		elog(ERROR, "pgraft_kv: failed to queue DELETE operation for replication. Operation rejected to prevent split-brain.");
@@ -85,6 +99,24 @@ pgraft_kv_replicate_delete(const char *key, const char *client_id)
 	return result;
 }
 
+/*
+ * Replicate a JSON merge patch through Raft
+ *
+ * Only the patch travels in the log; each node merges it into its own copy
+ * of the value when the entry is applied.
+ */
+int
+pgraft_kv_replicate_patch(const char *key, const char *patch, int64_t expected_version, const char *client_id)
+{
+	if (pgraft_kv_queue_operation(PGRAFT_KV_PATCH, key, patch, expected_version, client_id) < 0)
+	{
+		elog(ERROR, "pgraft_kv: failed to queue PATCH operation for replication. Operation rejected to prevent split-brain.");
+		return -1;
+	}
+	
+	return 0;
+}
+
 /*
  * Apply log entry to key/value store
  */
@@ -100,7 +132,7 @@ pgraft_kv_apply_log_entry(const pgraft_kv_log_entry_t *log_entry, int64_t log_in
 	
 	switch (log_entry->op_type) {
 		case PGRAFT_KV_PUT:
-			result = pgraft_kv_put(log_entry->key, log_entry->value, log_index);
+			result = pgraft_kv_put(log_entry->key, log_entry->value, 0, log_index);
 			break;
 		case PGRAFT_KV_DELETE:
 			result = pgraft_kv_delete(log_entry->key, log_index);
@@ -125,9 +157,59 @@ pgraft_kv_apply_log_entry(const pgraft_kv_log_entry_t *log_entry, int64_t log_in
 /* Global shared memory pointer */
 static pgraft_kv_store_t *g_kv_store = NULL;
 
+/* Serializes the cold tier; taken before the store mutex, never inside it */
+static LWLock *kv_cold_lock = NULL;
+
 /* Persistence file path */
 #define PGRAFT_KV_PERSIST_FILE "/tmp/pgraft_kv_store.dat"
 
+/* Applying a batch entry: puts and deletes leave saving the store to it */
+static bool kv_defer_save = false;
+
+static bool pgraft_kv_defrag_unit(pgraft_kv_store_t *store);
+
+/*
+ * Backend-local read cache (pgraft.kv_read_cache_size)
+ *
+ * Results of pgraft_kv_get(), including misses, are kept per backend
+ * together with the store revision they were read at.  While the shared
+ * revision still matches, a repeat read is answered from the cache without
+ * taking the store's spinlock; any change to the store bumps the revision
+ * and the whole cache is dropped on the next read.
+ */
+typedef struct pgraft_kv_cache_entry
+{
+	char		key[256];			/* Hash key, must be first */
+	bool		found;
+	int64_t		version;
+	char	   *value;				/* NULL for a miss */
+} pgraft_kv_cache_entry_t;
+
+static HTAB *kv_cache = NULL;
+static MemoryContext kv_cache_context = NULL;
+static uint64 kv_cache_revision = 0;
+
+/*
+ * A value as copied out of the arena under the store mutex
+ * It is expanded into text after the mutex is released.
+ */
+typedef struct pgraft_kv_value_copy
+{
+	uint32		stored_size;
+	uint32		raw_size;
+	bool		compressed;
+	char		data[PGRAFT_KV_VALUE_SIZE];
+} pgraft_kv_value_copy_t;
+
+/*
+ * Shared memory size of the key/value store, including the value arena
+ */
+Size
+pgraft_kv_shmem_size(void)
+{
+	return add_size(PGRAFT_KV_STORE_HEADER_SIZE, mul_size((Size) pgraft_kv_arena_size, 1024));
+}
+
 /*
  * Initialize shared memory for key/value store
  */
@@ -140,18 +222,20 @@ pgraft_kv_init_shared_memory(void)
 	
 	/* Allocate shared memory */
 	g_kv_store = (pgraft_kv_store_t *) ShmemInitStruct("pgraft_kv_store",
-														sizeof(pgraft_kv_store_t),
+														pgraft_kv_shmem_size(),
 														&found);
 	
 	if (!found)
 	{
 		elog(INFO, "pgraft: creating new key/value store shared memory");
 		
-		/* Initialize shared memory */
-		memset(g_kv_store, 0, sizeof(pgraft_kv_store_t));
+		/* Initialize shared memory; the arena needs no clearing */
+		memset(g_kv_store, 0, PGRAFT_KV_STORE_HEADER_SIZE);
+		g_kv_store->arena_size = (uint32) pgraft_kv_arena_size * 1024;
 		
 		/* Initialize mutex */
 		SpinLockInit(&g_kv_store->mutex);
+		pg_atomic_init_u64(&g_kv_store->revision, 1);
 		
 		/* Initialize default values */
 		g_kv_store->num_entries = 0;
@@ -168,11 +252,89 @@ pgraft_kv_init_shared_memory(void)
 		{
 			elog(INFO, "pgraft: loaded existing key/value data from disk");
 		}
+		
+		/* Keys evicted before the restart */
+		g_kv_store->cold_entries = pgraft_kv_cold_count();
+		
+		/*
+		 * A crash between moving a key into the store and removing it from
+		 * the cold tier leaves it in both; the cold copy is no newer.
+		 */
+		for (int i = 0; i < g_kv_store->num_entries && g_kv_store->cold_entries > 0; i++)
+		{
+			pgraft_kv_entry_t *entry = &g_kv_store->entries[i];
+			pgraft_kv_cold_record_t record;
+			int64		count;
+			
+			if (pgraft_kv_cold_fetch(entry->key, &record) &&
+				record.entry.mod_revision <= entry->mod_revision &&
+				pgraft_kv_cold_remove(entry->key, &count))
+				g_kv_store->cold_entries = count;
+		}
+		
+		/* Which of them are leased is left to the first lease sweep */
+		g_kv_store->cold_leased = g_kv_store->cold_entries;
+		
+		if (g_kv_store->cold_entries > 0)
+		{
+			/* Their changes are only known to be older than the store's */
+			g_kv_store->cold_revision = pg_atomic_read_u64(&g_kv_store->revision);
+			elog(INFO, "pgraft: %lld keys in the key/value cold tier", (long long) g_kv_store->cold_entries);
+		}
 	}
 	else
 	{
 		elog(INFO, "pgraft: using existing key/value store shared memory");
 	}
+	
+	kv_cold_lock = &(GetNamedLWLockTranche(PGRAFT_KV_COLD_TRANCHE))->lock;
+}
+
+/*
+ * Start an empty read cache valid at the given revision
+ */
+static void
+pgraft_kv_cache_reset(uint64 revision)
+{
+	HASHCTL		ctl;
+	
+	if (kv_cache_context == NULL)
+		kv_cache_context = AllocSetContextCreate(TopMemoryContext,
+												 "pgraft kv read cache",
+												 ALLOCSET_DEFAULT_SIZES);
+	else
+		MemoryContextReset(kv_cache_context);
+	
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(((pgraft_kv_cache_entry_t *) NULL)->key);
+	ctl.entrysize = sizeof(pgraft_kv_cache_entry_t);
+	ctl.hcxt = kv_cache_context;
+	kv_cache = hash_create("pgraft kv read cache", 256, &ctl,
+						   HASH_ELEM | HASH_STRINGS | HASH_CONTEXT);
+	kv_cache_revision = revision;
+}
+
+/*
+ * Remember the result of a read made at the given revision
+ * A full cache is simply started over.
+ */
+static void
+pgraft_kv_cache_store(const char *key, bool found, const char *value, int64_t version,
+					  uint64 revision)
+{
+	pgraft_kv_cache_entry_t *cached;
+	bool		exists;
+	
+	if (kv_cache == NULL || revision != kv_cache_revision ||
+		hash_get_num_entries(kv_cache) >= pgraft_kv_read_cache_size)
+		pgraft_kv_cache_reset(revision);
+	
+	cached = (pgraft_kv_cache_entry_t *) hash_search(kv_cache, key, HASH_ENTER, &exists);
+	if (exists && cached->value)
+		pfree(cached->value);
+	cached->found = found;
+	cached->version = version;
+	cached->value = found ? MemoryContextStrdup(kv_cache_context, value) : NULL;
 }
 
 /*
@@ -208,248 +370,2384 @@ pgraft_kv_find_entry_index(const char *key)
 }
 
 /*
- * PUT operation - store or update a key/value pair
+ * Order live values by their position in the arena
  */
-int
-pgraft_kv_put(const char *key, const char *value, int64_t log_index)
+static int
+pgraft_kv_compare_offsets(const void *a, const void *b)
 {
-	pgraft_kv_store_t *store = pgraft_kv_get_store();
-	pgraft_kv_entry_t *entry;
-	int entry_index;
-	int64_t timestamp = GetCurrentTimestamp();
+	uint32		offset_a = g_kv_store->entries[*(const int *) a].value_offset;
+	uint32		offset_b = g_kv_store->entries[*(const int *) b].value_offset;
 	
-	if (!store || !key || !value)
-	{
-		elog(ERROR, "pgraft_kv: invalid parameters for PUT operation (store=%p, key=%p, value=%p)", store, key, value);
+	if (offset_a < offset_b)
 		return -1;
+	return offset_a > offset_b ? 1 : 0;
+}
+
+/*
+ * Slide every live value to the front of the arena; caller holds the mutex
+ */
+static void
+pgraft_kv_arena_compact(pgraft_kv_store_t *store)
+{
+	int			order[lengthof(store->entries)];
+	int			count = 0;
+	uint32		next = 0;
+	int			i;
+	
+	for (i = 0; i < store->num_entries; i++)
+	{
+		if (store->entries[i].value_size > 0)
+			order[count++] = i;
 	}
+	qsort(order, count, sizeof(int), pgraft_kv_compare_offsets);
 	
-	if (strlen(key) >= 256)
+	for (i = 0; i < count; i++)
 	{
-		elog(ERROR, "pgraft_kv: key too long (max 255 characters, got %zu)", strlen(key));
-		return -1;
+		pgraft_kv_entry_t *entry = &store->entries[order[i]];
+		
+		if (entry->value_offset != next)
+			memmove(store->arena + next, store->arena + entry->value_offset, entry->value_size);
+		entry->value_offset = next;
+		next += entry->value_size;
 	}
 	
-	if (strlen(value) >= 1024)
+	store->arena_used = next;
+	store->arena_live = next;
+	
+	/* Any background pass is overtaken */
+	store->defrag_active = false;
+	store->defrag_cursor = 0;
+	store->full_compactions++;
+}
+
+/*
+ * Drop an entry's value from the arena; caller holds the mutex
+ */
+static void
+pgraft_kv_arena_release(pgraft_kv_store_t *store, pgraft_kv_entry_t *entry)
+{
+	store->arena_live -= entry->value_size;
+	entry->value_offset = 0;
+	entry->value_size = 0;
+	entry->raw_size = 0;
+	entry->compressed = false;
+}
+
+/*
+ * Can a value of the given stored size be appended at the end of the
+ * arena?  Caller holds the mutex.
+ */
+static bool
+pgraft_kv_arena_tail_fits(pgraft_kv_store_t *store, uint32 size)
+{
+	return size <= store->arena_size - store->arena_used;
+}
+
+/*
+ * Give an entry a new stored value; caller holds the mutex
+ *
+ * A value no larger than the current one is written in place, otherwise it
+ * is appended.  Returns false, leaving the entry untouched, if the tail of
+ * the arena has no room: the arena is never compacted here, as that would
+ * sort and move every value with the mutex held.  Callers make room first
+ * (pgraft_kv_make_room()), which reclaims holes a unit at a time.
+ */
+static bool
+pgraft_kv_arena_store(pgraft_kv_store_t *store, pgraft_kv_entry_t *entry,
+					  const char *data, uint32 size, uint32 raw_size, bool compressed)
+{
+	if (size > entry->value_size && !pgraft_kv_arena_tail_fits(store, size))
+		return false;
+	
+	if (size > 0 && size <= entry->value_size)
 	{
-		elog(ERROR, "pgraft_kv: value too long (max 1023 characters, got %zu)", strlen(value));
-		return -1;
+		store->arena_live -= entry->value_size - size;
+	}
+	else if (size == 0)
+	{
+		/* An empty value takes no room, and so has no place to be moved from */
+		pgraft_kv_arena_release(store, entry);
+	}
+	else
+	{
+		pgraft_kv_arena_release(store, entry);
+		entry->value_offset = store->arena_used;
+		store->arena_used += size;
+		store->arena_live += size;
 	}
 	
-	SpinLockAcquire(&store->mutex);
+	memcpy(store->arena + entry->value_offset, data, size);
+	entry->value_size = size;
+	entry->raw_size = raw_size;
+	entry->compressed = compressed;
+	return true;
+}
+
+/*
+ * Copy an entry's stored value; caller holds the mutex
+ */
+static void
+pgraft_kv_copy_value(pgraft_kv_store_t *store, const pgraft_kv_entry_t *entry,
+					 pgraft_kv_value_copy_t *copy)
+{
+	copy->stored_size = entry->value_size;
+	copy->raw_size = entry->raw_size;
+	copy->compressed = entry->compressed;
+	memcpy(copy->data, store->arena + entry->value_offset, entry->value_size);
+}
+
+/*
+ * Turn a copied value back into text, decompressing it if needed
+ */
+static void
+pgraft_kv_expand_value(const pgraft_kv_value_copy_t *copy, char *value, size_t value_size)
+{
+	char		raw[PGRAFT_KV_VALUE_SIZE];
 	
-	/* Check if key already exists */
-	entry_index = pgraft_kv_find_entry_index(key);
+	if (!copy->compressed)
+		memcpy(raw, copy->data, copy->raw_size);
+	else if (pglz_decompress(copy->data, copy->stored_size, raw, copy->raw_size, true) != (int32) copy->raw_size)
+		elog(ERROR, "pgraft_kv: compressed value is corrupt (%u bytes stored, %u expected)",
+			 copy->stored_size, copy->raw_size);
 	
-	if (entry_index >= 0)
+	raw[copy->raw_size] = '\0';
+	strlcpy(value, raw, value_size);
+}
+
+/*
+ * Hand a change to the client gateway, together with the key as it was
+ * before; prev is NULL if it did not exist
+ */
+static void
+pgraft_kv_publish(const pgraft_kv_entry_t *entry, const char *value,
+				  const pgraft_kv_entry_t *prev, const pgraft_kv_value_copy_t *prev_copy)
+{
+	char		prev_value[PGRAFT_KV_VALUE_SIZE];
+	
+	if (prev == NULL)
 	{
-		/* Update existing entry */
-		entry = &store->entries[entry_index];
-		strncpy(entry->value, value, sizeof(entry->value) - 1);
-		entry->value[sizeof(entry->value) - 1] = '\0';
-		entry->version++;
-		entry->updated_at = timestamp;
-		entry->log_index = log_index;
-		entry->deleted = false;
+		pgraft_kv_gateway_publish(entry, value, NULL, NULL);
+		return;
+	}
+	
+	pgraft_kv_expand_value(prev_copy, prev_value, sizeof(prev_value));
+	pgraft_kv_gateway_publish(entry, value, prev, prev_value);
+}
+
+/*
+ * Hash of a key and its value, the part of an entry's hash that can be
+ * computed before taking the mutex
+ */
+static uint64
+pgraft_kv_hash_value(const char *key, const char *value)
+{
+	return hash_combine64(hash_bytes_extended((const unsigned char *) key, strlen(key), 0),
+						  hash_bytes_extended((const unsigned char *) value, strlen(value), 0));
+}
+
+/*
+ * Hash of an entry from its key and value hash and its version
+ * The store revision an entry was changed at differs between nodes; the
+ * version does not, so it stands in for the revision.
+ */
+static uint64
+pgraft_kv_hash_entry(uint64 value_hash, int64_t version)
+{
+	uint64		hash = hash_combine64(value_hash, (uint64) version);
+	
+	/* 0 stands for no key */
+	return hash != 0 ? hash : 1;
+}
+
+/*
+ * Inner node of the hash tree; empty subtrees hash to 0
+ */
+static uint64
+pgraft_kv_hash_pair(uint64 left, uint64 right)
+{
+	uint64		pair[2];
+	
+	if (left == 0 && right == 0)
+		return 0;
+	pair[0] = left;
+	pair[1] = right;
+	return hash_bytes_extended((const unsigned char *) pair, sizeof(pair), 0);
+}
+
+/*
+ * Replace a key's hash in the tree and rehash the path to the root, one
+ * change; caller holds the mutex
+ */
+static void
+pgraft_kv_hash_change(pgraft_kv_store_t *store, const char *key, uint64 old_hash, uint64 new_hash)
+{
+	uint32		node;
+	
+	node = PGRAFT_KV_HASH_LEAVES +
+		(hash_bytes((const unsigned char *) key, strlen(key)) & (PGRAFT_KV_HASH_LEAVES - 1));
+	
+	/* Leaves sum their keys' hashes, so the order keys arrive in does not matter */
+	store->hash_tree[node] += new_hash - old_hash;
+	for (node /= 2; node > 0; node /= 2)
+		store->hash_tree[node] = pgraft_kv_hash_pair(store->hash_tree[2 * node],
+													 store->hash_tree[2 * node + 1]);
+	
+	store->hash_revision++;
+	store->hash_history[store->hash_revision % PGRAFT_KV_HASH_HISTORY] = store->hash_tree[1];
+}
+
+/*
+ * Bytes the hot tier takes in shared memory: entry slots in use, and their
+ * values in the arena
+ */
+Size
+pgraft_kv_hot_bytes(const pgraft_kv_store_t *store)
+{
+	return (Size) store->num_entries * sizeof(pgraft_kv_entry_t) + store->arena_live;
+}
+
+/*
+ * Does one more entry with a value of the given stored size need something
+ * evicted first?  Caller holds the mutex.
+ *
+ * An empty store always takes one entry, whatever pgraft.kv_memory_budget
+ * says, so that applying a write never depends on this node's budget.
+ */
+static bool
+pgraft_kv_hot_is_full(pgraft_kv_store_t *store, uint32 size)
+{
+	Size		budget = (Size) pgraft_kv_memory_budget * 1024;
+	
+	if (store->num_entries >= (int32_t) lengthof(store->entries))
+		return true;
+	if (size > store->arena_size - store->arena_live)
+		return true;
+	return budget > 0 && store->num_entries > 0 &&
+		pgraft_kv_hot_bytes(store) + sizeof(pgraft_kv_entry_t) + size > budget;
+}
+
+/*
+ * Newest deletion that may be dropped from shared memory
+ * The materializer only learns of a deletion from its entry, so while it
+ * runs a deletion stays until pgraft.kv has it.
+ */
+static uint64
+pgraft_kv_purgeable_revision(pgraft_kv_store_t *store)
+{
+	if (pgraft_kv_sync_database == NULL || pgraft_kv_sync_database[0] == '\0')
+		return PG_UINT64_MAX;
+	return store->spill_horizon;
+}
+
+/*
+ * Pick the entry to evict, -1 only if the store is empty; caller holds the
+ * mutex
+ *
+ * Deletions pgraft.kv has go first as they need no writing out, then the
+ * least recently used key, whether pgraft.kv has it yet or not: the
+ * materializer reads evicted keys from the cold tier.  Keys attached to a
+ * lease come after the others, since lease expiry only reads the cold tier
+ * while some are there.  Deletions pgraft.kv has yet to see go last, as
+ * dropping one makes it rebuild pgraft.kv.
+ */
+static int
+pgraft_kv_choose_victim(pgraft_kv_store_t *store)
+{
+	uint64		horizon = pgraft_kv_purgeable_revision(store);
+	int			victim = -1;
+	int			leased = -1;
+	int			pending = -1;
+	int			i;
+	
+	for (i = 0; i < store->num_entries; i++)
+	{
+		pgraft_kv_entry_t *entry = &store->entries[i];
 		
-		elog(DEBUG1, "pgraft_kv: Updated key '%s' (version %lld)", key, (long long)entry->version);
+		if (entry->deleted)
+		{
+			if (entry->mod_revision <= horizon)
+				return i;
+			pending = i;
+			continue;
+		}
+		if (entry->lease != 0)
+		{
+			if (leased < 0 || entry->last_access < store->entries[leased].last_access)
+				leased = i;
+			continue;
+		}
+		if (victim < 0 || entry->last_access < store->entries[victim].last_access)
+			victim = i;
+	}
+	
+	if (victim >= 0)
+		return victim;
+	return leased >= 0 ? leased : pending;
+}
+
+/*
+ * Find an entry, deleted or not, by key and last change; caller holds the mutex
+ */
+static int
+pgraft_kv_find_revision_index(pgraft_kv_store_t *store, const char *key, uint64 mod_revision)
+{
+	int			i;
+	
+	for (i = 0; i < store->num_entries; i++)
+	{
+		if (store->entries[i].mod_revision == mod_revision &&
+			strcmp(store->entries[i].key, key) == 0)
+			return i;
+	}
+	
+	return -1;
+}
+
+/*
+ * Take an entry out of shared memory, moving the last one into its slot;
+ * caller holds the mutex
+ */
+static void
+pgraft_kv_remove_entry(pgraft_kv_store_t *store, int index)
+{
+	/* An incremental export can no longer tell of this deletion */
+	if (store->entries[index].deleted)
+	{
+		store->purged_revision = Max(store->purged_revision, store->entries[index].mod_revision);
+		
+		/* Nor can the materializer, whose pgraft.kv still has the key */
+		if (store->entries[index].mod_revision > pgraft_kv_purgeable_revision(store))
+			store->resync_revision = pg_atomic_read_u64(&store->revision);
+	}
+	
+	pgraft_kv_arena_release(store, &store->entries[index]);
+	store->num_entries--;
+	if (index != store->num_entries)
+		memcpy(&store->entries[index], &store->entries[store->num_entries], sizeof(pgraft_kv_entry_t));
+	memset(&store->entries[store->num_entries], 0, sizeof(pgraft_kv_entry_t));
+}
+
+/*
+ * Evict entries until one with a value of the given stored size fits
+ *
+ * Caller holds the cold tier lock exclusively.  Each victim is written to
+ * the cold tier without the mutex held, and only dropped from shared
+ * memory if no write overtook it meanwhile.  Once the live values leave
+ * room but the tail of the arena does not, the holes are reclaimed by
+ * defragmentation units, each taking the mutex on its own.  Returns false
+ * if room cannot be made, which only happens once shared memory is empty.
+ */
+static bool
+pgraft_kv_make_room(pgraft_kv_store_t *store, uint32 size)
+{
+	for (;;)
+	{
+		pgraft_kv_entry_t victim;
+		pgraft_kv_value_copy_t copy;
+		int64		count;
+		int			index;
+		
+		SpinLockAcquire(&store->mutex);
+		
+		if (!pgraft_kv_hot_is_full(store, size))
+		{
+			if (pgraft_kv_arena_tail_fits(store, size))
+			{
+				SpinLockRelease(&store->mutex);
+				return true;
+			}
+			
+			/* A pass ends with the tail holding all free space */
+			if (!store->defrag_active)
+			{
+				store->defrag_active = true;
+				store->defrag_cursor = 0;
+				store->defrag_passes++;
+			}
+			pgraft_kv_defrag_unit(store);
+			SpinLockRelease(&store->mutex);
+			continue;
+		}
+		
+		index = pgraft_kv_choose_victim(store);
+		if (index < 0)
+		{
+			SpinLockRelease(&store->mutex);
+			return false;
+		}
+		
+		victim = store->entries[index];
+		if (victim.deleted)
+		{
+			pgraft_kv_remove_entry(store, index);
+			SpinLockRelease(&store->mutex);
+			continue;
+		}
+		pgraft_kv_copy_value(store, &victim, &copy);
+		
+		SpinLockRelease(&store->mutex);
+		
+		count = pgraft_kv_cold_store(&victim, copy.data);
+		
+		SpinLockAcquire(&store->mutex);
+		store->cold_entries = count;
+		index = pgraft_kv_find_revision_index(store, victim.key, victim.mod_revision);
+		if (index >= 0)
+		{
+			pgraft_kv_remove_entry(store, index);
+			store->cold_revision = Max(store->cold_revision, victim.mod_revision);
+			store->evictions++;
+			if (victim.lease != 0)
+				store->cold_leased++;
+		}
+		SpinLockRelease(&store->mutex);
+		
+		/* Rewritten while being evicted: the cold copy is stale */
+		if (index < 0 && pgraft_kv_cold_remove(victim.key, &count))
+		{
+			SpinLockAcquire(&store->mutex);
+			store->cold_entries = count;
+			SpinLockRelease(&store->mutex);
+		}
+	}
+}
+
+/*
+ * Drop a key from the cold tier once shared memory holds it; caller holds
+ * the cold tier lock exclusively
+ *
+ * The store is saved first, so that a crash in between leaves the key in
+ * both tiers rather than in neither.
+ */
+static void
+pgraft_kv_cold_forget(pgraft_kv_store_t *store, const char *key)
+{
+	int64		count;
+	
+	pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
+	
+	if (pgraft_kv_cold_remove(key, &count))
+	{
+		SpinLockAcquire(&store->mutex);
+		store->cold_entries = count;
+		SpinLockRelease(&store->mutex);
+	}
+}
+
+/*
+ * Copy the stored value of a cold tier record
+ */
+static void
+pgraft_kv_copy_cold_value(const pgraft_kv_cold_record_t *record, pgraft_kv_value_copy_t *copy)
+{
+	copy->stored_size = record->entry.value_size;
+	copy->raw_size = record->entry.raw_size;
+	copy->compressed = record->entry.compressed;
+	memcpy(copy->data, record->data, record->entry.value_size);
+}
+
+/*
+ * Look up a key that was not in shared memory
+ *
+ * The cold tier lock keeps the key from moving between tiers meanwhile.
+ * A key found in the cold tier stays there: reads run in any backend,
+ * standbys' included, so only applying a write brings a key back into
+ * shared memory.  Returns false if the key is in neither tier.
+ */
+static bool
+pgraft_kv_lookup_cold(pgraft_kv_store_t *store, const char *key,
+					  pgraft_kv_value_copy_t *copy, pgraft_kv_entry_t *entry)
+{
+	pgraft_kv_cold_record_t record;
+	int			entry_index;
+	bool		found;
+	
+	LWLockAcquire(kv_cold_lock, LW_SHARED);
+	
+	/* Brought back while we waited for the lock */
+	SpinLockAcquire(&store->mutex);
+	entry_index = pgraft_kv_find_entry_index(key);
+	if (entry_index >= 0)
+	{
+		pgraft_kv_copy_value(store, &store->entries[entry_index], copy);
+		*entry = store->entries[entry_index];
+		SpinLockRelease(&store->mutex);
+		LWLockRelease(kv_cold_lock);
+		return true;
+	}
+	SpinLockRelease(&store->mutex);
+	
+	found = pgraft_kv_cold_fetch(key, &record);
+	if (found)
+	{
+		pgraft_kv_copy_cold_value(&record, copy);
+		*entry = record.entry;
+	}
+	
+	LWLockRelease(kv_cold_lock);
+	return found;
+}
+
+/*
+ * Let deletions pgraft.kv holds be dropped from shared memory
+ */
+void
+pgraft_kv_set_spill_horizon(uint64 revision)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	
+	if (!store)
+		return;
+	
+	SpinLockAcquire(&store->mutex);
+	store->spill_horizon = revision;
+	SpinLockRelease(&store->mutex);
+}
+
+/*
+ * PUT operation - store or update a key/value pair
+ *
+ * The key is attached to the given client gateway lease, or to none with
+ * lease 0, whatever it was attached to before.
+ */
+int
+pgraft_kv_put(const char *key, const char *value, int64_t lease, int64_t log_index)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_entry_t *entry;
+	int entry_index;
+	int64_t timestamp = GetCurrentTimestamp();
+	char *buffer = NULL;
+	const char *stored;
+	uint32 raw_size;
+	uint32 stored_size;
+	bool compressed = false;
+	bool cold_locked = false;
+	bool was_cold = false;
+	pgraft_kv_cold_record_t record;
+	uint64 value_hash;
+	uint64 old_hash;
+	int old_size;
+	bool publish = pgraft_kv_gateway_active();
+	bool had_prev = false;
+	pgraft_kv_entry_t prev;
+	pgraft_kv_value_copy_t prev_copy;
+	pgraft_kv_entry_t changed;
+	
+	if (!store || !key || !value)
+	{
+		elog(ERROR, "pgraft_kv: invalid parameters for PUT operation (store=%p, key=%p, value=%p)", store, key, value);
+		return -1;
+	}
+	
+	if (strlen(key) >= 256)
+	{
+		elog(ERROR, "pgraft_kv: key too long (max 255 characters, got %zu)", strlen(key));
+		return -1;
+	}
+	
+	if (strlen(value) >= PGRAFT_KV_VALUE_SIZE)
+	{
+		elog(ERROR, "pgraft_kv: value too long (max %d characters, got %zu)", PGRAFT_KV_VALUE_SIZE - 1, strlen(value));
+		return -1;
+	}
+	
+	/* Hash and compress the value before taking the mutex */
+	value_hash = pgraft_kv_hash_value(key, value);
+	stored = value;
+	raw_size = stored_size = strlen(value);
+	if (pgraft_kv_compress_threshold > 0 && raw_size >= (uint32) pgraft_kv_compress_threshold)
+	{
+		int32		length;
+		
+		buffer = palloc(PGLZ_MAX_OUTPUT(raw_size));
+		length = pglz_compress(value, raw_size, buffer, PGLZ_strategy_default);
+		if (length >= 0 && (uint32) length < raw_size)
+		{
+			stored = buffer;
+			stored_size = length;
+			compressed = true;
+		}
+	}
+	
+	SpinLockAcquire(&store->mutex);
+	
+	/* Check if key already exists */
+	entry_index = pgraft_kv_find_entry_index(key);
+	
+	/*
+	 * A new key that may be in the cold tier or needs room made for it, or
+	 * a rewrite the arena cannot take as it is: evict first, so that whether
+	 * a put applies does not depend on this node's pgraft.kv_arena_size
+	 */
+	if ((entry_index < 0 && (store->cold_entries > 0 || pgraft_kv_hot_is_full(store, stored_size) ||
+							 !pgraft_kv_arena_tail_fits(store, stored_size))) ||
+		(entry_index >= 0 && stored_size > store->entries[entry_index].value_size &&
+		 !pgraft_kv_arena_tail_fits(store, stored_size)))
+	{
+		SpinLockRelease(&store->mutex);
+		
+		LWLockAcquire(kv_cold_lock, LW_EXCLUSIVE);
+		cold_locked = true;
+		
+		if (!pgraft_kv_make_room(store, stored_size))
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("pgraft_kv: no room for key '%s' in the key/value store", key)));
+		
+		/* It carries on from its cold version, even if just evicted to make room */
+		if (store->cold_entries > 0)
+			was_cold = pgraft_kv_cold_fetch(key, &record);
+		
+		SpinLockAcquire(&store->mutex);
+		entry_index = pgraft_kv_find_entry_index(key);
+	}
+	
+	if (entry_index >= 0)
+	{
+		/* Update existing entry */
+		entry = &store->entries[entry_index];
+		if (publish)
+		{
+			prev = *entry;
+			pgraft_kv_copy_value(store, entry, &prev_copy);
+			had_prev = true;
+		}
+		old_hash = entry->kv_hash;
+		old_size = entry->raw_size;
+		if (!pgraft_kv_arena_store(store, entry, stored, stored_size, raw_size, compressed))
+		{
+			SpinLockRelease(&store->mutex);
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("pgraft_kv: value arena is full (%u bytes, see pgraft.kv_arena_size)", store->arena_size)));
+			return -1;
+		}
+		entry->version++;
+		entry->updated_at = timestamp;
+		entry->log_index = log_index;
+		entry->deleted = false;
+		
+		elog(DEBUG1, "pgraft_kv: Updated key '%s' (version %lld)", key, (long long)entry->version);
+	}
+	else
+	{
+		/* Create new entry */
+		if (store->num_entries >= 1000)
+		{
+			SpinLockRelease(&store->mutex);
+			elog(ERROR, "pgraft_kv: key/value store is full (1000 entries)");
+			return -1;
+		}
+		
+		entry = &store->entries[store->num_entries];
+		memset(entry, 0, sizeof(pgraft_kv_entry_t));
+		if (!pgraft_kv_arena_store(store, entry, stored, stored_size, raw_size, compressed))
+		{
+			SpinLockRelease(&store->mutex);
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("pgraft_kv: value arena is full (%u bytes, see pgraft.kv_arena_size)", store->arena_size)));
+			return -1;
+		}
+		strncpy(entry->key, key, sizeof(entry->key) - 1);
+		entry->key[sizeof(entry->key) - 1] = '\0';
+		old_hash = was_cold ? record.entry.kv_hash : 0;
+		old_size = was_cold ? (int) record.entry.raw_size : -1;
+		entry->version = was_cold ? record.entry.version + 1 : 1;
+		entry->created_at = was_cold ? record.entry.created_at : timestamp;
+		entry->create_index = was_cold ? record.entry.create_index : log_index;
+		entry->updated_at = timestamp;
+		entry->log_index = log_index;
+		entry->deleted = false;
+		
+		store->num_entries++;
+		if (was_cold)
+		{
+			store->promotions++;
+			if (record.entry.lease != 0 && store->cold_leased > 0)
+				store->cold_leased--;
+			if (publish)
+			{
+				prev = record.entry;
+				pgraft_kv_copy_cold_value(&record, &prev_copy);
+				had_prev = true;
+			}
+		}
+		
+		elog(DEBUG1, "pgraft_kv: Created new key '%s'", key);
+	}
+	
+	store->puts++;
+	store->total_operations++;
+	store->last_applied_index = Max(store->last_applied_index, log_index);
+	entry->lease = lease;
+	entry->last_access = ++store->access_clock;
+	entry->mod_revision = pg_atomic_fetch_add_u64(&store->revision, 1) + 1;
+	entry->kv_hash = pgraft_kv_hash_entry(value_hash, entry->version);
+	pgraft_kv_hash_change(store, key, old_hash, entry->kv_hash);
+	pgraft_kv_quota_account(key, old_size, raw_size);
+	changed = *entry;
+	
+	SpinLockRelease(&store->mutex);
+	
+	if (buffer)
+		pfree(buffer);
+	
+	/* Persist to disk */
+	if (was_cold)
+		pgraft_kv_cold_forget(store, key);
+	else if (!kv_defer_save)
+		pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
+	
+	if (cold_locked)
+		LWLockRelease(kv_cold_lock);
+	
+	pgraft_kv_stats_write(key, false, raw_size);
+	
+	if (publish)
+		pgraft_kv_publish(&changed, value, had_prev ? &prev : NULL, &prev_copy);
+	
+	return 0;
+}
+
+/*
+ * GET operation - retrieve value for a key
+ */
+int
+pgraft_kv_get(const char *key, char *value, size_t value_size, int64_t *version)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_entry_t *entry;
+	int entry_index;
+	bool use_cache;
+	bool cold = false;
+	bool found;
+	uint64 revision;
+	int64_t entry_version = 0;
+	pgraft_kv_value_copy_t copy;
+	char entry_value[PGRAFT_KV_VALUE_SIZE];
+	instr_time start;
+	
+	if (!store || !key || !value)
+	{
+		elog(ERROR, "pgraft_kv: invalid parameters for GET operation");
+		return -1;
+	}
+	
+	INSTR_TIME_SET_CURRENT(start);
+	
+	use_cache = (pgraft_kv_read_cache_size > 0 && strlen(key) < sizeof(entry->key));
+	
+	/* Unchanged store: answer from the backend's cache without any lock */
+	if (use_cache && kv_cache != NULL &&
+		pg_atomic_read_u64(&store->revision) == kv_cache_revision)
+	{
+		pgraft_kv_cache_entry_t *cached;
+		
+		cached = (pgraft_kv_cache_entry_t *) hash_search(kv_cache, key, HASH_FIND, NULL);
+		if (cached)
+		{
+			if (!cached->found)
+			{
+				pgraft_kv_stats_read(key, -1, start);
+				return -1;
+			}
+			strlcpy(value, cached->value, value_size);
+			if (version)
+				*version = cached->version;
+			pgraft_kv_stats_read(key, strlen(cached->value), start);
+			return 0;
+		}
+	}
+	
+	SpinLockAcquire(&store->mutex);
+	
+	revision = pg_atomic_read_u64(&store->revision);
+	entry_index = pgraft_kv_find_entry_index(key);
+	found = (entry_index >= 0);
+	
+	if (found)
+	{
+		entry = &store->entries[entry_index];
+		
+		/* Copy value; it is decompressed after the mutex is released */
+		pgraft_kv_copy_value(store, entry, &copy);
+		entry_version = entry->version;
+		entry->last_access = ++store->access_clock;
+		
+		store->hot_hits++;
+		store->gets++;
+		store->total_operations++;
+	}
+	else if (store->cold_entries > 0)
+		cold = true;
+	else
+		store->misses++;
+	
+	SpinLockRelease(&store->mutex);
+	
+	if (cold)
+	{
+		pgraft_kv_entry_t cold_entry;
+		
+		found = pgraft_kv_lookup_cold(store, key, &copy, &cold_entry);
+		if (found)
+			entry_version = cold_entry.version;
+		
+		SpinLockAcquire(&store->mutex);
+		if (found)
+		{
+			store->cold_hits++;
+			store->gets++;
+			store->total_operations++;
+		}
+		else
+			store->misses++;
+		SpinLockRelease(&store->mutex);
+	}
+	
+	if (!found)
+	{
+		if (use_cache)
+			pgraft_kv_cache_store(key, false, NULL, 0, revision);
+		pgraft_kv_stats_read(key, -1, start);
+		elog(DEBUG1, "pgraft_kv: Key '%s' not found", key);
+		return -1;  /* Key not found */
+	}
+	
+	pgraft_kv_expand_value(&copy, entry_value, sizeof(entry_value));
+	strlcpy(value, entry_value, value_size);
+	if (version)
+		*version = entry_version;
+	
+	if (use_cache)
+		pgraft_kv_cache_store(key, true, entry_value, entry_version, revision);
+	
+	pgraft_kv_stats_read(key, copy.raw_size, start);
+	
+	elog(DEBUG1, "pgraft_kv: Retrieved key '%s' (version %lld)", key, (long long)entry_version);
+	
+	return 0;  /* Success */
+}
+
+/*
+ * Delete a key that was not in shared memory, returns false if it is not
+ * in the cold tier either
+ *
+ * Like any deletion it leaves a deleted entry in shared memory, which
+ * carries the key's next version and tells the materializer.
+ */
+static bool
+pgraft_kv_delete_cold(pgraft_kv_store_t *store, const char *key, int64_t log_index)
+{
+	pgraft_kv_cold_record_t record;
+	pgraft_kv_entry_t *entry;
+	pgraft_kv_entry_t changed;
+	bool		promoted;
+	
+	LWLockAcquire(kv_cold_lock, LW_EXCLUSIVE);
+	
+	SpinLockAcquire(&store->mutex);
+	promoted = (pgraft_kv_find_entry_index(key) >= 0);
+	SpinLockRelease(&store->mutex);
+	
+	/* Brought back while we waited for the lock */
+	if (promoted)
+	{
+		LWLockRelease(kv_cold_lock);
+		return pgraft_kv_delete(key, log_index) == 0;
+	}
+	
+	if (!pgraft_kv_cold_fetch(key, &record))
+	{
+		LWLockRelease(kv_cold_lock);
+		return false;
+	}
+	
+	if (!pgraft_kv_make_room(store, 0))
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("pgraft_kv: no room to record the deletion of key '%s' in the key/value store", key)));
+	
+	SpinLockAcquire(&store->mutex);
+	
+	entry = &store->entries[store->num_entries];
+	*entry = record.entry;
+	entry->value_offset = 0;
+	entry->value_size = 0;
+	entry->raw_size = 0;
+	entry->compressed = false;
+	entry->deleted = true;
+	entry->lease = 0;
+	entry->updated_at = GetCurrentTimestamp();
+	entry->log_index = log_index;
+	entry->version++;
+	entry->last_access = ++store->access_clock;
+	store->num_entries++;
+	
+	store->deletes++;
+	store->total_operations++;
+	store->last_applied_index = Max(store->last_applied_index, log_index);
+	if (record.entry.lease != 0 && store->cold_leased > 0)
+		store->cold_leased--;
+	entry->mod_revision = pg_atomic_fetch_add_u64(&store->revision, 1) + 1;
+	pgraft_kv_hash_change(store, key, entry->kv_hash, 0);
+	entry->kv_hash = 0;
+	pgraft_kv_quota_account(key, record.entry.raw_size, -1);
+	changed = *entry;
+	
+	SpinLockRelease(&store->mutex);
+	
+	pgraft_kv_cold_forget(store, key);
+	LWLockRelease(kv_cold_lock);
+	
+	pgraft_kv_stats_write(key, true, 0);
+	
+	if (pgraft_kv_gateway_active())
+	{
+		pgraft_kv_value_copy_t prev_copy;
+		
+		pgraft_kv_copy_cold_value(&record, &prev_copy);
+		pgraft_kv_publish(&changed, NULL, &record.entry, &prev_copy);
+	}
+	
+	elog(DEBUG1, "pgraft_kv: Deleted cold key '%s'", key);
+	
+	return true;
+}
+
+/*
+ * DELETE operation - mark a key as deleted
+ */
+int
+pgraft_kv_delete(const char *key, int64_t log_index)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_entry_t *entry;
+	int entry_index;
+	int old_size;
+	bool publish = pgraft_kv_gateway_active();
+	pgraft_kv_entry_t prev;
+	pgraft_kv_value_copy_t prev_copy;
+	pgraft_kv_entry_t changed;
+	
+	if (!store || !key)
+	{
+		elog(ERROR, "pgraft_kv: invalid parameters for DELETE operation");
+		return -1;
+	}
+	
+	SpinLockAcquire(&store->mutex);
+	
+	entry_index = pgraft_kv_find_entry_index(key);
+	
+	if (entry_index < 0)
+	{
+		bool		cold = (store->cold_entries > 0);
+		
+		SpinLockRelease(&store->mutex);
+		if (cold && pgraft_kv_delete_cold(store, key, log_index))
+			return 0;
+		elog(DEBUG1, "pgraft_kv: Key '%s' not found for deletion", key);
+		return -1;  /* Key not found */
+	}
+	
+	entry = &store->entries[entry_index];
+	if (publish)
+	{
+		prev = *entry;
+		pgraft_kv_copy_value(store, entry, &prev_copy);
+	}
+	old_size = entry->raw_size;
+	pgraft_kv_arena_release(store, entry);
+	entry->deleted = true;
+	entry->lease = 0;
+	entry->updated_at = GetCurrentTimestamp();
+	entry->log_index = log_index;
+	entry->version++;
+	
+	store->deletes++;
+	store->total_operations++;
+	store->last_applied_index = Max(store->last_applied_index, log_index);
+	entry->mod_revision = pg_atomic_fetch_add_u64(&store->revision, 1) + 1;
+	pgraft_kv_hash_change(store, key, entry->kv_hash, 0);
+	entry->kv_hash = 0;
+	pgraft_kv_quota_account(key, old_size, -1);
+	changed = *entry;
+	
+	SpinLockRelease(&store->mutex);
+	
+	/* Persist to disk */
+	if (!kv_defer_save)
+		pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
+	
+	pgraft_kv_stats_write(key, true, 0);
+	
+	if (publish)
+		pgraft_kv_publish(&changed, NULL, &prev, &prev_copy);
+	
+	elog(DEBUG1, "pgraft_kv: Deleted key '%s'", key);
+	
+	return 0;
+}
+
+/*
+ * Is a jsonb value an object?
+ */
+static bool
+pgraft_kv_jsonb_is_object(const JsonbValue *v)
+{
+	return v != NULL && v->type == jbvBinary && JsonContainerIsObject(v->val.binary.data);
+}
+
+/*
+ * Point a JsonbValue at the root of a jsonb datum
+ */
+static void
+pgraft_kv_jsonb_root(Jsonb *jb, JsonbValue *v)
+{
+	if (JB_ROOT_IS_SCALAR(jb))
+	{
+		JsonbExtractScalar(&jb->root, v);
+		return;
+	}
+	
+	v->type = jbvBinary;
+	v->val.binary.data = &jb->root;
+	v->val.binary.len = VARSIZE(jb) - VARHDRSZ;
+}
+
+/*
+ * Push the RFC 7386 merge of patch into target onto a jsonb parse state
+ *
+ * patch must be an object; target may be NULL or any value, a non-object
+ * target merges as an empty object.  The result is built through jsonb so
+ * its text form (sorted keys, normalized numbers) is the same on every node.
+ */
+static JsonbValue *
+pgraft_kv_merge_patch(JsonbParseState **state, JsonbValue *target, JsonbValue *patch)
+{
+	JsonbContainer *patch_obj = patch->val.binary.data;
+	JsonbContainer *target_obj = NULL;
+	JsonbIterator *it;
+	JsonbIteratorToken token;
+	JsonbValue	key;
+	JsonbValue	value;
+	
+	if (pgraft_kv_jsonb_is_object(target))
+		target_obj = target->val.binary.data;
+	
+	pushJsonbValue(state, WJB_BEGIN_OBJECT, NULL);
+	
+	/* Members the patch does not mention are kept as they are */
+	if (target_obj != NULL)
+	{
+		it = JsonbIteratorInit(target_obj);
+		while ((token = JsonbIteratorNext(&it, &key, true)) != WJB_DONE)
+		{
+			if (token != WJB_KEY)
+				continue;
+			JsonbIteratorNext(&it, &value, true);
+			
+			if (getKeyJsonValueFromContainer(patch_obj, key.val.string.val,
+											 key.val.string.len, NULL) != NULL)
+				continue;
+			pushJsonbValue(state, WJB_KEY, &key);
+			pushJsonbValue(state, WJB_VALUE, &value);
+		}
+	}
+	
+	/* null removes a member, objects merge recursively, anything else replaces */
+	it = JsonbIteratorInit(patch_obj);
+	while ((token = JsonbIteratorNext(&it, &key, true)) != WJB_DONE)
+	{
+		JsonbValue *member = NULL;
+		
+		if (token != WJB_KEY)
+			continue;
+		JsonbIteratorNext(&it, &value, true);
+		
+		if (value.type == jbvNull)
+			continue;
+		
+		pushJsonbValue(state, WJB_KEY, &key);
+		if (!pgraft_kv_jsonb_is_object(&value))
+		{
+			pushJsonbValue(state, WJB_VALUE, &value);
+			continue;
+		}
+		
+		if (target_obj != NULL)
+			member = getKeyJsonValueFromContainer(target_obj, key.val.string.val,
+												  key.val.string.len, NULL);
+		pgraft_kv_merge_patch(state, member, &value);
+	}
+	
+	return pushJsonbValue(state, WJB_END_OBJECT, NULL);
+}
+
+/*
+ * PATCH operation - apply a JSON merge patch (RFC 7386) to a key's value
+ *
+ * Called when a replicated kv_patch entry is applied, so the outcome must
+ * depend only on the entry and the store.  A missing key patches null.  When
+ * expected_version is not -1 and differs from the key's version (0 for a
+ * missing key) the entry is skipped and 1 is returned.  A value that is not
+ * valid JSON, or a result over the value size limit, raises an error.
+ */
+int
+pgraft_kv_patch(const char *key, const char *patch, int64_t expected_version, int64_t log_index)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_entry_t *entry;
+	int entry_index;
+	bool found = false;
+	bool cold;
+	int64_t version = 0;
+	pgraft_kv_value_copy_t copy;
+	char value[PGRAFT_KV_VALUE_SIZE];
+	Jsonb	   *patch_jb;
+	JsonbValue	patch_root;
+	char	   *merged;
+	
+	if (!store || !key || !patch)
+	{
+		elog(ERROR, "pgraft_kv: invalid parameters for PATCH operation");
+		return -1;
+	}
+	
+	SpinLockAcquire(&store->mutex);
+	
+	entry_index = pgraft_kv_find_entry_index(key);
+	if (entry_index >= 0)
+	{
+		entry = &store->entries[entry_index];
+		pgraft_kv_copy_value(store, entry, &copy);
+		version = entry->version;
+		found = true;
+	}
+	cold = (!found && store->cold_entries > 0);
+	
+	SpinLockRelease(&store->mutex);
+	
+	/* A cold key is brought back by the put of its patched value */
+	if (cold)
+	{
+		pgraft_kv_entry_t cold_entry;
+		
+		found = pgraft_kv_lookup_cold(store, key, &copy, &cold_entry);
+		if (found)
+			version = cold_entry.version;
+	}
+	
+	if (found)
+		pgraft_kv_expand_value(&copy, value, sizeof(value));
+	
+	if (expected_version >= 0 && version != expected_version)
+	{
+		elog(LOG, "pgraft_kv: skipped patch of key '%s': version is %lld, expected %lld",
+			 key, (long long) version, (long long) expected_version);
+		return 1;
+	}
+	
+	patch_jb = DatumGetJsonbP(DirectFunctionCall1(jsonb_in, CStringGetDatum(patch)));
+	pgraft_kv_jsonb_root(patch_jb, &patch_root);
+	
+	if (!pgraft_kv_jsonb_is_object(&patch_root))
+	{
+		/* A non-object patch replaces the whole value */
+		merged = JsonbToCString(NULL, &patch_jb->root, VARSIZE(patch_jb));
+	}
+	else
+	{
+		JsonbParseState *state = NULL;
+		JsonbValue	target_root;
+		JsonbValue *target = NULL;
+		Jsonb	   *result;
+		
+		if (found)
+		{
+			Jsonb	   *target_jb;
+			
+			target_jb = DatumGetJsonbP(DirectFunctionCall1(jsonb_in, CStringGetDatum(value)));
+			pgraft_kv_jsonb_root(target_jb, &target_root);
+			target = &target_root;
+		}
+		
+		result = JsonbValueToJsonb(pgraft_kv_merge_patch(&state, target, &patch_root));
+		merged = JsonbToCString(NULL, &result->root, VARSIZE(result));
+	}
+	
+	if (strlen(merged) >= sizeof(value))
+	{
+		elog(ERROR, "pgraft_kv: patched value of key '%s' too long (max %zu characters, got %zu)",
+			 key, sizeof(value) - 1, strlen(merged));
+		return -1;
+	}
+	
+	return pgraft_kv_put(key, merged, 0, log_index);
+}
+
+/*
+ * Check if key exists
+ */
+bool
+pgraft_kv_exists(const char *key)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	bool exists;
+	bool cold;
+	
+	if (!store || !key)
+		return false;
+	
+	SpinLockAcquire(&store->mutex);
+	exists = (pgraft_kv_find_entry_index(key) >= 0);
+	cold = (!exists && store->cold_entries > 0);
+	SpinLockRelease(&store->mutex);
+	
+	if (cold)
+	{
+		pgraft_kv_value_copy_t copy;
+		pgraft_kv_entry_t cold_entry;
+		
+		exists = pgraft_kv_lookup_cold(store, key, &copy, &cold_entry);
+	}
+	
+	return exists;
+}
+
+/*
+ * Get statistics
+ */
+int
+pgraft_kv_get_stats(pgraft_kv_store_t *stats)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	
+	if (!store || !stats)
+		return -1;
+	
+	SpinLockAcquire(&store->mutex);
+	memcpy(stats, store, sizeof(pgraft_kv_store_t));
+	SpinLockRelease(&store->mutex);
+	
+	return 0;
+}
+
+/*
+ * Copy the storage footprint of every live key, returns the number copied
+ */
+int
+pgraft_kv_get_value_stats(pgraft_kv_value_stats_t *rows, int max_rows)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	int count = 0;
+	int i;
+	
+	if (!store || !rows)
+		return 0;
+	
+	SpinLockAcquire(&store->mutex);
+	for (i = 0; i < store->num_entries && count < max_rows; i++)
+	{
+		pgraft_kv_entry_t *entry = &store->entries[i];
+		
+		if (entry->deleted)
+			continue;
+		memcpy(rows[count].key, entry->key, sizeof(rows[count].key));
+		rows[count].version = entry->version;
+		rows[count].raw_size = entry->raw_size;
+		rows[count].stored_size = entry->value_size;
+		rows[count].compressed = entry->compressed;
+		count++;
+	}
+	SpinLockRelease(&store->mutex);
+	
+	return count;
+}
+
+/*
+ * Current store revision, and the last one at which entries were dropped
+ */
+void
+pgraft_kv_get_revisions(uint64 *revision, uint64 *resync_revision)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	
+	*revision = 0;
+	*resync_revision = 0;
+	if (!store)
+		return;
+	
+	SpinLockAcquire(&store->mutex);
+	*revision = pg_atomic_read_u64(&store->revision);
+	*resync_revision = store->resync_revision;
+	SpinLockRelease(&store->mutex);
+}
+
+/*
+ * Order change revisions ascending
+ */
+static int
+pgraft_kv_compare_revisions(const void *a, const void *b)
+{
+	uint64		revision_a = *(const uint64 *) a;
+	uint64		revision_b = *(const uint64 *) b;
+	
+	if (revision_a < revision_b)
+		return -1;
+	return revision_a > revision_b ? 1 : 0;
+}
+
+/*
+ * Changes after a revision, gathered from the cold tier by
+ * pgraft_kv_cold_changed() and pgraft_kv_cold_change()
+ */
+typedef struct pgraft_kv_change_scan
+{
+	uint64		since;
+	uint64		limit;
+	uint64	   *revisions;		/* Grown as needed */
+	int			size;
+	int			count;
+	int			max_changes;
+	pgraft_kv_change_t *changes;
+	pgraft_kv_value_copy_t *copies;
+}			pgraft_kv_change_scan_t;
+
+static void
+pgraft_kv_cold_changed(const pgraft_kv_cold_record_t *record, void *arg)
+{
+	pgraft_kv_change_scan_t *scan = (pgraft_kv_change_scan_t *) arg;
+	
+	if (record->entry.mod_revision <= scan->since)
+		return;
+	
+	if (scan->count == scan->size)
+	{
+		scan->size *= 2;
+		scan->revisions = (uint64 *) repalloc(scan->revisions, sizeof(uint64) * scan->size);
+	}
+	scan->revisions[scan->count++] = record->entry.mod_revision;
+}
+
+static void
+pgraft_kv_cold_change(const pgraft_kv_cold_record_t *record, void *arg)
+{
+	pgraft_kv_change_scan_t *scan = (pgraft_kv_change_scan_t *) arg;
+	pgraft_kv_change_t *change;
+	
+	if (record->entry.mod_revision <= scan->since || record->entry.mod_revision > scan->limit ||
+		scan->count >= scan->max_changes)
+		return;
+	
+	change = &scan->changes[scan->count];
+	memcpy(change->key, record->entry.key, sizeof(change->key));
+	change->version = record->entry.version;
+	change->created_at = record->entry.created_at;
+	change->updated_at = record->entry.updated_at;
+	change->mod_revision = record->entry.mod_revision;
+	change->deleted = false;
+	pgraft_kv_copy_cold_value(record, &scan->copies[scan->count]);
+	scan->count++;
+}
+
+/*
+ * Does the cold tier hold keys changed after since?  Caller holds the mutex.
+ */
+static bool
+pgraft_kv_cold_has_changes(pgraft_kv_store_t *store, uint64 since)
+{
+	return store->cold_entries > 0 && since < store->cold_revision;
+}
+
+/*
+ * Collect the revisions of keys changed after since, both tiers; returns
+ * the count and the palloc'd revisions in *revisions
+ *
+ * Caller holds the cold tier lock, so that no key moves between the tiers
+ * meanwhile.  Keys are evicted whether pgraft.kv has their last change or
+ * not, so the cold tier is read too whenever it holds a newer change.
+ */
+static int
+pgraft_kv_changed_revisions(pgraft_kv_store_t *store, uint64 since, uint64 **revisions,
+							uint64 *current)
+{
+	pgraft_kv_change_scan_t scan;
+	bool		cold;
+	int			i;
+	
+	memset(&scan, 0, sizeof(scan));
+	scan.since = since;
+	scan.size = lengthof(store->entries);
+	scan.revisions = (uint64 *) palloc(sizeof(uint64) * scan.size);
+	
+	SpinLockAcquire(&store->mutex);
+	*current = pg_atomic_read_u64(&store->revision);
+	cold = pgraft_kv_cold_has_changes(store, since);
+	for (i = 0; i < store->num_entries; i++)
+	{
+		if (store->entries[i].mod_revision > since)
+			scan.revisions[scan.count++] = store->entries[i].mod_revision;
+	}
+	SpinLockRelease(&store->mutex);
+	
+	if (cold)
+		pgraft_kv_cold_scan(pgraft_kv_cold_changed, &scan);
+	
+	*revisions = scan.revisions;
+	return scan.count;
+}
+
+/*
+ * Number of keys put or deleted after revision since
+ */
+int
+pgraft_kv_count_changes(uint64 since)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	uint64	   *revisions;
+	uint64		current;
+	int			count;
+	
+	if (!store)
+		return 0;
+	
+	LWLockAcquire(kv_cold_lock, LW_SHARED);
+	count = pgraft_kv_changed_revisions(store, since, &revisions, &current);
+	LWLockRelease(kv_cold_lock);
+	pfree(revisions);
+	
+	return count;
+}
+
+/*
+ * Copy out the oldest changes made after revision since
+ *
+ * At most max_changes keys are returned, in no particular order, with
+ * their values decompressed.  *through is set to the revision the changes
+ * bring a copy of the store up to: every key changed in (since, *through]
+ * is included, from whichever tier holds it.  The cold tier lock is held
+ * shared throughout, so no key moves between the tiers; values are only
+ * copied for the keys in the batch, so the mutex is held for two short
+ * passes however far behind the caller is.
+ */
+int
+pgraft_kv_collect_changes(uint64 since, int max_changes, pgraft_kv_change_t *changes,
+						  uint64 *through)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_change_scan_t scan;
+	uint64	   *revisions;
+	uint64		current;
+	uint64		limit;
+	pgraft_kv_value_copy_t *copies;
+	bool		cold;
+	int			pending;
+	int			count = 0;
+	int			i;
+	
+	*through = since;
+	if (!store || max_changes <= 0)
+		return 0;
+	
+	LWLockAcquire(kv_cold_lock, LW_SHARED);
+	
+	pending = pgraft_kv_changed_revisions(store, since, &revisions, &current);
+	if (pending == 0)
+	{
+		LWLockRelease(kv_cold_lock);
+		pfree(revisions);
+		*through = current;
+		return 0;
+	}
+	
+	/* Changes made after the first pass wait for the next call */
+	limit = current;
+	
+	/* Too many to take at once: stop at the max_changes-th oldest change */
+	if (pending > max_changes)
+	{
+		qsort(revisions, pending, sizeof(uint64), pgraft_kv_compare_revisions);
+		limit = revisions[max_changes - 1];
+	}
+	pfree(revisions);
+	
+	copies = (pgraft_kv_value_copy_t *) palloc(sizeof(pgraft_kv_value_copy_t) * max_changes);
+	
+	SpinLockAcquire(&store->mutex);
+	cold = pgraft_kv_cold_has_changes(store, since);
+	for (i = 0; i < store->num_entries && count < max_changes; i++)
+	{
+		pgraft_kv_entry_t *entry = &store->entries[i];
+		
+		if (entry->mod_revision <= since || entry->mod_revision > limit)
+			continue;
+		
+		memcpy(changes[count].key, entry->key, sizeof(changes[count].key));
+		changes[count].version = entry->version;
+		changes[count].created_at = entry->created_at;
+		changes[count].updated_at = entry->updated_at;
+		changes[count].mod_revision = entry->mod_revision;
+		changes[count].deleted = entry->deleted;
+		pgraft_kv_copy_value(store, entry, &copies[count]);
+		count++;
+	}
+	SpinLockRelease(&store->mutex);
+	
+	if (cold && count < max_changes)
+	{
+		memset(&scan, 0, sizeof(scan));
+		scan.since = since;
+		scan.limit = limit;
+		scan.count = count;
+		scan.max_changes = max_changes;
+		scan.changes = changes;
+		scan.copies = copies;
+		pgraft_kv_cold_scan(pgraft_kv_cold_change, &scan);
+		count = scan.count;
+	}
+	
+	LWLockRelease(kv_cold_lock);
+	
+	for (i = 0; i < count; i++)
+	{
+		if (changes[i].deleted)
+			changes[i].value[0] = '\0';
+		else
+			pgraft_kv_expand_value(&copies[i], changes[i].value, sizeof(changes[i].value));
+	}
+	pfree(copies);
+	
+	*through = limit;
+	return count;
+}
+
+/*
+ * Root of the hash tree after the given change, 0 for the current one
+ *
+ * Returns -1 if that change is newer than the tree or its root is no longer
+ * kept; hash_revision and compact_revision bound the changes that can be
+ * asked for.
+ */
+int
+pgraft_kv_get_hash(uint64 revision, uint64 *hash, uint64 *hash_revision, uint64 *compact_revision)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	int			result = 0;
+	
+	*hash = 0;
+	*hash_revision = 0;
+	*compact_revision = 0;
+	if (!store)
+		return -1;
+	
+	SpinLockAcquire(&store->mutex);
+	*hash_revision = store->hash_revision;
+	if (store->hash_revision >= PGRAFT_KV_HASH_HISTORY)
+		*compact_revision = store->hash_revision - PGRAFT_KV_HASH_HISTORY + 1;
+	if (revision == 0)
+		*hash = store->hash_tree[1];
+	else if (revision > *hash_revision || revision < *compact_revision)
+		result = -1;
+	else
+		*hash = store->hash_history[revision % PGRAFT_KV_HASH_HISTORY];
+	SpinLockRelease(&store->mutex);
+	
+	return result;
+}
+
+/*
+ * Copy the 2^level nodes of one level of the hash tree, level 0 being the
+ * root and PGRAFT_KV_HASH_DEPTH the leaves; returns the hash revision
+ * they were taken at
+ */
+uint64
+pgraft_kv_get_hash_level(int level, uint64 *hashes)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	uint64		revision;
+	
+	Assert(level >= 0 && level <= PGRAFT_KV_HASH_DEPTH);
+	
+	if (!store)
+	{
+		memset(hashes, 0, sizeof(uint64) << level);
+		return 0;
+	}
+	
+	SpinLockAcquire(&store->mutex);
+	memcpy(hashes, &store->hash_tree[1 << level], sizeof(uint64) << level);
+	revision = store->hash_revision;
+	SpinLockRelease(&store->mutex);
+	
+	return revision;
+}
+
+/*
+ * Length of a key's value, -1 if the key does not exist
+ */
+int
+pgraft_kv_value_size(const char *key)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_value_copy_t copy;
+	pgraft_kv_entry_t cold_entry;
+	int			entry_index;
+	int			size = -1;
+	bool		cold = false;
+	
+	if (!store)
+		return -1;
+	
+	SpinLockAcquire(&store->mutex);
+	entry_index = pgraft_kv_find_entry_index(key);
+	if (entry_index >= 0)
+		size = store->entries[entry_index].raw_size;
+	else
+		cold = (store->cold_entries > 0);
+	SpinLockRelease(&store->mutex);
+	
+	if (cold && pgraft_kv_lookup_cold(store, key, &copy, &cold_entry))
+		size = copy.raw_size;
+	
+	return size;
+}
+
+typedef struct pgraft_kv_prefix_count
+{
+	const char *prefix;
+	size_t		prefix_len;
+	int64		keys;
+	int64		bytes;
+}			pgraft_kv_prefix_count_t;
+
+static void
+pgraft_kv_count_cold(const pgraft_kv_cold_record_t *record, void *arg)
+{
+	pgraft_kv_prefix_count_t *count = (pgraft_kv_prefix_count_t *) arg;
+	
+	if (!record->entry.deleted &&
+		strncmp(record->entry.key, count->prefix, count->prefix_len) == 0)
+	{
+		count->keys++;
+		count->bytes += strlen(record->entry.key) + record->entry.raw_size;
+	}
+}
+
+/*
+ * Count the live keys starting with prefix, both tiers, and their bytes
+ * (key and value)
+ *
+ * counted() gets the result, and the resync revision it is valid for,
+ * while the store mutex is still held, so that no change can be applied
+ * between counting and recording the count; it must not do more than
+ * store a few values.
+ */
+void
+pgraft_kv_count_prefix(const char *prefix, pgraft_kv_counted_callback counted, void *arg)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_prefix_count_t count;
+	bool		cold;
+	int			i;
+	
+	if (!store)
+		return;
+	
+	memset(&count, 0, sizeof(count));
+	count.prefix = prefix;
+	count.prefix_len = strlen(prefix);
+	
+	/* Keys cannot move between the tiers while we hold the cold tier lock */
+	LWLockAcquire(kv_cold_lock, LW_SHARED);
+	
+	SpinLockAcquire(&store->mutex);
+	cold = (store->cold_entries > 0);
+	SpinLockRelease(&store->mutex);
+	
+	if (cold)
+		pgraft_kv_cold_scan(pgraft_kv_count_cold, &count);
+	
+	SpinLockAcquire(&store->mutex);
+	for (i = 0; i < store->num_entries; i++)
+	{
+		pgraft_kv_entry_t *entry = &store->entries[i];
+		
+		if (!entry->deleted && strncmp(entry->key, prefix, count.prefix_len) == 0)
+		{
+			count.keys++;
+			count.bytes += strlen(entry->key) + entry->raw_size;
+		}
+	}
+	counted(count.keys, count.bytes, store->resync_revision, arg);
+	SpinLockRelease(&store->mutex);
+	
+	LWLockRelease(kv_cold_lock);
+}
+
+/*
+ * Hand one exported entry, with its value expanded, to the caller
+ */
+static void
+pgraft_kv_export_entry(const pgraft_kv_entry_t *entry, const pgraft_kv_value_copy_t *copy,
+					   pgraft_kv_export_callback emit, void *arg)
+{
+	pgraft_kv_change_t change;
+	
+	memcpy(change.key, entry->key, sizeof(change.key));
+	change.version = entry->version;
+	change.created_at = entry->created_at;
+	change.updated_at = entry->updated_at;
+	change.mod_revision = entry->mod_revision;
+	change.deleted = entry->deleted;
+	if (entry->deleted)
+		change.value[0] = '\0';
+	else
+		pgraft_kv_expand_value(copy, change.value, sizeof(change.value));
+	
+	emit(&change, arg);
+}
+
+/*
+ * Hand every key changed after revision changed_since, both tiers, to
+ * emit(); *revision is the store revision when the export started
+ *
+ * With changed_since 0 the live keys are exported, a full snapshot;
+ * otherwise deletions are included, so that a copy taken up to
+ * changed_since can be brought up to date.  This is not a point-in-time
+ * view: the cold tier lock is only held while the hot keys are copied out
+ * and while each chunk of the cold tier is read, so that puts and
+ * evictions on the apply path are not held up for the whole export.  Every
+ * change made up to *revision is exported; a key changed after it may be
+ * exported in either state or, if it moved between the tiers, not at all,
+ * and an export from *revision picks it up.  emit() runs without any lock
+ * and may allocate or raise errors.
+ *
+ * Returns -1, exporting nothing, if deletions made after changed_since
+ * have been dropped from the store meanwhile; *horizon is then the oldest
+ * revision an incremental export can start from.
+ */
+int
+pgraft_kv_export(uint64 changed_since, pgraft_kv_export_callback emit, void *arg,
+				 uint64 *revision, uint64 *horizon)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_cold_cursor_t cursor;
+	pgraft_kv_entry_t *entries;
+	pgraft_kv_value_copy_t *copies;
+	bool		cold = false;
+	int			count = 0;
+	int			i;
+	
+	*revision = 0;
+	*horizon = 0;
+	cursor.fd = -1;
+	if (!store)
+		return 0;
+	
+	entries = (pgraft_kv_entry_t *) palloc(sizeof(pgraft_kv_entry_t) * lengthof(store->entries));
+	copies = (pgraft_kv_value_copy_t *) palloc(sizeof(pgraft_kv_value_copy_t) * lengthof(store->entries));
+	
+	/* Under the lock no key moves between the tiers while both are opened */
+	LWLockAcquire(kv_cold_lock, LW_SHARED);
+	
+	SpinLockAcquire(&store->mutex);
+	*revision = pg_atomic_read_u64(&store->revision);
+	*horizon = Max(store->resync_revision, store->purged_revision);
+	if (changed_since > 0 && changed_since < *horizon)
+	{
+		SpinLockRelease(&store->mutex);
+		LWLockRelease(kv_cold_lock);
+		pfree(entries);
+		pfree(copies);
+		return -1;
+	}
+	cold = (store->cold_entries > 0);
+	for (i = 0; i < store->num_entries; i++)
+	{
+		pgraft_kv_entry_t *entry = &store->entries[i];
+		
+		if (entry->mod_revision <= changed_since || (changed_since == 0 && entry->deleted))
+			continue;
+		
+		entries[count] = *entry;
+		pgraft_kv_copy_value(store, entry, &copies[count]);
+		count++;
+	}
+	SpinLockRelease(&store->mutex);
+	
+	if (cold)
+		cold = pgraft_kv_cold_cursor_open(&cursor);
+	
+	LWLockRelease(kv_cold_lock);
+	
+	PG_TRY();
+	{
+		for (i = 0; i < count; i++)
+			pgraft_kv_export_entry(&entries[i], &copies[i], emit, arg);
+		
+		while (cold)
+		{
+			CHECK_FOR_INTERRUPTS();
+			
+			/* Only while reading: a put or eviction may write the slots */
+			LWLockAcquire(kv_cold_lock, LW_SHARED);
+			cold = pgraft_kv_cold_cursor_next(&cursor);
+			LWLockRelease(kv_cold_lock);
+			
+			for (i = 0; i < cursor.count; i++)
+			{
+				pgraft_kv_cold_record_t *record = &cursor.records[i];
+				pgraft_kv_value_copy_t copy;
+				
+				if (record->entry.deleted || record->entry.mod_revision <= changed_since)
+					continue;
+				
+				pgraft_kv_copy_cold_value(record, &copy);
+				pgraft_kv_export_entry(&record->entry, &copy, emit, arg);
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		if (cursor.fd >= 0)
+			pgraft_kv_cold_cursor_close(&cursor);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	
+	if (cursor.fd >= 0)
+		pgraft_kv_cold_cursor_close(&cursor);
+	pfree(entries);
+	pfree(copies);
+	
+	return 0;
+}
+
+/*
+ * Read a key, with its metadata, from either tier for the client gateway;
+ * returns false if it does not exist
+ *
+ * Unlike pgraft_kv_get() this is not counted as a read and does not touch
+ * the read cache.  value may be NULL when only the metadata is wanted.
+ */
+bool
+pgraft_kv_read(const char *key, pgraft_kv_entry_t *entry, char *value, size_t value_size)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_value_copy_t copy;
+	int			entry_index;
+	bool		found = false;
+	bool		cold = false;
+	
+	if (!store || !key)
+		return false;
+	
+	SpinLockAcquire(&store->mutex);
+	entry_index = pgraft_kv_find_entry_index(key);
+	if (entry_index >= 0)
+	{
+		*entry = store->entries[entry_index];
+		found = !entry->deleted;
+		if (found)
+			pgraft_kv_copy_value(store, entry, &copy);
+	}
+	else
+		cold = (store->cold_entries > 0);
+	SpinLockRelease(&store->mutex);
+	
+	if (cold && pgraft_kv_lookup_cold(store, key, &copy, entry))
+		found = !entry->deleted;
+	
+	if (found && value != NULL)
+		pgraft_kv_expand_value(&copy, value, value_size);
+	
+	return found;
+}
+
+/* Keys collected by pgraft_kv_range() */
+typedef struct pgraft_kv_key_list
+{
+	char	  **keys;
+	int64		count;
+	int64		allocated;
+}			pgraft_kv_key_list_t;
+
+static void
+pgraft_kv_key_list_add(pgraft_kv_key_list_t *list, const char *key)
+{
+	if (list->count == list->allocated)
+	{
+		list->allocated *= 2;
+		list->keys = (char **) repalloc(list->keys, sizeof(char *) * list->allocated);
+	}
+	list->keys[list->count++] = pstrdup(key);
+}
+
+static int
+pgraft_kv_compare_keys(const void *a, const void *b)
+{
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/*
+ * Is key in [start, end)?  An empty end has no upper bound.
+ */
+static bool
+pgraft_kv_key_in_range(const char *key, const char *start, const char *end)
+{
+	return strcmp(key, start) >= 0 && (end[0] == '\0' || strcmp(key, end) < 0);
+}
+
+/*
+ * Hand the live keys in [start, end), both tiers, in key order to emit();
+ * returns how many there are
+ *
+ * end NULL reads the key start alone; an empty end reads every key from
+ * start on.  Only the first limit keys are handed over, all of them with
+ * limit 0, and none with emit NULL; with keys_only their values are not
+ * read.  *revision is the Raft log index the result reflects.  Meant for
+ * the worker, the only process that changes the store, so the result is
+ * consistent; emit() runs without any lock.
+ */
+int64
+pgraft_kv_range(const char *start, const char *end, int64 limit, bool keys_only,
+				pgraft_kv_read_callback emit, void *arg, uint64 *revision)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_key_list_t list;
+	pgraft_kv_cold_cursor_t cursor;
+	pgraft_kv_entry_t entry;
+	char		(*hot_keys)[sizeof(entry.key)];
+	int			hot_count = 0;
+	char	   *value;
+	bool		cold;
+	int64		emitted = 0;
+	int64		unique = 0;
+	int64		i;
+	
+	*revision = 0;
+	if (!store || !start)
+		return 0;
+	
+	value = keys_only ? NULL : palloc(PGRAFT_KV_VALUE_SIZE);
+	
+	if (end == NULL)
+	{
+		SpinLockAcquire(&store->mutex);
+		*revision = store->last_applied_index;
+		SpinLockRelease(&store->mutex);
+		
+		if (pgraft_kv_read(start, &entry, value, PGRAFT_KV_VALUE_SIZE))
+		{
+			if (emit != NULL)
+				emit(&entry, value, arg);
+			unique = 1;
+		}
+		if (value != NULL)
+			pfree(value);
+		return unique;
+	}
+	
+	list.allocated = 64;
+	list.count = 0;
+	list.keys = (char **) palloc(sizeof(char *) * list.allocated);
+	hot_keys = palloc(sizeof(*hot_keys) * lengthof(store->entries));
+	cursor.fd = -1;
+	
+	LWLockAcquire(kv_cold_lock, LW_SHARED);
+	
+	SpinLockAcquire(&store->mutex);
+	*revision = store->last_applied_index;
+	cold = (store->cold_entries > 0);
+	for (i = 0; i < store->num_entries; i++)
+	{
+		pgraft_kv_entry_t *hot = &store->entries[i];
+		
+		if (!hot->deleted && pgraft_kv_key_in_range(hot->key, start, end))
+			memcpy(hot_keys[hot_count++], hot->key, sizeof(hot->key));
+	}
+	SpinLockRelease(&store->mutex);
+	
+	for (i = 0; i < hot_count; i++)
+		pgraft_kv_key_list_add(&list, hot_keys[i]);
+	pfree(hot_keys);
+	
+	if (cold)
+		cold = pgraft_kv_cold_cursor_open(&cursor);
+	
+	PG_TRY();
+	{
+		while (cold)
+		{
+			cold = pgraft_kv_cold_cursor_next(&cursor);
+			
+			for (i = 0; i < cursor.count; i++)
+			{
+				pgraft_kv_cold_record_t *record = &cursor.records[i];
+				
+				if (!record->entry.deleted && pgraft_kv_key_in_range(record->entry.key, start, end))
+					pgraft_kv_key_list_add(&list, record->entry.key);
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		if (cursor.fd >= 0)
+			pgraft_kv_cold_cursor_close(&cursor);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	
+	if (cursor.fd >= 0)
+		pgraft_kv_cold_cursor_close(&cursor);
+	LWLockRelease(kv_cold_lock);
+	
+	/* A key being moved between the tiers can be seen in both */
+	if (list.count > 1)
+		qsort(list.keys, list.count, sizeof(char *), pgraft_kv_compare_keys);
+	for (i = 0; i < list.count; i++)
+	{
+		if (unique > 0 && strcmp(list.keys[unique - 1], list.keys[i]) == 0)
+			continue;
+		list.keys[unique++] = list.keys[i];
+	}
+	
+	for (i = 0; i < unique && emit != NULL && (limit <= 0 || emitted < limit); i++)
+	{
+		if (!pgraft_kv_read(list.keys[i], &entry, value, PGRAFT_KV_VALUE_SIZE))
+			continue;
+		emit(&entry, value, arg);
+		emitted++;
+	}
+	
+	if (value != NULL)
+		pfree(value);
+	pfree(list.keys);
+	
+	return unique;
+}
+
+/*
+ * Hand every live key attached to a lease, both tiers, to visit(), without
+ * its value
+ *
+ * The cold tier is only read if keys were leased when they were evicted;
+ * a full read of it counts them again.  Meant for the worker.
+ */
+void
+pgraft_kv_scan_leased(pgraft_kv_read_callback visit, void *arg)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_entry_t *entries;
+	pgraft_kv_cold_cursor_t cursor;
+	bool		cold;
+	int64		cold_leased = 0;
+	int			count = 0;
+	int			i;
+	
+	if (!store)
+		return;
+	
+	entries = (pgraft_kv_entry_t *) palloc(sizeof(pgraft_kv_entry_t) * lengthof(store->entries));
+	cursor.fd = -1;
+	
+	LWLockAcquire(kv_cold_lock, LW_SHARED);
+	
+	SpinLockAcquire(&store->mutex);
+	cold = (store->cold_entries > 0 && store->cold_leased > 0);
+	for (i = 0; i < store->num_entries; i++)
+	{
+		if (!store->entries[i].deleted && store->entries[i].lease != 0)
+			entries[count++] = store->entries[i];
+	}
+	SpinLockRelease(&store->mutex);
+	
+	if (cold)
+		cold = pgraft_kv_cold_cursor_open(&cursor);
+	
+	PG_TRY();
+	{
+		for (i = 0; i < count; i++)
+			visit(&entries[i], NULL, arg);
+		
+		while (cold)
+		{
+			cold = pgraft_kv_cold_cursor_next(&cursor);
+			
+			for (i = 0; i < cursor.count; i++)
+			{
+				pgraft_kv_cold_record_t *record = &cursor.records[i];
+				
+				if (record->entry.deleted || record->entry.lease == 0)
+					continue;
+				cold_leased++;
+				visit(&record->entry, NULL, arg);
+			}
+		}
+	}
+	PG_CATCH();
+	{
+		if (cursor.fd >= 0)
+			pgraft_kv_cold_cursor_close(&cursor);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	
+	if (cursor.fd >= 0)
+	{
+		pgraft_kv_cold_cursor_close(&cursor);
+		SpinLockAcquire(&store->mutex);
+		store->cold_leased = cold_leased;
+		SpinLockRelease(&store->mutex);
+	}
+	LWLockRelease(kv_cold_lock);
+	
+	pfree(entries);
+}
+
+/*
+ * Hold back saving the store after every change, for a group of changes
+ * applied together; the store is saved when they are done
+ */
+void
+pgraft_kv_defer_save(bool defer)
+{
+	kv_defer_save = defer;
+	if (!defer)
+		pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
+}
+
+/*
+ * Lease slot with the given id, live or revoked; caller holds the mutex
+ */
+static pgraft_kv_lease_t *
+pgraft_kv_find_lease(pgraft_kv_store_t *store, int64_t id)
+{
+	int			i;
+	
+	for (i = 0; i < PGRAFT_KV_MAX_LEASES; i++)
+	{
+		if (store->leases[i].id == id)
+			return &store->leases[i];
+	}
+	return NULL;
+}
+
+/*
+ * Grant a client gateway lease at the proposer's timestamp now; returns
+ * false if it is already live or no slot is left
+ *
+ * A revoked lease's slot is reused once no free one is left, the oldest
+ * revocation first; its keys have long been deleted by then.
+ */
+bool
+pgraft_kv_lease_grant(int64_t id, int64_t ttl, int64_t now)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	pgraft_kv_lease_t *lease;
+	int			i;
+	
+	if (!store || id == 0 || ttl <= 0)
+		return false;
+	
+	SpinLockAcquire(&store->mutex);
+	lease = pgraft_kv_find_lease(store, id);
+	if (lease != NULL && lease->revoked_index == 0)
+	{
+		SpinLockRelease(&store->mutex);
+		return false;
 	}
-	else
+	if (lease == NULL)
+		lease = pgraft_kv_find_lease(store, 0);
+	for (i = 0; lease == NULL && i < PGRAFT_KV_MAX_LEASES; i++)
 	{
-		/* Create new entry */
-		if (store->num_entries >= 1000)
+		/* No free slot: the earliest revoked one */
+		pgraft_kv_lease_t *candidate = &store->leases[i];
+		int			j;
+		
+		if (candidate->revoked_index == 0)
+			continue;
+		for (j = i + 1; j < PGRAFT_KV_MAX_LEASES; j++)
 		{
-			SpinLockRelease(&store->mutex);
-			elog(ERROR, "pgraft_kv: key/value store is full (1000 entries)");
-			return -1;
+			if (store->leases[j].revoked_index != 0 &&
+				store->leases[j].revoked_index < candidate->revoked_index)
+				candidate = &store->leases[j];
 		}
-		
-		entry = &store->entries[store->num_entries];
-		strncpy(entry->key, key, sizeof(entry->key) - 1);
-		entry->key[sizeof(entry->key) - 1] = '\0';
-		strncpy(entry->value, value, sizeof(entry->value) - 1);
-		entry->value[sizeof(entry->value) - 1] = '\0';
-		entry->version = 1;
-		entry->created_at = timestamp;
-		entry->updated_at = timestamp;
-		entry->log_index = log_index;
-		entry->deleted = false;
-		
-		store->num_entries++;
-		
-		elog(DEBUG1, "pgraft_kv: Created new key '%s'", key);
+		lease = candidate;
+	}
+	if (lease == NULL)
+	{
+		SpinLockRelease(&store->mutex);
+		return false;
 	}
 	
-	store->puts++;
-	store->total_operations++;
-	store->last_applied_index = log_index;
-	
+	lease->id = id;
+	lease->ttl = ttl;
+	lease->expires_at = now + ttl * USECS_PER_SEC;
+	lease->revoked_index = 0;
 	SpinLockRelease(&store->mutex);
 	
-	/* Persist to disk */
-	pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
-	
-	return 0;
+	if (!kv_defer_save)
+		pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
+	return true;
 }
 
 /*
- * GET operation - retrieve value for a key
+ * Renew a live lease at the proposer's timestamp now; returns false if it
+ * is not live
  */
-int
-pgraft_kv_get(const char *key, char *value, size_t value_size, int64_t *version)
+bool
+pgraft_kv_lease_keepalive(int64_t id, int64_t now)
 {
 	pgraft_kv_store_t *store = pgraft_kv_get_store();
-	pgraft_kv_entry_t *entry;
-	int entry_index;
+	pgraft_kv_lease_t *lease;
 	
-	if (!store || !key || !value)
-	{
-		elog(ERROR, "pgraft_kv: invalid parameters for GET operation");
-		return -1;
-	}
+	if (!store || id == 0)
+		return false;
 	
 	SpinLockAcquire(&store->mutex);
-	
-	entry_index = pgraft_kv_find_entry_index(key);
-	
-	if (entry_index < 0)
+	lease = pgraft_kv_find_lease(store, id);
+	if (lease == NULL || lease->revoked_index != 0)
 	{
 		SpinLockRelease(&store->mutex);
-		elog(DEBUG1, "pgraft_kv: Key '%s' not found", key);
-		return -1;  /* Key not found */
+		return false;
 	}
-	
-	entry = &store->entries[entry_index];
-	
-	/* Copy value */
-	strncpy(value, entry->value, value_size - 1);
-	value[value_size - 1] = '\0';
-	
-	if (version)
-		*version = entry->version;
-	
-	store->gets++;
-	store->total_operations++;
-	
+	lease->expires_at = Max(lease->expires_at, now + lease->ttl * USECS_PER_SEC);
 	SpinLockRelease(&store->mutex);
 	
-	elog(DEBUG1, "pgraft_kv: Retrieved key '%s' (version %lld)", key, (long long)entry->version);
-	
-	return 0;  /* Success */
+	if (!kv_defer_save)
+		pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
+	return true;
 }
 
 /*
- * DELETE operation - mark a key as deleted
+ * Revoke a live lease by the entry at log_index; with expire, only if it
+ * has expired by the proposer's timestamp now, as a keepalive may have
+ * been applied since the expiry was proposed.  Returns false if nothing
+ * was revoked.
  */
-int
-pgraft_kv_delete(const char *key, int64_t log_index)
+bool
+pgraft_kv_lease_revoke(int64_t id, int64_t now, bool expire, int64_t log_index)
 {
 	pgraft_kv_store_t *store = pgraft_kv_get_store();
-	pgraft_kv_entry_t *entry;
-	int entry_index;
+	pgraft_kv_lease_t *lease;
 	
-	if (!store || !key)
-	{
-		elog(ERROR, "pgraft_kv: invalid parameters for DELETE operation");
-		return -1;
-	}
+	if (!store || id == 0)
+		return false;
 	
 	SpinLockAcquire(&store->mutex);
-	
-	entry_index = pgraft_kv_find_entry_index(key);
-	
-	if (entry_index < 0)
+	lease = pgraft_kv_find_lease(store, id);
+	if (lease == NULL || lease->revoked_index != 0 || (expire && now < lease->expires_at))
 	{
 		SpinLockRelease(&store->mutex);
-		elog(DEBUG1, "pgraft_kv: Key '%s' not found for deletion", key);
-		return -1;  /* Key not found */
+		return false;
 	}
-	
-	entry = &store->entries[entry_index];
-	entry->deleted = true;
-	entry->updated_at = GetCurrentTimestamp();
-	entry->log_index = log_index;
-	entry->version++;
-	
-	store->deletes++;
-	store->total_operations++;
-	store->last_applied_index = log_index;
-	
+	lease->revoked_index = Max(log_index, 1);
 	SpinLockRelease(&store->mutex);
 	
-	/* Persist to disk */
-	pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
-	
-	elog(DEBUG1, "pgraft_kv: Deleted key '%s'", key);
-	
-	return 0;
+	if (!kv_defer_save)
+		pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
+	return true;
 }
 
 /*
- * Check if key exists
+ * Copy a live lease; returns false if it is not live
  */
 bool
-pgraft_kv_exists(const char *key)
+pgraft_kv_lease_get(int64_t id, pgraft_kv_lease_t *lease)
 {
 	pgraft_kv_store_t *store = pgraft_kv_get_store();
-	bool exists;
+	pgraft_kv_lease_t *found;
 	
-	if (!store || !key)
+	if (!store || id == 0)
 		return false;
 	
 	SpinLockAcquire(&store->mutex);
-	exists = (pgraft_kv_find_entry_index(key) >= 0);
+	found = pgraft_kv_find_lease(store, id);
+	if (found != NULL && found->revoked_index == 0)
+		*lease = *found;
+	else
+		found = NULL;
 	SpinLockRelease(&store->mutex);
 	
-	return exists;
+	return found != NULL;
 }
 
 /*
- * Get statistics
+ * Copy up to max_leases live leases; returns how many were copied
  */
 int
-pgraft_kv_get_stats(pgraft_kv_store_t *stats)
+pgraft_kv_lease_list(pgraft_kv_lease_t *leases, int max_leases)
 {
 	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	int			count = 0;
+	int			i;
 	
-	if (!store || !stats)
-		return -1;
+	if (!store)
+		return 0;
 	
 	SpinLockAcquire(&store->mutex);
-	memcpy(stats, store, sizeof(pgraft_kv_store_t));
+	for (i = 0; i < PGRAFT_KV_MAX_LEASES && count < max_leases; i++)
+	{
+		if (store->leases[i].id != 0 && store->leases[i].revoked_index == 0)
+			leases[count++] = store->leases[i];
+	}
 	SpinLockRelease(&store->mutex);
 	
-	return 0;
+	return count;
 }
 
 /*
  * Save key/value store to disk for persistence
+ *
+ * The file holds the store header followed by the used part of the arena,
+ * so compressed values stay compressed on disk.
  */
 int
 pgraft_kv_save_to_disk(const char *path)
 {
 	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	char *image;
+	Size image_size;
 	FILE *file;
 	size_t written;
 	
 	if (!store || !path)
 		return -1;
 	
+	/* Snapshot under the mutex, write without it; retry if the arena grew */
+	for (;;)
+	{
+		Size		allocated = PGRAFT_KV_STORE_HEADER_SIZE + store->arena_used;
+		
+		image = palloc(allocated);
+		
+		SpinLockAcquire(&store->mutex);
+		image_size = PGRAFT_KV_STORE_HEADER_SIZE + store->arena_used;
+		if (image_size <= allocated)
+			memcpy(image, store, image_size);
+		SpinLockRelease(&store->mutex);
+		
+		if (image_size <= allocated)
+			break;
+		pfree(image);
+	}
+	
 	file = fopen(path, "wb");
 	if (!file)
 	{
 		elog(WARNING, "pgraft_kv: failed to open file for writing: %s", path);
+		pfree(image);
 		return -1;
 	}
 	
-	SpinLockAcquire(&store->mutex);
-	
-	/* Write the entire store structure */
-	written = fwrite(store, sizeof(pgraft_kv_store_t), 1, file);
-	
-	SpinLockRelease(&store->mutex);
-	
+	written = fwrite(image, image_size, 1, file);
 	fclose(file);
+	pfree(image);
 	
 	if (written != 1)
 	{
@@ -457,20 +2755,26 @@ pgraft_kv_save_to_disk(const char *path)
 		return -1;
 	}
 	
-	elog(DEBUG1, "pgraft_kv: Saved store to disk (%d entries)", store->num_entries);
+	elog(DEBUG1, "pgraft_kv: Saved store to disk (%d entries, %zu bytes)", store->num_entries, image_size);
 	return 0;
 }
 
 /*
  * Load key/value store from disk
+ *
+ * A file whose size does not match its header, or whose values do not fit
+ * this server's arena, is ignored.
  */
 int
 pgraft_kv_load_from_disk(const char *path)
 {
 	pgraft_kv_store_t *store = pgraft_kv_get_store();
-	pgraft_kv_store_t temp_store;
+	pgraft_kv_store_t *temp_store;
 	FILE *file;
+	long file_size;
 	size_t read_size;
+	uint64 max_revision;
+	int i;
 	
 	if (!store || !path)
 		return -1;
@@ -483,29 +2787,83 @@ pgraft_kv_load_from_disk(const char *path)
 		return -1;
 	}
 	
+	if (fseek(file, 0, SEEK_END) != 0 || (file_size = ftell(file)) < 0 ||
+		fseek(file, 0, SEEK_SET) != 0 ||
+		file_size < (long) PGRAFT_KV_STORE_HEADER_SIZE ||
+		file_size > (long) (PGRAFT_KV_STORE_HEADER_SIZE + store->arena_size))
+	{
+		fclose(file);
+		elog(WARNING, "pgraft_kv: ignoring store file %s: unexpected size", path);
+		return -1;
+	}
+	
 	/* Read into temporary structure first */
-	read_size = fread(&temp_store, sizeof(pgraft_kv_store_t), 1, file);
+	temp_store = palloc(file_size);
+	read_size = fread(temp_store, file_size, 1, file);
 	fclose(file);
 	
 	if (read_size != 1)
 	{
 		elog(WARNING, "pgraft_kv: failed to read store from disk");
+		pfree(temp_store);
+		return -1;
+	}
+	
+	if (temp_store->num_entries < 0 || temp_store->num_entries > (int32_t) lengthof(temp_store->entries) ||
+		(long) (PGRAFT_KV_STORE_HEADER_SIZE + temp_store->arena_used) != file_size)
+	{
+		elog(WARNING, "pgraft_kv: ignoring store file %s: inconsistent header", path);
+		pfree(temp_store);
 		return -1;
 	}
 	
+	for (i = 0; i < temp_store->num_entries; i++)
+	{
+		pgraft_kv_entry_t *entry = &temp_store->entries[i];
+		
+		if ((uint64) entry->value_offset + entry->value_size > temp_store->arena_used ||
+			entry->raw_size >= PGRAFT_KV_VALUE_SIZE)
+		{
+			elog(WARNING, "pgraft_kv: ignoring store file %s: value of entry %d out of bounds", path, i);
+			pfree(temp_store);
+			return -1;
+		}
+	}
+	
 	SpinLockAcquire(&store->mutex);
 	
 	/* Copy data except the mutex */
-	memcpy(store->entries, temp_store.entries, sizeof(store->entries));
-	store->num_entries = temp_store.num_entries;
-	store->total_operations = temp_store.total_operations;
-	store->last_applied_index = temp_store.last_applied_index;
-	store->puts = temp_store.puts;
-	store->deletes = temp_store.deletes;
-	store->gets = temp_store.gets;
+	memcpy(store->entries, temp_store->entries, sizeof(store->entries));
+	store->num_entries = temp_store->num_entries;
+	store->total_operations = temp_store->total_operations;
+	store->last_applied_index = temp_store->last_applied_index;
+	store->puts = temp_store->puts;
+	store->deletes = temp_store->deletes;
+	store->gets = temp_store->gets;
+	memcpy(store->arena, temp_store->arena, temp_store->arena_used);
+	store->arena_used = temp_store->arena_used;
+	store->arena_live = temp_store->arena_live;
+	store->defrag_active = false;
+	store->defrag_cursor = 0;
+	memcpy(store->hash_tree, temp_store->hash_tree, sizeof(store->hash_tree));
+	store->hash_revision = temp_store->hash_revision;
+	memcpy(store->hash_history, temp_store->hash_history, sizeof(store->hash_history));
+	memcpy(store->leases, temp_store->leases, sizeof(store->leases));
+	
+	/* Carry on above the revisions the saved entries, cold ones included, were changed at */
+	max_revision = pg_atomic_read_u64(&temp_store->revision);
+	for (i = 0; i < store->num_entries; i++)
+	{
+		max_revision = Max(max_revision, store->entries[i].mod_revision);
+		store->access_clock = Max(store->access_clock, store->entries[i].last_access);
+	}
+	pg_atomic_write_u64(&store->revision, Max(max_revision, pg_atomic_read_u64(&store->revision)) + 1);
+	store->resync_revision = pg_atomic_read_u64(&store->revision);
 	
 	SpinLockRelease(&store->mutex);
 	
+	pfree(temp_store);
+	
 	elog(INFO, "pgraft_kv: loaded store from disk (%d entries)", store->num_entries);
 	return 0;
 }
@@ -563,6 +2921,12 @@ pgraft_kv_compact(void)
 	
 	store->num_entries = j;
 	
+	/* Close the holes deleted and rewritten values left in the arena */
+	pgraft_kv_arena_compact(store);
+	
+	/* Deletions dropped here can no longer be seen by the materializer */
+	store->resync_revision = pg_atomic_fetch_add_u64(&store->revision, 1) + 1;
+	
 	SpinLockRelease(&store->mutex);
 	
 	/* Persist the compacted store */
@@ -571,6 +2935,130 @@ pgraft_kv_compact(void)
 	elog(INFO, "pgraft_kv: compacted store to %d active entries", j);
 }
 
+/*
+ * Background defragmentation
+ *
+ * Deleted entries, and the holes deleted and rewritten values leave in the
+ * arena, are reclaimed by the worker a little at a time instead of by a
+ * compaction that holds the mutex over the whole store.  Each unit of work,
+ * dropping one deleted entry or moving one value down, takes the mutex on
+ * its own.  Readers only touch the arena under the mutex, so a value's
+ * offset is never seen half updated; and since no key changes, the store
+ * revision, which backends' read caches check, is left alone.
+ */
+
+/*
+ * Is the store fragmented past pgraft.kv_defrag_threshold?  Caller holds
+ * the mutex.
+ */
+static bool
+pgraft_kv_is_fragmented(pgraft_kv_store_t *store)
+{
+	uint64		horizon = pgraft_kv_purgeable_revision(store);
+	uint64		holes = store->arena_used - store->arena_live;
+	int			purgeable = 0;
+	int			i;
+	
+	if (pgraft_kv_defrag_threshold == 0)
+		return false;
+	if (holes > 0 && holes * 100 >= (uint64) store->arena_used * pgraft_kv_defrag_threshold)
+		return true;
+	
+	/* Only deletions pgraft.kv already has count, others cannot be dropped yet */
+	for (i = 0; i < store->num_entries; i++)
+	{
+		if (store->entries[i].deleted && store->entries[i].mod_revision <= horizon)
+			purgeable++;
+	}
+	return purgeable > 0 && purgeable * 100 >= store->num_entries * pgraft_kv_defrag_threshold;
+}
+
+/*
+ * One unit of a defragmentation pass; caller holds the mutex
+ *
+ * Drops a deleted entry if there is one that may go, otherwise moves the
+ * lowest value above the cursor down to it.  Returns false, ending the
+ * pass, once no value is left above the cursor.  New values are appended
+ * at the end of the arena and rewrites only shrink values in place, so the
+ * space between the cursor and the next value is always free.
+ */
+static bool
+pgraft_kv_defrag_unit(pgraft_kv_store_t *store)
+{
+	uint64		horizon = pgraft_kv_purgeable_revision(store);
+	pgraft_kv_entry_t *entry;
+	int			next = -1;
+	int			i;
+	
+	for (i = 0; i < store->num_entries; i++)
+	{
+		entry = &store->entries[i];
+		
+		if (entry->deleted && entry->mod_revision <= horizon)
+		{
+			pgraft_kv_remove_entry(store, i);
+			store->defrag_purged++;
+			return true;
+		}
+		if (entry->value_size > 0 && entry->value_offset >= store->defrag_cursor &&
+			(next < 0 || entry->value_offset < store->entries[next].value_offset))
+			next = i;
+	}
+	
+	if (next < 0)
+	{
+		store->arena_used = store->defrag_cursor;
+		store->defrag_active = false;
+		return false;
+	}
+	
+	entry = &store->entries[next];
+	if (entry->value_offset != store->defrag_cursor)
+	{
+		memmove(store->arena + store->defrag_cursor, store->arena + entry->value_offset, entry->value_size);
+		entry->value_offset = store->defrag_cursor;
+		store->defrag_relocations++;
+		store->defrag_bytes_moved += entry->value_size;
+	}
+	store->defrag_cursor += entry->value_size;
+	return true;
+}
+
+/*
+ * Take one step of background defragmentation, called by the worker
+ *
+ * A pass starts when the store is fragmented past pgraft.kv_defrag_threshold
+ * and advances by up to pgraft.kv_defrag_step units per call.
+ */
+void
+pgraft_kv_defragment(void)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	bool		active;
+	int			i;
+	
+	if (!store)
+		return;
+	
+	SpinLockAcquire(&store->mutex);
+	if (!store->defrag_active && pgraft_kv_is_fragmented(store))
+	{
+		store->defrag_active = true;
+		store->defrag_cursor = 0;
+		store->defrag_passes++;
+	}
+	active = store->defrag_active;
+	SpinLockRelease(&store->mutex);
+	
+	for (i = 0; active && i < pgraft_kv_defrag_step; i++)
+	{
+		SpinLockAcquire(&store->mutex);
+		/* A full compaction may have finished the pass for us */
+		active = store->defrag_active && pgraft_kv_defrag_unit(store);
+		SpinLockRelease(&store->mutex);
+	}
+}
+
 /*
  * Reset the store
  */
@@ -582,6 +3070,7 @@ pgraft_kv_reset(void)
 	if (!store)
 		return;
 	
+	LWLockAcquire(kv_cold_lock, LW_EXCLUSIVE);
 	SpinLockAcquire(&store->mutex);
 	
 	memset(store->entries, 0, sizeof(store->entries));
@@ -591,41 +3080,92 @@ pgraft_kv_reset(void)
 	store->puts = 0;
 	store->deletes = 0;
 	store->gets = 0;
+	store->arena_used = 0;
+	store->arena_live = 0;
+	store->cold_entries = 0;
+	store->cold_revision = 0;
+	store->hot_hits = 0;
+	store->cold_hits = 0;
+	store->misses = 0;
+	store->evictions = 0;
+	store->promotions = 0;
+	store->cold_leased = 0;
+	memset(store->leases, 0, sizeof(store->leases));
+	store->defrag_active = false;
+	store->defrag_cursor = 0;
+	store->defrag_passes = 0;
+	store->defrag_relocations = 0;
+	store->defrag_bytes_moved = 0;
+	store->defrag_purged = 0;
+	store->full_compactions = 0;
+	memset(store->hash_tree, 0, sizeof(store->hash_tree));
+	store->hash_revision = 0;
+	memset(store->hash_history, 0, sizeof(store->hash_history));
+	store->purged_revision = 0;
+	store->resync_revision = pg_atomic_fetch_add_u64(&store->revision, 1) + 1;
 	
 	SpinLockRelease(&store->mutex);
 	
-	/* Remove persistence file */
+	/* Remove persistence files */
 	unlink(PGRAFT_KV_PERSIST_FILE);
+	pgraft_kv_cold_reset();
+	LWLockRelease(kv_cold_lock);
 	
 	elog(INFO, "pgraft_kv: store reset");
 }
 
+/*
+ * Raft group owning a key
+ *
+ * Keys are hash-partitioned across pgraft.raft_groups groups; with a single
+ * group everything lives in group 0.  The Go client gateway calls this from
+ * its own threads, so it must not allocate or report errors.
+ */
+int
+pgraft_kv_group_for_key(const char *key)
+{
+	if (pgraft_raft_groups <= 1 || key == NULL)
+		return 0;
+	
+	return (int) (hash_bytes((const unsigned char *) key, strlen(key)) % (uint32) pgraft_raft_groups);
+}
+
 /*
  * Queue KV operation for background worker to process through Raft
+ *
+ * For PGRAFT_KV_PATCH value is the merge patch and expected_version the key
+ * version it is conditional on (-1 for none); other operations pass -1.
  */
 int
-pgraft_kv_queue_operation(pgraft_kv_op_type_t op_type, const char *key, const char *value, const char *client_id)
+pgraft_kv_queue_operation(pgraft_kv_op_type_t op_type, const char *key, const char *value,
+						  int64_t expected_version, const char *client_id)
 {
-	pgraft_cluster_t *cluster_state;
 	bool is_leader = false;
 	COMMAND_TYPE cmd_type;
 	bool queued = false;
-	
-	/* Get cluster state from shared memory */
-	cluster_state = pgraft_core_get_shared_memory();
-	if (!cluster_state) {
-		elog(ERROR, "pgraft_kv: cannot access cluster state");
-		return -1;
-	}
+	int32_t term;
+	int64_t leader_id;
+	char leader_address[256];
+	int group;
+	uint64 command_id = 0;
+	char json_data[PGRAFT_PROPOSAL_DATA_SIZE + 1];
+	int created;
+	int submitted;
+	instr_time start;
+	
+	INSTR_TIME_SET_CURRENT(start);
 	
 	/* Refresh cluster state from Go layer before checking leader status */
 	pgraft_update_shared_memory_from_go();
 	
-	/* Check if current node is leader */
-	is_leader = (cluster_state->node_id == cluster_state->leader_id);
+	/* Check if we lead the key's group, and remember the term we lead in */
+	group = pgraft_kv_group_for_key(key);
+	is_leader = pgraft_core_group_leadership(group, &term, &leader_id,
+											 leader_address, sizeof(leader_address));
 	
 	if (!is_leader) {
-		elog(ERROR, "pgraft_kv: write operations only allowed on leader node (current leader: %lld)", (long long)cluster_state->leader_id);
+		elog(ERROR, "pgraft_kv: write operations only allowed on leader node (current leader of group %d: %lld)",
+			 group, (long long)leader_id);
 		return -1;
 	}
 	
@@ -634,19 +3174,103 @@ pgraft_kv_queue_operation(pgraft_kv_op_type_t op_type, const char *key, const ch
 		cmd_type = COMMAND_KV_PUT;
 	} else if (op_type == PGRAFT_KV_DELETE) {
 		cmd_type = COMMAND_KV_DELETE;
+	} else if (op_type == PGRAFT_KV_PATCH) {
+		cmd_type = COMMAND_KV_PATCH;
 	} else {
 		elog(ERROR, "pgraft_kv: unsupported operation type: %d", op_type);
 		return -1;
 	}
 	
+	/* Refuse writes the key's namespace quotas do not allow */
+	pgraft_kv_quota_admit(op_type, key, value);
+	
+	/* Hand the entry straight to the Go layer if it consumes the proposal ring */
+	if (op_type == PGRAFT_KV_PATCH)
+		created = pgraft_json_create_kv_patch(key, value, expected_version, client_id, json_data, sizeof(json_data));
+	else
+		created = pgraft_json_create_kv_operation(op_type, key, value, client_id, json_data, sizeof(json_data));
+	if (created != 0) {
+		elog(ERROR, "pgraft_kv: failed to create JSON for operation (key=%s)", key);
+		return -1;
+	}
+	
+	/* Values a queued command cannot hold only go through the ring */
+	submitted = pgraft_proposal_submit(group, term, json_data, strlen(json_data), pgraft_proposal_timeout);
+	if (submitted == PGRAFT_PROPOSAL_SUBMITTED) {
+		pgraft_kv_stats_proposal(key, start);
+		return 0;
+	}
+	if (submitted == PGRAFT_PROPOSAL_TIMED_OUT) {
+		elog(ERROR, "pgraft_kv: timed out after %d ms waiting for operation to be proposed (key=%s); outcome unknown",
+			 pgraft_proposal_timeout, key);
+		return -1;
+	}
+	
 	/* Queue the operation for the background worker to process through Raft */
-	queued = pgraft_queue_kv_command(cmd_type, key, value, client_id);
+	queued = pgraft_queue_kv_command(cmd_type, key, value, client_id, expected_version, term, group, &command_id);
 	if (!queued) {
 		elog(ERROR, "pgraft_kv: failed to queue operation for Raft replication");
 		return -1;
 	}
 	
-	elog(INFO, "pgraft_kv: operation queued for Raft replication (type=%d, key=%s)", op_type, key);
+	elog(INFO, "pgraft_kv: operation queued for Raft replication (type=%d, key=%s, group=%d)", op_type, key, group);
+	
+	/* Wait for the worker to propose it; fails fast if we lose leadership */
+	if (pgraft_core_wait_for_group_command(command_id, group, term, pgraft_proposal_timeout) != 0) {
+		elog(ERROR, "pgraft_kv: timed out after %d ms waiting for operation to be proposed (key=%s); outcome unknown",
+			 pgraft_proposal_timeout, key);
+		return -1;
+	}
+	
+	pgraft_kv_stats_proposal(key, start);
+	
+	return 0;
+}
+
+/*
+ * Apply a committed kv_batch entry (pgraft_kv_import()), all nodes
+ *
+ * Its puts and deletes are applied in order like single KV entries, except
+ * that the store is saved once at the end rather than after every key.
+ * Deleting a key that does not exist is not an error: a batch can carry a
+ * deletion and an earlier write of the same key can have been overtaken.
+ */
+int
+pgraft_kv_apply_batch(uint64 raft_index, const char *json_data, size_t len)
+{
+	pgraft_kv_batch_item_t *items;
+	int			count;
+	int			i;
+	
+	if (pgraft_json_parse_kv_batch(json_data, len, &items, &count) != 0)
+	{
+		elog(WARNING, "pgraft_kv: failed to parse KV batch at index %lu", (unsigned long) raft_index);
+		return -1;
+	}
+	
+	kv_defer_save = true;
+	PG_TRY();
+	{
+		for (i = 0; i < count; i++)
+		{
+			if (items[i].value == NULL)
+				(void) pgraft_kv_delete(items[i].key, raft_index);
+			else
+				pgraft_kv_put(items[i].key, items[i].value, 0, raft_index);
+		}
+	}
+	PG_CATCH();
+	{
+		kv_defer_save = false;
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	kv_defer_save = false;
+	
+	pgraft_kv_save_to_disk(PGRAFT_KV_PERSIST_FILE);
+	
+	elog(LOG, "pgraft_kv: applied batch of %d keys at index %lu", count, (unsigned long) raft_index);
+	
 	return 0;
 }
 
@@ -657,7 +3281,7 @@ pgraft_kv_queue_operation(pgraft_kv_op_type_t op_type, const char *key, const ch
 int
 pgraft_kv_put_local(const char *key, const char *value)
 {
-	return pgraft_kv_put(key, value, 0); /* Skip replication flag */
+	return pgraft_kv_put(key, value, 0, 0); /* Skip replication flag */
 }
 
 int
@@ -0,0 +1,240 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_bulk.c
+ *      Batched bulk import of KV keys
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "utils/memutils.h"
+
+#include "../include/pgraft_kv_bulk.h"
+#include "../include/pgraft_kv.h"
+#include "../include/pgraft_kv_quota.h"
+#include "../include/pgraft_kv_stats.h"
+#include "../include/pgraft_core.h"
+#include "../include/pgraft_go.h"
+#include "../include/pgraft_guc.h"
+#include "../include/pgraft_json.h"
+#include "../include/pgraft_proposal.h"
+
+/*
+ * Length of a string as a JSON string literal: json-c escapes quotes,
+ * backslashes and slashes with a backslash and control characters with at
+ * most six bytes
+ */
+static size_t
+pgraft_kv_bulk_json_length(const char *str)
+{
+	size_t		length = 2;
+	const unsigned char *c;
+
+	for (c = (const unsigned char *) str; *c; c++)
+	{
+		if (*c == '"' || *c == '\\' || *c == '/')
+			length += 2;
+		else if (*c < 0x20)
+			length += 6;
+		else
+			length++;
+	}
+
+	return length;
+}
+
+/*
+ * Encoded size of one item: {"key":...,"value":...} or {"key":...,"deleted":true},
+ * with the comma separating it from the previous one
+ */
+static size_t
+pgraft_kv_bulk_item_size(const char *key, const char *value)
+{
+	size_t		size = sizeof("{\"key\":,}") + pgraft_kv_bulk_json_length(key);
+
+	if (value)
+		size += sizeof("\"value\":") + pgraft_kv_bulk_json_length(value);
+	else
+		size += sizeof("\"deleted\":true");
+
+	return size;
+}
+
+/*
+ * Propose a batch's keys one at a time through the worker, when the
+ * proposal ring cannot take the batch
+ */
+static void
+pgraft_kv_import_queue(pgraft_kv_import_t *import, int group, pgraft_kv_batch_t *batch)
+{
+	int			i;
+
+	for (i = 0; i < batch->count; i++)
+	{
+		pgraft_kv_batch_item_t *item = &batch->items[i];
+		uint64		command_id = 0;
+
+		if (!pgraft_queue_kv_command(item->value ? COMMAND_KV_PUT : COMMAND_KV_DELETE,
+									 item->key, item->value, import->client_id, -1,
+									 batch->term, group, &command_id))
+			elog(ERROR, "pgraft_kv: failed to queue imported key '%s' for Raft replication", item->key);
+
+		if (pgraft_core_wait_for_group_command(command_id, group, batch->term, pgraft_proposal_timeout) != 0)
+			elog(ERROR, "pgraft_kv: timed out after %d ms waiting for imported key '%s' to be proposed; outcome unknown",
+				 pgraft_proposal_timeout, item->key);
+	}
+
+	import->entries += batch->count;
+}
+
+/*
+ * Propose the keys gathered for a group and start its next batch
+ */
+static void
+pgraft_kv_import_flush(pgraft_kv_import_t *import, int group)
+{
+	pgraft_kv_batch_t *batch = import->batches[group];
+	char	   *json_data;
+	int			submitted;
+	int			i;
+
+	if (batch == NULL || batch->count == 0)
+		return;
+
+	json_data = palloc(PGRAFT_PROPOSAL_DATA_SIZE + 1);
+	if (pgraft_json_create_kv_batch(batch->items, batch->count, import->client_id,
+									json_data, PGRAFT_PROPOSAL_DATA_SIZE + 1) != 0)
+		elog(ERROR, "pgraft_kv: failed to create JSON for a batch of %d keys", batch->count);
+
+	submitted = pgraft_proposal_submit(group, batch->term, json_data, strlen(json_data), pgraft_proposal_timeout);
+	if (submitted == PGRAFT_PROPOSAL_TIMED_OUT)
+		elog(ERROR, "pgraft_kv: timed out after %d ms waiting for a batch of %d keys to be proposed; outcome unknown",
+			 pgraft_proposal_timeout, batch->count);
+	if (submitted == PGRAFT_PROPOSAL_SUBMITTED)
+		import->entries++;
+	else
+		pgraft_kv_import_queue(import, group, batch);
+	pfree(json_data);
+
+	for (i = 0; i < batch->count; i++)
+		pgraft_kv_stats_proposal(batch->items[i].key, batch->started);
+
+	import->keys += batch->count;
+	batch->count = 0;
+	batch->size = 0;
+	MemoryContextReset(batch->context);
+}
+
+/*
+ * Start an import
+ */
+pgraft_kv_import_t *
+pgraft_kv_import_begin(void)
+{
+	pgraft_kv_import_t *import = (pgraft_kv_import_t *) palloc0(sizeof(pgraft_kv_import_t));
+
+	snprintf(import->client_id, sizeof(import->client_id), "pg_%d", MyProcPid);
+
+	/* Refresh cluster state from Go layer before checking leader status */
+	pgraft_update_shared_memory_from_go();
+
+	return import;
+}
+
+/*
+ * Add a key to its group's batch, proposing the batch first if the key
+ * would not fit
+ *
+ * The key is checked the way a single write is, and the caller must lead
+ * its group.  value NULL deletes the key.
+ */
+void
+pgraft_kv_import_add(pgraft_kv_import_t *import, const char *key, const char *value)
+{
+	pgraft_kv_batch_t *batch;
+	MemoryContext oldcontext;
+	size_t		size;
+	int			group;
+
+	if (key == NULL)
+		elog(ERROR, "pgraft_kv: imported key cannot be NULL");
+	if (strlen(key) >= 256)
+		elog(ERROR, "pgraft_kv: key too long (max 255 characters, got %zu)", strlen(key));
+	if (value && strlen(value) >= PGRAFT_KV_VALUE_SIZE)
+		elog(ERROR, "pgraft_kv: value of key '%s' too long (max %d characters, got %zu)",
+			 key, PGRAFT_KV_VALUE_SIZE - 1, strlen(value));
+
+	group = pgraft_kv_group_for_key(key);
+	batch = import->batches[group];
+	if (batch == NULL)
+	{
+		batch = (pgraft_kv_batch_t *) palloc0(sizeof(pgraft_kv_batch_t));
+		batch->context = AllocSetContextCreate(CurrentMemoryContext,
+											   "pgraft KV import batch",
+											   ALLOCSET_DEFAULT_SIZES);
+		import->batches[group] = batch;
+	}
+
+	/* Leadership is checked once per group; proposals fail fast if it moves */
+	if (batch->term == 0)
+	{
+		int64_t		leader_id;
+		char		leader_address[256];
+
+		if (!pgraft_core_group_leadership(group, &batch->term, &leader_id,
+										  leader_address, sizeof(leader_address)))
+			elog(ERROR, "pgraft_kv: write operations only allowed on leader node (current leader of group %d: %lld)",
+				 group, (long long) leader_id);
+	}
+
+	/* Refuse keys the namespace quotas do not allow */
+	pgraft_kv_quota_admit(value ? PGRAFT_KV_PUT : PGRAFT_KV_DELETE, key, value);
+
+	size = pgraft_kv_bulk_item_size(key, value);
+	if (size > PGRAFT_PROPOSAL_DATA_SIZE - PGRAFT_KV_BATCH_ENVELOPE)
+		elog(ERROR, "pgraft_kv: imported key '%s' does not fit in a batch entry (%zu bytes encoded, max %d)",
+			 key, size, PGRAFT_PROPOSAL_DATA_SIZE - PGRAFT_KV_BATCH_ENVELOPE);
+	if (batch->count == PGRAFT_KV_BATCH_MAX_ITEMS ||
+		batch->size + size > PGRAFT_PROPOSAL_DATA_SIZE - PGRAFT_KV_BATCH_ENVELOPE)
+		pgraft_kv_import_flush(import, group);
+
+	if (batch->count == 0)
+		INSTR_TIME_SET_CURRENT(batch->started);
+
+	oldcontext = MemoryContextSwitchTo(batch->context);
+	batch->items[batch->count].key = pstrdup(key);
+	batch->items[batch->count].value = value ? pstrdup(value) : NULL;
+	MemoryContextSwitchTo(oldcontext);
+	batch->count++;
+	batch->size += size;
+}
+
+/*
+ * Propose what is left and end the import; returns the keys proposed
+ */
+int64
+pgraft_kv_import_finish(pgraft_kv_import_t *import)
+{
+	int64		keys;
+	int			group;
+
+	for (group = 0; group < PGRAFT_MAX_GROUPS; group++)
+	{
+		if (import->batches[group] == NULL)
+			continue;
+		pgraft_kv_import_flush(import, group);
+		MemoryContextDelete(import->batches[group]->context);
+		pfree(import->batches[group]);
+	}
+
+	elog(DEBUG1, "pgraft_kv: imported %lld keys in %lld Raft entries",
+		 (long long) import->keys, (long long) import->entries);
+
+	keys = import->keys;
+	pfree(import);
+
+	return keys;
+}
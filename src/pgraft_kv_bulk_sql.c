@@ -0,0 +1,187 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_bulk_sql.c
+ *      SQL interface for bulk KV export and import
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "executor/spi.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+#include "../include/pgraft_kv.h"
+#include "../include/pgraft_kv_bulk.h"
+
+PG_FUNCTION_INFO_V1(pgraft_kv_export_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_import_sql);
+
+/* Rows fetched from the import query at a time */
+#define PGRAFT_KV_IMPORT_FETCH 1000
+
+typedef struct pgraft_kv_export_set
+{
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+}			pgraft_kv_export_set_t;
+
+/*
+ * Add one exported key's row
+ */
+static void
+pgraft_kv_export_row(const pgraft_kv_change_t *change, void *arg)
+{
+	pgraft_kv_export_set_t *set = (pgraft_kv_export_set_t *) arg;
+	Datum		values[6];
+	bool		nulls[6];
+
+	memset(nulls, 0, sizeof(nulls));
+
+	values[0] = CStringGetTextDatum(change->key);
+	/* Deleted keys, in incremental exports only, have no value */
+	if (change->deleted)
+		nulls[1] = true;
+	else
+		values[1] = CStringGetTextDatum(change->value);
+	values[2] = Int64GetDatum(change->version);
+	values[3] = Int64GetDatum((int64) change->mod_revision);
+	values[4] = TimestampTzGetDatum(change->created_at);
+	values[5] = TimestampTzGetDatum(change->updated_at);
+
+	tuplestore_putvalues(set->tupstore, set->tupdesc, values, nulls);
+
+	/* Large exports: do not keep every key's text around until the end */
+	pfree(DatumGetPointer(values[0]));
+	if (!nulls[1])
+		pfree(DatumGetPointer(values[1]));
+}
+
+/*
+ * Every live key of this node's store, both tiers; or, given a revision,
+ * the keys put or deleted after it.  Not a point-in-time view, see
+ * pgraft_kv_export().
+ * Usage: COPY (SELECT * FROM pgraft_kv_export()) TO '/tmp/kv.csv' WITH (FORMAT csv);
+ */
+Datum
+pgraft_kv_export_sql(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	pgraft_kv_export_set_t set;
+	MemoryContext oldcontext;
+	int64		changed_since = PG_ARGISNULL(0) ? 0 : PG_GETARG_INT64(0);
+	uint64		revision;
+	uint64		horizon;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	if (changed_since < 0)
+		elog(ERROR, "pgraft_kv: changed_since cannot be negative");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (get_call_result_type(fcinfo, NULL, &set.tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* Kept within work_mem, spilling to a temporary file beyond it */
+	set.tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = set.tupstore;
+	rsinfo->setDesc = set.tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (pgraft_kv_export((uint64) changed_since, pgraft_kv_export_row, &set, &revision, &horizon) != 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("pgraft_kv: deletions after revision %lld are no longer kept",
+						(long long) changed_since),
+				 errhint("Export changes since revision %llu or later, or take a full export with changed_since 0.",
+						 (unsigned long long) horizon)));
+
+	elog(DEBUG1, "pgraft_kv: exported keys changed after revision %lld through revision %llu",
+		 (long long) changed_since, (unsigned long long) revision);
+
+	return (Datum) 0;
+}
+
+/*
+ * Propose the rows of a query as KV writes, in batches (leader only)
+ *
+ * The first column is the key and the second its value, NULL to delete
+ * the key; both are taken in their text form.  Returns the number of keys
+ * proposed.
+ * Usage: SELECT pgraft_kv_import('SELECT key, value FROM staging');
+ */
+Datum
+pgraft_kv_import_sql(PG_FUNCTION_ARGS)
+{
+	char	   *query;
+	SPIPlanPtr	plan;
+	Portal		portal;
+	pgraft_kv_import_t *import;
+	int64		keys;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_kv: import query cannot be NULL");
+
+	query = text_to_cstring(PG_GETARG_TEXT_PP(0));
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "pgraft_kv: import could not connect to SPI");
+
+	plan = SPI_prepare(query, 0, NULL);
+	if (plan == NULL)
+		elog(ERROR, "pgraft_kv: could not prepare import query: %s", SPI_result_code_string(SPI_result));
+
+	portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
+	import = pgraft_kv_import_begin();
+
+	for (;;)
+	{
+		TupleDesc	tupdesc;
+		uint64		i;
+
+		SPI_cursor_fetch(portal, true, PGRAFT_KV_IMPORT_FETCH);
+		if (SPI_processed == 0)
+			break;
+
+		tupdesc = SPI_tuptable->tupdesc;
+		if (tupdesc->natts < 2)
+			elog(ERROR, "pgraft_kv: import query must return a key and a value column");
+
+		for (i = 0; i < SPI_processed; i++)
+		{
+			HeapTuple	tuple = SPI_tuptable->vals[i];
+			char	   *key = SPI_getvalue(tuple, tupdesc, 1);
+			char	   *value = SPI_getvalue(tuple, tupdesc, 2);
+
+			pgraft_kv_import_add(import, key, value);
+
+			if (key)
+				pfree(key);
+			if (value)
+				pfree(value);
+		}
+
+		SPI_freetuptable(SPI_tuptable);
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	SPI_cursor_close(portal);
+	keys = pgraft_kv_import_finish(import);
+	SPI_finish();
+
+	pfree(query);
+
+	PG_RETURN_INT64(keys);
+}
@@ -0,0 +1,567 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_cold.c
+ *      On-disk hash table holding the keys evicted from the KV store
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/file_perm.h"
+#include "common/hashfn.h"
+#include "storage/fd.h"
+#include "utils/elog.h"
+
+#include "../include/pgraft_kv_cold.h"
+
+#define PGRAFT_KV_COLD_MAGIC		0x50474b43	/* "PGKC" */
+#define PGRAFT_KV_COLD_MIN_SLOTS	1024
+
+/* Record states; a fresh file is all zeroes, so all empty */
+#define PGRAFT_KV_COLD_EMPTY		0
+#define PGRAFT_KV_COLD_USED			1
+#define PGRAFT_KV_COLD_REMOVED		2
+
+/* Records read at a time while rebuilding */
+#define PGRAFT_KV_COLD_READ_BATCH	64
+
+/* Probing only needs a record's state, hash and key */
+#define PGRAFT_KV_COLD_PROBE_SIZE	offsetof(pgraft_kv_cold_record_t, entry.value_offset)
+
+/* Writing a record stops at the end of its value; the rest of the slot is never used */
+#define PGRAFT_KV_COLD_RECORD_LEN(record) \
+	(offsetof(pgraft_kv_cold_record_t, data) + (record)->entry.value_size)
+
+typedef struct pgraft_kv_cold_header
+{
+	uint32		magic;
+	uint32		record_size;	/* sizeof(pgraft_kv_cold_record_t) of the writer */
+	uint64		num_slots;		/* Power of two */
+	uint64		used;
+	uint64		removed;		/* Slots a probe has to step over */
+}			pgraft_kv_cold_header_t;
+
+static off_t
+pgraft_kv_cold_slot_offset(uint64 slot)
+{
+	return (off_t) sizeof(pgraft_kv_cold_header_t) + (off_t) slot * sizeof(pgraft_kv_cold_record_t);
+}
+
+/*
+ * Read or write exactly len bytes, closing fd and raising an error otherwise
+ */
+static void
+pgraft_kv_cold_io(int fd, bool write, void *buf, size_t len, off_t offset, const char *path)
+{
+	ssize_t		done;
+	int			save_errno;
+
+	done = write ? pwrite(fd, buf, len, offset) : pread(fd, buf, len, offset);
+	if (done == (ssize_t) len)
+		return;
+
+	save_errno = errno;
+	close(fd);
+	if (done >= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("pgraft_kv: short %s of cold tier file \"%s\" at offset %lld",
+						write ? "write" : "read", path, (long long) offset)));
+	errno = save_errno;
+	ereport(ERROR,
+			(errcode_for_file_access(),
+			 errmsg("pgraft_kv: could not %s cold tier file \"%s\": %m",
+					write ? "write" : "read", path)));
+}
+
+/*
+ * Flush the file to disk, closing fd and raising an error otherwise
+ *
+ * A key's record must be on disk before its shared memory copy is dropped
+ * and the store saved without it, or a crash in between loses the key.
+ */
+static void
+pgraft_kv_cold_sync(int fd, const char *path)
+{
+	int			save_errno;
+
+	if (pg_fsync(fd) == 0)
+		return;
+
+	save_errno = errno;
+	close(fd);
+	errno = save_errno;
+	ereport(data_sync_elevel(ERROR),
+			(errcode_for_file_access(),
+			 errmsg("pgraft_kv: could not fsync cold tier file \"%s\": %m", path)));
+}
+
+/*
+ * Create an empty file with the given number of slots; returns its fd
+ */
+static int
+pgraft_kv_cold_create(const char *path, uint64 num_slots, pgraft_kv_cold_header_t *header)
+{
+	int			fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC | PG_BINARY, pg_file_create_mode);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("pgraft_kv: could not create cold tier file \"%s\": %m", path)));
+
+	memset(header, 0, sizeof(pgraft_kv_cold_header_t));
+	header->magic = PGRAFT_KV_COLD_MAGIC;
+	header->record_size = sizeof(pgraft_kv_cold_record_t);
+	header->num_slots = num_slots;
+
+	pgraft_kv_cold_io(fd, true, header, sizeof(pgraft_kv_cold_header_t), 0, path);
+	if (ftruncate(fd, pgraft_kv_cold_slot_offset(num_slots)) != 0)
+	{
+		int			save_errno = errno;
+
+		close(fd);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("pgraft_kv: could not size cold tier file \"%s\": %m", path)));
+	}
+
+	return fd;
+}
+
+/*
+ * Open the file and read its header
+ * Returns -1 if it does not exist and create is false, or if it is not a
+ * cold tier file this server can read.
+ */
+static int
+pgraft_kv_cold_open(bool create, pgraft_kv_cold_header_t *header)
+{
+	int			fd;
+	ssize_t		done;
+
+	fd = open(PGRAFT_KV_COLD_FILE, O_RDWR | PG_BINARY, 0);
+	if (fd < 0)
+	{
+		if (errno != ENOENT)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("pgraft_kv: could not open cold tier file \"%s\": %m", PGRAFT_KV_COLD_FILE)));
+		if (!create)
+			return -1;
+		fd = pgraft_kv_cold_create(PGRAFT_KV_COLD_FILE, PGRAFT_KV_COLD_MIN_SLOTS, header);
+
+		/* The file's directory entry has to survive a crash as well */
+		pgraft_kv_cold_sync(fd, PGRAFT_KV_COLD_FILE);
+		fsync_fname(".", true);
+		return fd;
+	}
+
+	done = pread(fd, header, sizeof(pgraft_kv_cold_header_t), 0);
+	if (done != sizeof(pgraft_kv_cold_header_t) ||
+		header->magic != PGRAFT_KV_COLD_MAGIC ||
+		header->record_size != sizeof(pgraft_kv_cold_record_t) ||
+		header->num_slots < PGRAFT_KV_COLD_MIN_SLOTS ||
+		(header->num_slots & (header->num_slots - 1)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Look a key up by probing from its home slot
+ *
+ * Returns the key's slot, or -1 with *free_slot set to where it would go
+ * and *reuses_removed telling whether that slot held a removed record.
+ */
+static int64
+pgraft_kv_cold_find(int fd, const pgraft_kv_cold_header_t *header, const char *key, uint32 hash,
+					int64 *free_slot, bool *reuses_removed)
+{
+	pgraft_kv_cold_record_t probe;
+	uint64		mask = header->num_slots - 1;
+	uint64		slot = hash & mask;
+	uint64		probes;
+
+	*free_slot = -1;
+	*reuses_removed = false;
+
+	for (probes = 0; probes < header->num_slots; probes++, slot = (slot + 1) & mask)
+	{
+		pgraft_kv_cold_io(fd, false, &probe, PGRAFT_KV_COLD_PROBE_SIZE,
+						  pgraft_kv_cold_slot_offset(slot), PGRAFT_KV_COLD_FILE);
+
+		if (probe.state == PGRAFT_KV_COLD_EMPTY)
+		{
+			if (*free_slot < 0)
+				*free_slot = slot;
+			return -1;
+		}
+		if (probe.state == PGRAFT_KV_COLD_REMOVED)
+		{
+			if (*free_slot < 0)
+			{
+				*free_slot = slot;
+				*reuses_removed = true;
+			}
+			continue;
+		}
+		if (probe.hash == hash && strncmp(probe.entry.key, key, sizeof(probe.entry.key)) == 0)
+			return slot;
+	}
+
+	return -1;
+}
+
+/*
+ * Copy every record into a new file sized for them, then swap it in
+ */
+static void
+pgraft_kv_cold_rebuild(int old_fd, const pgraft_kv_cold_header_t *old_header)
+{
+	char		path[MAXPGPATH];
+	pgraft_kv_cold_header_t header;
+	pgraft_kv_cold_record_t *batch;
+	uint64		num_slots = PGRAFT_KV_COLD_MIN_SLOTS;
+	uint64		first;
+	int			fd;
+
+	/* Leave the table at most half full */
+	while (num_slots < (old_header->used + 1) * 2)
+		num_slots *= 2;
+
+	snprintf(path, sizeof(path), "%s.tmp", PGRAFT_KV_COLD_FILE);
+	fd = pgraft_kv_cold_create(path, num_slots, &header);
+
+	batch = (pgraft_kv_cold_record_t *) palloc(sizeof(pgraft_kv_cold_record_t) * PGRAFT_KV_COLD_READ_BATCH);
+
+	for (first = 0; first < old_header->num_slots; first += PGRAFT_KV_COLD_READ_BATCH)
+	{
+		uint64		count = Min(PGRAFT_KV_COLD_READ_BATCH, old_header->num_slots - first);
+		uint64		i;
+
+		pgraft_kv_cold_io(old_fd, false, batch, sizeof(pgraft_kv_cold_record_t) * count,
+						  pgraft_kv_cold_slot_offset(first), PGRAFT_KV_COLD_FILE);
+
+		for (i = 0; i < count; i++)
+		{
+			uint64		slot;
+			uint32		state;
+
+			if (batch[i].state != PGRAFT_KV_COLD_USED)
+				continue;
+
+			/* Nothing is removed in the new file, so the first empty slot will do */
+			for (slot = batch[i].hash & (num_slots - 1);; slot = (slot + 1) & (num_slots - 1))
+			{
+				pgraft_kv_cold_io(fd, false, &state, sizeof(state),
+								  pgraft_kv_cold_slot_offset(slot), path);
+				if (state == PGRAFT_KV_COLD_EMPTY)
+					break;
+			}
+			pgraft_kv_cold_io(fd, true, &batch[i], PGRAFT_KV_COLD_RECORD_LEN(&batch[i]),
+							  pgraft_kv_cold_slot_offset(slot), path);
+			header.used++;
+		}
+	}
+
+	pfree(batch);
+
+	pgraft_kv_cold_io(fd, true, &header, sizeof(header), 0, path);
+	pgraft_kv_cold_sync(fd, path);
+	close(fd);
+	durable_rename(path, PGRAFT_KV_COLD_FILE, ERROR);
+
+	elog(LOG, "pgraft_kv: rebuilt cold tier file with %llu keys in %llu slots",
+		 (unsigned long long) header.used, (unsigned long long) num_slots);
+}
+
+/*
+ * Number of keys in the file
+ * An unreadable or incompatible file is dropped, like an unreadable store
+ * file is ignored at startup.
+ */
+int64
+pgraft_kv_cold_count(void)
+{
+	pgraft_kv_cold_header_t header;
+	int			fd;
+
+	fd = pgraft_kv_cold_open(false, &header);
+	if (fd < 0)
+	{
+		if (unlink(PGRAFT_KV_COLD_FILE) == 0)
+			elog(WARNING, "pgraft_kv: removed unusable cold tier file \"%s\"", PGRAFT_KV_COLD_FILE);
+		return 0;
+	}
+
+	close(fd);
+	return (int64) header.used;
+}
+
+/*
+ * Size of the file on disk
+ */
+int64
+pgraft_kv_cold_file_size(void)
+{
+	struct stat st;
+
+	if (stat(PGRAFT_KV_COLD_FILE, &st) != 0)
+		return 0;
+	return (int64) st.st_size;
+}
+
+/*
+ * Read the record of a key, returns false if the key is not in the file
+ */
+bool
+pgraft_kv_cold_fetch(const char *key, pgraft_kv_cold_record_t *record)
+{
+	pgraft_kv_cold_header_t header;
+	int			fd;
+	int64		slot;
+	int64		free_slot;
+	bool		reuses_removed;
+
+	fd = pgraft_kv_cold_open(false, &header);
+	if (fd < 0)
+		return false;
+
+	slot = pgraft_kv_cold_find(fd, &header, key, hash_bytes((const unsigned char *) key, strlen(key)),
+							   &free_slot, &reuses_removed);
+	if (slot >= 0)
+		pgraft_kv_cold_io(fd, false, record, sizeof(pgraft_kv_cold_record_t),
+						  pgraft_kv_cold_slot_offset(slot), PGRAFT_KV_COLD_FILE);
+
+	close(fd);
+	return slot >= 0;
+}
+
+/*
+ * Call callback on every record in the file, in slot order
+ */
+void
+pgraft_kv_cold_scan(pgraft_kv_cold_callback callback, void *arg)
+{
+	pgraft_kv_cold_header_t header;
+	pgraft_kv_cold_record_t *batch;
+	uint64		first;
+	int			fd;
+
+	fd = pgraft_kv_cold_open(false, &header);
+	if (fd < 0)
+		return;
+
+	batch = (pgraft_kv_cold_record_t *) palloc(sizeof(pgraft_kv_cold_record_t) * PGRAFT_KV_COLD_READ_BATCH);
+
+	for (first = 0; first < header.num_slots; first += PGRAFT_KV_COLD_READ_BATCH)
+	{
+		uint64		count = Min(PGRAFT_KV_COLD_READ_BATCH, header.num_slots - first);
+		uint64		i;
+
+		pgraft_kv_cold_io(fd, false, batch, sizeof(pgraft_kv_cold_record_t) * count,
+						  pgraft_kv_cold_slot_offset(first), PGRAFT_KV_COLD_FILE);
+
+		for (i = 0; i < count; i++)
+		{
+			if (batch[i].state == PGRAFT_KV_COLD_USED)
+				callback(&batch[i], arg);
+		}
+	}
+
+	pfree(batch);
+	close(fd);
+}
+
+/*
+ * Open a cursor on the file; returns false if there is no usable file
+ */
+bool
+pgraft_kv_cold_cursor_open(pgraft_kv_cold_cursor_t *cursor)
+{
+	pgraft_kv_cold_header_t header;
+
+	memset(cursor, 0, sizeof(pgraft_kv_cold_cursor_t));
+	cursor->fd = pgraft_kv_cold_open(false, &header);
+	if (cursor->fd < 0)
+		return false;
+
+	cursor->num_slots = header.num_slots;
+	cursor->records = (pgraft_kv_cold_record_t *)
+		palloc(sizeof(pgraft_kv_cold_record_t) * PGRAFT_KV_COLD_READ_BATCH);
+	return true;
+}
+
+/*
+ * Read the next chunk of slots, leaving its used records in the cursor
+ * Returns false, reading nothing, once every slot was read.  Unlike the
+ * other readers this leaves the file open on error; the cursor's owner
+ * closes it.
+ */
+bool
+pgraft_kv_cold_cursor_next(pgraft_kv_cold_cursor_t *cursor)
+{
+	uint64		count;
+	size_t		len;
+	ssize_t		done;
+	uint64		i;
+
+	cursor->count = 0;
+	if (cursor->fd < 0 || cursor->next_slot >= cursor->num_slots)
+		return false;
+
+	count = Min(PGRAFT_KV_COLD_READ_BATCH, cursor->num_slots - cursor->next_slot);
+	len = sizeof(pgraft_kv_cold_record_t) * count;
+	done = pread(cursor->fd, cursor->records, len, pgraft_kv_cold_slot_offset(cursor->next_slot));
+	if (done < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("pgraft_kv: could not read cold tier file \"%s\": %m", PGRAFT_KV_COLD_FILE)));
+	if (done != (ssize_t) len)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATA_CORRUPTED),
+				 errmsg("pgraft_kv: short read of cold tier file \"%s\" at offset %lld",
+						PGRAFT_KV_COLD_FILE, (long long) pgraft_kv_cold_slot_offset(cursor->next_slot))));
+	cursor->next_slot += count;
+
+	for (i = 0; i < count; i++)
+	{
+		if (cursor->records[i].state != PGRAFT_KV_COLD_USED)
+			continue;
+		if (cursor->count != (int) i)
+			memcpy(&cursor->records[cursor->count], &cursor->records[i], sizeof(pgraft_kv_cold_record_t));
+		cursor->count++;
+	}
+
+	return true;
+}
+
+void
+pgraft_kv_cold_cursor_close(pgraft_kv_cold_cursor_t *cursor)
+{
+	if (cursor->fd >= 0)
+		close(cursor->fd);
+	cursor->fd = -1;
+	if (cursor->records)
+		pfree(cursor->records);
+	cursor->records = NULL;
+}
+
+/*
+ * Write an entry and its stored value, replacing any record of the key
+ *
+ * The record is on disk when this returns, so the caller may drop the key
+ * from shared memory.
+ */
+int64
+pgraft_kv_cold_store(const pgraft_kv_entry_t *entry, const char *data)
+{
+	pgraft_kv_cold_header_t header;
+	pgraft_kv_cold_record_t record;
+	uint32		hash = hash_bytes((const unsigned char *) entry->key, strlen(entry->key));
+	int			fd;
+	int64		slot;
+	int64		free_slot;
+	bool		reuses_removed;
+	bool		added;
+
+	fd = pgraft_kv_cold_open(true, &header);
+	if (fd < 0)
+		elog(ERROR, "pgraft_kv: cold tier file \"%s\" is not usable", PGRAFT_KV_COLD_FILE);
+
+	/* Grow, or clear out removed records, before probe sequences get long */
+	if ((header.used + header.removed + 1) * 4 > header.num_slots * 3)
+	{
+		pgraft_kv_cold_rebuild(fd, &header);
+		close(fd);
+		fd = pgraft_kv_cold_open(false, &header);
+		if (fd < 0)
+			elog(ERROR, "pgraft_kv: rebuilt cold tier file \"%s\" is not usable", PGRAFT_KV_COLD_FILE);
+	}
+
+	slot = pgraft_kv_cold_find(fd, &header, entry->key, hash, &free_slot, &reuses_removed);
+	added = (slot < 0);
+	if (added)
+	{
+		slot = free_slot;
+		header.used++;
+		if (reuses_removed)
+			header.removed--;
+	}
+
+	memset(&record, 0, sizeof(record));
+	record.state = PGRAFT_KV_COLD_USED;
+	record.hash = hash;
+	record.entry = *entry;
+	record.entry.value_offset = 0;
+	memcpy(record.data, data, entry->value_size);
+
+	pgraft_kv_cold_io(fd, true, &record, PGRAFT_KV_COLD_RECORD_LEN(&record), pgraft_kv_cold_slot_offset(slot),
+					  PGRAFT_KV_COLD_FILE);
+	if (added)
+		pgraft_kv_cold_io(fd, true, &header, sizeof(header), 0, PGRAFT_KV_COLD_FILE);
+
+	pgraft_kv_cold_sync(fd, PGRAFT_KV_COLD_FILE);
+	close(fd);
+	return (int64) header.used;
+}
+
+/*
+ * Remove a key, returns false if it was not in the file
+ */
+bool
+pgraft_kv_cold_remove(const char *key, int64 *count)
+{
+	pgraft_kv_cold_header_t header;
+	uint32		state = PGRAFT_KV_COLD_REMOVED;
+	int			fd;
+	int64		slot;
+	int64		free_slot;
+	bool		reuses_removed;
+
+	*count = 0;
+	fd = pgraft_kv_cold_open(false, &header);
+	if (fd < 0)
+		return false;
+
+	slot = pgraft_kv_cold_find(fd, &header, key, hash_bytes((const unsigned char *) key, strlen(key)),
+							   &free_slot, &reuses_removed);
+	if (slot >= 0)
+	{
+		pgraft_kv_cold_io(fd, true, &state, sizeof(state), pgraft_kv_cold_slot_offset(slot),
+						  PGRAFT_KV_COLD_FILE);
+		header.used--;
+		header.removed++;
+		pgraft_kv_cold_io(fd, true, &header, sizeof(header), 0, PGRAFT_KV_COLD_FILE);
+		pgraft_kv_cold_sync(fd, PGRAFT_KV_COLD_FILE);
+	}
+
+	close(fd);
+	*count = (int64) header.used;
+	return slot >= 0;
+}
+
+/*
+ * Drop every key
+ */
+void
+pgraft_kv_cold_reset(void)
+{
+	if (unlink(PGRAFT_KV_COLD_FILE) != 0 && errno != ENOENT)
+		ereport(WARNING,
+				(errcode_for_file_access(),
+				 errmsg("pgraft_kv: could not remove cold tier file \"%s\": %m", PGRAFT_KV_COLD_FILE)));
+}
@@ -0,0 +1,622 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_gateway.c
+ *      Txns, leases and reads of the client gateway, on the KV store
+ *
+ * The Go layer only speaks the etcd API; every decision a write depends
+ * on is made here, in the apply path, from the store every node agrees
+ * on.  A kv_txn entry's compares are evaluated against the store before
+ * its success or failure writes run, and lease entries change the lease
+ * table the store carries.  The worker also answers the gateway's reads
+ * from the store, so neither the keys nor their values are kept twice.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <string.h>
+
+#include "miscadmin.h"
+#include "nodes/pg_list.h"
+#include "storage/lwlock.h"
+#include "storage/spin.h"
+#include "utils/elog.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+#include "../include/pgraft_kv_gateway.h"
+#include "../include/pgraft_kv.h"
+#include "../include/pgraft_go.h"
+#include "../include/pgraft_guc.h"
+#include "../include/pgraft_json.h"
+
+/* Reads answered per worker iteration, so writes are not held up */
+#define PGRAFT_KV_GATEWAY_READS_PER_ROUND	64
+
+/* Keys left on dead leases whose deletion one sweep proposes */
+#define PGRAFT_KV_GATEWAY_SWEEP_KEYS		64
+
+/*
+ * Outcome of the entry being applied, for pgraft_kv_gateway_applied():
+ * false if a Txn's compares failed or a lease operation did nothing
+ */
+static bool gateway_outcome = true;
+
+/* A gateway read being answered */
+typedef struct pgraft_kv_gateway_reply
+{
+	uint64		id;
+	int64		lease;
+	int64		count;
+}			pgraft_kv_gateway_reply_t;
+
+/* Keys to delete, collected by a callback */
+typedef struct pgraft_kv_gateway_keys
+{
+	int			group;			/* Only keys of this group, -1 for any */
+	int64		lease;			/* Only keys on this lease, 0 for any */
+	bool		dead_leases;	/* Only keys on a lease that is not live */
+	List	   *keys;
+}			pgraft_kv_gateway_keys_t;
+
+/*
+ * Is the client gateway on?  Changes are only handed to it then.
+ */
+bool
+pgraft_kv_gateway_active(void)
+{
+	return pgraft_client_gateway && pgraft_go_is_loaded();
+}
+
+/*
+ * Highest Raft log index applied to the store, the gateway's revision
+ */
+static uint64
+pgraft_kv_gateway_revision(void)
+{
+	pgraft_kv_store_t *store = pgraft_kv_get_store();
+	uint64		revision;
+
+	if (!store)
+		return 0;
+
+	SpinLockAcquire(&store->mutex);
+	revision = store->last_applied_index;
+	SpinLockRelease(&store->mutex);
+
+	return revision;
+}
+
+/*
+ * Fill the Go form of a key
+ */
+static void
+pgraft_kv_gateway_kv(const pgraft_kv_entry_t *entry, const char *value, pgraft_go_kv_t *kv)
+{
+	kv->key = entry->key;
+	kv->value = value;
+	kv->create_revision = entry->create_index;
+	kv->mod_revision = entry->log_index;
+	kv->version = entry->version;
+	kv->lease = entry->lease;
+}
+
+/*
+ * Hand a change of the store to the gateway's watches
+ *
+ * Called by the store after every put and delete while the gateway is
+ * on, whichever path the change came through; value is NULL for a delete
+ * and prev NULL for a key that did not exist.
+ */
+void
+pgraft_kv_gateway_publish(const pgraft_kv_entry_t *entry, const char *value,
+						  const pgraft_kv_entry_t *prev, const char *prev_value)
+{
+	pgraft_go_kv_t kv;
+	pgraft_go_kv_t prev_kv;
+
+	pgraft_kv_gateway_kv(entry, entry->deleted ? NULL : value, &kv);
+	if (prev != NULL && !prev->deleted)
+	{
+		pgraft_kv_gateway_kv(prev, prev_value, &prev_kv);
+		pgraft_go_gateway_event(&kv, &prev_kv);
+	}
+	else
+		pgraft_go_gateway_event(&kv, NULL);
+}
+
+/*
+ * Tell the gateway an entry was applied, and whether it succeeded
+ *
+ * The gateway answers the request that proposed the entry, found by its
+ * client_id, with the changes published since the previous entry.
+ */
+void
+pgraft_kv_gateway_applied(uint64 raft_index, const char *json_data, size_t len, bool applied)
+{
+	char		client_id[64];
+	bool		succeeded = applied && gateway_outcome;
+
+	gateway_outcome = true;
+	if (!pgraft_kv_gateway_active())
+		return;
+
+	if (pgraft_json_get_string(json_data, len, "client_id", client_id, sizeof(client_id)) != 0)
+		client_id[0] = '\0';
+
+	pgraft_go_gateway_applied(client_id, (int64_t) pgraft_kv_gateway_revision(), succeeded ? 1 : 0);
+}
+
+/*
+ * Does a Txn compare hold against the store?
+ */
+static bool
+pgraft_kv_compare_holds(const pgraft_kv_compare_t *compare)
+{
+	pgraft_kv_entry_t entry;
+	char	   *value = NULL;
+	bool		exists;
+	int64		actual = 0;
+	int			cmp;
+
+	if (compare->target == PGRAFT_KV_COMPARE_VALUE)
+		value = palloc(PGRAFT_KV_VALUE_SIZE);
+	exists = pgraft_kv_read(compare->key, &entry, value, PGRAFT_KV_VALUE_SIZE);
+
+	switch (compare->target)
+	{
+		case PGRAFT_KV_COMPARE_VERSION:
+			actual = exists ? entry.version : 0;
+			break;
+		case PGRAFT_KV_COMPARE_CREATE:
+			actual = exists ? entry.create_index : 0;
+			break;
+		case PGRAFT_KV_COMPARE_MOD:
+			actual = exists ? entry.log_index : 0;
+			break;
+		case PGRAFT_KV_COMPARE_LEASE:
+			actual = exists ? entry.lease : 0;
+			break;
+		case PGRAFT_KV_COMPARE_VALUE:
+			break;
+	}
+
+	if (compare->target == PGRAFT_KV_COMPARE_VALUE)
+	{
+		/* A missing key has no value to compare, as in etcd */
+		cmp = exists ? strcmp(value, compare->value) : 0;
+		pfree(value);
+		if (!exists)
+			return false;
+	}
+	else
+		cmp = (actual > compare->number) - (actual < compare->number);
+
+	switch (compare->result)
+	{
+		case PGRAFT_KV_COMPARE_EQUAL:
+			return cmp == 0;
+		case PGRAFT_KV_COMPARE_NOT_EQUAL:
+			return cmp != 0;
+		case PGRAFT_KV_COMPARE_GREATER:
+			return cmp > 0;
+		case PGRAFT_KV_COMPARE_LESS:
+			return cmp < 0;
+	}
+	return false;
+}
+
+/*
+ * Collect a key for deletion if it is in the wanted group
+ */
+static void
+pgraft_kv_gateway_collect(const pgraft_kv_entry_t *entry, const char *value, void *arg)
+{
+	pgraft_kv_gateway_keys_t *keys = (pgraft_kv_gateway_keys_t *) arg;
+
+	if (keys->lease != 0 && entry->lease != keys->lease)
+		return;
+	if (keys->group >= 0 && pgraft_kv_group_for_key(entry->key) != keys->group)
+		return;
+	if (keys->dead_leases)
+	{
+		pgraft_kv_lease_t lease;
+
+		if (entry->lease == 0 || pgraft_kv_lease_get(entry->lease, &lease))
+			return;
+	}
+	keys->keys = lappend(keys->keys, pstrdup(entry->key));
+}
+
+/*
+ * Delete collected keys at raft_index
+ */
+static void
+pgraft_kv_gateway_delete_keys(List *keys, uint64 raft_index)
+{
+	ListCell   *lc;
+
+	foreach(lc, keys)
+	{
+		if (pgraft_kv_delete((const char *) lfirst(lc), raft_index) != 0)
+			elog(ERROR, "pgraft_kv: failed to delete key '%s' at index %lu",
+				 (const char *) lfirst(lc), (unsigned long) raft_index);
+	}
+}
+
+/*
+ * Run the writes of one Txn branch
+ *
+ * A range delete only deletes the keys of the Txn's group: keys of other
+ * groups are changed by their own logs, which this entry is not ordered
+ * against.  Deleting a missing key does nothing.
+ */
+static void
+pgraft_kv_txn_run(const pgraft_kv_txn_t *txn, const pgraft_kv_txn_op_t *ops, int count, uint64 raft_index)
+{
+	int			i;
+
+	for (i = 0; i < count; i++)
+	{
+		const pgraft_kv_txn_op_t *op = &ops[i];
+
+		if (!op->is_delete)
+		{
+			if (pgraft_kv_put(op->key, op->value, op->lease, raft_index) != 0)
+				elog(ERROR, "pgraft_kv: failed to put key '%s' at index %lu",
+					 op->key, (unsigned long) raft_index);
+		}
+		else if (op->range_end == NULL)
+		{
+			pgraft_kv_entry_t entry;
+
+			if (pgraft_kv_read(op->key, &entry, NULL, 0) &&
+				pgraft_kv_delete(op->key, raft_index) != 0)
+				elog(ERROR, "pgraft_kv: failed to delete key '%s' at index %lu",
+					 op->key, (unsigned long) raft_index);
+		}
+		else
+		{
+			pgraft_kv_gateway_keys_t keys;
+			uint64		revision;
+
+			keys.group = pgraft_raft_groups > 1 ? txn->group : -1;
+			keys.lease = 0;
+			keys.dead_leases = false;
+			keys.keys = NIL;
+			(void) pgraft_kv_range(op->key, op->range_end, 0, true,
+								   pgraft_kv_gateway_collect, &keys, &revision);
+			pgraft_kv_gateway_delete_keys(keys.keys, raft_index);
+			list_free_deep(keys.keys);
+		}
+	}
+}
+
+/*
+ * Apply a committed kv_txn entry (all nodes)
+ *
+ * Every node evaluates the compares against the same store state, the one
+ * left by the entries before this one in the group's log, so every node
+ * runs the same branch.  The store is saved once, after the branch.
+ */
+int
+pgraft_kv_txn_apply(uint64 raft_index, const char *json_data, size_t len)
+{
+	pgraft_kv_txn_t txn;
+	bool		succeeded = true;
+	int			i;
+
+	if (pgraft_json_parse_kv_txn(json_data, len, &txn) != 0)
+	{
+		elog(WARNING, "pgraft_kv: failed to parse KV txn at index %lu", (unsigned long) raft_index);
+		return -1;
+	}
+
+	for (i = 0; i < txn.num_compares && succeeded; i++)
+		succeeded = pgraft_kv_compare_holds(&txn.compares[i]);
+
+	pgraft_kv_defer_save(true);
+	PG_TRY();
+	{
+		if (succeeded)
+			pgraft_kv_txn_run(&txn, txn.success, txn.num_success, raft_index);
+		else
+			pgraft_kv_txn_run(&txn, txn.failure, txn.num_failure, raft_index);
+	}
+	PG_CATCH();
+	{
+		pgraft_kv_defer_save(false);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	pgraft_kv_defer_save(false);
+
+	gateway_outcome = succeeded;
+
+	elog(DEBUG1, "pgraft_kv: applied txn at index %lu (%s)", (unsigned long) raft_index,
+		 succeeded ? "succeeded" : "failed");
+
+	return 0;
+}
+
+/*
+ * Apply a committed lease_grant, lease_keepalive or lease_revoke entry
+ * (all nodes)
+ *
+ * Revoking a lease deletes the group 0 keys attached to it in the same
+ * entry; keys of other groups are left to the leader's sweep.
+ */
+int
+pgraft_kv_lease_apply(uint64 raft_index, const char *json_data, size_t len)
+{
+	pgraft_kv_lease_op_t op;
+
+	if (pgraft_json_parse_kv_lease_operation(json_data, len, &op) != 0)
+	{
+		elog(WARNING, "pgraft_kv: failed to parse lease operation at index %lu", (unsigned long) raft_index);
+		return -1;
+	}
+
+	switch (op.op_type)
+	{
+		case PGRAFT_KV_LEASE_GRANT:
+			gateway_outcome = pgraft_kv_lease_grant(op.lease, op.ttl, op.timestamp);
+			break;
+		case PGRAFT_KV_LEASE_KEEPALIVE:
+			gateway_outcome = pgraft_kv_lease_keepalive(op.lease, op.timestamp);
+			break;
+		case PGRAFT_KV_LEASE_REVOKE:
+			gateway_outcome = pgraft_kv_lease_revoke(op.lease, op.timestamp, op.expire, raft_index);
+			if (gateway_outcome)
+			{
+				pgraft_kv_gateway_keys_t keys;
+
+				keys.group = 0;
+				keys.lease = op.lease;
+				keys.dead_leases = false;
+				keys.keys = NIL;
+				pgraft_kv_scan_leased(pgraft_kv_gateway_collect, &keys);
+
+				pgraft_kv_defer_save(true);
+				PG_TRY();
+				{
+					pgraft_kv_gateway_delete_keys(keys.keys, raft_index);
+				}
+				PG_CATCH();
+				{
+					pgraft_kv_defer_save(false);
+					PG_RE_THROW();
+				}
+				PG_END_TRY();
+				pgraft_kv_defer_save(false);
+
+				elog(LOG, "pgraft_kv: lease %lld %s, %d keys deleted", (long long) op.lease,
+					 op.expire ? "expired" : "revoked", list_length(keys.keys));
+				list_free_deep(keys.keys);
+			}
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Hand one key of a range read to the gateway
+ */
+static void
+pgraft_kv_gateway_row(const pgraft_kv_entry_t *entry, const char *value, void *arg)
+{
+	pgraft_kv_gateway_reply_t *reply = (pgraft_kv_gateway_reply_t *) arg;
+	pgraft_go_kv_t kv;
+
+	pgraft_kv_gateway_kv(entry, value, &kv);
+	pgraft_go_gateway_read_row(reply->id, &kv);
+}
+
+/*
+ * Hand one key attached to the lease of a lease read to the gateway
+ */
+static void
+pgraft_kv_gateway_lease_key(const pgraft_kv_entry_t *entry, const char *value, void *arg)
+{
+	pgraft_kv_gateway_reply_t *reply = (pgraft_kv_gateway_reply_t *) arg;
+	pgraft_go_kv_t kv;
+
+	if (entry->lease != reply->lease)
+		return;
+
+	pgraft_kv_gateway_kv(entry, NULL, &kv);
+	pgraft_go_gateway_read_row(reply->id, &kv);
+	reply->count++;
+}
+
+/*
+ * Answer one gateway read from the store
+ */
+static void
+pgraft_kv_gateway_answer(const pgraft_go_gateway_read_t *read)
+{
+	pgraft_kv_gateway_reply_t reply;
+	uint64		revision;
+	int64		ttl = -1;
+	int64		remaining = 0;
+
+	reply.id = read->id;
+	reply.lease = read->lease;
+	reply.count = 0;
+
+	if (read->kind == PGRAFT_GO_READ_RANGE)
+	{
+		reply.count = pgraft_kv_range(read->key, read->range_end, read->limit, read->keys_only != 0,
+									  read->count_only ? NULL : pgraft_kv_gateway_row, &reply, &revision);
+	}
+	else
+	{
+		pgraft_kv_lease_t lease;
+
+		revision = pgraft_kv_gateway_revision();
+		if (pgraft_kv_lease_get(read->lease, &lease))
+		{
+			ttl = lease.ttl;
+			remaining = Max(lease.expires_at - GetCurrentTimestamp(), 0) / USECS_PER_SEC;
+			if (read->lease_keys)
+				pgraft_kv_scan_leased(pgraft_kv_gateway_lease_key, &reply);
+		}
+	}
+
+	pgraft_go_gateway_read_done(read->id, (int64_t) revision, reply.count, ttl, remaining);
+}
+
+/*
+ * Answer the reads the client gateway queued (worker)
+ *
+ * A read that fails is answered with revision -1, so its client gets an
+ * error instead of waiting out the timeout.
+ */
+void
+pgraft_kv_gateway_serve(void)
+{
+	pgraft_go_gateway_read_t read;
+	int			served;
+
+	if (!pgraft_kv_gateway_active())
+		return;
+
+	/* The gateway's quota checks read usage as last counted */
+	pgraft_kv_quota_refresh();
+
+	for (served = 0; served < PGRAFT_KV_GATEWAY_READS_PER_ROUND; served++)
+	{
+		MemoryContext oldcontext = CurrentMemoryContext;
+
+		if (pgraft_go_gateway_next_read(&read) != 1)
+			break;
+
+		PG_TRY();
+		{
+			pgraft_kv_gateway_answer(&read);
+		}
+		PG_CATCH();
+		{
+			ErrorData  *edata;
+
+			MemoryContextSwitchTo(oldcontext);
+			edata = CopyErrorData();
+			FlushErrorState();
+			/* There is no transaction abort to release the KV cold tier lock */
+			LWLockReleaseAll();
+
+			elog(WARNING, "pgraft_kv: failed to answer a client gateway read: %s", edata->message);
+			FreeErrorData(edata);
+			pgraft_go_gateway_read_done(read.id, -1, 0, -1, 0);
+		}
+		PG_END_TRY();
+
+		pgraft_go_free_string(read.key);
+		if (read.range_end != NULL)
+			pgraft_go_free_string(read.range_end);
+	}
+}
+
+/*
+ * Propose the revocation of every expired lease, and the deletion of keys
+ * still attached to a lease that is gone (worker, group 0 leader)
+ *
+ * Expiry uses this node's clock, but the entry carries the timestamp it
+ * was decided at and only revokes a lease that had expired by then, so a
+ * keepalive applied in between wins.  A key is only left on a dead lease
+ * when it belongs to another group than 0, or was written after its lease
+ * was revoked; a conditional delete in the key's own group removes it
+ * unless it was written again meanwhile.
+ */
+void
+pgraft_kv_gateway_expire(void)
+{
+	pgraft_kv_lease_t *leases;
+	pgraft_kv_gateway_keys_t orphans;
+	TimestampTz now = GetCurrentTimestamp();
+	ListCell   *lc;
+	int			count;
+	int			swept = 0;
+	int			i;
+
+	if (!pgraft_kv_gateway_active())
+		return;
+
+	leases = (pgraft_kv_lease_t *) palloc(sizeof(pgraft_kv_lease_t) * PGRAFT_KV_MAX_LEASES);
+	count = pgraft_kv_lease_list(leases, PGRAFT_KV_MAX_LEASES);
+	for (i = 0; i < count; i++)
+	{
+		pgraft_kv_lease_op_t op;
+		char		json_data[256];
+
+		if (leases[i].expires_at > now)
+			continue;
+
+		memset(&op, 0, sizeof(op));
+		op.op_type = PGRAFT_KV_LEASE_REVOKE;
+		op.lease = leases[i].id;
+		op.timestamp = now;
+		op.expire = true;
+		if (pgraft_json_create_kv_lease_operation(&op, json_data, sizeof(json_data)) != 0)
+			continue;
+
+		elog(LOG, "pgraft_kv: client gateway lease %lld expired without keepalive", (long long) op.lease);
+		(void) pgraft_go_append_log(json_data, strlen(json_data));
+	}
+	pfree(leases);
+
+	orphans.group = -1;
+	orphans.lease = 0;
+	orphans.dead_leases = true;
+	orphans.keys = NIL;
+	pgraft_kv_scan_leased(pgraft_kv_gateway_collect, &orphans);
+
+	foreach(lc, orphans.keys)
+	{
+		char	   *key = (char *) lfirst(lc);
+		pgraft_kv_entry_t entry;
+		pgraft_kv_lease_t lease;
+		pgraft_kv_compare_t compare;
+		pgraft_kv_txn_op_t deletion;
+		pgraft_kv_txn_t txn;
+		char		json_data[1024];
+
+		if (swept >= PGRAFT_KV_GATEWAY_SWEEP_KEYS)
+			break;
+		if (!pgraft_kv_read(key, &entry, NULL, 0) || entry.lease == 0 ||
+			pgraft_kv_lease_get(entry.lease, &lease))
+			continue;
+
+		memset(&compare, 0, sizeof(compare));
+		compare.key = key;
+		compare.target = PGRAFT_KV_COMPARE_LEASE;
+		compare.result = PGRAFT_KV_COMPARE_EQUAL;
+		compare.number = entry.lease;
+		memset(&deletion, 0, sizeof(deletion));
+		deletion.is_delete = true;
+		deletion.key = key;
+		memset(&txn, 0, sizeof(txn));
+		txn.group = pgraft_kv_group_for_key(key);
+		txn.compares = &compare;
+		txn.num_compares = 1;
+		txn.success = &deletion;
+		txn.num_success = 1;
+
+		if (pgraft_json_create_kv_txn(&txn, "lease-sweep", json_data, sizeof(json_data)) != 0)
+			continue;
+
+		if (txn.group == 0)
+			(void) pgraft_go_append_log(json_data, strlen(json_data));
+		else
+			(void) pgraft_go_group_append(txn.group, json_data, strlen(json_data));
+		swept++;
+	}
+	list_free_deep(orphans.keys);
+
+	if (swept > 0)
+		elog(LOG, "pgraft_kv: proposed deleting %d keys left on dead client gateway leases", swept);
+}
@@ -0,0 +1,661 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_quota.c
+ *      KV namespace quotas on keys, bytes and write rate
+ *
+ * Limits travel through Raft as "quota_set" and "quota_drop" entries and
+ * sit in a shared memory table on every node.  Usage is node-local: the
+ * apply process adds each applied put and delete to the usage of the
+ * quotas whose prefix the key starts with, under the store mutex, and a
+ * backend that finds a quota not counted since the store last dropped
+ * entries wholesale recounts it from the store (pgraft_kv_count_prefix).
+ *
+ * The write rate is a token bucket per quota on the leader, holding up to
+ * one second's worth of writes.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <string.h>
+
+#include "port/atomics.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/elog.h"
+#include "utils/timestamp.h"
+
+#include "../include/pgraft_kv_quota.h"
+#include "../include/pgraft_core.h"
+#include "../include/pgraft_json.h"
+#include "../include/pgraft_guc.h"
+
+/* Global shared memory pointer */
+static pgraft_kv_quota_state_t *g_kv_quota_state = NULL;
+
+/* Arguments for the apply-wait predicate */
+typedef struct pgraft_kv_quota_wait
+{
+	char		prefix[PGRAFT_KV_QUOTA_PREFIX_LEN];
+	uint64		request;
+	int32		term;
+	int32		node_id;
+}			pgraft_kv_quota_wait_t;
+
+/* A quota that applies to a write, copied out for admission */
+typedef struct pgraft_kv_quota_check
+{
+	pgraft_kv_quota_t *quota;
+	int64		max_keys;
+	int64		max_bytes;
+}			pgraft_kv_quota_check_t;
+
+/* Why a write was refused, for the caller to report */
+typedef struct pgraft_kv_quota_refusal
+{
+	pgraft_kv_quota_t *quota;
+	int64		used;			/* Keys or bytes under the quota */
+	int64		grow;			/* Bytes the write adds */
+	int64		limit;
+}			pgraft_kv_quota_refusal_t;
+
+/*
+ * Initialize shared memory for quotas
+ */
+void
+pgraft_kv_quota_init_shared_memory(void)
+{
+	bool		found;
+
+	g_kv_quota_state = (pgraft_kv_quota_state_t *) ShmemInitStruct("pgraft_kv_quota_state",
+																   sizeof(pgraft_kv_quota_state_t),
+																   &found);
+
+	if (!found)
+	{
+		memset(g_kv_quota_state, 0, sizeof(pgraft_kv_quota_state_t));
+		SpinLockInit(&g_kv_quota_state->mutex);
+		pg_atomic_init_u32(&g_kv_quota_state->num_quotas, 0);
+	}
+}
+
+/*
+ * Get quota table shared memory
+ */
+pgraft_kv_quota_state_t *
+pgraft_kv_quota_get_state(void)
+{
+	return g_kv_quota_state;
+}
+
+/*
+ * Find a quota by prefix, dropped ones included
+ */
+static pgraft_kv_quota_t *
+pgraft_kv_quota_find(const char *prefix)
+{
+	uint32		num_quotas = pg_atomic_read_u32(&g_kv_quota_state->num_quotas);
+	uint32		i;
+
+	pg_read_barrier();
+	for (i = 0; i < num_quotas; i++)
+	{
+		if (strcmp(g_kv_quota_state->quotas[i].prefix, prefix) == 0)
+			return &g_kv_quota_state->quotas[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Apply-wait predicate
+ */
+static bool
+pgraft_kv_quota_applied(void *arg)
+{
+	pgraft_kv_quota_wait_t *wait = (pgraft_kv_quota_wait_t *) arg;
+	pgraft_kv_quota_t *quota;
+	bool		applied = false;
+
+	SpinLockAcquire(&g_kv_quota_state->mutex);
+	quota = pgraft_kv_quota_find(wait->prefix);
+	if (quota)
+		applied = (quota->request == wait->request && quota->term == wait->term &&
+				   quota->node_id == wait->node_id);
+	SpinLockRelease(&g_kv_quota_state->mutex);
+
+	return applied;
+}
+
+/*
+ * Check a prefix fits in the quota table
+ */
+static void
+pgraft_kv_quota_check_prefix(const char *prefix)
+{
+	if (strlen(prefix) == 0 || strlen(prefix) >= PGRAFT_KV_QUOTA_PREFIX_LEN)
+		elog(ERROR, "pgraft_kv: quota prefix must be 1 to %d characters", PGRAFT_KV_QUOTA_PREFIX_LEN - 1);
+}
+
+/*
+ * Propose a quota operation and wait for it to apply locally
+ */
+static void
+pgraft_kv_quota_propose(pgraft_kv_quota_op_t *op)
+{
+	pgraft_kv_quota_wait_t wait;
+	char		json_data[1024];
+
+	if (!g_kv_quota_state)
+		elog(ERROR, "pgraft_kv: quota table not initialized");
+
+	pgraft_core_require_leader(&op->term, &op->node_id);
+
+	SpinLockAcquire(&g_kv_quota_state->mutex);
+	op->request = ++g_kv_quota_state->next_request;
+	SpinLockRelease(&g_kv_quota_state->mutex);
+
+	if (pgraft_json_create_kv_quota_operation(op, json_data, sizeof(json_data)) != 0)
+		elog(ERROR, "pgraft_kv: failed to create JSON for quota of \"%s\"", op->prefix);
+
+	pgraft_core_propose(json_data, op->term);
+
+	memset(&wait, 0, sizeof(wait));
+	strlcpy(wait.prefix, op->prefix, sizeof(wait.prefix));
+	wait.request = op->request;
+	wait.term = op->term;
+	wait.node_id = op->node_id;
+
+	if (pgraft_core_wait_for_apply(pgraft_kv_quota_applied, &wait, wait.term, pgraft_proposal_timeout) != 0)
+		elog(ERROR, "pgraft_kv: timed out waiting for quota of \"%s\" to apply; outcome unknown",
+			 op->prefix);
+}
+
+/*
+ * Set the limits of the keys starting with prefix; 0 means no limit
+ */
+void
+pgraft_kv_quota_set(const char *prefix, int64 max_keys, int64 max_bytes, int32 max_write_rate)
+{
+	pgraft_kv_quota_op_t op;
+
+	pgraft_kv_quota_check_prefix(prefix);
+	if (max_keys < 0 || max_bytes < 0 || max_write_rate < 0)
+		elog(ERROR, "pgraft_kv: quota limits cannot be negative");
+
+	memset(&op, 0, sizeof(op));
+	strlcpy(op.prefix, prefix, sizeof(op.prefix));
+	op.max_keys = max_keys;
+	op.max_bytes = max_bytes;
+	op.max_write_rate = max_write_rate;
+
+	pgraft_kv_quota_propose(&op);
+}
+
+/*
+ * Drop the quota of a prefix; returns false if it has none
+ */
+bool
+pgraft_kv_quota_drop(const char *prefix)
+{
+	pgraft_kv_quota_op_t op;
+	pgraft_kv_quota_t *quota;
+	bool		in_use = false;
+
+	pgraft_kv_quota_check_prefix(prefix);
+	if (!g_kv_quota_state)
+		elog(ERROR, "pgraft_kv: quota table not initialized");
+
+	SpinLockAcquire(&g_kv_quota_state->mutex);
+	quota = pgraft_kv_quota_find(prefix);
+	if (quota)
+		in_use = quota->in_use;
+	SpinLockRelease(&g_kv_quota_state->mutex);
+
+	if (!in_use)
+		return false;
+
+	memset(&op, 0, sizeof(op));
+	strlcpy(op.prefix, prefix, sizeof(op.prefix));
+	op.drop = true;
+
+	pgraft_kv_quota_propose(&op);
+
+	return true;
+}
+
+/*
+ * Record a fresh count of a quota's usage; runs under the store mutex
+ */
+static void
+pgraft_kv_quota_counted(int64 keys, int64 bytes, uint64 resync_revision, void *arg)
+{
+	pgraft_kv_quota_t *quota = (pgraft_kv_quota_t *) arg;
+
+	pg_atomic_write_u64(&quota->keys, (uint64) keys);
+	pg_atomic_write_u64(&quota->bytes, (uint64) bytes);
+	pg_atomic_write_u64(&quota->counted_at, resync_revision + 1);
+}
+
+/*
+ * Keys and bytes under a quota on this node
+ */
+void
+pgraft_kv_quota_usage(pgraft_kv_quota_t *quota, int64 *keys, int64 *bytes)
+{
+	uint64		revision;
+	uint64		resync_revision;
+
+	pgraft_kv_get_revisions(&revision, &resync_revision);
+	if (pg_atomic_read_u64(&quota->counted_at) != resync_revision + 1)
+		pgraft_kv_count_prefix(quota->prefix, pgraft_kv_quota_counted, quota);
+
+	*keys = Max((int64) pg_atomic_read_u64(&quota->keys), 0);
+	*bytes = Max((int64) pg_atomic_read_u64(&quota->bytes), 0);
+}
+
+/*
+ * Top up a quota's write tokens for the time since the last refill;
+ * caller holds the mutex
+ */
+static void
+pgraft_kv_quota_refill(pgraft_kv_quota_t *quota, TimestampTz now)
+{
+	if (quota->refilled_at == 0)
+		quota->tokens = quota->max_write_rate;
+	else
+		quota->tokens = Min((double) quota->max_write_rate,
+							quota->tokens + (double) quota->max_write_rate *
+							Max(now - quota->refilled_at, 0) / USECS_PER_SEC);
+	quota->refilled_at = now;
+}
+
+/*
+ * Check a write to key against the quotas whose prefix it starts with
+ *
+ * value_size is the length of a put's new value or of a patch; a patch is
+ * taken to grow the value by at most its own length.  old_size is the
+ * key's current value length, -1 if it does not exist; if it is
+ * PGRAFT_KV_QUOTA_SIZE_UNKNOWN and a key or byte limit applies,
+ * PGRAFT_KV_QUOTA_NEED_SIZE is returned before anything is counted.  With
+ * recount, stale usage is counted again; without it, nothing here raises
+ * an error or takes an LWLock, so it may run on any thread.
+ */
+static int
+pgraft_kv_quota_check(pgraft_kv_op_type_t op_type, const char *key, int64 value_size, int64 old_size,
+					  bool recount, pgraft_kv_quota_refusal_t *refusal)
+{
+	pgraft_kv_quota_check_t checks[PGRAFT_KV_MAX_QUOTAS];
+	pgraft_kv_quota_check_t *refused = NULL;
+	uint32		num_quotas;
+	int			num_checks = 0;
+	int64		key_len = strlen(key);
+	int64		keys = 0;
+	int64		bytes = 0;
+	int64		grow = 0;
+	TimestampTz now;
+	int			i;
+
+	if (!g_kv_quota_state)
+		return PGRAFT_KV_QUOTA_ADMITTED;
+
+	num_quotas = pg_atomic_read_u32(&g_kv_quota_state->num_quotas);
+	if (num_quotas == 0)
+		return PGRAFT_KV_QUOTA_ADMITTED;
+
+	SpinLockAcquire(&g_kv_quota_state->mutex);
+	for (i = 0; i < (int) num_quotas; i++)
+	{
+		pgraft_kv_quota_t *quota = &g_kv_quota_state->quotas[i];
+
+		if (!quota->in_use || strncmp(key, quota->prefix, quota->prefix_len) != 0)
+			continue;
+
+		checks[num_checks].quota = quota;
+		checks[num_checks].max_keys = quota->max_keys;
+		checks[num_checks].max_bytes = quota->max_bytes;
+		num_checks++;
+	}
+	SpinLockRelease(&g_kv_quota_state->mutex);
+
+	/* Keys and bytes: only writes that add some can go over */
+	for (i = 0; i < num_checks && op_type != PGRAFT_KV_DELETE; i++)
+	{
+		pgraft_kv_quota_check_t *check = &checks[i];
+
+		if (check->max_keys == 0 && check->max_bytes == 0)
+			continue;
+
+		if (old_size == PGRAFT_KV_QUOTA_SIZE_UNKNOWN)
+			return PGRAFT_KV_QUOTA_NEED_SIZE;
+		if (op_type == PGRAFT_KV_PATCH && old_size >= 0)
+			grow = value_size;
+		else
+			grow = (old_size < 0) ? key_len + value_size : value_size - old_size;
+
+		if (recount)
+			pgraft_kv_quota_usage(check->quota, &keys, &bytes);
+		else
+		{
+			keys = Max((int64) pg_atomic_read_u64(&check->quota->keys), 0);
+			bytes = Max((int64) pg_atomic_read_u64(&check->quota->bytes), 0);
+		}
+
+		if (check->max_keys > 0 && old_size < 0 && keys + 1 > check->max_keys)
+		{
+			SpinLockAcquire(&g_kv_quota_state->mutex);
+			check->quota->refused_keys++;
+			SpinLockRelease(&g_kv_quota_state->mutex);
+			refusal->quota = check->quota;
+			refusal->used = keys;
+			refusal->limit = check->max_keys;
+			return PGRAFT_KV_QUOTA_KEYS;
+		}
+
+		if (check->max_bytes > 0 && grow > 0 && bytes + grow > check->max_bytes)
+		{
+			SpinLockAcquire(&g_kv_quota_state->mutex);
+			check->quota->refused_bytes++;
+			SpinLockRelease(&g_kv_quota_state->mutex);
+			refusal->quota = check->quota;
+			refusal->used = bytes;
+			refusal->grow = grow;
+			refusal->limit = check->max_bytes;
+			return PGRAFT_KV_QUOTA_BYTES;
+		}
+	}
+
+	/* Write rate: take a token from every limited quota, or from none */
+	now = GetCurrentTimestamp();
+	SpinLockAcquire(&g_kv_quota_state->mutex);
+	for (i = 0; i < num_checks; i++)
+	{
+		pgraft_kv_quota_t *quota = checks[i].quota;
+
+		if (quota->max_write_rate == 0)
+			continue;
+		pgraft_kv_quota_refill(quota, now);
+		if (quota->tokens < 1.0 && refused == NULL)
+			refused = &checks[i];
+	}
+	for (i = 0; i < num_checks; i++)
+	{
+		pgraft_kv_quota_t *quota = checks[i].quota;
+
+		if (refused)
+		{
+			if (refused == &checks[i])
+				quota->refused_rate++;
+			continue;
+		}
+		if (quota->max_write_rate > 0)
+			quota->tokens -= 1.0;
+		quota->admitted++;
+	}
+	if (refused)
+		refusal->limit = refused->quota->max_write_rate;
+	SpinLockRelease(&g_kv_quota_state->mutex);
+
+	if (refused)
+	{
+		refusal->quota = refused->quota;
+		return PGRAFT_KV_QUOTA_RATE;
+	}
+	return PGRAFT_KV_QUOTA_ADMITTED;
+}
+
+/*
+ * Refuse a write to key if a quota whose prefix it starts with does not
+ * allow it
+ *
+ * value is the new value of a put and the patch of a patch.
+ */
+void
+pgraft_kv_quota_admit(pgraft_kv_op_type_t op_type, const char *key, const char *value)
+{
+	pgraft_kv_quota_refusal_t refusal;
+	int64		value_size = (op_type == PGRAFT_KV_DELETE || value == NULL) ? 0 : strlen(value);
+	int			result;
+
+	memset(&refusal, 0, sizeof(refusal));
+	result = pgraft_kv_quota_check(op_type, key, value_size, PGRAFT_KV_QUOTA_SIZE_UNKNOWN, true, &refusal);
+	if (result == PGRAFT_KV_QUOTA_NEED_SIZE)
+		result = pgraft_kv_quota_check(op_type, key, value_size, pgraft_kv_value_size(key), true, &refusal);
+
+	switch (result)
+	{
+		case PGRAFT_KV_QUOTA_KEYS:
+			ereport(ERROR,
+					(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+					 errmsg("pgraft_kv: key quota of \"%s\" exceeded by new key \"%s\"",
+							refusal.quota->prefix, key),
+					 errdetail("The prefix holds %lld keys, the limit is %lld.",
+							   (long long) refusal.used, (long long) refusal.limit)));
+			break;
+		case PGRAFT_KV_QUOTA_BYTES:
+			ereport(ERROR,
+					(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+					 errmsg("pgraft_kv: byte quota of \"%s\" exceeded by write to key \"%s\"",
+							refusal.quota->prefix, key),
+					 errdetail("The prefix holds %lld bytes and the write adds %lld, the limit is %lld.",
+							   (long long) refusal.used, (long long) refusal.grow,
+							   (long long) refusal.limit)));
+			break;
+		case PGRAFT_KV_QUOTA_RATE:
+			ereport(ERROR,
+					(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+					 errmsg("pgraft_kv: write rate quota of \"%s\" exceeded by write to key \"%s\"",
+							refusal.quota->prefix, key),
+					 errdetail("The limit is %d writes per second.", (int) refusal.limit),
+					 errhint("Retry the write later.")));
+			break;
+	}
+}
+
+/*
+ * Check a write through the client gateway against the key's quotas
+ *
+ * The Go layer calls this from its own threads before proposing, so it
+ * takes no LWLock and raises no error: usage is read as last counted,
+ * which the worker keeps current (pgraft_kv_quota_refresh()), and the
+ * key's current size comes from the caller.  Returns a PGRAFT_KV_QUOTA_*
+ * result.
+ */
+int
+pgraft_kv_quota_admit_gateway(const char *key, int is_delete, int64_t value_size, int64_t old_size)
+{
+	pgraft_kv_quota_refusal_t refusal;
+
+	memset(&refusal, 0, sizeof(refusal));
+	return pgraft_kv_quota_check(is_delete ? PGRAFT_KV_DELETE : PGRAFT_KV_PUT, key, value_size, old_size,
+								 false, &refusal);
+}
+
+/*
+ * Refuse an entry appended to the log as it is if its KV writes are not
+ * allowed
+ *
+ * pgraft_log_append() proposes any payload, and one of a KV entry type is
+ * applied like the entries the KV functions propose, so its writes are
+ * checked the same way.  Both branches of a Txn are checked, as either may
+ * run.
+ */
+void
+pgraft_kv_quota_admit_entry(const char *json_data, size_t len)
+{
+	char		type[32];
+	int			i;
+
+	if (!g_kv_quota_state || pg_atomic_read_u32(&g_kv_quota_state->num_quotas) == 0)
+		return;
+	if (len == 0 || json_data[0] != '{' || pgraft_json_get_type(json_data, len, type, sizeof(type)) != 0)
+		return;
+
+	if (strcmp(type, "kv_put") == 0 || strcmp(type, "kv_delete") == 0 || strcmp(type, "kv_patch") == 0)
+	{
+		int			op_type;
+		char	   *key;
+		char	   *value;
+
+		if (pgraft_json_parse_kv_operation(json_data, len, &op_type, &key, &value) == 0)
+			pgraft_kv_quota_admit((pgraft_kv_op_type_t) op_type, key, value);
+	}
+	else if (strcmp(type, "kv_batch") == 0)
+	{
+		pgraft_kv_batch_item_t *items;
+		int			count;
+
+		if (pgraft_json_parse_kv_batch(json_data, len, &items, &count) != 0)
+			return;
+		for (i = 0; i < count; i++)
+			pgraft_kv_quota_admit(items[i].value ? PGRAFT_KV_PUT : PGRAFT_KV_DELETE, items[i].key, items[i].value);
+	}
+	else if (strcmp(type, "kv_txn") == 0)
+	{
+		pgraft_kv_txn_t txn;
+
+		if (pgraft_json_parse_kv_txn(json_data, len, &txn) != 0)
+			return;
+		for (i = 0; i < txn.num_success; i++)
+			pgraft_kv_quota_admit(txn.success[i].is_delete ? PGRAFT_KV_DELETE : PGRAFT_KV_PUT,
+								  txn.success[i].key, txn.success[i].value);
+		for (i = 0; i < txn.num_failure; i++)
+			pgraft_kv_quota_admit(txn.failure[i].is_delete ? PGRAFT_KV_DELETE : PGRAFT_KV_PUT,
+								  txn.failure[i].key, txn.failure[i].value);
+	}
+}
+
+/*
+ * Count again the usage of quotas whose count is stale (worker)
+ *
+ * Usage goes stale when the store drops entries wholesale.  Backends
+ * recount on their own, but the client gateway's checks cannot, so the
+ * worker does it for them while the gateway is on.
+ */
+void
+pgraft_kv_quota_refresh(void)
+{
+	uint32		num_quotas;
+	int64		keys;
+	int64		bytes;
+	uint32		i;
+
+	if (!g_kv_quota_state)
+		return;
+
+	num_quotas = pg_atomic_read_u32(&g_kv_quota_state->num_quotas);
+	for (i = 0; i < num_quotas; i++)
+	{
+		pgraft_kv_quota_t *quota = &g_kv_quota_state->quotas[i];
+		bool		in_use;
+
+		SpinLockAcquire(&g_kv_quota_state->mutex);
+		in_use = quota->in_use;
+		SpinLockRelease(&g_kv_quota_state->mutex);
+
+		if (in_use)
+			pgraft_kv_quota_usage(quota, &keys, &bytes);
+	}
+}
+
+/*
+ * Add an applied change of a key to the usage of its quotas
+ *
+ * Called by the apply process under the store mutex; sizes are value
+ * lengths, -1 where the key did not or does not exist.
+ */
+void
+pgraft_kv_quota_account(const char *key, int old_size, int new_size)
+{
+	uint32		num_quotas;
+	int64		key_len;
+	int64		keys;
+	int64		bytes;
+	uint32		i;
+
+	if (!g_kv_quota_state)
+		return;
+
+	num_quotas = pg_atomic_read_u32(&g_kv_quota_state->num_quotas);
+	if (num_quotas == 0)
+		return;
+	pg_read_barrier();
+
+	key_len = strlen(key);
+	keys = (new_size >= 0) - (old_size >= 0);
+	bytes = (new_size >= 0 ? key_len + new_size : 0) - (old_size >= 0 ? key_len + old_size : 0);
+
+	/* Dropped quotas keep counting, so that setting them again is accurate */
+	for (i = 0; i < num_quotas; i++)
+	{
+		pgraft_kv_quota_t *quota = &g_kv_quota_state->quotas[i];
+
+		if (strncmp(key, quota->prefix, quota->prefix_len) != 0)
+			continue;
+		if (keys != 0)
+			pg_atomic_fetch_add_u64(&quota->keys, keys);
+		if (bytes != 0)
+			pg_atomic_fetch_add_u64(&quota->bytes, bytes);
+	}
+}
+
+/*
+ * Apply a committed quota entry
+ * Runs on every node in log order, so the limits are the same everywhere
+ */
+int
+pgraft_kv_quota_apply(uint64 raft_index, const char *json_data, size_t len)
+{
+	pgraft_kv_quota_op_t op;
+	pgraft_kv_quota_t *quota;
+	uint32		num_quotas;
+
+	if (!g_kv_quota_state)
+		return -1;
+
+	if (pgraft_json_parse_kv_quota_operation(json_data, len, &op) != 0)
+		return -1;
+
+	SpinLockAcquire(&g_kv_quota_state->mutex);
+	quota = pgraft_kv_quota_find(op.prefix);
+	if (quota == NULL)
+	{
+		num_quotas = pg_atomic_read_u32(&g_kv_quota_state->num_quotas);
+		if (num_quotas >= PGRAFT_KV_MAX_QUOTAS)
+		{
+			SpinLockRelease(&g_kv_quota_state->mutex);
+			elog(WARNING, "pgraft_kv: quota table full, cannot apply quota of \"%s\" at index %lu",
+				 op.prefix, (unsigned long) raft_index);
+			return -1;
+		}
+
+		/* Fill the slot in before the apply path and backends can see it */
+		quota = &g_kv_quota_state->quotas[num_quotas];
+		memset(quota, 0, sizeof(*quota));
+		strlcpy(quota->prefix, op.prefix, sizeof(quota->prefix));
+		quota->prefix_len = strlen(quota->prefix);
+		pg_atomic_init_u64(&quota->keys, 0);
+		pg_atomic_init_u64(&quota->bytes, 0);
+		pg_atomic_init_u64(&quota->counted_at, 0);
+		pg_write_barrier();
+		pg_atomic_write_u32(&g_kv_quota_state->num_quotas, num_quotas + 1);
+	}
+
+	quota->in_use = !op.drop;
+	quota->max_keys = op.drop ? 0 : op.max_keys;
+	quota->max_bytes = op.drop ? 0 : op.max_bytes;
+	quota->max_write_rate = op.drop ? 0 : op.max_write_rate;
+	quota->request = op.request;
+	quota->term = op.term;
+	quota->node_id = op.node_id;
+	quota->refilled_at = 0;
+	SpinLockRelease(&g_kv_quota_state->mutex);
+
+	elog(LOG, "pgraft_kv: %s quota of \"%s\" at index %lu", op.drop ? "dropped" : "set",
+		 op.prefix, (unsigned long) raft_index);
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_quota_sql.c
+ *      SQL interface for KV namespace quotas
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+
+#include "../include/pgraft_kv_quota.h"
+
+PG_FUNCTION_INFO_V1(pgraft_kv_set_quota_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_drop_quota_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_quotas_sql);
+
+/*
+ * Limit the keys starting with a prefix (leader only, replicated)
+ * Usage: SELECT pgraft_kv_set_quota('/team-a/', max_keys => 10000, max_bytes => 1048576);
+ */
+Datum
+pgraft_kv_set_quota_sql(PG_FUNCTION_ARGS)
+{
+	char	   *prefix;
+	int64		max_keys;
+	int64		max_bytes;
+	int32		max_write_rate;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_kv: quota prefix cannot be NULL");
+
+	prefix = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	max_keys = PG_ARGISNULL(1) ? 0 : PG_GETARG_INT64(1);
+	max_bytes = PG_ARGISNULL(2) ? 0 : PG_GETARG_INT64(2);
+	max_write_rate = PG_ARGISNULL(3) ? 0 : PG_GETARG_INT32(3);
+
+	pgraft_kv_quota_set(prefix, max_keys, max_bytes, max_write_rate);
+	pfree(prefix);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Drop the quota of a prefix (leader only, replicated)
+ * Usage: SELECT pgraft_kv_drop_quota('/team-a/');
+ */
+Datum
+pgraft_kv_drop_quota_sql(PG_FUNCTION_ARGS)
+{
+	char	   *prefix;
+	bool		dropped;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_kv: quota prefix cannot be NULL");
+
+	prefix = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	dropped = pgraft_kv_quota_drop(prefix);
+	pfree(prefix);
+
+	PG_RETURN_BOOL(dropped);
+}
+
+/*
+ * List quotas with their usage on this node and the writes the leader
+ * admitted and refused
+ */
+Datum
+pgraft_kv_quotas_sql(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	pgraft_kv_quota_state_t *state;
+	pgraft_kv_quota_t *quotas;
+	int			num_quotas;
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	state = pgraft_kv_quota_get_state();
+	if (state == NULL)
+		return (Datum) 0;
+
+	/* Copy the limits out so no tuple building happens under the spinlock */
+	quotas = (pgraft_kv_quota_t *) palloc(sizeof(pgraft_kv_quota_t) * PGRAFT_KV_MAX_QUOTAS);
+	SpinLockAcquire(&state->mutex);
+	num_quotas = pg_atomic_read_u32(&state->num_quotas);
+	memcpy(quotas, state->quotas, sizeof(pgraft_kv_quota_t) * num_quotas);
+	SpinLockRelease(&state->mutex);
+
+	for (i = 0; i < num_quotas; i++)
+	{
+		Datum		values[11];
+		bool		nulls[11];
+		int64		keys;
+		int64		bytes;
+
+		if (!quotas[i].in_use)
+			continue;
+
+		/* Usage is read from the table itself, recounting it if needed */
+		pgraft_kv_quota_usage(&state->quotas[i], &keys, &bytes);
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(quotas[i].prefix);
+		values[1] = Int64GetDatum(quotas[i].max_keys);
+		nulls[1] = (quotas[i].max_keys == 0);
+		values[2] = Int64GetDatum(quotas[i].max_bytes);
+		nulls[2] = (quotas[i].max_bytes == 0);
+		values[3] = Int32GetDatum(quotas[i].max_write_rate);
+		nulls[3] = (quotas[i].max_write_rate == 0);
+		values[4] = Int64GetDatum(keys);
+		values[5] = Int64GetDatum(bytes);
+		values[6] = Int64GetDatum(quotas[i].admitted);
+		values[7] = Int64GetDatum(quotas[i].refused_keys);
+		values[8] = Int64GetDatum(quotas[i].refused_bytes);
+		values[9] = Int64GetDatum(quotas[i].refused_rate);
+		values[10] = Float8GetDatum(Max(quotas[i].max_keys > 0 ? (double) keys / quotas[i].max_keys : 0.0,
+										quotas[i].max_bytes > 0 ? (double) bytes / quotas[i].max_bytes : 0.0));
+		nulls[10] = (quotas[i].max_keys == 0 && quotas[i].max_bytes == 0);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(quotas);
+
+	return (Datum) 0;
+}
@@ -1,14 +1,19 @@
 #include "postgres.h"
 #include "fmgr.h"
 #include "utils/builtins.h"
+#include "utils/jsonb.h"
 #include "utils/timestamp.h"
 #include "miscadmin.h"
 #include "storage/proc.h"
 #include "access/tupdesc.h"
 #include "funcapi.h"
+#include "utils/tuplestore.h"
 #include "../include/pgraft_kv.h"
+#include "../include/pgraft_kv_cold.h"
+#include "../include/pgraft_guc.h"
 #include "../include/pgraft_core.h"
 #include "../include/pgraft_json.h"
+#include "../include/pgraft_go.h"
 
 /* Prototypes for PostgreSQL functions */
 
@@ -17,9 +22,16 @@ PG_FUNCTION_INFO_V1(pgraft_kv_put_sql);
 PG_FUNCTION_INFO_V1(pgraft_kv_get_sql);
 PG_FUNCTION_INFO_V1(pgraft_kv_delete_sql);
 PG_FUNCTION_INFO_V1(pgraft_kv_exists_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_patch_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_version_sql);
 PG_FUNCTION_INFO_V1(pgraft_kv_list_keys_sql);
 PG_FUNCTION_INFO_V1(pgraft_kv_stats_sql);
 PG_FUNCTION_INFO_V1(pgraft_kv_get_stats_table);
+PG_FUNCTION_INFO_V1(pgraft_kv_value_stats_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_tier_stats_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_defrag_stats_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_hash_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_hash_tree_sql);
 PG_FUNCTION_INFO_V1(pgraft_kv_compact_sql);
 PG_FUNCTION_INFO_V1(pgraft_kv_reset_sql);
 
@@ -27,7 +39,7 @@ PG_FUNCTION_INFO_V1(pgraft_kv_reset_sql);
 static int
 replicate_kv_operation(pgraft_kv_op_type_t op_type, const char *key, const char *value)
 {
-	char json_data[2048];
+	char json_data[PGRAFT_PROPOSAL_DATA_SIZE + 1];
 	int result;
 	char *client_id;
 	
@@ -105,8 +117,8 @@ pgraft_kv_put_sql(PG_FUNCTION_ARGS)
 		PG_RETURN_BOOL(false);
 	}
 	
-	if (strlen(value) >= 1024) {
-		elog(WARNING, "pgraft_kv: value too long (max 1023 characters, got %zu)", strlen(value));
+	if (strlen(value) >= PGRAFT_KV_VALUE_SIZE) {
+		elog(WARNING, "pgraft_kv: value too long (max %d characters, got %zu)", PGRAFT_KV_VALUE_SIZE - 1, strlen(value));
 		PG_RETURN_BOOL(false);
 	}
 	
@@ -134,7 +146,7 @@ pgraft_kv_get_sql(PG_FUNCTION_ARGS)
 {
 	text *key_text;
 	char *key;
-	char value[1024];
+	char value[PGRAFT_KV_VALUE_SIZE];
 	int64_t version;
 	int result;
 	
@@ -253,6 +265,96 @@ pgraft_kv_exists_sql(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(exists);
 }
 
+/*
+ * PATCH operation - apply a JSON merge patch (RFC 7386) to a key's value
+ * Usage: SELECT pgraft_kv_patch('mykey', '{"a": null, "b": 2}', 3);
+ *
+ * Only the patch is replicated.  With an expected version the patch is
+ * skipped on every node unless the key is still at that version when the
+ * entry is applied (0 means the key must not exist).
+ */
+Datum
+pgraft_kv_patch_sql(PG_FUNCTION_ARGS)
+{
+	Jsonb *patch_jb;
+	char *key;
+	char *patch;
+	char *client_id;
+	int64_t expected_version = -1;
+	int result;
+	
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1)) {
+		elog(WARNING, "pgraft_kv: key and patch cannot be NULL");
+		PG_RETURN_BOOL(false);
+	}
+	
+	key = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	patch_jb = PG_GETARG_JSONB_P(1);
+	patch = JsonbToCString(NULL, &patch_jb->root, VARSIZE(patch_jb));
+	
+	if (!PG_ARGISNULL(2)) {
+		expected_version = PG_GETARG_INT64(2);
+		if (expected_version < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("pgraft_kv: expected version must not be negative")));
+	}
+	
+	if (strlen(key) == 0) {
+		elog(WARNING, "pgraft_kv: key cannot be empty");
+		PG_RETURN_BOOL(false);
+	}
+	
+	if (strlen(key) >= 256) {
+		elog(WARNING, "pgraft_kv: key too long (max 255 characters, got %zu)", strlen(key));
+		PG_RETURN_BOOL(false);
+	}
+	
+	if (strlen(patch) >= PGRAFT_KV_VALUE_SIZE) {
+		elog(WARNING, "pgraft_kv: patch too long (max %d characters, got %zu)", PGRAFT_KV_VALUE_SIZE - 1, strlen(patch));
+		PG_RETURN_BOOL(false);
+	}
+	
+	if (strpbrk(key, "\r\n\t")) {
+		elog(WARNING, "pgraft_kv: key contains invalid characters (null, newline, tab, or carriage return)");
+		PG_RETURN_BOOL(false);
+	}
+	
+	client_id = psprintf("pg_%d", MyProcPid);
+	result = pgraft_kv_replicate_patch(key, patch, expected_version, client_id);
+	
+	pfree(client_id);
+	pfree(patch);
+	pfree(key);
+	
+	PG_RETURN_BOOL(result == 0);
+}
+
+/*
+ * VERSION operation - current version of a key, for pgraft_kv_patch()
+ * Usage: SELECT pgraft_kv_version('mykey');
+ */
+Datum
+pgraft_kv_version_sql(PG_FUNCTION_ARGS)
+{
+	char *key;
+	char value[PGRAFT_KV_VALUE_SIZE];
+	int64_t version;
+	int result;
+	
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	
+	key = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	result = pgraft_kv_get(key, value, sizeof(value), &version);
+	pfree(key);
+	
+	if (result != 0)
+		PG_RETURN_NULL();
+	
+	PG_RETURN_INT64(version);
+}
+
 /*
  * LIST_KEYS operation - list all keys as JSON array
  * Usage: SELECT pgraft_kv_list_keys();
@@ -308,10 +410,11 @@ pgraft_kv_get_stats_table(PG_FUNCTION_ARGS)
 {
 	pgraft_kv_store_t *store;
 	TupleDesc tupdesc;
-	Datum values[8];
-	bool nulls[8] = {false};
+	Datum values[12];
+	bool nulls[12] = {false};
 	HeapTuple tuple;
 	int active_entries = 0, deleted_entries = 0;
+	int64 raw_bytes = 0;
 	
 	/* Get the store */
 	store = pgraft_kv_get_store();
@@ -328,8 +431,10 @@ pgraft_kv_get_stats_table(PG_FUNCTION_ARGS)
 	for (int i = 0; i < store->num_entries; i++) {
 		if (store->entries[i].deleted)
 			deleted_entries++;
-		else
+		else {
 			active_entries++;
+			raw_bytes += store->entries[i].raw_size;
+		}
 	}
 	
 	/* Prepare values */
@@ -341,12 +446,269 @@ pgraft_kv_get_stats_table(PG_FUNCTION_ARGS)
 	values[5] = Int64GetDatum(store->gets);
 	values[6] = Int32GetDatum(active_entries);
 	values[7] = Int32GetDatum(deleted_entries);
+	values[8] = Int64GetDatum(raw_bytes);
+	values[9] = Int64GetDatum((int64) store->arena_live);
+	values[10] = Int64GetDatum((int64) store->arena_used);
+	values[11] = Int64GetDatum((int64) store->arena_size);
 	
 	/* Build and return tuple */
 	tuple = heap_form_tuple(tupdesc, values, nulls);
 	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
 }
 
+/*
+ * Per-key storage footprint, showing which values are kept compressed
+ * Usage: SELECT * FROM pgraft_kv_value_stats();
+ */
+Datum
+pgraft_kv_value_stats_sql(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	pgraft_kv_value_stats_t *rows;
+	TupleDesc tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	int count;
+	int i;
+	
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "pgraft_kv: return type must be a row type");
+	
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	
+	MemoryContextSwitchTo(oldcontext);
+	
+	rows = (pgraft_kv_value_stats_t *) palloc(sizeof(pgraft_kv_value_stats_t) * lengthof(((pgraft_kv_store_t *) NULL)->entries));
+	count = pgraft_kv_get_value_stats(rows, lengthof(((pgraft_kv_store_t *) NULL)->entries));
+	
+	for (i = 0; i < count; i++) {
+		Datum values[5];
+		bool nulls[5] = {false};
+		
+		values[0] = CStringGetTextDatum(rows[i].key);
+		values[1] = Int64GetDatum(rows[i].version);
+		values[2] = Int32GetDatum((int32) rows[i].raw_size);
+		values[3] = Int32GetDatum((int32) rows[i].stored_size);
+		values[4] = BoolGetDatum(rows[i].compressed);
+		
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+	
+	pfree(rows);
+	
+	return (Datum) 0;
+}
+
+/*
+ * Hot and cold tier sizes and how reads were answered
+ * Usage: SELECT * FROM pgraft_kv_tier_stats();
+ */
+Datum
+pgraft_kv_tier_stats_sql(PG_FUNCTION_ARGS)
+{
+	pgraft_kv_store_t stats;
+	TupleDesc tupdesc;
+	Datum values[11];
+	bool nulls[11] = {false};
+	HeapTuple tuple;
+	int64 lookups;
+	
+	if (pgraft_kv_get_stats(&stats) != 0)
+		elog(ERROR, "pgraft_kv: key/value store not initialized");
+	
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "pgraft_kv: return type must be a row type");
+	
+	lookups = stats.hot_hits + stats.cold_hits + stats.misses;
+	
+	values[0] = Int32GetDatum(stats.num_entries);
+	values[1] = Int64GetDatum((int64) pgraft_kv_hot_bytes(&stats));
+	values[2] = Int64GetDatum((int64) pgraft_kv_memory_budget * 1024);
+	nulls[2] = (pgraft_kv_memory_budget == 0);
+	values[3] = Int64GetDatum(stats.cold_entries);
+	values[4] = Int64GetDatum(pgraft_kv_cold_file_size());
+	values[5] = Int64GetDatum(stats.hot_hits);
+	values[6] = Int64GetDatum(stats.cold_hits);
+	values[7] = Int64GetDatum(stats.misses);
+	values[8] = Float8GetDatum(lookups > 0 ? (double) stats.hot_hits / lookups : 0.0);
+	nulls[8] = (lookups == 0);
+	values[9] = Int64GetDatum(stats.evictions);
+	values[10] = Int64GetDatum(stats.promotions);
+	
+	tuple = heap_form_tuple(tupdesc, values, nulls);
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
+
+/*
+ * How fragmented the store is and what background defragmentation did
+ * Usage: SELECT * FROM pgraft_kv_defrag_stats();
+ */
+Datum
+pgraft_kv_defrag_stats_sql(PG_FUNCTION_ARGS)
+{
+	pgraft_kv_store_t stats;
+	TupleDesc tupdesc;
+	Datum values[11];
+	bool nulls[11] = {false};
+	HeapTuple tuple;
+	int deleted = 0;
+	int i;
+	
+	if (pgraft_kv_get_stats(&stats) != 0)
+		elog(ERROR, "pgraft_kv: key/value store not initialized");
+	
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "pgraft_kv: return type must be a row type");
+	
+	for (i = 0; i < stats.num_entries; i++)
+	{
+		if (stats.entries[i].deleted)
+			deleted++;
+	}
+	
+	values[0] = Int64GetDatum((int64) stats.arena_size);
+	values[1] = Int64GetDatum((int64) stats.arena_used);
+	values[2] = Int64GetDatum((int64) stats.arena_live);
+	values[3] = Float8GetDatum(stats.arena_used > 0 ?
+							   (double) (stats.arena_used - stats.arena_live) / stats.arena_used : 0.0);
+	values[4] = Int32GetDatum(deleted);
+	values[5] = BoolGetDatum(stats.defrag_active);
+	values[6] = Int64GetDatum(stats.defrag_passes);
+	values[7] = Int64GetDatum(stats.defrag_relocations);
+	values[8] = Int64GetDatum(stats.defrag_bytes_moved);
+	values[9] = Int64GetDatum(stats.defrag_purged);
+	values[10] = Int64GetDatum(stats.full_compactions);
+	
+	tuple = heap_form_tuple(tupdesc, values, nulls);
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
+
+/*
+ * HASHKV operation - root of the store's hash tree after a given change
+ * Usage: SELECT * FROM pgraft_kv_hash();
+ *        SELECT * FROM pgraft_kv_hash(42);
+ */
+Datum
+pgraft_kv_hash_sql(PG_FUNCTION_ARGS)
+{
+	int64 revision = PG_ARGISNULL(0) ? 0 : PG_GETARG_INT64(0);
+	uint64 hash;
+	uint64 hash_revision;
+	uint64 compact_revision;
+	TupleDesc tupdesc;
+	Datum values[3];
+	bool nulls[3] = {false};
+	HeapTuple tuple;
+	
+	if (revision < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("pgraft_kv: revision must not be negative")));
+	
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "pgraft_kv: return type must be a row type");
+	
+	if (pgraft_kv_get_hash((uint64) revision, &hash, &hash_revision, &compact_revision) != 0)
+	{
+		if ((uint64) revision > hash_revision)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("pgraft_kv: revision " INT64_FORMAT " is a future revision", revision),
+					 errdetail("The store has applied " UINT64_FORMAT " changes.", hash_revision)));
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("pgraft_kv: revision " INT64_FORMAT " has been compacted", revision),
+				 errdetail("The oldest revision kept is " UINT64_FORMAT ".", compact_revision)));
+	}
+	
+	values[0] = Int64GetDatum((int64) hash);
+	values[1] = Int64GetDatum((int64) (revision > 0 ? (uint64) revision : hash_revision));
+	values[2] = Int64GetDatum((int64) compact_revision);
+	
+	tuple = heap_form_tuple(tupdesc, values, nulls);
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
+
+/*
+ * One level of the store's hash tree, to find the buckets where two nodes
+ * differ
+ * Usage: SELECT * FROM pgraft_kv_hash_tree(4);
+ */
+Datum
+pgraft_kv_hash_tree_sql(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	int32 level;
+	TupleDesc tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	uint64 *hashes;
+	uint64 revision;
+	int width;
+	int i;
+	
+	if (PG_ARGISNULL(0))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("pgraft_kv: hash tree level cannot be NULL")));
+	
+	level = PG_GETARG_INT32(0);
+	if (level < 0 || level > PGRAFT_KV_HASH_DEPTH)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("pgraft_kv: hash tree level must be between 0 and %d", PGRAFT_KV_HASH_DEPTH)));
+	
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "pgraft_kv: return type must be a row type");
+	
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	
+	MemoryContextSwitchTo(oldcontext);
+	
+	hashes = (uint64 *) palloc(sizeof(uint64) << level);
+	revision = pgraft_kv_get_hash_level(level, hashes);
+	
+	/* Buckets below each node */
+	width = PGRAFT_KV_HASH_LEAVES >> level;
+	
+	for (i = 0; i < (1 << level); i++) {
+		Datum values[5];
+		bool nulls[5] = {false};
+		
+		values[0] = Int32GetDatum(i);
+		values[1] = Int32GetDatum(i * width);
+		values[2] = Int32GetDatum((i + 1) * width - 1);
+		values[3] = Int64GetDatum((int64) hashes[i]);
+		values[4] = Int64GetDatum((int64) revision);
+		
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+	
+	pfree(hashes);
+	
+	return (Datum) 0;
+}
+
 /*
  * COMPACT operation - remove deleted entries and optimize storage
  * Usage: SELECT pgraft_kv_compact();
@@ -0,0 +1,442 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_stats.c
+ *      Per-namespace KV statistics and hot key sketches
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "common/hashfn.h"
+#include "port/atomics.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/timestamp.h"
+
+#include "../include/pgraft_kv_stats.h"
+#include "../include/pgraft_guc.h"
+
+/* Global shared memory pointer */
+static pgraft_kv_stats_state_t *g_kv_stats_state = NULL;
+
+static void
+pgraft_kv_namespace_stats_clear(pgraft_kv_namespace_stats_t *ns)
+{
+	pg_atomic_write_u64(&ns->reads, 0);
+	pg_atomic_write_u64(&ns->read_misses, 0);
+	pg_atomic_write_u64(&ns->read_bytes, 0);
+	pg_atomic_write_u64(&ns->read_time_ns, 0);
+	pg_atomic_write_u64(&ns->puts, 0);
+	pg_atomic_write_u64(&ns->deletes, 0);
+	pg_atomic_write_u64(&ns->write_bytes, 0);
+	pg_atomic_write_u64(&ns->proposals, 0);
+	pg_atomic_write_u64(&ns->proposal_time_ns, 0);
+}
+
+static void
+pgraft_kv_namespace_stats_init(pgraft_kv_namespace_stats_t *ns)
+{
+	pg_atomic_init_u32(&ns->used, 0);
+	pg_atomic_init_u64(&ns->reads, 0);
+	pg_atomic_init_u64(&ns->read_misses, 0);
+	pg_atomic_init_u64(&ns->read_bytes, 0);
+	pg_atomic_init_u64(&ns->read_time_ns, 0);
+	pg_atomic_init_u64(&ns->puts, 0);
+	pg_atomic_init_u64(&ns->deletes, 0);
+	pg_atomic_init_u64(&ns->write_bytes, 0);
+	pg_atomic_init_u64(&ns->proposals, 0);
+	pg_atomic_init_u64(&ns->proposal_time_ns, 0);
+}
+
+/*
+ * Initialize shared memory for KV statistics
+ */
+void
+pgraft_kv_stats_init_shared_memory(void)
+{
+	bool		found;
+	int			i;
+	int			j;
+	int			k;
+
+	g_kv_stats_state = (pgraft_kv_stats_state_t *) ShmemInitStruct("pgraft_kv_stats_state",
+																   sizeof(pgraft_kv_stats_state_t),
+																   &found);
+
+	if (!found)
+	{
+		memset(g_kv_stats_state, 0, sizeof(pgraft_kv_stats_state_t));
+		SpinLockInit(&g_kv_stats_state->mutex);
+		g_kv_stats_state->stats_reset = GetCurrentTimestamp();
+
+		for (i = 0; i < PGRAFT_KV_NAMESPACE_SLOTS; i++)
+			pgraft_kv_namespace_stats_init(&g_kv_stats_state->namespaces[i]);
+		pgraft_kv_namespace_stats_init(&g_kv_stats_state->overflow);
+
+		for (i = 0; i < PGRAFT_KV_ACCESS_KINDS; i++)
+		{
+			pgraft_kv_sketch_t *sketch = &g_kv_stats_state->sketches[i];
+
+			for (j = 0; j < PGRAFT_KV_SKETCH_DEPTH; j++)
+				for (k = 0; k < PGRAFT_KV_SKETCH_WIDTH; k++)
+					pg_atomic_init_u64(&sketch->counters[j][k], 0);
+			pg_atomic_init_u64(&sketch->total, 0);
+			pg_atomic_init_u64(&sketch->threshold, 0);
+			for (j = 0; j < PGRAFT_KV_HOT_KEYS; j++)
+				pg_atomic_init_u64(&sketch->hashes[j], 0);
+		}
+	}
+}
+
+/*
+ * Get shared memory pointer
+ */
+pgraft_kv_stats_state_t *
+pgraft_kv_stats_get_shared_memory(void)
+{
+	if (g_kv_stats_state == NULL)
+		pgraft_kv_stats_init_shared_memory();
+	return g_kv_stats_state;
+}
+
+/*
+ * Bytes of a key that make up its namespace: a leading '/' and the first
+ * pgraft.kv_namespace_depth segments that end in '/'
+ */
+int
+pgraft_kv_namespace_length(const char *key)
+{
+	const char *p = key;
+	const char *end = key;
+	int			depth = 0;
+
+	if (*p == '/')
+		end = ++p;
+
+	for (; *p != '\0' && depth < pgraft_kv_namespace_depth; p++)
+	{
+		if (*p == '/')
+		{
+			end = p + 1;
+			depth++;
+		}
+	}
+
+	return (int) (end - key);
+}
+
+/*
+ * Counters of a key's namespace, claiming a slot the first time it is seen
+ */
+static pgraft_kv_namespace_stats_t *
+pgraft_kv_stats_namespace(pgraft_kv_stats_state_t *state, const char *key)
+{
+	char		prefix[PGRAFT_KV_NAMESPACE_SIZE];
+	int			length = Min(pgraft_kv_namespace_length(key), PGRAFT_KV_NAMESPACE_SIZE - 1);
+	bool		locked = false;
+	uint32		hash;
+	int			i;
+
+	memcpy(prefix, key, length);
+	prefix[length] = '\0';
+	hash = hash_bytes((const unsigned char *) prefix, length);
+
+	for (i = 0; i < PGRAFT_KV_NAMESPACE_SLOTS; i++)
+	{
+		pgraft_kv_namespace_stats_t *ns = &state->namespaces[(hash + i) % PGRAFT_KV_NAMESPACE_SLOTS];
+
+		if (pg_atomic_read_u32(&ns->used) == 0)
+		{
+			/* Look at the free slot again under the mutex before claiming it */
+			if (!locked)
+			{
+				SpinLockAcquire(&state->mutex);
+				locked = true;
+				i--;
+				continue;
+			}
+
+			ns->hash = hash;
+			strlcpy(ns->prefix, prefix, sizeof(ns->prefix));
+			pg_write_barrier();
+			pg_atomic_write_u32(&ns->used, 1);
+			SpinLockRelease(&state->mutex);
+			return ns;
+		}
+
+		pg_read_barrier();
+		if (ns->hash == hash && strcmp(ns->prefix, prefix) == 0)
+		{
+			if (locked)
+				SpinLockRelease(&state->mutex);
+			return ns;
+		}
+	}
+
+	if (locked)
+		SpinLockRelease(&state->mutex);
+	return &state->overflow;
+}
+
+/*
+ * Sketch column a key hash maps to in a row; each row uses 16 other bits
+ */
+static inline int
+pgraft_kv_sketch_column(uint64 hash, int row)
+{
+	return (int) ((hash >> (row * 16)) % PGRAFT_KV_SKETCH_WIDTH);
+}
+
+/*
+ * Count-min estimate of a key's accesses
+ */
+static uint64
+pgraft_kv_sketch_estimate(pgraft_kv_sketch_t *sketch, uint64 hash)
+{
+	uint64		estimate = PG_UINT64_MAX;
+	int			row;
+
+	for (row = 0; row < PGRAFT_KV_SKETCH_DEPTH; row++)
+		estimate = Min(estimate,
+					   pg_atomic_read_u64(&sketch->counters[row][pgraft_kv_sketch_column(hash, row)]));
+
+	return estimate;
+}
+
+/*
+ * Count one access to a key, and list it among the hot keys if its estimate
+ * passes that of the coldest listed key
+ */
+static void
+pgraft_kv_sketch_add(pgraft_kv_stats_state_t *state, pgraft_kv_sketch_t *sketch, const char *key)
+{
+	uint64		hash = hash_bytes_extended((const unsigned char *) key, strlen(key), 0);
+	uint64		estimate = PG_UINT64_MAX;
+	uint64		estimates[PGRAFT_KV_HOT_KEYS];
+	uint64		threshold;
+	int			coldest = 0;
+	int			row;
+	int			i;
+
+	/* 0 marks a free list slot */
+	if (hash == 0)
+		hash = 1;
+
+	pg_atomic_fetch_add_u64(&sketch->total, 1);
+	for (row = 0; row < PGRAFT_KV_SKETCH_DEPTH; row++)
+		estimate = Min(estimate,
+					   pg_atomic_add_fetch_u64(&sketch->counters[row][pgraft_kv_sketch_column(hash, row)], 1));
+
+	/* Nearly every access stops here, without a lock */
+	if (estimate <= pg_atomic_read_u64(&sketch->threshold))
+		return;
+	for (i = 0; i < PGRAFT_KV_HOT_KEYS; i++)
+	{
+		if (pg_atomic_read_u64(&sketch->hashes[i]) == hash)
+			return;
+	}
+
+	SpinLockAcquire(&state->mutex);
+
+	for (i = 0; i < PGRAFT_KV_HOT_KEYS; i++)
+	{
+		uint64		listed = pg_atomic_read_u64(&sketch->hashes[i]);
+
+		/* Listed by someone else meanwhile */
+		if (listed == hash)
+		{
+			SpinLockRelease(&state->mutex);
+			return;
+		}
+		estimates[i] = (listed == 0) ? 0 : pgraft_kv_sketch_estimate(sketch, listed);
+		if (estimates[i] < estimates[coldest])
+			coldest = i;
+	}
+
+	if (estimate > estimates[coldest])
+	{
+		strlcpy(sketch->keys[coldest], key, sizeof(sketch->keys[coldest]));
+		pg_atomic_write_u64(&sketch->hashes[coldest], hash);
+		estimates[coldest] = estimate;
+	}
+
+	/* The coldest listed key is what the next newcomer has to beat */
+	threshold = estimates[0];
+	for (i = 1; i < PGRAFT_KV_HOT_KEYS; i++)
+		threshold = Min(threshold, estimates[i]);
+	pg_atomic_write_u64(&sketch->threshold, threshold);
+
+	SpinLockRelease(&state->mutex);
+}
+
+/*
+ * Nanoseconds since an operation started
+ */
+static uint64
+pgraft_kv_stats_elapsed_ns(instr_time start)
+{
+	instr_time	elapsed;
+
+	INSTR_TIME_SET_CURRENT(elapsed);
+	INSTR_TIME_SUBTRACT(elapsed, start);
+	return (uint64) (INSTR_TIME_GET_DOUBLE(elapsed) * 1000000000.0);
+}
+
+/*
+ * Count a read of a key; value_bytes is -1 if the key was not found
+ */
+void
+pgraft_kv_stats_read(const char *key, int value_bytes, instr_time start)
+{
+	pgraft_kv_stats_state_t *state = pgraft_kv_stats_get_shared_memory();
+	pgraft_kv_namespace_stats_t *ns;
+
+	if (!state)
+		return;
+
+	ns = pgraft_kv_stats_namespace(state, key);
+	pg_atomic_fetch_add_u64(&ns->reads, 1);
+	if (value_bytes < 0)
+		pg_atomic_fetch_add_u64(&ns->read_misses, 1);
+	else
+		pg_atomic_fetch_add_u64(&ns->read_bytes, value_bytes);
+	pg_atomic_fetch_add_u64(&ns->read_time_ns, pgraft_kv_stats_elapsed_ns(start));
+
+	pgraft_kv_sketch_add(state, &state->sketches[PGRAFT_KV_ACCESS_READ], key);
+}
+
+/*
+ * Count an applied put or delete of a key
+ */
+void
+pgraft_kv_stats_write(const char *key, bool deleted, int value_bytes)
+{
+	pgraft_kv_stats_state_t *state = pgraft_kv_stats_get_shared_memory();
+	pgraft_kv_namespace_stats_t *ns;
+
+	if (!state)
+		return;
+
+	ns = pgraft_kv_stats_namespace(state, key);
+	if (deleted)
+		pg_atomic_fetch_add_u64(&ns->deletes, 1);
+	else
+	{
+		pg_atomic_fetch_add_u64(&ns->puts, 1);
+		pg_atomic_fetch_add_u64(&ns->write_bytes, value_bytes);
+	}
+
+	pgraft_kv_sketch_add(state, &state->sketches[PGRAFT_KV_ACCESS_WRITE], key);
+}
+
+/*
+ * Count a write proposed through Raft by this node, and how long the
+ * caller waited for it to be proposed
+ */
+void
+pgraft_kv_stats_proposal(const char *key, instr_time start)
+{
+	pgraft_kv_stats_state_t *state = pgraft_kv_stats_get_shared_memory();
+	pgraft_kv_namespace_stats_t *ns;
+
+	if (!state)
+		return;
+
+	ns = pgraft_kv_stats_namespace(state, key);
+	pg_atomic_fetch_add_u64(&ns->proposals, 1);
+	pg_atomic_fetch_add_u64(&ns->proposal_time_ns, pgraft_kv_stats_elapsed_ns(start));
+}
+
+/*
+ * Order hot keys by estimate, hottest first
+ */
+static int
+pgraft_kv_compare_hot_keys(const void *a, const void *b)
+{
+	uint64		estimate_a = ((const pgraft_kv_hot_key_t *) a)->estimate;
+	uint64		estimate_b = ((const pgraft_kv_hot_key_t *) b)->estimate;
+
+	if (estimate_a > estimate_b)
+		return -1;
+	return estimate_a < estimate_b ? 1 : 0;
+}
+
+/*
+ * Copy the listed hot keys of one kind of access, hottest first, into
+ * keys[PGRAFT_KV_HOT_KEYS]; sets total to the accesses counted and returns
+ * the number of keys
+ */
+int
+pgraft_kv_stats_hot_keys(pgraft_kv_access_t kind, pgraft_kv_hot_key_t *keys, uint64 *total)
+{
+	pgraft_kv_stats_state_t *state = pgraft_kv_stats_get_shared_memory();
+	pgraft_kv_sketch_t *sketch;
+	int			count = 0;
+	int			i;
+
+	*total = 0;
+	if (!state)
+		return 0;
+
+	sketch = &state->sketches[kind];
+
+	SpinLockAcquire(&state->mutex);
+	for (i = 0; i < PGRAFT_KV_HOT_KEYS; i++)
+	{
+		uint64		hash = pg_atomic_read_u64(&sketch->hashes[i]);
+
+		if (hash == 0)
+			continue;
+		memcpy(keys[count].key, sketch->keys[i], sizeof(keys[count].key));
+		keys[count].estimate = pgraft_kv_sketch_estimate(sketch, hash);
+		count++;
+	}
+	SpinLockRelease(&state->mutex);
+
+	*total = pg_atomic_read_u64(&sketch->total);
+	qsort(keys, count, sizeof(pgraft_kv_hot_key_t), pgraft_kv_compare_hot_keys);
+
+	return count;
+}
+
+/*
+ * Zero every counter and forget the hot keys; namespaces keep their slots
+ */
+void
+pgraft_kv_stats_reset(void)
+{
+	pgraft_kv_stats_state_t *state = pgraft_kv_stats_get_shared_memory();
+	TimestampTz now = GetCurrentTimestamp();
+	int			i;
+	int			j;
+	int			k;
+
+	if (!state)
+		return;
+
+	for (i = 0; i < PGRAFT_KV_NAMESPACE_SLOTS; i++)
+		pgraft_kv_namespace_stats_clear(&state->namespaces[i]);
+	pgraft_kv_namespace_stats_clear(&state->overflow);
+
+	for (i = 0; i < PGRAFT_KV_ACCESS_KINDS; i++)
+	{
+		pgraft_kv_sketch_t *sketch = &state->sketches[i];
+
+		for (j = 0; j < PGRAFT_KV_SKETCH_DEPTH; j++)
+			for (k = 0; k < PGRAFT_KV_SKETCH_WIDTH; k++)
+				pg_atomic_write_u64(&sketch->counters[j][k], 0);
+		pg_atomic_write_u64(&sketch->total, 0);
+	}
+
+	SpinLockAcquire(&state->mutex);
+	for (i = 0; i < PGRAFT_KV_ACCESS_KINDS; i++)
+	{
+		pg_atomic_write_u64(&state->sketches[i].threshold, 0);
+		for (j = 0; j < PGRAFT_KV_HOT_KEYS; j++)
+			pg_atomic_write_u64(&state->sketches[i].hashes[j], 0);
+	}
+	state->stats_reset = now;
+	SpinLockRelease(&state->mutex);
+}
@@ -0,0 +1,182 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_stats_sql.c
+ *      SQL interface for per-namespace KV statistics and hot keys
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+#include "../include/pgraft_kv_stats.h"
+
+PG_FUNCTION_INFO_V1(pgraft_kv_namespace_stats_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_hot_keys_sql);
+PG_FUNCTION_INFO_V1(pgraft_kv_stats_reset_sql);
+
+/*
+ * Start a materialized set-returning function's result
+ */
+static Tuplestorestate *
+pgraft_kv_stats_begin_set(FunctionCallInfo fcinfo, TupleDesc *tupdesc)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext oldcontext;
+	Tuplestorestate *tupstore;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = *tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return tupstore;
+}
+
+/*
+ * Add one namespace's row, unless nothing was counted for it
+ */
+static void
+pgraft_kv_namespace_stats_row(Tuplestorestate *tupstore, TupleDesc tupdesc,
+							  pgraft_kv_namespace_stats_t *ns, bool overflow, TimestampTz stats_reset)
+{
+	Datum		values[11];
+	bool		nulls[11];
+	uint64		reads = pg_atomic_read_u64(&ns->reads);
+	uint64		puts = pg_atomic_read_u64(&ns->puts);
+	uint64		deletes = pg_atomic_read_u64(&ns->deletes);
+	uint64		proposals = pg_atomic_read_u64(&ns->proposals);
+
+	if (reads == 0 && puts == 0 && deletes == 0 && proposals == 0)
+		return;
+
+	memset(nulls, 0, sizeof(nulls));
+
+	/* Namespaces past the table's capacity share one NULL row */
+	if (overflow)
+		nulls[0] = true;
+	else
+		values[0] = CStringGetTextDatum(ns->prefix);
+	values[1] = Int64GetDatum((int64) reads);
+	values[2] = Int64GetDatum((int64) pg_atomic_read_u64(&ns->read_misses));
+	values[3] = Int64GetDatum((int64) pg_atomic_read_u64(&ns->read_bytes));
+	values[4] = Float8GetDatum(reads > 0 ? pg_atomic_read_u64(&ns->read_time_ns) / 1000.0 / reads : 0.0);
+	nulls[4] = (reads == 0);
+	values[5] = Int64GetDatum((int64) puts);
+	values[6] = Int64GetDatum((int64) deletes);
+	values[7] = Int64GetDatum((int64) pg_atomic_read_u64(&ns->write_bytes));
+	values[8] = Int64GetDatum((int64) proposals);
+	values[9] = Float8GetDatum(proposals > 0 ? pg_atomic_read_u64(&ns->proposal_time_ns) / 1000000.0 / proposals : 0.0);
+	nulls[9] = (proposals == 0);
+	values[10] = TimestampTzGetDatum(stats_reset);
+
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+}
+
+/*
+ * Operations, bytes and latency per key namespace on this node
+ * Usage: SELECT * FROM pgraft_kv_namespace_stats();
+ */
+Datum
+pgraft_kv_namespace_stats_sql(PG_FUNCTION_ARGS)
+{
+	pgraft_kv_stats_state_t *state = pgraft_kv_stats_get_shared_memory();
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+	TimestampTz stats_reset;
+	int			i;
+
+	tupstore = pgraft_kv_stats_begin_set(fcinfo, &tupdesc);
+
+	SpinLockAcquire(&state->mutex);
+	stats_reset = state->stats_reset;
+	SpinLockRelease(&state->mutex);
+
+	for (i = 0; i < PGRAFT_KV_NAMESPACE_SLOTS; i++)
+	{
+		pgraft_kv_namespace_stats_t *ns = &state->namespaces[i];
+
+		if (pg_atomic_read_u32(&ns->used) == 0)
+			continue;
+		pg_read_barrier();
+		pgraft_kv_namespace_stats_row(tupstore, tupdesc, ns, false, stats_reset);
+	}
+	pgraft_kv_namespace_stats_row(tupstore, tupdesc, &state->overflow, true, stats_reset);
+
+	return (Datum) 0;
+}
+
+/*
+ * Most read and most written keys on this node, estimated by count-min
+ * sketches
+ * Usage: SELECT * FROM pgraft_kv_hot_keys();
+ */
+Datum
+pgraft_kv_hot_keys_sql(PG_FUNCTION_ARGS)
+{
+	static const char *const kinds[PGRAFT_KV_ACCESS_KINDS] = {"read", "write"};
+	pgraft_kv_hot_key_t keys[PGRAFT_KV_HOT_KEYS];
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+	int			kind;
+
+	tupstore = pgraft_kv_stats_begin_set(fcinfo, &tupdesc);
+
+	for (kind = 0; kind < PGRAFT_KV_ACCESS_KINDS; kind++)
+	{
+		uint64		total;
+		int			count;
+		int			i;
+
+		count = pgraft_kv_stats_hot_keys((pgraft_kv_access_t) kind, keys, &total);
+
+		for (i = 0; i < count; i++)
+		{
+			Datum		values[5];
+			bool		nulls[5];
+
+			memset(nulls, 0, sizeof(nulls));
+
+			values[0] = CStringGetTextDatum(kinds[kind]);
+			values[1] = Int32GetDatum(i + 1);
+			values[2] = CStringGetTextDatum(keys[i].key);
+			values[3] = Int64GetDatum((int64) keys[i].estimate);
+			values[4] = Float8GetDatum(total > 0 ? Min((double) keys[i].estimate / total, 1.0) : 0.0);
+
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+	}
+
+	return (Datum) 0;
+}
+
+/*
+ * Zero the namespace counters and hot key sketches
+ * Usage: SELECT pgraft_kv_stats_reset();
+ */
+Datum
+pgraft_kv_stats_reset_sql(PG_FUNCTION_ARGS)
+{
+	pgraft_kv_stats_reset();
+
+	PG_RETURN_VOID();
+}
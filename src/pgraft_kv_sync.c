@@ -0,0 +1,418 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_sync.c
+ *      Background worker materializing the KV store into pgraft.kv
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "access/xact.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "postmaster/bgworker.h"
+#include "postmaster/interrupt.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/elog.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+
+#include "../include/pgraft_kv_sync.h"
+#include "../include/pgraft_kv.h"
+#include "../include/pgraft_guc.h"
+
+/* How often the worker looks for pending changes */
+#define PGRAFT_KV_SYNC_POLL_MS			100
+
+/* Seconds before a failed worker is restarted */
+#define PGRAFT_KV_SYNC_RESTART_SECS		10
+
+/* Keys a rebuild writes at once; the rest follow as ordinary batches */
+#define PGRAFT_KV_SYNC_MAX_CHANGES		lengthof(((pgraft_kv_store_t *) NULL)->entries)
+
+/* Global shared memory pointer */
+static pgraft_kv_sync_state_t *g_kv_sync_state = NULL;
+
+/*
+ * Initialize shared memory for the materializer state
+ */
+void
+pgraft_kv_sync_init_shared_memory(void)
+{
+	bool		found;
+
+	g_kv_sync_state = (pgraft_kv_sync_state_t *) ShmemInitStruct("pgraft_kv_sync_state",
+																 sizeof(pgraft_kv_sync_state_t),
+																 &found);
+
+	if (!found)
+	{
+		memset(g_kv_sync_state, 0, sizeof(pgraft_kv_sync_state_t));
+		SpinLockInit(&g_kv_sync_state->mutex);
+	}
+}
+
+/*
+ * Get shared memory pointer
+ */
+pgraft_kv_sync_state_t *
+pgraft_kv_sync_get_shared_memory(void)
+{
+	if (g_kv_sync_state == NULL)
+		pgraft_kv_sync_init_shared_memory();
+	return g_kv_sync_state;
+}
+
+/*
+ * Register the materializer; it needs a database, so unlike the main
+ * worker it only exists when configured at server start
+ */
+void
+pgraft_kv_sync_register_worker(void)
+{
+	BackgroundWorker worker;
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+	if (pgraft_kv_sync_database == NULL || pgraft_kv_sync_database[0] == '\0')
+		return;
+
+	memset(&worker, 0, sizeof(BackgroundWorker));
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	/* Standbys receive pgraft.kv through physical replication */
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = PGRAFT_KV_SYNC_RESTART_SECS;
+
+	snprintf(worker.bgw_library_name, BGW_MAXLEN, "pgraft");
+	snprintf(worker.bgw_function_name, BGW_MAXLEN, "pgraft_kv_sync_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "pgraft kv materializer");
+	snprintf(worker.bgw_type, BGW_MAXLEN, "pgraft kv materializer");
+	worker.bgw_main_arg = (Datum) 0;
+	worker.bgw_notify_pid = 0;
+
+	RegisterBackgroundWorker(&worker);
+	elog(LOG, "pgraft: kv materializer registered for database \"%s\"", pgraft_kv_sync_database);
+}
+
+/*
+ * Forget the worker's pid on exit
+ */
+static void
+pgraft_kv_sync_detach(int code, Datum arg)
+{
+	SpinLockAcquire(&g_kv_sync_state->mutex);
+	g_kv_sync_state->pid = 0;
+	SpinLockRelease(&g_kv_sync_state->mutex);
+}
+
+/*
+ * Does the connected database have the pgraft.kv table
+ */
+static bool
+pgraft_kv_sync_table_exists(void)
+{
+	Oid			namespace_oid = get_namespace_oid("pgraft", true);
+
+	if (!OidIsValid(namespace_oid))
+		return false;
+	return OidIsValid(get_relname_relid("kv", namespace_oid));
+}
+
+/*
+ * Build a one-dimensional array of 8-byte pass-by-value datums
+ */
+static Datum
+pgraft_kv_sync_int8_array(Datum *elems, int count, Oid element_type)
+{
+	return PointerGetDatum(construct_array(elems, count, element_type, sizeof(int64),
+										   FLOAT8PASSBYVAL, TYPALIGN_DOUBLE));
+}
+
+/*
+ * Write the changes made after the last batch into pgraft.kv
+ *
+ * Changes come from both tiers of the store, so keys evicted before they
+ * were written are still materialized.  With resync set, the keys are
+ * taken from the start and rows for keys that are not live any more are
+ * deleted, which rebuilds the table whatever it held; keys beyond the
+ * first batch are written by the batches that follow.  Returns the number
+ * of keys written, or -1 when the table does not exist in the database.
+ */
+static int
+pgraft_kv_sync_flush(pgraft_kv_change_t *changes, int max_changes, bool resync,
+					 uint64 resync_revision)
+{
+	uint64		since = 0;
+	uint64		through;
+	Datum	   *live_keys;
+	Datum	   *live_values;
+	Datum	   *live_versions;
+	Datum	   *live_created;
+	Datum	   *live_updated;
+	Datum	   *deleted_keys;
+	int			num_live = 0;
+	int			num_deleted = 0;
+	int64		upserted = 0;
+	int64		deleted = 0;
+	int			count;
+	int			i;
+
+	if (!resync)
+	{
+		SpinLockAcquire(&g_kv_sync_state->mutex);
+		since = g_kv_sync_state->materialized_revision;
+		SpinLockRelease(&g_kv_sync_state->mutex);
+	}
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+
+	if (!pgraft_kv_sync_table_exists())
+	{
+		CommitTransactionCommand();
+		return -1;
+	}
+
+	if (SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR, "pgraft: kv materializer could not connect to SPI");
+	PushActiveSnapshot(GetTransactionSnapshot());
+	pgstat_report_activity(STATE_RUNNING, resync ? "rebuilding pgraft.kv" : "materializing pgraft.kv");
+
+	count = pgraft_kv_collect_changes(since, max_changes, changes, &through);
+
+	live_keys = (Datum *) palloc(sizeof(Datum) * Max(count, 1));
+	live_values = (Datum *) palloc(sizeof(Datum) * Max(count, 1));
+	live_versions = (Datum *) palloc(sizeof(Datum) * Max(count, 1));
+	live_created = (Datum *) palloc(sizeof(Datum) * Max(count, 1));
+	live_updated = (Datum *) palloc(sizeof(Datum) * Max(count, 1));
+	deleted_keys = (Datum *) palloc(sizeof(Datum) * Max(count, 1));
+
+	for (i = 0; i < count; i++)
+	{
+		if (changes[i].deleted)
+		{
+			deleted_keys[num_deleted++] = CStringGetTextDatum(changes[i].key);
+			continue;
+		}
+
+		live_keys[num_live] = CStringGetTextDatum(changes[i].key);
+		live_values[num_live] = CStringGetTextDatum(changes[i].value);
+		live_versions[num_live] = Int64GetDatum(changes[i].version);
+		live_created[num_live] = TimestampTzGetDatum(changes[i].created_at);
+		live_updated[num_live] = TimestampTzGetDatum(changes[i].updated_at);
+		num_live++;
+	}
+
+	if (num_live > 0)
+	{
+		Oid			argtypes[5] = {TEXTARRAYOID, TEXTARRAYOID, INT8ARRAYOID,
+								   TIMESTAMPTZARRAYOID, TIMESTAMPTZARRAYOID};
+		Datum		args[5];
+
+		args[0] = PointerGetDatum(construct_array(live_keys, num_live, TEXTOID, -1, false, TYPALIGN_INT));
+		args[1] = PointerGetDatum(construct_array(live_values, num_live, TEXTOID, -1, false, TYPALIGN_INT));
+		args[2] = pgraft_kv_sync_int8_array(live_versions, num_live, INT8OID);
+		args[3] = pgraft_kv_sync_int8_array(live_created, num_live, TIMESTAMPTZOID);
+		args[4] = pgraft_kv_sync_int8_array(live_updated, num_live, TIMESTAMPTZOID);
+
+		if (SPI_execute_with_args("INSERT INTO pgraft.kv (key, value, version, created_at, updated_at) "
+								  "SELECT * FROM unnest($1, $2, $3, $4, $5) "
+								  "ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value, "
+								  "version = EXCLUDED.version, created_at = EXCLUDED.created_at, "
+								  "updated_at = EXCLUDED.updated_at",
+								  5, argtypes, args, NULL, false, 0) != SPI_OK_INSERT)
+			elog(ERROR, "pgraft: kv materializer could not upsert into pgraft.kv");
+		upserted = SPI_processed;
+	}
+
+	if (num_deleted > 0)
+	{
+		Oid			argtypes[1] = {TEXTARRAYOID};
+		Datum		args[1];
+
+		args[0] = PointerGetDatum(construct_array(deleted_keys, num_deleted, TEXTOID, -1, false, TYPALIGN_INT));
+		if (SPI_execute_with_args("DELETE FROM pgraft.kv WHERE key = ANY ($1)",
+								  1, argtypes, args, NULL, false, 0) != SPI_OK_DELETE)
+			elog(ERROR, "pgraft: kv materializer could not delete from pgraft.kv");
+		deleted = SPI_processed;
+	}
+
+	/*
+	 * Rows of keys the store no longer has in either tier, including ones
+	 * dropped by compaction or whose deletion was dropped before this
+	 * worker saw it
+	 */
+	if (resync)
+	{
+		Oid			argtypes[1] = {TEXTARRAYOID};
+		Datum		args[1];
+		Datum	   *stale_keys;
+		int			num_stale = 0;
+		uint64		row;
+
+		args[0] = PointerGetDatum(construct_array(live_keys, num_live, TEXTOID, -1, false, TYPALIGN_INT));
+		if (SPI_execute_with_args("SELECT key FROM pgraft.kv WHERE key <> ALL ($1)",
+								  1, argtypes, args, NULL, true, 0) != SPI_OK_SELECT)
+			elog(ERROR, "pgraft: kv materializer could not scan pgraft.kv");
+
+		stale_keys = (Datum *) palloc(sizeof(Datum) * Max(SPI_processed, 1));
+		for (row = 0; row < SPI_processed; row++)
+		{
+			char	   *key = SPI_getvalue(SPI_tuptable->vals[row], SPI_tuptable->tupdesc, 1);
+
+			if (!pgraft_kv_exists(key))
+				stale_keys[num_stale++] = CStringGetTextDatum(key);
+		}
+
+		if (num_stale > 0)
+		{
+			args[0] = PointerGetDatum(construct_array(stale_keys, num_stale, TEXTOID, -1, false, TYPALIGN_INT));
+			if (SPI_execute_with_args("DELETE FROM pgraft.kv WHERE key = ANY ($1)",
+									  1, argtypes, args, NULL, false, 0) != SPI_OK_DELETE)
+				elog(ERROR, "pgraft: kv materializer could not prune pgraft.kv");
+			deleted += SPI_processed;
+		}
+	}
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	pgstat_report_activity(STATE_IDLE, NULL);
+
+	SpinLockAcquire(&g_kv_sync_state->mutex);
+	g_kv_sync_state->materialized_revision = through;
+	if (resync)
+	{
+		g_kv_sync_state->synced = true;
+		g_kv_sync_state->resync_revision = resync_revision;
+		g_kv_sync_state->resyncs++;
+	}
+	if (count > 0 || resync)
+	{
+		g_kv_sync_state->batches++;
+		g_kv_sync_state->rows_upserted += upserted;
+		g_kv_sync_state->rows_deleted += deleted;
+		g_kv_sync_state->last_batch_at = GetCurrentTimestamp();
+	}
+	SpinLockRelease(&g_kv_sync_state->mutex);
+
+	/* Deletions now in pgraft.kv may be dropped from shared memory */
+	pgraft_kv_set_spill_horizon(through);
+
+	return count;
+}
+
+/*
+ * Background worker main function
+ *
+ * Changes are written once pgraft.kv_sync_batch_size keys are pending, or
+ * once the oldest pending change has waited pgraft.kv_sync_interval.
+ */
+PGDLLEXPORT void
+pgraft_kv_sync_main(Datum main_arg)
+{
+	pgraft_kv_change_t *changes;
+	TimestampTz pending_since = 0;
+	bool		table_missing = false;
+
+	pqsignal(SIGHUP, SignalHandlerForConfigReload);
+	pqsignal(SIGTERM, die);
+	BackgroundWorkerUnblockSignals();
+
+	BackgroundWorkerInitializeConnection(pgraft_kv_sync_database, NULL, 0);
+
+	pgraft_kv_sync_get_shared_memory();
+	SpinLockAcquire(&g_kv_sync_state->mutex);
+	g_kv_sync_state->pid = MyProcPid;
+	g_kv_sync_state->synced = false;
+	SpinLockRelease(&g_kv_sync_state->mutex);
+	before_shmem_exit(pgraft_kv_sync_detach, (Datum) 0);
+
+	changes = (pgraft_kv_change_t *) MemoryContextAlloc(TopMemoryContext,
+														sizeof(pgraft_kv_change_t) * PGRAFT_KV_SYNC_MAX_CHANGES);
+
+	elog(LOG, "pgraft: kv materializer started for database \"%s\"", pgraft_kv_sync_database);
+
+	for (;;)
+	{
+		uint64		revision;
+		uint64		resync_revision;
+		uint64		materialized;
+		bool		synced;
+		int			pending;
+		int			written;
+
+		CHECK_FOR_INTERRUPTS();
+
+		if (ConfigReloadPending)
+		{
+			ConfigReloadPending = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+
+		pgraft_kv_get_revisions(&revision, &resync_revision);
+
+		SpinLockAcquire(&g_kv_sync_state->mutex);
+		synced = g_kv_sync_state->synced;
+		materialized = g_kv_sync_state->materialized_revision;
+		if (synced && resync_revision > g_kv_sync_state->resync_revision)
+			synced = false;
+		SpinLockRelease(&g_kv_sync_state->mutex);
+
+		if (!synced)
+		{
+			written = pgraft_kv_sync_flush(changes, PGRAFT_KV_SYNC_MAX_CHANGES, true, resync_revision);
+			if (written < 0 && !table_missing)
+				elog(WARNING, "pgraft: table pgraft.kv does not exist in database \"%s\", kv materializer is waiting for it",
+					 pgraft_kv_sync_database);
+			table_missing = (written < 0);
+			pending_since = 0;
+		}
+		else if (revision > materialized)
+		{
+			pending = pgraft_kv_count_changes(materialized);
+			if (pending > 0)
+			{
+				TimestampTz now = GetCurrentTimestamp();
+
+				if (pending_since == 0)
+					pending_since = now;
+
+				if (pending >= pgraft_kv_sync_batch_size ||
+					TimestampDifferenceExceeds(pending_since, now, pgraft_kv_sync_interval))
+				{
+					/* Drain what is pending, a batch per transaction */
+					do
+					{
+						CHECK_FOR_INTERRUPTS();
+						written = pgraft_kv_sync_flush(changes, pgraft_kv_sync_batch_size, false, 0);
+					} while (written >= pgraft_kv_sync_batch_size);
+					pending_since = 0;
+				}
+			}
+			else
+				pending_since = 0;
+		}
+
+		(void) WaitLatch(MyLatch,
+						 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+						 PGRAFT_KV_SYNC_POLL_MS,
+						 PG_WAIT_EXTENSION);
+		ResetLatch(MyLatch);
+	}
+}
@@ -0,0 +1,74 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_kv_sync_sql.c
+ *      SQL interface for the pgraft.kv materializer
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "access/htup_details.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+
+#include "../include/pgraft_kv_sync.h"
+#include "../include/pgraft_kv.h"
+#include "../include/pgraft_guc.h"
+
+PG_FUNCTION_INFO_V1(pgraft_kv_sync_status_sql);
+
+/*
+ * How far pgraft.kv lags behind the KV store
+ * Usage: SELECT * FROM pgraft_kv_sync_status();
+ */
+Datum
+pgraft_kv_sync_status_sql(PG_FUNCTION_ARGS)
+{
+	pgraft_kv_sync_state_t *state = pgraft_kv_sync_get_shared_memory();
+	pgraft_kv_sync_state_t snapshot;
+	TupleDesc	tupdesc;
+	Datum		values[11];
+	bool		nulls[11];
+	uint64		revision;
+	uint64		resync_revision;
+	HeapTuple	tuple;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	SpinLockAcquire(&state->mutex);
+	snapshot = *state;
+	SpinLockRelease(&state->mutex);
+
+	pgraft_kv_get_revisions(&revision, &resync_revision);
+
+	memset(nulls, 0, sizeof(nulls));
+
+	if (pgraft_kv_sync_database && pgraft_kv_sync_database[0] != '\0')
+		values[0] = CStringGetTextDatum(pgraft_kv_sync_database);
+	else
+		nulls[0] = true;
+	values[1] = Int32GetDatum((int32) snapshot.pid);
+	nulls[1] = (snapshot.pid == 0);
+	values[2] = Int64GetDatum((int64) revision);
+	values[3] = Int64GetDatum((int64) snapshot.materialized_revision);
+	/* Until the first rebuild nothing is known to be in the table */
+	if (snapshot.synced && resync_revision <= snapshot.resync_revision)
+		values[4] = Int32GetDatum(pgraft_kv_count_changes(snapshot.materialized_revision));
+	else
+		nulls[4] = true;
+	values[5] = BoolGetDatum(snapshot.synced);
+	values[6] = Int64GetDatum(snapshot.batches);
+	values[7] = Int64GetDatum(snapshot.rows_upserted);
+	values[8] = Int64GetDatum(snapshot.rows_deleted);
+	values[9] = Int64GetDatum(snapshot.resyncs);
+	values[10] = TimestampTzGetDatum(snapshot.last_batch_at);
+	nulls[10] = (snapshot.last_batch_at == 0);
+
+	tuple = heap_form_tuple(tupdesc, values, nulls);
+	PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+}
@@ -0,0 +1,759 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_lock.c
+ *      Distributed locks and leader elections on replicated state
+ *
+ * Acquire, release, renew, cancel and expire are all Raft entries, applied on
+ * every node in log order, so every node agrees on who holds a lock and in
+ * what order the waiters queued.  The log index of an acquire is its
+ * revision, which doubles as a fencing token for the holder.
+ *
+ * Handoff needs no polling: when a release or expiry grants the lock to the
+ * next waiter, the node applying that entry sets the waiter's latch if the
+ * waiter lives on it, so the new owner runs one commit after the release.
+ *
+ * Holders and waiters both keep their place by renewing it within their
+ * TTL.  A waiter renews on its own while it sleeps; if its backend dies or
+ * its cancel never commits (it was proposed in a term that has since
+ * ended, say) the leader expires it like a holder, and handoff skips it.
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <string.h>
+
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/latch.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/elog.h"
+#include "utils/timestamp.h"
+
+#include "../include/pgraft_lock.h"
+#include "../include/pgraft_core.h"
+#include "../include/pgraft_go.h"
+#include "../include/pgraft_json.h"
+#include "../include/pgraft_guc.h"
+
+#if PG_VERSION_NUM >= 170000
+#define PGRAFT_MY_PROCNO	MyProcNumber
+#else
+#define PGRAFT_MY_PROCNO	(MyProc->pgprocno)
+#endif
+
+/*
+ * Queued waiters sleep on their latch; this only bounds how long a waiter
+ * takes to notice that this node lost leadership.
+ */
+#define PGRAFT_LOCK_TERM_CHECK_MS	1000
+
+/* Global shared memory pointer */
+static pgraft_lock_state_t *g_lock_state = NULL;
+
+/* Where a backend stands on a lock */
+typedef enum
+{
+	LOCK_STANDING_NONE = 0,
+	LOCK_STANDING_WAITING,
+	LOCK_STANDING_HOLDER
+} pgraft_lock_standing_t;
+
+/* Arguments for the apply-wait predicates */
+typedef struct pgraft_lock_wait
+{
+	char		name[PGRAFT_LOCK_NAME_LEN];
+	int32		node_id;
+	int32		pid;
+	int64		lease_expires;	/* Renew: lease the renewal gives */
+} pgraft_lock_wait_t;
+
+/*
+ * Initialize shared memory for locks
+ */
+void
+pgraft_lock_init_shared_memory(void)
+{
+	bool		found;
+
+	g_lock_state = (pgraft_lock_state_t *) ShmemInitStruct("pgraft_lock_state",
+														   sizeof(pgraft_lock_state_t),
+														   &found);
+
+	if (!found)
+	{
+		memset(g_lock_state, 0, sizeof(pgraft_lock_state_t));
+		SpinLockInit(&g_lock_state->mutex);
+		elog(INFO, "pgraft: lock table initialized");
+	}
+}
+
+/*
+ * Get lock table shared memory
+ */
+pgraft_lock_state_t *
+pgraft_lock_get_state(void)
+{
+	return g_lock_state;
+}
+
+/*
+ * Find lock by name; caller holds the mutex
+ */
+static pgraft_lock_t *
+pgraft_lock_find(const char *name)
+{
+	int			i;
+
+	for (i = 0; i < PGRAFT_MAX_LOCKS; i++)
+	{
+		if (g_lock_state->locks[i].in_use &&
+			strcmp(g_lock_state->locks[i].name, name) == 0)
+			return &g_lock_state->locks[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Claim a free slot for name; caller holds the mutex
+ */
+static pgraft_lock_t *
+pgraft_lock_alloc(const char *name)
+{
+	int			i;
+
+	for (i = 0; i < PGRAFT_MAX_LOCKS; i++)
+	{
+		pgraft_lock_t *lock = &g_lock_state->locks[i];
+
+		if (!lock->in_use)
+		{
+			memset(lock, 0, sizeof(*lock));
+			lock->in_use = true;
+			strlcpy(lock->name, name, sizeof(lock->name));
+			return lock;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Where does (node_id, pid) stand on a lock; caller holds the mutex
+ */
+static pgraft_lock_standing_t
+pgraft_lock_standing(pgraft_lock_t *lock, int32 node_id, int32 pid, int64 *revision)
+{
+	int			i;
+
+	if (lock == NULL)
+		return LOCK_STANDING_NONE;
+
+	if (lock->held && lock->holder.node_id == node_id && lock->holder.pid == pid)
+	{
+		if (revision)
+			*revision = lock->holder.revision;
+		return LOCK_STANDING_HOLDER;
+	}
+
+	for (i = 0; i < lock->num_waiters; i++)
+	{
+		if (lock->waiters[i].node_id == node_id && lock->waiters[i].pid == pid)
+			return LOCK_STANDING_WAITING;
+	}
+
+	return LOCK_STANDING_NONE;
+}
+
+/*
+ * Give the lock to the oldest waiter, or free it; caller holds the mutex
+ * Returns true and fills *next if a waiter became the holder.
+ */
+static bool
+pgraft_lock_handoff(pgraft_lock_t *lock, int64 now, pgraft_lock_owner_t *next)
+{
+	/* Waiters that stopped renewing are gone; do not hand them the lock */
+	while (lock->num_waiters > 0 && lock->waiters[0].expires <= now)
+	{
+		lock->num_waiters--;
+		memmove(&lock->waiters[0], &lock->waiters[1],
+				sizeof(pgraft_lock_owner_t) * lock->num_waiters);
+		lock->expirations++;
+	}
+
+	if (lock->num_waiters == 0)
+	{
+		lock->held = false;
+		memset(&lock->holder, 0, sizeof(lock->holder));
+		return false;
+	}
+
+	lock->holder = lock->waiters[0];
+	lock->num_waiters--;
+	memmove(&lock->waiters[0], &lock->waiters[1],
+			sizeof(pgraft_lock_owner_t) * lock->num_waiters);
+	lock->lease_expires = now + (int64) lock->holder.ttl_ms * 1000;
+	lock->acquisitions++;
+	lock->handoffs++;
+	*next = lock->holder;
+
+	return true;
+}
+
+/*
+ * Wake a new owner if it is a backend on this node
+ */
+static void
+pgraft_lock_wake(const pgraft_lock_owner_t *owner)
+{
+	pgraft_cluster_t *cluster;
+	PGPROC	   *proc;
+	int32		local_node_id;
+
+	cluster = pgraft_core_get_shared_memory();
+	if (!cluster)
+		return;
+
+	SpinLockAcquire(&cluster->mutex);
+	local_node_id = cluster->node_id;
+	SpinLockRelease(&cluster->mutex);
+
+	if (owner->node_id != local_node_id ||
+		owner->procno < 0 || owner->procno >= (int32) ProcGlobal->allProcCount)
+		return;
+
+	/* The slot may have been reused if the waiter went away */
+	proc = GetPGProcByNumber(owner->procno);
+	if (proc->pid == owner->pid)
+		SetLatch(&proc->procLatch);
+}
+
+/*
+ * Apply-wait predicates
+ */
+static bool
+pgraft_lock_request_applied(void *arg)
+{
+	pgraft_lock_wait_t *wait = (pgraft_lock_wait_t *) arg;
+	pgraft_lock_standing_t standing;
+
+	SpinLockAcquire(&g_lock_state->mutex);
+	standing = pgraft_lock_standing(pgraft_lock_find(wait->name), wait->node_id, wait->pid, NULL);
+	SpinLockRelease(&g_lock_state->mutex);
+
+	return standing != LOCK_STANDING_NONE;
+}
+
+static bool
+pgraft_lock_release_applied(void *arg)
+{
+	pgraft_lock_wait_t *wait = (pgraft_lock_wait_t *) arg;
+	pgraft_lock_standing_t standing;
+
+	SpinLockAcquire(&g_lock_state->mutex);
+	standing = pgraft_lock_standing(pgraft_lock_find(wait->name), wait->node_id, wait->pid, NULL);
+	SpinLockRelease(&g_lock_state->mutex);
+
+	return standing != LOCK_STANDING_HOLDER;
+}
+
+static bool
+pgraft_lock_renew_applied(void *arg)
+{
+	pgraft_lock_wait_t *wait = (pgraft_lock_wait_t *) arg;
+	pgraft_lock_t *lock;
+	bool		applied;
+
+	SpinLockAcquire(&g_lock_state->mutex);
+	lock = pgraft_lock_find(wait->name);
+	applied = pgraft_lock_standing(lock, wait->node_id, wait->pid, NULL) != LOCK_STANDING_HOLDER ||
+		lock->lease_expires >= wait->lease_expires;
+	SpinLockRelease(&g_lock_state->mutex);
+
+	return applied;
+}
+
+/*
+ * Fill in the requesting-backend fields of a lock operation
+ */
+static void
+pgraft_lock_init_op(pgraft_lock_op_t *op, pgraft_lock_op_type_t op_type,
+					const char *name, int32 node_id)
+{
+	memset(op, 0, sizeof(*op));
+	op->op_type = op_type;
+	strlcpy(op->name, name, sizeof(op->name));
+	op->node_id = node_id;
+	op->pid = MyProcPid;
+	op->procno = PGRAFT_MY_PROCNO;
+	op->now = GetCurrentTimestamp();
+}
+
+/*
+ * Acquire a lock, blocking until it is ours
+ *
+ * The holder keeps it until pgraft_lock_release() or until ttl_ms passes,
+ * whichever comes first.  Returns the holder revision, which increases with
+ * every grant and can be used as a fencing token.  If this backend already
+ * holds the lock its current revision is returned.
+ */
+int64
+pgraft_lock_acquire(const char *name, int32 ttl_ms, const char *value)
+{
+	pgraft_lock_op_t op;
+	pgraft_lock_wait_t wait;
+	char		json_data[1024];
+	char		cancel_json[1024];
+	int32		term;
+	int32		node_id;
+	int64		revision = 0;
+	long		renew_ms;
+	TimestampTz renewed;
+	pgraft_lock_standing_t standing;
+
+	if (!g_lock_state)
+		elog(ERROR, "pgraft_lock: lock table not initialized");
+
+	if (strlen(name) == 0 || strlen(name) >= PGRAFT_LOCK_NAME_LEN)
+		elog(ERROR, "pgraft_lock: lock name must be 1 to %d characters", PGRAFT_LOCK_NAME_LEN - 1);
+
+	if (ttl_ms <= 0)
+		elog(ERROR, "pgraft_lock: ttl must be positive");
+
+	if (value && strlen(value) >= PGRAFT_LOCK_VALUE_LEN)
+		elog(ERROR, "pgraft_lock: value must be shorter than %d characters", PGRAFT_LOCK_VALUE_LEN);
+
+	pgraft_core_require_leader(&term, &node_id);
+
+	strlcpy(wait.name, name, sizeof(wait.name));
+	wait.node_id = node_id;
+	wait.pid = MyProcPid;
+
+	SpinLockAcquire(&g_lock_state->mutex);
+	standing = pgraft_lock_standing(pgraft_lock_find(name), node_id, MyProcPid, &revision);
+	SpinLockRelease(&g_lock_state->mutex);
+	if (standing == LOCK_STANDING_HOLDER)
+		return revision;
+	if (standing == LOCK_STANDING_WAITING)
+		elog(ERROR, "pgraft_lock: this session is already waiting for lock \"%s\"", name);
+
+	pgraft_lock_init_op(&op, PGRAFT_LOCK_ACQUIRE, name, node_id);
+	op.ttl_ms = ttl_ms;
+	if (value)
+		strlcpy(op.value, value, sizeof(op.value));
+	if (pgraft_json_create_lock_operation(&op, json_data, sizeof(json_data)) != 0)
+		elog(ERROR, "pgraft_lock: failed to create JSON for lock acquire");
+
+	/* Built up front so the error path below does not have to */
+	op.op_type = PGRAFT_LOCK_CANCEL;
+	if (pgraft_json_create_lock_operation(&op, cancel_json, sizeof(cancel_json)) != 0)
+		elog(ERROR, "pgraft_lock: failed to create JSON for lock cancel");
+
+	/* Renew our place in the queue three times per TTL */
+	renew_ms = Max(ttl_ms / 3, 1);
+
+	pgraft_core_propose(json_data, term);
+	renewed = op.now;
+
+	PG_TRY();
+	{
+		if (pgraft_core_wait_for_apply(pgraft_lock_request_applied, &wait, term, pgraft_proposal_timeout) != 0)
+			elog(ERROR, "pgraft_lock: timed out after %d ms waiting for lock request on \"%s\"",
+				 pgraft_proposal_timeout, name);
+
+		for (;;)
+		{
+			ResetLatch(MyLatch);
+
+			SpinLockAcquire(&g_lock_state->mutex);
+			standing = pgraft_lock_standing(pgraft_lock_find(name), node_id, MyProcPid, &revision);
+			SpinLockRelease(&g_lock_state->mutex);
+
+			if (standing == LOCK_STANDING_HOLDER)
+				break;
+			if (standing == LOCK_STANDING_NONE)
+				elog(ERROR, "pgraft_lock: request for lock \"%s\" was dropped (waiter queue full?)", name);
+
+			pgraft_core_check_term(term);
+
+			if (TimestampDifferenceExceeds(renewed, GetCurrentTimestamp(), (int) renew_ms))
+			{
+				pgraft_lock_init_op(&op, PGRAFT_LOCK_RENEW, name, node_id);
+				if (pgraft_json_create_lock_operation(&op, json_data, sizeof(json_data)) != 0)
+					elog(ERROR, "pgraft_lock: failed to create JSON for lock renew");
+				pgraft_core_propose(json_data, term);
+				renewed = op.now;
+			}
+
+			(void) WaitLatch(MyLatch,
+							 WL_LATCH_SET | WL_TIMEOUT | WL_EXIT_ON_PM_DEATH,
+							 Min(PGRAFT_LOCK_TERM_CHECK_MS, renew_ms),
+							 PG_WAIT_EXTENSION);
+			CHECK_FOR_INTERRUPTS();
+		}
+	}
+	PG_CATCH();
+	{
+		/*
+		 * Leave the queue (or give back a lock granted meanwhile); best
+		 * effort.  Proposed without a term so that a leader elected since
+		 * still takes it; if it never commits, the waiter stops renewing and
+		 * the leader expires it.
+		 */
+		(void) pgraft_queue_propose_command(cancel_json, 0, NULL);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	return revision;
+}
+
+/*
+ * Release a lock held by this backend
+ * Returns false if this backend does not hold it
+ */
+bool
+pgraft_lock_release(const char *name)
+{
+	pgraft_lock_op_t op;
+	pgraft_lock_wait_t wait;
+	char		json_data[1024];
+	int32		term;
+	int32		node_id;
+
+	if (!g_lock_state)
+		elog(ERROR, "pgraft_lock: lock table not initialized");
+
+	pgraft_core_require_leader(&term, &node_id);
+
+	strlcpy(wait.name, name, sizeof(wait.name));
+	wait.node_id = node_id;
+	wait.pid = MyProcPid;
+
+	if (pgraft_lock_release_applied(&wait))
+		return false;
+
+	pgraft_lock_init_op(&op, PGRAFT_LOCK_RELEASE, name, node_id);
+	if (pgraft_json_create_lock_operation(&op, json_data, sizeof(json_data)) != 0)
+		elog(ERROR, "pgraft_lock: failed to create JSON for lock release");
+
+	pgraft_core_propose(json_data, term);
+
+	if (pgraft_core_wait_for_apply(pgraft_lock_release_applied, &wait, term, pgraft_proposal_timeout) != 0)
+		elog(ERROR, "pgraft_lock: timed out after %d ms waiting for release of \"%s\"; outcome unknown",
+			 pgraft_proposal_timeout, name);
+
+	return true;
+}
+
+/*
+ * Extend the lease of a lock held by this backend by its TTL, counted from
+ * now
+ * Returns false if this backend does not hold it, including when the
+ * lease ran out before the renewal applied
+ */
+bool
+pgraft_lock_renew(const char *name)
+{
+	pgraft_lock_op_t op;
+	pgraft_lock_wait_t wait;
+	char		json_data[1024];
+	int32		term;
+	int32		node_id;
+	int64		revision = 0;
+	int32		ttl_ms = 0;
+	pgraft_lock_t *lock;
+	pgraft_lock_standing_t standing;
+
+	if (!g_lock_state)
+		elog(ERROR, "pgraft_lock: lock table not initialized");
+
+	pgraft_core_require_leader(&term, &node_id);
+
+	SpinLockAcquire(&g_lock_state->mutex);
+	lock = pgraft_lock_find(name);
+	standing = pgraft_lock_standing(lock, node_id, MyProcPid, &revision);
+	if (standing == LOCK_STANDING_HOLDER)
+		ttl_ms = lock->holder.ttl_ms;
+	SpinLockRelease(&g_lock_state->mutex);
+	if (standing != LOCK_STANDING_HOLDER)
+		return false;
+
+	pgraft_lock_init_op(&op, PGRAFT_LOCK_RENEW, name, node_id);
+	if (pgraft_json_create_lock_operation(&op, json_data, sizeof(json_data)) != 0)
+		elog(ERROR, "pgraft_lock: failed to create JSON for lock renew");
+
+	strlcpy(wait.name, name, sizeof(wait.name));
+	wait.node_id = node_id;
+	wait.pid = MyProcPid;
+	wait.lease_expires = op.now + (int64) ttl_ms * 1000;
+
+	pgraft_core_propose(json_data, term);
+
+	if (pgraft_core_wait_for_apply(pgraft_lock_renew_applied, &wait, term, pgraft_proposal_timeout) != 0)
+		elog(ERROR, "pgraft_lock: timed out after %d ms waiting for renewal of \"%s\"; outcome unknown",
+			 pgraft_proposal_timeout, name);
+
+	/* A lease that ran out first was expired; the renewal came too late */
+	SpinLockAcquire(&g_lock_state->mutex);
+	standing = pgraft_lock_standing(pgraft_lock_find(name), node_id, MyProcPid, &revision);
+	SpinLockRelease(&g_lock_state->mutex);
+
+	return standing == LOCK_STANDING_HOLDER;
+}
+
+/*
+ * Current holder of a lock, read from local replicated state
+ */
+bool
+pgraft_lock_get_holder(const char *name, pgraft_lock_owner_t *holder)
+{
+	pgraft_lock_t *lock;
+	bool		held = false;
+
+	if (!g_lock_state)
+		return false;
+
+	SpinLockAcquire(&g_lock_state->mutex);
+	lock = pgraft_lock_find(name);
+	if (lock && lock->held)
+	{
+		*holder = lock->holder;
+		held = true;
+	}
+	SpinLockRelease(&g_lock_state->mutex);
+
+	return held;
+}
+
+/*
+ * Apply a committed lock entry
+ * Runs on every node in log order, so the outcome is deterministic
+ */
+int
+pgraft_lock_apply(uint64 raft_index, const char *json_data, size_t len)
+{
+	pgraft_lock_op_t op;
+	pgraft_lock_t *lock;
+	pgraft_lock_owner_t next;
+	bool		wake = false;
+	int			result = 0;
+	int			i;
+
+	if (!g_lock_state)
+		return -1;
+
+	if (pgraft_json_parse_lock_operation(json_data, len, &op) != 0)
+		return -1;
+
+	SpinLockAcquire(&g_lock_state->mutex);
+	lock = pgraft_lock_find(op.name);
+
+	switch (op.op_type)
+	{
+		case PGRAFT_LOCK_ACQUIRE:
+			{
+				pgraft_lock_owner_t owner;
+
+				if (lock == NULL)
+					lock = pgraft_lock_alloc(op.name);
+				if (lock == NULL)
+				{
+					result = -1;
+					break;
+				}
+				if (pgraft_lock_standing(lock, op.node_id, op.pid, NULL) != LOCK_STANDING_NONE)
+					break;
+
+				memset(&owner, 0, sizeof(owner));
+				owner.node_id = op.node_id;
+				owner.pid = op.pid;
+				owner.procno = op.procno;
+				owner.ttl_ms = op.ttl_ms;
+				owner.revision = (int64) raft_index;
+				owner.expires = op.now + (int64) op.ttl_ms * 1000;
+				strlcpy(owner.value, op.value, sizeof(owner.value));
+
+				if (!lock->held)
+				{
+					lock->held = true;
+					lock->holder = owner;
+					lock->lease_expires = op.now + (int64) op.ttl_ms * 1000;
+					lock->acquisitions++;
+				}
+				else if (lock->num_waiters < PGRAFT_LOCK_MAX_WAITERS)
+					lock->waiters[lock->num_waiters++] = owner;
+				else
+					result = -1;
+			}
+			break;
+
+		case PGRAFT_LOCK_RELEASE:
+			if (pgraft_lock_standing(lock, op.node_id, op.pid, NULL) == LOCK_STANDING_HOLDER)
+				wake = pgraft_lock_handoff(lock, op.now, &next);
+			break;
+
+		case PGRAFT_LOCK_RENEW:
+			if (lock == NULL)
+				break;
+			if (pgraft_lock_standing(lock, op.node_id, op.pid, NULL) == LOCK_STANDING_HOLDER)
+			{
+				lock->lease_expires = Max(lock->lease_expires,
+										  op.now + (int64) lock->holder.ttl_ms * 1000);
+				break;
+			}
+			for (i = 0; i < lock->num_waiters; i++)
+			{
+				pgraft_lock_owner_t *waiter = &lock->waiters[i];
+
+				if (waiter->node_id == op.node_id && waiter->pid == op.pid)
+				{
+					waiter->expires = Max(waiter->expires, op.now + (int64) waiter->ttl_ms * 1000);
+					break;
+				}
+			}
+			break;
+
+		case PGRAFT_LOCK_EXPIRE:
+			if (lock == NULL)
+				break;
+			if (lock->held && lock->holder.revision == op.revision)
+			{
+				if (op.now >= lock->lease_expires)
+				{
+					lock->expirations++;
+					wake = pgraft_lock_handoff(lock, op.now, &next);
+				}
+				break;
+			}
+			for (i = 0; i < lock->num_waiters; i++)
+			{
+				if (lock->waiters[i].revision == op.revision)
+				{
+					if (op.now >= lock->waiters[i].expires)
+					{
+						lock->num_waiters--;
+						memmove(&lock->waiters[i], &lock->waiters[i + 1],
+								sizeof(pgraft_lock_owner_t) * (lock->num_waiters - i));
+						lock->expirations++;
+					}
+					break;
+				}
+			}
+			break;
+
+		case PGRAFT_LOCK_CANCEL:
+			if (lock == NULL)
+				break;
+			if (pgraft_lock_standing(lock, op.node_id, op.pid, NULL) == LOCK_STANDING_HOLDER)
+			{
+				wake = pgraft_lock_handoff(lock, op.now, &next);
+				break;
+			}
+			for (i = 0; i < lock->num_waiters; i++)
+			{
+				if (lock->waiters[i].node_id == op.node_id && lock->waiters[i].pid == op.pid)
+				{
+					lock->num_waiters--;
+					memmove(&lock->waiters[i], &lock->waiters[i + 1],
+							sizeof(pgraft_lock_owner_t) * (lock->num_waiters - i));
+					break;
+				}
+			}
+			break;
+	}
+
+	/* Recycle the slot once nobody holds or wants the lock */
+	if (lock && !lock->held && lock->num_waiters == 0)
+		lock->in_use = false;
+
+	g_lock_state->last_applied_index = raft_index;
+	SpinLockRelease(&g_lock_state->mutex);
+
+	if (wake)
+		pgraft_lock_wake(&next);
+
+	if (result != 0)
+		elog(WARNING, "pgraft_lock: lock table or waiter queue full, dropped request for \"%s\" at index %lu",
+			 op.name, (unsigned long) raft_index);
+
+	return result;
+}
+
+/*
+ * Propose expiry for holders whose lease has run out and for waiters that
+ * stopped renewing
+ *
+ * Called periodically by the background worker while this node leads.  The
+ * entry carries the holder's or waiter's revision, so a lock that changed
+ * hands, or a waiter that renewed, in the meantime is left alone when it
+ * applies.  At most PGRAFT_MAX_LOCKS are proposed per call; the rest wait
+ * for the next one.
+ */
+void
+pgraft_lock_expire_leases(void)
+{
+	pgraft_lock_op_t expired[PGRAFT_MAX_LOCKS];
+	int			num_expired = 0;
+	TimestampTz now;
+	int			i;
+
+	if (!g_lock_state)
+		return;
+
+	now = GetCurrentTimestamp();
+
+	SpinLockAcquire(&g_lock_state->mutex);
+	for (i = 0; i < PGRAFT_MAX_LOCKS; i++)
+	{
+		pgraft_lock_t *lock = &g_lock_state->locks[i];
+		int			j;
+
+		if (!lock->in_use)
+			continue;
+
+		if (lock->held && lock->lease_expires <= now)
+		{
+			memset(&expired[num_expired], 0, sizeof(pgraft_lock_op_t));
+			expired[num_expired].op_type = PGRAFT_LOCK_EXPIRE;
+			strlcpy(expired[num_expired].name, lock->name, sizeof(expired[num_expired].name));
+			expired[num_expired].revision = lock->holder.revision;
+			expired[num_expired].now = now;
+			num_expired++;
+		}
+
+		for (j = 0; j < lock->num_waiters && num_expired < PGRAFT_MAX_LOCKS; j++)
+		{
+			if (lock->waiters[j].expires > now)
+				continue;
+			memset(&expired[num_expired], 0, sizeof(pgraft_lock_op_t));
+			expired[num_expired].op_type = PGRAFT_LOCK_EXPIRE;
+			strlcpy(expired[num_expired].name, lock->name, sizeof(expired[num_expired].name));
+			expired[num_expired].revision = lock->waiters[j].revision;
+			expired[num_expired].now = now;
+			num_expired++;
+		}
+
+		if (num_expired >= PGRAFT_MAX_LOCKS - 1)
+			break;
+	}
+	SpinLockRelease(&g_lock_state->mutex);
+
+	for (i = 0; i < num_expired; i++)
+	{
+		char		json_data[1024];
+
+		if (pgraft_json_create_lock_operation(&expired[i], json_data, sizeof(json_data)) != 0)
+			continue;
+
+		elog(LOG, "pgraft_lock: lock \"%s\" revision %lld expired without renewal",
+			 expired[i].name, (long long) expired[i].revision);
+		(void) pgraft_go_append_log(json_data, strlen(json_data));
+	}
+}
@@ -0,0 +1,265 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_lock_sql.c
+ *      SQL interface for distributed locks and elections
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+#include "../include/pgraft_lock.h"
+
+PG_FUNCTION_INFO_V1(pgraft_lock_acquire_sql);
+PG_FUNCTION_INFO_V1(pgraft_lock_release_sql);
+PG_FUNCTION_INFO_V1(pgraft_lock_renew_sql);
+PG_FUNCTION_INFO_V1(pgraft_campaign_sql);
+PG_FUNCTION_INFO_V1(pgraft_resign_sql);
+PG_FUNCTION_INFO_V1(pgraft_proclaim_sql);
+PG_FUNCTION_INFO_V1(pgraft_election_leader_sql);
+PG_FUNCTION_INFO_V1(pgraft_lock_status_sql);
+
+/*
+ * Build the lock name an election lives under
+ */
+static char *
+pgraft_election_lock_name(text *election)
+{
+	return psprintf("%s%s", PGRAFT_ELECTION_PREFIX, text_to_cstring(election));
+}
+
+/*
+ * Acquire a lock, blocking until granted
+ * Usage: SELECT pgraft_lock_acquire('nightly-job', 30000);
+ */
+Datum
+pgraft_lock_acquire_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	int32		ttl_ms;
+	int64		revision;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_lock: lock name cannot be NULL");
+
+	name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	ttl_ms = PG_ARGISNULL(1) ? 30000 : PG_GETARG_INT32(1);
+	revision = pgraft_lock_acquire(name, ttl_ms, NULL);
+	pfree(name);
+
+	PG_RETURN_INT64(revision);
+}
+
+/*
+ * Release a lock held by this session
+ * Usage: SELECT pgraft_lock_release('nightly-job');
+ */
+Datum
+pgraft_lock_release_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	bool		released;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_lock: lock name cannot be NULL");
+
+	name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	released = pgraft_lock_release(name);
+	pfree(name);
+
+	PG_RETURN_BOOL(released);
+}
+
+/*
+ * Extend the lease of a lock held by this session
+ * Usage: SELECT pgraft_lock_renew('nightly-job');
+ */
+Datum
+pgraft_lock_renew_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	bool		renewed;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_lock: lock name cannot be NULL");
+
+	name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	renewed = pgraft_lock_renew(name);
+	pfree(name);
+
+	PG_RETURN_BOOL(renewed);
+}
+
+/*
+ * Campaign in an election, blocking until elected
+ * Usage: SELECT pgraft_campaign('scheduler', 'host-a:5432', 30000);
+ */
+Datum
+pgraft_campaign_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	char	   *value;
+	int32		ttl_ms;
+	int64		revision;
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		elog(ERROR, "pgraft_lock: election and value cannot be NULL");
+
+	name = pgraft_election_lock_name(PG_GETARG_TEXT_PP(0));
+	value = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	ttl_ms = PG_ARGISNULL(2) ? 30000 : PG_GETARG_INT32(2);
+	revision = pgraft_lock_acquire(name, ttl_ms, value);
+	pfree(name);
+	pfree(value);
+
+	PG_RETURN_INT64(revision);
+}
+
+/*
+ * Step down as leader of an election
+ * Usage: SELECT pgraft_resign('scheduler');
+ */
+Datum
+pgraft_resign_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	bool		resigned;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_lock: election cannot be NULL");
+
+	name = pgraft_election_lock_name(PG_GETARG_TEXT_PP(0));
+	resigned = pgraft_lock_release(name);
+	pfree(name);
+
+	PG_RETURN_BOOL(resigned);
+}
+
+/*
+ * Stay leader of an election: extend the lease this session won it with
+ * Usage: SELECT pgraft_proclaim('scheduler');
+ */
+Datum
+pgraft_proclaim_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	bool		renewed;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_lock: election cannot be NULL");
+
+	name = pgraft_election_lock_name(PG_GETARG_TEXT_PP(0));
+	renewed = pgraft_lock_renew(name);
+	pfree(name);
+
+	PG_RETURN_BOOL(renewed);
+}
+
+/*
+ * Value published by the current election leader, NULL if none
+ * Reads local replicated state, so it works on any node
+ */
+Datum
+pgraft_election_leader_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	pgraft_lock_owner_t holder;
+	bool		held;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	name = pgraft_election_lock_name(PG_GETARG_TEXT_PP(0));
+	held = pgraft_lock_get_holder(name, &holder);
+	pfree(name);
+
+	if (!held)
+		PG_RETURN_NULL();
+
+	PG_RETURN_TEXT_P(cstring_to_text(holder.value));
+}
+
+/*
+ * List locks with their holder and waiter count
+ */
+Datum
+pgraft_lock_status_sql(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	pgraft_lock_state_t *state;
+	pgraft_lock_t *locks;
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	state = pgraft_lock_get_state();
+	if (state == NULL)
+		return (Datum) 0;
+
+	/* Copy the table out so no tuple building happens under the spinlock */
+	locks = (pgraft_lock_t *) palloc(sizeof(pgraft_lock_t) * PGRAFT_MAX_LOCKS);
+	SpinLockAcquire(&state->mutex);
+	memcpy(locks, state->locks, sizeof(pgraft_lock_t) * PGRAFT_MAX_LOCKS);
+	SpinLockRelease(&state->mutex);
+
+	for (i = 0; i < PGRAFT_MAX_LOCKS; i++)
+	{
+		Datum		values[9];
+		bool		nulls[9];
+
+		if (!locks[i].in_use)
+			continue;
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(locks[i].name);
+		values[1] = Int32GetDatum(locks[i].holder.node_id);
+		values[2] = Int32GetDatum(locks[i].holder.pid);
+		values[3] = Int64GetDatum(locks[i].holder.revision);
+		values[4] = CStringGetTextDatum(locks[i].holder.value);
+		values[5] = TimestampTzGetDatum(locks[i].lease_expires);
+		values[6] = Int32GetDatum(locks[i].num_waiters);
+		values[7] = Int64GetDatum(locks[i].handoffs);
+		values[8] = Int64GetDatum(locks[i].expirations);
+		if (!locks[i].held)
+		{
+			nulls[1] = nulls[2] = nulls[3] = nulls[4] = nulls[5] = true;
+		}
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(locks);
+
+	return (Datum) 0;
+}
@@ -1,7 +1,7 @@
 /*-------------------------------------------------------------------------
  *
  * pgraft_log.c
- *      Log replication management for pgraft
+ *      Raft log inspection and replication for pgraft
  *
  * Copyright (c) 2024-2025, pgElephant, Inc.
  *
@@ -9,6 +9,8 @@
  */
 
 #include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
 #include "storage/shmem.h"
 #include "storage/spin.h"
 #include "utils/elog.h"
@@ -18,19 +20,20 @@
 
 #include "../include/pgraft_log.h"
 #include "../include/pgraft_go.h"
+#include "../include/pgraft_guc.h"
 
 /* Global shared memory pointer */
 static pgraft_log_state_t *g_log_state = NULL;
 
 /*
- * Initialize shared memory for log replication
+ * Initialize shared memory for log inspection
  */
 void
 pgraft_log_init_shared_memory(void)
 {
 	bool		found;
 	
-	elog(INFO, "pgraft: initializing log replication shared memory");
+	elog(INFO, "pgraft: initializing log inspection shared memory");
 	
 	/* Allocate shared memory */
 	g_log_state = (pgraft_log_state_t *) ShmemInitStruct("pgraft_log_state",
@@ -39,29 +42,13 @@ pgraft_log_init_shared_memory(void)
 	
 	if (!found)
 	{
-		elog(INFO, "pgraft: creating new log replication shared memory");
-		
-		/* Initialize shared memory */
-		memset(g_log_state, 0, sizeof(pgraft_log_state_t));
-		
-		/* Initialize mutex */
+		/* Only the slot header needs clearing, the page is written before it is read */
+		memset(g_log_state, 0, offsetof(pgraft_log_state_t, page));
+		g_log_state->status = LOG_SLOT_IDLE;
+		ConditionVariableInit(&g_log_state->cv);
 		SpinLockInit(&g_log_state->mutex);
 		
-		/* Initialize default values */
-		g_log_state->log_size = 0;
-		g_log_state->last_index = 0;
-		g_log_state->commit_index = 0;
-		g_log_state->last_applied = 0;
-		g_log_state->entries_replicated = 0;
-		g_log_state->entries_committed = 0;
-		g_log_state->entries_applied = 0;
-		g_log_state->replication_errors = 0;
-		
-		elog(INFO, "pgraft: log replication shared memory initialized");
-	}
-	else
-	{
-		elog(INFO, "pgraft: log replication shared memory already exists");
+		elog(INFO, "pgraft: log inspection shared memory initialized");
 	}
 }
 
@@ -80,253 +67,238 @@ pgraft_log_get_shared_memory(void)
 }
 
 /*
- * Append entry to log
+ * Set the slot status and stamp the time of the change
+ * Caller holds the mutex and broadcasts once it is released.
  */
-int
-pgraft_log_append_entry(int64_t term, const char *data, int32_t data_size)
+static void
+pgraft_log_set_status(pgraft_log_state_t *state, LOG_SLOT_STATUS status)
+{
+	state->status = status;
+	state->status_time = GetCurrentTimestamp();
+}
+
+/*
+ * Give up our claim on the slot, whatever state it is in
+ */
+static void
+pgraft_log_release_slot(pgraft_log_state_t *state)
 {
-	pgraft_log_state_t *state;
-	pgraft_log_entry_t *entry;
-	
-	state = pgraft_log_get_shared_memory();
-	if (!state)
-	{
-		elog(ERROR, "pgraft: failed to get shared memory");
-		return -1;
-	}
-	
-	if (data_size > 1024)
-	{
-		elog(ERROR, "pgraft: data size %d exceeds maximum 1024", data_size);
-		return -1;
-	}
-	
 	SpinLockAcquire(&state->mutex);
-	
-	if (state->log_size >= 1000)
+	if (state->owner_pid == MyProcPid)
 	{
-		SpinLockRelease(&state->mutex);
-		elog(ERROR, "pgraft: log is full (1000 entries)");
-		return -1;
+		/* The worker is writing the page; let it free the slot when done */
+		if (state->status == LOG_SLOT_SERVING)
+			state->abandoned = true;
+		else
+			pgraft_log_set_status(state, LOG_SLOT_IDLE);
+		state->owner_pid = 0;
 	}
+	SpinLockRelease(&state->mutex);
 	
-	/* Add new entry */
-	entry = &state->entries[state->log_size];
-	entry->index = state->last_index + 1;
-	entry->term = term;
-	entry->timestamp = GetCurrentTimestamp();
-	entry->data_size = data_size;
-	entry->committed = 0;
-	entry->applied = 0;
-	
-	if (data && data_size > 0)
-		memcpy(entry->data, data, data_size);
-	entry->data[data_size] = '\0';
-	
-	state->log_size++;
-	state->last_index = entry->index;
+	ConditionVariableBroadcast(&state->cv);
+}
+
+/*
+ * Copy the answered page out of the slot
+ * Only the used part of the arrays and of the payload buffer is copied.
+ */
+static void
+pgraft_log_copy_page(const pgraft_log_page_t *src, pgraft_log_page_t *dst)
+{
+	int			n = Max(src->num_entries, 0);
 	
-	SpinLockRelease(&state->mutex);
+	dst->first_index = src->first_index;
+	dst->last_index = src->last_index;
+	dst->commit_index = src->commit_index;
+	dst->persist_errors = src->persist_errors;
+	dst->num_entries = n;
+	if (n == 0)
+		return;
 	
-	elog(DEBUG1, "pgraft: Appended entry %lld with term %lld", (long long)entry->index, (long long)term);
-	return 0;
+	memcpy(dst->index, src->index, sizeof(uint64) * n);
+	memcpy(dst->term, src->term, sizeof(uint64) * n);
+	memcpy(dst->type, src->type, sizeof(int32_t) * n);
+	memcpy(dst->size, src->size, sizeof(int32_t) * n);
+	memcpy(dst->offset, src->offset, sizeof(int32_t) * n);
+	memcpy(dst->length, src->length, sizeof(int32_t) * n);
+	memcpy(dst->data, src->data, src->offset[n - 1] + src->length[n - 1]);
 }
 
 /*
- * Commit log entry
+ * Read up to max_entries Raft log entries starting at from_index
+ * Returns false if the worker could not answer in time or Raft is not
+ * running.  Indexes below the first retained entry start the page at the
+ * first retained entry.
  */
-int
-pgraft_log_commit_entry(int64_t index)
+bool
+pgraft_log_read_page(uint64 from_index, int max_entries, pgraft_log_page_t *page)
 {
 	pgraft_log_state_t *state;
-	int			i;
+	TimestampTz deadline;
+	bool		answered = false;
 	
 	state = pgraft_log_get_shared_memory();
 	if (!state)
+		elog(ERROR, "pgraft: cannot read the raft log - failed to get shared memory");
+	
+	deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), pgraft_proposal_timeout);
+	
+	/* Claim the slot; take it over if its owner died without freeing it */
+	ConditionVariablePrepareToSleep(&state->cv);
+	for (;;)
 	{
-		elog(ERROR, "pgraft: failed to get shared memory");
-		return -1;
+		long		remaining;
+		bool		claimed = false;
+		
+		SpinLockAcquire(&state->mutex);
+		if (state->status == LOG_SLOT_IDLE ||
+			((state->status == LOG_SLOT_READY || state->status == LOG_SLOT_FAILED) &&
+			 TimestampDifferenceExceeds(state->status_time, GetCurrentTimestamp(),
+										pgraft_proposal_timeout)))
+		{
+			state->owner_pid = MyProcPid;
+			state->abandoned = false;
+			state->from_index = from_index;
+			state->max_entries = Min(max_entries, PGRAFT_LOG_PAGE_ENTRIES);
+			pgraft_log_set_status(state, LOG_SLOT_REQUESTED);
+			claimed = true;
+		}
+		SpinLockRelease(&state->mutex);
+		
+		if (claimed)
+			break;
+		
+		remaining = TimestampDifferenceMilliseconds(GetCurrentTimestamp(), deadline);
+		if (remaining <= 0)
+		{
+			ConditionVariableCancelSleep();
+			ereport(ERROR,
+					(errcode(ERRCODE_LOCK_NOT_AVAILABLE),
+					 errmsg("pgraft: timed out waiting for another raft log reader")));
+		}
+		
+		(void) ConditionVariableTimedSleep(&state->cv, remaining, PG_WAIT_EXTENSION);
 	}
 	
-	SpinLockAcquire(&state->mutex);
-	
-	/* Find and commit entry */
-	for (i = 0; i < state->log_size; i++)
+	/* Wait for the worker, freeing the slot if we are interrupted */
+	PG_TRY();
 	{
-		if (state->entries[i].index == index)
+		for (;;)
 		{
-			state->entries[i].committed = 1;
-			if (index > state->commit_index)
-				state->commit_index = index;
-			state->entries_committed++;
+			LOG_SLOT_STATUS status;
+			bool		owned;
+			long		remaining;
+			
+			SpinLockAcquire(&state->mutex);
+			status = state->status;
+			owned = (state->owner_pid == MyProcPid);
 			SpinLockRelease(&state->mutex);
-			elog(DEBUG1, "pgraft: Committed entry %lld", (long long)index);
-			return 0;
+			
+			/* Taken over after we stalled past the timeout */
+			if (!owned)
+				break;
+			
+			if (status == LOG_SLOT_READY)
+			{
+				pgraft_log_copy_page(&state->page, page);
+				answered = true;
+				break;
+			}
+			if (status == LOG_SLOT_FAILED)
+				break;
+			
+			/* Keep waiting once the worker has started on the page */
+			remaining = TimestampDifferenceMilliseconds(GetCurrentTimestamp(), deadline);
+			if (remaining <= 0 && status == LOG_SLOT_REQUESTED)
+				break;
+			
+			(void) ConditionVariableTimedSleep(&state->cv, Max(remaining, 10), PG_WAIT_EXTENSION);
 		}
 	}
+	PG_CATCH();
+	{
+		ConditionVariableCancelSleep();
+		pgraft_log_release_slot(state);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
 	
-	SpinLockRelease(&state->mutex);
-	elog(WARNING, "pgraft: entry %lld not found", (long long)index);
-	return -1;
-}
-
-/*
- * Apply log entry
- */
-int
-pgraft_log_apply_entry(int64_t index)
-{
-    pgraft_log_state_t *state = pgraft_log_get_shared_memory();
-    if (!state) {
-        elog(ERROR, "pgraft: failed to get shared memory");
-        return -1;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    
-    /* Find and apply entry */
-    for (int i = 0; i < state->log_size; i++) {
-        if (state->entries[i].index == index) {
-            if (!state->entries[i].committed) {
-                SpinLockRelease(&state->mutex);
-			elog(WARNING, "pgraft: cannot apply uncommitted entry %lld", (long long)index);
-                return -1;
-            }
-            
-            state->entries[i].applied = 1;
-            if (index > state->last_applied) {
-                state->last_applied = index;
-            }
-            state->entries_applied++;
-            SpinLockRelease(&state->mutex);
-			elog(DEBUG1, "pgraft: Applied entry %lld", (long long)index);
-            return 0;
-        }
-    }
-    
-    SpinLockRelease(&state->mutex);
-    elog(WARNING, "pgraft: entry %lld not found", (long long)index);
-    return -1;
-}
-
-/*
- * Get log entry by index
- */
-int
-pgraft_log_get_entry(int64_t index, pgraft_log_entry_t* entry)
-{
-    pgraft_log_state_t *state = pgraft_log_get_shared_memory();
-    if (!state || !entry) {
-        elog(ERROR, "pgraft: invalid parameters");
-        return -1;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    
-    /* Find entry */
-    for (int i = 0; i < state->log_size; i++) {
-        if (state->entries[i].index == index) {
-            *entry = state->entries[i];
-            SpinLockRelease(&state->mutex);
-            return 0;
-        }
-    }
-    
-    SpinLockRelease(&state->mutex);
-    return -1;
-}
-
-/*
- * Get last log index
- */
-int
-pgraft_log_get_last_index(int64_t* last_index)
-{
-    pgraft_log_state_t *state = pgraft_log_get_shared_memory();
-    if (!state || !last_index) {
-        elog(ERROR, "pgraft: invalid parameters");
-        return -1;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    *last_index = state->last_index;
-    SpinLockRelease(&state->mutex);
-    
-    return 0;
-}
-
-/*
- * Get commit index
- */
-int
-pgraft_log_get_commit_index(int64_t* commit_index)
-{
-    pgraft_log_state_t *state = pgraft_log_get_shared_memory();
-    if (!state || !commit_index) {
-        elog(ERROR, "pgraft: invalid parameters");
-        return -1;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    *commit_index = state->commit_index;
-    SpinLockRelease(&state->mutex);
-    
-    return 0;
+	ConditionVariableCancelSleep();
+	pgraft_log_release_slot(state);
+	
+	return answered;
 }
 
 /*
- * Get last applied index
+ * Answer a pending page request (background worker)
  */
-int
-pgraft_log_get_last_applied(int64_t* last_applied)
+void
+pgraft_log_serve_request(void)
 {
-    pgraft_log_state_t *state = pgraft_log_get_shared_memory();
-    if (!state || !last_applied) {
-        elog(ERROR, "pgraft: invalid parameters");
-        return -1;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    *last_applied = state->last_applied;
-    SpinLockRelease(&state->mutex);
-    
-    return 0;
+	pgraft_log_state_t *state;
+	pgraft_log_page_t *page;
+	uint64		from_index;
+	int			max_entries;
+	uint64		bounds[4];
+	int			n;
+	
+	state = pgraft_log_get_shared_memory();
+	if (!state)
+		return;
+	
+	SpinLockAcquire(&state->mutex);
+	if (state->status != LOG_SLOT_REQUESTED)
+	{
+		SpinLockRelease(&state->mutex);
+		return;
+	}
+	pgraft_log_set_status(state, LOG_SLOT_SERVING);
+	from_index = state->from_index;
+	max_entries = state->max_entries;
+	SpinLockRelease(&state->mutex);
+	
+	/* Nobody else touches the page while the slot is SERVING */
+	page = &state->page;
+	memset(bounds, 0, sizeof(bounds));
+	n = pgraft_go_read_log(from_index, max_entries, page->index, page->term,
+						   page->type, page->size, page->offset, page->length,
+						   page->data, sizeof(page->data), bounds);
+	page->num_entries = n;
+	page->first_index = bounds[0];
+	page->last_index = bounds[1];
+	page->commit_index = bounds[2];
+	page->persist_errors = bounds[3];
+	
+	SpinLockAcquire(&state->mutex);
+	if (state->abandoned)
+	{
+		state->abandoned = false;
+		pgraft_log_set_status(state, LOG_SLOT_IDLE);
+	}
+	else
+		pgraft_log_set_status(state, n < 0 ? LOG_SLOT_FAILED : LOG_SLOT_READY);
+	SpinLockRelease(&state->mutex);
+	
+	ConditionVariableBroadcast(&state->cv);
 }
 
 /*
- * Replicate log to node
+ * Human-readable entry type
  */
-int
-pgraft_log_replicate_to_node(int32_t node_id, int64_t from_index)
+const char *
+pgraft_log_entry_type_name(int32_t type)
 {
-    pgraft_log_state_t *state;
-    int entries_to_replicate = 0;
-    int i;
-    
-    state = pgraft_log_get_shared_memory();
-    if (!state) {
-        elog(ERROR, "pgraft: failed to get shared memory");
-        return -1;
-    }
-    
-    elog(DEBUG1, "pgraft: Replicating to node %d from index %lld", node_id, (long long)from_index);
-    
-    SpinLockAcquire(&state->mutex);
-    
-    /* Find entries to replicate */
-    
-    for (i = 0; i < state->log_size; i++) {
-        if (state->entries[i].index >= from_index) {
-            entries_to_replicate++;
-        }
-    }
-    
-    state->entries_replicated += entries_to_replicate;
-    
-    SpinLockRelease(&state->mutex);
-    
-    elog(DEBUG1, "pgraft: Replicated %d entries to node %d", entries_to_replicate, node_id);
-    return 0;
+	switch (type)
+	{
+		case PGRAFT_LOG_ENTRY_NORMAL:
+			return "normal";
+		case PGRAFT_LOG_ENTRY_CONF_CHANGE:
+			return "conf_change";
+		case PGRAFT_LOG_ENTRY_CONF_CHANGE_V2:
+			return "conf_change_v2";
+		default:
+			return "unknown";
+	}
 }
 
 /*
@@ -379,112 +351,3 @@ pgraft_log_sync_with_leader(void)
     
     return 0;
 }
-
-/*
- * Get log statistics
- */
-int
-pgraft_log_get_statistics(pgraft_log_state_t* stats)
-{
-    pgraft_log_state_t *state = pgraft_log_get_shared_memory();
-    if (!state || !stats) {
-        elog(ERROR, "pgraft: invalid parameters");
-        return -1;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    *stats = *state;
-    SpinLockRelease(&state->mutex);
-    
-    return 0;
-}
-
-/*
- * Get replication status
- */
-int
-pgraft_log_get_replication_status(char* status, size_t status_size)
-{
-    pgraft_log_state_t *state = pgraft_log_get_shared_memory();
-    if (!state || !status || status_size == 0) {
-        elog(ERROR, "pgraft: invalid parameters");
-        return -1;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    
-    snprintf(status, status_size, 
-             "Log Size: %d, Last Index: %lld, Commit Index: %lld, Last Applied: %lld, "
-             "Replicated: %lld, Committed: %lld, Applied: %lld, Errors: %lld",
-             state->log_size, (long long)state->last_index, (long long)state->commit_index, (long long)state->last_applied,
-             (long long)state->entries_replicated, (long long)state->entries_committed, 
-             (long long)state->entries_applied, (long long)state->replication_errors);
-    
-    SpinLockRelease(&state->mutex);
-    
-    return 0;
-}
-
-/*
- * Cleanup old log entries
- */
-void
-pgraft_log_cleanup_old_entries(int64_t before_index)
-{
-    pgraft_log_state_t *state;
-    int removed = 0;
-    int i;
-    int j;
-    
-    state = pgraft_log_get_shared_memory();
-    if (!state) {
-        return;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    
-    for (i = 0; i < state->log_size; i++) {
-        if (state->entries[i].index < before_index) {
-            /* Shift remaining entries */
-            for (j = i; j < state->log_size - 1; j++) {
-                state->entries[j] = state->entries[j + 1];
-            }
-            state->log_size--;
-            removed++;
-            i--; /* Check the same index again */
-        }
-    }
-    
-    SpinLockRelease(&state->mutex);
-    
-    if (removed > 0) {
-		elog(INFO, "pgraft: removed %d old entries before index %lld", removed, (long long)before_index);
-    }
-}
-
-/*
- * Reset log
- */
-void
-pgraft_log_reset(void)
-{
-    pgraft_log_state_t *state = pgraft_log_get_shared_memory();
-    if (!state) {
-        return;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    
-    state->log_size = 0;
-    state->last_index = 0;
-    state->commit_index = 0;
-    state->last_applied = 0;
-    state->entries_replicated = 0;
-    state->entries_committed = 0;
-    state->entries_applied = 0;
-    state->replication_errors = 0;
-    
-    SpinLockRelease(&state->mutex);
-    
-    elog(INFO, "pgraft: log reset completed");
-}
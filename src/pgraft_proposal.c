@@ -0,0 +1,339 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_proposal.c
+ *      Shared memory proposal ring consumed directly by the Go layer
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/elog.h"
+#include "utils/timestamp.h"
+
+#include <errno.h>
+#include <semaphore.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/pgraft_proposal.h"
+#include "../include/pgraft_core.h"
+#include "../include/pgraft_go.h"
+
+/* Longest single sleep of a waiting backend, to notice interrupts and deposal */
+#define PGRAFT_PROPOSAL_POLL_MS		10
+
+StaticAssertDecl(sizeof(pg_atomic_uint32) == sizeof(uint32),
+				 "the Go layer reads slot states as plain uint32 words");
+
+/* Global shared memory pointer */
+static pgraft_proposal_state_t *g_proposal_state = NULL;
+
+/*
+ * Initialize shared memory for the proposal ring
+ */
+void
+pgraft_proposal_init_shared_memory(void)
+{
+	bool		found;
+	
+	g_proposal_state = (pgraft_proposal_state_t *) ShmemInitStruct("pgraft_proposal_state",
+																   sizeof(pgraft_proposal_state_t),
+																   &found);
+	
+	if (!found)
+	{
+		pgraft_go_proposal_ring_t *ring = &g_proposal_state->ring;
+		int			i;
+		
+		pg_atomic_init_u32(&ring->consumer, 0);
+		for (i = 0; i < PGRAFT_PROPOSAL_SLOTS; i++)
+			pg_atomic_init_u32(&ring->slots[i].state, PGRAFT_PROPOSAL_FREE);
+		
+#ifdef USE_UNNAMED_POSIX_SEMAPHORES
+		if (sem_init(&ring->wakeup, 1, 0) != 0)
+			elog(FATAL, "pgraft: could not create proposal ring semaphore: %m");
+		for (i = 0; i < PGRAFT_PROPOSAL_SLOTS; i++)
+		{
+			if (sem_init(&ring->slots[i].done, 1, 0) != 0)
+				elog(FATAL, "pgraft: could not create proposal slot semaphore: %m");
+		}
+#endif
+		
+		SpinLockInit(&g_proposal_state->mutex);
+		g_proposal_state->head = 0;
+		g_proposal_state->direct = 0;
+		g_proposal_state->fallbacks = 0;
+	}
+}
+
+/*
+ * Get shared memory pointer
+ */
+pgraft_proposal_state_t *
+pgraft_proposal_get_shared_memory(void)
+{
+	if (g_proposal_state == NULL)
+		pgraft_proposal_init_shared_memory();
+	return g_proposal_state;
+}
+
+#ifdef USE_UNNAMED_POSIX_SEMAPHORES
+
+/*
+ * Sleep on a semaphore for at most timeout_ms
+ * Signals end the sleep early, which is what lets interrupts through.
+ */
+static void
+pgraft_proposal_sem_wait(sem_t *sem, long timeout_ms)
+{
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L)
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	
+	(void) sem_timedwait(sem, &ts);
+}
+
+/*
+ * Stop waiting for a slot
+ * A slot the goroutine has not finished is left for it to free; one it has
+ * answered is freed here.
+ */
+static void
+pgraft_proposal_abandon(pgraft_go_proposal_slot_t *slot)
+{
+	for (;;)
+	{
+		uint32		state = pg_atomic_read_u32(&slot->state);
+		
+		if (state == PGRAFT_PROPOSAL_DONE)
+		{
+			pg_atomic_write_u32(&slot->state, PGRAFT_PROPOSAL_FREE);
+			return;
+		}
+		if (state != PGRAFT_PROPOSAL_READY && state != PGRAFT_PROPOSAL_TAKEN)
+			return;
+		if (pg_atomic_compare_exchange_u32(&slot->state, &state, PGRAFT_PROPOSAL_ABANDONED))
+			return;
+	}
+}
+
+/*
+ * Clear the consumer flag when the worker that attached the ring exits
+ */
+static void
+pgraft_proposal_detach(int code, Datum arg)
+{
+	pgraft_proposal_state_t *state = pgraft_proposal_get_shared_memory();
+	
+	SpinLockAcquire(&state->mutex);
+	pg_atomic_write_u32(&state->ring.consumer, 0);
+	SpinLockRelease(&state->mutex);
+}
+
+#endif
+
+/*
+ * Start the Go proposal goroutine on the ring (background worker)
+ * Slots left behind by an earlier worker are answered or freed first, so
+ * the goroutine can start at the current head: a slot it never took was
+ * not proposed and fails, while one it took may or may not have been, and
+ * its backend is told the outcome is unknown.  Does nothing if the ring is
+ * already consumed.
+ */
+void
+pgraft_proposal_attach(void)
+{
+#ifdef USE_UNNAMED_POSIX_SEMAPHORES
+	static bool exit_callback_registered = false;
+	pgraft_proposal_state_t *state;
+	pgraft_go_proposal_ring_t *ring;
+	uint64		tail;
+	int			i;
+	
+	state = pgraft_proposal_get_shared_memory();
+	if (!state)
+		return;
+	ring = &state->ring;
+	
+	if (pg_atomic_read_u32(&ring->consumer) != 0)
+		return;
+	
+	SpinLockAcquire(&state->mutex);
+	for (i = 0; i < PGRAFT_PROPOSAL_SLOTS; i++)
+	{
+		pgraft_go_proposal_slot_t *slot = &ring->slots[i];
+		uint32		slot_state = pg_atomic_read_u32(&slot->state);
+		
+		if (slot_state == PGRAFT_PROPOSAL_READY || slot_state == PGRAFT_PROPOSAL_TAKEN)
+		{
+			slot->result = slot_state == PGRAFT_PROPOSAL_TAKEN ?
+				PGRAFT_PROPOSAL_UNKNOWN : PGRAFT_PROPOSAL_FAILED;
+			pg_write_barrier();
+			pg_atomic_write_u32(&slot->state, PGRAFT_PROPOSAL_DONE);
+			(void) sem_post(&slot->done);
+		}
+		else if (slot_state == PGRAFT_PROPOSAL_ABANDONED)
+			pg_atomic_write_u32(&slot->state, PGRAFT_PROPOSAL_FREE);
+	}
+	tail = state->head;
+	SpinLockRelease(&state->mutex);
+	
+	if (pgraft_go_attach_proposals(ring, tail) != 0)
+	{
+		elog(WARNING, "pgraft: could not start the Go proposal goroutine, writes go through the worker queue");
+		return;
+	}
+	
+	if (!exit_callback_registered)
+	{
+		before_shmem_exit(pgraft_proposal_detach, (Datum) 0);
+		exit_callback_registered = true;
+	}
+	
+	SpinLockAcquire(&state->mutex);
+	pg_atomic_write_u32(&ring->consumer, 1);
+	SpinLockRelease(&state->mutex);
+	
+	elog(LOG, "pgraft: proposal ring attached at slot %llu", (unsigned long long) tail);
+#else
+	elog(DEBUG1, "pgraft: no unnamed POSIX semaphores, writes go through the worker queue");
+#endif
+}
+
+/*
+ * Propose an encoded entry to a Raft group through the ring
+ *
+ * Returns PGRAFT_PROPOSAL_SUBMITTED once the entry is proposed, or
+ * PGRAFT_PROPOSAL_TIMED_OUT if it was not answered within timeout_ms or
+ * the worker restarted while proposing it, in which case the outcome is
+ * unknown.  Returns PGRAFT_PROPOSAL_UNAVAILABLE,
+ * having done nothing, when the ring cannot take the entry; the caller then
+ * queues it for the worker.  Raises an error if the Go layer refuses the
+ * entry or this node stops leading the group in term.
+ */
+int
+pgraft_proposal_submit(int group, int32_t term, const char *data, int length, int timeout_ms)
+{
+#ifdef USE_UNNAMED_POSIX_SEMAPHORES
+	pgraft_proposal_state_t *state;
+	pgraft_go_proposal_ring_t *ring;
+	pgraft_go_proposal_slot_t *slot;
+	TimestampTz deadline;
+	int32_t		result = PGRAFT_PROPOSAL_FAILED;
+	bool		answered = false;
+	
+	if (length <= 0 || length > PGRAFT_PROPOSAL_DATA_SIZE)
+		return PGRAFT_PROPOSAL_UNAVAILABLE;
+	
+	state = pgraft_proposal_get_shared_memory();
+	if (!state)
+		return PGRAFT_PROPOSAL_UNAVAILABLE;
+	ring = &state->ring;
+	
+	/* Claim and fill the next slot in one go, keeping slots in ring order */
+	SpinLockAcquire(&state->mutex);
+	slot = &ring->slots[state->head % PGRAFT_PROPOSAL_SLOTS];
+	if (pg_atomic_read_u32(&ring->consumer) == 0 ||
+		pg_atomic_read_u32(&slot->state) != PGRAFT_PROPOSAL_FREE)
+	{
+		state->fallbacks++;
+		SpinLockRelease(&state->mutex);
+		return PGRAFT_PROPOSAL_UNAVAILABLE;
+	}
+	slot->group = group;
+	slot->term = term;
+	slot->result = PGRAFT_PROPOSAL_FAILED;
+	slot->length = length;
+	memcpy(slot->data, data, length);
+	pg_write_barrier();
+	pg_atomic_write_u32(&slot->state, PGRAFT_PROPOSAL_READY);
+	state->head++;
+	state->direct++;
+	SpinLockRelease(&state->mutex);
+	
+	(void) sem_post(&ring->wakeup);
+	
+	deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), timeout_ms);
+	
+	PG_TRY();
+	{
+		for (;;)
+		{
+			int32_t		current_term;
+			int64_t		leader_id;
+			char		leader_address[256];
+			bool		is_leader;
+			long		remaining;
+			
+			if (pg_atomic_read_u32(&slot->state) == PGRAFT_PROPOSAL_DONE)
+			{
+				pg_read_barrier();
+				result = slot->result;
+				pg_atomic_write_u32(&slot->state, PGRAFT_PROPOSAL_FREE);
+				answered = true;
+				break;
+			}
+			
+			/* Deposed while the write was still in flight: fail fast */
+			is_leader = pgraft_core_group_leadership(group, &current_term, &leader_id,
+													 leader_address, sizeof(leader_address));
+			if (current_term != term || !is_leader)
+				pgraft_core_report_leader_change(term, current_term, leader_id, leader_address);
+			
+			remaining = TimestampDifferenceMilliseconds(GetCurrentTimestamp(), deadline);
+			if (remaining <= 0)
+				break;
+			
+			CHECK_FOR_INTERRUPTS();
+			pgraft_proposal_sem_wait(&slot->done, Min(remaining, PGRAFT_PROPOSAL_POLL_MS));
+		}
+	}
+	PG_CATCH();
+	{
+		pgraft_proposal_abandon(slot);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+	
+	if (!answered)
+	{
+		pgraft_proposal_abandon(slot);
+		return PGRAFT_PROPOSAL_TIMED_OUT;
+	}
+	
+	/* The entry may have been proposed before the consumer went away */
+	if (result == PGRAFT_PROPOSAL_UNKNOWN)
+		return PGRAFT_PROPOSAL_TIMED_OUT;
+	
+	if (result == PGRAFT_PROPOSAL_STALE)
+	{
+		int32_t		current_term;
+		int64_t		leader_id;
+		char		leader_address[256];
+		
+		(void) pgraft_core_group_leadership(group, &current_term, &leader_id,
+											leader_address, sizeof(leader_address));
+		pgraft_core_report_leader_change(term, current_term, leader_id, leader_address);
+	}
+	if (result != PGRAFT_PROPOSAL_OK)
+		elog(ERROR, "pgraft: failed to propose write to raft group %d", group);
+	
+	return PGRAFT_PROPOSAL_SUBMITTED;
+#else
+	return PGRAFT_PROPOSAL_UNAVAILABLE;
+#endif
+}
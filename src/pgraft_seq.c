@@ -0,0 +1,399 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_seq.c
+ *      Replicated sequence allocator with leader-side range leasing
+ *
+ * A raft round per id is far too slow, so the leader reserves a whole range
+ * (pgraft.seq_lease_size ids) with a single "seq_lease" entry and then hands
+ * ids out of that range under a spinlock.  The lease applies on every node
+ * as a compare-and-set on the sequence's high-water mark, which keeps ids
+ * unique across failovers: a new leader always leases above everything any
+ * earlier leader was granted, and a stale proposal simply fails to apply.
+ * Ids left in a range when leadership moves are never reused (gaps).
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <string.h>
+
+#include "miscadmin.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/elog.h"
+
+#include "../include/pgraft_seq.h"
+#include "../include/pgraft_core.h"
+#include "../include/pgraft_json.h"
+#include "../include/pgraft_guc.h"
+
+/* Global shared memory pointer */
+static pgraft_seq_state_t *g_seq_state = NULL;
+
+/* How often a leader retries a lease that lost the compare-and-set */
+#define PGRAFT_SEQ_LEASE_RETRIES 3
+
+/* Arguments for the apply-wait predicates */
+typedef struct pgraft_seq_wait
+{
+	char		name[PGRAFT_SEQ_NAME_LEN];
+	int64		start;
+} pgraft_seq_wait_t;
+
+/*
+ * Initialize shared memory for sequences
+ */
+void
+pgraft_seq_init_shared_memory(void)
+{
+	bool		found;
+
+	g_seq_state = (pgraft_seq_state_t *) ShmemInitStruct("pgraft_seq_state",
+														 sizeof(pgraft_seq_state_t),
+														 &found);
+
+	if (!found)
+	{
+		memset(g_seq_state, 0, sizeof(pgraft_seq_state_t));
+		SpinLockInit(&g_seq_state->mutex);
+		elog(INFO, "pgraft: sequence table initialized");
+	}
+}
+
+/*
+ * Get sequence table shared memory
+ */
+pgraft_seq_state_t *
+pgraft_seq_get_state(void)
+{
+	return g_seq_state;
+}
+
+/*
+ * Find sequence by name; caller holds the mutex
+ */
+static pgraft_seq_t *
+pgraft_seq_find(const char *name)
+{
+	int			i;
+
+	for (i = 0; i < g_seq_state->num_seqs; i++)
+	{
+		if (g_seq_state->seqs[i].in_use &&
+			strcmp(g_seq_state->seqs[i].name, name) == 0)
+			return &g_seq_state->seqs[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Apply-wait predicates
+ */
+static bool
+pgraft_seq_exists_applied(void *arg)
+{
+	pgraft_seq_wait_t *wait = (pgraft_seq_wait_t *) arg;
+	bool		exists;
+
+	SpinLockAcquire(&g_seq_state->mutex);
+	exists = (pgraft_seq_find(wait->name) != NULL);
+	SpinLockRelease(&g_seq_state->mutex);
+
+	return exists;
+}
+
+static bool
+pgraft_seq_lease_applied(void *arg)
+{
+	pgraft_seq_wait_t *wait = (pgraft_seq_wait_t *) arg;
+	pgraft_seq_t *seq;
+	bool		moved;
+
+	/* Any lease on top of our start means ours was decided one way or the other */
+	SpinLockAcquire(&g_seq_state->mutex);
+	seq = pgraft_seq_find(wait->name);
+	moved = (seq == NULL || seq->reserved_to != wait->start);
+	SpinLockRelease(&g_seq_state->mutex);
+
+	return moved;
+}
+
+static bool
+pgraft_seq_lease_settled(void *arg)
+{
+	pgraft_seq_wait_t *wait = (pgraft_seq_wait_t *) arg;
+	pgraft_seq_t *seq;
+	bool		settled;
+
+	SpinLockAcquire(&g_seq_state->mutex);
+	seq = pgraft_seq_find(wait->name);
+	settled = (seq == NULL || !seq->lease_pending);
+	SpinLockRelease(&g_seq_state->mutex);
+
+	return settled;
+}
+
+/*
+ * Create a replicated sequence
+ * Returns false if a sequence with that name already exists
+ */
+bool
+pgraft_seq_create(const char *name)
+{
+	pgraft_seq_op_t op;
+	pgraft_seq_wait_t wait;
+	char		json_data[1024];
+	int32		term;
+	int32		node_id;
+
+	if (!g_seq_state)
+		elog(ERROR, "pgraft_seq: sequence table not initialized");
+
+	if (strlen(name) == 0 || strlen(name) >= PGRAFT_SEQ_NAME_LEN)
+		elog(ERROR, "pgraft_seq: sequence name must be 1 to %d characters", PGRAFT_SEQ_NAME_LEN - 1);
+
+	strlcpy(wait.name, name, sizeof(wait.name));
+	wait.start = 0;
+	if (pgraft_seq_exists_applied(&wait))
+		return false;
+
+	pgraft_core_require_leader(&term, &node_id);
+
+	memset(&op, 0, sizeof(op));
+	op.op_type = PGRAFT_SEQ_CREATE;
+	strlcpy(op.name, name, sizeof(op.name));
+	op.term = term;
+	op.node_id = node_id;
+
+	if (pgraft_json_create_seq_operation(&op, json_data, sizeof(json_data)) != 0)
+		elog(ERROR, "pgraft_seq: failed to create JSON for sequence create");
+
+	pgraft_core_propose(json_data, term);
+
+	if (pgraft_core_wait_for_apply(pgraft_seq_exists_applied, &wait, term, pgraft_proposal_timeout) != 0)
+		elog(ERROR, "pgraft_seq: timed out after %d ms waiting for sequence \"%s\" to be created; outcome unknown",
+			 pgraft_proposal_timeout, name);
+
+	return true;
+}
+
+/*
+ * Lease a new range for seq and install it as the local range
+ *
+ * Called with lease_pending set by us.  Returns true if our lease won the
+ * compare-and-set; false if another lease got there first and the caller
+ * should retry from the new high-water mark.
+ */
+static bool
+pgraft_seq_lease(const char *name, int64 start, int64 end, int32 term, int32 node_id)
+{
+	pgraft_seq_op_t op;
+	pgraft_seq_wait_t wait;
+	pgraft_seq_t *seq;
+	char		json_data[1024];
+	bool		won = false;
+
+	memset(&op, 0, sizeof(op));
+	op.op_type = PGRAFT_SEQ_LEASE;
+	strlcpy(op.name, name, sizeof(op.name));
+	op.start = start;
+	op.end = end;
+	op.term = term;
+	op.node_id = node_id;
+
+	strlcpy(wait.name, name, sizeof(wait.name));
+	wait.start = start;
+
+	PG_TRY();
+	{
+		if (pgraft_json_create_seq_operation(&op, json_data, sizeof(json_data)) != 0)
+			elog(ERROR, "pgraft_seq: failed to create JSON for sequence lease");
+
+		pgraft_core_propose(json_data, term);
+
+		if (pgraft_core_wait_for_apply(pgraft_seq_lease_applied, &wait, term, pgraft_proposal_timeout) != 0)
+			elog(ERROR, "pgraft_seq: timed out after %d ms waiting for lease on sequence \"%s\"",
+				 pgraft_proposal_timeout, name);
+	}
+	PG_CATCH();
+	{
+		SpinLockAcquire(&g_seq_state->mutex);
+		seq = pgraft_seq_find(name);
+		if (seq)
+			seq->lease_pending = false;
+		SpinLockRelease(&g_seq_state->mutex);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	SpinLockAcquire(&g_seq_state->mutex);
+	seq = pgraft_seq_find(name);
+	if (seq)
+	{
+		if (seq->granted_start == start && seq->granted_end == end &&
+			seq->granted_term == term && seq->granted_node == node_id)
+		{
+			seq->next_id = start;
+			seq->lease_end = end;
+			seq->lease_term = term;
+			won = true;
+		}
+		seq->lease_pending = false;
+	}
+	SpinLockRelease(&g_seq_state->mutex);
+
+	return won;
+}
+
+/*
+ * Allocate count consecutive ids from a sequence
+ *
+ * Served from the leader's in-memory range; only when that is exhausted (or
+ * was leased in an earlier term) does this go through Raft.  Returns the
+ * first id of the block.
+ */
+int64
+pgraft_seq_next(const char *name, int64 count)
+{
+	int32		term;
+	int32		node_id;
+	int			attempts = 0;
+
+	if (!g_seq_state)
+		elog(ERROR, "pgraft_seq: sequence table not initialized");
+
+	if (count < 1)
+		elog(ERROR, "pgraft_seq: count must be at least 1");
+
+	pgraft_core_require_leader(&term, &node_id);
+
+	for (;;)
+	{
+		pgraft_seq_t *seq;
+		int64		start;
+		int64		end;
+		int64		id;
+
+		CHECK_FOR_INTERRUPTS();
+
+		SpinLockAcquire(&g_seq_state->mutex);
+		seq = pgraft_seq_find(name);
+		if (seq == NULL)
+		{
+			SpinLockRelease(&g_seq_state->mutex);
+			elog(ERROR, "pgraft_seq: sequence \"%s\" does not exist", name);
+		}
+
+		/* Fast path: enough ids left in a range leased in this term */
+		if (seq->lease_term == term && seq->lease_end - seq->next_id >= count)
+		{
+			id = seq->next_id;
+			seq->next_id += count;
+			seq->ids_issued += count;
+			SpinLockRelease(&g_seq_state->mutex);
+			return id;
+		}
+
+		/* Someone else is already leasing; wait for them instead of piling on */
+		if (seq->lease_pending && seq->pending_term == term)
+		{
+			pgraft_seq_wait_t wait;
+
+			SpinLockRelease(&g_seq_state->mutex);
+			strlcpy(wait.name, name, sizeof(wait.name));
+			wait.start = 0;
+			if (pgraft_core_wait_for_apply(pgraft_seq_lease_settled, &wait, term, pgraft_proposal_timeout) != 0)
+			{
+				/* Lease holder went away without clearing the flag; take over */
+				SpinLockAcquire(&g_seq_state->mutex);
+				seq = pgraft_seq_find(name);
+				if (seq)
+					seq->lease_pending = false;
+				SpinLockRelease(&g_seq_state->mutex);
+			}
+			continue;
+		}
+
+		if (++attempts > PGRAFT_SEQ_LEASE_RETRIES)
+		{
+			SpinLockRelease(&g_seq_state->mutex);
+			elog(ERROR, "pgraft_seq: could not lease a range for sequence \"%s\" after %d attempts",
+				 name, PGRAFT_SEQ_LEASE_RETRIES);
+		}
+
+		start = seq->reserved_to;
+		end = start + Max((int64) pgraft_seq_lease_size, count);
+		seq->lease_pending = true;
+		seq->pending_term = term;
+		SpinLockRelease(&g_seq_state->mutex);
+
+		elog(DEBUG1, "pgraft_seq: leasing [%lld, %lld) for sequence \"%s\" in term %d",
+			 (long long) start, (long long) end, name, term);
+
+		(void) pgraft_seq_lease(name, start, end, term, node_id);
+	}
+}
+
+/*
+ * Apply a committed sequence entry
+ * Runs on every node in log order, so the outcome is deterministic
+ */
+int
+pgraft_seq_apply(uint64 raft_index, const char *json_data, size_t len)
+{
+	pgraft_seq_op_t op;
+	pgraft_seq_t *seq;
+	int			result = 0;
+
+	if (!g_seq_state)
+		return -1;
+
+	if (pgraft_json_parse_seq_operation(json_data, len, &op) != 0)
+		return -1;
+
+	SpinLockAcquire(&g_seq_state->mutex);
+	seq = pgraft_seq_find(op.name);
+
+	switch (op.op_type)
+	{
+		case PGRAFT_SEQ_CREATE:
+			if (seq != NULL)
+				break;
+			if (g_seq_state->num_seqs >= PGRAFT_MAX_SEQUENCES)
+			{
+				result = -1;
+				break;
+			}
+			seq = &g_seq_state->seqs[g_seq_state->num_seqs++];
+			memset(seq, 0, sizeof(*seq));
+			seq->in_use = true;
+			strlcpy(seq->name, op.name, sizeof(seq->name));
+			seq->reserved_to = 1;
+			break;
+
+		case PGRAFT_SEQ_LEASE:
+			/* Compare-and-set: only a lease starting at the high-water mark counts */
+			if (seq == NULL || op.start != seq->reserved_to || op.end <= op.start)
+				break;
+			seq->reserved_to = op.end;
+			seq->granted_start = op.start;
+			seq->granted_end = op.end;
+			seq->granted_term = op.term;
+			seq->granted_node = op.node_id;
+			seq->leases++;
+			break;
+	}
+
+	g_seq_state->last_applied_index = raft_index;
+	SpinLockRelease(&g_seq_state->mutex);
+
+	if (result != 0)
+		elog(WARNING, "pgraft_seq: sequence table full, cannot create \"%s\" at index %lu",
+			 op.name, (unsigned long) raft_index);
+
+	return result;
+}
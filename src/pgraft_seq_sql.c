@@ -0,0 +1,142 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_seq_sql.c
+ *      SQL interface for replicated sequences
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "utils/builtins.h"
+#include "utils/tuplestore.h"
+
+#include "../include/pgraft_seq.h"
+
+PG_FUNCTION_INFO_V1(pgraft_seq_create_sql);
+PG_FUNCTION_INFO_V1(pgraft_seq_next_sql);
+PG_FUNCTION_INFO_V1(pgraft_seq_status_sql);
+
+/*
+ * Create a replicated sequence
+ * Usage: SELECT pgraft_seq_create('orders');
+ */
+Datum
+pgraft_seq_create_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	bool		created;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_seq: sequence name cannot be NULL");
+
+	name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	created = pgraft_seq_create(name);
+	pfree(name);
+
+	PG_RETURN_BOOL(created);
+}
+
+/*
+ * Allocate ids from a replicated sequence
+ * Returns the first of n consecutive ids
+ * Usage: SELECT pgraft_seq_next('orders');  SELECT pgraft_seq_next('orders', 100);
+ */
+Datum
+pgraft_seq_next_sql(PG_FUNCTION_ARGS)
+{
+	char	   *name;
+	int64		count;
+	int64		id;
+
+	if (PG_ARGISNULL(0))
+		elog(ERROR, "pgraft_seq: sequence name cannot be NULL");
+
+	name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	count = PG_ARGISNULL(1) ? 1 : PG_GETARG_INT64(1);
+	id = pgraft_seq_next(name, count);
+	pfree(name);
+
+	PG_RETURN_INT64(id);
+}
+
+/*
+ * List sequences with their replicated and local lease state
+ */
+Datum
+pgraft_seq_status_sql(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	pgraft_seq_state_t *state;
+	pgraft_seq_t *seqs;
+	int			num_seqs;
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	state = pgraft_seq_get_state();
+	if (state == NULL)
+		return (Datum) 0;
+
+	/* Copy the table out so no tuple building happens under the spinlock */
+	seqs = (pgraft_seq_t *) palloc(sizeof(pgraft_seq_t) * PGRAFT_MAX_SEQUENCES);
+	SpinLockAcquire(&state->mutex);
+	num_seqs = state->num_seqs;
+	memcpy(seqs, state->seqs, sizeof(pgraft_seq_t) * num_seqs);
+	SpinLockRelease(&state->mutex);
+
+	for (i = 0; i < num_seqs; i++)
+	{
+		Datum		values[6];
+		bool		nulls[6];
+
+		if (!seqs[i].in_use)
+			continue;
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(seqs[i].name);
+		values[1] = Int64GetDatum(seqs[i].reserved_to);
+		values[2] = Int64GetDatum(seqs[i].leases);
+		values[3] = Int64GetDatum(seqs[i].next_id);
+		values[4] = Int64GetDatum(seqs[i].lease_end);
+		values[5] = Int64GetDatum(seqs[i].ids_issued);
+		if (seqs[i].lease_end == 0)
+		{
+			nulls[3] = true;
+			nulls[4] = true;
+		}
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(seqs);
+
+	return (Datum) 0;
+}
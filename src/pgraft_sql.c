@@ -10,6 +10,7 @@
 
 #include "postgres.h"
 #include "fmgr.h"
+#include "miscadmin.h"
 #include "utils/elog.h"
 #include "utils/builtins.h"
 #include "access/htup_details.h"
@@ -18,13 +19,18 @@
 #include "utils/typcache.h"
 #include "utils/tuplestore.h"
 #include "utils/guc.h"
+#include "lib/stringinfo.h"
+#include "storage/fd.h"
 
 #include "../include/pgraft_sql.h"
 #include "../include/pgraft_core.h"
 #include "../include/pgraft_go.h"
 #include "../include/pgraft_state.h"
 #include "../include/pgraft_log.h"
+#include "../include/pgraft_apply.h"
+#include "../include/pgraft_json.h"
 #include "../include/pgraft_guc.h"
+#include "../include/pgraft_kv.h"
 
 /* Function info macros for core functions */
 PG_FUNCTION_INFO_V1(pgraft_init);
@@ -38,6 +44,10 @@ PG_FUNCTION_INFO_V1(pgraft_get_term);
 PG_FUNCTION_INFO_V1(pgraft_is_leader);
 PG_FUNCTION_INFO_V1(pgraft_get_worker_state);
 PG_FUNCTION_INFO_V1(pgraft_get_queue_status);
+PG_FUNCTION_INFO_V1(pgraft_get_queue_lanes);
+PG_FUNCTION_INFO_V1(pgraft_get_groups);
+PG_FUNCTION_INFO_V1(pgraft_get_peer_latency);
+PG_FUNCTION_INFO_V1(pgraft_get_election_timeout);
 PG_FUNCTION_INFO_V1(pgraft_get_version);
 PG_FUNCTION_INFO_V1(pgraft_test);
 PG_FUNCTION_INFO_V1(pgraft_set_debug);
@@ -47,6 +57,7 @@ PG_FUNCTION_INFO_V1(pgraft_log_append);
 PG_FUNCTION_INFO_V1(pgraft_log_commit);
 PG_FUNCTION_INFO_V1(pgraft_log_apply);
 PG_FUNCTION_INFO_V1(pgraft_log_get_entry_sql);
+PG_FUNCTION_INFO_V1(pgraft_log_entries);
 PG_FUNCTION_INFO_V1(pgraft_log_get_stats_table);
 PG_FUNCTION_INFO_V1(pgraft_log_get_replication_status_table);
 
@@ -200,6 +211,14 @@ pgraft_init_from_gucs(void)
 	config.max_log_entries = pgraft_max_log_entries;
 	config.batch_size = pgraft_batch_size;
 	config.max_batch_delay = pgraft_max_batch_delay;
+	config.raft_groups = pgraft_raft_groups;
+	config.quiesce_timeout = pgraft_quiesce_timeout;
+	config.tick_interval = pgraft_tick_interval;
+	config.election_timeout_max = pgraft_election_timeout_max;
+	config.client_gateway = pgraft_client_gateway ? 1 : 0;
+	config.proposal_timeout = pgraft_proposal_timeout;
+	config.group_for_key = pgraft_kv_group_for_key;
+	config.quota_admit = pgraft_kv_quota_admit_gateway;
 	
 	/* Use etcd-compatible GUC variables */
 	cluster_id = initial_cluster_token;
@@ -433,7 +452,7 @@ pgraft_get_cluster_status_table(PG_FUNCTION_ARGS)
     values[1] = Int64GetDatum(cluster.current_term);
     values[2] = Int64GetDatum(cluster.leader_id);
     values[3] = CStringGetTextDatum(cluster.state);
-    values[4] = Int32GetDatum(cluster.num_nodes);
+    values[4] = Int32GetDatum(pgraft_core_get_num_nodes());
     values[5] = Int64GetDatum(cluster.messages_processed);
     values[6] = Int64GetDatum(cluster.heartbeats_sent);
     values[7] = Int64GetDatum(cluster.elections_triggered);
@@ -457,7 +476,9 @@ pgraft_get_nodes_table(PG_FUNCTION_ARGS)
 	Tuplestorestate *tupstore;
 	MemoryContext per_query_ctx;
 	MemoryContext oldcontext;
-	pgraft_cluster_t cluster_state;
+	pgraft_node_table_t *table;
+	pgraft_node_t *nodes;
+	int64_t		leader_id;
 	
 	/* Check to see if caller supports us returning a tuplestore */
 	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
@@ -484,43 +505,35 @@ pgraft_get_nodes_table(PG_FUNCTION_ARGS)
 	
 	MemoryContextSwitchTo(oldcontext);
 	
-	if (pgraft_core_get_cluster_state(&cluster_state) != 0)
-	{
+	/* One copy of the membership table; rows are built straight from it */
+	leader_id = pgraft_core_get_leader_id();
+	table = pgraft_core_snapshot_nodes();
+	if (table == NULL)
 		PG_RETURN_NULL();
-	}
+	nodes = PGRAFT_NODE_TABLE_NODES(table);
 	
-	/* Return all nodes from shared memory */
-	for (int i = 0; i < cluster_state.num_nodes && i < 16; i++)
+	for (int i = 0; i < table->num_nodes; i++)
 	{
-		pgraft_node_t *node = &cluster_state.nodes[i];
+		pgraft_node_t *node = &nodes[i];
+		const char *address = PGRAFT_NODE_ADDRESS(table, node);
+		const char *colon = strrchr(address, ':');
 		Datum		values[4];
 		bool		nulls[4];
-		HeapTuple	tuple;
-		
-		/* Extract host and port from address "host:port" */
-		char *address_copy = pstrdup(node->address);
-		char *colon = strchr(address_copy, ':');
-		int port = 0;
-		if (colon)
-		{
-			*colon = '\0';
-			port = atoi(colon + 1);
-		}
 		
+		/* Split "host:port" in place */
 		values[0] = Int32GetDatum(node->id);
-		values[1] = CStringGetTextDatum(address_copy);
-		values[2] = Int32GetDatum(port);
-		values[3] = BoolGetDatum(cluster_state.leader_id == (int64_t)node->id);
+		values[1] = PointerGetDatum(cstring_to_text_with_len(address,
+															 colon ? colon - address : node->address_len));
+		values[2] = Int32GetDatum(colon ? atoi(colon + 1) : node->port);
+		values[3] = BoolGetDatum(leader_id == (int64_t) node->id);
 		
 		memset(nulls, 0, sizeof(nulls));
 		
-		tuple = heap_form_tuple(tupdesc, values, nulls);
-		tuplestore_puttuple(tupstore, tuple);
-		heap_freetuple(tuple);
-		
-		pfree(address_copy);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 	}
 	
+	pfree(table);
+	
 	/* clean up and return the tuplestore */
 	PG_RETURN_NULL();
 }
@@ -688,58 +701,55 @@ pgraft_set_debug(PG_FUNCTION_ARGS)
 
 /*
  * Append log entry
+ * The entry is proposed to Raft, which assigns it an index and term; the
+ * term argument is kept for compatibility and ignored.
  */
 Datum
 pgraft_log_append(PG_FUNCTION_ARGS)
 {
-    int64_t term = PG_GETARG_INT64(0);
     text *data_text = PG_GETARG_TEXT_PP(1);
     char *data = text_to_cstring(data_text);
     
+    /* A KV entry appended as it is is held to the same quotas as the KV functions */
+    pgraft_kv_quota_admit_entry(data, strlen(data));
     
     /* Queue LOG_APPEND command for worker to process */
-    if (!pgraft_queue_log_command(COMMAND_LOG_APPEND, data, (int)term)) {
+    if (!pgraft_queue_log_command(COMMAND_LOG_APPEND, data, 0)) {
         elog(ERROR, "pgraft: failed to queue LOG_APPEND command");
-        return -1;
+        PG_RETURN_BOOL(false);
     }
     
-    return 0;
+    PG_RETURN_BOOL(true);
 }
 
 /*
- * Commit log entry
+ * Whether a log entry is committed
+ * Raft commits entries on its own; this only reports the outcome.
  */
 Datum
 pgraft_log_commit(PG_FUNCTION_ARGS)
 {
     int64_t index = PG_GETARG_INT64(0);
+    pgraft_log_page_t *page = palloc0(offsetof(pgraft_log_page_t, index));
+    bool committed;
     
+    committed = pgraft_log_read_page(0, 0, page) && index > 0 &&
+        (uint64) index <= page->commit_index;
+    pfree(page);
     
-    /* Queue LOG_COMMIT command for worker to process */
-    if (!pgraft_queue_log_command(COMMAND_LOG_COMMIT, NULL, (int)index)) {
-        elog(ERROR, "pgraft: failed to queue LOG_COMMIT command");
-        return -1;
-    }
-    
-    return 0;
+    PG_RETURN_BOOL(committed);
 }
 
 /*
- * Apply log entry
+ * Whether a log entry has been applied on this node
+ * The worker applies committed entries on its own; this only reports it.
  */
 Datum
 pgraft_log_apply(PG_FUNCTION_ARGS)
 {
     int64_t index = PG_GETARG_INT64(0);
     
-    
-    /* Queue LOG_APPLY command for worker to process */
-    if (!pgraft_queue_log_command(COMMAND_LOG_APPLY, NULL, (int)index)) {
-        elog(ERROR, "pgraft: failed to queue LOG_APPLY command");
-        return -1;
-    }
-    
-    return 0;
+    PG_RETURN_BOOL(index > 0 && (uint64) index <= pgraft_get_applied_index());
 }
 
 /*
@@ -749,62 +759,202 @@ Datum
 pgraft_log_get_entry_sql(PG_FUNCTION_ARGS)
 {
     int64_t index = PG_GETARG_INT64(0);
-    pgraft_log_entry_t entry;
+    pgraft_log_page_t *page;
     StringInfoData result;
     
-    if (pgraft_log_get_entry(index, &entry) != 0) {
-        elog(ERROR, "pgraft: failed to get log entry %lld", (long long)index);
+    page = palloc(sizeof(pgraft_log_page_t));
+    if (!pgraft_log_read_page((uint64) index, 1, page)) {
+        elog(ERROR, "pgraft: failed to read the raft log");
+        PG_RETURN_NULL();
+    }
+    if (page->num_entries < 1 || page->index[0] != (uint64) index) {
+        elog(ERROR, "pgraft: log entry %lld is not in the raft log (retained: %llu to %llu)",
+             (long long)index, (unsigned long long)page->first_index,
+             (unsigned long long)page->last_index);
         PG_RETURN_NULL();
     }
     initStringInfo(&result);
     
-    appendStringInfo(&result, "Index: %lld, Term: %lld, Timestamp: %lld, Data: %s, Committed: %s, Applied: %s",
-                    (long long)entry.index, (long long)entry.term, (long long)entry.timestamp, entry.data,
-                    entry.committed ? "yes" : "no", entry.applied ? "yes" : "no");
+    appendStringInfo(&result, "Index: %lld, Term: %llu, Type: %s, Data: %.*s, Committed: %s, Applied: %s",
+                    (long long)index, (unsigned long long)page->term[0],
+                    pgraft_log_entry_type_name(page->type[0]),
+                    page->type[0] == PGRAFT_LOG_ENTRY_NORMAL ? page->length[0] : 0,
+                    page->data + page->offset[0],
+                    (uint64) index <= page->commit_index ? "yes" : "no",
+                    (uint64) index <= pgraft_get_applied_index() ? "yes" : "no");
+    pfree(page);
     
     PG_RETURN_TEXT_P(cstring_to_text(result.data));
 }
 
+/* Position of a pgraft_log_entries() scan */
+typedef struct pgraft_log_cursor
+{
+	pgraft_log_page_t page;			/* Current page of the log */
+	int			pos;				/* Next entry of the page to return */
+	uint64		next_index;			/* First index of the next page */
+	int64		remaining;			/* Rows left before the limit */
+	bool		last_page;			/* No entries beyond the current page */
+}			pgraft_log_cursor_t;
 
 /*
- * Get log statistics as table with individual columns
+ * Stream Raft log entries with their decoded operation and key
+ * Rows are returned one at a time and the log is read a page at a time,
+ * so scanning the whole log needs memory for one page only.
+ * Usage: SELECT * FROM pgraft_log_entries(1, 100);
  */
 Datum
-pgraft_log_get_stats_table(PG_FUNCTION_ARGS)
+pgraft_log_entries(PG_FUNCTION_ARGS)
 {
-    pgraft_log_state_t stats;
+	FuncCallContext *funcctx;
+	pgraft_log_cursor_t *cursor;
+	pgraft_log_page_t *page;
+	Datum		values[8];
+	bool		nulls[8];
+	char		op[64];
+	char		key[256];
+	HeapTuple	tuple;
+	int			i;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		TupleDesc	tupdesc;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		/* Build a tuple descriptor for our result type */
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR, "return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		cursor = (pgraft_log_cursor_t *) palloc(sizeof(pgraft_log_cursor_t));
+		cursor->page.num_entries = 0;
+		cursor->pos = 0;
+		cursor->next_index = PG_ARGISNULL(0) ? 1 : (uint64) Max(PG_GETARG_INT64(0), 1);
+		cursor->remaining = PG_ARGISNULL(1) ? PG_INT64_MAX : PG_GETARG_INT32(1);
+		cursor->last_page = false;
+		if (cursor->remaining < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("pgraft: max_entries must not be negative")));
+		funcctx->user_fctx = cursor;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	cursor = (pgraft_log_cursor_t *) funcctx->user_fctx;
+	page = &cursor->page;
+
+	/* Fetch the next page once the current one is used up */
+	if (cursor->pos >= page->num_entries && cursor->remaining > 0 && !cursor->last_page)
+	{
+		if (!pgraft_log_read_page(cursor->next_index,
+								  (int) Min(cursor->remaining, PGRAFT_LOG_PAGE_ENTRIES), page))
+			ereport(ERROR,
+					(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+					 errmsg("pgraft: failed to read the raft log"),
+					 errhint("The raft log is only readable while the background worker runs Raft.")));
+
+		cursor->pos = 0;
+		if (page->num_entries <= 0)
+			cursor->last_page = true;
+		else
+		{
+			cursor->next_index = page->index[page->num_entries - 1] + 1;
+			cursor->last_page = (cursor->next_index > page->last_index);
+		}
+	}
+
+	if (cursor->remaining <= 0 || cursor->pos >= page->num_entries)
+		SRF_RETURN_DONE(funcctx);
+
+	i = cursor->pos++;
+	cursor->remaining--;
+
+	memset(nulls, 0, sizeof(nulls));
+
+	values[0] = Int64GetDatum((int64) page->index[i]);
+	values[1] = Int64GetDatum((int64) page->term[i]);
+	values[2] = CStringGetTextDatum(pgraft_log_entry_type_name(page->type[i]));
+	values[3] = Int32GetDatum(page->size[i]);
+
+	/* Replicated operations are JSON; conf changes and raw entries are not */
+	if (page->type[i] == PGRAFT_LOG_ENTRY_NORMAL &&
+		pgraft_json_describe_entry(page->data + page->offset[i], page->length[i],
+								   op, sizeof(op), key, sizeof(key)) == 0)
+	{
+		values[4] = CStringGetTextDatum(op);
+		values[5] = CStringGetTextDatum(key);
+		nulls[4] = (op[0] == '\0');
+		nulls[5] = (key[0] == '\0');
+	}
+	else
+		nulls[4] = nulls[5] = true;
+
+	values[6] = BoolGetDatum(page->index[i] <= page->commit_index);
+
+	/* bytea shares text's representation; data is raw, not a string */
+	values[7] = PointerGetDatum(cstring_to_text_with_len(page->data + page->offset[i],
+														 page->length[i]));
+
+	tuple = heap_form_tuple(funcctx->tuple_desc, values, nulls);
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(tuple));
+}
+
+/*
+ * Build the log statistics row shared by the stats and replication views
+ */
+static Datum
+pgraft_log_stats_tuple(FunctionCallInfo fcinfo)
+{
+    pgraft_log_page_t *page;
     TupleDesc	tupdesc;
     Datum		values[8];
     bool		nulls[8];
     HeapTuple	tuple;
-    
-    if (pgraft_log_get_statistics(&stats) != 0) {
-        elog(ERROR, "pgraft: failed to get log statistics");
-        PG_RETURN_NULL();
-    }
+    bool		have_log;
     
     /* Build tuple descriptor */
     if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
         elog(ERROR, "pgraft: return type must be a row type");
     
+    /* An empty page still carries the log bounds */
+    page = palloc0(offsetof(pgraft_log_page_t, index));
+    have_log = pgraft_log_read_page(0, 0, page);
+    
     /* Prepare values */
-    values[0] = Int64GetDatum(stats.log_size);
-    values[1] = Int64GetDatum(stats.last_index);
-    values[2] = Int64GetDatum(stats.commit_index);
-    values[3] = Int64GetDatum(stats.last_applied);
-    values[4] = Int64GetDatum(stats.entries_replicated);
-    values[5] = Int64GetDatum(stats.entries_committed);
-    values[6] = Int64GetDatum(stats.entries_applied);
-    values[7] = Int64GetDatum(stats.replication_errors);
+    values[0] = Int64GetDatum(page->last_index >= page->first_index ?
+                              (int64) (page->last_index - page->first_index + 1) : 0);
+    values[1] = Int64GetDatum((int64) page->last_index);
+    values[2] = Int64GetDatum((int64) page->commit_index);
+    values[3] = Int64GetDatum((int64) pgraft_get_applied_index());
+    values[4] = Int64GetDatum((int64) page->last_index);
+    values[5] = Int64GetDatum((int64) page->commit_index);
+    values[6] = values[3];
+    values[7] = Int64GetDatum((int64) page->persist_errors);
     
-    /* Set nulls */
-    memset(nulls, 0, sizeof(nulls));
+    /* Everything but the applied index comes from the Raft log */
+    memset(nulls, !have_log, sizeof(nulls));
+    nulls[3] = nulls[6] = false;
     
     /* Build and return tuple */
     tuple = heap_form_tuple(tupdesc, values, nulls);
+    pfree(page);
     PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
 }
 
+/*
+ * Get log statistics as table with individual columns
+ */
+Datum
+pgraft_log_get_stats_table(PG_FUNCTION_ARGS)
+{
+    return pgraft_log_stats_tuple(fcinfo);
+}
+
 
 /*
  * Get replication status as table with individual columns
@@ -812,37 +962,7 @@ pgraft_log_get_stats_table(PG_FUNCTION_ARGS)
 Datum
 pgraft_log_get_replication_status_table(PG_FUNCTION_ARGS)
 {
-    pgraft_log_state_t stats;
-    TupleDesc	tupdesc;
-    Datum		values[8];
-    bool		nulls[8];
-    HeapTuple	tuple;
-    
-    if (pgraft_log_get_statistics(&stats) != 0) {
-        elog(ERROR, "pgraft: failed to get replication status");
-        PG_RETURN_NULL();
-    }
-    
-    /* Build tuple descriptor */
-    if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-        elog(ERROR, "pgraft: return type must be a row type");
-    
-    /* Prepare values */
-    values[0] = Int64GetDatum(stats.log_size);
-    values[1] = Int64GetDatum(stats.last_index);
-    values[2] = Int64GetDatum(stats.commit_index);
-    values[3] = Int64GetDatum(stats.last_applied);
-    values[4] = Int64GetDatum(stats.entries_replicated);
-    values[5] = Int64GetDatum(stats.entries_committed);
-    values[6] = Int64GetDatum(stats.entries_applied);
-    values[7] = Int64GetDatum(stats.replication_errors);
-    
-    /* Set nulls */
-    memset(nulls, 0, sizeof(nulls));
-    
-    /* Build and return tuple */
-    tuple = heap_form_tuple(tupdesc, values, nulls);
-    PG_RETURN_DATUM(HeapTupleGetDatum(tuple));
+    return pgraft_log_stats_tuple(fcinfo);
 }
 
 
@@ -882,19 +1002,24 @@ pgraft_get_queue_status(PG_FUNCTION_ARGS)
 
 	/* Get worker state */
 	state = pgraft_worker_get_state();
-	if (state != NULL && state->status_count > 0)
+	if (state != NULL)
 	{
+		pgraft_command_t *cmd = palloc(sizeof(pgraft_command_t));
 		int			position = 0;
 		int			i;
 
-		/* Iterate through status commands */
-		for (i = 0; i < state->status_count; i++)
+		/* Copy each status out; the worker updates them concurrently */
+		for (i = 0; i < MAX_STATUS_COMMANDS; i++)
 		{
-			int index = (state->status_head + i) % MAX_COMMANDS;
-			pgraft_command_t *cmd = &state->status_commands[index];
 			Datum		values[6];
 			bool		nulls[6];
 
+			SpinLockAcquire(&state->status_mutex);
+			*cmd = state->status_commands[i];
+			SpinLockRelease(&state->status_mutex);
+			if (cmd->command_id == 0)
+				continue;
+
 			memset(nulls, 0, sizeof(nulls));
 
 			values[0] = Int32GetDatum(position++);
@@ -906,6 +1031,7 @@ pgraft_get_queue_status(PG_FUNCTION_ARGS)
 
 			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 		}
+		pfree(cmd);
 	}
 
 	/* Clean up and return the tuplestore */
@@ -915,6 +1041,246 @@ pgraft_get_queue_status(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * Get per-lane command queue depth, capacity and counters
+ */
+Datum
+pgraft_get_queue_lanes(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	pgraft_worker_state_t *state;
+	pgraft_command_lane_t lanes[COMMAND_NUM_LANES];
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	state = pgraft_worker_get_state();
+	if (state == NULL)
+		return (Datum) 0;
+
+	/* Snapshot lane counters; the command payloads are not needed */
+	SpinLockAcquire(&state->queue_mutex);
+	for (i = 0; i < COMMAND_NUM_LANES; i++)
+	{
+		lanes[i].count = state->lanes[i].count;
+		lanes[i].capacity = state->lanes[i].capacity;
+		lanes[i].weight = state->lanes[i].weight;
+		lanes[i].enqueued = state->lanes[i].enqueued;
+		lanes[i].rejected = state->lanes[i].rejected;
+	}
+	SpinLockRelease(&state->queue_mutex);
+
+	for (i = 0; i < COMMAND_NUM_LANES; i++)
+	{
+		Datum		values[6];
+		bool		nulls[6];
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = CStringGetTextDatum(pgraft_command_lane_name((COMMAND_LANE) i));
+		values[1] = Int32GetDatum(lanes[i].count);
+		values[2] = Int32GetDatum(lanes[i].capacity);
+		values[3] = Int32GetDatum(lanes[i].weight);
+		values[4] = Int64GetDatum(lanes[i].enqueued);
+		values[5] = Int64GetDatum(lanes[i].rejected);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	return (Datum) 0;
+}
+
+
+/*
+ * List Raft groups with their leader and progress
+ * Group 0 is the cluster group; its commit index and proposal count are
+ * reported by pgraft_get_cluster_status() and friends, so they are NULL here.
+ */
+Datum
+pgraft_get_groups(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	pgraft_cluster_t *cluster;
+	pgraft_group_status_t groups[PGRAFT_MAX_GROUPS];
+	int32_t		node_id;
+	int			num_groups;
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	cluster = pgraft_core_get_shared_memory();
+	if (cluster == NULL)
+		return (Datum) 0;
+
+	SpinLockAcquire(&cluster->mutex);
+	node_id = cluster->node_id;
+	num_groups = Max(cluster->num_groups, 1);
+	memcpy(groups, cluster->groups, sizeof(groups));
+	groups[0].leader_id = cluster->leader_id;
+	groups[0].current_term = cluster->current_term;
+	SpinLockRelease(&cluster->mutex);
+
+	for (i = 0; i < num_groups; i++)
+	{
+		Datum		values[8];
+		bool		nulls[8];
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = Int32GetDatum(i);
+		values[1] = Int64GetDatum(groups[i].leader_id);
+		values[2] = Int32GetDatum(groups[i].current_term);
+		values[3] = BoolGetDatum(groups[i].leader_id == (int64_t) node_id);
+		values[4] = Int64GetDatum((int64) groups[i].commit_index);
+		values[5] = Int64GetDatum((int64) groups[i].applied_index);
+		values[6] = Int64GetDatum(groups[i].proposals);
+		values[7] = BoolGetDatum(groups[i].quiesced);
+		if (groups[i].leader_id <= 0)
+			nulls[1] = true;
+		if (i == 0)
+			nulls[4] = nulls[6] = true;
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	return (Datum) 0;
+}
+
+/*
+ * List heartbeat round-trip time and jitter to each peer
+ * Only the leader sends heartbeats, so followers report what they measured
+ * while they last led, if ever.
+ */
+Datum
+pgraft_get_peer_latency(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	pgraft_node_table_t *table;
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	table = pgraft_core_snapshot_nodes();
+	if (table == NULL)
+		return (Datum) 0;
+
+	for (i = 0; i < table->num_peers; i++)
+	{
+		pgraft_peer_latency_t *peer = &table->peers[i];
+		Datum		values[4];
+		bool		nulls[4];
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = Int64GetDatum(peer->node_id);
+		values[1] = Float8GetDatum(peer->rtt_us / 1000.0);
+		values[2] = Float8GetDatum(peer->rtt_var_us / 1000.0);
+		values[3] = Int64GetDatum(peer->samples);
+		if (peer->samples == 0)
+			nulls[1] = nulls[2] = true;
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(table);
+
+	return (Datum) 0;
+}
+
+/*
+ * Election timeout this node currently uses, in milliseconds
+ * Equals pgraft.election_timeout unless pgraft.election_timeout_max lets it
+ * stretch on a slow or jittery link.
+ */
+Datum
+pgraft_get_election_timeout(PG_FUNCTION_ARGS)
+{
+	pgraft_cluster_t *cluster;
+	int32_t		timeout_ms;
+
+	cluster = pgraft_core_get_shared_memory();
+	if (cluster == NULL)
+		PG_RETURN_NULL();
+
+	SpinLockAcquire(&cluster->mutex);
+	timeout_ms = cluster->election_timeout_ms;
+	SpinLockRelease(&cluster->mutex);
+
+	if (timeout_ms <= 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_INT32(timeout_ms);
+}
+
 /*
  * Sync with leader
  */
@@ -978,71 +1344,90 @@ pgraft_replicate_entry_func(PG_FUNCTION_ARGS)
 /* Network worker functions removed - handled automatically by background worker */
 
 /*
- * Get nodes directly from Go Raft layer
- * This function works on replicas because it queries the Raft cluster directly
- * instead of reading from PostgreSQL shared memory
+ * List cluster members as the Raft layer sees them
+ * Reads the state file the background worker writes, so it works on
+ * replicas and needs no access to the Go library
  */
 Datum
 pgraft_get_nodes_from_raft(PG_FUNCTION_ARGS)
 {
-	char *result = NULL;
-	text *result_text;
-	FILE *fp;
-	char filepath[MAXPGPATH];
-	char line[4096];
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	StringInfoData buf;
+	char		filepath[MAXPGPATH];
+	char		chunk[4096];
 	const char *data_dir;
-	char *nodes_start = NULL;
-	
-	/* Read nodes list from persistence file (written by background worker) */
-	/* This allows SQL functions to access the data without calling Go directly */
-	
+	pgraft_member_t *members;
+	int			num_members;
+	size_t		nread;
+	FILE	   *fp;
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
 	data_dir = GetConfigOption("pgraft.data_dir", false, false);
 	if (!data_dir)
 		data_dir = "pgraft-data";
-	
+
 	snprintf(filepath, sizeof(filepath), "%s/cluster_state.json", data_dir);
-	
-	fp = fopen(filepath, "r");
+
+	fp = AllocateFile(filepath, "r");
 	if (!fp)
 	{
 		elog(DEBUG1, "pgraft_get_nodes_from_raft: could not open state file");
-		PG_RETURN_TEXT_P(cstring_to_text("[]"));
+		return (Datum) 0;
 	}
-	
-	/* Parse the file to extract the "nodes" field */
-	while (fgets(line, sizeof(line), fp) != NULL)
-	{
-		char *nodes_pos = strstr(line, "\"nodes\":");
-		if (nodes_pos)
-		{
-			/* Skip "nodes": */
-			nodes_start = nodes_pos + 8;
-			/* Skip whitespace */
-			while (*nodes_start == ' ' || *nodes_start == '\t')
-				nodes_start++;
-			
-			/* Find the end of the JSON array (before the comma) */
-			char *end = strrchr(nodes_start, ',');
-			if (end)
-			{
-				*end = '\0';
-				result = pstrdup(nodes_start);
-			}
-			break;
-		}
-	}
-	
-	fclose(fp);
-	
-	if (result == NULL)
+
+	initStringInfo(&buf);
+	while ((nread = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+		appendBinaryStringInfo(&buf, chunk, (int) nread);
+	FreeFile(fp);
+
+	members = (pgraft_member_t *) palloc(sizeof(pgraft_member_t) * pgraft_max_nodes);
+	num_members = pgraft_json_parse_members(buf.data, members, pgraft_max_nodes);
+	if (num_members < 0)
+		elog(DEBUG1, "pgraft_get_nodes_from_raft: state file is not valid JSON");
+
+	for (i = 0; i < num_members; i++)
 	{
-		elog(DEBUG1, "pgraft_get_nodes_from_raft: nodes field not found in file");
-		PG_RETURN_TEXT_P(cstring_to_text("[]"));
+		Datum		values[4];
+		bool		nulls[4];
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = Int64GetDatum(members[i].id);
+		values[1] = CStringGetTextDatum(members[i].name);
+		values[2] = CStringGetTextDatum(members[i].address);
+		values[3] = BoolGetDatum(members[i].active);
+		nulls[1] = (members[i].name[0] == '\0');
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
 	}
-	
-	/* Convert C string to PostgreSQL text */
-	result_text = cstring_to_text(result);
-	pfree(result);
-	
-	PG_RETURN_TEXT_P(result_text);
+
+	pfree(members);
+	pfree(buf.data);
+
+	return (Datum) 0;
 }
@@ -60,10 +60,6 @@ pgraft_state_init_shared_memory(void)
 		g_go_state->go_leader_id = 0;
 		strncpy(g_go_state->go_raft_state, "unknown", sizeof(g_go_state->go_raft_state) - 1);
 		g_go_state->go_raft_state[sizeof(g_go_state->go_raft_state) - 1] = '\0';
-		g_go_state->num_nodes = 0;
-		memset(g_go_state->node_ids, 0, sizeof(g_go_state->node_ids));
-		memset(g_go_state->node_addresses, 0, sizeof(g_go_state->node_addresses));
-		memset(g_go_state->node_ports, 0, sizeof(g_go_state->node_ports));
 		g_go_state->go_messages_processed = 0;
 		g_go_state->go_log_entries_committed = 0;
 		g_go_state->go_heartbeats_sent = 0;
@@ -260,62 +256,6 @@ pgraft_state_restore_node_config(int32_t* node_id, char* address, int32_t* port)
     elog(DEBUG1, "pgraft: Restored node config %d at %s:%d", *node_id, address, *port);
 }
 
-/*
- * Save cluster nodes configuration to shared memory
- */
-void
-pgraft_state_save_cluster_nodes(int32_t num_nodes, int32_t* node_ids, 
-                               char node_addresses[][256], int32_t* node_ports)
-{
-    pgraft_go_state_t *state = pgraft_state_get_shared_memory();
-    if (!state) {
-        elog(ERROR, "pgraft: failed to get shared memory");
-        return;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    
-    state->num_nodes = num_nodes;
-    for (int i = 0; i < num_nodes && i < 16; i++) {
-        state->node_ids[i] = node_ids[i];
-        strncpy(state->node_addresses[i], node_addresses[i], sizeof(state->node_addresses[i]) - 1);
-        state->node_addresses[i][sizeof(state->node_addresses[i]) - 1] = '\0';
-        state->node_ports[i] = node_ports[i];
-    }
-    
-    SpinLockRelease(&state->mutex);
-    
-    elog(DEBUG1, "pgraft: Saved %d cluster nodes", num_nodes);
-}
-
-/*
- * Restore cluster nodes configuration from shared memory
- */
-void
-pgraft_state_restore_cluster_nodes(int32_t* num_nodes, int32_t* node_ids, 
-                                  char node_addresses[][256], int32_t* node_ports)
-{
-    pgraft_go_state_t *state = pgraft_state_get_shared_memory();
-    if (!state || !num_nodes || !node_ids || !node_addresses || !node_ports) {
-        elog(ERROR, "pgraft: invalid parameters");
-        return;
-    }
-    
-    SpinLockAcquire(&state->mutex);
-    
-    *num_nodes = state->num_nodes;
-    for (int i = 0; i < state->num_nodes && i < 16; i++) {
-        node_ids[i] = state->node_ids[i];
-        strncpy(node_addresses[i], state->node_addresses[i], 255);
-        node_addresses[i][255] = '\0';
-        node_ports[i] = state->node_ports[i];
-    }
-    
-    SpinLockRelease(&state->mutex);
-    
-    elog(DEBUG1, "pgraft: Restored %d cluster nodes", *num_nodes);
-}
-
 /* State validation functions */
 bool pgraft_state_is_go_lib_loaded(void) {
     pgraft_go_state_t *state;
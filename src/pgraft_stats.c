@@ -0,0 +1,207 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_stats.c
+ *      Cluster-wide statistics gathered over the Raft peer transport
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/elog.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+#include <string.h>
+
+#include "../include/pgraft_stats.h"
+#include "../include/pgraft_core.h"
+#include "../include/pgraft_apply.h"
+#include "../include/pgraft_go.h"
+#include "../include/pgraft_guc.h"
+#include "../include/pgraft_kv.h"
+
+/* Global shared memory pointer */
+static pgraft_stats_state_t *g_stats_state = NULL;
+
+/*
+ * Shared memory needed for one round of pgraft.max_nodes rows
+ */
+Size
+pgraft_stats_shmem_size(void)
+{
+	return add_size(offsetof(pgraft_stats_state_t, nodes),
+					mul_size(pgraft_max_nodes, sizeof(pgraft_go_node_stats_t)));
+}
+
+/*
+ * Initialize shared memory for cluster statistics
+ */
+void
+pgraft_stats_init_shared_memory(void)
+{
+	bool		found;
+	
+	g_stats_state = (pgraft_stats_state_t *) ShmemInitStruct("pgraft_stats_state",
+															 pgraft_stats_shmem_size(),
+															 &found);
+	
+	if (!found)
+	{
+		memset(g_stats_state, 0, offsetof(pgraft_stats_state_t, nodes));
+		g_stats_state->capacity = pgraft_max_nodes;
+		ConditionVariableInit(&g_stats_state->cv);
+		SpinLockInit(&g_stats_state->mutex);
+	}
+}
+
+/*
+ * Get shared memory pointer
+ */
+pgraft_stats_state_t *
+pgraft_stats_get_shared_memory(void)
+{
+	if (g_stats_state == NULL)
+		pgraft_stats_init_shared_memory();
+	return g_stats_state;
+}
+
+/*
+ * Copy the published round out; caller holds the mutex
+ */
+static int
+pgraft_stats_copy(pgraft_stats_state_t *state, pgraft_go_node_stats_t *nodes,
+				  TimestampTz *collected_at)
+{
+	memcpy(nodes, state->nodes, sizeof(pgraft_go_node_stats_t) * state->num_nodes);
+	*collected_at = state->collected_at;
+	return state->num_nodes;
+}
+
+/*
+ * Copy a round of cluster statistics no older than ttl_ms into nodes[],
+ * which must hold pgraft.max_nodes rows
+ * If the worker cannot collect a fresh round in time the last one is
+ * returned instead; 0 rows means none was ever collected.
+ */
+int
+pgraft_stats_collect(int ttl_ms, pgraft_go_node_stats_t *nodes, TimestampTz *collected_at)
+{
+	pgraft_stats_state_t *state;
+	TimestampTz deadline;
+	uint64		generation;
+	int			count;
+	
+	state = pgraft_stats_get_shared_memory();
+	if (!state)
+		elog(ERROR, "pgraft: cannot read cluster stats - failed to get shared memory");
+	
+	SpinLockAcquire(&state->mutex);
+	if (state->generation > 0 &&
+		!TimestampDifferenceExceeds(state->collected_at, GetCurrentTimestamp(), ttl_ms))
+	{
+		count = pgraft_stats_copy(state, nodes, collected_at);
+		SpinLockRelease(&state->mutex);
+		return count;
+	}
+	
+	/* Ask the worker; the most demanding waiter sets the accepted age */
+	if (!state->requested || ttl_ms < state->requested_ttl)
+		state->requested_ttl = ttl_ms;
+	state->requested = true;
+	generation = state->generation;
+	SpinLockRelease(&state->mutex);
+	
+	deadline = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), pgraft_proposal_timeout);
+	
+	ConditionVariablePrepareToSleep(&state->cv);
+	for (;;)
+	{
+		bool		published;
+		long		remaining;
+		
+		SpinLockAcquire(&state->mutex);
+		published = (state->generation != generation);
+		SpinLockRelease(&state->mutex);
+		
+		if (published)
+			break;
+		
+		remaining = TimestampDifferenceMilliseconds(GetCurrentTimestamp(), deadline);
+		if (remaining <= 0)
+		{
+			elog(DEBUG1, "pgraft: no fresh cluster stats round, serving the last one");
+			break;
+		}
+		
+		(void) ConditionVariableTimedSleep(&state->cv, remaining, PG_WAIT_EXTENSION);
+	}
+	ConditionVariableCancelSleep();
+	
+	SpinLockAcquire(&state->mutex);
+	count = pgraft_stats_copy(state, nodes, collected_at);
+	SpinLockRelease(&state->mutex);
+	
+	return count;
+}
+
+/*
+ * Publish this node's worker-side metrics to Go and answer a pending
+ * request for a fresh round (background worker)
+ */
+void
+pgraft_stats_serve_request(void)
+{
+	static pgraft_go_node_stats_t *nodes = NULL;
+	pgraft_stats_state_t *state;
+	pgraft_worker_state_t *worker;
+	uint64		kv_hash;
+	uint64		kv_hash_revision;
+	uint64		compact_revision;
+	int			ttl_ms;
+	int			age_ms = 0;
+	int			count;
+	
+	state = pgraft_stats_get_shared_memory();
+	worker = pgraft_worker_get_state();
+	if (!state || !worker)
+		return;
+	
+	/* Peers may ask for our snapshot at any time, keep it current */
+	(void) pgraft_kv_get_hash(0, &kv_hash, &kv_hash_revision, &compact_revision);
+	pgraft_go_set_local_stats(pgraft_get_applied_index(), worker->command_count,
+							  kv_hash, kv_hash_revision);
+	
+	SpinLockAcquire(&state->mutex);
+	if (!state->requested)
+	{
+		SpinLockRelease(&state->mutex);
+		return;
+	}
+	ttl_ms = state->requested_ttl;
+	SpinLockRelease(&state->mutex);
+	
+	if (nodes == NULL)
+		nodes = MemoryContextAlloc(TopMemoryContext,
+								   sizeof(pgraft_go_node_stats_t) * state->capacity);
+	
+	/* -1 while Go is still collecting; ask again on the next iteration */
+	count = pgraft_go_cluster_stats(nodes, state->capacity, ttl_ms, &age_ms);
+	if (count < 0)
+		return;
+	
+	SpinLockAcquire(&state->mutex);
+	memcpy(state->nodes, nodes, sizeof(pgraft_go_node_stats_t) * count);
+	state->num_nodes = count;
+	state->collected_at = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), -age_ms);
+	state->generation++;
+	state->requested = false;
+	SpinLockRelease(&state->mutex);
+	
+	ConditionVariableBroadcast(&state->cv);
+}
@@ -0,0 +1,97 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgraft_stats_sql.c
+ *      SQL interface for cluster-wide statistics
+ *
+ * Copyright (c) 2024-2025, pgElephant, Inc.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+#include "../include/pgraft_stats.h"
+#include "../include/pgraft_guc.h"
+
+PG_FUNCTION_INFO_V1(pgraft_cluster_stats_sql);
+
+/*
+ * One row per node with its metrics as last collected over the peer
+ * transport; works on any node
+ */
+Datum
+pgraft_cluster_stats_sql(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_mcxt;
+	MemoryContext oldcontext;
+	pgraft_go_node_stats_t *nodes;
+	TimestampTz collected_at;
+	int			num_nodes;
+	int			i;
+
+	/* Check to ensure we were called as a set-returning function */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	/* Switch into long-lived context to construct returned data structures */
+	per_query_mcxt = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_mcxt);
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, 1024);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	nodes = (pgraft_go_node_stats_t *) palloc(sizeof(pgraft_go_node_stats_t) * pgraft_max_nodes);
+	num_nodes = pgraft_stats_collect(pgraft_cluster_stats_ttl, nodes, &collected_at);
+
+	for (i = 0; i < num_nodes; i++)
+	{
+		Datum		values[15];
+		bool		nulls[15];
+
+		memset(nulls, 0, sizeof(nulls));
+
+		values[0] = Int64GetDatum(nodes[i].node_id);
+		values[1] = BoolGetDatum(nodes[i].reachable != 0);
+		values[2] = Int64GetDatum(nodes[i].leader_id);
+		values[3] = Int64GetDatum((int64) nodes[i].term);
+		values[4] = Int64GetDatum((int64) nodes[i].commit_index);
+		values[5] = Int64GetDatum((int64) nodes[i].applied_index);
+		values[6] = Int64GetDatum(nodes[i].apply_lag);
+		values[7] = Int64GetDatum(nodes[i].queue_depth);
+		values[8] = Int64GetDatum(nodes[i].pending_entries);
+		values[9] = Int64GetDatum(nodes[i].disk_bytes);
+		values[10] = Int64GetDatum(nodes[i].rtt_us);
+		values[11] = Int64GetDatum(nodes[i].max_peer_rtt_us);
+		values[12] = Int64GetDatum((int64) nodes[i].kv_hash);
+		values[13] = Int64GetDatum((int64) nodes[i].kv_hash_revision);
+		values[14] = TimestampTzGetDatum(collected_at);
+
+		/* A silent node has nothing but its id */
+		if (!nodes[i].reachable)
+			memset(&nulls[2], true, sizeof(bool) * 12);
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	pfree(nodes);
+
+	return (Datum) 0;
+}
@@ -12,91 +12,237 @@
 
 #include <time.h>
 
+static bool pgraft_enqueue_command(pgraft_command_t *cmd, uint64 *command_id);
+
 /*
- * Add command to queue (called by SQL functions)
+ * Map a command type to the priority lane it is queued on
  */
-bool
-pgraft_queue_command(COMMAND_TYPE type, int node_id, const char *address, int port, const char *cluster_id)
+COMMAND_LANE
+pgraft_command_lane(COMMAND_TYPE type)
+{
+	switch (type)
+	{
+		case COMMAND_INIT:
+		case COMMAND_ADD_NODE:
+		case COMMAND_REMOVE_NODE:
+		case COMMAND_SHUTDOWN:
+			return COMMAND_LANE_CONTROL;
+		case COMMAND_KV_PUT:
+		case COMMAND_KV_DELETE:
+		case COMMAND_KV_PATCH:
+		case COMMAND_PROPOSE:
+			return COMMAND_LANE_KV;
+		case COMMAND_LOG_APPEND:
+		default:
+			return COMMAND_LANE_BULK;
+	}
+}
+
+/*
+ * Human-readable lane name
+ */
+const char *
+pgraft_command_lane_name(COMMAND_LANE lane)
+{
+	switch (lane)
+	{
+		case COMMAND_LANE_CONTROL:
+			return "control";
+		case COMMAND_LANE_KV:
+			return "kv";
+		case COMMAND_LANE_BULK:
+			return "bulk";
+		default:
+			return "unknown";
+	}
+}
+
+/*
+ * Initialize priority lanes (called once when worker state is created)
+ */
+void
+pgraft_queue_init_lanes(pgraft_worker_state_t *state)
+{
+	static const int capacities[COMMAND_NUM_LANES] = {
+		MAX_CONTROL_COMMANDS, MAX_KV_COMMANDS, MAX_BULK_COMMANDS
+	};
+	static const int weights[COMMAND_NUM_LANES] = {
+		CONTROL_LANE_WEIGHT, KV_LANE_WEIGHT, BULK_LANE_WEIGHT
+	};
+	int			i;
+	
+	SpinLockInit(&state->queue_mutex);
+	state->command_count = 0;
+	
+	for (i = 0; i < COMMAND_NUM_LANES; i++)
+	{
+		pgraft_command_lane_t *lane = &state->lanes[i];
+		
+		lane->head = 0;
+		lane->tail = 0;
+		lane->count = 0;
+		lane->capacity = Min(capacities[i], MAX_COMMANDS);
+		lane->weight = weights[i];
+		lane->credits = weights[i];
+		lane->enqueued = 0;
+		lane->rejected = 0;
+	}
+}
+
+/*
+ * Append a fully built command to its priority lane
+ *
+ * Assigns the command id under the queue lock.  Returns false if the lane
+ * is full; other lanes are unaffected.
+ */
+static bool
+pgraft_enqueue_command(pgraft_command_t *cmd, uint64 *command_id)
 {
 	pgraft_worker_state_t *state;
-	pgraft_command_t *cmd;
-	
-	elog(LOG, "pgraft: pgraft_queue_command called with type=%d, node_id=%d, address=%s, port=%d", 
-		 type, node_id, address ? address : "NULL", port);
+	pgraft_command_lane_t *lane;
+	COMMAND_LANE lane_id;
+	int			depth;
 	
 	state = pgraft_worker_get_state();
 	if (state == NULL) {
-		elog(ERROR, "pgraft: failed to get worker state in pgraft_queue_command");
 		return false;
 	}
 	
-	/* Check if queue is full */
-	if (state->command_count >= MAX_COMMANDS) {
-		elog(WARNING, "pgraft: command queue is full, cannot queue new command");
+	lane_id = pgraft_command_lane(cmd->type);
+	lane = &state->lanes[lane_id];
+	
+	/* Initialize status tracking */
+	cmd->status = COMMAND_STATUS_PENDING;
+	cmd->error_message[0] = '\0';
+	cmd->timestamp = time(NULL);
+	
+	SpinLockAcquire(&state->queue_mutex);
+	
+	/* Check if this lane is full */
+	if (lane->count >= lane->capacity) {
+		lane->rejected++;
+		SpinLockRelease(&state->queue_mutex);
+		elog(WARNING, "pgraft: %s command lane is full (%d entries), cannot queue command %d",
+			 pgraft_command_lane_name(lane_id), lane->capacity, cmd->type);
 		return false;
 	}
 	
-	/* Get pointer to next slot in circular buffer */
-	cmd = &state->commands[state->command_tail];
+	cmd->command_id = ++state->next_command_id;
+	lane->commands[lane->tail] = *cmd;
+	
+	/* Update circular buffer pointers */
+	lane->tail = (lane->tail + 1) % lane->capacity;
+	lane->count++;
+	lane->enqueued++;
+	state->command_count++;
+	depth = lane->count;
+	
+	SpinLockRelease(&state->queue_mutex);
+	
+	/* Record the status now, so that a waiter cannot miss the outcome */
+	pgraft_add_command_to_status(cmd);
+	
+	if (command_id)
+		*command_id = cmd->command_id;
+	
+	elog(DEBUG1, "pgraft: command %d queued on %s lane (id=%llu, depth=%d)",
+		 cmd->type, pgraft_command_lane_name(lane_id),
+		 (unsigned long long) cmd->command_id, depth);
+	return true;
+}
+
+/*
+ * Add command to queue (called by SQL functions)
+ */
+bool
+pgraft_queue_command(COMMAND_TYPE type, int node_id, const char *address, int port, const char *cluster_id)
+{
+	pgraft_command_t cmd;
+	
+	elog(LOG, "pgraft: pgraft_queue_command called with type=%d, node_id=%d, address=%s, port=%d", 
+		 type, node_id, address ? address : "NULL", port);
+	
+	memset(&cmd, 0, sizeof(cmd));
 	
 	/* Initialize command */
-	cmd->type = type;
-	cmd->node_id = node_id;
+	cmd.type = type;
+	cmd.node_id = node_id;
 	if (address) {
-		strncpy(cmd->address, address, sizeof(cmd->address) - 1);
-		cmd->address[sizeof(cmd->address) - 1] = '\0';
-	} else {
-		cmd->address[0] = '\0';
+		strncpy(cmd.address, address, sizeof(cmd.address) - 1);
+		cmd.address[sizeof(cmd.address) - 1] = '\0';
 	}
-	cmd->port = port;
+	cmd.port = port;
+	cmd.term = 0;
 	
 	if (cluster_id) {
-		strncpy(cmd->cluster_id, cluster_id, sizeof(cmd->cluster_id) - 1);
-		cmd->cluster_id[sizeof(cmd->cluster_id) - 1] = '\0';
-	} else {
-		cmd->cluster_id[0] = '\0';
+		strncpy(cmd.cluster_id, cluster_id, sizeof(cmd.cluster_id) - 1);
+		cmd.cluster_id[sizeof(cmd.cluster_id) - 1] = '\0';
 	}
 	
-	/* Initialize status tracking */
-	cmd->status = COMMAND_STATUS_PENDING;
-	cmd->error_message[0] = '\0';
-	cmd->timestamp = time(NULL);
-	
-	/* Update circular buffer pointers */
-	state->command_tail = (state->command_tail + 1) % MAX_COMMANDS;
-	state->command_count++;
+	if (!pgraft_enqueue_command(&cmd, NULL))
+		return false;
 	
-	elog(LOG, "pgraft: command %d queued for node %d at %s:%d (count=%d)", 
-		 type, node_id, address, port, state->command_count);
+	elog(LOG, "pgraft: command %d queued for node %d at %s:%d", 
+		 type, node_id, address ? address : "NULL", port);
 	return true;
 }
 
 /*
  * Remove command from queue (called by worker)
  * Returns true if command was dequeued, false if queue is empty
+ *
+ * Lanes are visited in priority order and each may dequeue up to its
+ * remaining credits; once no non-empty lane has credits left, all lanes are
+ * refilled with their weight.  Control commands therefore go first, yet KV
+ * and bulk traffic still make progress under sustained control load.
  */
 bool
 pgraft_dequeue_command(pgraft_command_t *cmd)
 {
 	pgraft_worker_state_t *state;
+	pgraft_command_lane_t *lane = NULL;
+	int			i;
 	
 	state = pgraft_worker_get_state();
 	if (state == NULL) {
 		return false;
 	}
 	
+	SpinLockAcquire(&state->queue_mutex);
+	
 	/* Check if queue is empty */
 	if (state->command_count == 0) {
+		SpinLockRelease(&state->queue_mutex);
 		return false;
 	}
 	
-	/* Copy command from head of circular buffer */
-	*cmd = state->commands[state->command_head];
+	for (i = 0; i < COMMAND_NUM_LANES; i++) {
+		if (state->lanes[i].count > 0 && state->lanes[i].credits > 0) {
+			lane = &state->lanes[i];
+			break;
+		}
+	}
+	
+	/* Every non-empty lane spent its share: start a new round */
+	if (lane == NULL) {
+		for (i = 0; i < COMMAND_NUM_LANES; i++) {
+			state->lanes[i].credits = state->lanes[i].weight;
+			if (lane == NULL && state->lanes[i].count > 0)
+				lane = &state->lanes[i];
+		}
+	}
+	
+	/* Copy command from head of the chosen lane */
+	*cmd = lane->commands[lane->head];
 	
 	/* Update circular buffer pointers */
-	state->command_head = (state->command_head + 1) % MAX_COMMANDS;
+	lane->head = (lane->head + 1) % lane->capacity;
+	lane->count--;
+	lane->credits--;
 	state->command_count--;
 	
+	SpinLockRelease(&state->queue_mutex);
+	
 	return true;
 }
 
@@ -122,249 +268,273 @@ pgraft_queue_is_empty(void)
 bool
 pgraft_queue_log_command(COMMAND_TYPE type, const char *log_data, int log_index)
 {
-	pgraft_worker_state_t *state;
-	pgraft_command_t *cmd;
+	pgraft_command_t cmd;
 	
-	state = pgraft_worker_get_state();
-	if (state == NULL) {
-		return false;
-	}
-	
-	/* Check if queue is full */
-	if (state->command_count >= MAX_COMMANDS) {
-		elog(WARNING, "pgraft: command queue is full, cannot queue log command");
-		return false;
-	}
-	
-	/* Get pointer to next slot in circular buffer */
-	cmd = &state->commands[state->command_tail];
+	memset(&cmd, 0, sizeof(cmd));
 	
 	/* Initialize command */
-	cmd->type = type;
-	cmd->node_id = 0;  /* Not applicable for log commands */
-	cmd->address[0] = '\0';  /* Not applicable for log commands */
-	cmd->port = 0;  /* Not applicable for log commands */
-	cmd->cluster_id[0] = '\0';  /* Not applicable for log commands */
+	cmd.type = type;
 	
 	/* Set log-specific fields */
 	if (log_data) {
-		strncpy(cmd->log_data, log_data, sizeof(cmd->log_data) - 1);
-		cmd->log_data[sizeof(cmd->log_data) - 1] = '\0';
-	} else {
-		cmd->log_data[0] = '\0';
+		strncpy(cmd.log_data, log_data, sizeof(cmd.log_data) - 1);
+		cmd.log_data[sizeof(cmd.log_data) - 1] = '\0';
 	}
-	cmd->log_index = log_index;
-	
-	/* Initialize status tracking */
-	cmd->status = COMMAND_STATUS_PENDING;
-	cmd->error_message[0] = '\0';
-	cmd->timestamp = time(NULL);
+	cmd.log_index = log_index;
+	cmd.term = 0;
 	
-	/* Update circular buffer pointers */
-	state->command_tail = (state->command_tail + 1) % MAX_COMMANDS;
-	state->command_count++;
+	if (!pgraft_enqueue_command(&cmd, NULL))
+		return false;
 	
-	elog(LOG, "pgraft: log command %d queued (index=%d, count=%d)", type, log_index, state->command_count);
+	elog(LOG, "pgraft: log command %d queued (index=%d)", type, log_index);
 	return true;
 }
 
 /*
  * Add KV command to queue (called by SQL KV functions)
+ *
+ * term is the Raft term the caller observed itself leading in; the worker
+ * drops the command if leadership has moved on by the time it is dequeued.
+ * group_id is the Raft group owning the key.  expected_version is only used
+ * by COMMAND_KV_PATCH (-1 for none).  The assigned command id is returned
+ * through command_id so the caller can wait for the outcome.
  */
 bool
-pgraft_queue_kv_command(COMMAND_TYPE type, const char *key, const char *value, const char *client_id)
+pgraft_queue_kv_command(COMMAND_TYPE type, const char *key, const char *value, const char *client_id,
+						int64_t expected_version, int32_t term, int group_id, uint64 *command_id)
 {
-	pgraft_worker_state_t *state;
-	pgraft_command_t *cmd;
+	pgraft_command_t cmd;
 	
-	state = pgraft_worker_get_state();
-	if (state == NULL) {
-		return false;
-	}
-	
-	/* Check if queue is full */
-	if (state->command_count >= MAX_COMMANDS) {
-		elog(WARNING, "pgraft: command queue is full, cannot queue KV command");
-		return false;
-	}
-	
-	/* Get pointer to next slot in circular buffer */
-	cmd = &state->commands[state->command_tail];
+	memset(&cmd, 0, sizeof(cmd));
 	
 	/* Initialize command */
-	cmd->type = type;
-	cmd->node_id = 0;  /* Not applicable for KV commands */
-	cmd->address[0] = '\0';  /* Not applicable for KV commands */
-	cmd->port = 0;  /* Not applicable for KV commands */
-	cmd->cluster_id[0] = '\0';  /* Not applicable for KV commands */
+	cmd.type = type;
 	
 	/* Set KV-specific fields */
 	if (key) {
-		strncpy(cmd->kv_key, key, sizeof(cmd->kv_key) - 1);
-		cmd->kv_key[sizeof(cmd->kv_key) - 1] = '\0';
-	} else {
-		cmd->kv_key[0] = '\0';
+		strncpy(cmd.kv_key, key, sizeof(cmd.kv_key) - 1);
+		cmd.kv_key[sizeof(cmd.kv_key) - 1] = '\0';
 	}
 	
+	/* Callers check values against the store's limit, which is the slot size */
+	if (value && strlen(value) >= sizeof(cmd.kv_value))
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("pgraft: value of key '%s' is too long (max %zu characters, got %zu)",
+						key ? key : "", sizeof(cmd.kv_value) - 1, strlen(value))));
+	
 	if (value) {
-		strncpy(cmd->kv_value, value, sizeof(cmd->kv_value) - 1);
-		cmd->kv_value[sizeof(cmd->kv_value) - 1] = '\0';
-	} else {
-		cmd->kv_value[0] = '\0';
+		strncpy(cmd.kv_value, value, sizeof(cmd.kv_value) - 1);
+		cmd.kv_value[sizeof(cmd.kv_value) - 1] = '\0';
 	}
 	
 	if (client_id) {
-		strncpy(cmd->kv_client_id, client_id, sizeof(cmd->kv_client_id) - 1);
-		cmd->kv_client_id[sizeof(cmd->kv_client_id) - 1] = '\0';
-	} else {
-		cmd->kv_client_id[0] = '\0';
+		strncpy(cmd.kv_client_id, client_id, sizeof(cmd.kv_client_id) - 1);
+		cmd.kv_client_id[sizeof(cmd.kv_client_id) - 1] = '\0';
 	}
+	cmd.kv_expected_version = expected_version;
+	cmd.term = term;
+	cmd.group_id = group_id;
 	
-	/* Initialize status tracking */
-	cmd->status = COMMAND_STATUS_PENDING;
-	cmd->error_message[0] = '\0';
-	cmd->timestamp = time(NULL);
-	
-	/* Update circular buffer pointers */
-	state->command_tail = (state->command_tail + 1) % MAX_COMMANDS;
-	state->command_count++;
+	if (!pgraft_enqueue_command(&cmd, command_id))
+		return false;
 	
-	elog(LOG, "pgraft: KV command %d queued (key=%s, count=%d)", type, key ? key : "NULL", state->command_count);
+	elog(LOG, "pgraft: KV command %d queued (key=%s)", type, key ? key : "NULL");
 	return true;
 }
 
 /*
- * Add command to status tracking buffer
+ * Add a prebuilt replicated entry to the queue
+ *
+ * Used by the state machine modules (sequences etc.) that encode their own
+ * JSON payloads.  Shares the KV lane and the stale-term check with KV writes.
  */
 bool
-pgraft_add_command_to_status(pgraft_command_t *cmd)
+pgraft_queue_propose_command(const char *data, int32_t term, uint64 *command_id)
 {
-	pgraft_worker_state_t *state;
-	pgraft_command_t *status_cmd;
+	pgraft_command_t cmd;
 	
-	state = pgraft_worker_get_state();
-	if (state == NULL) {
+	if (data == NULL || strlen(data) >= sizeof(cmd.log_data)) {
+		elog(WARNING, "pgraft: proposal payload missing or too large");
 		return false;
 	}
 	
-	/* Check if status buffer is full */
-	if (state->status_count >= MAX_COMMANDS) {
-		elog(WARNING, "pgraft: status buffer is full, removing oldest entry");
-		/* Remove oldest status entry */
-		state->status_head = (state->status_head + 1) % MAX_COMMANDS;
-		state->status_count--;
-	}
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.type = COMMAND_PROPOSE;
+	strlcpy(cmd.log_data, data, sizeof(cmd.log_data));
+	cmd.term = term;
 	
-	/* Get pointer to next slot in status circular buffer */
-	status_cmd = &state->status_commands[state->status_tail];
+	if (!pgraft_enqueue_command(&cmd, command_id))
+		return false;
 	
-	/* Copy command to status buffer */
-	*status_cmd = *cmd;
+	elog(DEBUG1, "pgraft: proposal queued (%s)", data);
+	return true;
+}
+
+/*
+ * Find a command's status slot, -1 if it has none; caller holds status_mutex
+ */
+static int
+pgraft_find_command_status(pgraft_worker_state_t *state, uint64 command_id)
+{
+	int i;
 	
-	/* Update circular buffer pointers */
-	state->status_tail = (state->status_tail + 1) % MAX_COMMANDS;
-	state->status_count++;
+	for (i = 0; i < MAX_STATUS_COMMANDS; i++) {
+		if (state->status_commands[i].command_id == command_id)
+			return i;
+	}
 	
-	return true;
+	return -1;
 }
 
 /*
- * Get command status by timestamp
+ * Pick a slot for a new status: a free one, else the oldest finished
+ * command, whose waiter has given up; caller holds status_mutex
+ */
+static int
+pgraft_claim_command_status(pgraft_worker_state_t *state)
+{
+	int victim = -1;
+	bool victim_finished = false;
+	int i;
+	
+	for (i = 0; i < MAX_STATUS_COMMANDS; i++) {
+		pgraft_command_t *status_cmd = &state->status_commands[i];
+		bool finished;
+		
+		if (status_cmd->command_id == 0) {
+			state->status_count++;
+			return i;
+		}
+		
+		finished = (status_cmd->status == COMMAND_STATUS_COMPLETED ||
+					status_cmd->status == COMMAND_STATUS_FAILED);
+		if (victim < 0 || (finished && !victim_finished) ||
+			(finished == victim_finished && status_cmd->command_id < state->status_commands[victim].command_id)) {
+			victim = i;
+			victim_finished = finished;
+		}
+	}
+	
+	return victim;
+}
+
+/*
+ * Record a command's status, unless it already has one
+ *
+ * Called when the command is queued and again when the worker dequeues
+ * it, whichever comes first; the worker's updates are never undone.
  */
 bool
-pgraft_get_command_status(int64_t timestamp, pgraft_command_t *status_cmd)
+pgraft_add_command_to_status(pgraft_command_t *cmd)
 {
 	pgraft_worker_state_t *state;
-	int i;
+	bool evicted_pending = false;
+	int index;
 	
 	state = pgraft_worker_get_state();
 	if (state == NULL) {
 		return false;
 	}
 	
-	/* Search through status buffer */
-	for (i = 0; i < state->status_count; i++) {
-		int index = (state->status_head + i) % MAX_COMMANDS;
-		if (state->status_commands[index].timestamp == timestamp) {
-			*status_cmd = state->status_commands[index];
-			return true;
-		}
+	SpinLockAcquire(&state->status_mutex);
+	if (pgraft_find_command_status(state, cmd->command_id) < 0) {
+		index = pgraft_claim_command_status(state);
+		evicted_pending = (state->status_commands[index].command_id != 0 &&
+						   state->status_commands[index].status != COMMAND_STATUS_COMPLETED &&
+						   state->status_commands[index].status != COMMAND_STATUS_FAILED);
+		state->status_commands[index] = *cmd;
+		state->status_commands[index].status = COMMAND_STATUS_PENDING;
 	}
+	SpinLockRelease(&state->status_mutex);
+	
+	if (evicted_pending)
+		elog(WARNING, "pgraft: command status table is full, dropped the status of an unfinished command");
 	
-	return false;
+	return true;
 }
 
 /*
- * Update command status in status buffer
+ * Get command status by command id
  */
 bool
-pgraft_update_command_status(int64_t timestamp, COMMAND_STATUS status, const char *error_message)
+pgraft_get_command_status(uint64 command_id, pgraft_command_t *status_cmd)
 {
 	pgraft_worker_state_t *state;
-	int i;
+	int index;
 	
 	state = pgraft_worker_get_state();
 	if (state == NULL) {
 		return false;
 	}
 	
-	/* Search through status buffer */
-	for (i = 0; i < state->status_count; i++) {
-		int index = (state->status_head + i) % MAX_COMMANDS;
-		if (state->status_commands[index].timestamp == timestamp) {
-			state->status_commands[index].status = status;
-			if (error_message) {
-				strncpy(state->status_commands[index].error_message, error_message, 
-						sizeof(state->status_commands[index].error_message) - 1);
-				state->status_commands[index].error_message[sizeof(state->status_commands[index].error_message) - 1] = '\0';
-			}
-			return true;
-		}
-	}
+	SpinLockAcquire(&state->status_mutex);
+	index = pgraft_find_command_status(state, command_id);
+	if (index >= 0)
+		*status_cmd = state->status_commands[index];
+	SpinLockRelease(&state->status_mutex);
 	
-	return false;
+	return index >= 0;
 }
 
 /*
- * Remove completed commands from status buffer
+ * Update command status in status buffer
+ *
+ * Backends waiting on the outcome sleep on the cluster condition variable,
+ * so wake them once the status has been written.
  */
 bool
-pgraft_remove_completed_commands(void)
+pgraft_update_command_status(uint64 command_id, COMMAND_STATUS status, const char *error_message)
 {
 	pgraft_worker_state_t *state;
-	int removed = 0;
-	int i;
+	pgraft_cluster_t *cluster;
+	int index;
 	
 	state = pgraft_worker_get_state();
 	if (state == NULL) {
 		return false;
 	}
 	
-	/* Remove completed and failed commands from status buffer */
-	for (i = 0; i < state->status_count; i++) {
-		int index = (state->status_head + i) % MAX_COMMANDS;
-		COMMAND_STATUS status = state->status_commands[index].status;
-		
-		if (status == COMMAND_STATUS_COMPLETED || status == COMMAND_STATUS_FAILED) {
-			removed++;
-		} else {
-			/* Move command to front if we removed some */
-			if (removed > 0) {
-				int new_index = (state->status_head + i - removed) % MAX_COMMANDS;
-				state->status_commands[new_index] = state->status_commands[index];
-			}
-		}
+	SpinLockAcquire(&state->status_mutex);
+	index = pgraft_find_command_status(state, command_id);
+	if (index >= 0) {
+		state->status_commands[index].status = status;
+		if (error_message)
+			strlcpy(state->status_commands[index].error_message, error_message,
+					sizeof(state->status_commands[index].error_message));
 	}
+	SpinLockRelease(&state->status_mutex);
 	
-	/* Update status buffer pointers */
-	state->status_head = (state->status_head + removed) % MAX_COMMANDS;
-	state->status_count -= removed;
+	if (index < 0)
+		return false;
 	
-	if (removed > 0) {
-		elog(LOG, "pgraft: removed %d completed commands from status buffer", removed);
+	cluster = pgraft_core_get_shared_memory();
+	if (cluster)
+		ConditionVariableBroadcast(&cluster->leader_cv);
+	return true;
+}
+
+/*
+ * Drop a command's status once its waiter has seen the outcome
+ */
+void
+pgraft_forget_command_status(uint64 command_id)
+{
+	pgraft_worker_state_t *state;
+	int index;
+	
+	state = pgraft_worker_get_state();
+	if (state == NULL) {
+		return;
 	}
 	
-	return true;
+	SpinLockAcquire(&state->status_mutex);
+	index = pgraft_find_command_status(state, command_id);
+	if (index >= 0) {
+		state->status_commands[index].command_id = 0;
+		state->status_count--;
+	}
+	SpinLockRelease(&state->status_mutex);
 }
 
 /*